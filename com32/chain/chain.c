@@ -33,6 +33,7 @@
 #include <syslinux/bootrm.h>
 #include <syslinux/config.h>
 #include <syslinux/disk.h>
+#include <syslinux/probecache.h>
 #include <syslinux/video.h>
 #include "chain.h"
 #include "utility.h"
@@ -58,14 +59,77 @@ static int is_phys(uint8_t sdifs)
 }
 
 /*
- * Search for a specific drive, based on the MBR signature.
- * Return drive and iterator at 0th position.
+ * Index of every disk and GPT partition, for finding one by MBR
+ * signature, GPT GUID or GPT label.  It is built by one pass over all
+ * the disks and kept in the core's probe cache, so that later runs in
+ * the same session go straight to the right disk instead of walking
+ * every one of them again.  The index is only ever a hint: a hit is
+ * checked against the disk itself, and a miss or a stale entry means
+ * a fresh pass.
  */
-static int find_by_sig(uint32_t mbr_sig,
-			struct part_iter **_boot_part)
+struct part_index {
+    uint8_t drive;
+    bool gpt;
+    int index0;			/* -1 for the disk itself */
+    uint64_t abs_lba;
+    uint32_t disk_sig;		/* MBR disks only */
+    struct guid guid;		/* GPT only */
+    char label[PI_GPTLABSIZE/2+1];
+};
+
+enum find_by { FIND_SIG, FIND_GUID, FIND_LABEL };
+
+struct find_key {
+    enum find_by by;
+    uint32_t disk_sig;
+    const struct guid *guid;
+    const char *label;
+};
+
+static void index_entry(struct part_index *e, int drive,
+			const struct part_iter *iter)
 {
-    struct part_iter *iter = NULL;
+    memset(e, 0, sizeof *e);
+    e->drive = drive;
+    e->index0 = iter->index0;
+    e->abs_lba = iter->abs_lba;
+    if (iter->type == typegpt) {
+	e->gpt = true;
+	e->guid = iter->gpt.part_guid;
+	strcpy(e->label, iter->gpt.part_label);
+    } else {
+	e->disk_sig = iter->dos.disk_sig;
+    }
+}
+
+/*
+ * Same tests the lookups always made: a signature names an MBR disk,
+ * a GUID a GPT disk or partition, and a label a GPT partition.
+ */
+static bool index_match(const struct part_index *e, const struct find_key *key)
+{
+    switch (key->by) {
+    case FIND_SIG:
+	return !e->gpt && e->index0 < 0 && e->disk_sig == key->disk_sig;
+    case FIND_GUID:
+	return e->gpt && !memcmp(&e->guid, key->guid, sizeof *key->guid);
+    case FIND_LABEL:
+	return e->gpt && e->index0 >= 0 && !strcmp(key->label, e->label);
+    }
+    return false;
+}
+
+/*
+ * Walk all the disks once, returning what we find and its length.
+ * Only GPT disks are stepped through; an MBR disk is known by its
+ * signature alone, so its extended partition chain is never read.
+ */
+static struct part_index *build_index(size_t *_n)
+{
+    struct part_index *idx = NULL, *tmp;
+    struct part_iter *iter;
     struct disk_info diskinfo;
+    size_t n = 0, size = 0;
     int drive;
 
     for (drive = 0x80; drive < 0x80 + fixed_cnt; drive++) {
@@ -73,17 +137,107 @@ static int find_by_sig(uint32_t mbr_sig,
 	    continue;		/* Drive doesn't exist */
 	if (!(iter = pi_begin(&diskinfo, opt.piflags)))
 	    continue;
-	/* Check for a matching MBR disk */
-	if (iter->type == typedos && iter->dos.disk_sig == mbr_sig)
-	    goto ok;
+	do {
+	    if (n == size) {
+		size = size ? size * 2 : 16;
+		if (!(tmp = realloc(idx, size * sizeof *idx))) {
+		    pi_del(&iter);
+		    free(idx);
+		    return NULL;
+		}
+		idx = tmp;
+	    }
+	    index_entry(idx + n++, drive, iter);
+	} while (iter->type == typegpt && !pi_next(iter));
 	pi_del(&iter);
     }
-    drive = -1;
-ok:
-    *_boot_part = iter;
+
+    *_n = n;
+    return idx;
+}
+
+/*
+ * Open the disk an index entry names and step to the entry's partition.
+ * Return the iterator there if it still matches, NULL otherwise.
+ */
+static struct part_iter *index_open(const struct part_index *e,
+				    const struct find_key *key)
+{
+    struct part_iter *iter;
+    struct disk_info diskinfo;
+    struct part_index now;
+
+    if (disk_get_params(e->drive, &diskinfo))
+	return NULL;
+    if (!(iter = pi_begin(&diskinfo, opt.piflags)))
+	return NULL;
+    while (iter->index0 < e->index0)
+	if (pi_next(iter))
+	    goto bail;
+    index_entry(&now, e->drive, iter);
+    if (now.index0 == e->index0 && index_match(&now, key))
+	return iter;
+bail:
+    pi_del(&iter);
+    return NULL;
+}
+
+static int index_find(const struct part_index *idx, size_t n,
+		      const struct find_key *key,
+		      struct part_iter **_boot_part)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+	if (!index_match(idx + i, key))
+	    continue;
+	if ((*_boot_part = index_open(idx + i, key)))
+	    return idx[i].drive;
+    }
+    return -1;
+}
+
+/*
+ * Search for a drive/partition by key, trying the cached index first.
+ * Return drive and iterator at proper position.
+ */
+static int find_by_key(const struct find_key *key,
+		       struct part_iter **_boot_part)
+{
+    const struct part_index *cached;
+    struct part_index *idx;
+    size_t len, n;
+    int drive;
+
+    *_boot_part = NULL;
+
+    cached = probe_cache_get(PROBE_PART_INDEX, &len);
+    if (cached && !(len % sizeof *cached)) {
+	drive = index_find(cached, len / sizeof *cached, key, _boot_part);
+	if (drive >= 0)
+	    return drive;
+    }
+
+    if (!(idx = build_index(&n)))
+	return -1;
+    drive = index_find(idx, n, key, _boot_part);
+    probe_cache_put(PROBE_PART_INDEX, idx, n * sizeof *idx);
+    free(idx);
     return drive;
 }
 
+/*
+ * Search for a specific drive, based on the MBR signature.
+ * Return drive and iterator at 0th position.
+ */
+static int find_by_sig(uint32_t mbr_sig,
+			struct part_iter **_boot_part)
+{
+    struct find_key key = { .by = FIND_SIG, .disk_sig = mbr_sig };
+
+    return find_by_key(&key, _boot_part);
+}
+
 /*
  * Search for a specific drive/partition, based on the GPT GUID.
  * Return drive and iterator at proper position.
@@ -91,27 +245,9 @@ ok:
 static int find_by_guid(const struct guid *gpt_guid,
 			struct part_iter **_boot_part)
 {
-    struct part_iter *iter = NULL;
-    struct disk_info diskinfo;
-    int drive;
+    struct find_key key = { .by = FIND_GUID, .guid = gpt_guid };
 
-    for (drive = 0x80; drive < 0x80 + fixed_cnt; drive++) {
-	if (disk_get_params(drive, &diskinfo))
-	    continue;		/* Drive doesn't exist */
-	if (!(iter = pi_begin(&diskinfo, opt.piflags)))
-	    continue;
-	/* Check for a matching GPT disk/partition guid */
-	if (iter->type == typegpt)
-	    do {
-		if (!memcmp(&iter->gpt.part_guid, gpt_guid, sizeof *gpt_guid))
-		    goto ok;
-	    } while (!pi_next(iter));
-	pi_del(&iter);
-    }
-    drive = -1;
-ok:
-    *_boot_part = iter;
-    return drive;
+    return find_by_key(&key, _boot_part);
 }
 
 /*
@@ -120,27 +256,9 @@ ok:
  */
 static int find_by_label(const char *label, struct part_iter **_boot_part)
 {
-    struct part_iter *iter = NULL;
-    struct disk_info diskinfo;
-    int drive;
+    struct find_key key = { .by = FIND_LABEL, .label = label };
 
-    for (drive = 0x80; drive < 0x80 + fixed_cnt; drive++) {
-	if (disk_get_params(drive, &diskinfo))
-	    continue;		/* Drive doesn't exist */
-	if (!(iter = pi_begin(&diskinfo, opt.piflags)))
-	    continue;
-	/* Check for a matching GPT partition label */
-	if (iter->type == typegpt)
-	    while (!pi_next(iter)) {
-		if (!strcmp(label, iter->gpt.part_label))
-		    goto ok;
-	    }
-	pi_del(&iter);
-    }
-    drive = -1;
-ok:
-    *_boot_part = iter;
-    return drive;
+    return find_by_key(&key, _boot_part);
 }
 
 static void do_boot(struct data_area *data, int ndata)
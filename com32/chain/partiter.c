@@ -119,28 +119,37 @@ bail:
     return -1;
 }
 
-/* pi_gpt_ctor() - GPT iterator specific initialization */
+/*
+ * pi_gpt_ctor() - GPT iterator specific initialization
+ *
+ * The iterator takes over the partition list as read (and checksummed)
+ * by try_gpt_list(), rather than copying it.
+ */
 static int pi_gpt_ctor(struct part_iter *iter,
 	const struct disk_info *di, int flags,
-	const struct disk_gpt_header *gpth, const struct disk_gpt_part_entry *gptl
+	const struct disk_gpt_header *gpth, struct disk_gpt_part_entry **gptl
 )
 {
-    uint64_t siz;
+    const struct disk_gpt_part_entry *gp;
+    int i;
 
     if (pi_ctor(iter, di, flags))
 	return -1;
 
-    siz = (uint64_t)gpth->part_count * gpth->part_size;
-
-    if (!(iter->data = malloc((size_t)siz))) {
-	critm();
-	goto bail;
-    }
-
-    memcpy(iter->data, gptl, (size_t)siz);
+    iter->data = (char *)*gptl;
+    *gptl = NULL;
 
     iter->gpt.pe_count = (int)gpth->part_count;
     iter->gpt.pe_size = (int)gpth->part_size;
+
+    /* most of a typical 128 entry list is empty, find where it ends */
+    for (i = iter->gpt.pe_count; i > 0; i--) {
+	gp = (const struct disk_gpt_part_entry *)
+	    (iter->data + (i - 1) * iter->gpt.pe_size);
+	if (!guid_is0(&gp->type))
+	    break;
+    }
+    iter->gpt.pe_used = i;
     iter->gpt.ufirst = gpth->lba_first_usable;
     iter->gpt.ulast = gpth->lba_last_usable;
 
@@ -149,9 +158,6 @@ static int pi_gpt_ctor(struct part_iter *iter,
 
     iter->type = typegpt;
     return 0;
-bail:
-    pi_dtor_(iter);
-    return -1;
 }
 
 /* Logical partition must be sane, meaning:
@@ -485,11 +491,15 @@ static int pi_dos_next(struct part_iter *iter)
 static int pi_gpt_next(struct part_iter *iter)
 {
     const struct disk_gpt_part_entry *gpt_part = NULL;
+    int end;
 
     if (iter->status)
 	return iter->status;
 
-    while (++iter->index0 < iter->gpt.pe_count) {
+    /* past the last used entry, there are only holes left */
+    end = iter->flags & PIF_STEPALL ? iter->gpt.pe_count : iter->gpt.pe_used;
+
+    while (++iter->index0 < end) {
 	gpt_part = (const struct disk_gpt_part_entry *)
 	    (iter->data + iter->index0 * iter->gpt.pe_size);
 
@@ -502,7 +512,7 @@ static int pi_gpt_next(struct part_iter *iter)
 	    break;
     }
     /* no more partitions ? */
-    if (iter->index0 == iter->gpt.pe_count) {
+    if (iter->index0 >= end) {
 	iter->status = PI_DONE;
 	return iter->status;
     }
@@ -706,7 +716,7 @@ struct part_iter *pi_begin(const struct disk_info *di, int flags)
 	    goto out;
 
 	/* looks like GPT */
-	ret = pi_gpt_ctor(iter, di, flags, gpth, gptl);
+	ret = pi_gpt_ctor(iter, di, flags, gpth, &gptl);
     } else {
 	/* looks like MBR */
 	ret = pi_dos_ctor(iter, di, flags, mbr);
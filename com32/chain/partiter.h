@@ -89,6 +89,7 @@ struct part_iter {
 	    struct guid part_guid;
 	    char part_label[PI_GPTLABSIZE/2+1];
 	    int pe_count;
+	    int pe_used;	  /* entries up to and including the last non-empty one */
 	    int pe_size;
 	    uint64_t ufirst;
 	    uint64_t ulast;
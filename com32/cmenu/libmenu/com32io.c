@@ -11,6 +11,8 @@
  * ----------------------------------------------------------------------- */
 
 #include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
 #include <com32.h>
 #include "com32io.h"
 #include "tui.h"
@@ -76,3 +78,301 @@ unsigned char getcharat(char page)
     __intcall(0x16, &inreg, &outreg);
     return REG_AL(outreg);
 }
+
+/* Off-screen cell buffer */
+
+#define SCR_ALTCHARSET 0x01	// Cell comes from the SO (line drawing) set
+#define SCR_STALE      0x80	// Screen contents unknown, always redraw
+#define SCR_MAXGAP     4	// Rewrite this many unchanged cells rather than move
+
+typedef struct {
+    char ch;
+    char attr;
+    char flags;
+} t_scrcell;
+
+static struct {
+    t_scrcell *back;		// What we want on the screen
+    t_scrcell *front;		// What we believe is on the screen
+    int rows, cols;
+    int users;			// Nesting depth of scrbuf_begin()
+    int suspended;		// Nesting depth of scrsuspend()
+    int row, col;		// Drawing position in the back buffer
+    char charset;		// SCR_ALTCHARSET after SO, 0 after SI
+    int outlen;
+    char out[512];		// Escape sequences and text not yet written
+} scr;
+
+static inline int scr_direct(void)
+{
+    return !scr.back || scr.suspended;
+}
+
+static inline int scr_samecell(const t_scrcell * a, const t_scrcell * b)
+{
+    return a->ch == b->ch && a->attr == b->attr && a->flags == b->flags;
+}
+
+static void scr_drain(void)
+{
+    if (scr.outlen)
+	fwrite(scr.out, 1, scr.outlen, stdout);
+    scr.outlen = 0;
+}
+
+static void scr_emit(const char *str, int len)
+{
+    if (scr.outlen + len > (int)sizeof scr.out)
+	scr_drain();
+    memcpy(scr.out + scr.outlen, str, len);
+    scr.outlen += len;
+}
+
+// Same SGR mapping as cprint(), but always from a reset state
+static void scr_emitattr(char attr)
+{
+    static const char ansi_char[8] = "04261537";
+    char buf[16], *p = buf;
+
+    *p++ = '\033';
+    *p++ = '[';
+    *p++ = '0';
+    *p++ = ';';
+    if (attr & 0x08) {
+	*p++ = '1';
+	*p++ = ';';
+    }
+    if (attr & 0x80) {
+	*p++ = '4';
+	*p++ = ';';
+    }
+    *p++ = '3';
+    *p++ = ansi_char[attr & 7];
+    *p++ = ';';
+    *p++ = '4';
+    *p++ = ansi_char[(attr >> 4) & 7];
+    *p++ = 'm';
+    scr_emit(buf, p - buf);
+}
+
+// Fill the back buffer with blanks, as left by cls()
+static void scr_blank(void)
+{
+    int i;
+
+    for (i = 0; i < scr.rows * scr.cols; i++) {
+	scr.back[i].ch = ' ';
+	scr.back[i].attr = 0x07;
+	scr.back[i].flags = 0;
+    }
+}
+
+static void scr_putcell(char chr, char attr)
+{
+    t_scrcell *cell;
+
+    switch (chr) {
+    case SO:
+	scr.charset = SCR_ALTCHARSET;
+	return;
+    case SI:
+	scr.charset = 0;
+	return;
+    case '\b':
+	if (scr.col > 0)
+	    scr.col--;
+	return;
+    case '\r':
+	scr.col = 0;
+	return;
+    case '\n':
+	scr.row++;
+	return;
+    }
+    if (scr.row >= 0 && scr.row < scr.rows &&
+	scr.col >= 0 && scr.col < scr.cols) {
+	cell = &scr.back[scr.row * scr.cols + scr.col];
+	cell->ch = chr;
+	cell->attr = attr;
+	cell->flags = scr.charset;
+    }
+    scr.col++;
+}
+
+// Start drawing into an off-screen buffer the size of the screen.
+// Returns -1 (and keeps drawing straight to the console) if there is
+// no memory for it.
+int scrbuf_begin(void)
+{
+    int rows, cols;
+
+    if (scr.users++)
+	return 0;
+
+    if (getscreensize(1, &rows, &cols)) {
+	rows = 24;
+	cols = 80;
+    }
+    scr.back = malloc(2 * rows * cols * sizeof(t_scrcell));
+    if (!scr.back) {
+	scr.users--;
+	return -1;
+    }
+    scr.front = scr.back + rows * cols;
+    scr.rows = rows;
+    scr.cols = cols;
+    scr.row = scr.col = 0;
+    scr.charset = 0;
+    scr.outlen = 0;
+    scr.suspended = 0;
+    scr_blank();
+    scrinvalidate();
+    return 0;
+}
+
+// Stop buffering; anything drawn since the last scrflush() is dropped
+void scrbuf_end(void)
+{
+    if (!scr.users || --scr.users)
+	return;
+    free(scr.back);
+    scr.back = scr.front = NULL;
+}
+
+// Flush, then send drawing straight to the console until scrresume().
+// Use this around code which writes to the console by itself.
+void scrsuspend(void)
+{
+    scrflush();
+    scr.suspended++;
+}
+
+void scrresume(void)
+{
+    if (scr.suspended)
+	scr.suspended--;
+}
+
+// Forget what is on the screen, so the next flush redraws every cell
+void scrinvalidate(void)
+{
+    int i;
+
+    if (!scr.back)
+	return;
+    for (i = 0; i < scr.rows * scr.cols; i++)
+	scr.front[i].flags = SCR_STALE;
+}
+
+// Send the cells which differ from the screen, a run at a time
+void scrflush(void)
+{
+    t_scrcell *b, *f;
+    int r, c, j, end, gap;
+    int crow = -1, ccol = -1;	// Cursor position, if known
+    int attr = 0x100;		// Current attribute, 0x100 if not known
+    char charset = 0;
+    char buf[32];
+
+    if (scr_direct())
+	return;
+
+    for (r = 0; r < scr.rows; r++) {
+	b = scr.back + r * scr.cols;
+	f = scr.front + r * scr.cols;
+	c = 0;
+	while (c < scr.cols) {
+	    if (scr_samecell(&b[c], &f[c])) {
+		c++;
+		continue;
+	    }
+	    // Extend the run over short stretches of unchanged cells
+	    end = c + 1;
+	    gap = 0;
+	    for (j = end; j < scr.cols; j++) {
+		if (!scr_samecell(&b[j], &f[j])) {
+		    end = j + 1;
+		    gap = 0;
+		} else if (++gap > SCR_MAXGAP) {
+		    break;
+		}
+	    }
+	    if (r != crow || c != ccol)
+		scr_emit(buf, sprintf(buf, CSI "%d;%dH", r + 1, c + 1));
+	    for (; c < end; c++) {
+		if ((b[c].flags & SCR_ALTCHARSET) != charset) {
+		    charset = b[c].flags & SCR_ALTCHARSET;
+		    scr_emit(charset ? "\016" : "\017", 1);
+		}
+		if (b[c].attr != attr) {
+		    attr = b[c].attr;
+		    scr_emitattr(attr);
+		}
+		scr_emit(&b[c].ch, 1);
+		f[c] = b[c];
+	    }
+	    crow = r;
+	    ccol = end;
+	}
+    }
+    if (charset)
+	scr_emit("\017", 1);
+    scr_drain();
+
+    // We changed the attribute behind cprint()'s back; reset its cache
+    if (attr != 0x100)
+	cprint('0', '0', 1);
+}
+
+void scrgotoxy(char row, char col)
+{
+    if (scr_direct()) {
+	gotoxy(row, col);
+	return;
+    }
+    scr.row = row;
+    scr.col = col;
+}
+
+void scrprint(char chr, char attr, unsigned int times)
+{
+    if (scr_direct()) {
+	cprint(chr, attr, times);
+	return;
+    }
+    while (times--)
+	scr_putcell(chr, attr);
+}
+
+void scrsprint(const char *str, char attr)
+{
+    if (scr_direct()) {
+	csprint(str, attr);
+	return;
+    }
+    while (*str)
+	scr_putcell(*str++, attr);
+}
+
+void scrclearwindow(char top, char left, char bot, char right,
+		    char fillchar, char fillattr)
+{
+    char x;
+
+    for (x = top; x < bot + 1; x++) {
+	scrgotoxy(x, left);
+	scrprint(fillchar, fillattr, right - left + 1);
+    }
+}
+
+// Clear the screen; the next flush repaints all of it
+void scrcls(void)
+{
+    cls();
+    if (scr_direct())
+	return;
+    scr_blank();
+    scrinvalidate();
+    scr.row = scr.col = 0;
+    scr.charset = 0;
+}
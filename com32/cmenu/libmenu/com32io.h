@@ -63,4 +63,31 @@ static inline char getvideomode(void)	// Get the current video mode
     return readbiosb(0x449);
 }
 
+/* Off-screen cell buffer
+ *
+ * Between scrbuf_begin() and scrbuf_end() the scr* routines draw into a
+ * buffer, and scrflush() sends only the cells which changed, in runs,
+ * with as few cursor moves and attribute changes as it can.  Otherwise,
+ * or while suspended, they behave like gotoxy(), cprint() and friends.
+ */
+
+int scrbuf_begin(void);
+void scrbuf_end(void);
+void scrsuspend(void);		// Flush, then draw straight to the console
+void scrresume(void);
+void scrinvalidate(void);	// Screen was changed behind our back
+void scrflush(void);
+
+void scrgotoxy(char row, char col);
+void scrprint(char chr, char attr, unsigned int times);
+void scrsprint(const char *str, char attr);
+void scrclearwindow(char top, char left, char bot, char right,
+		    char fillchar, char fillattr);
+void scrcls(void);
+
+static inline void scrputch(char chr, char attr)
+{
+    scrprint(chr, attr, 1);
+}
+
 #endif
@@ -14,9 +14,11 @@
 #include "com32io.h"
 #include <stdlib.h>
 #include <console.h>
+#include <arena.h>
 
 // Local Variables
 static pt_menusystem ms;    // Pointer to the menusystem
+static struct arena *menu_arena;    // Everything the menusystem allocates
 char TITLESTR[] =
     "COMBOOT Menu System for SYSLINUX developed by Murali Krishnan Ganapathy";
 char TITLELONG[] = " TITLE too long ";
@@ -46,6 +48,9 @@ static int getch(void)
     int key;
     unsigned long i;
 
+    // Put what we have drawn on the screen before waiting
+    scrflush();
+
     // Wait until keypress if no handler specified
     if ((ms->ontimeout == NULL) && (ms->ontotaltimeout == NULL))
         return get_key(stdin, 0);
@@ -68,7 +73,9 @@ static int getch(void)
         }
         if (!th)
             continue;       // no handler
+        scrsuspend();
         key = th();
+        scrresume();
         switch (key) {
         case CODE_ENTER:    // Pretend user hit enter
             return KEY_ENTER;
@@ -118,15 +125,15 @@ static void reset_ui(void)
 {
     uchar tpos;
 
-    cls();
-    clearwindow(ms->minrow, ms->mincol, ms->maxrow, ms->maxcol,
+    scrcls();
+    scrclearwindow(ms->minrow, ms->mincol, ms->maxrow, ms->maxcol,
                 ms->fillchar, ms->fillattr);
 
     tpos = (ms->numcols - strlen(ms->title) - 1) >> 1;  // center it on line
-    gotoxy(ms->minrow, ms->mincol);
-    cprint(ms->tfillchar, ms->titleattr, ms->numcols);
-    gotoxy(ms->minrow, ms->mincol + tpos);
-    csprint(ms->title, ms->titleattr);
+    scrgotoxy(ms->minrow, ms->mincol);
+    scrprint(ms->tfillchar, ms->titleattr, ms->numcols);
+    scrgotoxy(ms->minrow, ms->mincol + tpos);
+    scrsprint(ms->title, ms->titleattr);
 
     cursoroff();
 }
@@ -151,7 +158,7 @@ void printmenuitem(const char *str, uchar * attr)
                 hlite = NOHLITE;
                 break;
             default:
-                putch(*str, attr[hlite]);
+                scrputch(*str, attr[hlite]);
         }
         str++;
     }
@@ -256,20 +263,20 @@ static void print_line(pt_menu menu, int curr, uchar top, uchar left,
     }
 
     // Wipe area with spaces
-    gotoxy(top + row, left - 2);
-    cprint(ms->spacechar, attr[NOHLITE], menuwidth + 2);
+    scrgotoxy(top + row, left - 2);
+    scrprint(ms->spacechar, attr[NOHLITE], menuwidth + 2);
 
     // Print first part
-    gotoxy(top + row, left - 2);
-    csprint(fchar, attr[NOHLITE]);
+    scrgotoxy(top + row, left - 2);
+    scrsprint(fchar, attr[NOHLITE]);
 
     // Print main part
-    gotoxy(top + row, left);
+    scrgotoxy(top + row, left);
     printmenuitem(str, attr);
 
     // Print last part
-    gotoxy(top + row, left + menuwidth - 1);
-    csprint(lchar, attr[NOHLITE]);
+    scrgotoxy(top + row, left + menuwidth - 1);
+    scrsprint(lchar, attr[NOHLITE]);
 }
 
 // print the menu starting from FIRST
@@ -285,14 +292,14 @@ static void printmenu(pt_menu menu, int curr, uchar top, uchar left, uchar first
     numitems = menu->menuheight;
 
     menuwidth = menu->menuwidth + 3;
-    clearwindow(top, left - 2, top + numitems + 1, left + menuwidth + 1,
+    scrclearwindow(top, left - 2, top + numitems + 1, left + menuwidth + 1,
         ms->fillchar, ms->shadowattr);
     drawbox(top - 1, left - 3, top + numitems, left + menuwidth,
         ms->normalattr[NOHLITE]);
 
     // Menu title
     x = (menuwidth - strlen(menu->title) - 1) >> 1;
-    gotoxy(top - 1, left + x);
+    scrgotoxy(top - 1, left + x);
     printmenuitem(menu->title, ms->normalattr);
 
     // All lines in the menu
@@ -313,32 +320,35 @@ static void printmenu(pt_menu menu, int curr, uchar top, uchar left, uchar first
     if (!isvisible(menu, first, x)) // There is more above
     {
     row = 1;
-    gotoxy(top, left + menuwidth);
-    cprint(MOREABOVE, ms->normalattr[NOHLITE], 1);
+    scrgotoxy(top, left + menuwidth);
+    scrprint(MOREABOVE, ms->normalattr[NOHLITE], 1);
     }
     x = prev_visible_sep(menu, menu->numitems); // last item
     if (!isvisible(menu, first, x)) // There is more above
     {
     row = 1;
-    gotoxy(top + numitems - 1, left + menuwidth);
-    cprint(MOREBELOW, ms->normalattr[NOHLITE], 1);
+    scrgotoxy(top + numitems - 1, left + menuwidth);
+    scrprint(MOREBELOW, ms->normalattr[NOHLITE], 1);
     }
     // Add a scroll box
     x = ((numitems - 1) * curr) / (menu->numitems);
     if ((x > 0) && (row == 1)) {
-    gotoxy(top + x, left + menuwidth);
-    csprint("\016\141\017", ms->normalattr[NOHLITE]);
+    scrgotoxy(top + x, left + menuwidth);
+    scrsprint("\016\141\017", ms->normalattr[NOHLITE]);
     }
-    if (ms->handler)
+    if (ms->handler) {
+    scrsuspend();
     ms->handler(ms, menu->items[curr]);
+    scrresume();
+    }
 }
 
 void cleanupmenu(pt_menu menu, uchar top, uchar left, int numitems)
 {
     if (numitems > menu->menuheight)
     numitems = menu->menuheight;
-    clearwindow(top, left - 2, top + numitems + 1, left + menu->menuwidth + 4, ms->fillchar, ms->fillattr); // Clear the shadow
-    clearwindow(top - 1, left - 3, top + numitems, left + menu->menuwidth + 3, ms->fillchar, ms->fillattr); // main window
+    scrclearwindow(top, left - 2, top + numitems + 1, left + menu->menuwidth + 4, ms->fillchar, ms->fillattr); // Clear the shadow
+    scrclearwindow(top - 1, left - 3, top + numitems, left + menu->menuwidth + 3, ms->fillchar, ms->fillattr); // main window
 }
 
 
@@ -355,16 +365,16 @@ static pt_menuitem getmenuoption(pt_menu menu, uchar top, uchar left, uchar star
 
     numitems = calc_visible(menu, 0);
     // Setup status line
-    gotoxy(ms->minrow + ms->statline, ms->mincol);
-    cprint(ms->spacechar, ms->statusattr[NOHLITE], ms->numcols);
+    scrgotoxy(ms->minrow + ms->statline, ms->mincol);
+    scrprint(ms->spacechar, ms->statusattr[NOHLITE], ms->numcols);
 
     // Initialise current menu item
     curr = next_visible(menu, startopt);
     prev = curr;
 
-    gotoxy(ms->minrow + ms->statline, ms->mincol);
-    cprint(ms->spacechar, ms->statusattr[NOHLITE], ms->numcols);
-    gotoxy(ms->minrow + ms->statline, ms->mincol);
+    scrgotoxy(ms->minrow + ms->statline, ms->mincol);
+    scrprint(ms->spacechar, ms->statusattr[NOHLITE], ms->numcols);
+    scrgotoxy(ms->minrow + ms->statline, ms->mincol);
     printmenuitem(menu->items[curr]->status, ms->statusattr);
     first = calc_first_early(menu, curr);
     prev_first = first;
@@ -437,9 +447,13 @@ static pt_menuitem getmenuoption(pt_menu menu, uchar top, uchar left, uchar star
         return ci;
         if (ci->handler != NULL)    // Do we have a handler
         {
+        scrsuspend();
         hr = ci->handler(ms, ci);
+        scrresume();
         if (hr.refresh) // Do we need to refresh
         {
+            // The handler may have drawn anywhere
+            scrinvalidate();
             // Cleanup menu using old number of items
             cleanupmenu(menu, top, left, numitems);
             // Recalculate the number of items
@@ -458,9 +472,13 @@ static pt_menuitem getmenuoption(pt_menu menu, uchar top, uchar left, uchar star
         ci->itemdata.checked = !ci->itemdata.checked;
         if (ci->handler != NULL)    // Do we have a handler
         {
+        scrsuspend();
         hr = ci->handler(ms, ci);
+        scrresume();
         if (hr.refresh) // Do we need to refresh
         {
+            // The handler may have drawn anywhere
+            scrinvalidate();
             // Cleanup menu using old number of items
             cleanupmenu(menu, top, left, numitems);
             // Recalculate the number of items
@@ -482,8 +500,11 @@ static pt_menuitem getmenuoption(pt_menu menu, uchar top, uchar left, uchar star
             first = calc_first_early(menu, tmp);
         curr = tmp;
         } else {
-        if (ms->keys_handler)   // Call extra keys handler
+        if (ms->keys_handler) {   // Call extra keys handler
+            scrsuspend();
             ms->keys_handler(ms, menu->items[curr], asc);
+            scrresume();
+        }
 
             /* The handler may have changed the UI, reset it on exit */
             reset_ui();
@@ -498,10 +519,10 @@ static pt_menuitem getmenuoption(pt_menu menu, uchar top, uchar left, uchar star
     }
     // Update status line
     /* Erase the previous status */
-    gotoxy(ms->minrow + ms->statline, ms->mincol);
-    cprint(ms->spacechar, ms->statusattr[NOHLITE], ms->numcols);
+    scrgotoxy(ms->minrow + ms->statline, ms->mincol);
+    scrprint(ms->spacechar, ms->statusattr[NOHLITE], ms->numcols);
     /* Print the new status */
-    gotoxy(ms->minrow + ms->statline, ms->mincol);
+    scrgotoxy(ms->minrow + ms->statline, ms->mincol);
     printmenuitem(menu->items[curr]->status, ms->statusattr);
     }
     return NULL;        // Should never come here
@@ -556,8 +577,8 @@ startover:
     // itemdata.submenunum = itemdata.radiomenunum (since enum data type)
     if (opt->itemdata.submenunum >= ms->nummenus)   // This is Bad....
     {
-    gotoxy(12, 12); // Middle of screen
-    csprint("ERROR: Invalid submenu requested.", 0x07);
+    scrgotoxy(12, 12); // Middle of screen
+    scrsprint("ERROR: Invalid submenu requested.", 0x07);
     cleanupmenu(cmenu, top, left, calc_visible(cmenu, 0));
     return NULL;        // Pretend user hit esc
     }
@@ -581,8 +602,11 @@ startover:
     if (opt->action == OPT_RADIOMENU) {
     if (choice != NULL)
         opt->data = (void *)choice; // store choice in data field
-    if (opt->handler != NULL)
+    if (opt->handler != NULL) {
+        scrsuspend();
         opt->handler(ms, opt);
+        scrresume();
+    }
     choice = NULL;      // Pretend user hit esc
     }
     if (choice == NULL)     // User hit Esc in submenu
@@ -647,6 +671,9 @@ pt_menuitem showmenus(uchar startmenu)
     /* Turn autowrap off, to avoid scrolling the menu */
     printf(CSI "?7l");
 
+    // Draw off-screen, and only send what changed
+    scrbuf_begin();
+
     // Setup screen for menusystem
     reset_ui();
 
@@ -654,6 +681,8 @@ pt_menuitem showmenus(uchar startmenu)
     rv = runmenusystem(ms->minrow + MENUROW, ms->mincol + MENUCOL,
                ms->menus[(unsigned int)startmenu], 0, NORMALMENU);
 
+    scrbuf_end();
+
     // Hide the garbage we left on the screen
     cls();
     gotoxy(ms->minrow, ms->mincol);
@@ -668,7 +697,11 @@ pt_menusystem init_menusystem(const char *title)
     int i;
 
     ms = NULL;
-    ms = (pt_menusystem) malloc(sizeof(t_menusystem));
+    if (menu_arena == NULL)
+    menu_arena = arena_create(0);
+    if (menu_arena == NULL)
+    return NULL;
+    ms = (pt_menusystem) arena_alloc(menu_arena, sizeof(t_menusystem));
     if (ms == NULL)
     return NULL;
     ms->nummenus = 0;
@@ -676,7 +709,7 @@ pt_menusystem init_menusystem(const char *title)
     for (i = 0; i < MAXMENUS; i++)
     ms->menus[i] = NULL;
 
-    ms->title = (char *)malloc(TITLELEN + 1);
+    ms->title = (char *)arena_alloc(menu_arena, TITLELEN + 1);
     if (title == NULL)
     strcpy(ms->title, TITLESTR);    // Copy string
     else
@@ -1021,7 +1054,7 @@ uchar add_menu(const char *title, int maxmenusize)
     if (num >= MAXMENUS)
     return -1;
     m = NULL;
-    m = (pt_menu) malloc(sizeof(t_menu));
+    m = (pt_menu) arena_alloc(menu_arena, sizeof(t_menu));
     if (m == NULL)
     return -1;
     ms->menus[num] = m;
@@ -1033,11 +1066,12 @@ uchar add_menu(const char *title, int maxmenusize)
     m->maxmenusize = MAXMENUSIZE;
     else
     m->maxmenusize = maxmenusize;
-    m->items = (pt_menuitem *) malloc(sizeof(pt_menuitem) * (m->maxmenusize));
+    m->items = (pt_menuitem *) arena_alloc(menu_arena,
+                       sizeof(pt_menuitem) * (m->maxmenusize));
     for (i = 0; i < m->maxmenusize; i++)
     m->items[i] = NULL;
 
-    m->title = (char *)malloc(MENULEN + 1);
+    m->title = (char *)arena_alloc(menu_arena, MENULEN + 1);
     if (title) {
     if (strlen(title) > MENULEN - 2)
         strcpy(m->title, TITLELONG);
@@ -1055,16 +1089,10 @@ void set_menu_name(const char *name)    // Set the "name" of this menu
     pt_menu m;
 
     m = ms->menus[ms->nummenus - 1];
-    if (m->name)        // Free up previous name
-    {
-    free(m->name);
-    m->name = NULL;
-    }
+    m->name = NULL;     // A previous name goes with the arena
 
-    if (name) {
-    m->name = (char *)malloc(strlen(name) + 1);
-    strcpy(m->name, name);
-    }
+    if (name)
+    m->name = arena_strdup(menu_arena, name);
 }
 
 // Create a new named menu and return its position
@@ -1091,7 +1119,7 @@ pt_menuitem add_sep(void)       // Add a separator to current menu
 
     m = (ms->menus[ms->nummenus - 1]);
     mi = NULL;
-    mi = (pt_menuitem) malloc(sizeof(t_menuitem));
+    mi = (pt_menuitem) arena_alloc(menu_arena, sizeof(t_menuitem));
     if (mi == NULL)
     return NULL;
     m->items[(unsigned int)m->numitems] = mi;
@@ -1116,16 +1144,16 @@ pt_menuitem add_item(const char *item, const char *status, t_action action,
 
     m = (ms->menus[ms->nummenus - 1]);
     mi = NULL;
-    mi = (pt_menuitem) malloc(sizeof(t_menuitem));
+    mi = (pt_menuitem) arena_alloc(menu_arena, sizeof(t_menuitem));
     if (mi == NULL)
     return NULL;
     m->items[(unsigned int)m->numitems] = mi;
     mi->handler = NULL;     // No handler
 
     // Allocate space to store stuff
-    mi->item = (char *)malloc(MENULEN + 1);
-    mi->status = (char *)malloc(STATLEN + 1);
-    mi->data = (char *)malloc(ACTIONLEN + 1);
+    mi->item = (char *)arena_alloc(menu_arena, MENULEN + 1);
+    mi->status = (char *)arena_alloc(menu_arena, STATLEN + 1);
+    mi->data = (char *)arena_alloc(menu_arena, ACTIONLEN + 1);
 
     if (item) {
     if (strlen(item) > MENULEN) {
@@ -1190,8 +1218,6 @@ pt_menuitem add_item(const char *item, const char *status, t_action action,
     break;
     case OPT_RADIOMENU:
     mi->itemdata.radiomenunum = itemdata;
-    if (mi->data)
-        free(mi->data);
     mi->data = NULL;    // No selection made
     break;
     default:            // to keep the compiler happy
@@ -1222,6 +1248,9 @@ void set_item_options(uchar shortcut, int helpid)
 // Free internal datasutructures
 void close_menusystem(void)
 {
+    arena_destroy(menu_arena);
+    menu_arena = NULL;
+    ms = NULL;
 }
 
 // append_line_helper(pt_menu menu,char *line)
@@ -213,25 +213,25 @@ void drawbox(const char top, const char left, const char bot,
 	     const char right, const char attr)
 {
     unsigned char x;
-	putchar(SO);
+    scrputch(SO, attr);
     // Top border
-    gotoxy(top, left);
-    putch(TOP_LEFT_CORNER_BORDER, attr);
-    cprint(TOP_BORDER, attr, right - left - 1);
-    putch(TOP_RIGHT_CORNER_BORDER, attr);
+    scrgotoxy(top, left);
+    scrputch(TOP_LEFT_CORNER_BORDER, attr);
+    scrprint(TOP_BORDER, attr, right - left - 1);
+    scrputch(TOP_RIGHT_CORNER_BORDER, attr);
     // Bottom border
-    gotoxy(bot, left);
-    putch(BOTTOM_LEFT_CORNER_BORDER, attr);
-    cprint(BOTTOM_BORDER, attr, right - left - 1);
-    putch(BOTTOM_RIGHT_CORNER_BORDER, attr);
+    scrgotoxy(bot, left);
+    scrputch(BOTTOM_LEFT_CORNER_BORDER, attr);
+    scrprint(BOTTOM_BORDER, attr, right - left - 1);
+    scrputch(BOTTOM_RIGHT_CORNER_BORDER, attr);
     // Left & right borders
     for (x = top + 1; x < bot; x++) {
-	gotoxy(x, left);
-	putch(LEFT_BORDER, attr);
-	gotoxy(x, right);
-	putch(RIGHT_BORDER, attr);
+	scrgotoxy(x, left);
+	scrputch(LEFT_BORDER, attr);
+	scrgotoxy(x, right);
+	scrputch(RIGHT_BORDER, attr);
     }
-	putchar(SI);
+    scrputch(SI, attr);
 }
 
 void drawhorizline(const char top, const char left, const char right,
@@ -245,14 +245,14 @@ void drawhorizline(const char top, const char left, const char right,
 	start = left;
 	end = right;
     }
-    gotoxy(top, start);
-	putchar(SO);
-    cprint(MIDDLE_BORDER, attr, end - start + 1);
+    scrgotoxy(top, start);
+    scrputch(SO, attr);
+    scrprint(MIDDLE_BORDER, attr, end - start + 1);
     if (dumb == 0) {
-	gotoxy(top, left);
-	putch(MIDDLE_BORDER, attr);
-	gotoxy(top, right);
-	putch(MIDDLE_BORDER, attr);
+	scrgotoxy(top, left);
+	scrputch(MIDDLE_BORDER, attr);
+	scrgotoxy(top, right);
+	scrputch(MIDDLE_BORDER, attr);
     }
-	putchar(SI);
+    scrputch(SI, attr);
 }
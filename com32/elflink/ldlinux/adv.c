@@ -35,8 +35,11 @@
 #include <syslinux/firmware.h>
 #include <klibc/compiler.h>
 #include <syslinux/adv.h>
+#include <com32.h>
+#include "config.h"
 
 void __constructor __syslinux_init(void)
 {
 	firmware->adv_ops->init();
+	adv_mark_clean();
 }
@@ -28,14 +28,60 @@
 /*
  * syslinux/advwrite.c
  *
- * Write back the ADV
+ * Write back the ADV.  Most boots write back exactly what they read
+ * (a menu saving the entry it was already set to, say), so keep a
+ * copy of what is on disk and don't write the same thing again.
  */
 
 #include <klibc/compiler.h>
+#include <stdlib.h>
+#include <string.h>
 #include <syslinux/adv.h>
 #include <syslinux/firmware.h>
+#include <com32.h>
+#include <fs.h>
+#include "config.h"
+
+/* The ADV contents as last read from, or written to, the disk */
+static void *adv_disk;
+
+void adv_mark_clean(void)
+{
+    if (!adv_disk)
+	adv_disk = malloc(syslinux_adv_size());
+    if (adv_disk)
+	memcpy(adv_disk, syslinux_adv_ptr(), syslinux_adv_size());
+}
 
 __export int syslinux_adv_write(void)
 {
-    return firmware->adv_ops->write();
+    int rv;
+
+    if (adv_disk &&
+	!memcmp(adv_disk, syslinux_adv_ptr(), syslinux_adv_size()))
+	return 0;
+
+    rv = firmware->adv_ops->write();
+    if (!rv)
+	adv_mark_clean();
+
+    return rv;
+}
+
+/*
+ * Keep the list of files this boot opened in the ADV, for the next
+ * boot to prefetch.  Called at the last moment before the boot, so it
+ * has everything; when the list is what it was last time, nothing is
+ * written.
+ */
+__export void syslinux_save_history(void)
+{
+    const char *list;
+    size_t len;
+
+    list = boot_history(&len);
+    if (!len || syslinux_setadv(ADV_BOOTHIST, len, list))
+	return;
+
+    syslinux_adv_write();
 }
@@ -0,0 +1,225 @@
+/*
+ * cfgcache.c - Precompiled configuration trees
+ *
+ * A configuration that INCLUDEs dozens of files costs an open and a
+ * read for each of them on every boot, which over TFTP adds up.
+ * utils/mkcfgcache flattens a configuration file together with
+ * everything it includes into a single cache file, stored next to it
+ * with CONFIG_CACHE_SUFFIX appended to its name.  "CACHE file" in a
+ * configuration parses that cache in place of "INCLUDE file"; nothing
+ * is looked up unless asked for.
+ *
+ * The cache lists the files it was built from with their sizes and
+ * content hashes.  On a filesystem with a local device, each of them
+ * is read back and must still hash the same (or still be missing).
+ * Neither mtimes nor ETags are visible through the com32 file layer,
+ * and reading every source over the network is what the cache is
+ * there to avoid, so on a network filesystem the cache is trusted as
+ * it stands: it is up to whoever edits the sources to run mkcfgcache.
+ * Whenever the cache can't be used, the sources are included as usual.
+ *
+ * The layout, all fields little endian:
+ *
+ *	struct config_cache_header
+ *	the sources, the configuration file itself first, each
+ *	    u32 size, u32 hash, u16 name length, the name
+ *	the flattened configuration
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dev.h>
+#include <com32.h>
+#include <sys/stat.h>
+#include <dprintf.h>
+#include <fs.h>
+
+#include "config.h"
+
+#define CONFIG_CACHE_MAGIC	"SYSLXCFC"
+#define CONFIG_CACHE_VERSION	1
+#define CONFIG_CACHE_ABSENT	0xffffffff	/* The source didn't exist */
+
+struct config_cache_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t sources;		/* Number of sources */
+    uint32_t size;		/* Of the flattened configuration */
+    uint32_t hash;		/* Of the flattened configuration */
+};
+
+#define CONFIG_CACHE_HASH_INIT	2166136261u
+
+/* FNV-1a, as computed by mkcfgcache */
+static uint32_t config_cache_hash(uint32_t hash, const char *data, size_t len)
+{
+    while (len--) {
+	hash ^= (unsigned char)*data++;
+	hash *= 16777619;
+    }
+
+    return hash;
+}
+
+/* The size of an open file, or CONFIG_CACHE_ABSENT if it isn't known */
+static uint32_t config_cache_fsize(int fd)
+{
+    struct stat st;
+
+    if (fstat(fd, &st) || !S_ISREG(st.st_mode))
+	return CONFIG_CACHE_ABSENT;
+
+    return st.st_size;
+}
+
+/*
+ * Read a source back and check it against its recorded size and hash.
+ * A source recorded as absent must still not exist.
+ */
+static bool config_cache_same(const char *name, uint32_t size, uint32_t hash)
+{
+    char buf[512];
+    uint32_t now = CONFIG_CACHE_HASH_INIT;
+    size_t len = 0;
+    ssize_t rv;
+    int fd;
+
+    fd = open(name, O_RDONLY);
+    if (fd < 0)
+	return size == CONFIG_CACHE_ABSENT;
+
+    while ((rv = read(fd, buf, sizeof buf)) > 0) {
+	now = config_cache_hash(now, buf, rv);
+	len += rv;
+    }
+
+    close(fd);
+    return !rv && len == size && now == hash;
+}
+
+static char *config_cache_read(const char *name, size_t *size)
+{
+    char *data;
+    size_t len, done;
+    ssize_t rv;
+    int fd;
+
+    fd = open(name, O_RDONLY);
+    if (fd < 0)
+	return NULL;
+
+    len = config_cache_fsize(fd);
+    if (len == CONFIG_CACHE_ABSENT || len < sizeof(struct config_cache_header))
+	goto bail;
+
+    data = malloc(len);
+    if (!data)
+	goto bail;
+
+    for (done = 0; done < len; done += rv) {
+	rv = read(fd, data + done, len - done);
+	if (rv <= 0) {
+	    free(data);
+	    goto bail;
+	}
+    }
+
+    close(fd);
+    *size = len;
+    return data;
+
+bail:
+    close(fd);
+    return NULL;
+}
+
+/*
+ * Check that the cache is whole and, if "verify", that the sources
+ * are as they were when it was built.  Returns the offset of the
+ * flattened configuration, or 0.
+ */
+static size_t config_cache_check(const char *data, size_t len, bool verify)
+{
+    const struct config_cache_header *hdr = (const void *)data;
+    char name[FILENAME_MAX];
+    size_t off = sizeof *hdr;
+    uint32_t i, size, hash;
+    uint16_t namelen;
+
+    if (memcmp(hdr->magic, CONFIG_CACHE_MAGIC, sizeof hdr->magic) ||
+	hdr->version != CONFIG_CACHE_VERSION || !hdr->sources)
+	return 0;
+
+    for (i = 0; i < hdr->sources; i++) {
+	if (len - off < 10)
+	    return 0;
+
+	memcpy(&size, data + off, 4);
+	memcpy(&hash, data + off + 4, 4);
+	memcpy(&namelen, data + off + 8, 2);
+	off += 10;
+
+	if (len - off < namelen || namelen >= sizeof name)
+	    return 0;
+
+	memcpy(name, data + off, namelen);
+	name[namelen] = '\0';
+	off += namelen;
+
+	if (verify && !config_cache_same(name, size, hash)) {
+	    dprintf("config cache: %s has changed\n", name);
+	    return 0;
+	}
+    }
+
+    if (len - off != hdr->size ||
+	config_cache_hash(CONFIG_CACHE_HASH_INIT, data + off, hdr->size) !=
+	hdr->hash)
+	return 0;
+
+    return off;
+}
+
+/*
+ * Open the cache for the configuration file "name", if there is one
+ * and it is up to date.  Returns a file
+ * descriptor for the flattened configuration, which lives in *buf
+ * until that is freed, or -1 if the sources have to be parsed.
+ */
+int config_cache_open(const char *name, void **buf)
+{
+    char path[FILENAME_MAX];
+    char *data;
+    size_t len, off;
+    int fd;
+
+    if (snprintf(path, sizeof path, "%s%s", name, CONFIG_CACHE_SUFFIX) >=
+	(int)sizeof path)
+	return -1;
+
+    data = config_cache_read(path, &len);
+    if (!data)
+	return -1;
+
+    off = config_cache_check(data, len,
+			     !(this_fs->fs_ops->fs_flags & FS_NODEV));
+    if (!off)
+	goto bail;
+
+    fd = openmem(data + off, len - off, O_RDONLY);
+    if (fd < 0)
+	goto bail;
+
+    dprintf("config cache: using %s\n", path);
+    *buf = data;
+    return fd;
+
+bail:
+    free(data);
+    return -1;
+}
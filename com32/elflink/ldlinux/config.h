@@ -19,6 +19,9 @@
 #define LEVEL_DEFAULT	1
 #define LEVEL_UI	2
 
+/* Appended to a CACHE file name to find the cache itself */
+#define CONFIG_CACHE_SUFFIX	".cache"
+
 extern short uappendlen;	//bytes in append= command
 extern short ontimeoutlen;	//bytes in ontimeout command
 extern short onerrorlen;	//bytes in onerror command
@@ -49,4 +52,8 @@ extern void ldlinux_enter_command(void);
 extern void ldlinux_console_init(void);
 extern const char *apply_extension(const char *kernel, const char *ext);
 
+extern int config_cache_open(const char *name, void **buf);
+
+extern void adv_mark_clean(void);
+
 #endif /* __CONFIG_H__ */
@@ -83,11 +83,19 @@ __export void execute(const char *cmdline, uint32_t type, bool sysappend)
 	} while (ch);
 
 	if (sysappend) {
+		size_t salen;
+		const char *sa = sysappend_line(&salen);
+
 		/* If we've seen some args, insert a space */
-		if (--q != args)
+		if (--q != args && salen)
 			*q++ = ' ';
 
-		do_sysappend(q);
+		if (q + salen >= kernel + MAX_CMDLINE_LEN) {
+			printf("cmdline too long\n");
+			free((void *)kernel);
+			return;
+		}
+		memcpy(q, sa, salen + 1);
 	}
 
 	dprintf("kernel is %s, args = %s  type = %d \n", kernel, args, type);
@@ -162,8 +170,14 @@ __export void execute(const char *cmdline, uint32_t type, bool sysappend)
 		local_boot(strtoul(kernel, NULL, 0));
 	} else if (type == IMAGE_TYPE_PXE || type == IMAGE_TYPE_BSS ||
 		   type == IMAGE_TYPE_BOOT) {
+		module_cache_flush();
+		module_bundle_release();
 		chainboot_file(kernel, type);
 	} else {
+		/* The memory is better spent on the kernel and initrd */
+		module_cache_flush();
+		module_bundle_release();
+
 		/* Need add one item for kernel load, as we don't use
 		* the assembly runkernel.inc any more */
 		new_linux_kernel((char *)kernel, (char *)args);
@@ -2,16 +2,85 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <console.h>
 #include <dprintf.h>
 #include <syslinux/loadfile.h>
 #include <syslinux/linux.h>
 #include <syslinux/pxe.h>
+#include <syslinux/boottime.h>
+#include <fs.h>
 #include "core.h"
 
 const char *globaldefault = NULL;
 const char *append = NULL;
 
+/*
+ * Total size of the comma-separated initrd list, each file aligned the
+ * way initramfs_load_archive() puts it; 0 if any size is unknown.
+ */
+static size_t initrd_list_size(const char *list)
+{
+	struct stat st;
+	size_t total = 0, n;
+	char *name;
+	int fd;
+
+	for (;;) {
+		n = strcspn(list, " ,");
+		if (!n || !(name = strndup(list, n)))
+			return 0;
+
+		fd = open(name, O_RDONLY);
+		free(name);
+		if (fd < 0)
+			return 0;
+		if (fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+			close(fd);
+			return 0;
+		}
+		close(fd);
+
+		total = ((total + 3) & ~3) + st.st_size;
+
+		list += n;
+		if (*list != ',')
+			return total;
+		list++;
+	}
+}
+
+/*
+ * Let the filesystem know about the kernel and every initrd up front;
+ * one that can fetches them all at once while we read them in order.
+ */
+static void prefetch_kernel_files(const char *kernel_name, const char *cmdline)
+{
+	const char *list = strstr(cmdline, "initrd=");
+	char *name;
+	size_t n;
+
+	prefetch_file(kernel_name);
+	if (!list)
+		return;
+
+	list += 7;
+	for (;;) {
+		n = strcspn(list, " ,");
+		if (n && (name = strndup(list, n))) {
+			prefetch_file(name);
+			free(name);
+		}
+
+		list += n;
+		if (*list != ',')
+			return;
+		list++;
+	}
+}
+
 /* Will be called from readconfig.c */
 int new_linux_kernel(char *okernel, char *ocmdline)
 {
@@ -19,6 +88,7 @@ int new_linux_kernel(char *okernel, char *ocmdline)
 	struct initramfs *initramfs = NULL;
 	char *temp;
 	void *kernel_data;
+	size_t initrd_max, initrd_size;
 	size_t kernel_len, cmdline_len;
 	bool opt_quiet = false;
 	char *initrd_name, *cmdline;
@@ -51,15 +121,19 @@ int new_linux_kernel(char *okernel, char *ocmdline)
 	if (strstr(cmdline, "quiet"))
 		opt_quiet = true;
 
+	prefetch_kernel_files(kernel_name, cmdline);
+
 	if (!opt_quiet)
 		printf("Loading %s... ", kernel_name);
 
+	boot_time_stamp(BOOT_PHASE_KERNEL_LOAD);
 	if (loadfile(kernel_name, &kernel_data, &kernel_len)) {
 		if (opt_quiet)
 			printf("Loading %s ", kernel_name);
 		printf("failed: ");
 		goto bail;
 	}
+	boot_time_stamp(BOOT_PHASE_KERNEL_LOADED);
 
 	if (!opt_quiet)
 		printf("ok\n");
@@ -67,11 +141,26 @@ int new_linux_kernel(char *okernel, char *ocmdline)
 	/* Find and load initramfs */
 	temp = strstr(cmdline, "initrd=");
 	if (temp) {
+		boot_time_stamp(BOOT_PHASE_INITRD_LOAD);
+
 		/* Initialize the initramfs chain */
 		initramfs = initramfs_init();
 		if (!initramfs)
 			goto bail;
 
+		/*
+		 * Read the initrds straight into the place the kernel
+		 * gets them at, if there is room there
+		 */
+		initrd_max = syslinux_linux_initrd_max(kernel_data, kernel_len,
+						       cmdline);
+		if (initrd_max) {
+			initrd_size = initrd_list_size(temp + 7);
+			if (initrd_size)
+				initramfs_reserve(initramfs, initrd_size,
+						  initrd_max);
+		}
+
 		temp += 6; /* strlen("initrd") */
 		do {
 		    size_t n = 0;
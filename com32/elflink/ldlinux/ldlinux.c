@@ -13,6 +13,7 @@
 #include "syslinux/adv.h"
 #include "syslinux/boot.h"
 #include "syslinux/config.h"
+#include "syslinux/boottime.h"
 
 #include <sys/module.h>
 
@@ -149,6 +150,8 @@ __export void load_kernel(const char *command_line)
 	const char *kernel;
 	uint32_t type;
 
+	boot_time_stamp(BOOT_PHASE_SELECT);
+
 	kernel = strdup(command_line);
 	if (!kernel)
 		goto bad_kernel;
@@ -264,6 +267,7 @@ static void enter_cmdline(void)
 			continue;
 		}
 
+		boot_time_stamp(BOOT_PHASE_MENU);
 		cmdline = edit_cmdline("boot:", 1, NULL, cat_help_file, &to);
 		printf("\n");
 
@@ -299,6 +303,29 @@ void ldlinux_console_init(void)
 	openconsole(&dev_stdcon_r, &dev_ansiserial_w);
 }
 
+/*
+ * Hand the files the last boot opened to prefetch_file(), in the order
+ * it opened them; see syslinux_save_history().
+ */
+static void prefetch_history(void)
+{
+	char list[256], *p, *end;
+	const void *adv;
+	size_t len;
+
+	adv = syslinux_getadv(ADV_BOOTHIST, &len);
+	if (!adv || !len)
+		return;
+
+	memcpy(list, adv, len);
+	list[len] = '\0';
+
+	for (p = list, end = list + len; p < end; p += strlen(p) + 1) {
+		if (*p)
+			prefetch_file(p);
+	}
+}
+
 __export int main(int argc __unused, char **argv)
 {
 	const void *adv;
@@ -308,7 +335,9 @@ __export int main(int argc __unused, char **argv)
 
 	ldlinux_console_init();
 
+	prefetch_history();
 	parse_configs(&argv[1]);
+	boot_time_stamp(BOOT_PHASE_CONFIG_PARSED);
 
 	__syslinux_set_serial_console_info();
 
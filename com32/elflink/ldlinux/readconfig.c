@@ -21,6 +21,7 @@
 #include <alloca.h>
 #include <inttypes.h>
 #include <colortbl.h>
+#include <arena.h>
 #include <com32.h>
 #include <syslinux/adv.h>
 #include <syslinux/config.h>
@@ -30,8 +31,11 @@
 #include <core.h>
 #include <fs.h>
 #include <syslinux/pxe_api.h>
+#include <syslinux/trace.h>
+#include <sys/module.h>
 
 #include "menu.h"
+#include "kwdhash.h"
 #include "config.h"
 #include "getkey.h"
 #include "core.h"
@@ -82,6 +86,7 @@ short includelevel = 1;		//nesting level
 short defaultlevel = 0;		//the current level of default
 short vkernel = 0;		//have we seen any "label" statements?
 extern short NoHalt;		//idle.c
+extern uint16_t FsVerify;	//fs.c
 
 const char *onerror = NULL;	//"onerror" command line
 const char *ontimeout = NULL;	//"ontimeout" command line
@@ -94,6 +99,9 @@ const char *empty_string;
 /* Root menu, starting menu, hidden menu, and list of all menus */
 struct menu *root_menu, *start_menu, *hide_menu, *menu_list, *default_menu;
 
+/* Menus and their entries, dropped all at once on a new parse_configs() */
+static struct arena *config_arena;
+
 /* These are global parameters regardless of which menu we're displaying */
 int shiftkey = 0;		/* Only display menu if shift key pressed */
 int hiddenmenu = 0;
@@ -109,6 +117,112 @@ static bool menusave = false;	/* True if there is any "menu save" */
 static struct menu_entry *all_entries;
 static struct menu_entry **all_entries_end = &all_entries;
 
+/*
+ * Hash index of the labels in all_entries, so that resolving a label
+ * doesn't scan every entry.  Only the first entry with a given label
+ * is indexed, which is the one a scan of all_entries would find.
+ */
+static struct menu_entry **label_hash;
+static unsigned int label_hash_size;	/* Power of 2 */
+static unsigned int label_hash_count;
+static bool label_hash_failed;	/* Out of memory, scan all_entries */
+
+static unsigned int label_hash_fn(const char *str, int len)
+{
+    unsigned int hash = 2166136261u;
+
+    while (len--) {
+	hash ^= (unsigned char)*str++;
+	hash *= 16777619;
+    }
+
+    return hash;
+}
+
+static struct menu_entry *label_lookup(const char *str, int len)
+{
+    struct menu_entry *me;
+
+    if (label_hash_failed) {
+	for (me = all_entries; me; me = me->next) {
+	    if (me->label && !strncmp(str, me->label, len) && !me->label[len])
+		return me;
+	}
+	return NULL;
+    }
+
+    if (!label_hash_size)
+	return NULL;
+
+    me = label_hash[label_hash_fn(str, len) & (label_hash_size - 1)];
+    for (; me; me = me->label_next) {
+	if (!strncmp(str, me->label, len) && !me->label[len])
+	    return me;
+    }
+
+    return NULL;
+}
+
+static void label_index(struct menu_entry *me)
+{
+    struct menu_entry **buckets, *e, *next;
+    unsigned int i, b, size, len = strlen(me->label);
+
+    if (label_hash_failed || label_lookup(me->label, len))
+	return;			/* The first one wins */
+
+    if (label_hash_count >= label_hash_size) {
+	size = label_hash_size ? label_hash_size << 1 : 256;
+	buckets = arena_zalloc(config_arena, size * sizeof *buckets);
+	if (!buckets) {
+	    if (!label_hash_size) {
+		label_hash_failed = true;
+		return;
+	    }
+	    goto insert;	/* Keep using the old table */
+	}
+
+	for (i = 0; i < label_hash_size; i++) {
+	    for (e = label_hash[i]; e; e = next) {
+		next = e->label_next;
+		b = label_hash_fn(e->label, strlen(e->label)) & (size - 1);
+		e->label_next = buckets[b];
+		buckets[b] = e;
+	    }
+	}
+
+	label_hash = buckets;
+	label_hash_size = size;
+    }
+
+insert:
+    i = label_hash_fn(me->label, len) & (label_hash_size - 1);
+    me->label_next = label_hash[i];
+    label_hash[i] = me;
+    label_hash_count++;
+}
+
+/*
+ * Submenus from MENU LAZYINCLUDE, whose files are only read when a
+ * label or menu can't be found in what has been read so far.
+ */
+static int lazy_menus;		/* Number not read yet */
+
+static void load_lazy_menus(void);
+
+/* As label_lookup(), reading lazily included submenus if need be */
+static struct menu_entry *label_lookup_all(const char *str, int len)
+{
+    struct menu_entry *me;
+
+    for (;;) {
+	me = label_lookup(str, len);
+	if (me || !lazy_menus)
+	    return me;
+	load_lazy_menus();
+    }
+}
+
 static const struct messages messages[MSG_COUNT] = {
     [MSG_AUTOBOOT] = {"autoboot", "Automatic boot in # second{,s}..."},
     [MSG_TAB] = {"tabmsg", "Press [Tab] to edit options"},
@@ -129,12 +243,16 @@ static struct menu *find_menu(const char *label)
 {
     struct menu *m;
 
-    for (m = menu_list; m; m = m->next) {
-	if (!strcmp(label, m->label))
-	    return m;
-    }
+    for (;;) {
+	for (m = menu_list; m; m = m->next) {
+	    if (!strcmp(label, m->label))
+		return m;
+	}
 
-    return NULL;
+	if (!lazy_menus)
+	    return NULL;
+	load_lazy_menus();
+    }
 }
 
 #define MAX_LINE 4096
@@ -187,10 +305,31 @@ static char *looking_at(char *line, const char *kwd)
     return my_isspace(*p) ? p : NULL;	/* Must be EOL or whitespace */
 }
 
+/*
+ * Which keyword the line starts with, in one lookup of the table that
+ * genhash.pl makes of the keywords file, and where it ends.  KWD_NONE
+ * if it doesn't start with one.
+ */
+static enum keyword keyword(char *line, char **end)
+{
+    const struct keyword_slot *k;
+    uint32_t h = 0;
+    char *p;
+
+    for (p = line; !my_isspace(*p); p++)
+	h = ((h << 5) | (h >> 27)) ^ ((uint8_t)*p | 0x20);
+
+    k = &kwd_hash[(uint32_t)(h * KWD_HASH_MULT) >> (32 - KWD_HASH_BITS)];
+    if (!k->name || !(*end = looking_at(line, k->name)))
+	return KWD_NONE;
+
+    return k->kwd;
+}
+
 static struct menu *new_menu(struct menu *parent,
 			     struct menu_entry *parent_entry, const char *label)
 {
-    struct menu *m = calloc(1, sizeof(struct menu));
+    struct menu *m = arena_zalloc(config_arena, sizeof(struct menu));
     int i;
 	
 	//dprintf("enter: menu_label = %s", label);
@@ -285,16 +424,19 @@ static struct menu_entry *new_entry(struct menu *m)
     //dprintf("enter, call from menu %s", m->label);
 
     if (m->nentries >= m->nentries_space) {
+	size_t oldsize = m->nentries_space * sizeof(struct menu_entry *);
+
 	if (!m->nentries_space)
 	    m->nentries_space = 1;
 	else
 	    m->nentries_space <<= 1;
 
-	m->menu_entries = realloc(m->menu_entries, m->nentries_space *
-				  sizeof(struct menu_entry *));
+	m->menu_entries = arena_realloc(config_arena, m->menu_entries, oldsize,
+					m->nentries_space *
+					sizeof(struct menu_entry *));
     }
 
-    me = calloc(1, sizeof(struct menu_entry));
+    me = arena_zalloc(config_arena, sizeof(struct menu_entry));
     me->menu = m;
     me->entry = m->nentries;
     m->menu_entries[m->nentries++] = me;
@@ -393,6 +535,9 @@ static void record(struct menu *m, struct labeldata *ld, const char *append)
 	    me->passwd = NULL;
 	}
 
+	if (me->label)
+	    label_index(me);
+
 	if (ld->menulabel)
 	    consider_for_hotkey(m, me);
 
@@ -485,7 +630,6 @@ void print_labels(const char *prefix, size_t len)
 struct menu_entry *find_label(const char *str)
 {
     const char *p;
-    struct menu_entry *me;
     int pos;
 
     p = str;
@@ -495,12 +639,7 @@ struct menu_entry *find_label(const char *str)
     /* p now points to the first byte beyond the kernel name */
     pos = p - str;
 
-    for (me = all_entries; me; me = me->next) {
-	if (!strncmp(str, me->label, pos) && !me->label[pos])
-	    return me;
-    }
-
-    return NULL;
+    return label_lookup_all(str, pos);
 }
 
 static const char *unlabel(const char *str)
@@ -518,13 +657,12 @@ static const char *unlabel(const char *str)
     /* p now points to the first byte beyond the kernel name */
     pos = p - str;
 
-    for (me = all_entries; me; me = me->next) {
-	if (!strncmp(str, me->label, pos) && !me->label[pos]) {
-	    /* Found matching label */
-	    rsprintf(&q, "%s%s", me->cmdline, p);
-	    refstr_put(str);
-	    return q;
-	}
+    me = label_lookup_all(str, pos);
+    if (me) {
+	/* Found matching label */
+	rsprintf(&q, "%s%s", me->cmdline, p);
+	refstr_put(str);
+	return q;
     }
 
     return str;
@@ -850,6 +988,30 @@ put:
 
 }
 
+static void do_lazy_include(char *str, struct menu *m)
+{
+    const char *file;
+    char *p;
+
+    p = skipspace(str);
+    file = refdup_word(&p);
+    p = skipspace(p);
+
+    if (!*p) {
+	/* Not a submenu, so nothing to put off */
+	refstr_put(file);
+	do_include_menu(str, m);
+	return;
+    }
+
+    record(m, &ld, append);
+    m = current_menu = begin_submenu(p);
+    m->lazy_file = file;
+    m->lazy_append = refstr_get(append);
+    lazy_menus++;
+    current_menu = end_submenu();
+}
+
 static void do_include(char *str)
 {
     const char *file;
@@ -873,12 +1035,41 @@ put:
     refstr_put(file);
 }
 
+static void do_include_cache(char *str)
+{
+    const char *file;
+    void *cache = NULL;
+    char *p;
+    FILE *f;
+    int fd;
+
+    p = skipspace(str);
+    file = refdup_word(&p);
+
+    fd = config_cache_open(file, &cache);
+    if (fd < 0) {
+	/* No usable cache, parse the sources instead */
+	refstr_put(file);
+	do_include(str);
+	return;
+    }
+
+    f = fdopen(fd, "r");
+    if (f)
+	parse_config_file(f);
+
+    close(fd);
+    free(cache);
+    refstr_put(file);
+}
+
 static void parse_config_file(FILE * f)
 {
     char line[MAX_LINE], *p, *ep, ch;
     enum kernel_type type;
     enum message_number msgnr;
     int fkeyno;
+    enum keyword kwd;
     struct menu *m = current_menu;
 
     while (fgets(line, sizeof line, f)) {
@@ -890,12 +1081,14 @@ static void parse_config_file(FILE * f)
 	    *p = '\0';
 
 	p = skipspace(line);
+	kwd = keyword(p, &ep);
 
-	if (looking_at(p, "menu")) {
+	if (kwd == KWD_MENU) {
 
 	    p = skipspace(p + 4);
+	    kwd = keyword(p, &ep);
 
-	    if (looking_at(p, "label")) {
+	    if (kwd == KWD_LABEL) {
 			if (ld.label) {
 				refstr_put(ld.menulabel);
 				ld.menulabel = refstrdup(skipspace(p + 5));
@@ -909,7 +1102,7 @@ static void parse_config_file(FILE * f)
 				m->title = strip_caret(m->parent_entry->displayname);
 				}
 			}
-			} else if (looking_at(p, "title")) {
+			} else if (kwd == KWD_TITLE) {
 			refstr_put(m->title);
 			m->title = refstrdup(skipspace(p + 5));
 			if (m->parent_entry) {
@@ -919,15 +1112,15 @@ static void parse_config_file(FILE * f)
 				m->parent_entry->displayname = refstr_get(m->title);
 				}
 			}
-	    } else if (looking_at(p, "default")) {
+	    } else if (kwd == KWD_DEFAULT) {
 		if (ld.label) {
 		    ld.menudefault = 1;
 		} else if (m->parent_entry) {
 		    m->parent->defentry = m->parent_entry->entry;
 		}
-	    } else if (looking_at(p, "hide")) {
+	    } else if (kwd == KWD_HIDE) {
 		ld.menuhide = 1;
-	    } else if (looking_at(p, "passwd")) {
+	    } else if (kwd == KWD_PASSWD) {
 		if (ld.label) {
 		    refstr_put(ld.passwd);
 		    ld.passwd = refstrdup(skipspace(p + 6));
@@ -935,44 +1128,46 @@ static void parse_config_file(FILE * f)
 		    refstr_put(m->parent_entry->passwd);
 		    m->parent_entry->passwd = refstrdup(skipspace(p + 6));
 		}
-	    } else if (looking_at(p, "shiftkey")) {
+	    } else if (kwd == KWD_SHIFTKEY) {
 		shiftkey = 1;
-	    } else if (looking_at(p, "save")) {
+	    } else if (kwd == KWD_SAVE) {
 		menusave = true;
 		if (ld.label)
 		    ld.save = 1;
 		else
 		    m->save = true;
-	    } else if (looking_at(p, "nosave")) {
+	    } else if (kwd == KWD_NOSAVE) {
 		if (ld.label)
 		    ld.save = -1;
 		else
 		    m->save = false;
-	    } else if (looking_at(p, "onerror")) {
+	    } else if (kwd == KWD_ONERROR) {
 		refstr_put(m->onerror);
 		m->onerror = refstrdup(skipspace(p + 7));
 		onerrorlen = strlen(m->onerror);
 		refstr_put(onerror);
 		onerror = refstrdup(m->onerror);
-	    } else if (looking_at(p, "master")) {
+	    } else if (kwd == KWD_MASTER) {
 		p = skipspace(p + 6);
 		if (looking_at(p, "passwd")) {
 		    refstr_put(m->menu_master_passwd);
 		    m->menu_master_passwd = refstrdup(skipspace(p + 6));
 		}
-	    } else if ((ep = looking_at(p, "include"))) {
+	    } else if (kwd == KWD_INCLUDE) {
 		do_include_menu(ep, m);
-	    } else if ((ep = looking_at(p, "background"))) {
+	    } else if (kwd == KWD_LAZYINCLUDE) {
+		do_lazy_include(ep, m);
+	    } else if (kwd == KWD_BACKGROUND) {
 		p = skipspace(ep);
 		refstr_put(m->menu_background);
 		m->menu_background = refdup_word(&p);
-	    } else if ((ep = looking_at(p, "hidden"))) {
+	    } else if (kwd == KWD_HIDDEN) {
 		hiddenmenu = 1;
-	    } else if ((ep = is_message_name(p, &msgnr))) {
+	    } else if (!kwd && (ep = is_message_name(p, &msgnr))) {
 		refstr_put(m->messages[msgnr]);
 		m->messages[msgnr] = refstrdup(skipspace(ep));
-	    } else if ((ep = looking_at(p, "color")) ||
-		       (ep = looking_at(p, "colour"))) {
+	    } else if (kwd == KWD_COLOR ||
+		       kwd == KWD_COLOUR) {
 		int i;
 		struct color_table *cptr;
 		p = skipspace(ep);
@@ -1020,8 +1215,8 @@ static void parse_config_file(FILE * f)
 		    }
 		    cptr++;
 		}
-	    } else if ((ep = looking_at(p, "msgcolor")) ||
-		       (ep = looking_at(p, "msgcolour"))) {
+	    } else if (kwd == KWD_MSGCOLOR ||
+		       kwd == KWD_MSGCOLOUR) {
 		unsigned int fg_mask = MSG_COLORS_DEF_FG;
 		unsigned int bg_mask = MSG_COLORS_DEF_BG;
 		enum color_table_shadow shadow = MSG_COLORS_DEF_SHADOW;
@@ -1057,31 +1252,31 @@ static void parse_config_file(FILE * f)
 		    }
 		}
 		set_msg_colors_global(m->color_table, fg_mask, bg_mask, shadow);
-	    } else if (looking_at(p, "separator")) {
+	    } else if (kwd == KWD_SEPARATOR) {
 		record(m, &ld, append);
 		ld.label = refstr_get(empty_string);
 		ld.menuseparator = 1;
 		record(m, &ld, append);
-	    } else if (looking_at(p, "disable") || looking_at(p, "disabled")) {
+	    } else if (kwd == KWD_DISABLE || kwd == KWD_DISABLED) {
 		ld.menudisabled = 1;
-	    } else if (looking_at(p, "indent")) {
+	    } else if (kwd == KWD_INDENT) {
 		ld.menuindent = atoi(skipspace(p + 6));
-	    } else if (looking_at(p, "begin")) {
+	    } else if (kwd == KWD_BEGIN) {
 		record(m, &ld, append);
 		m = current_menu = begin_submenu(skipspace(p + 5));
-	    } else if (looking_at(p, "end")) {
+	    } else if (kwd == KWD_END) {
 		record(m, &ld, append);
 		m = current_menu = end_submenu();
-	    } else if (looking_at(p, "quit")) {
+	    } else if (kwd == KWD_QUIT) {
 		if (ld.label)
 		    ld.action = MA_QUIT;
-	    } else if (looking_at(p, "goto")) {
+	    } else if (kwd == KWD_GOTO) {
 		if (ld.label) {
 		    ld.action = MA_GOTO_UNRES;
 		    refstr_put(ld.kernel);
 		    ld.kernel = refstrdup(skipspace(p + 4));
 		}
-	    } else if (looking_at(p, "exit")) {
+	    } else if (kwd == KWD_EXIT) {
 		p = skipspace(p + 4);
 		if (ld.label && m->parent) {
 		    if (*p) {
@@ -1094,7 +1289,7 @@ static void parse_config_file(FILE * f)
 			ld.submenu = m->parent;
 		    }
 		}
-	    } else if (looking_at(p, "start")) {
+	    } else if (kwd == KWD_START) {
 		start_menu = m;
 	    } else {
 		/* Unknown, check for layout parameters */
@@ -1108,7 +1303,7 @@ static void parse_config_file(FILE * f)
 	    }
 	}
 	/* feng: menu handling end */	
-	else if (looking_at(p, "text")) {
+	else if (kwd == KWD_TEXT) {
 
 		/* loop till we fined the "endtext" */
 	    enum text_cmd {
@@ -1140,7 +1335,7 @@ static void parse_config_file(FILE * f)
 		    break;
 		}
 	    }
-	} else if ((ep = is_fkey(p, &fkeyno))) {
+	} else if (!kwd && (ep = is_fkey(p, &fkeyno))) {
 	    p = skipspace(ep);
 	    if (m->fkeyhelp[fkeyno].textname) {
 		refstr_put(m->fkeyhelp[fkeyno].textname);
@@ -1157,9 +1352,11 @@ static void parse_config_file(FILE * f)
 		p = skipspace(p);
 		m->fkeyhelp[fkeyno].background = refdup_word(&p);
 	    }
-	} else if ((ep = looking_at(p, "include"))) {
+	} else if (kwd == KWD_INCLUDE) {
 	    do_include(ep);
-	} else if (looking_at(p, "append")) {
+	} else if (kwd == KWD_CACHE) {
+	    do_include_cache(ep);
+	} else if (kwd == KWD_APPEND) {
 	    const char *a = refstrdup(skipspace(p + 6));
 	    if (ld.label) {
 		refstr_put(ld.append);
@@ -1169,7 +1366,7 @@ static void parse_config_file(FILE * f)
 		append = a;
 	    }
 	    //dprintf("we got a append: %s", a);
-	} else if (looking_at(p, "initrd")) {
+	} else if (kwd == KWD_INITRD) {
 	    const char *a = refstrdup(skipspace(p + 6));
 	    if (ld.label) {
 		refstr_put(ld.initrd);
@@ -1177,7 +1374,7 @@ static void parse_config_file(FILE * f)
 	    } else {
 		/* Ignore */
 	    }
-	} else if (looking_at(p, "label")) {
+	} else if (kwd == KWD_LABEL) {
 	    p = skipspace(p + 5);
 	    /* when first time see "label", it will not really record anything */
 	    record(m, &ld, append);
@@ -1193,30 +1390,30 @@ static void parse_config_file(FILE * f)
 	    ld.ipappend = SysAppends;
 	    ld.menudefault = ld.menuhide = ld.menuseparator =
 		ld.menudisabled = ld.menuindent = 0;
-	} else if ((ep = is_kernel_type(p, &type))) {
+	} else if (!kwd && (ep = is_kernel_type(p, &type))) {
 	    if (ld.label) {
 		refstr_put(ld.kernel);
 		ld.kernel = refstrdup(skipspace(ep));
 		ld.type = type;
 		//dprintf("got a kernel: %s, type = %d", ld.kernel, ld.type);
 	    }
-	} else if (looking_at(p, "timeout")) {
+	} else if (kwd == KWD_TIMEOUT) {
 	    kbdtimeout = (atoi(skipspace(p + 7)) * CLK_TCK + 9) / 10;
-	} else if (looking_at(p, "totaltimeout")) {
+	} else if (kwd == KWD_TOTALTIMEOUT) {
 	    totaltimeout = (atoll(skipspace(p + 13)) * CLK_TCK + 9) / 10;
-	} else if (looking_at(p, "ontimeout")) {
+	} else if (kwd == KWD_ONTIMEOUT) {
 	    ontimeout = refstrdup(skipspace(p + 9));
 	    ontimeoutlen = strlen(ontimeout);
-	} else if (looking_at(p, "allowoptions")) {
+	} else if (kwd == KWD_ALLOWOPTIONS) {
 	    allowoptions = !!atoi(skipspace(p + 12));
-	} else if ((ep = looking_at(p, "ipappend")) ||
-		   (ep = looking_at(p, "sysappend"))) {
+	} else if (kwd == KWD_IPAPPEND ||
+		   kwd == KWD_SYSAPPEND) {
 	    uint32_t s = strtoul(skipspace(ep), NULL, 0);
 	    if (ld.label)
 		ld.ipappend = s;
 	    else
 		SysAppends = s;
-	} else if (looking_at(p, "default")) {
+	} else if (kwd == KWD_DEFAULT) {
 	    /* default could be a kernel image or another label */
 	    refstr_put(globaldefault);
 	    globaldefault = refstrdup(skipspace(p + 7));
@@ -1232,7 +1429,7 @@ static void parse_config_file(FILE * f)
 		refstr_put(default_cmd);
 		default_cmd = refstrdup(globaldefault);
 	    }
-	} else if (looking_at(p, "ui")) {
+	} else if (kwd == KWD_UI) {
 	    has_ui = 1;
 	    defaultlevel = LEVEL_UI;
 	    refstr_put(default_cmd);
@@ -1243,7 +1440,7 @@ static void parse_config_file(FILE * f)
 	 * subset 1:  pc_opencmd 
 	 * display/font/kbdmap are rather similar, open a file then do sth
 	 */
-	else if (looking_at(p, "display")) {
+	else if (kwd == KWD_DISPLAY) {
 		const char *filename;
 		char *dst = KernelName;
 		size_t len = FILENAME_MAX - 1;
@@ -1256,7 +1453,7 @@ static void parse_config_file(FILE * f)
 
 		get_msg_file(KernelName);
 		refstr_put(filename);
-	} else if (looking_at(p, "font")) {
+	} else if (kwd == KWD_FONT) {
 		const char *filename;
 		char *dst = KernelName;
 		size_t len = FILENAME_MAX - 1;
@@ -1269,7 +1466,7 @@ static void parse_config_file(FILE * f)
 
 		loadfont(KernelName);
 		refstr_put(filename);
-	} else if (looking_at(p, "kbdmap")) {
+	} else if (kwd == KWD_KBDMAP) {
 		const char *filename;
 
 		filename = refstrdup(skipspace(p + 6));
@@ -1280,21 +1477,23 @@ static void parse_config_file(FILE * f)
 	 * subset 2:  pc_setint16
 	 * set a global flag
 	 */
-	else if (looking_at(p, "implicit")) {
+	else if (kwd == KWD_IMPLICIT) {
 		allowimplicit = atoi(skipspace(p + 8));
-	} else if (looking_at(p, "prompt")) {
+	} else if (kwd == KWD_PROMPT) {
 		forceprompt = atoi(skipspace(p + 6));
-	} else if (looking_at(p, "console")) {
+	} else if (kwd == KWD_CONSOLE) {
 		DisplayCon = atoi(skipspace(p + 7));
-	} else if (looking_at(p, "allowoptions")) {
+	} else if (kwd == KWD_ALLOWOPTIONS) {
 		allowoptions = atoi(skipspace(p + 12));
-	} else if (looking_at(p, "noescape")) {
+	} else if (kwd == KWD_NOESCAPE) {
 		noescape = atoi(skipspace(p + 8));
-	} else if (looking_at(p, "nocomplete")) {
+	} else if (kwd == KWD_NOCOMPLETE) {
 		nocomplete = atoi(skipspace(p + 10));
-	} else if (looking_at(p, "nohalt")) {
+	} else if (kwd == KWD_NOHALT) {
 		NoHalt = atoi(skipspace(p + 8));
-	} else if (looking_at(p, "onerror")) {
+	} else if (kwd == KWD_FSVERIFY) {
+		FsVerify = atoi(skipspace(p + 8));
+	} else if (kwd == KWD_ONERROR) {
 		refstr_put(m->onerror);
 		m->onerror = refstrdup(skipspace(p + 7));
 		onerrorlen = strlen(m->onerror);
@@ -1302,14 +1501,17 @@ static void parse_config_file(FILE * f)
 		onerror = refstrdup(m->onerror);
 	}
 
-	else if (looking_at(p, "pxeretry"))
+	else if (kwd == KWD_PXERETRY)
 		PXERetry = atoi(skipspace(p + 8));
 
 	/* serial setting, bps, flow control */
-	else if (looking_at(p, "serial")) {
+	else if (kwd == KWD_SERIAL) {
 		uint16_t port, flow;
 		uint32_t baud;
 
+		/* Finish with the old port and its settings first */
+		serial_tx_flush();
+
 		p = skipspace(p + 6);
 		port = strtoul(p, &p, 0);
 
@@ -1396,6 +1598,9 @@ static void parse_config_file(FILE * f)
 		if (inb(port + 2) < 0x0C0) {
 			outb(0, port + 2);
 			io_delay();
+			SerialTxFifo = 1;
+		} else {
+			SerialTxFifo = 16;
 		}
 
 		/* Assert bits in MCR */
@@ -1414,12 +1619,19 @@ static void parse_config_file(FILE * f)
 			write_serial_str(copyright_str);
 		}
 
-	} else if (looking_at(p, "say")) {
+	} else if (kwd == KWD_SAY) {
 		printf("%s\n", p+4);
-	} else if (looking_at(p, "path")) {
+	} else if (kwd == KWD_PATH) {
 		if (parse_path(skipspace(p + 4)))
 			printf("Failed to parse PATH\n");
-	} else if (looking_at(p, "sendcookies")) {
+	} else if (kwd == KWD_BUNDLE) {
+		if (module_bundle_load(skipspace(p + 6)))
+			printf("Failed to load module bundle %s\n",
+			       skipspace(p + 6));
+	} else if (kwd == KWD_TRACE) {
+		if (trace_set(skipspace(p + 5)))
+			printf("TRACE: unknown group or out of memory\n");
+	} else if (kwd == KWD_SENDCOOKIES) {
 		const union syslinux_derivative_info *sdi;
 
 		p += strlen("sendcookies");
@@ -1488,6 +1700,90 @@ static void resolve_gotos(void)
     }
 }
 
+/*
+ * Read the file of a MENU LAZYINCLUDE submenu, as if it had been
+ * included where the submenu was defined, and finish setting up the
+ * menus it brings in the way parse_configs() does.
+ */
+void load_lazy_menu(struct menu *m)
+{
+    const char *file = m->lazy_file;
+    const char *ontimeout = m->ontimeout;
+    const char *onerror = m->onerror;
+    const char *save_append = append;
+    struct menu *save_menu = current_menu;
+    struct menu *old_list = menu_list;
+    struct menu *new_list, *n;
+    FILE *f;
+    int fd;
+
+    if (!file)
+	return;
+
+    m->lazy_file = NULL;
+    lazy_menus--;
+
+    append = m->lazy_append;
+    m->lazy_append = NULL;
+    current_menu = m;
+
+    fd = open(file, O_RDONLY);
+    if (fd >= 0) {
+	f = fdopen(fd, "r");
+	if (f) {
+	    parse_config_file(f);
+	    fclose(f);
+	} else {
+	    close(fd);
+	}
+    }
+
+    record(current_menu, &ld, append);
+    refstr_put(file);
+
+    refstr_put(append);
+    append = save_append;
+    current_menu = save_menu;
+
+    /*
+     * Only what the file set needs unlabel(); anything inherited from
+     * this menu has been through it already.  Looking labels up may
+     * read other lazy submenus, which take care of their own menus.
+     */
+    new_list = menu_list;
+
+    resolve_gotos();
+
+    for (n = new_list; n != old_list; n = n->next) {
+	n->curentry = n->defentry;
+
+	if (n->ontimeout && n->ontimeout != ontimeout)
+	    n->ontimeout = unlabel(n->ontimeout);
+	if (n->onerror && n->onerror != onerror)
+	    n->onerror = unlabel(n->onerror);
+    }
+
+    m->curentry = m->defentry;
+
+    if (m->ontimeout != ontimeout)
+	m->ontimeout = unlabel(m->ontimeout);
+    if (m->onerror != onerror)
+	m->onerror = unlabel(m->onerror);
+}
+
+static void load_lazy_menus(void)
+{
+    struct menu *m;
+
+    while (lazy_menus) {
+	for (m = menu_list; m; m = m->next) {
+	    if (m->lazy_file)
+		break;
+	}
+	load_lazy_menu(m);
+    }
+}
+
 void parse_configs(char **argv)
 {
     const char *filename;
@@ -1495,11 +1791,24 @@ void parse_configs(char **argv)
     struct menu_entry *me;
     dprintf("enter");
 
+    /* Configurations repeat the same strings over and over */
+    refstr_intern(true);
+
     empty_string = refstrdup("");
 
     /* feng: reset current menu_list and entry list */
     menu_list = NULL;
     all_entries = NULL;
+    all_entries_end = &all_entries;
+    label_hash = NULL;
+    label_hash_size = label_hash_count = 0;
+    label_hash_failed = false;
+    lazy_menus = 0;
+
+    if (config_arena)
+	arena_reset(config_arena);
+    else
+	config_arena = arena_create(0);
 
     /* Initialize defaults for the root and hidden menus */
     hide_menu = new_menu(NULL, NULL, refstrdup(".hidden"));
@@ -41,10 +41,36 @@
 #include <syslinux/adv.h>
 #include <klibc/compiler.h>
 #include <inttypes.h>
+#include <stdbool.h>
 #include <string.h>
 #include <errno.h>
 #include <alloca.h>
 
+/*
+ * Return true if the ADV data at P already says what setting TAG to
+ * (SIZE, DATA) would make it say, so there is nothing to do.
+ */
+static bool adv_unchanged(const uint8_t *p, size_t left, int tag,
+			  size_t size, const void *data)
+{
+    while (left >= 2) {
+	uint8_t ptag = p[0];
+	size_t plen = p[1] + 2;
+
+	if (ptag == ADV_END)
+	    break;
+	if (plen > left)
+	    return false;	/* Corrupt; let it be overwritten */
+	if (ptag == tag)
+	    return p[1] == size && !memcmp(p + 2, data, size);
+
+	left -= plen;
+	p += plen;
+    }
+
+    return !size;
+}
+
 __export int syslinux_setadv(int tag, size_t size, const void *data)
 {
     uint8_t *p, *advtmp;
@@ -60,6 +86,10 @@ __export int syslinux_setadv(int tag, size_t size, const void *data)
 	return -1;
     }
 
+    if (adv_unchanged(syslinux_adv_ptr(), syslinux_adv_size(),
+		      tag, size, data))
+	return 0;
+
     rleft = left = syslinux_adv_size();
     p = advtmp = alloca(left);
     memcpy(p, syslinux_adv_ptr(), left);	/* Make working copy */
@@ -30,6 +30,7 @@
 #include <syslinux/boot.h>
 #include <console.h>
 #include <com32.h>
+#include <fs.h>
 
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -173,7 +174,8 @@ void gfx_infobox(int type, char *str1, char *str2);
 void gfx_progress_init(ssize_t kernel_size, char *label);
 void gfx_progress_update(ssize_t size);
 void gfx_progress_done(void);
-void *load_one(char *file, ssize_t *file_size);
+void *load_one(char *file, ssize_t *file_size, char *label);
+void prefetch_entry(char *kernel, char *initrds);
 void boot(int index);
 void boot_entry(menu_t *menu_ptr, char *arg);
 
@@ -753,13 +755,18 @@ void gfx_progress_done(void)
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 // Read file and update progress bar.
 //
-void *load_one(char *file, ssize_t *file_size)
+// If label is set, the progress bar is started for this file as soon as
+// its size is known. The bar advances in whole sectors; what is left of
+// a chunk is carried over to the next one.
+//
+void *load_one(char *file, ssize_t *file_size, char *label)
 {
   int fd;
-  void *buf = NULL;
+  void *buf = NULL, *p;
   char *str;
   struct stat sbuf;
-  ssize_t size = 0, cur, i;
+  ssize_t size = 0, buf_size, cur = 0, shown = 0, i = 0;
+  ssize_t sector_mask = (1 << gfx_config.sector_shift) - 1;
 
   *file_size = 0;
 
@@ -772,43 +779,74 @@ void *load_one(char *file, ssize_t *file_size)
 
   if(!fstat(fd, &sbuf) && S_ISREG(sbuf.st_mode)) size = sbuf.st_size;
 
-  i = 0;
+  if(label) gfx_progress_init(size, label);
+
+  // size unknown: grow the buffer geometrically as data arrives
+  buf_size = size ? size : CHUNK_SIZE;
+  buf = malloc(buf_size);
 
-  if(size) {
-    buf = malloc(size);
-    for(i = 1, cur = 0 ; cur < size && i > 0; cur += i) {
-      i = read(fd, buf + cur, min(CHUNK_SIZE, size - cur));
-      if(i == -1) break;
-      gfx_progress_update(i);
+  while(buf) {
+    if(cur == buf_size) {
+      if(size) break;
+      p = realloc(buf, buf_size * 2);
+      if(!p) {
+        free(buf);
+        buf = NULL;
+        break;
+      }
+      buf = p;
+      buf_size *= 2;
+    }
+    i = read(fd, buf + cur, min(CHUNK_SIZE, buf_size - cur));
+    if(i <= 0) break;
+    cur += i;
+    if((cur & ~sector_mask) != shown) {
+      gfx_progress_update((cur & ~sector_mask) - shown);
+      shown = cur & ~sector_mask;
     }
-  }
-  else {
-    do {
-      buf = realloc(buf, size + CHUNK_SIZE);
-      i = read(fd, buf + size, CHUNK_SIZE);
-      if(i == -1) break;
-      size += i;
-      gfx_progress_update(i);
-    } while(i > 0);
   }
 
   close(fd);
 
-  if(i == -1) {
-    asprintf(&str, "%s: read error @ %d", file, size);
+  if(!buf || i == -1) {
+    if(buf)
+      asprintf(&str, "%s: read error @ %d", file, cur);
+    else
+      asprintf(&str, "%s: out of memory", file);
     gfx_infobox(0, str, NULL);
     free(str);
     free(buf);
     buf = NULL;
-    size = 0;
+    cur = 0;
   }
 
-  *file_size = size;
+  *file_size = cur;
 
   return buf;
 }
 
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Tell the filesystem about the kernel and initrds we are about to read;
+// one that can (lpxelinux) fetches them all at once while we read them
+// in order.
+//
+void prefetch_entry(char *kernel, char *initrds)
+{
+  char *s, *s0, *t;
+
+  prefetch_file(kernel);
+
+  if(!initrds || !(s = s0 = strdup(initrds))) return;
+
+  while((t = strsep(&s, ","))) {
+    if(*t) prefetch_file(t);
+  }
+
+  free(s0);
+}
+
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 // Boot menu entry.
 //
@@ -878,8 +916,6 @@ void boot_entry(menu_t *menu_ptr, char *arg)
   ssize_t kernel_size = 0, initrd_size = 0;
   struct initramfs *initrd = NULL;
   char *file, *cmd_buf;
-  int fd;
-  struct stat sbuf;
   char *s, *s0, *t, *initrd_arg;
 
   if(!menu_ptr) return;
@@ -901,33 +937,6 @@ void boot_entry(menu_t *menu_ptr, char *arg)
     return;
   }
 
-  // first, load kernel
-
-  kernel_size = 0;
-
-  if((fd = open(file, O_RDONLY)) >= 0) {
-    if(!fstat(fd, &sbuf) && S_ISREG(sbuf.st_mode)) kernel_size = sbuf.st_size;
-    close(fd);
-  }
-
-  gfx_progress_init(kernel_size, file);
-
-  kernel = load_one(file, &kernel_size);
-
-  if(!kernel) {
-    return;
-  }
-
-  if(kernel_size < 1024 || *(uint32_t *) (kernel + 0x202) != 0x53726448) {
-    // not a linux kernel
-    gfx_done();
-    asprintf(&cmd_buf, "%s %s", menu_ptr->label, arg);
-    syslinux_run_command(cmd_buf);
-    return;
-  }
-
-  // printf("kernel = %p, size = %d\n", kernel, kernel_size);
-
   // parse cmdline for "initrd" option
 
   initrd_arg = menu_ptr->initrd;
@@ -948,11 +957,34 @@ void boot_entry(menu_t *menu_ptr, char *arg)
     initrd_arg = s0 = strdup(initrd_arg);
   }
 
+  // get the initrds on their way while the kernel loads
+  prefetch_entry(file, initrd_arg);
+
+  // first, load kernel
+
+  kernel = load_one(file, &kernel_size, file);
+
+  if(!kernel) {
+    free(s0);
+    return;
+  }
+
+  if(kernel_size < 1024 || *(uint32_t *) (kernel + 0x202) != 0x53726448) {
+    // not a linux kernel
+    free(s0);
+    gfx_done();
+    asprintf(&cmd_buf, "%s %s", menu_ptr->label, arg);
+    syslinux_run_command(cmd_buf);
+    return;
+  }
+
+  // printf("kernel = %p, size = %d\n", kernel, kernel_size);
+
   if(initrd_arg) {
     initrd = initramfs_init();
 
     while((t = strsep(&initrd_arg, ","))) {
-      initrd_buf = load_one(t, &initrd_size);
+      initrd_buf = load_one(t, &initrd_size, NULL);
 
       if(!initrd_buf) {
         printf("%s: read error\n", t);
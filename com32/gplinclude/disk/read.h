@@ -15,4 +15,5 @@
 int read_mbr(int, void *);
 int dev_read(int, void *, unsigned int, int);
 int read_sectors(struct driveinfo *, void *, const unsigned int, const int);
+void disk_cache_invalidate(int);
 #endif /* _READ_H */
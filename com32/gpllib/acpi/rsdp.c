@@ -31,37 +31,61 @@
 #include <string.h>
 #include <memory.h>
 #include <dprintf.h>
+#include <syslinux/probecache.h>
 #include "acpi/acpi.h"
 
-int search_rsdp(s_acpi * acpi)
+/* Scan the BIOS area for the "RSD PTR" signature */
+static uint8_t *find_rsdp(void)
 {
-    /* Let's seach for RSDT table */
     uint8_t *q;
+    const void *cached;
+    size_t len;
+
+    /* Another module may have scanned for it already */
+    cached = probe_cache_get(PROBE_ACPI_RSDP, &len);
+    if (cached && len == sizeof(q)) {
+	memcpy(&q, cached, sizeof(q));
+	return q;
+    }
 
     /* Let's start for the base address */
     for (q = (uint8_t *)RSDP_MIN_ADDRESS; q < (uint8_t *)RSDP_MAX_ADDRESS; q+=16 ) {
 	/* Searching for RSDP with "RSD PTR" signature */
-	if (memcmp(q, RSDP, sizeof(RSDP)-1) == 0) {
-	    s_rsdp *r = &acpi->rsdp;
-	    r->valid = true;
-	    r->address = q;
-	    cp_str_struct(r->signature);
-	    cp_struct(&r->checksum);
-	    cp_str_struct(r->oem_id);
-	    cp_struct(&r->revision);
-	    cp_struct(&r->rsdt_address);
-	    cp_struct(&r->length);
-	    cp_struct(&r->xsdt_address);
-	    cp_struct(&r->extended_checksum);
-	    q += 3;		/* reserved field */
-	    acpi->rsdt.address = r->rsdt_address;
-	    acpi->xsdt.address = r->xsdt_address;
-	    DEBUG_PRINT(("RSDT should be at %p\n",r->rsdt_address));
-	    DEBUG_PRINT(("XSDT should be at %p\n",r->xsdt_address));
-	    return RSDP_TABLE_FOUND;
-	}
+	if (memcmp(q, RSDP, sizeof(RSDP)-1) == 0)
+	    break;
     }
-    return -RSDP_TABLE_FOUND;
+    if (q >= (uint8_t *)RSDP_MAX_ADDRESS)
+	q = NULL;
+
+    probe_cache_put(PROBE_ACPI_RSDP, &q, sizeof(q));
+    return q;
+}
+
+int search_rsdp(s_acpi * acpi)
+{
+    /* Let's seach for RSDT table */
+    uint8_t *q = find_rsdp();
+    s_rsdp *r = &acpi->rsdp;
+
+    if (!q)
+	return -RSDP_TABLE_FOUND;
+
+    r->valid = true;
+    r->address = q;
+    cp_str_struct(r->signature);
+    cp_struct(&r->checksum);
+    cp_str_struct(r->oem_id);
+    cp_struct(&r->revision);
+    cp_struct(&r->rsdt_address);
+    cp_struct(&r->length);
+    cp_struct(&r->xsdt_address);
+    cp_struct(&r->extended_checksum);
+    q += 3;		/* reserved field */
+    acpi->rsdt.address = r->rsdt_address;
+    acpi->xsdt.address = r->xsdt_address;
+    DEBUG_PRINT(("RSDT should be at %p\n",r->rsdt_address));
+    DEBUG_PRINT(("XSDT should be at %p\n",r->xsdt_address));
+    return RSDP_TABLE_FOUND;
 }
 
 void print_rsdp(s_acpi * acpi)
@@ -16,6 +16,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <disk/geom.h>
+#include <pmapi.h>
 
 #include <stdio.h>
 
@@ -76,24 +77,13 @@ void lba_to_chs(const struct driveinfo *drive_info, const int lba,
  *       extended drive parameter table is valid (see #00273,#00278)
  *     3-15    reserved (0)
  **/
-static int detect_extensions(struct driveinfo *drive_info)
+static int detect_extensions(struct driveinfo *drive_info,
+			     const struct com32_disk_probe *probe)
 {
-    com32sys_t getebios, ebios;
-
-    memset(&getebios, 0, sizeof getebios);
-    memset(&ebios, 0, sizeof ebios);
-
-    getebios.eflags.b[0] = 0x3;	/* CF set */
-    getebios.ebx.w[0] = 0x55aa;
-    getebios.edx.b[0] = drive_info->disk;
-    getebios.eax.b[1] = 0x41;
-
-    __intcall(0x13, &getebios, &ebios);
-
-    if (!(ebios.eflags.l & EFLAGS_CF) && ebios.ebx.w[0] == 0xaa55) {
+    if (probe->flags & COM32_DISK_EBIOS) {
 	drive_info->ebios = 1;
-	drive_info->edd_version = ebios.eax.b[1];
-	drive_info->edd_functionality_subset = ebios.ecx.w[0];
+	drive_info->edd_version = probe->edd_version;
+	drive_info->edd_functionality_subset = probe->edd_subset;
 	return 0;
     } else
 	return -1;		/* Drive does not exist? */
@@ -117,44 +107,18 @@ static int detect_extensions(struct driveinfo *drive_info)
  *     numbers, stopping as soon as the number of valid drives encountered
  *     equals the value in 0040h:0075h
  **/
-static int get_drive_parameters_with_extensions(struct driveinfo *drive_info)
+static int get_drive_parameters_with_extensions(struct driveinfo *drive_info,
+						const struct com32_disk_probe *probe)
 {
-    com32sys_t inreg, outreg;
-    struct edd_device_parameters *dp;
-
-    memset(&inreg, 0, sizeof inreg);
-
     /*
-     * The caller shall set this value to the maximum Result Buffer
-     * length, in bytes. If the length of this buffer is less than 30
-     * bytes, this function shall not return the pointer to Drive Parameter
-     * Table (DPT) extension. If the buffer length is 30 or greater on
-     * entry, it shall be set to 30 on exit. If the buffer length is
-     * between 26 and 29, it shall be set to 26 on exit.
-     * If the buffer length is less than 26 on entry an error shall be
-     * returned.
+     * The core asked with a buffer of COM32_DISK_EDD_LEN bytes, which
+     * is the size of struct edd_device_parameters
      */
-    dp = lmalloc(sizeof *dp);
-    if (!dp)
+    if (!(probe->flags & COM32_DISK_EDD))
 	return -1;
 
-    dp->len = sizeof(struct edd_device_parameters);
-
-    inreg.esi.w[0] = OFFS(dp);
-    inreg.ds = SEG(dp);
-    inreg.edx.b[0] = drive_info->disk;
-    inreg.eax.b[1] = 0x48;
-
-    __intcall(0x13, &inreg, &outreg);
-
-    /* CF set on error */
-    if (outreg.eflags.l & EFLAGS_CF) {
-	lfree(dp);
-	return outreg.eax.b[1];
-    }
-
-    memcpy(&drive_info->edd_params, dp, sizeof drive_info->edd_params);
-    lfree(dp);
+    memcpy(&drive_info->edd_params, probe->edd_params,
+	   sizeof drive_info->edd_params);
 
     return 0;
 }
@@ -207,48 +171,36 @@ static int get_drive_parameters_with_extensions(struct driveinfo *drive_info)
  * SeeAlso: AH=06h"Adaptec",AH=13h"SyQuest",AH=48h,AH=15h,INT 1E
  * SeeAlso: INT 41"HARD DISK 0"
  **/
-static int get_drive_parameters_without_extensions(struct driveinfo *drive_info)
+static int get_drive_parameters_without_extensions(struct driveinfo *drive_info,
+						   const struct com32_disk_probe *probe)
 {
-    com32sys_t getparm, parm;
-
-    memset(&getparm, 0, sizeof getparm);
-    memset(&parm, 0, sizeof parm);
-
-    /* Ralf Brown recommends setting ES:DI to 0:0 */
-    getparm.esi.w[0] = 0;
-    getparm.ds = 0;
-    getparm.edx.b[0] = drive_info->disk;
-    getparm.eax.b[1] = 0x08;
-
-    __intcall(0x13, &getparm, &parm);
-
     /* CF set on error */
-    if (parm.eflags.l & EFLAGS_CF)
-	return parm.eax.b[1];
+    if (!(probe->flags & COM32_DISK_CHS))
+	return -1;
 
     /* DL contains the maximum drive number (it starts at 0) */
-    drive_info->legacy_max_drive = parm.edx.b[0];
+    drive_info->legacy_max_drive = probe->chs_dx & 0xff;
 
     // XXX broken
     /* Drive specified greater than the bumber of attached drives */
     //if (drive_info->disk > drive_info->drives)
     //      return -1;
 
-    drive_info->legacy_type = parm.ebx.b[0];
+    drive_info->legacy_type = probe->chs_type;
 
     /* DH contains the maximum head number (it starts at 0) */
-    drive_info->legacy_max_head = parm.edx.b[1];
+    drive_info->legacy_max_head = probe->chs_dx >> 8;
 
     /* Maximum sector number (bits 5-0) per track */
-    drive_info->legacy_sectors_per_track = parm.ecx.b[0] & 0x3f;
+    drive_info->legacy_sectors_per_track = probe->chs_cx & 0x3f;
 
     /*
      * Maximum cylinder number:
      *     CH = low eight bits of maximum cylinder number
      *     CL = high two bits of maximum cylinder number (bits 7-6)
      */
-    drive_info->legacy_max_cylinder = parm.ecx.b[1] +
-	((parm.ecx.b[0] & 0xc0) << 2);
+    drive_info->legacy_max_cylinder = (probe->chs_cx >> 8) +
+	((probe->chs_cx & 0xc0) << 2);
 
     if (drive_info->legacy_sectors_per_track > 0)
 	drive_info->cbios = 1;	/* Valid geometry */
@@ -262,17 +214,24 @@ static int get_drive_parameters_without_extensions(struct driveinfo *drive_info)
  **/
 int get_drive_parameters(struct driveinfo *drive_info)
 {
+    struct com32_disk_probe probe;
     int return_code;
 
-    if (detect_extensions(drive_info))
+    /*
+     * The core makes the INT 13h calls below once per drive and
+     * session, and hands out what they said from then on
+     */
+    pmapi_disk_probe(drive_info->disk, &probe);
+
+    if (detect_extensions(drive_info, &probe))
 	return -1;
 
-    return_code = get_drive_parameters_without_extensions(drive_info);
+    return_code = get_drive_parameters_without_extensions(drive_info, &probe);
 
     /* If geometry isn't valid, no need to try to get more info about the drive */
     /* Looks like in can confuse some optical drives */
     if (drive_info->ebios && drive_info->cbios)
-	get_drive_parameters_with_extensions(drive_info);
+	get_drive_parameters_with_extensions(drive_info, &probe);
 
     return return_code;
 }
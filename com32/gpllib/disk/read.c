@@ -23,8 +23,131 @@
 #include <disk/common.h>
 
 /*
- * TODO: implement file descriptors to cache metadata (geometry, ...)
+ * Disk probing reads the same few sectors of each drive over and over:
+ * the MBR, the EBR chain, the first sector of every partition.  Keep
+ * the geometry of the drives we have read from, which otherwise costs
+ * three BIOS calls per read, and the last sectors read from the first
+ * few MB of each drive.
  */
+#define GEOM_CACHE	16
+#define SECTOR_CACHE	64
+#define SECTOR_CACHE_LBA_MAX	8192	/* First 4 MB */
+
+static struct {
+    int valid;
+    struct driveinfo info;
+} geom_cache[GEOM_CACHE];
+static int geom_next;
+
+struct sector_cache {
+    int disk;			/* -1 if unused */
+    unsigned int lba;
+    char data[SECTOR];
+};
+static struct sector_cache *sector_cache;
+static int sector_next;
+
+static int cached_drive_parameters(struct driveinfo *drive_info)
+{
+    int i;
+
+    for (i = 0; i < GEOM_CACHE; i++) {
+	if (geom_cache[i].valid &&
+	    geom_cache[i].info.disk == drive_info->disk) {
+	    *drive_info = geom_cache[i].info;
+	    return 0;
+	}
+    }
+
+    if (get_drive_parameters(drive_info) == -1)
+	return -1;
+
+    geom_cache[geom_next].valid = 1;
+    geom_cache[geom_next].info = *drive_info;
+    geom_next = (geom_next + 1) % GEOM_CACHE;
+    return 0;
+}
+
+static struct sector_cache *sector_lookup(int disk, unsigned int lba)
+{
+    int i;
+
+    if (!sector_cache)
+	return NULL;
+
+    for (i = 0; i < SECTOR_CACHE; i++) {
+	if (sector_cache[i].disk == disk && sector_cache[i].lba == lba)
+	    return &sector_cache[i];
+    }
+    return NULL;
+}
+
+static void sector_insert(int disk, unsigned int lba, const void *data)
+{
+    struct sector_cache *sc;
+    int i;
+
+    if (lba >= SECTOR_CACHE_LBA_MAX)
+	return;
+
+    if (!sector_cache) {
+	sector_cache = malloc(SECTOR_CACHE * sizeof *sector_cache);
+	if (!sector_cache)
+	    return;
+	for (i = 0; i < SECTOR_CACHE; i++)
+	    sector_cache[i].disk = -1;
+    }
+
+    sc = sector_lookup(disk, lba);
+    if (!sc) {
+	sc = &sector_cache[sector_next];
+	sector_next = (sector_next + 1) % SECTOR_CACHE;
+    }
+    sc->disk = disk;
+    sc->lba = lba;
+    memcpy(sc->data, data, SECTOR);
+}
+
+/**
+ * disk_cache_invalidate - forget cached sectors of a drive
+ * @drive:	Drive number
+ *
+ * Called after writing to the drive.
+ **/
+void disk_cache_invalidate(int drive)
+{
+    int i;
+
+    if (!sector_cache)
+	return;
+
+    for (i = 0; i < SECTOR_CACHE; i++) {
+	if (sector_cache[i].disk == drive)
+	    sector_cache[i].disk = -1;
+    }
+}
+
+/*
+ * Serve a read from the sector cache if all of it is there
+ */
+static int read_cached(int disk, char *data, unsigned int lba, int sectors)
+{
+    struct sector_cache *sc;
+    int i;
+
+    if (lba + sectors > SECTOR_CACHE_LBA_MAX)
+	return 0;
+
+    for (i = 0; i < sectors; i++) {
+	if (!sector_lookup(disk, lba + i))
+	    return 0;
+    }
+    for (i = 0; i < sectors; i++) {
+	sc = sector_lookup(disk, lba + i);
+	memcpy(data + i * SECTOR, sc->data, SECTOR);
+    }
+    return 1;
+}
 
 /**
  * read_mbr - return a pointer to a malloced buffer containing the mbr
@@ -62,35 +185,16 @@ int dev_read(int drive, void *buf, unsigned int lba, int sectors)
     return read_sectors(&drive_info, buf, lba, sectors);
 }
 
-/**
- * read_sectors - read several sectors from disk
- * @drive_info:		driveinfo struct describing the disk
- * @data:		Pre-allocated buffer for output
- * @lba:		Position to read
- * @sectors:		Number of sectors to read
- *
- * Return the number of sectors read on success or -1 on failure.
- * errno_disk contains the error number.
- **/
-int read_sectors(struct driveinfo *drive_info, void *data,
-		 const unsigned int lba, const int sectors)
+/*
+ * One BIOS read, of at most EBIOS_MAX_SECTORS with EBIOS and of a
+ * single sector with plain INT 13h
+ */
+#define EBIOS_MAX_SECTORS	127
+
+static int read_chunk(struct driveinfo *drive_info, void *buf,
+		      struct ebios_dapa *dapa, unsigned int lba, int sectors)
 {
     com32sys_t inreg, outreg;
-    struct ebios_dapa *dapa;
-    void *buf;
-    char *bufp = data;
-    int rv = -1;
-
-    if (get_drive_parameters(drive_info) == -1)
-	return -1;
-
-    buf = lmalloc(sectors * SECTOR);
-    if (!buf)
-	return -1;
-
-    dapa = lmalloc(sizeof(*dapa));
-    if (!dapa)
-	goto fail;
 
     memset(&inreg, 0, sizeof inreg);
 
@@ -111,7 +215,7 @@ int read_sectors(struct driveinfo *drive_info, void *data,
 	if (!drive_info->cbios) {	// XXX errno
 	    /* We failed to get the geometry */
 	    if (lba)
-		goto fail;	/* Can only read MBR */
+		return -1;	/* Can only read MBR */
 
 	    s = 1;
 	    h = 0;
@@ -121,7 +225,7 @@ int read_sectors(struct driveinfo *drive_info, void *data,
 
 	// XXX errno
 	if (s > 63 || h > 256 || c > 1023)
-	    goto fail;
+	    return -1;
 
 	inreg.eax.w[0] = 0x0201;	/* Read one sector */
 	inreg.ecx.b[1] = c & 0xff;
@@ -135,10 +239,59 @@ int read_sectors(struct driveinfo *drive_info, void *data,
     /* Perform the read */
     if (int13_retry(&inreg, &outreg)) {
 	errno_disk = outreg.eax.b[1];
-	goto fail;		/* Give up */
+	return -1;		/* Give up */
     }
 
-    memcpy(bufp, buf, sectors * SECTOR);
+    return 0;
+}
+
+/**
+ * read_sectors - read several sectors from disk
+ * @drive_info:		driveinfo struct describing the disk
+ * @data:		Pre-allocated buffer for output
+ * @lba:		Position to read
+ * @sectors:		Number of sectors to read
+ *
+ * Return the number of sectors read on success or -1 on failure.
+ * errno_disk contains the error number.
+ **/
+int read_sectors(struct driveinfo *drive_info, void *data,
+		 const unsigned int lba, const int sectors)
+{
+    struct ebios_dapa *dapa;
+    void *buf;
+    char *bufp = data;
+    int chunk, done, i, rv = -1;
+
+    if (cached_drive_parameters(drive_info) == -1)
+	return -1;
+
+    if (read_cached(drive_info->disk, bufp, lba, sectors))
+	return sectors;
+
+    chunk = drive_info->ebios ? EBIOS_MAX_SECTORS : 1;
+    if (chunk > sectors)
+	chunk = sectors;
+
+    buf = lmalloc(chunk * SECTOR);
+    if (!buf)
+	return -1;
+
+    dapa = lmalloc(sizeof(*dapa));
+    if (!dapa)
+	goto fail;
+
+    for (done = 0; done < sectors; done += chunk) {
+	if (chunk > sectors - done)
+	    chunk = sectors - done;
+	if (read_chunk(drive_info, buf, dapa, lba + done, chunk))
+	    goto fail;
+	memcpy(bufp + done * SECTOR, buf, chunk * SECTOR);
+    }
+
+    for (i = 0; i < sectors; i++)
+	sector_insert(drive_info->disk, lba + i, bufp + i * SECTOR);
+
     rv = sectors;
 
 fail:
@@ -90,6 +90,7 @@ int write_sectors(const struct driveinfo *drive_info, const unsigned int lba,
     }
 
     /* Perform the write */
+    disk_cache_invalidate(drive_info->disk);
     if (int13_retry(&inreg, &outreg)) {
 	errno_disk = outreg.eax.b[1];	/* Give up */
     } else
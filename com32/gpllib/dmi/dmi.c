@@ -28,6 +28,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <syslinux/probecache.h>
 #include "dmi/dmi.h"
 
 const char *out_of_spec = "<OUT OF SPEC>";
@@ -542,6 +543,8 @@ static int legacy_decode(s_dmi * dmi, uint8_t * buf)
 int dmi_iterate(s_dmi * dmi)
 {
     uint8_t *p, *q;
+    const void *cached;
+    size_t len;
     int found = 0;
 
     /* Cleaning structures */
@@ -566,6 +569,13 @@ int dmi_iterate(s_dmi * dmi)
     dmi->processor.filled = false;
     dmi->system.filled = false;
 
+    /* Another module may have scanned for the table already */
+    cached = probe_cache_get(PROBE_DMI_TABLE, &len);
+    if (cached && len == sizeof(dmi_table)) {
+	memcpy(&dmi->dmitable, cached, sizeof(dmi_table));
+	return dmi->dmitable.base ? DMI_TABLE_PRESENT : -ENODMITABLE;
+    }
+
     p = (uint8_t *) 0xF0000;	/* The start address to look at the dmi table */
     /* The anchor-string is 16-bytes aligned */
     for (q = p; q < p + 0x10000; q += 16) {
@@ -588,14 +598,15 @@ int dmi_iterate(s_dmi * dmi)
 	}
     }
 
-    if (found)
-	return DMI_TABLE_PRESENT;
+    if (!found) {
+	dmi->dmitable.base = 0;
+	dmi->dmitable.num = 0;
+	dmi->dmitable.ver = 0;
+	dmi->dmitable.len = 0;
+    }
+    probe_cache_put(PROBE_DMI_TABLE, &dmi->dmitable, sizeof(dmi_table));
 
-    dmi->dmitable.base = 0;
-    dmi->dmitable.num = 0;
-    dmi->dmitable.ver = 0;
-    dmi->dmitable.len = 0;
-    return -ENODMITABLE;
+    return found && dmi->dmitable.base ? DMI_TABLE_PRESENT : -ENODMITABLE;
 }
 
 void dmi_decode(struct dmi_header *h, uint16_t ver, s_dmi * dmi)
@@ -1008,6 +1019,20 @@ void parse_dmitable(s_dmi * dmi)
 {
     int i = 0;
     uint8_t *data = NULL;
+    const s_dmi *cached;
+    size_t len;
+
+    /* Reuse another module's parse of the same table */
+    cached = probe_cache_get(PROBE_DMI, &len);
+    if (cached && len == sizeof(s_dmi) &&
+	cached->dmitable.base == dmi->dmitable.base &&
+	cached->dmitable.len == dmi->dmitable.len &&
+	cached->dmitable.num == dmi->dmitable.num &&
+	cached->dmitable.ver == dmi->dmitable.ver) {
+	memcpy(dmi, cached, sizeof(s_dmi));
+	return;
+    }
+
     uint8_t buf[dmi->dmitable.len];
     memcpy(buf, (int *)dmi->dmitable.base, sizeof(uint8_t) * dmi->dmitable.len);
     data = buf;
@@ -1041,4 +1066,6 @@ void parse_dmitable(s_dmi * dmi)
 	data = next;
 	i++;
     }
+
+    probe_cache_put(PROBE_DMI, dmi, sizeof(s_dmi));
 }
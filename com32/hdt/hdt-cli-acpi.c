@@ -284,6 +284,7 @@ struct cli_module_descr acpi_show_modules = {
 struct cli_mode_descr acpi_mode = {
     .mode = ACPI_MODE,
     .name = CLI_ACPI,
+    .detect = HDT_DETECT_ACPI,
     .default_modules = NULL,
     .show_modules = &acpi_show_modules,
     .set_modules = NULL,
@@ -257,6 +257,7 @@ struct cli_module_descr cpu_show_modules = {
 struct cli_mode_descr cpu_mode = {
     .mode = CPU_MODE,
     .name = CLI_CPU,
+    .detect = HDT_DETECT_CPU,
     .default_modules = NULL,
     .show_modules = &cpu_show_modules,
     .set_modules = NULL,
@@ -247,6 +247,7 @@ struct cli_module_descr disk_show_modules = {
 struct cli_mode_descr disk_mode = {
     .mode = DISK_MODE,
     .name = CLI_DISK,
+    .detect = HDT_DETECT_DISKS,
     .default_modules = NULL,
     .show_modules = &disk_show_modules,
     .set_modules = NULL,
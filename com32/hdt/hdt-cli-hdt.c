@@ -198,6 +198,9 @@ static void goto_menu(int argc __unused, char **argv __unused,
 void main_show_summary(int argc __unused, char **argv __unused,
 		       struct s_hardware *hardware)
 {
+    /* Also reached as the hdt mode's bare "show", so probe here */
+    hdt_detect(hardware, HDT_DETECT_CPU | HDT_DETECT_MEMORY |
+	       HDT_DETECT_PCI | HDT_DETECT_PXE);
     reset_more_printf();
     clear_screen();
     main_show_cpu(argc, argv, hardware);
@@ -388,26 +391,31 @@ struct cli_callback_descr list_hdt_show_modules[] = {
      .name = CLI_PCI,
      .exec = main_show_pci,
      .nomodule = false,
+     .detect = HDT_DETECT_PCI,
      },
     {
      .name = CLI_DMI,
      .exec = main_show_dmi,
      .nomodule = false,
+     .detect = HDT_DETECT_DMI,
      },
     {
      .name = CLI_CPU,
      .exec = main_show_cpu,
      .nomodule = false,
+     .detect = HDT_DETECT_CPU,
      },
     {
      .name = CLI_DISK,
      .exec = disks_summary,
      .nomodule = false,
+     .detect = HDT_DETECT_DISKS,
      },
     {
      .name = CLI_PXE,
      .exec = main_show_pxe,
      .nomodule = false,
+     .detect = HDT_DETECT_PXE,
      },
     {
      .name = CLI_SYSLINUX,
@@ -418,11 +426,13 @@ struct cli_callback_descr list_hdt_show_modules[] = {
      .name = CLI_KERNEL,
      .exec = main_show_kernel,
      .nomodule = false,
+     .detect = HDT_DETECT_PCI,
      },
     {
      .name = CLI_VESA,
      .exec = main_show_vesa,
      .nomodule = false,
+     .detect = HDT_DETECT_VESA,
      },
     {
      .name = CLI_HDT,
@@ -433,16 +443,19 @@ struct cli_callback_descr list_hdt_show_modules[] = {
      .name = CLI_VPD,
      .exec = main_show_vpd,
      .nomodule = false,
+     .detect = HDT_DETECT_VPD,
      },
     {
      .name = CLI_MEMORY,
      .exec = show_dmi_memory_modules,
      .nomodule = false,
+     .detect = HDT_DETECT_DMI | HDT_DETECT_MEMORY,
      },
     {
      .name = CLI_ACPI,
      .exec = main_show_acpi,
      .nomodule = false,
+     .detect = HDT_DETECT_ACPI,
      },
     {
      .name = "modes",
@@ -142,6 +142,7 @@ struct cli_module_descr kernel_show_modules = {
 struct cli_mode_descr kernel_mode = {
     .mode = KERNEL_MODE,
     .name = CLI_KERNEL,
+    .detect = HDT_DETECT_PCI,
     .default_modules = NULL,
     .show_modules = &kernel_show_modules,
     .set_modules = NULL,
@@ -133,6 +133,7 @@ struct cli_module_descr memory_show_modules = {
 struct cli_mode_descr memory_mode = {
     .mode = MEMORY_MODE,
     .name = CLI_MEMORY,
+    .detect = HDT_DETECT_DMI | HDT_DETECT_MEMORY,
     .default_modules = NULL,
     .show_modules = &memory_show_modules,
     .set_modules = NULL,
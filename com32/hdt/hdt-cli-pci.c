@@ -288,6 +288,7 @@ struct cli_module_descr pci_show_modules = {
 struct cli_mode_descr pci_mode = {
     .mode = PCI_MODE,
     .name = CLI_PCI,
+    .detect = HDT_DETECT_PCI,
     .default_modules = NULL,
     .show_modules = &pci_show_modules,
     .set_modules = NULL,
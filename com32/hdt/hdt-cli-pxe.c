@@ -91,6 +91,7 @@ struct cli_module_descr pxe_show_modules = {
 struct cli_mode_descr pxe_mode = {
     .mode = PXE_MODE,
     .name = CLI_PXE,
+    .detect = HDT_DETECT_PXE,
     .default_modules = NULL,
     .show_modules = &pxe_show_modules,
     .set_modules = NULL,
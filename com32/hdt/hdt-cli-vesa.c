@@ -139,6 +139,7 @@ struct cli_module_descr vesa_commands = {
 struct cli_mode_descr vesa_mode = {
     .mode = VESA_MODE,
     .name = CLI_VESA,
+    .detect = HDT_DETECT_VESA,
     .default_modules = &vesa_commands,
     .show_modules = &vesa_show_modules,
     .set_modules = NULL,
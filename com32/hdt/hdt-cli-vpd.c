@@ -74,6 +74,7 @@ struct cli_module_descr vpd_show_modules = {
 struct cli_mode_descr vpd_mode = {
     .mode = VPD_MODE,
     .name = CLI_VPD,
+    .detect = HDT_DETECT_VPD,
     .default_modules = NULL,
     .show_modules = &vpd_show_modules,
     .set_modules = NULL,
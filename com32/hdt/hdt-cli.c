@@ -120,8 +120,14 @@ static void autocomplete_destroy_list(void)
  **/
 void set_mode(cli_mode_t mode, struct s_hardware *hardware)
 {
+    struct cli_mode_descr *mode_descr;
     int i = 0;
 
+    /* Probe what the mode shows before checking it has anything to show */
+    find_cli_mode_descr(mode, &mode_descr);
+    if (mode_descr != NULL)
+	hdt_detect(hardware, mode_descr->detect);
+
     switch (mode) {
     case EXIT_MODE:
 	hdt_cli.mode = mode;
@@ -612,6 +618,16 @@ out:
     return;
 }
 
+/**
+ * run_callback - probe what a callback needs, then call it
+ **/
+static void run_callback(struct cli_callback_descr *callback, int argc,
+			 char **argv, struct s_hardware *hardware)
+{
+    hdt_detect(hardware, callback->detect);
+    callback->exec(argc, argv, hardware);
+}
+
 /**
  * exec_command - main logic to map the command line to callbacks
  **/
@@ -663,7 +679,7 @@ static void exec_command(char *line, struct s_hardware *hardware)
 	}
 
 	if (current_module != NULL)
-	    current_module->exec(argc, argv, hardware);
+	    run_callback(current_module, argc, argv, hardware);
 	else if (!strncmp(command, CLI_SHOW, sizeof(CLI_SHOW) - 1) &&
 		 current_mode->show_modules != NULL &&
 		 current_mode->show_modules->default_callback != NULL)
@@ -676,7 +692,7 @@ static void exec_command(char *line, struct s_hardware *hardware)
 	    find_cli_callback_descr(command, hdt_mode.default_modules,
 				    &current_module);
 	    if (current_module != NULL)
-		current_module->exec(argc, argv, hardware);
+		run_callback(current_module, argc, argv, hardware);
 	    else
 		more_printf("unknown command: '%s'\n", command);
 	}
@@ -700,7 +716,7 @@ static void exec_command(char *line, struct s_hardware *hardware)
 				    &current_module);
 	    /* Execute the callback, if found */
 	    if (current_module != NULL)
-		current_module->exec(argc, argv, hardware);
+		run_callback(current_module, argc, argv, hardware);
 	    else {
 		dprintf("CLI DEBUG exec: Looking for callback\n");
 		/* Look now for a 'show' callback in the hdt mode */
@@ -708,7 +724,7 @@ static void exec_command(char *line, struct s_hardware *hardware)
 					&current_module);
 		/* Execute the callback, if found */
 		if (current_module != NULL)
-		    current_module->exec(argc, argv, hardware);
+		    run_callback(current_module, argc, argv, hardware);
 		else
 		    printf("unknown module: '%s'\n", module);
 	    }
@@ -719,14 +735,14 @@ static void exec_command(char *line, struct s_hardware *hardware)
 				    &current_module);
 	    /* Execute the callback, if found */
 	    if (current_module != NULL)
-		current_module->exec(argc, argv, hardware);
+		run_callback(current_module, argc, argv, hardware);
 	    else {
 		/* Look now for a 'set' callback in the hdt mode */
 		find_cli_callback_descr(module, hdt_mode.set_modules,
 					&current_module);
 		/* Execute the callback, if found */
 		if (current_module != NULL)
-		    current_module->exec(argc, argv, hardware);
+		    run_callback(current_module, argc, argv, hardware);
 		else
 		    printf("unknown module: '%s'\n", module);
 	    }
@@ -104,6 +104,8 @@ struct s_cli hdt_cli;
 struct cli_mode_descr {
     const unsigned int mode;
     const char *name;
+    /* HDT_DETECT_* bits to probe on entering the mode */
+    unsigned int detect;
     /* Handle 1-token commands */
     struct cli_module_descr *default_modules;
     /* Handle show <module> <args> */
@@ -124,6 +126,7 @@ struct cli_callback_descr {
     const char *name;
     void (*exec) (int argc, char **argv, struct s_hardware * hardware);
     bool nomodule;
+    unsigned int detect;	/* HDT_DETECT_* bits the callback needs */
 };
 
 /* Manage aliases */
@@ -206,6 +206,7 @@ void init_hardware(struct s_hardware *hardware)
     hardware->vpd_detection = false;
     hardware->memory_detection = false;
     hardware->acpi_detection = false;
+    hardware->detected = 0;
     hardware->nb_pci_devices = 0;
     hardware->is_dmi_valid = false;
     hardware->is_pxe_valid = false;
@@ -743,50 +744,87 @@ void init_console(struct s_hardware *hardware)
 	console_ansi_raw();
 }
 
-void detect_hardware(struct s_hardware *hardware)
+/*
+ * Run the detectors in WHAT, along with those they depend on, unless
+ * they have already run.  Probing is done when something first needs
+ * the results rather than all at startup, as some detectors (disks,
+ * PXE, VESA) can take a long while on real hardware.
+ */
+void hdt_detect(struct s_hardware *hardware, unsigned int what)
 {
-    if (!quiet)
-        more_printf("ACPI: Detecting\n");
-    detect_acpi(hardware);
+    if (what & HDT_DETECT_CPU)
+	what |= HDT_DETECT_DMI | HDT_DETECT_ACPI;
+    if (what & HDT_DETECT_PXE)
+	what |= HDT_DETECT_PCI;
+
+    what &= ~hardware->detected;
+    hardware->detected |= what;
+
+    if (what & HDT_DETECT_ACPI) {
+	if (!quiet)
+	    more_printf("ACPI: Detecting\n");
+	detect_acpi(hardware);
+    }
 
-    if (!quiet)
-        more_printf("MEMORY: Detecting\n");
-    detect_memory(hardware);
+    if (what & HDT_DETECT_MEMORY) {
+	if (!quiet)
+	    more_printf("MEMORY: Detecting\n");
+	detect_memory(hardware);
+    }
 
-    if (!quiet)
-        more_printf("DMI: Detecting Table\n");
-    if (detect_dmi(hardware) == -ENODMITABLE) {
-        more_printf("DMI: ERROR ! Table not found ! \n");
-        more_printf("DMI: Many hardware components will not be detected ! \n");
-    } else {
-        if (!quiet)
-            more_printf("DMI: Table found ! (version %u.%u)\n",
-                        hardware->dmi.dmitable.major_version,
-                        hardware->dmi.dmitable.minor_version);
+    if (what & HDT_DETECT_DMI) {
+	if (!quiet)
+	    more_printf("DMI: Detecting Table\n");
+	if (detect_dmi(hardware) == -ENODMITABLE) {
+	    more_printf("DMI: ERROR ! Table not found ! \n");
+	    more_printf("DMI: Many hardware components will not be detected ! \n");
+	} else {
+	    if (!quiet)
+		more_printf("DMI: Table found ! (version %u.%u)\n",
+			    hardware->dmi.dmitable.major_version,
+			    hardware->dmi.dmitable.minor_version);
+	}
     }
 
-    if (!quiet)
-        more_printf("CPU: Detecting\n");
-    cpu_detect(hardware);
+    if (what & HDT_DETECT_CPU) {
+	if (!quiet)
+	    more_printf("CPU: Detecting\n");
+	cpu_detect(hardware);
+    }
 
-    if (!quiet)
-        more_printf("DISKS: Detecting\n");
-    detect_disks(hardware);
+    if (what & HDT_DETECT_DISKS) {
+	if (!quiet)
+	    more_printf("DISKS: Detecting\n");
+	detect_disks(hardware);
+    }
 
-    if (!quiet)
-        more_printf("VPD: Detecting\n");
-    detect_vpd(hardware);
+    if (what & HDT_DETECT_VPD) {
+	if (!quiet)
+	    more_printf("VPD: Detecting\n");
+	detect_vpd(hardware);
+    }
 
-    detect_pci(hardware);
-    if (!quiet)
-        more_printf("PCI: %d Devices Found\n", hardware->nb_pci_devices);
- 
-   if (!quiet)
-        more_printf("PXE: Detecting\n");
-    detect_pxe(hardware);
+    if (what & HDT_DETECT_PCI) {
+	detect_pci(hardware);
+	if (!quiet)
+	    more_printf("PCI: %d Devices Found\n", hardware->nb_pci_devices);
+    }
 
-    if (!quiet)
-        more_printf("VESA: Detecting\n");
-    detect_vesa(hardware);
+    if (what & HDT_DETECT_PXE) {
+	if (!quiet)
+	    more_printf("PXE: Detecting\n");
+	detect_pxe(hardware);
+    }
+
+    if (what & HDT_DETECT_VESA) {
+	if (!quiet)
+	    more_printf("VESA: Detecting\n");
+	detect_vesa(hardware);
+    }
+}
+
+void detect_hardware(struct s_hardware *hardware)
+{
+    hdt_detect(hardware, HDT_DETECT_ALL);
 }
 
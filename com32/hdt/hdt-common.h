@@ -209,6 +209,7 @@ struct s_hardware {
     bool vpd_detection;		/* Does the vpd stuff has already been detected? */
     bool memory_detection;	/* Does the memory size got detected ?*/
     bool acpi_detection;	/* Does the acpi got detected ?*/
+    unsigned int detected;	/* HDT_DETECT_* bits hdt_detect() has run */
 
     char syslinux_fs[22];
     const struct syslinux_version *sv;
@@ -224,6 +225,18 @@ struct s_hardware {
     char postexec[255];
 };
 
+/* Detectors for hdt_detect(); each one runs at most once */
+#define HDT_DETECT_ACPI		(1 << 0)
+#define HDT_DETECT_MEMORY	(1 << 1)
+#define HDT_DETECT_DMI		(1 << 2)
+#define HDT_DETECT_CPU		(1 << 3)
+#define HDT_DETECT_DISKS	(1 << 4)
+#define HDT_DETECT_VPD		(1 << 5)
+#define HDT_DETECT_PCI		(1 << 6)
+#define HDT_DETECT_PXE		(1 << 7)
+#define HDT_DETECT_VESA		(1 << 8)
+#define HDT_DETECT_ALL		((1 << 9) - 1)
+
 void reset_more_printf(void);
 const char *find_argument(const char **argv, const char *argument);
 char *remove_spaces(char *p);
@@ -245,6 +258,7 @@ void detect_parameters(const int argc, const char *argv[],
 int detect_vesa(struct s_hardware *hardware);
 void detect_memory(struct s_hardware *hardware);
 void init_console(struct s_hardware *hardware);
+void hdt_detect(struct s_hardware *hardware, unsigned int what);
 void detect_hardware(struct s_hardware *hardware);
 void dump(struct s_hardware *hardware);
 #endif
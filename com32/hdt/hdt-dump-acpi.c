@@ -29,7 +29,7 @@
 #include "hdt-common.h"
 #include "hdt-dump.h"
 
-void show_header(char *name, void *address, s_acpi_description_header *h, ZZJSON_CONFIG *config, ZZJSON **item)
+void show_header(char *name, void *address, s_acpi_description_header *h, struct json_writer *json)
 {
 	char signature[10]={0};
 	char revision[10]={0};
@@ -80,7 +80,7 @@ void show_header(char *name, void *address, s_acpi_description_header *h, ZZJSON
 
 }
 
-void dump_rsdt(s_acpi * acpi, ZZJSON_CONFIG * config, ZZJSON ** item)
+void dump_rsdt(s_acpi * acpi, struct json_writer *json)
 {
 	char valid[8]={0};
 	snprintf(valid,sizeof(valid),"%s","false");
@@ -97,10 +97,10 @@ void dump_rsdt(s_acpi * acpi, ZZJSON_CONFIG * config, ZZJSON ** item)
 		return;
 	}
 
-	show_header("rsdt",acpi->rsdt.address, &acpi->rsdt.header, config, item);	
+	show_header("rsdt",acpi->rsdt.address, &acpi->rsdt.header, json);	
 }
 
-void dump_xsdt(s_acpi * acpi, ZZJSON_CONFIG * config, ZZJSON ** item)
+void dump_xsdt(s_acpi * acpi, struct json_writer *json)
 {
 	char valid[8]={0};
 	snprintf(valid,sizeof(valid),"%s","false");
@@ -117,10 +117,10 @@ void dump_xsdt(s_acpi * acpi, ZZJSON_CONFIG * config, ZZJSON ** item)
 		return;
 	}
 
-	show_header("xsdt",acpi->xsdt.address, &acpi->xsdt.header, config, item);	
+	show_header("xsdt",acpi->xsdt.address, &acpi->xsdt.header, json);	
 }
 
-void dump_fadt(s_acpi * acpi, ZZJSON_CONFIG * config, ZZJSON ** item)
+void dump_fadt(s_acpi * acpi, struct json_writer *json)
 {
 	char valid[8]={0};
 	snprintf(valid,sizeof(valid),"%s","false");
@@ -137,10 +137,10 @@ void dump_fadt(s_acpi * acpi, ZZJSON_CONFIG * config, ZZJSON ** item)
 		return;
 	}
 
-	show_header("fadt",acpi->fadt.address, &acpi->fadt.header, config, item);	
+	show_header("fadt",acpi->fadt.address, &acpi->fadt.header, json);	
 }
 
-void dump_dsdt(s_acpi * acpi, ZZJSON_CONFIG * config, ZZJSON ** item)
+void dump_dsdt(s_acpi * acpi, struct json_writer *json)
 {
 	char valid[8]={0};
 	snprintf(valid,sizeof(valid),"%s","false");
@@ -157,10 +157,10 @@ void dump_dsdt(s_acpi * acpi, ZZJSON_CONFIG * config, ZZJSON ** item)
 		return;
 	}
 
-	show_header("dsdt",acpi->dsdt.address, &acpi->dsdt.header, config, item);	
+	show_header("dsdt",acpi->dsdt.address, &acpi->dsdt.header, json);	
 }
 
-void dump_sbst(s_acpi * acpi, ZZJSON_CONFIG * config, ZZJSON ** item)
+void dump_sbst(s_acpi * acpi, struct json_writer *json)
 {
 	char valid[8]={0};
 	snprintf(valid,sizeof(valid),"%s","false");
@@ -177,10 +177,10 @@ void dump_sbst(s_acpi * acpi, ZZJSON_CONFIG * config, ZZJSON ** item)
 		return;
 	}
 
-	show_header("sbst",acpi->sbst.address, &acpi->sbst.header, config, item);	
+	show_header("sbst",acpi->sbst.address, &acpi->sbst.header, json);	
 }
 
-void dump_ecdt(s_acpi * acpi, ZZJSON_CONFIG * config, ZZJSON ** item)
+void dump_ecdt(s_acpi * acpi, struct json_writer *json)
 {
 	char valid[8]={0};
 	snprintf(valid,sizeof(valid),"%s","false");
@@ -197,10 +197,10 @@ void dump_ecdt(s_acpi * acpi, ZZJSON_CONFIG * config, ZZJSON ** item)
 		return;
 	}
 
-	show_header("ecdt",acpi->ecdt.address, &acpi->ecdt.header, config, item);	
+	show_header("ecdt",acpi->ecdt.address, &acpi->ecdt.header, json);	
 }
 
-void dump_hpet(s_acpi * acpi, ZZJSON_CONFIG * config, ZZJSON ** item)
+void dump_hpet(s_acpi * acpi, struct json_writer *json)
 {
 	char valid[8]={0};
 	snprintf(valid,sizeof(valid),"%s","false");
@@ -217,10 +217,10 @@ void dump_hpet(s_acpi * acpi, ZZJSON_CONFIG * config, ZZJSON ** item)
 		return;
 	}
 
-	show_header("hpet",acpi->hpet.address, &acpi->hpet.header, config, item);	
+	show_header("hpet",acpi->hpet.address, &acpi->hpet.header, json);	
 }
 
-void dump_tcpa(s_acpi * acpi, ZZJSON_CONFIG * config, ZZJSON ** item)
+void dump_tcpa(s_acpi * acpi, struct json_writer *json)
 {
 	char valid[8]={0};
 	snprintf(valid,sizeof(valid),"%s","false");
@@ -237,10 +237,10 @@ void dump_tcpa(s_acpi * acpi, ZZJSON_CONFIG * config, ZZJSON ** item)
 		return;
 	}
 
-	show_header("tcpa",acpi->tcpa.address, &acpi->tcpa.header, config, item);	
+	show_header("tcpa",acpi->tcpa.address, &acpi->tcpa.header, json);	
 }
 
-void dump_mcfg(s_acpi * acpi, ZZJSON_CONFIG * config, ZZJSON ** item)
+void dump_mcfg(s_acpi * acpi, struct json_writer *json)
 {
 	char valid[8]={0};
 	snprintf(valid,sizeof(valid),"%s","false");
@@ -257,10 +257,10 @@ void dump_mcfg(s_acpi * acpi, ZZJSON_CONFIG * config, ZZJSON ** item)
 		return;
 	}
 
-	show_header("mcfg",acpi->mcfg.address, &acpi->mcfg.header, config, item);	
+	show_header("mcfg",acpi->mcfg.address, &acpi->mcfg.header, json);	
 }
 
-void dump_slic(s_acpi * acpi, ZZJSON_CONFIG * config, ZZJSON ** item)
+void dump_slic(s_acpi * acpi, struct json_writer *json)
 {
 	char valid[8]={0};
 	snprintf(valid,sizeof(valid),"%s","false");
@@ -277,11 +277,11 @@ void dump_slic(s_acpi * acpi, ZZJSON_CONFIG * config, ZZJSON ** item)
 		return;
 	}
 
-	show_header("slic",acpi->slic.address, &acpi->slic.header, config, item);	
+	show_header("slic",acpi->slic.address, &acpi->slic.header, json);	
 }
 
 
-void dump_boot(s_acpi * acpi, ZZJSON_CONFIG * config, ZZJSON ** item)
+void dump_boot(s_acpi * acpi, struct json_writer *json)
 {
 	char valid[8]={0};
 	snprintf(valid,sizeof(valid),"%s","false");
@@ -298,10 +298,10 @@ void dump_boot(s_acpi * acpi, ZZJSON_CONFIG * config, ZZJSON ** item)
 		return;
 	}
 
-	show_header("boot",acpi->boot.address, &acpi->boot.header, config, item);	
+	show_header("boot",acpi->boot.address, &acpi->boot.header, json);	
 }
 
-void dump_madt(s_acpi * acpi, ZZJSON_CONFIG * config, ZZJSON ** item)
+void dump_madt(s_acpi * acpi, struct json_writer *json)
 {
 	char valid[8]={0};
 	snprintf(valid,sizeof(valid),"%s","false");
@@ -318,10 +318,10 @@ void dump_madt(s_acpi * acpi, ZZJSON_CONFIG * config, ZZJSON ** item)
 		return;
 	}
 
-	show_header("madt",acpi->madt.address, &acpi->madt.header, config, item);	
+	show_header("madt",acpi->madt.address, &acpi->madt.header, json);	
 }
 
-void dump_ssdt(s_ssdt *ssdt, ZZJSON_CONFIG * config, ZZJSON ** item)
+void dump_ssdt(s_ssdt *ssdt, struct json_writer *json)
 {
 	char valid[8]={0};
 	snprintf(valid,sizeof(valid),"%s","false");
@@ -338,10 +338,10 @@ void dump_ssdt(s_ssdt *ssdt, ZZJSON_CONFIG * config, ZZJSON ** item)
 		return;
 	}
 
-	show_header("ssdt",ssdt->address, &ssdt->header, config, item);	
+	show_header("ssdt",ssdt->address, &ssdt->header, json);	
 }
 
-void dump_rsdp(s_acpi * acpi, ZZJSON_CONFIG * config, ZZJSON ** item)
+void dump_rsdp(s_acpi * acpi, struct json_writer *json)
 {
 	char valid[8]={0};
 	snprintf(valid,sizeof(valid),"%s","false");
@@ -375,7 +375,7 @@ void dump_rsdp(s_acpi * acpi, ZZJSON_CONFIG * config, ZZJSON ** item)
 
 }
 
-void dump_facs(s_acpi * acpi, ZZJSON_CONFIG * config, ZZJSON ** item)
+void dump_facs(s_acpi * acpi, struct json_writer *json)
 {
 	char valid[8]={0};
 	snprintf(valid,sizeof(valid),"%s","false");
@@ -403,7 +403,7 @@ void dump_facs(s_acpi * acpi, ZZJSON_CONFIG * config, ZZJSON ** item)
 
 }
 
-void dump_interrupt_source_override(s_madt * madt, ZZJSON_CONFIG * config, ZZJSON ** item)
+void dump_interrupt_source_override(s_madt * madt, struct json_writer *json)
 {
     CREATE_ARRAY
 	add_as("acpi.item","interrupt_source_override")
@@ -438,7 +438,7 @@ void dump_interrupt_source_override(s_madt * madt, ZZJSON_CONFIG * config, ZZJSO
     FLUSH_OBJECT;
 }
 
-void dump_io_apic(s_madt * madt, ZZJSON_CONFIG * config, ZZJSON ** item)
+void dump_io_apic(s_madt * madt, struct json_writer *json)
 {
     CREATE_ARRAY
 	add_as("acpi.item","io_apic")
@@ -486,7 +486,7 @@ void dump_io_apic(s_madt * madt, ZZJSON_CONFIG * config, ZZJSON ** item)
     FLUSH_OBJECT;
 }
 
-void dump_local_apic_nmi(s_madt * madt, ZZJSON_CONFIG * config, ZZJSON ** item)
+void dump_local_apic_nmi(s_madt * madt, struct json_writer *json)
 {
     CREATE_ARRAY
 	add_as("acpi.item","local_apic_nmi")
@@ -515,7 +515,7 @@ void dump_local_apic_nmi(s_madt * madt, ZZJSON_CONFIG * config, ZZJSON ** item)
     FLUSH_OBJECT;
 }
 
-void dump_local_apic(s_madt * madt, ZZJSON_CONFIG * config, ZZJSON ** item)
+void dump_local_apic(s_madt * madt, struct json_writer *json)
 {
     char buffer[16] = { 0 };
     snprintf(buffer, sizeof(buffer), "0x%08x", madt->local_apic_address);
@@ -555,8 +555,7 @@ void dump_local_apic(s_madt * madt, ZZJSON_CONFIG * config, ZZJSON ** item)
     FLUSH_OBJECT;
 }
 
-void dump_acpi(struct s_hardware *hardware, ZZJSON_CONFIG * config,
-	       ZZJSON ** item)
+void dump_acpi(struct s_hardware *hardware, struct json_writer *json)
 {
     CREATE_NEW_OBJECT;
     add_hb(is_acpi_valid);
@@ -571,30 +570,31 @@ void dump_acpi(struct s_hardware *hardware, ZZJSON_CONFIG * config,
 
     FLUSH_OBJECT;
 
-    dump_local_apic(madt, config, item);
-    dump_local_apic_nmi(madt, config, item);
-    dump_io_apic(madt, config, item);
-    dump_interrupt_source_override(madt, config, item);
-
-    dump_rsdp(&hardware->acpi,config,item);
-    dump_rsdt(&hardware->acpi,config,item);
-    dump_xsdt(&hardware->acpi,config,item);
-    dump_fadt(&hardware->acpi,config,item);
-    dump_dsdt(&hardware->acpi,config,item);
-    dump_sbst(&hardware->acpi,config,item);
-    dump_ecdt(&hardware->acpi,config,item);
-    dump_hpet(&hardware->acpi,config,item);
-    dump_tcpa(&hardware->acpi,config,item);
-    dump_mcfg(&hardware->acpi,config,item);
-    dump_slic(&hardware->acpi,config,item);
-    dump_boot(&hardware->acpi,config,item);
-    dump_madt(&hardware->acpi,config,item);
+    dump_local_apic(madt, json);
+    dump_local_apic_nmi(madt, json);
+    dump_io_apic(madt, json);
+    dump_interrupt_source_override(madt, json);
+
+    dump_rsdp(&hardware->acpi,json);
+    dump_rsdt(&hardware->acpi,json);
+    dump_xsdt(&hardware->acpi,json);
+    dump_fadt(&hardware->acpi,json);
+    dump_dsdt(&hardware->acpi,json);
+    dump_sbst(&hardware->acpi,json);
+    dump_ecdt(&hardware->acpi,json);
+    dump_hpet(&hardware->acpi,json);
+    dump_tcpa(&hardware->acpi,json);
+    dump_mcfg(&hardware->acpi,json);
+    dump_slic(&hardware->acpi,json);
+    dump_boot(&hardware->acpi,json);
+    dump_madt(&hardware->acpi,json);
     for (int i = 0; i < hardware->acpi.ssdt_count; i++) {
             if ((hardware->acpi.ssdt[i] != NULL) && (hardware->acpi.ssdt[i]->valid))
-		    dump_ssdt(hardware->acpi.ssdt[i], config, item);
+		    dump_ssdt(hardware->acpi.ssdt[i], json);
     }
-    dump_facs(&hardware->acpi,config,item);
+    dump_facs(&hardware->acpi,json);
 
 exit:
+    FLUSH_OBJECT;
     to_cpio("acpi");
 }
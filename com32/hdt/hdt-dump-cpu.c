@@ -29,7 +29,7 @@
 #include "hdt-common.h"
 #include "hdt-dump.h"
 
-void dump_cpu(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON **item) {
+void dump_cpu(struct s_hardware *hardware, struct json_writer *json) {
 
         CREATE_NEW_OBJECT;
 	add_hs(cpu.vendor);
@@ -30,8 +30,8 @@
 #include "hdt-dump.h"
 #include "hdt-util.h"
 
-ZZJSON_CONFIG *config;
-ZZJSON **item;
+/* For show_partition_information(), which parse_partition_table() calls */
+static struct json_writer *json;
 
 static void show_partition_information(struct driveinfo *drive_info,
                                        struct part_entry *ptab,
@@ -74,9 +74,8 @@ static void show_partition_information(struct driveinfo *drive_info,
 
 
 
-void show_disk(struct s_hardware *hardware, ZZJSON_CONFIG *conf, ZZJSON **it, int drive) {
-	config=conf;
-	item=it;
+void show_disk(struct s_hardware *hardware, struct json_writer *js, int drive) {
+	json=js;
 	int i = drive - 0x80;
 	struct driveinfo *d = &hardware->disk_info[i];
 	char mbr_name[50]={0};
@@ -90,9 +89,8 @@ void show_disk(struct s_hardware *hardware, ZZJSON_CONFIG *conf, ZZJSON **it, in
 	char edd_version[5]={0};
 	snprintf(disk,sizeof(disk),"0x%X",d->disk);
 	snprintf(edd_version,sizeof(edd_version),"%X",d->edd_version);
-	zzjson_print(config, *item);
-	zzjson_free(config, *item);
 
+	/* This ends what came before it */
 	CREATE_ARRAY
 		add_as("disk->number",disk) 
 		add_ai("disk->cylinders",d->legacy_max_cylinder +1) 
@@ -121,7 +119,8 @@ void show_disk(struct s_hardware *hardware, ZZJSON_CONFIG *conf, ZZJSON **it, in
 	}
 }
 
-void dump_disks(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON **item) {
+void dump_disks(struct s_hardware *hardware, struct json_writer *js) {
+	json=js;
 	bool found=false;
 
  	if (hardware->disks_count > 0)  
@@ -132,7 +131,7 @@ void dump_disks(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON **ite
 				add_b("disks->is_valid",true);
        				found=true;
 			}
-			show_disk(hardware, config, item, drive);
+			show_disk(hardware, json, drive);
 		}
 	}
 
@@ -29,7 +29,7 @@
 #include "hdt-common.h"
 #include "hdt-dump.h"
 
-void dump_hardware_security(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON **item) {
+void dump_hardware_security(struct s_hardware *hardware, struct json_writer *json) {
 	if (!hardware->dmi.hardware_security.filled) {
 			CREATE_NEW_OBJECT;
 				add_s("dmi.warning","No hardware security structure found");
@@ -46,7 +46,7 @@ void dump_hardware_security(struct s_hardware *hardware, ZZJSON_CONFIG *config,
 	FLUSH_OBJECT;
 }
 
-void dump_oem_strings(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON **item) {
+void dump_oem_strings(struct s_hardware *hardware, struct json_writer *json) {
 	if (strlen(hardware->dmi.oem_strings) == 0) {
 			CREATE_NEW_OBJECT;
 				add_s("dmi.warning","No OEM structure found");
@@ -59,7 +59,7 @@ void dump_oem_strings(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON
 	FLUSH_OBJECT;
 }
 
-void dump_memory_size(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON **item) {
+void dump_memory_size(struct s_hardware *hardware, struct json_writer *json) {
 	CREATE_NEW_OBJECT;
 		add_s("dmi.item","memory size");
 		add_i("dmi.memory_size (KB)",hardware->detected_memory_size);
@@ -67,7 +67,7 @@ void dump_memory_size(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON
 	FLUSH_OBJECT;
 }
 
-void dump_memory_modules(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON **item) {
+void dump_memory_modules(struct s_hardware *hardware, struct json_writer *json) {
 
 	if (hardware->dmi.memory_module_count == 0) {
 			CREATE_NEW_OBJECT;
@@ -100,7 +100,7 @@ void dump_memory_modules(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJ
 	}
 }
 	
-void dump_cache(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON **item) {
+void dump_cache(struct s_hardware *hardware, struct json_writer *json) {
 
 	if (hardware->dmi.cache_count == 0) {
 			CREATE_NEW_OBJECT;
@@ -127,7 +127,7 @@ void dump_cache(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON **ite
 		FLUSH_OBJECT;
 	}
 }
-void dump_memory_banks(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON **item) {
+void dump_memory_banks(struct s_hardware *hardware, struct json_writer *json) {
 
 	if (hardware->dmi.memory_count == 0) {
 			CREATE_NEW_OBJECT;
@@ -169,7 +169,7 @@ void dump_memory_banks(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSO
 	}
 }
 
-void dump_processor(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON **item) {
+void dump_processor(struct s_hardware *hardware, struct json_writer *json) {
 	if (hardware->dmi.processor.filled == false) {
 		CREATE_NEW_OBJECT;
 			add_s("dmi.warning","no processor structure found");
@@ -217,7 +217,7 @@ void dump_processor(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON *
 	FLUSH_OBJECT;
 }
 
-void dump_battery(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON **item) {
+void dump_battery(struct s_hardware *hardware, struct json_writer *json) {
 	if (hardware->dmi.battery.filled == false) {
 		CREATE_NEW_OBJECT;
 			add_s("dmi.warning","no battery structure found");
@@ -242,7 +242,7 @@ void dump_battery(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON **i
 	FLUSH_OBJECT;
 }
 
-void dump_ipmi(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON **item) {
+void dump_ipmi(struct s_hardware *hardware, struct json_writer *json) {
 	if (hardware->dmi.ipmi.filled == false) {
 		CREATE_NEW_OBJECT;
 			add_s("dmi.warning","no IPMI structure found");
@@ -273,7 +273,7 @@ void dump_ipmi(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON **item
 	FLUSH_OBJECT;
 }
 
-void dump_chassis(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON **item) {
+void dump_chassis(struct s_hardware *hardware, struct json_writer *json) {
 	if (hardware->dmi.chassis.filled == false) {
 		CREATE_NEW_OBJECT;
 			add_s("dmi.warning","no chassis structure found");
@@ -299,7 +299,7 @@ void dump_chassis(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON **i
 	FLUSH_OBJECT;
 }
 
-void dump_bios(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON **item) {
+void dump_bios(struct s_hardware *hardware, struct json_writer *json) {
 	if (hardware->dmi.bios.filled == false) {
 		CREATE_NEW_OBJECT;
 			add_s("dmi.warning","no bios structure found");
@@ -343,7 +343,7 @@ void dump_bios(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON **item
 	FLUSH_OBJECT;
 }
 
-void dump_system(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON **item) {
+void dump_system(struct s_hardware *hardware, struct json_writer *json) {
 
 	if (hardware->dmi.system.filled == false) {
 		CREATE_NEW_OBJECT;
@@ -379,7 +379,7 @@ void dump_system(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON **it
 	FLUSH_OBJECT;
 }
 
-void dump_base_board(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON **item) {
+void dump_base_board(struct s_hardware *hardware, struct json_writer *json) {
 
 	if (hardware->dmi.base_board.filled == false) {
 		CREATE_NEW_OBJECT;
@@ -414,7 +414,7 @@ void dump_base_board(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON
 	FLUSH_OBJECT;
 }
 
-void dump_dmi(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON **item) {
+void dump_dmi(struct s_hardware *hardware, struct json_writer *json) {
 
 	CREATE_NEW_OBJECT;
 	add_hb(is_dmi_valid);
@@ -429,19 +429,19 @@ void dump_dmi(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON **item)
 		FLUSH_OBJECT;
 	}
 
-	dump_base_board(hardware,config,item);
-	dump_system(hardware,config,item);
-	dump_bios(hardware,config,item);
-	dump_chassis(hardware,config,item);
-	dump_ipmi(hardware,config,item);
-	dump_battery(hardware,config,item);
-	dump_processor(hardware,config,item);
-	dump_cache(hardware,config,item);
-	dump_memory_banks(hardware,config,item);
-	dump_memory_modules(hardware,config,item);
-	dump_memory_size(hardware,config,item);
-	dump_oem_strings(hardware,config,item);
-	dump_hardware_security(hardware,config,item);
+	dump_base_board(hardware,json);
+	dump_system(hardware,json);
+	dump_bios(hardware,json);
+	dump_chassis(hardware,json);
+	dump_ipmi(hardware,json);
+	dump_battery(hardware,json);
+	dump_processor(hardware,json);
+	dump_cache(hardware,json);
+	dump_memory_banks(hardware,json);
+	dump_memory_modules(hardware,json);
+	dump_memory_size(hardware,json);
+	dump_oem_strings(hardware,json);
+	dump_hardware_security(hardware,json);
 exit:
 	to_cpio("dmi");
 }
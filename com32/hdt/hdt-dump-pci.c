@@ -29,8 +29,7 @@
 #include "hdt-common.h"
 #include "hdt-dump.h"
 
-void dump_pci(struct s_hardware *hardware, ZZJSON_CONFIG * config,
-	      ZZJSON ** item)
+void dump_pci(struct s_hardware *hardware, struct json_writer *json)
 {
     int i = 1;
     struct pci_device *pci_device=NULL;
@@ -31,7 +31,7 @@
 #include <sys/gpxe.h>
 #include <netinet/in.h>
 
-void dump_pxe(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON **item) {
+void dump_pxe(struct s_hardware *hardware, struct json_writer *json) {
 	struct in_addr in;
 
 	CREATE_NEW_OBJECT;
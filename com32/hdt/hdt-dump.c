@@ -125,16 +125,28 @@ char *compute_filename(struct s_hardware *hardware)
     return filename;
 }
 
-int dumpprintf(FILE * p, const char *format, ...)
+/* The sink for the JSON writer: one file's worth, until to_cpio() */
+static int dump_write(void *handle, const void *data, size_t len)
 {
-    va_list ap;
-    int rv;
-
-    (void)p;
-    va_start(ap, format);
-    rv = vbufprintf(&p_buf, format, ap);
-    va_end(ap);
-    return rv;
+    struct print_buf *b = handle;
+    size_t size;
+    char *buf;
+
+    if (b->len + len >= b->size) {
+	size = b->size ? b->size : BUFPAD;
+	while (b->len + len >= size)
+	    size <<= 1;
+	buf = realloc(b->buf, size);
+	if (!buf)
+	    return -1;
+	b->buf = buf;
+	b->size = size;
+    }
+
+    memcpy(b->buf + b->len, data, len);
+    b->len += len;
+    b->buf[b->len] = '\0';
+    return len;
 }
 
 void to_cpio(char *filename)
@@ -149,18 +161,13 @@ void to_cpio(char *filename)
     }
 }
 
-void flush(ZZJSON_CONFIG * config, ZZJSON ** item)
-{
-    zzjson_print(config, *item);
-    zzjson_free(config, *item);
-    *item = NULL;
-}
-
 /**
  * dump - dump info
  **/
 void dump(struct s_hardware *hardware)
 {
+    hdt_detect(hardware, HDT_DETECT_ALL);
+
     if (hardware->is_pxe_valid == false) {
 	more_printf("PXE stack was not detected, Dump feature is not available\n");
 	return;
@@ -168,17 +175,10 @@ void dump(struct s_hardware *hardware)
 
     const union syslinux_derivative_info *sdi = syslinux_derivative_info();
     int err = 0;
-    ZZJSON *json = NULL;
-    ZZJSON_CONFIG config = { ZZJSON_VERY_STRICT, NULL,
-	(int (*)(void *))fgetc,
-	NULL,
-	malloc, calloc, free, realloc,
-	stderr, NULL, stdout,
-	(int (*)(void *, const char *,...))dumpprintf,
-	(int (*)(int, void *))fputc
-    };
+    struct json_writer json;
 
     memset(&p_buf, 0, sizeof(p_buf));
+    json_init(&json, dump_write, &p_buf);
 
     /* By now, we only support TFTP reporting */
     upload = &upload_tftp;
@@ -208,18 +208,18 @@ void dump(struct s_hardware *hardware)
     /* We initiate the cpio to send */
     cpio_init(upload, (const char **)arg);
 
-    dump_cpu(hardware, &config, &json);
-    dump_pxe(hardware, &config, &json);
-    dump_syslinux(hardware, &config, &json);
-    dump_vpd(hardware, &config, &json);
-    dump_vesa(hardware, &config, &json);
-    dump_disks(hardware, &config, &json);
-    dump_dmi(hardware, &config, &json);
-    dump_memory(hardware, &config, &json);
-    dump_pci(hardware, &config, &json);
-    dump_acpi(hardware, &config, &json);
-    dump_kernel(hardware, &config, &json);
-    dump_hdt(hardware, &config, &json);
+    dump_cpu(hardware, &json);
+    dump_pxe(hardware, &json);
+    dump_syslinux(hardware, &json);
+    dump_vpd(hardware, &json);
+    dump_vesa(hardware, &json);
+    dump_disks(hardware, &json);
+    dump_dmi(hardware, &json);
+    dump_memory(hardware, &json);
+    dump_pci(hardware, &json);
+    dump_acpi(hardware, &json);
+    dump_kernel(hardware, &json);
+    dump_hdt(hardware, &json);
 
     /* We close & flush the file to send */
     cpio_close(upload);
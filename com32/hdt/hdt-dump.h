@@ -29,57 +29,82 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <ctype.h>
 #include <bufprintf.h>
-#include <zzjson/zzjson.h>
 #include "hdt-common.h"
 
+/* hdt-json.c: JSON written as the hardware is walked, with no tree */
+#define JSON_BUF	256
+#define JSON_DEPTH	2	/* An array of objects is as deep as it goes */
+
+enum json_type {
+    JSON_OBJECT,
+    JSON_ARRAY,
+};
+
+struct json_writer {
+    int (*write)(void *handle, const void *data, size_t len);
+    void *handle;
+    int err;			/* The sink failed; what is left is dropped */
+    int depth;			/* 0 when nothing is open */
+    bool first[JSON_DEPTH + 1];	/* No member yet at this depth */
+    char close[JSON_DEPTH + 1];
+    size_t len;
+    char buf[JSON_BUF];
+};
+
+void json_init(struct json_writer *w,
+	       int (*write)(void *, const void *, size_t), void *handle);
+void json_begin(struct json_writer *w, enum json_type type);
+void json_element(struct json_writer *w);
+void json_element_end(struct json_writer *w);
+void json_string(struct json_writer *w, const char *label, const char *value);
+void json_int(struct json_writer *w, const char *label, long long value);
+void json_bool(struct json_writer *w, const char *label, bool value);
+void json_end(struct json_writer *w);
+int json_flush(struct json_writer *w);
+
 // Macros to manipulate Arrays
-#define APPEND_ARRAY ZZJSON *temp_array; temp_array = zzjson_array_append(config, *item, zzjson_create_object(config,
-#define APPEND_OBJECT_ARRAY(value) ZZJSON *temp_ar; temp_ar = zzjson_array_append(config, *item, value); *item=temp_ar; 
-#define CREATE_ARRAY *item = zzjson_create_array(config, zzjson_create_object(config, 
-#define add_ai(name,value) name,zzjson_create_number_i(config,value),
+#define CREATE_ARRAY json_begin(json, JSON_ARRAY); json_element(json);
+#define APPEND_ARRAY json_element(json);
+#define add_ai(name,value) json_int(json, name, value);
 #define add_ahi(value) add_ai(#value,hardware->value)
-#define add_as(name,value) name,zzjson_create_string(config,value),
+#define add_as(name,value) json_string(json, name, value);
 #define add_ahs(value) add_as(#value,hardware->value)
-#define END_OF_ARRAY NULL),NULL)
-#define END_OF_APPEND NULL)); *item=temp_array;
+#define END_OF_ARRAY json_element_end(json);
+#define END_OF_APPEND json_element_end(json);
 
 // Macros to manipulate objects
-#define CREATE_NEW_OBJECT   *item = zzjson_create_object(config, NULL);
-#define FLUSH_OBJECT flush(config, item); 
+#define CREATE_NEW_OBJECT json_begin(json, JSON_OBJECT);
+#define FLUSH_OBJECT json_end(json);
 
 // Macros to manipulate integers as objects
-#define add_i(name,value) *item = zzjson_object_append(config, *item, name, zzjson_create_number_i(config, value))
+#define add_i(name,value) json_int(json, name, value)
 #define add_hi(value) add_i(#value,hardware->value)
 
 // Macros to manipulate strings as objects
-#define add_s(name,value) *item = zzjson_object_append(config, *item, name, zzjson_create_string(config, value))
+#define add_s(name,value) json_string(json, name, value)
 #define add_hs(value) add_s(#value,(char *)hardware->value)
 
 // Macros to manipulate bool as objects
-#define add_bool_true(name) *item = zzjson_object_append(config, *item, (char *)name, zzjson_create_true(config))
-#define add_bool_false(name) *item = zzjson_object_append(config, *item, (char*)name, zzjson_create_false(config))
-#define add_b(name,value) if (value==true) {add_bool_true(name);} else {add_bool_false(name);}
+#define add_b(name,value) json_bool(json, name, value==true)
 #define add_hb(value) add_b(#value,hardware->value)
 
 extern struct print_buf p_buf;
 
-void print_and_flush(ZZJSON_CONFIG *config, ZZJSON **item);
-int dumpprintf(FILE *p, const char *format, ...);
-void flush (ZZJSON_CONFIG *config, ZZJSON ** item);
 void to_cpio(char *filename);
 
-void dump_cpu(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON **item);
-void dump_pxe(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON **item);
-void dump_syslinux(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON **item);
-void dump_vpd(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON **item);
-void dump_vesa(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON **item);
-void dump_disks(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON **item);
-void dump_dmi(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON **item);
-void dump_memory(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON **item);
-void dump_pci(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON **item);
-void dump_acpi(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON **item);
-void dump_kernel(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON **item);
-void dump_hdt(struct s_hardware *hardware, ZZJSON_CONFIG *config, ZZJSON **item);
+void dump_cpu(struct s_hardware *hardware, struct json_writer *json);
+void dump_pxe(struct s_hardware *hardware, struct json_writer *json);
+void dump_syslinux(struct s_hardware *hardware, struct json_writer *json);
+void dump_vpd(struct s_hardware *hardware, struct json_writer *json);
+void dump_vesa(struct s_hardware *hardware, struct json_writer *json);
+void dump_disks(struct s_hardware *hardware, struct json_writer *json);
+void dump_dmi(struct s_hardware *hardware, struct json_writer *json);
+void dump_memory(struct s_hardware *hardware, struct json_writer *json);
+void dump_pci(struct s_hardware *hardware, struct json_writer *json);
+void dump_acpi(struct s_hardware *hardware, struct json_writer *json);
+void dump_kernel(struct s_hardware *hardware, struct json_writer *json);
+void dump_hdt(struct s_hardware *hardware, struct json_writer *json);
 void dump(struct s_hardware *hardware);
@@ -0,0 +1,208 @@
+/*
+ * hdt-json.c
+ *
+ * A JSON writer for the dump that writes as it goes, instead of building
+ * a zzjson tree and printing that: members go through a small buffer
+ * straight to the sink, so what it costs does not grow with the machine.
+ *
+ * The layout is zzjson_print()'s, byte for byte, so what reads the dumps
+ * sees no change: four spaces of indent a level, "label" : value, and no
+ * newline before a value at the top.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "hdt-dump.h"
+
+#define JSON_INDENT	4
+
+static void json_put(struct json_writer *w, const char *s, size_t len)
+{
+    size_t n;
+
+    while (len) {
+	if (w->len == sizeof w->buf)
+	    json_flush(w);
+
+	n = sizeof w->buf - w->len;
+	if (n > len)
+	    n = len;
+	memcpy(w->buf + w->len, s, n);
+	w->len += n;
+	s += n;
+	len -= n;
+    }
+}
+
+static inline void json_puts(struct json_writer *w, const char *s)
+{
+    json_put(w, s, strlen(s));
+}
+
+/* A newline, and the indent for depth */
+static void json_newline(struct json_writer *w, int depth)
+{
+    static const char spaces[] = "        ";
+    int n = depth * JSON_INDENT;
+
+    json_put(w, "\n", 1);
+    while (n > 0) {
+	json_put(w, spaces, n < 8 ? n : 8);
+	n -= 8;
+    }
+}
+
+/* Escaped as zzjson's print_string() does it */
+static void json_escaped(struct json_writer *w, const char *s)
+{
+    const char *run = s;
+    char esc[2] = { '\\', 0 };
+    int c;
+
+    while ((c = *s)) {
+	switch (c) {
+	case '\\':
+	    esc[1] = s[1] == 'u' ? 0 : '\\';	/* \uHHHH goes as it is */
+	    break;
+	case '"':
+	    esc[1] = '"';
+	    break;
+	case '\b':
+	    esc[1] = 'b';
+	    break;
+	case '\f':
+	    esc[1] = 'f';
+	    break;
+	case '\n':
+	    esc[1] = 'n';
+	    break;
+	case '\r':
+	    esc[1] = 'r';
+	    break;
+	case '\t':
+	    esc[1] = 't';
+	    break;
+	default:
+	    esc[1] = 0;
+	    break;
+	}
+	s++;
+	if (esc[1]) {
+	    json_put(w, run, s - 1 - run);
+	    json_put(w, esc, 2);
+	    run = s;
+	}
+    }
+    json_put(w, run, s - run);
+}
+
+/* The label of the next member, and whatever has to come before it */
+static void json_label(struct json_writer *w, const char *label)
+{
+    if (!w->first[w->depth])
+	json_put(w, ",", 1);
+    w->first[w->depth] = false;
+
+    json_newline(w, w->depth);
+    json_put(w, "\"", 1);
+    json_escaped(w, label);
+    json_put(w, "\" :", 3);
+}
+
+void json_init(struct json_writer *w,
+	       int (*write)(void *, const void *, size_t), void *handle)
+{
+    memset(w, 0, sizeof *w);
+    w->write = write;
+    w->handle = handle;
+}
+
+/* Start a top-level object or array, ending the one before if need be */
+void json_begin(struct json_writer *w, enum json_type type)
+{
+    json_end(w);
+
+    w->depth = 1;
+    w->first[1] = true;
+    w->close[1] = type == JSON_ARRAY ? ']' : '}';
+    json_put(w, type == JSON_ARRAY ? "[" : "{", 1);
+}
+
+/* Start the next object in the top-level array */
+void json_element(struct json_writer *w)
+{
+    if (w->depth != 1 || w->close[1] != ']')
+	return;
+
+    if (!w->first[1])
+	json_put(w, ",", 1);
+    w->first[1] = false;
+
+    json_newline(w, 1);
+    json_put(w, "{", 1);
+    w->depth = 2;
+    w->first[2] = true;
+    w->close[2] = '}';
+}
+
+void json_element_end(struct json_writer *w)
+{
+    if (w->depth != 2)
+	return;
+
+    json_newline(w, 1);
+    json_put(w, "}", 1);
+    w->depth = 1;
+}
+
+void json_string(struct json_writer *w, const char *label, const char *value)
+{
+    /* zzjson couldn't hold a NULL string either; leave it out */
+    if (!w->depth || !value)
+	return;
+
+    json_label(w, label);
+    json_put(w, " \"", 2);
+    json_escaped(w, value);
+    json_put(w, "\"", 1);
+}
+
+void json_int(struct json_writer *w, const char *label, long long value)
+{
+    char num[24];
+
+    if (!w->depth)
+	return;
+
+    json_label(w, label);
+    snprintf(num, sizeof num, " %lld", value);
+    json_puts(w, num);
+}
+
+void json_bool(struct json_writer *w, const char *label, bool value)
+{
+    if (!w->depth)
+	return;
+
+    json_label(w, label);
+    json_puts(w, value ? " true" : " false");
+}
+
+/* Close whatever is open, and hand everything to the sink */
+void json_end(struct json_writer *w)
+{
+    while (w->depth) {
+	json_newline(w, w->depth - 1);
+	json_put(w, &w->close[w->depth], 1);
+	w->depth--;
+    }
+    json_flush(w);
+}
+
+int json_flush(struct json_writer *w)
+{
+    if (w->len && !w->err && w->write(w->handle, w->buf, w->len) < 0)
+	w->err = -1;
+    w->len = 0;
+    return w->err;
+}
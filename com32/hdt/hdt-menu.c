@@ -37,6 +37,9 @@ int start_menu_mode(struct s_hardware *hardware, char *version_string)
 
     memset(&hdt_menu, 0, sizeof(hdt_menu));
 
+    /* The menus are all built up front, so they need everything */
+    hdt_detect(hardware, HDT_DETECT_ALL);
+
     /* Setup the menu system */
     setup_menu(version_string);
 
@@ -0,0 +1,31 @@
+/*
+ * arena.h
+ *
+ * Bump-pointer allocation for data that all goes away at once, such
+ * as what a configuration file parses into.  Nothing allocated from an
+ * arena is freed on its own; arena_reset() frees all of it.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_CHUNK_SIZE	16384	/* Default for arena_create(0) */
+
+struct arena_chunk;
+
+struct arena {
+    struct arena_chunk *chunks;	/* The one being carved up first */
+    size_t chunk_size;
+};
+
+struct arena *arena_create(size_t chunk_size);
+void *arena_alloc(struct arena *, size_t);
+void *arena_zalloc(struct arena *, size_t);
+void *arena_realloc(struct arena *, void *, size_t, size_t);
+char *arena_strdup(struct arena *, const char *);
+void arena_reset(struct arena *);
+void arena_destroy(struct arena *);
+
+#endif /* ARENA_H */
@@ -14,6 +14,7 @@
 
 __extern DIR *opendir(const char *);
 __extern struct dirent *readdir(DIR *);
+__extern int readdir_batch(DIR *, struct dirent *, int);
 __extern int closedir(DIR *);
 __extern DIR *fdopendir(int);
 
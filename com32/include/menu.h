@@ -63,6 +63,7 @@ struct menu_entry {
     const char *background;
     struct menu *submenu;
     struct menu_entry *next;	/* Linked list of all labels across menus */
+    struct menu_entry *label_next;	/* Label hash chain */
     int entry;			/* Entry number inside menu */
     enum menu_action action;
     unsigned char hotkey;
@@ -172,6 +173,9 @@ struct menu {
     struct color_table *color_table;
 
     struct fkey_help fkeyhelp[12];
+
+    const char *lazy_file;	/* MENU LAZYINCLUDE file not read yet */
+    const char *lazy_append;	/* APPEND in effect where it was included */
 };
 
 extern struct menu *root_menu, *start_menu, *hide_menu, *menu_list;
@@ -183,11 +187,13 @@ extern struct menu *root_menu, *start_menu, *hide_menu, *menu_list;
 extern int shiftkey;
 extern int hiddenmenu;
 extern int clearmenu;
+extern int prefetchmenu;
 extern long long totaltimeout;
 extern clock_t kbdtimeout;
 extern const char *hide_key[KEY_MAX];
 
 void parse_configs(char **argv);
+void load_lazy_menu(struct menu *m);
 int draw_background(const char *filename);
 void set_resolution(int x, int y);
 void start_console(void);
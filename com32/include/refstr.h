@@ -21,6 +21,7 @@
 
 #include <stddef.h>
 #include <stdarg.h>
+#include <stdbool.h>
 
 static inline __attribute__ ((always_inline))
 const char *refstr_get(const char *r)
@@ -37,4 +38,7 @@ const char *refstrndup(const char *, size_t);
 int rsprintf(const char **, const char *, ...);
 int vrsprintf(const char **, const char *, va_list);
 
+/* Interned strings are shared, so they must never be written to */
+bool refstr_intern(bool);
+
 #endif
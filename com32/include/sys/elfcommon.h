@@ -90,6 +90,7 @@
 #define	DT_FINI_ARRAYSZ	28		/* Size in bytes of DT_FINI_ARRAY */
 #define DT_RUNPATH	29		/* Library search path */
 #define DT_FLAGS	30		/* Flags for the object being loaded */
+#define DF_BIND_NOW	0x00000008	/* DT_FLAGS: no lazy binding */
 #define DT_ENCODING	32		/* Start of encoded range */
 #define DT_PREINIT_ARRAY 32		/* Array with addresses of preinit fct*/
 #define DT_PREINIT_ARRAYSZ 33		/* size in bytes of DT_PREINIT_ARRAY */
@@ -146,6 +147,7 @@
 
 /* These were chosen by Sun.  */
 #define DT_FLAGS_1	0x6ffffffb	/* State flags, see DF_1_* below.  */
+#define DF_1_NOW	0x00000001	/* Set RTLD_NOW for this object.  */
 #define	DT_VERDEF	0x6ffffffc	/* Address of version definition
 					   table */
 #define	DT_VERDEFNUM	0x6ffffffd	/* Number of version definitions */
@@ -3,4 +3,24 @@
 
 extern int x86_init_fpu(void);
 
+/*
+ * SSE instructions fault unless CR4.OSFXSR is set, and whatever we
+ * boot next expects the control registers the way the firmware left
+ * them.  So COM32 code never turns SSE on for good: it brackets each
+ * stretch of SSE code with x86_sse_begin() and x86_sse_end(), which
+ * set OSFXSR and OSXMMEXCPT (and clear CR0.EM and CR0.TS) only for
+ * that long.  Nothing saves the XMM registers across interrupts or
+ * thread switches either, so they hold nothing outside a bracket.
+ * The core itself stays off SSE altogether.
+ *
+ * x86_has_sse() says whether the CPU can do it at all.
+ */
+struct x86_sse_state {
+    unsigned long cr0, cr4;
+};
+
+extern int x86_has_sse(void);
+extern void x86_sse_begin(struct x86_sse_state *st);
+extern void x86_sse_end(const struct x86_sse_state *st);
+
 #endif /* _SYS_FPU_H */
@@ -0,0 +1,35 @@
+#ifndef _SYS_MEMOPS_H
+#define _SYS_MEMOPS_H
+
+/*
+ * Tuning for memcpy(), memmove() and memset(), filled in for the
+ * running CPU by x86_init_mem().  A transfer of at least "rep" bytes
+ * uses a plain byte-granular REP MOVSB/STOSB (fast on CPUs with
+ * ERMSB), and one of at least "nt" bytes is written with non-temporal
+ * stores, so that copying a kernel doesn't flush everything else out
+ * of the cache.  Anything shorter than MEM_DISPATCH_MIN never looks.
+ */
+
+#define MEM_DISPATCH_MIN	64
+
+#ifdef __ASSEMBLY__
+
+#define MEM_TUNE_REP		0
+#define MEM_TUNE_NT		__SIZEOF_POINTER__
+
+#else
+
+#include <stddef.h>
+
+struct mem_tune {
+    size_t rep;
+    size_t nt;
+};
+
+extern struct mem_tune __mem_tune;
+
+extern void x86_init_mem(void);
+
+#endif /* __ASSEMBLY__ */
+
+#endif /* _SYS_MEMOPS_H */
@@ -116,8 +116,10 @@ struct elf_module {
 	union {
 		// Transient - Data available while the module is loading
 		struct {
-			FILE		*_file;		// The file object of the open file
-			Elf_Off	_cr_offset;	// The current offset in the open file
+			const char	*_buf;		// The whole module file
+			size_t		_buf_size;	// Its size
+			char		*_buf_alloc;	// _buf, unless in a module bundle
+			Elf_Off	_cr_offset;	// The current offset in the file
 		} l;
 
 		// Process execution data
@@ -130,6 +132,30 @@ struct elf_module {
 	// ELF DT_NEEDED entries for this module
 	int				nr_needed;
 	Elf_Word			needed[MAX_NR_DEPS];
+
+	uint32_t			symbol_seq;	// Order in the global symbol table
+
+	// Resident module cache data (see module_cache_flush())
+	bool			cacheable;	// The image can be kept after unloading
+	uint32_t			instance;	// Unique number of this load
+	Elf_Addr			data_addr;	// Start of the writable segments
+	Elf_Word			data_filesz;	// Bytes of them loaded from the file
+	Elf_Word			data_memsz;	// Bytes of them, with the .bss
+	void				*data_copy;	// The data as relocated, before ctors
+	int				nr_cache_deps;
+	struct module_cache_dep	*cache_deps;	// The modules it was linked against
+};
+
+/**
+ * struct module_cache_dep - a module a cached module was linked against
+ *
+ * The module descriptor may be gone by the time the cached module is
+ * wanted again, so it is only compared against, together with the
+ * instance number it had.
+ */
+struct module_cache_dep {
+	struct elf_module	*module;
+	uint32_t		instance;
 };
 
 /**
@@ -155,6 +181,26 @@ extern struct elf_module *unload_modules_since(const char *name);
 
 extern FILE *findpath(char *name);
 
+/**
+ * module_bundle_load - reads in a module bundle.
+ * @name:	the bundle file, looked up like a module.
+ *
+ * The modules in the bundle are then loaded from memory, in preference
+ * to looking for them in PATH. Modules which are already loaded, such
+ * as LDLINUX and libcom32.c32, are not replaced. Loading the same
+ * bundle twice does nothing. Returns 0 on success, and -1 if the file
+ * can't be found or isn't a valid bundle.
+ */
+extern int module_bundle_load(const char *name);
+
+/**
+ * module_bundle_release - frees all loaded module bundles.
+ *
+ * Modules are looked for in PATH again afterwards. It returns the
+ * number of bytes released.
+ */
+extern size_t module_bundle_release(void);
+
 
 /**
  * Names of symbols with special meaning (treated as special cases at linking)
@@ -257,6 +303,36 @@ extern int module_unload(struct elf_module *module);
  */
 extern int _module_unload(struct elf_module *module);
 
+/**
+ * module_cache_flush - frees the images kept by the resident module cache.
+ *
+ * Unloaded modules are kept in memory, relocated and linked, so that
+ * loading them again is just a matter of restoring their data. This
+ * gives that memory back, e.g. before loading something big. It returns
+ * the number of bytes released.
+ */
+extern size_t module_cache_flush(void);
+
+/**
+ * module_cache_limit - sets how much memory the resident module cache may use.
+ * @bytes:	the new limit; 0 disables the cache.
+ *
+ * The least recently unloaded modules are dropped to stay within the
+ * limit. The previous limit is returned.
+ */
+extern size_t module_cache_limit(size_t bytes);
+
+/**
+ * module_prefetch - loads a module ahead of time into the resident module cache.
+ * @name:	the name of the module, as it will be spawned.
+ *
+ * The module and the modules it needs are loaded, and the module is
+ * unloaded again without being run, so that spawning it later doesn't
+ * touch any file. A library module is just left loaded. It returns 0
+ * if the module is now loaded or cached.
+ */
+extern int module_prefetch(const char *name);
+
 /**
  * get_module_type - get type of the module
  * @module: the module descriptor structure.
@@ -326,6 +402,34 @@ extern Elf_Sym *module_find_symbol(const char *name, struct elf_module *module);
  */
 extern Elf_Sym *global_find_symbol(const char *name, struct elf_module **module);
 
+/**
+ * global_find_symbol_from - searches for a symbol definition as it would
+ * have been found when a module was loaded.
+ * @name: the name of the symbol to be found.
+ * @from: the module; modules loaded after it are not searched.
+ * @module: as for global_find_symbol().
+ *
+ * This is what binding a symbol after the module has been loaded has to
+ * use, so that it gets the same definition it would have got at load time.
+ */
+extern Elf_Sym *global_find_symbol_from(const char *name,
+					struct elf_module *from,
+					struct elf_module **module);
+
+/**
+ * global_symbols_add - enters the symbols a module defines in the table
+ * used by global_find_symbol().
+ * @module: the module, just put on the module list
+ */
+extern void global_symbols_add(struct elf_module *module);
+
+/**
+ * global_symbols_remove - drops the symbols of a module from the table
+ * used by global_find_symbol().
+ * @module: the module, just taken off the module list
+ */
+extern void global_symbols_remove(struct elf_module *module);
+
 /**
  * module_get_absolute - converts an memory address relative to a module base address
  * to its absolute value in RAM.
@@ -27,8 +27,8 @@ enum {
 struct pci_dev_info {
     char vendor_name[PCI_VENDOR_NAME_SIZE];
     char product_name[PCI_PRODUCT_NAME_SIZE];
-    char linux_kernel_module[LINUX_KERNEL_MODULE_SIZE]
-	[MAX_KERNEL_MODULES_PER_PCI_DEVICE];
+    char linux_kernel_module[MAX_KERNEL_MODULES_PER_PCI_DEVICE]
+	[LINUX_KERNEL_MODULE_SIZE];
     int linux_kernel_module_count;
     char class_name[PCI_CLASS_NAME_SIZE];	/* The most precise class name */
     char category_name[PCI_CLASS_NAME_SIZE];	/*The general category */
@@ -93,17 +93,19 @@ static inline void cpuid_count(uint32_t op, uint32_t cnt,
 		 : "a"(op), "c"(cnt));
 }
 
+/* "A" is edx:eax only on i386; here it would be just one of them */
 static inline uint64_t rdmsr(uint32_t msr)
 {
-    uint64_t v;
+    uint32_t lo, hi;
 
-    asm volatile("rdmsr" : "=A" (v) : "c"(msr));
-    return v;
+    asm volatile("rdmsr" : "=a" (lo), "=d" (hi) : "c"(msr));
+    return ((uint64_t)hi << 32) | lo;
 }
 
 static inline void wrmsr(uint64_t v, uint32_t msr)
 {
-    asm volatile("wrmsr" : : "A" (v), "c" (msr));
+    asm volatile("wrmsr" : : "a" ((uint32_t)v), "d" ((uint32_t)(v >> 32)),
+		 "c" (msr));
 }
 
 static inline void cpu_relax(void)
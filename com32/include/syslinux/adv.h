@@ -50,6 +50,7 @@ static inline size_t syslinux_adv_size(void)
 }
 
 __extern int syslinux_adv_write(void);
+__extern void syslinux_save_history(void);
 
 __extern int syslinux_setadv(int, size_t, const void *);
 __extern const void *syslinux_getadv(int, size_t *);
@@ -41,5 +41,6 @@
 #define ADV_END		0
 #define ADV_BOOTONCE	1
 #define ADV_MENUSAVE	2
+#define ADV_BOOTHIST	3	/* Files the last boot opened */
 
 #endif /* _SYSLINUX_ADVCONST_H */
@@ -0,0 +1,74 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Permission is hereby granted, free of charge, to any person
+ *   obtaining a copy of this software and associated documentation
+ *   files (the "Software"), to deal in the Software without
+ *   restriction, including without limitation the rights to use,
+ *   copy, modify, merge, publish, distribute, sublicense, and/or
+ *   sell copies of the Software, and to permit persons to whom
+ *   the Software is furnished to do so, subject to the following
+ *   conditions:
+ *
+ *   The above copyright notice and this permission notice shall
+ *   be included in all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *   OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *   HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *   OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * syslinux/boottime.h
+ *
+ * TSC timestamps taken at fixed points of the boot, handed to the
+ * kernel as a setup_data entry.
+ */
+
+#ifndef _SYSLINUX_BOOTTIME_H
+#define _SYSLINUX_BOOTTIME_H
+
+#include <stdint.h>
+
+/*
+ * Each phase keeps the last time it was reached, so a boot that falls
+ * back to the menu records the attempt that actually went through.
+ * The numbering is part of the setup_data format: only add at the end.
+ */
+enum boot_phase {
+    BOOT_PHASE_CORE_INIT,	/* Core C code starts */
+    BOOT_PHASE_FS_MOUNT,	/* Root filesystem mounted */
+    BOOT_PHASE_CONFIG_PARSED,	/* Configuration files read */
+    BOOT_PHASE_MENU,		/* Menu or boot: prompt on screen */
+    BOOT_PHASE_SELECT,		/* Boot entry chosen */
+    BOOT_PHASE_KERNEL_LOAD,	/* Kernel load begins */
+    BOOT_PHASE_KERNEL_LOADED,	/* Kernel load ends */
+    BOOT_PHASE_INITRD_LOAD,	/* Initrd load begins */
+    BOOT_PHASE_INITRD_LOADED,	/* Initrd load ends */
+    BOOT_PHASE_SHUFFLE,		/* Final moves and jump to the kernel */
+    BOOT_PHASE_MAX
+};
+
+/* setup_data type of the entry; not one of the kernel's own */
+#define SETUP_BOOT_TIMES	0x53594c31	/* "1LYS" */
+
+#define BOOT_TIMES_VERSION	1
+
+/* This is also the payload of the setup_data entry */
+struct boot_times {
+    uint32_t version;		/* BOOT_TIMES_VERSION */
+    uint32_t count;		/* Number of entries in tsc[] */
+    uint64_t tsc[BOOT_PHASE_MAX]; /* 0 if the phase was never reached */
+};
+
+extern void boot_time_stamp(enum boot_phase phase);
+
+/* Returns NULL if the CPU has no TSC */
+extern const struct boot_times *boot_times_get(void);
+
+#endif /* _SYSLINUX_BOOTTIME_H */
@@ -0,0 +1,62 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Permission is hereby granted, free of charge, to any person
+ *   obtaining a copy of this software and associated documentation
+ *   files (the "Software"), to deal in the Software without
+ *   restriction, including without limitation the rights to use,
+ *   copy, modify, merge, publish, distribute, sublicense, and/or
+ *   sell copies of the Software, and to permit persons to whom
+ *   the Software is furnished to do so, subject to the following
+ *   conditions:
+ *
+ *   The above copyright notice and this permission notice shall
+ *   be included in all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *   OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *   HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *   OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * syslinux/clock.h
+ *
+ * A monotonic clock in nanoseconds, for timing things shorter than the
+ * millisecond timer can see.  It runs off the TSC, calibrated once at
+ * startup; without a TSC it falls back on the millisecond timer.
+ */
+
+#ifndef _SYSLINUX_CLOCK_H
+#define _SYSLINUX_CLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef uint64_t nstime_t;
+
+enum clock_source {
+    CLOCK_MS_TIMER,		/* No usable TSC; millisecond steps */
+    CLOCK_TSC_CPUID,		/* TSC, its rate from CPUID leaf 15h */
+    CLOCK_TSC_PIT,		/* TSC, timed against PIT channel 2 */
+};
+
+struct clock_info {
+    enum clock_source source;
+    uint32_t tsc_khz;		/* 0 unless the source is the TSC */
+    bool invariant;		/* The TSC rate holds in every P/C-state */
+};
+
+/* Nanoseconds since the clock was calibrated */
+extern nstime_t clock_ns(void);
+
+/* A span of TSC cycles, as from rdtsc(), in nanoseconds; 0 without one */
+extern nstime_t clock_cycles_to_ns(uint64_t cycles);
+
+extern const struct clock_info *clock_get_info(void);
+
+#endif /* _SYSLINUX_CLOCK_H */
@@ -0,0 +1,65 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Permission is hereby granted, free of charge, to any person
+ *   obtaining a copy of this software and associated documentation
+ *   files (the "Software"), to deal in the Software without
+ *   restriction, including without limitation the rights to use,
+ *   copy, modify, merge, publish, distribute, sublicense, and/or
+ *   sell copies of the Software, and to permit persons to whom
+ *   the Software is furnished to do so, subject to the following
+ *   conditions:
+ *
+ *   The above copyright notice and this permission notice shall
+ *   be included in all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *   OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *   HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *   OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * syslinux/disktrace.h
+ *
+ * Ring buffer of the sector transfers done by the core disk layer.
+ */
+
+#ifndef _SYSLINUX_DISKTRACE_H
+#define _SYSLINUX_DISKTRACE_H
+
+#include <stdint.h>
+
+/* Which part of the core issued the transfer */
+enum disk_io_source {
+    DISK_IO_OTHER,		/* Superblock probes and the like */
+    DISK_IO_CACHE,		/* Block cache fill or read-ahead */
+    DISK_IO_GETFSSEC,		/* File data via generic_getfssec() */
+    DISK_IO_ADV,		/* Auxiliary data vector update */
+};
+
+struct disk_trace_rec {
+    uint64_t lba;		/* Relative to the start of the partition */
+    uint64_t tsc_start;		/* 0 if the CPU has no TSC */
+    uint64_t tsc_end;
+    uint32_t count;		/* Sectors requested */
+    int32_t result;		/* Sectors transferred */
+    uint8_t is_write;
+    uint8_t source;		/* enum disk_io_source */
+    uint16_t _pad;
+};
+
+struct disk_trace {
+    uint32_t size;		/* Number of slots in the ring */
+    uint32_t total;		/* Number of records ever logged */
+    struct disk_trace_rec *rec;	/* Slot (total % size) is the next one */
+};
+
+/* Returns NULL if tracing is not available */
+extern const struct disk_trace *disk_trace_get(void);
+
+#endif /* _SYSLINUX_DISKTRACE_H */
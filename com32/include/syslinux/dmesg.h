@@ -0,0 +1,73 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Permission is hereby granted, free of charge, to any person
+ *   obtaining a copy of this software and associated documentation
+ *   files (the "Software"), to deal in the Software without
+ *   restriction, including without limitation the rights to use,
+ *   copy, modify, merge, publish, distribute, sublicense, and/or
+ *   sell copies of the Software, and to permit persons to whom
+ *   the Software is furnished to do so, subject to the following
+ *   conditions:
+ *
+ *   The above copyright notice and this permission notice shall
+ *   be included in all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *   OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *   HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *   OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * syslinux/dmesg.h
+ *
+ * The debug log: with DEBUG_PORT, dprintf() appends timestamped records
+ * to a ring in high memory, and the serial port is fed from it while
+ * the core is idle, so logging costs little more than the formatting.
+ * The records are handed to the kernel as a setup_data entry, too.
+ */
+
+#ifndef _SYSLINUX_DMESG_H
+#define _SYSLINUX_DMESG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <klibc/compiler.h>
+
+/* setup_data type of the entry; not one of the kernel's own */
+#define SETUP_DMESG		0x53594c32	/* "2LYS" */
+
+#define DMESG_VERSION		1
+
+/* Each record is this header and then len bytes of text, with no NUL */
+struct dmesg_record {
+    uint64_t ns;		/* clock_ns() when it was logged */
+    uint32_t len;
+} __packed;
+
+/* The setup_data payload: this, and then the records, oldest first */
+struct dmesg_setup {
+    uint32_t version;		/* DMESG_VERSION */
+    uint32_t lost;		/* Records overwritten before this copy */
+};
+
+/*
+ * Read the record at *pos into text, as much of it as fits, and move
+ * *pos on to the next; start with *pos at 0.  If the record has been
+ * overwritten, *pos skips to the oldest there is.  Returns the length
+ * of the text copied, or -1 at the end or if there is no log.
+ */
+extern int dmesg_read(uint32_t *pos, uint64_t *ns, char *text, size_t size);
+
+/* Records overwritten so far */
+extern uint32_t dmesg_lost(void);
+
+/* A malloc()ed struct dmesg_setup and the records, or NULL */
+extern void *dmesg_snapshot(size_t *len);
+
+#endif /* _SYSLINUX_DMESG_H */
@@ -16,6 +16,7 @@ struct output_ops {
 	void (*get_mode)(int *, int *);
 	void (*text_mode)(void);
 	void (*get_cursor)(uint8_t *, uint8_t *);
+	void (*flush)(void);	/* Optional; for buffered consoles */
 };
 
 struct input_ops {
@@ -37,17 +38,40 @@ struct vesa_ops {
 	int (*set_mode)(struct vesa_info *, int *, int *, enum vesa_pixel_format *);
 	void (*screencpy)(size_t, const uint32_t *, size_t, struct win_info *);
 	int (*font_query)(uint8_t **);
+	/* Optional: put out what screencpy() may have held back */
+	void (*flush)(void);
 };
 
 enum heap;
+struct com32_mem_stats;
 struct mem_ops {
 	void *(*malloc)(size_t, enum heap, size_t);
 	void *(*realloc)(void *, size_t);
 	void (*free)(void *);
+	int (*stats)(struct com32_mem_stats *);	/* Optional */
+	/* Optional: add at least size bytes below limit to the heap */
+	int (*grow_below)(size_t size, size_t limit);
+};
+
+/*
+ * Somewhere to keep files fetched over HTTP from one boot to the next,
+ * by URL, with the ETag or Last-Modified they came with.  open() gives
+ * the copy there is, if any, and its validator and size; create()
+ * starts a new one, which close() keeps if given its validator and
+ * size, and throws away if given NULL.
+ */
+struct netcache_ops {
+	void *(*open)(const char *key, char *validator, size_t len,
+		      uint32_t *size);
+	uint32_t (*read)(void *h, void *buf, uint32_t len, uint32_t offset);
+	void *(*create)(const char *key);
+	void (*write)(void *h, const void *buf, uint32_t len, uint32_t offset);
+	void (*close)(void *h, const char *validator, uint32_t size);
 };
 
 struct initramfs;
 struct setup_data;
+struct com32_disk_probe;
 
 struct firmware {
 	void (*init)(void);
@@ -62,6 +86,8 @@ struct firmware {
 			  struct setup_data *, char *);
 	struct vesa_ops *vesa;
 	struct mem_ops *mem;
+	int (*disk_probe)(int, struct com32_disk_probe *);	/* Optional */
+	struct netcache_ops *netcache;				/* Optional */
 };
 
 extern struct firmware *firmware;
@@ -42,7 +42,10 @@
 /* A chunk of an initramfs.  These are kept as a doubly-linked
    circular list with headnode; the headnode is distinguished by
    having len == 0.  The data pointer can be NULL if data_len is zero;
-   if data_len < len then the balance of the region is zeroed. */
+   if data_len < len then the balance of the region is zeroed.  A chunk
+   with a path has no data yet: data_len bytes of that file get read in
+   by initramfs_resolve(), straight to where the kernel will find them
+   if there is room for that. */
 
 struct initramfs {
     struct initramfs *prev, *next;
@@ -50,6 +53,10 @@ struct initramfs {
     size_t align;
     const void *data;
     size_t data_len;
+    char *path;
+    /* Headnode only: the space set aside by initramfs_reserve() */
+    char *rsv;
+    size_t rsv_len, rsv_used;
 };
 #define INITRAMFS_MAX_ALIGN	4096
 
@@ -161,6 +168,8 @@ int syslinux_boot_linux(void *kernel_buf, size_t kernel_size,
 			struct initramfs *initramfs,
 			struct setup_data *setup_data,
 			char *cmdline);
+size_t syslinux_linux_initrd_max(const void *kernel_buf, size_t kernel_size,
+				 const char *cmdline);
 
 /* Initramfs manipulation functions */
 
@@ -177,12 +186,17 @@ int initramfs_load_file(struct initramfs *ihead, const char *src_filename,
 			const char *dst_filename, int do_mkdir, uint32_t mode);
 int initramfs_add_trailer(struct initramfs *ihead);
 int initramfs_load_archive(struct initramfs *ihead, const char *filename);
+int initramfs_reserve(struct initramfs *ihead, size_t size, size_t limit);
+int initramfs_add_path(struct initramfs *ihead, const char *path,
+		       size_t data_len, size_t len, size_t align);
+int initramfs_resolve(struct initramfs *ihead, size_t limit);
+void *initramfs_reserved_base(struct initramfs *ihead, size_t limit);
 
 /* Get the combined size of the initramfs */
-static inline uint32_t initramfs_size(struct initramfs *initramfs)
+static inline size_t initramfs_size(struct initramfs *initramfs)
 {
     struct initramfs *ip;
-    uint32_t size = 0;
+    size_t size = 0;
 
     if (!initramfs)
 	return 0;
@@ -5,7 +5,17 @@
 #include <stdio.h>
 #include <stdbool.h>
 
+/*
+ * Physical addresses.  An x86_64 build can place things above 4 GB;
+ * the BIOS shuffler, and so anything on i386, can't.
+ */
+#if defined(__COM32__) && defined(__x86_64__)
+typedef uint64_t addr_t;
+# define PRIxADDR	PRIx64
+#else
 typedef uint32_t addr_t;
+# define PRIxADDR	PRIx32
+#endif
 
 /*
  * A syslinux_movelist is a linked list of move operations.  The ordering
@@ -51,6 +51,92 @@ struct com32_filedata {
     uint16_t handle;		/* File handle */
 };
 
+struct com32_cache_stats {
+    const char *fs_name;	/* Filesystem the cache belongs to */
+    uint32_t block_size;	/* Cache block size in bytes */
+    uint32_t entries;		/* Number of cache blocks */
+    uint32_t readahead;		/* Read-ahead window in blocks, 0 = off */
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+    uint32_t ra_reqs;
+    uint32_t ra_blocks;
+};
+
+/* lwIP's pools; com32_net_stats.pool[], all zero for the PXE stack's UDP */
+enum com32_net_pool {
+    COM32_NET_PBUF,		/* Packets received and not yet read */
+    COM32_NET_TCP_SEG,		/* TCP segments queued */
+    COM32_NET_NETBUF,
+    COM32_NET_POOLS
+};
+
+struct com32_net_pool_stats {
+    uint32_t avail;		/* Elements in the pool */
+    uint32_t used;		/* Taken now */
+    uint32_t max;		/* The most ever taken at once */
+    uint32_t err;		/* Times it was found empty */
+};
+
+struct com32_net_stats {
+    uint64_t bytes;		/* File data delivered */
+    uint32_t files;		/* Files fetched over the network */
+    uint32_t xfer_ms;		/* Time those files were open */
+    uint32_t last_bytes;	/* The file closed last */
+    uint32_t last_ms;
+    uint32_t rx_packets;	/* Link layer */
+    uint32_t tx_packets;
+    uint32_t tftp_timeouts;	/* Waits for a block that ran out */
+    uint32_t tftp_dupblocks;	/* Blocks that came other than in order */
+    uint32_t tcp_rexmits;	/* Segments we sent again */
+    uint32_t tcp_dupsegs;	/* Segments the server sent again */
+    uint32_t tcp_stalls;	/* Times our receive window filled up */
+    struct com32_net_pool_stats pool[COM32_NET_POOLS];
+};
+
+/* Owners of heap memory, as told apart by the core allocator */
+enum com32_mem_owner {
+    COM32_MEM_CORE,		/* malloc() by the core and by modules */
+    COM32_MEM_MODULE,		/* lmalloc() by the running module */
+    COM32_MEM_OWNERS
+};
+
+/* Free blocks by size: slot n has those of 2^(n+5) to 2^(n+6)-1 bytes */
+#define COM32_MEM_HIST	24
+
+struct com32_heap_stats {
+    uint32_t used_bytes[COM32_MEM_OWNERS]; /* Block headers included */
+    uint32_t used_blocks[COM32_MEM_OWNERS];
+    uint32_t free_bytes;
+    uint32_t free_blocks;
+    uint32_t largest_free;	/* The most one allocation can get */
+    uint32_t free_hist[COM32_MEM_HIST]; /* The last slot gets all bigger */
+};
+
+struct com32_mem_stats {
+    struct com32_heap_stats heap[2]; /* High memory, then low memory */
+};
+
+/* What INT 13h had to say about a BIOS drive; com32_disk_probe.flags */
+#define COM32_DISK_CHS		0x01	/* AH=08h answered */
+#define COM32_DISK_EBIOS	0x02	/* AH=41h answered */
+#define COM32_DISK_EDD		0x04	/* AH=48h answered */
+#define COM32_DISK_MEMDISK	0x08	/* MEMDISK answered the AH=08h */
+
+#define COM32_DISK_EDD_LEN	74	/* The most of AH=48h kept */
+
+struct com32_disk_probe {
+    uint8_t drive;
+    uint8_t flags;
+    uint8_t chs_type;		/* AH=08h: BL */
+    uint8_t edd_version;	/* AH=41h: AH */
+    uint16_t chs_cx;		/* AH=08h: CX and DX */
+    uint16_t chs_dx;
+    uint16_t edd_subset;	/* AH=41h: CX */
+    uint32_t memdisk_info;	/* MEMDISK: ES:DI, as a flat address */
+    uint8_t edd_params[COM32_DISK_EDD_LEN]; /* AH=48h, as the BIOS left it */
+};
+
 struct com32_pmapi {
     size_t __pmapi_size;
 
@@ -77,6 +163,12 @@ struct com32_pmapi {
 
     const int sysappend_count;
     const char * const *sysappend_strings;
+
+    int (*cache_stats)(struct com32_cache_stats *);
+    int (*net_stats)(struct com32_net_stats *);
+    int (*mem_stats)(struct com32_mem_stats *);
+    int (*net_handoff)(void *, size_t);
+    int (*disk_probe)(int, struct com32_disk_probe *);
 };
 
 #endif /* _SYSLINUX_PMAPI_H */
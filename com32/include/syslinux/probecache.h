@@ -0,0 +1,63 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Permission is hereby granted, free of charge, to any person
+ *   obtaining a copy of this software and associated documentation
+ *   files (the "Software"), to deal in the Software without
+ *   restriction, including without limitation the rights to use,
+ *   copy, modify, merge, publish, distribute, sublicense, and/or
+ *   sell copies of the Software, and to permit persons to whom
+ *   the Software is furnished to do so, subject to the following
+ *   conditions:
+ *
+ *   The above copyright notice and this permission notice shall
+ *   be included in all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *   OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *   HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *   OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * syslinux/probecache.h
+ *
+ * Firmware probe results kept by the core across module loads, so that
+ * a chain of modules (hdt, sysdump, dmitest, ...) scans the BIOS for
+ * the SMBIOS and ACPI tables once rather than once each; chain.c32
+ * walks the disks' partition tables and lua.c32 compiles each script
+ * once per session.  The core only stores the bytes; the module that
+ * puts an entry defines what it is.
+ */
+
+#ifndef _SYSLINUX_PROBECACHE_H
+#define _SYSLINUX_PROBECACHE_H
+
+#include <stddef.h>
+
+enum probe_cache_key {
+    PROBE_DMI_TABLE,		/* gpllib dmi_table from dmi_iterate() */
+    PROBE_DMI,			/* gpllib s_dmi from parse_dmitable() */
+    PROBE_ACPI_RSDP,		/* Address of the RSDP, or NULL if none */
+    PROBE_PART_INDEX,		/* chain.c32 disk and GPT partition index */
+    PROBE_LUA_CHUNKS,		/* lua.c32 scripts compiled this session */
+    PROBE_CACHE_KEYS
+};
+
+/*
+ * Returns the entry stored under "key" and its length, or NULL if there
+ * is none.  Callers must check the length against what they expect, as
+ * the entry may have been put by a module built against another version
+ * of the structure.
+ */
+extern const void *probe_cache_get(enum probe_cache_key key, size_t *len);
+
+/* Store a copy of "len" bytes under "key".  Returns -1 if out of memory. */
+extern int probe_cache_put(enum probe_cache_key key, const void *data,
+			   size_t len);
+
+#endif /* _SYSLINUX_PROBECACHE_H */
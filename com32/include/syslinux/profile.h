@@ -0,0 +1,74 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Permission is hereby granted, free of charge, to any person
+ *   obtaining a copy of this software and associated documentation
+ *   files (the "Software"), to deal in the Software without
+ *   restriction, including without limitation the rights to use,
+ *   copy, modify, merge, publish, distribute, sublicense, and/or
+ *   sell copies of the Software, and to permit persons to whom
+ *   the Software is furnished to do so, subject to the following
+ *   conditions:
+ *
+ *   The above copyright notice and this permission notice shall
+ *   be included in all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *   OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *   HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *   OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * syslinux/profile.h
+ *
+ * Sampling profiler: each timer tick that interrupts protected-mode
+ * code counts the EIP it interrupted, and the module that was running,
+ * in a hash table.  Ticks taken in real mode, i.e. in the BIOS, are
+ * only counted; they have no EIP of ours to go by.
+ *
+ * The tick is the BIOS's 18.2 Hz one, so this is for boots that are
+ * slow by seconds: a profile wants a few hundred samples at least.
+ */
+
+#ifndef _SYSLINUX_PROFILE_H
+#define _SYSLINUX_PROFILE_H
+
+#include <stdint.h>
+
+#define PROFILE_CONTEXTS	32	/* Modules told apart; the last is "(others)" */
+#define PROFILE_NAME		32	/* Of a module name, with the null */
+
+struct profile_bucket {
+    uint32_t eip;
+    uint32_t context;		/* Index into contexts[] */
+    uint32_t count;		/* 0 if the slot is free */
+};
+
+struct profile {
+    uint32_t size;		/* Slots in buckets[], a power of two */
+    uint32_t ticks;		/* All timer ticks while running */
+    uint32_t samples;		/* Those that landed in protected mode */
+    uint32_t dropped;		/* Of those, the ones with no free slot */
+    uint32_t running;
+    uint32_t ncontexts;
+    char contexts[PROFILE_CONTEXTS][PROFILE_NAME]; /* 0 is "(core)" */
+    struct profile_bucket *buckets;
+};
+
+/*
+ * Start sampling into a table of (at least) slots buckets, after
+ * throwing away whatever was there before.  Returns -1 if there is no
+ * memory, or no profiler on this firmware.
+ */
+extern int profile_start(uint32_t slots);
+extern void profile_stop(void);
+
+/* Returns NULL if it was never started */
+extern const struct profile *profile_get(void);
+
+#endif /* _SYSLINUX_PROFILE_H */
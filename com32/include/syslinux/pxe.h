@@ -36,6 +36,12 @@
 
 #include <syslinux/pxe_api.h>
 
+/*
+ * DHCP option (site-specific) in which pxechn.c32 hands what the
+ * running PXELINUX knows about the network on to the one it chains
+ */
+#define PXE_HANDOFF_OPT	224
+
 /* SYSLINUX-defined PXE utility functions */
 int pxe_get_cached_info(int level, void **buf, size_t *len);
 int pxe_get_nic_type(t_PXENV_UNDI_GET_NIC_TYPE * gnt);
@@ -0,0 +1,64 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Permission is hereby granted, free of charge, to any person
+ *   obtaining a copy of this software and associated documentation
+ *   files (the "Software"), to deal in the Software without
+ *   restriction, including without limitation the rights to use,
+ *   copy, modify, merge, publish, distribute, sublicense, and/or
+ *   sell copies of the Software, and to permit persons to whom
+ *   the Software is furnished to do so, subject to the following
+ *   conditions:
+ *
+ *   The above copyright notice and this permission notice shall
+ *   be included in all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *   OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *   HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *   OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * syslinux/smp.h
+ *
+ * Work for the other CPUs.  smp_start() wakes the application
+ * processors, which then run jobs off a shared queue until they are
+ * parked again before the OS is started.  Jobs must be compute only:
+ * no BIOS calls, no malloc(), no console and no dprintf(), as only the
+ * boot CPU may do those.
+ *
+ * Without other CPUs, or before smp_start(), the jobs still run, on
+ * the boot CPU, in smp_wait().
+ */
+
+#ifndef _SYSLINUX_SMP_H
+#define _SYSLINUX_SMP_H
+
+struct smp_job {
+    void (*func)(void *);
+    void *arg;
+    struct smp_job *next;	/* On the queue */
+    volatile int done;
+};
+
+/* Returns the number of CPUs taking jobs, the boot CPU included */
+extern int smp_start(void);
+extern int smp_cpus(void);
+
+extern void smp_submit(struct smp_job *job);
+
+/* Wait for job, running queued jobs meanwhile */
+extern void smp_wait(struct smp_job *job);
+
+/* Submit the n jobs and wait for them all */
+extern void smp_run_jobs(struct smp_job *jobs, int n);
+
+/* Let the jobs finish, and put the other CPUs back to wait for a SIPI */
+extern void smp_park(void);
+
+#endif /* _SYSLINUX_SMP_H */
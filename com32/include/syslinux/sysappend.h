@@ -54,6 +54,7 @@ enum syslinux_sysappend {
     SYSAPPEND_BIOSVERSION,	/* BIOS version string */
     SYSAPPEND_SYSFF,		/* System form factor */
     SYSAPPEND_FSUUID,		/* Boot filesystem UUID */
+    SYSAPPEND_NETSTAT,		/* PXELINUX: network transfer statistics */
     SYSAPPEND_MAX		/* Total number of strings */
 };
 
@@ -0,0 +1,79 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Permission is hereby granted, free of charge, to any person
+ *   obtaining a copy of this software and associated documentation
+ *   files (the "Software"), to deal in the Software without
+ *   restriction, including without limitation the rights to use,
+ *   copy, modify, merge, publish, distribute, sublicense, and/or
+ *   sell copies of the Software, and to permit persons to whom
+ *   the Software is furnished to do so, subject to the following
+ *   conditions:
+ *
+ *   The above copyright notice and this permission notice shall
+ *   be included in all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *   OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *   HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *   OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * syslinux/threadstat.h
+ *
+ * Per-thread CPU accounting for the core threads (the network stack
+ * threads on PXELINUX, the idle thread and so on), and an optional
+ * ring of context switches.  Threads only exist on BIOS.
+ */
+
+#ifndef _SYSLINUX_THREADSTAT_H
+#define _SYSLINUX_THREADSTAT_H
+
+#include <stdint.h>
+
+struct thread_stat {
+    const void *id;		/* Matches the thread_trace_rec fields */
+    const char *name;
+    int prio;
+    uint32_t switches_in;
+    uint32_t switches_out;
+    uint32_t blocks;		/* Times it slept on a semaphore */
+    uint32_t blocked_ms;	/* Total time spent asleep */
+    const void *blocked_on;	/* Semaphore it is asleep on, or NULL */
+    uint64_t runtime;		/* TSC cycles it has run; 0 without a TSC */
+};
+
+struct thread_trace_rec {
+    uint64_t tsc;		/* 0 if the CPU has no TSC */
+    const void *from;		/* thread_stat.id of the outgoing thread */
+    const void *to;
+    const void *sem;		/* Semaphore "from" went to sleep on, or NULL */
+};
+
+struct thread_trace {
+    uint32_t size;		/* Number of slots in the ring */
+    uint32_t total;		/* Number of switches ever logged */
+    struct thread_trace_rec *rec;	/* Slot (total % size) is the next one */
+};
+
+/*
+ * Fill in up to "max" entries; returns the number of threads, which
+ * may be more than "max".
+ */
+extern int thread_stats_get(struct thread_stat *st, int max);
+
+/*
+ * Start logging switches into a fresh ring of "entries" slots, or stop
+ * and free the ring if "entries" is 0.  Returns -1 if out of memory.
+ */
+extern int thread_trace_enable(unsigned int entries);
+
+/* Returns NULL if tracing is off */
+extern const struct thread_trace *thread_trace_get(void);
+
+#endif /* _SYSLINUX_THREADSTAT_H */
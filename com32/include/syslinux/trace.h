@@ -0,0 +1,100 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Permission is hereby granted, free of charge, to any person
+ *   obtaining a copy of this software and associated documentation
+ *   files (the "Software"), to deal in the Software without
+ *   restriction, including without limitation the rights to use,
+ *   copy, modify, merge, publish, distribute, sublicense, and/or
+ *   sell copies of the Software, and to permit persons to whom
+ *   the Software is furnished to do so, subject to the following
+ *   conditions:
+ *
+ *   The above copyright notice and this permission notice shall
+ *   be included in all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *   OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *   HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *   OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * syslinux/trace.h
+ *
+ * Static tracepoints in the core.  Each tracepoint belongs to a group,
+ * and groups are switched on and off at run time with the TRACE
+ * directive or trace.c32.  While its group is off, a tracepoint costs
+ * one test of a global mask.  Hits are logged into a ring in memory,
+ * stamped with the TSC.
+ */
+
+#ifndef _SYSLINUX_TRACE_H
+#define _SYSLINUX_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <klibc/compiler.h>
+
+enum trace_group {
+    TRACE_CACHE,		/* Block cache hits, misses and read-ahead */
+    TRACE_GETFSSEC,		/* File reads through the filesystem driver */
+    TRACE_NET,			/* TFTP and TCP (HTTP, FTP) buffer fills */
+    TRACE_SCHED,		/* Thread switches */
+    TRACE_MALLOC,		/* Heap allocations and frees */
+    TRACE_MODULE,		/* Module loads and unloads */
+    TRACE_NGROUPS
+};
+
+struct trace_rec {
+    uint64_t tsc;		/* 0 if the CPU has no TSC */
+    uint64_t a, b;		/* Meaning depends on the tracepoint */
+    const char *name;		/* Tracepoint, e.g. "cache_miss" */
+    uint8_t group;		/* enum trace_group */
+    char str[15];		/* Module name and the like, or empty */
+};
+
+struct trace_log {
+    uint32_t size;		/* Number of slots in the ring */
+    uint32_t total;		/* Number of records ever logged */
+    struct trace_rec *rec;	/* Slot (total % size) is the next one */
+};
+
+/* One bit per enum trace_group */
+extern uint32_t trace_mask;
+
+extern void __trace(int group, const char *name, const char *str,
+		    uint64_t a, uint64_t b);
+
+#define trace(group, name, a, b)					\
+    do {								\
+	if (__unlikely(trace_mask & (1U << (group))))			\
+	    __trace((group), (name), NULL, (a), (b));			\
+    } while (0)
+
+#define trace_str(group, name, str, a, b)				\
+    do {								\
+	if (__unlikely(trace_mask & (1U << (group))))			\
+	    __trace((group), (name), (str), (a), (b));			\
+    } while (0)
+
+/*
+ * Switch groups on or off by name, separated by spaces or commas:
+ * "cache net" turns those on, "-net" turns it off, "all" and "off"
+ * do what they say.  The ring is allocated the first time a group is
+ * turned on.  Returns -1 on an unknown name (the others still take
+ * effect) or if there is no memory for the ring.
+ */
+extern int trace_set(const char *spec);
+
+/* Name of a group, as trace_set() takes it; NULL if out of range */
+extern const char *trace_group_name(int group);
+
+/* Returns NULL if nothing has been traced yet */
+extern const struct trace_log *trace_get(void);
+
+#endif /* _SYSLINUX_TRACE_H */
@@ -0,0 +1,149 @@
+/*
+ * arena.c
+ *
+ * Allocations come off the front chunk until it runs out; one bigger
+ * than a quarter of a chunk gets a chunk of its own behind it, so as
+ * not to waste what is left of the front one.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arena.h>
+
+#define ARENA_ALIGN	8
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size;		/* Of data[] */
+    size_t used;
+    char data[] __attribute__((aligned(ARENA_ALIGN)));
+};
+
+static struct arena_chunk *arena_new_chunk(size_t size)
+{
+    struct arena_chunk *c = malloc(sizeof *c + size);
+
+    if (c) {
+	c->size = size;
+	c->used = 0;
+    }
+    return c;
+}
+
+struct arena *arena_create(size_t chunk_size)
+{
+    struct arena *a = malloc(sizeof *a);
+
+    if (a) {
+	a->chunks = NULL;
+	a->chunk_size = chunk_size ? chunk_size : ARENA_CHUNK_SIZE;
+    }
+    return a;
+}
+
+void *arena_alloc(struct arena *a, size_t size)
+{
+    struct arena_chunk *c = a->chunks;
+    void *p;
+
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    if (c && c->size - c->used >= size) {
+	p = c->data + c->used;
+	c->used += size;
+	return p;
+    }
+
+    if (size > a->chunk_size >> 2) {
+	c = arena_new_chunk(size);
+	if (!c)
+	    return NULL;
+	c->used = size;
+	if (a->chunks) {
+	    c->next = a->chunks->next;
+	    a->chunks->next = c;
+	} else {
+	    c->next = NULL;
+	    a->chunks = c;
+	}
+	return c->data;
+    }
+
+    c = arena_new_chunk(a->chunk_size);
+    if (!c)
+	return NULL;
+    c->next = a->chunks;
+    a->chunks = c;
+    c->used = size;
+    return c->data;
+}
+
+void *arena_zalloc(struct arena *a, size_t size)
+{
+    void *p = arena_alloc(a, size);
+
+    if (p)
+	memset(p, 0, size);
+    return p;
+}
+
+/*
+ * The old block is left where it is; growing an array by doubling it
+ * wastes at most as much as the array itself.
+ */
+void *arena_realloc(struct arena *a, void *ptr, size_t oldsize,
+		    size_t newsize)
+{
+    void *p;
+
+    if (newsize <= oldsize)
+	return ptr;
+
+    p = arena_alloc(a, newsize);
+    if (p && ptr)
+	memcpy(p, ptr, oldsize);
+    return p;
+}
+
+char *arena_strdup(struct arena *a, const char *s)
+{
+    size_t len = strlen(s) + 1;
+    char *d = arena_alloc(a, len);
+
+    if (d)
+	memcpy(d, s, len);
+    return d;
+}
+
+/*
+ * Free everything allocated so far, keeping one chunk to start over with
+ */
+void arena_reset(struct arena *a)
+{
+    struct arena_chunk *c, *next, *keep = NULL;
+
+    for (c = a->chunks; c; c = next) {
+	next = c->next;
+	if (!keep && c->size == a->chunk_size)
+	    keep = c;
+	else
+	    free(c);
+    }
+
+    if (keep) {
+	keep->next = NULL;
+	keep->used = 0;
+    }
+    a->chunks = keep;
+}
+
+void arena_destroy(struct arena *a)
+{
+    if (!a)
+	return;
+
+    arena_reset(a);
+    free(a->chunks);
+    free(a);
+}
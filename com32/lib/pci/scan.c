@@ -41,6 +41,7 @@
 #include <stdbool.h>
 #include <ctype.h>
 #include <syslinux/zio.h>
+#include <syslinux/loadfile.h>
 #include <dprintf.h>
 
 #define MAX_LINE 512
@@ -61,111 +62,471 @@ static int hex_to_int(char *hexa)
     return strtoul(hexa, NULL, 16);
 }
 
+/*
+ * Module matching.  modules.pcimap and modules.alias are each parsed
+ * once into a table of patterns, kept loaded between calls.  The
+ * patterns that name a vendor are sorted by it, so a device is only
+ * tried against its own vendor's patterns and against the few that
+ * match any vendor (mostly class matches, like USB host controllers).
+ */
+#define PCI_ANY_VENDOR	0x10000		/* sorts after every real vendor */
+
+struct pci_alias {
+    uint32_t vendor;			/* or PCI_ANY_VENDOR */
+    uint32_t vid_did, vid_did_mask;	/* as in struct pci_device */
+    uint32_t svid_sdid, svid_sdid_mask;
+    uint32_t class, class_mask;		/* base class, subclass, prog-if */
+    uint32_t seq;			/* line order, the order of results */
+    const char *module;
+};
+
+struct pci_alias_index {
+    char *path;
+    struct pci_alias *alias;
+    size_t count;
+    size_t nvendor;			/* how many name a vendor */
+};
+
+static struct pci_alias_index pci_pcimap, pci_modalias;
+
+static int pci_alias_cmp(const void *a, const void *b)
+{
+    const struct pci_alias *x = a, *y = b;
+
+    if (x->vendor != y->vendor)
+	return x->vendor < y->vendor ? -1 : 1;
+    return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+static void pci_alias_free(struct pci_alias_index *idx)
+{
+    const char *last = NULL;
+    size_t i;
+
+    /* consecutive patterns share their module name */
+    for (i = 0; i < idx->count; i++) {
+	if (idx->alias[i].module != last)
+	    free((void *)idx->alias[i].module);
+	last = idx->alias[i].module;
+    }
+    free(idx->alias);
+    free(idx->path);
+    memset(idx, 0, sizeof *idx);
+}
+
+/* Append a pattern, sharing the module name with the previous one */
+static int pci_alias_add(struct pci_alias_index *idx, size_t *size,
+			 struct pci_alias *a, const char *module)
+{
+    struct pci_alias *na;
+    const char *last = idx->count ? idx->alias[idx->count - 1].module : NULL;
+
+    if (idx->count == *size) {
+	*size = *size ? *size * 2 : 256;
+	na = realloc(idx->alias, *size * sizeof *na);
+	if (!na)
+	    return -1;
+	idx->alias = na;
+    }
+
+    if (last && !strcmp(last, module)) {
+	a->module = last;
+    } else {
+	a->module = strdup(module);
+	if (!a->module)
+	    return -1;
+    }
+
+    a->vid_did &= a->vid_did_mask;
+    a->svid_sdid &= a->svid_sdid_mask;
+    a->class &= a->class_mask;
+    a->vendor = (a->vid_did_mask & 0xffff) == 0xffff ?
+	(a->vid_did & 0xffff) : PCI_ANY_VENDOR;
+    a->seq = idx->count;
+    idx->alias[idx->count++] = *a;
+    return 0;
+}
+
+/*
+ * Parse one "tag" field of a modalias: width hex digits, or fewer
+ * followed by '*' for "anything from here on".  Values wider than 16
+ * bits are accepted only if the top half is zero, since that is all a
+ * PCI id can be.
+ */
+static bool pci_alias_field(const char **p, const char *tag, int width,
+			    uint32_t *val, uint32_t *mask)
+{
+    size_t n = strlen(tag);
+    uint64_t v = 0, m = 0;
+    int digits = 0;
+
+    if (strncmp(*p, tag, n))
+	return false;
+    *p += n;
+
+    while (isxdigit(**p) && digits < width) {
+	v = v << 4 | (isdigit(**p) ? **p - '0' : (**p | 0x20) - 'a' + 10);
+	m = m << 4 | 0xf;
+	(*p)++;
+	digits++;
+    }
+    if (**p == '*') {
+	(*p)++;
+	v <<= 4 * (width - digits);
+	m <<= 4 * (width - digits);
+    } else if (digits != width) {
+	return false;
+    }
+
+    if (width > 4) {
+	if (v & m & 0xffff0000)
+	    return false;
+	v &= 0xffff;
+	m &= 0xffff;
+    }
+    *val = v;
+    *mask = m;
+    return true;
+}
+
+/* "alias pci:v00008086d0000100Esv*sd*bc*sc*i* e1000" */
+static bool pci_alias_parse_modalias(char *line, struct pci_alias *a,
+				     const char **module)
+{
+    const char *p = line + strlen("alias pci:");
+    uint32_t v[7], m[7];
+    char *end;
+
+    if (strncmp(line, "alias pci:", strlen("alias pci:")) ||
+	!pci_alias_field(&p, "v", 8, &v[0], &m[0]) ||
+	!pci_alias_field(&p, "d", 8, &v[1], &m[1]) ||
+	!pci_alias_field(&p, "sv", 8, &v[2], &m[2]) ||
+	!pci_alias_field(&p, "sd", 8, &v[3], &m[3]) ||
+	!pci_alias_field(&p, "bc", 2, &v[4], &m[4]) ||
+	!pci_alias_field(&p, "sc", 2, &v[5], &m[5]) ||
+	!pci_alias_field(&p, "i", 2, &v[6], &m[6]) ||
+	!isspace(*p))
+	return false;
+
+    a->vid_did = v[0] | v[1] << 16;
+    a->vid_did_mask = m[0] | m[1] << 16;
+    a->svid_sdid = v[2] | v[3] << 16;
+    a->svid_sdid_mask = m[2] | m[3] << 16;
+    a->class = v[4] << 16 | v[5] << 8 | v[6];
+    a->class_mask = m[4] << 16 | m[5] << 8 | m[6];
+
+    p = skipspace(p);
+    for (end = (char *)p; *end && !isspace(*end); end++)
+	;
+    *end = '\0';
+    *module = p;
+    return *p != '\0';
+}
+
+/* "e1000 0x00008086 0x0000100e 0xffffffff 0xffffffff 0x0 0x0 0x0" */
+static bool pci_alias_parse_pcimap(char *line, struct pci_alias *a,
+				   const char **module)
+{
+    uint32_t f[6];
+    char *p, *end;
+    int i;
+
+    if (line[0] == '#' || isspace(line[0]))
+	return false;
+
+    for (p = line; *p && !isspace(*p); p++)
+	;
+    if (!*p)
+	return false;
+    *p++ = '\0';
+
+    for (i = 0; i < 6; i++) {
+	f[i] = strtoul(p, &end, 16);
+	if (end == p)
+	    return false;
+	p = end;
+    }
+
+    /* 0xffffffff is PCI_ANY_ID; ids are 16 bits */
+    a->vid_did = (f[0] & 0xffff) | f[1] << 16;
+    a->vid_did_mask = (f[0] == 0xffffffff ? 0 : 0xffff) |
+	(f[1] == 0xffffffff ? 0 : 0xffff0000);
+    a->svid_sdid = (f[2] & 0xffff) | f[3] << 16;
+    a->svid_sdid_mask = (f[2] == 0xffffffff ? 0 : 0xffff) |
+	(f[3] == 0xffffffff ? 0 : 0xffff0000);
+    a->class = f[4];
+    a->class_mask = f[5] & 0xffffff;
+
+    /*
+     * The kernel module name is featuring '_' or '-' in the module name
+     * whereas modules.alias is only using '_'.  To avoid kernel modules
+     * duplication, let's rename all '-' in '_' to match what
+     * modules.alias provides.
+     */
+    chrreplace(line, '-', '_');
+    *module = line;
+    return true;
+}
+
+/*
+ * Load the patterns in path, unless they already are; returns the
+ * number of them or -1 if path can't be opened.
+ */
+static int pci_alias_load(struct pci_alias_index *idx, const char *path,
+			  bool (*parse)(char *, struct pci_alias *,
+					const char **))
+{
+    char line[MAX_LINE];
+    struct pci_alias a;
+    const char *module;
+    size_t size = 0;
+    FILE *f;
+
+    if (idx->path && !strcmp(idx->path, path))
+	return idx->count;
+
+    f = zfopen(path, "r");
+    if (!f)
+	return -1;
+
+    pci_alias_free(idx);
+    idx->path = strdup(path);
+
+    while (fgets(line, sizeof line, f)) {
+	if (!parse(line, &a, &module))
+	    continue;
+	if (pci_alias_add(idx, &size, &a, module))
+	    break;		/* out of memory: use what we have */
+    }
+    fclose(f);
+
+    qsort(idx->alias, idx->count, sizeof *idx->alias, pci_alias_cmp);
+    for (idx->nvendor = 0; idx->nvendor < idx->count; idx->nvendor++) {
+	if (idx->alias[idx->nvendor].vendor == PCI_ANY_VENDOR)
+	    break;
+    }
+
+    dprintf("pci: %s: %zu patterns, %zu for any vendor\n", path,
+	    idx->count, idx->count - idx->nvendor);
+    return idx->count;
+}
+
+static bool pci_alias_match(const struct pci_alias *a,
+			    const struct pci_device *dev)
+{
+    return (dev->vid_did & a->vid_did_mask) == a->vid_did &&
+	(dev->svid_sdid & a->svid_sdid_mask) == a->svid_sdid &&
+	((dev->rid_class >> 8) & a->class_mask) == a->class;
+}
+
+static void pci_add_module(struct pci_dev_info *info, const char *module)
+{
+    int i;
+
+    for (i = 0; i < info->linux_kernel_module_count; i++) {
+	if (!strcmp(info->linux_kernel_module[i], module))
+	    return;
+    }
+    if (i >= MAX_KERNEL_MODULES_PER_PCI_DEVICE)
+	return;
+
+    strlcpy(info->linux_kernel_module[i], module,
+	    LINUX_KERNEL_MODULE_SIZE - 1);
+    info->linux_kernel_module_count++;
+}
+
+/*
+ * Add the module of every pattern matching dev, in the order they are
+ * in the file: the vendor's own patterns and the any-vendor ones are
+ * each in that order, so merge the two.
+ */
+static void pci_alias_lookup(const struct pci_alias_index *idx,
+			     struct pci_device *dev)
+{
+    const struct pci_alias *v, *vend, *any, *aend;
+    size_t lo = 0, hi = idx->nvendor, mid;
+
+    while (lo < hi) {
+	mid = lo + (hi - lo) / 2;
+	if (idx->alias[mid].vendor < dev->vendor)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+
+    v = vend = idx->alias + lo;
+    while (vend < idx->alias + idx->nvendor && vend->vendor == dev->vendor)
+	vend++;
+    any = idx->alias + idx->nvendor;
+    aend = idx->alias + idx->count;
+
+    while (v < vend || any < aend) {
+	if (any == aend || (v < vend && v->seq < any->seq)) {
+	    if (pci_alias_match(v, dev))
+		pci_add_module(dev->dev_info, v->module);
+	    v++;
+	} else {
+	    if (pci_alias_match(any, dev))
+		pci_add_module(dev->dev_info, any->module);
+	    any++;
+	}
+    }
+}
+
+/* Give every device a dev_info, and "unknown" in its empty module slots */
+static int pci_init_modules(struct pci_domain *domain)
+{
+    struct pci_device *dev;
+
+    for_each_pci_func(dev, domain) {
+	if (!dev->dev_info) {
+	    dev->dev_info = zalloc(sizeof *dev->dev_info);
+	    if (!dev->dev_info)
+		return -1;
+	}
+	for (int i = 0; i < MAX_KERNEL_MODULES_PER_PCI_DEVICE; i++) {
+	    if (!dev->dev_info->linux_kernel_module[i][0])
+		strlcpy(dev->dev_info->linux_kernel_module[i], "unknown", 7);
+	}
+    }
+
+    return 0;
+}
+
 /* Try to match any pci device to the appropriate kernel module */
 /* it uses the modules.pcimap from the boot device */
 int get_module_name_from_pcimap(struct pci_domain *domain,
 				char *modules_pcimap_path)
 {
-  char line[MAX_LINE];
-  char module_name[21]; // the module name field is 21 char long
-  char delims[]=" ";    // colums are separated by spaces
-  char vendor_id[16];
-  char product_id[16];
-  char sub_vendor_id[16];
-  char sub_product_id[16];
-  FILE *f;
-  struct pci_device *dev=NULL;
-
-  /* Intializing the linux_kernel_module for each pci device to "unknown" */
-  /* adding a dev_info member if needed */
-  for_each_pci_func(dev, domain) {
-    /* initialize the dev_info structure if it doesn't exist yet. */
-    if (! dev->dev_info) {
-      dev->dev_info = zalloc(sizeof *dev->dev_info);
-      if (!dev->dev_info)
+    struct pci_device *dev;
+
+    if (pci_init_modules(domain))
 	return -1;
+
+    if (pci_alias_load(&pci_pcimap, modules_pcimap_path,
+		       pci_alias_parse_pcimap) < 0)
+	return -ENOMODULESPCIMAP;
+
+    for_each_pci_func(dev, domain)
+	pci_alias_lookup(&pci_pcimap, dev);
+
+    return 0;
+}
+
+/*
+ * The binary index of pci.ids made by utils/mkpciids, which sits next
+ * to it as <pci.ids>.idx; see there for the layout.  When it exists
+ * the lookups are binary searches in it, instead of a parse of the
+ * whole text file for every call.  It is kept loaded, since the name
+ * and the class lookups come one after the other.
+ */
+#define PCI_IDS_INDEX_SUFFIX	".idx"
+#define PCI_IDS_MAGIC		"SYSLXPCI"
+#define PCI_IDS_VERSION		1
+
+enum pci_ids_table {
+    PCI_IDS_VENDOR,
+    PCI_IDS_DEVICE,
+    PCI_IDS_SUBSYS,
+    PCI_IDS_CLASS,
+    PCI_IDS_SUBCLASS,
+    PCI_IDS_TABLES
+};
+
+struct pci_ids_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t count[PCI_IDS_TABLES];
+    uint32_t strsize;
+};
+
+/* A record is (id, name) or, for subsystems, (id, subsystem id, name) */
+static const size_t pci_ids_words[PCI_IDS_TABLES] = { 2, 2, 3, 2, 2 };
+
+static struct pci_ids_index {
+    char *path;
+    void *data;
+    const uint32_t *table[PCI_IDS_TABLES];
+    uint32_t count[PCI_IDS_TABLES];
+    const char *strings;
+    uint32_t strsize;
+} pci_ids;
+
+/* Load the index for pciids_path, unless it already is; 0 on success */
+static int pci_ids_load(const char *pciids_path)
+{
+    char path[strlen(pciids_path) + sizeof PCI_IDS_INDEX_SUFFIX];
+    const struct pci_ids_header *hdr;
+    const uint32_t *p;
+    size_t len, need;
+    void *data;
+    int t;
+
+    if (pci_ids.path && !strcmp(pci_ids.path, pciids_path))
+	return 0;
+
+    strcpy(path, pciids_path);
+    strcat(path, PCI_IDS_INDEX_SUFFIX);
+    if (zloadfile(path, &data, &len))
+	return -1;
+
+    hdr = data;
+    need = sizeof *hdr;
+    if (len < need || memcmp(hdr->magic, PCI_IDS_MAGIC, sizeof hdr->magic) ||
+	hdr->version != PCI_IDS_VERSION)
+	goto bad;
+    for (t = 0; t < PCI_IDS_TABLES; t++)
+	need += (size_t)hdr->count[t] * pci_ids_words[t] * sizeof(uint32_t);
+    need += hdr->strsize;
+    if (len < need || !hdr->strsize)
+	goto bad;
+
+    free(pci_ids.path);
+    free(pci_ids.data);
+    pci_ids.path = strdup(pciids_path);
+    pci_ids.data = data;
+    p = (const uint32_t *)(hdr + 1);
+    for (t = 0; t < PCI_IDS_TABLES; t++) {
+	pci_ids.table[t] = p;
+	pci_ids.count[t] = hdr->count[t];
+	p += hdr->count[t] * pci_ids_words[t];
     }
-    for (int i=0;i<MAX_KERNEL_MODULES_PER_PCI_DEVICE;i++) {
-     if (strlen(dev->dev_info->linux_kernel_module[i])==0)
-       strlcpy(dev->dev_info->linux_kernel_module[i], "unknown",7);
-    }
-  }
-
-  /* Opening the modules.pcimap (of a linux kernel) from the boot device */
-  f=zfopen(modules_pcimap_path, "r");
-  if (!f)
-    return -ENOMODULESPCIMAP;
-
-  strcpy(vendor_id,"0000");
-  strcpy(product_id,"0000");
-  strcpy(sub_product_id,"0000");
-  strcpy(sub_vendor_id,"0000");
-
-  /* for each line we found in the modules.pcimap */
-  while ( fgets(line, sizeof line, f) ) {
-    /* skipping unecessary lines */
-    if ((line[0] == '#') || (line[0] == ' ') || (line[0] == 10))
-        continue;
-
-    char *result = NULL;
-    int field=0;
-
-    /* looking for the next field */
-    result = strtok(line, delims);
-    while( result != NULL ) {
-       /* if the column is larger than 1 char */
-       /* multiple spaces generates some empty fields */
-       if (strlen(result)>1) {
-	 switch (field) {
-	 /* About case 0, the kernel module name is featuring '_' or '-' 
-	  * in the module name whereas modules.alias is only using '_'.
-	  * To avoid kernel modules duplication, let's rename all '-' in '_' 
-	  * to match what modules.alias provides */
-	 case 0:chrreplace(result,'-','_');strcpy(module_name,result); break;
-	 case 1:strcpy(vendor_id,result); break;
-	 case 2:strcpy(product_id,result); break;
-	 case 3:strcpy(sub_vendor_id,result); break;
-	 case 4:strcpy(sub_product_id,result); break;
-	 }
-	 field++;
-       }
-       /* Searching the next field */
-       result = strtok( NULL, delims );
-   }
-    int int_vendor_id=hex_to_int(vendor_id);
-    int int_sub_vendor_id=hex_to_int(sub_vendor_id);
-    int int_product_id=hex_to_int(product_id);
-    int int_sub_product_id=hex_to_int(sub_product_id);
-    /* if a pci_device matches an entry, fill the linux_kernel_module with
-       the appropriate kernel module */
-    for_each_pci_func(dev, domain) {
-      if (int_vendor_id == dev->vendor &&
-	  int_product_id == dev->product &&
-	  (int_sub_product_id & dev->sub_product)
-	  == dev->sub_product &&
-	  (int_sub_vendor_id & dev->sub_vendor)
-	  == dev->sub_vendor) {
-	      bool found=false;
-
-	      /* Scan all known kernel modules for this pci device */
-	      for (int i=0; i<dev->dev_info->linux_kernel_module_count; i++) {
-
-       	      /* Try to detect if we already knew the same kernel module*/
-	       if (strstr(dev->dev_info->linux_kernel_module[i], module_name)) {
-		      found=true;
-		      break;
-	       }
-	      }
-	      /* If we don't have this kernel module, let's add it */
-	      if (!found) {
-		strcpy(dev->dev_info->linux_kernel_module[dev->dev_info->linux_kernel_module_count], module_name);
-		dev->dev_info->linux_kernel_module_count++;
-	      }
-      }
+    pci_ids.strings = (const char *)p;
+    pci_ids.strsize = hdr->strsize;
+    return 0;
+
+bad:
+    dprintf("pci: %s is not a valid pci.ids index\n", path);
+    free(data);
+    return -1;
+}
+
+/*
+ * Look up id (and, for subsystems, subid) in table t; returns the
+ * name, or NULL if it isn't there.
+ */
+static const char *pci_ids_find(enum pci_ids_table t, uint32_t id,
+				uint32_t subid)
+{
+    const size_t words = pci_ids_words[t];
+    const uint32_t *rec;
+    uint32_t lo = 0, hi = pci_ids.count[t], mid, name;
+
+    while (lo < hi) {
+	mid = lo + (hi - lo) / 2;
+	rec = pci_ids.table[t] + mid * words;
+	if (rec[0] < id || (rec[0] == id && words > 2 && rec[1] < subid)) {
+	    lo = mid + 1;
+	} else if (rec[0] > id || (words > 2 && rec[1] > subid)) {
+	    hi = mid;
+	} else {
+	    name = rec[words - 1];
+	    /* the string table ends in a NUL, so any offset in it is safe */
+	    return name < pci_ids.strsize ? pci_ids.strings + name : NULL;
+	}
     }
-  }
-  fclose(f);
-  return 0;
+
+    return NULL;
 }
 
 /* Try to match any pci device to the appropriate class name */
@@ -179,6 +540,7 @@ int get_class_name_from_pci_ids(struct pci_domain *domain, char *pciids_path)
     char sub_class_id_str[5];
     FILE *f;
     struct pci_device *dev;
+    const char *name;
     bool class_mode = false;
 
     /* Intializing the vendor/product name for each pci device to "unknown" */
@@ -193,6 +555,25 @@ int get_class_name_from_pci_ids(struct pci_domain *domain, char *pciids_path)
 	strlcpy(dev->dev_info->class_name, "unknown", 7);
     }
 
+    if (!pci_ids_load(pciids_path)) {
+	for_each_pci_func(dev, domain) {
+	    name = pci_ids_find(PCI_IDS_CLASS, dev->class[2], 0);
+	    if (!name)
+		continue;
+	    /* the same as the text parser makes of a "C xx  name" line */
+	    snprintf(dev->dev_info->class_name, PCI_CLASS_NAME_SIZE - 1,
+		     "%02x  %s", dev->class[2], name);
+	    strlcpy(dev->dev_info->category_name, name,
+		    PCI_CLASS_NAME_SIZE - 1);
+	    name = pci_ids_find(PCI_IDS_SUBCLASS,
+				dev->class[2] << 8 | dev->class[1], 0);
+	    if (name)
+		strlcpy(dev->dev_info->class_name, name,
+			PCI_CLASS_NAME_SIZE - 1);
+	}
+	return 0;
+    }
+
     /* Opening the pci.ids from the boot device */
     f = zfopen(pciids_path, "r");
     if (!f)
@@ -274,6 +655,7 @@ int get_name_from_pci_ids(struct pci_domain *domain, char *pciids_path)
     char sub_vendor_id[5];
     FILE *f;
     struct pci_device *dev;
+    const char *name;
     bool skip_to_next_vendor = false;
     uint16_t int_vendor_id;
     uint16_t int_product_id;
@@ -293,6 +675,24 @@ int get_name_from_pci_ids(struct pci_domain *domain, char *pciids_path)
 	strlcpy(dev->dev_info->product_name, "unknown", 7);
     }
 
+    if (!pci_ids_load(pciids_path)) {
+	for_each_pci_func(dev, domain) {
+	    name = pci_ids_find(PCI_IDS_VENDOR, dev->vendor, 0);
+	    if (!name)
+		continue;
+	    strlcpy(dev->dev_info->vendor_name, name,
+		    PCI_VENDOR_NAME_SIZE - 1);
+	    name = pci_ids_find(PCI_IDS_SUBSYS, dev->vid_did,
+				dev->svid_sdid);
+	    if (!name)
+		name = pci_ids_find(PCI_IDS_DEVICE, dev->vid_did, 0);
+	    if (name)
+		strlcpy(dev->dev_info->product_name, name,
+			PCI_PRODUCT_NAME_SIZE - 1);
+	}
+	return 0;
+    }
+
     /* Opening the pci.ids from the boot device */
     f = zfopen(pciids_path, "r");
     if (!f)
@@ -594,144 +994,18 @@ void free_pci_domain(struct pci_domain *domain)
 /* it uses the modules.alias from the boot device */
 int get_module_name_from_alias(struct pci_domain *domain, char *modules_alias_path)
 {
-  char line[MAX_LINE];
-  char module_name[21]; // the module name field is 21 char long
-  char delims[]="*";    // colums are separated by spaces
-  char vendor_id[16];
-  char product_id[16];
-  char sub_vendor_id[16];
-  char sub_product_id[16];
-  FILE *f;
-  struct pci_device *dev=NULL;
-  int valid_lines=0;
-
-  /* Intializing the linux_kernel_module for each pci device to "unknown" */
-  /* adding a dev_info member if needed */
-  for_each_pci_func(dev, domain) {
-    /* initialize the dev_info structure if it doesn't exist yet. */
-    if (! dev->dev_info) {
-      dev->dev_info = zalloc(sizeof *dev->dev_info);
-      if (!dev->dev_info)
-	return -1;
-    }
-    for (int i=0;i<MAX_KERNEL_MODULES_PER_PCI_DEVICE;i++) {
-     if (strlen(dev->dev_info->linux_kernel_module[i])==0)
-       strlcpy(dev->dev_info->linux_kernel_module[i], "unknown",7);
-    }
-  }
-
-  /* Opening the modules.pcimap (of a linux kernel) from the boot device */
-  f=zfopen(modules_alias_path, "r");
-  if (!f)
-    return -ENOMODULESALIAS;
-
-  /* for each line we found in the modules.pcimap */
-  while ( fgets(line, sizeof line, f) ) {
-    /* skipping unecessary lines */
-    if ((line[0] == '#') || (strstr(line,"alias pci:v")==NULL))
-        continue;
-
-    valid_lines++;
-    /* Resetting temp buffer*/
-    memset(module_name,0,sizeof(module_name));
-    memset(vendor_id,0,sizeof(vendor_id));
-    memset(sub_vendor_id,0,sizeof(sub_vendor_id));
-    memset(product_id,0,sizeof(product_id));
-    memset(sub_product_id,0,sizeof(sub_product_id));
-    strcpy(vendor_id,"0000");
-    strcpy(product_id,"0000");
-    /* ffff will be used to match any device as in modules.alias
-     * a missing subvendor/product have to be considered as  0xFFFF*/
-    strcpy(sub_product_id,"ffff");
-    strcpy(sub_vendor_id,"ffff");
-
-    char *result = NULL;
-    int field=0;
-
-    /* looking for the next field */
-    result = strtok(line+strlen("alias pci:v"), delims);
-    while( result != NULL ) {
-	if (field==0) {
-
-		/* Searching for the vendor separator*/
-		char *temp = strstr(result,"d");
-		if (temp != NULL) {
-			strlcpy(vendor_id,result,temp-result);
-			result+=strlen(vendor_id)+1;
-		}
+    struct pci_device *dev;
 
-		/* Searching for the product separator*/
-		temp = strstr(result,"sv");
-		if (temp != NULL) {
-			strlcpy(product_id,result,temp-result);
-			result+=strlen(product_id)+1;
-		}
+    if (pci_init_modules(domain))
+	return -1;
 
-		/* Searching for the sub vendor separator*/
-		temp = strstr(result,"sd");
-		if (temp != NULL) {
-			strlcpy(sub_vendor_id,result,temp-result);
-			result+=strlen(sub_vendor_id)+1;
-		}
+    /* An empty or broken modules.alias is as good as none */
+    if (pci_alias_load(&pci_modalias, modules_alias_path,
+		       pci_alias_parse_modalias) <= 0)
+	return -ENOMODULESALIAS;
 
-		/* Searching for the sub product separator*/
-		temp = strstr(result,"bc");
-		if (temp != NULL) {
-			strlcpy(sub_product_id,result,temp-result);
-			result+=strlen(sub_product_id)+1;
-		}
-	/* That's the module name */
-	} else if ((strlen(result)>2) &&
-			(result[0]==0x20))
-		strcpy(module_name,result+1);
-		/* We have to replace \n by \0*/
-		module_name[strlen(module_name)-1]='\0';
-	field++;
-
-	/* Searching the next field */
-        result = strtok( NULL, delims );
-    }
+    for_each_pci_func(dev, domain)
+	pci_alias_lookup(&pci_modalias, dev);
 
-    /* Now we have extracted informations from the modules.alias
-     * Let's compare it with the devices we know*/
-    int int_vendor_id=hex_to_int(vendor_id);
-    int int_sub_vendor_id=hex_to_int(sub_vendor_id);
-    int int_product_id=hex_to_int(product_id);
-    int int_sub_product_id=hex_to_int(sub_product_id);
-    /* if a pci_device matches an entry, fill the linux_kernel_module with
-       the appropriate kernel module */
-    for_each_pci_func(dev, domain) {
-      if (int_vendor_id == dev->vendor &&
-	  int_product_id == dev->product &&
-	  (int_sub_product_id & dev->sub_product)
-	  == dev->sub_product &&
-	  (int_sub_vendor_id & dev->sub_vendor)
-	  == dev->sub_vendor) {
-	      bool found=false;
-	      
-	      /* Scan all known kernel modules for this pci device */
-	      for (int i=0; i<dev->dev_info->linux_kernel_module_count; i++) {
-
-       	      /* Try to detect if we already knew the same kernel module*/
-	       if (strstr(dev->dev_info->linux_kernel_module[i], module_name)) {
-		      found=true;
-		      break;
-	       }
-	      }
-	      /* If we don't have this kernel module, let's add it */
-	      if (!found) {
-		strcpy(dev->dev_info->linux_kernel_module[dev->dev_info->linux_kernel_module_count], module_name);
-		dev->dev_info->linux_kernel_module_count++;
-	      }
-      }
-    }
-  }
-  fclose(f);
-  /* If no valid line was found in the module.alias,
-   * we shall report it as broken/empty/non-existing */
-  if (valid_lines == 0) {
-    return -ENOMODULESALIAS;
-  }
-
-  return 0;
+    return 0;
 }
@@ -1,46 +1,186 @@
 /*
  * qsort.c
  *
- * This is actually combsort.  It's an O(n log n) algorithm with
- * simplicity/small code size being its main virtue.
+ * Introsort: quicksort, with the pivot a median of three, finishing
+ * short runs with insertion sort and falling back on heapsort if the
+ * partitions keep coming out lopsided, so it is O(n log n) whatever
+ * the input.  Elements of 4 and 8 bytes (ints, and pointers on either
+ * architecture), suitably aligned, are swapped with plain moves.
  */
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
-static inline size_t newgap(size_t gap)
+#define INSERTION_MAX	16	/* Runs this short are insertion sorted */
+#define NINTHER_MIN	40	/* Longer runs take the median of nine */
+
+typedef int (*compar_t) (const void *, const void *);
+
+enum swap_type {
+    SWAP_BYTES,
+    SWAP_U32,
+    SWAP_U64,
+};
+
+static inline void swap(char *a, char *b, size_t size, enum swap_type type)
+{
+    if (type == SWAP_U32) {
+	uint32_t t = *(uint32_t *)a;
+	*(uint32_t *)a = *(uint32_t *)b;
+	*(uint32_t *)b = t;
+    } else if (type == SWAP_U64) {
+	uint64_t t = *(uint64_t *)a;
+	*(uint64_t *)a = *(uint64_t *)b;
+	*(uint64_t *)b = t;
+    } else {
+	memswap(a, b, size);
+    }
+}
+
+static void insertion_sort(char *base, size_t nmemb, size_t size,
+			   enum swap_type type, compar_t compar)
+{
+    char *end = base + nmemb * size;
+    char *p, *q;
+
+    for (p = base + size; p < end; p += size) {
+	for (q = p; q > base && compar(q - size, q) > 0; q -= size)
+	    swap(q - size, q, size, type);
+    }
+}
+
+static void sift_down(char *base, size_t root, size_t nmemb, size_t size,
+		      enum swap_type type, compar_t compar)
+{
+    size_t child;
+
+    while ((child = 2 * root + 1) < nmemb) {
+	if (child + 1 < nmemb &&
+	    compar(base + child * size, base + (child + 1) * size) < 0)
+	    child++;
+	if (compar(base + root * size, base + child * size) >= 0)
+	    break;
+	swap(base + root * size, base + child * size, size, type);
+	root = child;
+    }
+}
+
+static void heap_sort(char *base, size_t nmemb, size_t size,
+		      enum swap_type type, compar_t compar)
+{
+    size_t i;
+
+    for (i = nmemb / 2; i-- > 0;)
+	sift_down(base, i, nmemb, size, type, compar);
+
+    for (i = nmemb; --i > 0;) {
+	swap(base, base + i * size, size, type);
+	sift_down(base, 0, i, size, type, compar);
+    }
+}
+
+static inline char *med3(char *a, char *b, char *c, compar_t compar)
 {
-    gap = (gap * 10) / 13;
-    if (gap == 9 || gap == 10)
-	gap = 11;
+    if (compar(a, b) < 0)
+	return compar(b, c) < 0 ? b : compar(a, c) < 0 ? c : a;
+    else
+	return compar(b, c) > 0 ? b : compar(a, c) > 0 ? c : a;
+}
+
+/*
+ * Partition around the median of the first, middle and last elements
+ * (of three such medians, for longer runs); returns where the pivot
+ * ends up, with nothing greater before it and nothing less after it.
+ */
+static char *partition(char *base, size_t nmemb, size_t size,
+		       enum swap_type type, compar_t compar)
+{
+    char *mid = base + (nmemb / 2) * size;
+    char *last = base + (nmemb - 1) * size;
+    char *i, *j;
+    size_t step;
 
-    if (gap < 1)
-	gap = 1;
-    return gap;
+    if (nmemb > NINTHER_MIN) {
+	step = (nmemb / 8) * size;
+	mid = med3(med3(base, base + step, base + 2 * step, compar),
+		   med3(mid - step, mid, mid + step, compar),
+		   med3(last - 2 * step, last - step, last, compar),
+		   compar);
+    } else {
+	mid = med3(base, mid, last, compar);
+    }
+
+    /* The pivot goes first */
+    swap(base, mid, size, type);
+
+    i = base + size;
+    j = last;
+    for (;;) {
+	while (i <= j && compar(i, base) < 0)
+	    i += size;
+	while (j >= i && compar(j, base) > 0)
+	    j -= size;
+	if (i >= j)
+	    break;
+	swap(i, j, size, type);
+	i += size;
+	j -= size;
+    }
+
+    swap(base, j, size, type);
+    return j;
+}
+
+static void intro_sort(char *base, size_t nmemb, size_t size,
+		       enum swap_type type, compar_t compar, int depth)
+{
+    char *p;
+    size_t left, right;
+
+    while (nmemb > INSERTION_MAX) {
+	if (!depth--) {
+	    heap_sort(base, nmemb, size, type, compar);
+	    return;
+	}
+
+	p = partition(base, nmemb, size, type, compar);
+	left = (p - base) / size;
+	right = nmemb - left - 1;
+
+	/* Recurse into the smaller side, so the stack stays O(log n) */
+	if (left < right) {
+	    intro_sort(base, left, size, type, compar, depth);
+	    base = p + size;
+	    nmemb = right;
+	} else {
+	    intro_sort(p + size, right, size, type, compar, depth);
+	    nmemb = left;
+	}
+    }
+
+    insertion_sort(base, nmemb, size, type, compar);
 }
 
 void qsort(void *base, size_t nmemb, size_t size,
 	   int (*compar) (const void *, const void *))
 {
-    size_t gap = nmemb;
-    size_t i, j;
-    char *p1, *p2;
-    int swapped;
+    enum swap_type type = SWAP_BYTES;
+    uintptr_t align = (uintptr_t)base | size;
+    int depth = 0;
+    size_t n;
 
-    if (!nmemb)
+    if (nmemb < 2 || !size)
 	return;
 
-    do {
-	gap = newgap(gap);
-	swapped = 0;
+    if (size == 4 && !(align & (__alignof__(uint32_t) - 1)))
+	type = SWAP_U32;
+    else if (size == 8 && !(align & (__alignof__(uint64_t) - 1)))
+	type = SWAP_U64;
 
-	for (i = 0, p1 = base; i < nmemb - gap; i++, p1 += size) {
-	    j = i + gap;
-	    if (compar(p1, p2 = (char *)base + j * size) > 0) {
-		memswap(p1, p2, size);
-		swapped = 1;
-	    }
-	}
-    } while (gap > 1 || swapped);
+    for (n = nmemb; n > 1; n >>= 1)
+	depth += 2;
+
+    intro_sort(base, nmemb, size, type, compar, depth);
 }
@@ -193,6 +193,9 @@ ssize_t __ansicon_write(struct file_info *fp, const void *buf, size_t count)
 	n++;
     }
 
+    if (firmware->o_ops->flush)
+	firmware->o_ops->flush();
+
     return n;
 }
 
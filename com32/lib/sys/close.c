@@ -57,6 +57,7 @@ int close(int fd)
 	    return rv;
     }
 
+    free(fp->i.bufmem);
     memset(fp, 0, sizeof *fp);	/* File structure unused */
     return 0;
 }
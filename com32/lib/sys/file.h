@@ -76,6 +76,7 @@ struct output_dev {
 
 #define NFILES 128		/* Number of files to support */
 #define MAXBLOCK 16384		/* Defined by ABI */
+#define FILEBUF_MAX 65536	/* The biggest buffer a file gets unasked */
 
 struct file_info {
     const struct input_dev *iop;	/* Input operations */
@@ -93,13 +94,19 @@ struct file_info {
 	size_t nbytes;		/* Number of bytes available in buffer */
 	char *datap;		/* Current data pointer */
 	void *pvt;		/* Private pointer for driver */
-	char buf[MAXBLOCK];
+	size_t size_hint;	/* Likely size if fd.size is unknown, or 0 */
+	char *buf;		/* Buffer, allocated on first use */
+	size_t bufsize;		/* Its size; until then, what setvbuf() asked */
+	void *bufmem;		/* What to free() on close, if anything */
     } i;
 };
 
 extern struct file_info __file_info[NFILES];
 extern const struct input_dev __file_dev;
 
+/* Give fp its input buffer, if it hasn't got one yet */
+int __file_buffer(struct file_info *fp, size_t size);
+
 /* Line input discipline */
 ssize_t __line_input(struct file_info *fp, char *buf, size_t bufsize,
 		     ssize_t(*get_char) (struct file_info *, void *, size_t));
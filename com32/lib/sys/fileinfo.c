@@ -1,3 +1,28 @@
+#include <errno.h>
 #include "file.h"
 
 struct file_info __file_info[NFILES];
+
+/*
+ * Buffers come from the heap as files are first read, so that the
+ * many files never read from, or read from memory, don't tie one up;
+ * size is the one to have if setvbuf() hasn't asked for another.
+ */
+int __file_buffer(struct file_info *fp, size_t size)
+{
+    if (fp->i.buf)
+	return 0;
+
+    if (fp->i.bufsize)
+	size = fp->i.bufsize;
+
+    fp->i.bufmem = malloc(size);
+    if (!fp->i.bufmem) {
+	errno = ENOMEM;
+	return -1;
+    }
+
+    fp->i.buf = fp->i.datap = fp->i.bufmem;
+    fp->i.bufsize = size;
+    return 0;
+}
@@ -39,12 +39,30 @@
 #include <minmax.h>
 #include "file.h"
 
+/*
+ * The buffer a file gets unless setvbuf() said otherwise: room for all
+ * of it, in whole blocks, if it is small; else FILEBUF_MAX, which is
+ * also what a file of unknown size gets.  The bigger the buffer, the
+ * fewer the trips through the core; for a file on the network, those
+ * are what keep the transfer waiting on us.
+ */
+static size_t file_bufsize(const struct file_info *fp)
+{
+    size_t blk = (size_t)1 << fp->i.fd.blocklg2;
+    size_t size = min(fp->i.fd.size, (size_t)FILEBUF_MAX);
+
+    return max((size + blk - 1) & ~(blk - 1), blk);
+}
+
 int __file_get_block(struct file_info *fp)
 {
     ssize_t bytes_read;
 
+    if (__file_buffer(fp, file_bufsize(fp)))
+	return -1;
+
     bytes_read = pmapi_read_file(&fp->i.fd.handle, fp->i.buf,
-					  MAXBLOCK >> fp->i.fd.blocklg2);
+				 fp->i.bufsize >> fp->i.fd.blocklg2);
     if (!bytes_read) {
 	errno = EIO;
 	return -1;
@@ -61,13 +79,19 @@ ssize_t __file_read(struct file_info * fp, void *buf, size_t count)
     ssize_t n = 0;
     size_t ncopy;
 
+    if (__file_buffer(fp, file_bufsize(fp)))
+	return -1;
+
     while (count) {
 	if (fp->i.nbytes == 0) {
 	    if (fp->i.offset >= fp->i.fd.size || !fp->i.fd.handle)
 		return n;	/* As good as it gets... */
 
-	    if (count > MAXBLOCK) {
-		/* Large transfer: copy directly, without buffering */
+	    if (count >= fp->i.bufsize) {
+		/*
+		 * Large transfer: have getfssec read whole blocks straight
+		 * into the caller's buffer; only the tail is buffered.
+		 */
 		ncopy = pmapi_read_file(&fp->i.fd.handle, bufp,
 						 count >> fp->i.fd.blocklg2);
 		if (!ncopy) {
@@ -75,6 +99,7 @@ ssize_t __file_read(struct file_info * fp, void *buf, size_t count)
 		    return n ? n : -1;
 		}
 
+		fp->i.offset += ncopy;
 		goto got_data;
 	    } else {
 		if (__file_get_block(fp))
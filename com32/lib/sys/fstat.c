@@ -47,9 +47,10 @@ int fstat(int fd, struct stat *buf)
     if (fp->iop->flags & __DEV_FILE) {
 	if (fp->i.fd.size == (uint32_t) - 1) {
 	    /* File of unknown length, report it as a socket
-	       (it probably really is, anyway!) */
+	       (it probably really is, anyway!); st_size is then
+	       only a guess, for sizing a buffer, or 0 */
 	    buf->st_mode = S_IFSOCK | 0444;
-	    buf->st_size = 0;
+	    buf->st_size = fp->i.size_hint;
 	} else {
 	    buf->st_mode = S_IFREG | 0444;
 	    buf->st_size = fp->i.fd.size;
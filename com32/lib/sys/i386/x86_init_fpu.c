@@ -5,6 +5,9 @@
  */
 
 #include <inttypes.h>
+#include <com32.h>
+#include <cpufeature.h>
+#include <sys/cpu.h>
 #include <sys/fpu.h>
 
 static inline uint64_t get_cr0(void)
@@ -19,6 +22,18 @@ static inline void set_cr0(uint32_t v)
     asm volatile ("movl %0,%%cr0"::"r" (v));
 }
 
+static inline uint32_t get_cr4(void)
+{
+    uint32_t v;
+asm("movl %%cr4,%0":"=r"(v));
+    return v;
+}
+
+static inline void set_cr4(uint32_t v)
+{
+    asm volatile ("movl %0,%%cr4"::"r" (v));
+}
+
 #define CR0_PE	0x00000001
 #define CR0_MP  0x00000002
 #define CR0_EM  0x00000004
@@ -31,6 +46,9 @@ static inline void set_cr0(uint32_t v)
 #define CR0_CD  0x40000000
 #define CR0_PG  0x80000000
 
+#define CR4_OSFXSR     0x00000200
+#define CR4_OSXMMEXCPT 0x00000400
+
 int x86_init_fpu(void)
 {
     uint32_t cr0;
@@ -56,3 +74,37 @@ int x86_init_fpu(void)
 
     return 0;
 }
+
+/*
+ * See <sys/fpu.h>: SSE is only switched on around the code that uses
+ * it, and whatever we changed is put back afterwards.
+ */
+int x86_has_sse(void)
+{
+    const uint32_t need = (1 << X86_FEATURE_FXSR) | (1 << X86_FEATURE_XMM);
+
+    return cpu_has_eflag(EFLAGS_ID) && cpuid_eax(0) >= 1 &&
+	(cpuid_edx(1) & need) == need;
+}
+
+void x86_sse_begin(struct x86_sse_state *st)
+{
+    st->cr0 = get_cr0();
+    if (st->cr0 & (CR0_EM | CR0_TS))
+	set_cr0(st->cr0 & ~(CR0_EM | CR0_TS));
+
+    st->cr4 = get_cr4();
+    if ((st->cr4 & (CR4_OSFXSR | CR4_OSXMMEXCPT)) !=
+	(CR4_OSFXSR | CR4_OSXMMEXCPT))
+	set_cr4(st->cr4 | CR4_OSFXSR | CR4_OSXMMEXCPT);
+}
+
+void x86_sse_end(const struct x86_sse_state *st)
+{
+    if ((st->cr4 & (CR4_OSFXSR | CR4_OSXMMEXCPT)) !=
+	(CR4_OSFXSR | CR4_OSXMMEXCPT))
+	set_cr4(st->cr4);
+
+    if (st->cr0 & (CR0_EM | CR0_TS))
+	set_cr0(st->cr0);
+}
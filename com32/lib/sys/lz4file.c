@@ -0,0 +1,618 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Permission is hereby granted, free of charge, to any person
+ *   obtaining a copy of this software and associated documentation
+ *   files (the "Software"), to deal in the Software without
+ *   restriction, including without limitation the rights to use,
+ *   copy, modify, merge, publish, distribute, sublicense, and/or
+ *   sell copies of the Software, and to permit persons to whom
+ *   the Software is furnished to do so, subject to the following
+ *   conditions:
+ *
+ *   The above copyright notice and this permission notice shall
+ *   be included in all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *   OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *   HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *   OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * lz4file.c
+ *
+ * LZ4 frame format decompressor for zopen().  Each block is decoded
+ * whole into an output buffer, which read() then drains; blocks that
+ * depend on earlier ones find the last 64K of output just below them.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <pmapi.h>
+#include <minmax.h>
+
+#include "file.h"
+
+int __file_close(struct file_info *fp);
+
+#define LZ4_MAGIC	0x184D2204
+#define LZ4_SKIP_MAGIC	0x184D2A50	/* Low 4 bits are free */
+#define LZ4_SKIP_MASK	0xFFFFFFF0
+
+/* Frame descriptor FLG bits */
+#define LZ4_F_VERSION	0xc0
+#define LZ4_F_VERSION1	0x40
+#define LZ4_F_INDEP	0x20
+#define LZ4_F_BCSUM	0x10
+#define LZ4_F_CSIZE	0x08
+#define LZ4_F_CCSUM	0x04
+#define LZ4_F_DICTID	0x01
+
+#define LZ4_UNCOMPRESSED 0x80000000	/* Block size flag */
+#define LZ4_HISTORY	65536		/* Maximum match distance */
+#define LZ4_INBUF_SLACK	65536		/* Room for whole-block reads */
+#define LZ4_MIN_MATCH	4
+
+/*
+ * xxHash32, used for the header, block and content checksums
+ */
+#define XXH_P1	2654435761U
+#define XXH_P2	2246822519U
+#define XXH_P3	3266489917U
+#define XXH_P4	668265263U
+#define XXH_P5	374761393U
+
+struct xxh32 {
+    uint32_t v[4];
+    uint32_t total;
+    uint8_t buf[16];
+    unsigned int nbuf;
+};
+
+static inline uint32_t rotl32(uint32_t x, int r)
+{
+    return (x << r) | (x >> (32 - r));
+}
+
+static inline uint32_t get_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint32_t xxh32_round(uint32_t acc, const uint8_t *p)
+{
+    acc += get_le32(p) * XXH_P2;
+    return rotl32(acc, 13) * XXH_P1;
+}
+
+static void xxh32_init(struct xxh32 *s)
+{
+    s->v[0] = XXH_P1 + XXH_P2;
+    s->v[1] = XXH_P2;
+    s->v[2] = 0;
+    s->v[3] = -XXH_P1;
+    s->total = 0;
+    s->nbuf = 0;
+}
+
+static void xxh32_update(struct xxh32 *s, const uint8_t *p, size_t len)
+{
+    const uint8_t *end = p + len;
+
+    s->total += len;
+
+    if (s->nbuf) {
+	size_t n = 16 - s->nbuf;
+
+	if (n > len)
+	    n = len;
+	memcpy(s->buf + s->nbuf, p, n);
+	s->nbuf += n;
+	p += n;
+	if (s->nbuf < 16)
+	    return;
+	s->v[0] = xxh32_round(s->v[0], s->buf);
+	s->v[1] = xxh32_round(s->v[1], s->buf + 4);
+	s->v[2] = xxh32_round(s->v[2], s->buf + 8);
+	s->v[3] = xxh32_round(s->v[3], s->buf + 12);
+	s->nbuf = 0;
+    }
+
+    while (end - p >= 16) {
+	s->v[0] = xxh32_round(s->v[0], p);
+	s->v[1] = xxh32_round(s->v[1], p + 4);
+	s->v[2] = xxh32_round(s->v[2], p + 8);
+	s->v[3] = xxh32_round(s->v[3], p + 12);
+	p += 16;
+    }
+
+    memcpy(s->buf, p, end - p);
+    s->nbuf = end - p;
+}
+
+static uint32_t xxh32_digest(const struct xxh32 *s)
+{
+    const uint8_t *p = s->buf;
+    const uint8_t *end = p + s->nbuf;
+    uint32_t h;
+
+    if (s->total >= 16)
+	h = rotl32(s->v[0], 1) + rotl32(s->v[1], 7) +
+	    rotl32(s->v[2], 12) + rotl32(s->v[3], 18);
+    else
+	h = s->v[2] + XXH_P5;	/* v[2] is still the seed */
+
+    h += s->total;
+
+    while (end - p >= 4) {
+	h += get_le32(p) * XXH_P3;
+	h = rotl32(h, 17) * XXH_P4;
+	p += 4;
+    }
+    while (p < end) {
+	h += *p++ * XXH_P5;
+	h = rotl32(h, 11) * XXH_P1;
+    }
+
+    h ^= h >> 15;
+    h *= XXH_P2;
+    h ^= h >> 13;
+    h *= XXH_P3;
+    h ^= h >> 16;
+
+    return h;
+}
+
+static uint32_t xxh32(const uint8_t *p, size_t len)
+{
+    struct xxh32 s;
+
+    xxh32_init(&s);
+    xxh32_update(&s, p, len);
+    return xxh32_digest(&s);
+}
+
+/*
+ * Decode one LZ4 block at ip into op.  Matches may reach back as
+ * far as low.  Returns the end of the output, or NULL if the block is
+ * malformed or doesn't fit before oend.
+ */
+static uint8_t *lz4_decode_block(const uint8_t *ip, size_t len,
+				 uint8_t *op, uint8_t *oend,
+				 const uint8_t *low)
+{
+    const uint8_t *iend = ip + len;
+    const uint8_t *match;
+    unsigned int token;
+    size_t n, offset;
+
+    for (;;) {
+	if (ip >= iend)
+	    return NULL;
+	token = *ip++;
+
+	/* Literals */
+	n = token >> 4;
+	if (n == 15) {
+	    unsigned int b;
+
+	    do {
+		if (ip >= iend)
+		    return NULL;
+		b = *ip++;
+		n += b;
+	    } while (b == 255);
+	}
+	if (n > (size_t)(iend - ip) || n > (size_t)(oend - op))
+	    return NULL;
+	memcpy(op, ip, n);
+	ip += n;
+	op += n;
+
+	/* The last sequence ends with its literals */
+	if (ip == iend)
+	    return op;
+
+	/* Match */
+	if (iend - ip < 2)
+	    return NULL;
+	offset = ip[0] | (ip[1] << 8);
+	ip += 2;
+	if (!offset || offset > (size_t)(op - low))
+	    return NULL;
+	match = op - offset;
+
+	n = token & 15;
+	if (n == 15) {
+	    unsigned int b;
+
+	    do {
+		if (ip >= iend)
+		    return NULL;
+		b = *ip++;
+		n += b;
+	    } while (b == 255);
+	}
+	n += LZ4_MIN_MATCH;
+	if (n > (size_t)(oend - op))
+	    return NULL;
+
+	if (offset >= 8) {
+	    /* Copy in 8-byte steps, stopping short of the buffer end */
+	    uint8_t *mend = op + n;
+
+	    while (op < mend && oend - op >= 8) {
+		memcpy(op, match, 8);
+		op += 8;
+		match += 8;
+	    }
+	    if (op > mend) {
+		op = mend;
+	    } else {
+		while (op < mend)
+		    *op++ = *match++;
+	    }
+	} else {
+	    /* Overlapping match: repeats a short pattern */
+	    while (n--)
+		*op++ = *match++;
+	}
+    }
+}
+
+struct lz4_file {
+    uint8_t *in;		/* Compressed input buffer */
+    size_t in_size;
+    const uint8_t *inp;		/* Unconsumed input */
+    size_t in_avail;
+
+    uint8_t *out;		/* LZ4_HISTORY of history, then one block */
+    size_t out_size;
+    uint8_t *hist;		/* Oldest byte matches may refer to */
+    uint8_t *outp;		/* Decoded data not yet returned */
+    uint8_t *out_end;		/* End of decoded data */
+
+    uint32_t block_max;		/* Largest block in this frame */
+    uint8_t flags;		/* Frame descriptor FLG byte */
+    bool in_frame;		/* Between a frame header and its end mark */
+    bool eof;
+    struct xxh32 csum;		/* Running content checksum */
+};
+
+static ssize_t lz4_file_read(struct file_info *, void *, size_t);
+static int lz4_file_close(struct file_info *);
+
+static const struct input_dev lz4_file_dev = {
+    .dev_magic = __DEV_MAGIC,
+    .flags = __DEV_FILE | __DEV_INPUT,
+    .fileflags = O_RDONLY,
+    .read = lz4_file_read,
+    .close = lz4_file_close,
+    .open = NULL,
+};
+
+/*
+ * Make sure at least n bytes of input are available in one piece.
+ * Returns 1 at a clean end of file (no input at all left), 0 on
+ * success, -1 on error.
+ */
+static int lz4_need(struct file_info *fp, struct lz4_file *lz, size_t n)
+{
+    size_t bytes_read, space;
+
+    if (lz->in_avail >= n)
+	return 0;
+
+    if (n > lz->in_size) {
+	errno = EIO;
+	return -1;
+    }
+
+    memmove(lz->in, lz->inp, lz->in_avail);
+    lz->inp = lz->in;
+
+    while (lz->in_avail < n) {
+	if (!fp->i.fd.handle) {
+	    if (lz->in_avail)
+		errno = EIO;	/* Truncated */
+	    return lz->in_avail ? -1 : 1;
+	}
+
+	space = lz->in_size - lz->in_avail;
+	bytes_read = pmapi_read_file(&fp->i.fd.handle,
+				     lz->in + lz->in_avail,
+				     space >> fp->i.fd.blocklg2);
+	if (!bytes_read) {
+	    errno = EIO;
+	    return -1;
+	}
+	lz->in_avail += bytes_read;
+    }
+
+    return 0;
+}
+
+static inline void lz4_consume(struct lz4_file *lz, size_t n)
+{
+    lz->inp += n;
+    lz->in_avail -= n;
+}
+
+/* Grow the buffers to hold a frame with the given maximum block size */
+static int lz4_size_buffers(struct lz4_file *lz, uint32_t block_max)
+{
+    size_t in_size = block_max + 8 + LZ4_INBUF_SLACK;
+    size_t out_size = LZ4_HISTORY + block_max;
+    uint8_t *p;
+
+    if (in_size > lz->in_size) {
+	size_t inp = lz->inp - lz->in;
+
+	p = realloc(lz->in, in_size);
+	if (!p)
+	    return -1;
+	lz->in = p;
+	lz->inp = p + inp;
+	lz->in_size = in_size;
+    }
+
+    if (out_size > lz->out_size) {
+	/* Called between frames: nothing in here is needed any more */
+	p = realloc(lz->out, out_size);
+	if (!p)
+	    return -1;
+	lz->out = p;
+	lz->out_size = out_size;
+    }
+
+    lz->block_max = block_max;
+    return 0;
+}
+
+/*
+ * Read the next frame header, skipping skippable frames.  Returns 1
+ * if the input ends before another frame starts.
+ */
+static int lz4_frame_header(struct file_info *fp, struct lz4_file *lz)
+{
+    const uint8_t *h;
+    uint32_t magic;
+    size_t hlen;
+    int rv;
+
+    for (;;) {
+	rv = lz4_need(fp, lz, 4);
+	if (rv)
+	    return rv;
+
+	magic = get_le32(lz->inp);
+	if ((magic & LZ4_SKIP_MASK) != LZ4_SKIP_MAGIC)
+	    break;
+
+	if (lz4_need(fp, lz, 8))
+	    return -1;
+	magic = get_le32(lz->inp + 4);
+	lz4_consume(lz, 8);
+	while (magic) {
+	    size_t n;
+
+	    if (!lz->in_avail && lz4_need(fp, lz, 1))
+		return -1;
+	    n = lz->in_avail < magic ? lz->in_avail : magic;
+	    lz4_consume(lz, n);
+	    magic -= n;
+	}
+    }
+
+    if (magic != LZ4_MAGIC) {
+	/* Trailing data after the last frame is ignored */
+	return 1;
+    }
+
+    if (lz4_need(fp, lz, 7))
+	return -1;
+
+    h = lz->inp + 4;
+    if ((h[0] & LZ4_F_VERSION) != LZ4_F_VERSION1 || (h[0] & 0x02) ||
+	(h[1] & 0x8f) || (h[1] >> 4) < 4)
+	goto bad;
+
+    hlen = 4 + 2 + 1;
+    if (h[0] & LZ4_F_CSIZE)
+	hlen += 8;
+    if (h[0] & LZ4_F_DICTID)
+	hlen += 4;
+
+    if (lz4_need(fp, lz, hlen))
+	return -1;
+    h = lz->inp + 4;
+
+    if (((xxh32(h, hlen - 5) >> 8) & 0xff) != h[hlen - 5])
+	goto bad;
+
+    /* We have no way to get at a preset dictionary */
+    if (h[0] & LZ4_F_DICTID)
+	goto bad;
+
+    lz->flags = h[0];
+    if (lz4_size_buffers(lz, 1 << (8 + 2 * (h[1] >> 4)))) {
+	errno = ENOMEM;
+	return -1;
+    }
+    lz4_consume(lz, hlen);
+
+    /* A new frame starts with no history */
+    lz->hist = lz->outp = lz->out_end = lz->out + LZ4_HISTORY;
+    lz->in_frame = true;
+    xxh32_init(&lz->csum);
+
+    return 0;
+
+bad:
+    errno = EIO;
+    return -1;
+}
+
+/* Decode the next block of the frame into the output buffer */
+static int lz4_next_block(struct file_info *fp, struct lz4_file *lz)
+{
+    uint8_t *op = lz->out + LZ4_HISTORY;
+    uint8_t *low = op;
+    uint32_t bsize, csize;
+    size_t bcsum = (lz->flags & LZ4_F_BCSUM) ? 4 : 0;
+    uint8_t *end;
+
+    if (lz4_need(fp, lz, 4))
+	goto bad;
+    bsize = get_le32(lz->inp);
+    lz4_consume(lz, 4);
+
+    if (!bsize) {
+	/* End mark */
+	if (lz->flags & LZ4_F_CCSUM) {
+	    if (lz4_need(fp, lz, 4))
+		goto bad;
+	    if (get_le32(lz->inp) != xxh32_digest(&lz->csum))
+		goto bad;
+	    lz4_consume(lz, 4);
+	}
+	lz->in_frame = false;
+	return 0;
+    }
+
+    csize = bsize & ~LZ4_UNCOMPRESSED;
+    if (csize > lz->block_max)
+	goto bad;
+    if (lz4_need(fp, lz, csize + bcsum))
+	goto bad;
+    if (bcsum && get_le32(lz->inp + csize) != xxh32(lz->inp, csize))
+	goto bad;
+
+    if (!(lz->flags & LZ4_F_INDEP)) {
+	/* Slide the tail of the previous output down as history */
+	size_t keep = lz->out_end - lz->hist;
+
+	if (keep > LZ4_HISTORY)
+	    keep = LZ4_HISTORY;
+	low = op - keep;
+	if (lz->out_end != op)
+	    memmove(low, lz->out_end - keep, keep);
+    }
+
+    if (bsize & LZ4_UNCOMPRESSED) {
+	memcpy(op, lz->inp, csize);
+	end = op + csize;
+    } else {
+	end = lz4_decode_block(lz->inp, csize, op, op + lz->block_max, low);
+	if (!end)
+	    goto bad;
+    }
+    lz4_consume(lz, csize + bcsum);
+
+    if (lz->flags & LZ4_F_CCSUM)
+	xxh32_update(&lz->csum, op, end - op);
+
+    lz->hist = low;
+    lz->outp = op;
+    lz->out_end = end;
+    return 0;
+
+bad:
+    errno = EIO;
+    return -1;
+}
+
+static ssize_t lz4_file_read(struct file_info *fp, void *ptr, size_t n)
+{
+    struct lz4_file *lz = fp->i.pvt;
+    unsigned char *p = ptr;
+    ssize_t nout = 0;
+    size_t bytes;
+    int rv;
+
+    while (n) {
+	if (lz->outp == lz->out_end) {
+	    if (lz->eof)
+		break;
+
+	    if (!lz->in_frame) {
+		rv = lz4_frame_header(fp, lz);
+		if (rv) {
+		    if (rv < 0)
+			return nout ? nout : -1;
+		    lz->eof = true;
+		    break;
+		}
+	    }
+
+	    if (lz4_next_block(fp, lz))
+		return nout ? nout : -1;
+	    continue;
+	}
+
+	bytes = lz->out_end - lz->outp;
+	if (bytes > n)
+	    bytes = n;
+	memcpy(p, lz->outp, bytes);
+	lz->outp += bytes;
+	p += bytes;
+	n -= bytes;
+	nout += bytes;
+    }
+
+    return nout;
+}
+
+static int lz4_file_close(struct file_info *fp)
+{
+    struct lz4_file *lz = fp->i.pvt;
+
+    free(lz->in);
+    free(lz->out);
+    free(lz);
+    return __file_close(fp);
+}
+
+/*
+ * Set up decompression for a file whose first block, already in the
+ * file buffer, starts with the LZ4 frame magic.
+ */
+int __lz4_file_init(struct file_info *fp)
+{
+    struct lz4_file *lz = calloc(1, sizeof(struct lz4_file));
+
+    if (!lz)
+	return -1;
+
+    fp->i.pvt = lz;
+
+    lz->in_size = LZ4_INBUF_SLACK + max(fp->i.nbytes, MAXBLOCK);
+    lz->in = malloc(lz->in_size);
+    if (!lz->in)
+	return -1;
+    memcpy(lz->in, fp->i.datap, fp->i.nbytes);
+    lz->inp = lz->in;
+    lz->in_avail = fp->i.nbytes;
+
+    fp->iop = &lz4_file_dev;
+    fp->i.fd.size = -1;		/* Unknown */
+
+    /*
+     * The first frame may record its content size.  There may be more
+     * frames, and the header hasn't been checked yet, so this is only
+     * a hint.
+     */
+    if (fp->i.nbytes >= 14 && (lz->in[4] & LZ4_F_CSIZE) &&
+	!get_le32(lz->in + 10))
+	fp->i.size_hint = get_le32(lz->in + 6);
+
+    return 0;
+}
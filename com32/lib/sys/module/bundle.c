@@ -0,0 +1,204 @@
+/*
+ * bundle.c - Modules fetched together in one file
+ *
+ * A module bundle is a plain archive of modules with a table of
+ * contents up front, so that all the modules a boot needs can come
+ * in a single transfer instead of one open and read each.  Loaded
+ * bundles are searched by image_load() before PATH.
+ *
+ * Bundles are only read when the configuration asks for one (the
+ * BUNDLE directive), by which time LDLINUX and libcom32.c32 have come
+ * from their own files.  Those have to match the core exactly, so a
+ * stale bundle must never be able to stand in for them.
+ *
+ * The layout (all fields little endian, see utils/mkbundle):
+ *
+ *	struct module_bundle_header
+ *	struct module_bundle_entry[count]
+ *	the module files, at the offsets given by the entries
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dprintf.h>
+
+#include <linux/list.h>
+#include <sys/module.h>
+
+#include "common.h"
+
+#define MODULE_BUNDLE_MAGIC	"SYSLXBND"
+#define MODULE_BUNDLE_VERSION	1
+
+struct module_bundle_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t count;			/* Number of entries */
+};
+
+struct module_bundle_entry {
+	uint32_t offset;		/* From the start of the bundle */
+	uint32_t size;
+	char name[56];			/* NUL-terminated */
+};
+
+struct module_bundle {
+	struct list_head list;
+	char *name;			/* As passed to module_bundle_load() */
+	size_t size;
+	char *data;			/* The whole file */
+};
+
+static LIST_HEAD(module_bundles);
+
+static int module_bundle_check(const char *data, size_t size)
+{
+	const struct module_bundle_header *hdr = (const void *)data;
+	const struct module_bundle_entry *ent;
+	uint32_t i;
+
+	ent = (const void *)(hdr + 1);
+	for (i = 0; i < hdr->count; i++, ent++) {
+		if (ent->offset > size || ent->size > size - ent->offset)
+			return -1;
+		if (!memchr(ent->name, '\0', sizeof ent->name))
+			return -1;
+	}
+
+	return 0;
+}
+
+int module_bundle_load(const char *name)
+{
+	struct module_bundle_header hdr;
+	struct module_bundle_entry ent;
+	struct module_bundle *bundle;
+	size_t toc, size;
+	char *data = NULL;
+	uint32_t i;
+	FILE *f;
+
+	list_for_each_entry(bundle, &module_bundles, list) {
+		if (!strcmp(bundle->name, name))
+			return 0;
+	}
+
+	f = findpath((char *)name);
+	if (!f)
+		return -1;
+
+	if (fread(&hdr, sizeof hdr, 1, f) != 1 ||
+	    memcmp(hdr.magic, MODULE_BUNDLE_MAGIC, sizeof hdr.magic) ||
+	    hdr.version != MODULE_BUNDLE_VERSION ||
+	    hdr.count > 4096) {
+		dprintf("%s: not a module bundle\n", name);
+		goto bad;
+	}
+
+	/*
+	 * The table of contents tells how big the whole thing is, so it
+	 * can be read in one go.
+	 */
+	toc = sizeof hdr + hdr.count * sizeof ent;
+	size = toc;
+
+	data = malloc(toc);
+	if (!data)
+		goto bad;
+
+	memcpy(data, &hdr, sizeof hdr);
+	if (hdr.count &&
+	    fread(data + sizeof hdr, toc - sizeof hdr, 1, f) != 1)
+		goto bad;
+
+	for (i = 0; i < hdr.count; i++) {
+		memcpy(&ent, data + sizeof hdr + i * sizeof ent, sizeof ent);
+		if (ent.offset < toc)
+			goto bad;
+		size = MAX(size, (size_t)ent.offset + ent.size);
+	}
+
+	if (size > toc) {
+		char *p = realloc(data, size);
+
+		if (!p)
+			goto bad;
+		data = p;
+
+		if (fread(data + toc, size - toc, 1, f) != 1)
+			goto bad;
+	}
+
+	fclose(f);
+	f = NULL;
+
+	if (module_bundle_check(data, size))
+		goto bad;
+
+	bundle = malloc(sizeof *bundle);
+	if (!bundle)
+		goto bad;
+
+	bundle->name = strdup(name);
+	if (!bundle->name) {
+		free(bundle);
+		goto bad;
+	}
+
+	bundle->data = data;
+	bundle->size = size;
+	list_add(&bundle->list, &module_bundles);
+
+	dprintf("%s: %u modules in %zu bytes\n", name, hdr.count, size);
+	return 0;
+
+bad:
+	free(data);
+	if (f)
+		fclose(f);
+	return -1;
+}
+
+/*
+ * Look a plain module name up in the loaded bundles, the most recently
+ * loaded first.
+ */
+const void *module_bundle_find(const char *name, size_t *size)
+{
+	const struct module_bundle_header *hdr;
+	const struct module_bundle_entry *ent;
+	struct module_bundle *bundle;
+	uint32_t i;
+
+	list_for_each_entry(bundle, &module_bundles, list) {
+		hdr = (const void *)bundle->data;
+		ent = (const void *)(hdr + 1);
+
+		for (i = 0; i < hdr->count; i++, ent++) {
+			if (!strcmp(ent->name, name)) {
+				*size = ent->size;
+				return bundle->data + ent->offset;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+size_t module_bundle_release(void)
+{
+	struct module_bundle *bundle, *tmp;
+	size_t size = 0;
+
+	list_for_each_entry_safe(bundle, tmp, &module_bundles, list) {
+		list_del(&bundle->list);
+		size += bundle->size;
+		free(bundle->name);
+		free(bundle->data);
+		free(bundle);
+	}
+
+	return size;
+}
@@ -0,0 +1,276 @@
+/*
+ * cache.c - Resident cache of unloaded modules
+ *
+ * A menu typically runs the same modules again and again, and over
+ * PXE every load means fetching, relocating and linking the file
+ * anew.  So when a module is unloaded, its image is kept as it is,
+ * along with a copy of its writable data as it was right after
+ * relocation, before any constructor ran.  Loading it again restores
+ * that data, links it back in and runs the constructors, without
+ * touching the file.
+ *
+ * An image can only be reused if every module it was linked against
+ * is still the same one: still loaded, or itself in the cache (in
+ * which case it is brought back first).  Each load gets a unique
+ * instance number to tell.  The least recently unloaded images are
+ * dropped once the cache grows past its limit, or when memory is
+ * needed for something else.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <dprintf.h>
+
+#include <linux/list.h>
+#include <sys/module.h>
+
+#include "common.h"
+
+#define MODULE_CACHE_DEFAULT_LIMIT	(2 << 20)
+
+static LIST_HEAD(module_cache);		/* Most recently unloaded first */
+static size_t module_cache_size;
+static size_t module_cache_max = MODULE_CACHE_DEFAULT_LIMIT;
+static uint32_t module_instances;
+
+static size_t module_cache_cost(struct elf_module *module)
+{
+	return sizeof *module + module->module_size + module->data_filesz +
+		module->nr_cache_deps * sizeof *module->cache_deps;
+}
+
+/*
+ * Number a module that just got loaded, and keep a copy of its
+ * relocated data for when it comes back from the cache.
+ */
+void module_cache_track(struct elf_module *module)
+{
+	module->instance = ++module_instances;
+	module->cacheable = false;
+
+	if (!module_cache_max)
+		return;
+
+	if (module->data_filesz) {
+		module->data_copy = malloc(module->data_filesz);
+		if (!module->data_copy)
+			return;
+
+		memcpy(module->data_copy,
+		       module_get_absolute(module->data_addr, module),
+		       module->data_filesz);
+	}
+
+	module->cacheable = true;
+}
+
+static void module_cache_drop(struct elf_module *module)
+{
+	dprintf("module cache: dropping %s\n", module->name);
+
+	list_del_init(&module->list);
+	module_cache_size -= module_cache_cost(module);
+	module_free(module);
+}
+
+static void module_cache_trim(size_t max)
+{
+	struct elf_module *module;
+
+	while (module_cache_size > max && !list_empty(&module_cache)) {
+		module = list_entry(module_cache.prev, struct elf_module, list);
+		module_cache_drop(module);
+	}
+}
+
+/*
+ * Note which modules an unloading module is linked against, while its
+ * dependency list still says so.  Returns true if it should go into
+ * the cache rather than be freed, once it is off the module list.
+ */
+bool module_cache_prepare(struct elf_module *module)
+{
+	struct module_dep *dep;
+	int n = 0;
+
+	if (!module->cacheable || module->shallow)
+		return false;
+
+	list_for_each_entry(dep, &module->required, list)
+		n++;
+
+	free(module->cache_deps);
+	module->cache_deps = NULL;
+	module->nr_cache_deps = 0;
+
+	if (n) {
+		module->cache_deps = malloc(n * sizeof *module->cache_deps);
+		if (!module->cache_deps)
+			return false;
+
+		list_for_each_entry(dep, &module->required, list) {
+			module->cache_deps[module->nr_cache_deps].module = dep->module;
+			module->cache_deps[module->nr_cache_deps].instance =
+				dep->module->instance;
+			module->nr_cache_deps++;
+		}
+	}
+
+	return module_cache_cost(module) <= module_cache_max;
+}
+
+/* Put a module that has left the module list into the cache */
+void module_cache_add(struct elf_module *module)
+{
+	dprintf("module cache: keeping %s\n", module->name);
+
+	list_add(&module->list, &module_cache);
+	module_cache_size += module_cache_cost(module);
+	module_cache_trim(module_cache_max);
+}
+
+static struct elf_module *module_cache_find(const char *name)
+{
+	struct elf_module *module;
+
+	list_for_each_entry(module, &module_cache, list) {
+		if (!strcmp(module->name, name))
+			return module;
+	}
+
+	return NULL;
+}
+
+/*
+ * Where the module a cached one was linked against is now: 1 if it is
+ * loaded, 0 if it is in the cache, -1 if it is gone.  The descriptor
+ * is only compared against, as it may have been freed.
+ */
+static int module_cache_dep_state(struct module_cache_dep *cd)
+{
+	struct elf_module *module;
+
+	for_each_module(module) {
+		if (module == cd->module)
+			return module->instance == cd->instance ? 1 : -1;
+	}
+
+	list_for_each_entry(module, &module_cache, list) {
+		if (module == cd->module)
+			return module->instance == cd->instance ? 0 : -1;
+	}
+
+	return -1;
+}
+
+static int module_cache_revive(struct elf_module *module)
+{
+	struct module_cache_dep *cd;
+	module_ctor_t *ctor;
+	int i, state;
+
+	/* Someone loaded a new copy meanwhile */
+	if (module_find(module->name))
+		return -1;
+
+	for (i = 0; i < module->nr_cache_deps; i++) {
+		cd = &module->cache_deps[i];
+		state = module_cache_dep_state(cd);
+
+		if (state < 0)
+			return -1;
+		if (state == 0 && module_cache_revive(cd->module))
+			return -1;
+	}
+
+	list_del_init(&module->list);
+	module_cache_size -= module_cache_cost(module);
+
+	for (i = 0; i < module->nr_cache_deps; i++)
+		enforce_dependency(module->cache_deps[i].module, module);
+
+	if (module->data_filesz)
+		memcpy(module_get_absolute(module->data_addr, module),
+		       module->data_copy, module->data_filesz);
+	memset((char *)module_get_absolute(module->data_addr, module) +
+	       module->data_filesz, 0,
+	       module->data_memsz - module->data_filesz);
+
+	memset(&module->u, 0, sizeof module->u);
+
+	list_add(&module->list, &modules_head);
+	global_symbols_add(module);
+
+	dprintf("module cache: reusing %s\n", module->name);
+
+	for (ctor = module->ctors; ctor && *ctor; ctor++)
+		(*ctor) ();
+
+	return 0;
+}
+
+/*
+ * Bring a module back from the cache, as module_load() would load it.
+ * Returns NULL if it isn't there or can't be reused.
+ */
+struct elf_module *module_cache_get(const char *name)
+{
+	struct elf_module *module = module_cache_find(name);
+
+	if (!module)
+		return NULL;
+
+	if (module_cache_revive(module)) {
+		module_cache_drop(module);
+		return NULL;
+	}
+
+	return module;
+}
+
+size_t module_cache_flush(void)
+{
+	size_t size = module_cache_size;
+
+	module_cache_trim(0);
+	return size;
+}
+
+size_t module_cache_limit(size_t bytes)
+{
+	size_t old = module_cache_max;
+
+	module_cache_max = bytes;
+	module_cache_trim(bytes);
+	return old;
+}
+
+/*
+ * Load a module and the ones it needs, and unload it again at once,
+ * so that it waits in the cache for the time it is wanted.  Its
+ * libraries stay loaded, as they would after running it.  Returns 0
+ * if the module is now loaded or in the cache.
+ */
+int module_prefetch(const char *name)
+{
+	struct elf_module *module;
+
+	if (module_find(name) || module_cache_find(name))
+		return 0;
+
+	module = module_alloc(name);
+	if (!module)
+		return -1;
+
+	if (module_load(module)) {
+		dprintf("module cache: can't prefetch %s\n", name);
+		_module_unload(module);
+		return -1;
+	}
+
+	/* A library is simply left loaded */
+	if (get_module_type(module) != EXEC_MODULE)
+		return 0;
+
+	return module_unload(module);
+}
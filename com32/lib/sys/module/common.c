@@ -6,12 +6,17 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
 #include <elf.h>
+#include <ctype.h>
 #include <string.h>
+#include <dirent.h>
 #include <fs.h>
 
 #include <linux/list.h>
 #include <sys/module.h>
+#include <syslinux/trace.h>
 
 #include "elfutils.h"
 #include "common.h"
@@ -57,28 +62,208 @@ void print_elf_symbols(struct elf_module *module) {
 }
 #endif //ELF_DEBUG
 
-FILE *findpath(char *name)
+/*
+ * Index of the files in the PATH directories, so that looking for a
+ * module only tries to open it in the directories that have it.  It
+ * is built on first use by reading each directory once, and rebuilt
+ * whenever PATH changes.  Directories that can't be listed (TFTP, for
+ * one) are not indexed and are always probed, as before.
+ */
+#define PATH_INDEX_BUCKETS	128
+
+struct path_index_name {
+	struct path_index_name *next;
+	uint32_t hash;
+	int dir;			/* Index into path_index.dirs */
+	char name[];
+};
+
+struct path_index_dir {
+	struct path_entry *entry;
+	bool indexed;
+};
+
+static struct {
+	struct path_index_dir *dirs;	/* In PATH order; NULL = not built */
+	int ndirs;
+	struct path_index_name *buckets[PATH_INDEX_BUCKETS];
+} path_index;
+
+/* Case-insensitive, since FAT and ISO 9660 names are */
+static uint32_t path_index_hash(const char *name)
+{
+	uint32_t hash = 2166136261u;
+
+	while (*name) {
+		hash ^= tolower((unsigned char)*name++);
+		hash *= 16777619;
+	}
+
+	return hash;
+}
+
+static void path_index_free(void)
+{
+	struct path_index_name *pn, *next;
+	int i;
+
+	for (i = 0; i < PATH_INDEX_BUCKETS; i++) {
+		for (pn = path_index.buckets[i]; pn; pn = next) {
+			next = pn->next;
+			free(pn);
+		}
+		path_index.buckets[i] = NULL;
+	}
+
+	free(path_index.dirs);
+	path_index.dirs = NULL;
+	path_index.ndirs = 0;
+}
+
+/* Is the index still describing the current PATH list? */
+static bool path_index_valid(void)
+{
+	struct path_entry *entry;
+	int i = 0;
+
+	if (!path_index.dirs)
+		return false;
+
+	list_for_each_entry(entry, &PATH, list) {
+		if (i >= path_index.ndirs || path_index.dirs[i].entry != entry)
+			return false;
+		i++;
+	}
+
+	return i == path_index.ndirs;
+}
+
+static void path_index_dir(int dir)
+{
+	struct path_index_name *pn;
+	struct dirent *de;
+	uint32_t hash;
+	size_t len;
+	int count = 0;
+	DIR *d;
+
+	d = opendir(path_index.dirs[dir].entry->str);
+	if (!d)
+		return;
+
+	while ((de = readdir(d))) {
+		if (de->d_type == DT_DIR)
+			continue;
+
+		len = strlen(de->d_name);
+		pn = malloc(sizeof *pn + len + 1);
+		if (!pn)
+			break;
+
+		hash = path_index_hash(de->d_name);
+		pn->hash = hash;
+		pn->dir = dir;
+		memcpy(pn->name, de->d_name, len + 1);
+		pn->next = path_index.buckets[hash % PATH_INDEX_BUCKETS];
+		path_index.buckets[hash % PATH_INDEX_BUCKETS] = pn;
+		count++;
+	}
+
+	/*
+	 * A partial listing would hide files, so only trust a full one.
+	 * An empty one more likely means readdir isn't supported.
+	 */
+	path_index.dirs[dir].indexed = !de && count;
+	closedir(d);
+}
+
+static bool path_index_build(void)
 {
 	struct path_entry *entry;
+	int i, n = 0;
+
+	path_index_free();
+
+	list_for_each_entry(entry, &PATH, list)
+		n++;
+
+	path_index.dirs = calloc(n ? n : 1, sizeof *path_index.dirs);
+	if (!path_index.dirs)
+		return false;
+	path_index.ndirs = n;
+
+	i = 0;
+	list_for_each_entry(entry, &PATH, list)
+		path_index.dirs[i++].entry = entry;
+
+	for (i = 0; i < n; i++)
+		path_index_dir(i);
+
+	return true;
+}
+
+/* Could the directory have this file, as far as the index knows? */
+static bool path_index_may_have(int dir, const char *name, uint32_t hash)
+{
+	struct path_index_name *pn;
+
+	if (!path_index.dirs[dir].indexed)
+		return true;
+
+	for (pn = path_index.buckets[hash % PATH_INDEX_BUCKETS]; pn;
+	     pn = pn->next) {
+		if (pn->dir == dir && pn->hash == hash &&
+		    !strcasecmp(pn->name, name))
+			return true;
+	}
+
+	return false;
+}
+
+static FILE *path_open(struct path_entry *entry, const char *name)
+{
 	char path[FILENAME_MAX];
+	bool slash = false;
+
+	/* Ensure we have a '/' separator */
+	if (entry->str[strlen(entry->str) - 1] != '/')
+		slash = true;
+
+	snprintf(path, sizeof(path), "%s%s%s",
+		 entry->str, slash ? "/" : "", name);
+
+	dprintf("findpath: trying \"%s\"\n", path);
+	return fopen(path, "rb");
+}
+
+FILE *findpath(char *name)
+{
+	struct path_entry *entry;
+	uint32_t hash;
 	FILE *f;
+	int i;
 
 	f = fopen(name, "rb"); /* for full path */
 	if (f)
 		return f;
 
-	list_for_each_entry(entry, &PATH, list) {
-		bool slash = false;
-
-		/* Ensure we have a '/' separator */
-		if (entry->str[strlen(entry->str) - 1] != '/')
-			slash = true;
+	/* The index only knows about plain file names */
+	if (strchr(name, '/') ||
+	    (!path_index_valid() && !path_index_build())) {
+		list_for_each_entry(entry, &PATH, list) {
+			f = path_open(entry, name);
+			if (f)
+				return f;
+		}
+		return NULL;
+	}
 
-		snprintf(path, sizeof(path), "%s%s%s",
-			 entry->str, slash ? "/" : "", name);
+	hash = path_index_hash(name);
+	for (i = 0; i < path_index.ndirs; i++) {
+		if (!path_index_may_have(i, name, hash))
+			continue;
 
-		dprintf("findpath: trying \"%s\"\n", path);
-		f = fopen(path, "rb");
+		f = path_open(path_index.dirs[i].entry, name);
 		if (f)
 			return f;
 	}
@@ -90,62 +275,88 @@ FILE *findpath(char *name)
  * Image files manipulation routines
  */
 
-int image_load(struct elf_module *module)
+/*
+ * Read the whole file in one sequential pass: the ELF structures are
+ * then parsed from memory, in any order, without going back to the
+ * file (which over TFTP would mean reopening it).
+ */
+static int image_slurp(struct elf_module *module, FILE *f)
 {
-	module->u.l._file = findpath(module->name);
+	size_t size = 0, alloc = 0, n;
+	char *buf = NULL, *p;
+
+	do {
+		if (size == alloc) {
+			alloc = alloc ? alloc * 2 : 65536;
+			p = realloc(buf, alloc);
+			if (!p) {
+				free(buf);
+				return -1;
+			}
+			buf = p;
+		}
 
-	if (module->u.l._file == NULL) {
-		dprintf("Could not open object file '%s'\n", module->name);
-		goto error;
-	}
+		n = fread(buf + size, 1, alloc - size, f);
+		size += n;
+	} while (n);
+
+	module->u.l._buf = module->u.l._buf_alloc = buf;
+	module->u.l._buf_size = size;
+	return 0;
+}
+
+int image_load(struct elf_module *module)
+{
+	const void *data;
+	size_t size;
+	FILE *f;
+	int res;
 
 	module->u.l._cr_offset = 0;
 
-	return 0;
+	// A module in a loaded bundle needs no file access at all
+	if (!strchr(module->name, '/') &&
+	    (data = module_bundle_find(module->name, &size))) {
+		module->u.l._buf = data;
+		module->u.l._buf_size = size;
+		return 0;
+	}
+
+	f = findpath(module->name);
 
-error:
-	if (module->u.l._file != NULL) {
-		fclose(module->u.l._file);
-		module->u.l._file = NULL;
+	if (f == NULL) {
+		dprintf("Could not open object file '%s'\n", module->name);
+		return -1;
 	}
 
-	return -1;
+	res = image_slurp(module, f);
+	fclose(f);
+
+	return res;
 }
 
 
 int image_unload(struct elf_module *module) {
-	if (module->u.l._file != NULL) {
-		fclose(module->u.l._file);
-		module->u.l._file = NULL;
-
-	}
+	free(module->u.l._buf_alloc);
+	module->u.l._buf_alloc = NULL;
+	module->u.l._buf = NULL;
+	module->u.l._buf_size = 0;
 	module->u.l._cr_offset = 0;
 
 	return 0;
 }
 
 int image_read(void *buff, size_t size, struct elf_module *module) {
-	size_t result = fread(buff, size, 1, module->u.l._file);
-
-	if (result < 1)
+	if (size > module->u.l._buf_size - module->u.l._cr_offset)
 		return -1;
 
+	memcpy(buff, module->u.l._buf + module->u.l._cr_offset, size);
 	module->u.l._cr_offset += size;
 	return 0;
 }
 
 int image_skip(size_t size, struct elf_module *module) {
-	void *skip_buff = NULL;
-	size_t result;
-
-	if (size == 0)
-		return 0;
-
-	skip_buff = malloc(size);
-	result = fread(skip_buff, size, 1, module->u.l._file);
-	free(skip_buff);
-
-	if (result < 1)
+	if (size > module->u.l._buf_size - module->u.l._cr_offset)
 		return -1;
 
 	module->u.l._cr_offset += size;
@@ -153,10 +364,11 @@ int image_skip(size_t size, struct elf_module *module) {
 }
 
 int image_seek(Elf_Off offset, struct elf_module *module) {
-	if (offset < module->u.l._cr_offset) // Cannot seek backwards
+	if (offset > module->u.l._buf_size)
 		return -1;
 
-	return image_skip(offset - module->u.l._cr_offset, module);
+	module->u.l._cr_offset = offset;
+	return 0;
 }
 
 
@@ -316,50 +528,30 @@ int check_symbols(struct elf_module *module)
 	unsigned int i;
 	Elf_Sym *crt_sym = NULL, *ref_sym = NULL;
 	char *crt_name;
-	struct elf_module *crt_module;
-
-	int strong_count;
-	int weak_count;
 
 	for (i = 1; i < module->symtable_size/module->syment_size; i++)
 	{
 		crt_sym = symbol_get_entry(module, i);
 		crt_name = module->str_table + crt_sym->st_name;
 
-		strong_count = 0;
-		weak_count = (ELF32_ST_BIND(crt_sym->st_info) == STB_WEAK);
+		if (ELF32_ST_BIND(crt_sym->st_info) == STB_LOCAL)
+			continue;
 
-		for_each_module(crt_module)
-		{
-			ref_sym = module_find_symbol(crt_name, crt_module);
-
-			// If we found a definition for our symbol...
-			if (ref_sym != NULL && ref_sym->st_shndx != SHN_UNDEF)
-			{
-				switch (ELF32_ST_BIND(ref_sym->st_info))
-				{
-					case STB_GLOBAL:
-						strong_count++;
-						break;
-					case STB_WEAK:
-						weak_count++;
-						break;
-				}
-			}
-		}
+		ref_sym = global_find_symbol(crt_name, NULL);
 
 		if (crt_sym->st_shndx == SHN_UNDEF)
 		{
 			// We have an undefined symbol
 			//
-			// We use the weak_count to differentiate
-			// between Syslinux-derivative-specific
-			// functions. For example, unload_pxe() is
-			// only provided by PXELINUX, so we mark it as
-			// __weak and replace it with a reference to
-			// undefined_symbol() on SYSLINUX, EXTLINUX,
-			// and ISOLINUX. See perform_relocations().
-			if (strong_count == 0 && weak_count == 0)
+			// A weak reference needs no definition: these
+			// are Syslinux-derivative-specific functions.
+			// For example, unload_pxe() is only provided by
+			// PXELINUX, so we mark it as __weak and replace
+			// it with a reference to undefined_symbol() on
+			// SYSLINUX, EXTLINUX, and ISOLINUX. See
+			// perform_relocations().
+			if (ref_sym == NULL &&
+			    ELF32_ST_BIND(crt_sym->st_info) != STB_WEAK)
 			{
 				dprintf("Symbol %s is undefined\n", crt_name);
 				printf("Undef symbol FAIL: %s\n",crt_name);
@@ -368,14 +560,13 @@ int check_symbols(struct elf_module *module)
 		}
 		else
 		{
-			if (strong_count > 0 && ELF32_ST_BIND(ref_sym->st_info) == STB_GLOBAL)
+			if (ref_sym != NULL && ELF32_ST_BIND(ref_sym->st_info) == STB_GLOBAL)
 			{
 				// It's not an error - at relocation, the most recent symbol
 				// will be considered
 				dprintf("Info: Symbol %s is defined more than once\n", crt_name);
 			}
 		}
-		//printf("symbol %s laoded from %d\n",crt_name,crt_sym->st_value);
 	}
 
 	return 0;
@@ -392,12 +583,17 @@ int module_unloadable(struct elf_module *module) {
 // Unloads the module from the system and releases all the associated memory
 int _module_unload(struct elf_module *module) {
 	struct module_dep *crt_dep, *tmp;
+	bool cached;
+
 	// Make sure nobody needs us
 	if (!module_unloadable(module)) {
 		dprintf("Module is required by other modules.\n");
 		return -1;
 	}
 
+	// See whether the image can be kept for the next time it's needed
+	cached = module_cache_prepare(module);
+
 	// Remove any dependency information
 	list_for_each_entry_safe(crt_dep, tmp, &module->required, list) {
 		clear_dependency(crt_dep->module, module);
@@ -405,7 +601,22 @@ int _module_unload(struct elf_module *module) {
 
 	// Remove the module from the module list
 	list_del_init(&module->list);
+	global_symbols_remove(module);
+
+	dprintf("Unloading module %s\n", module->name);
+	trace_str(TRACE_MODULE, "module_unload", module->name,
+		  cached, 0);
+
+	if (cached)
+		module_cache_add(module);
+	else
+		module_free(module);
+
+	return 0;
+}
 
+// Releases all the memory associated with a module off the module list
+void module_free(struct elf_module *module) {
 	// Release the loaded segments or sections
 	if (module->module_addr != NULL) {
 		elf_free(module->module_addr);
@@ -414,11 +625,13 @@ int _module_unload(struct elf_module *module) {
 				module->name);
 	}
 
-	dprintf("Unloading module %s\n", module->name);
+	free(module->ctors);
+	free(module->dtors);
+	free(module->data_copy);
+	free(module->cache_deps);
+
 	// Release the module structure
 	free(module);
-
-	return 0;
 }
 
 int module_unload(struct elf_module *module) {
@@ -578,12 +791,136 @@ Elf_Sym *module_find_symbol(const char *name, struct elf_module *module) {
 	return result;
 }
 
-Elf_Sym *global_find_symbol(const char *name, struct elf_module **module) {
+/*
+ * Every GLOBAL or WEAK symbol defined by a loaded module, hashed by
+ * name, so that resolving a relocation doesn't have to ask each module
+ * in turn.  The module list has the most recently loaded module first,
+ * and that is the one whose definition wins; each entry carries the
+ * load sequence number of its module to get the same answer.  If the
+ * table ever can't be kept complete, lookups go back to asking each
+ * module.
+ */
+struct global_sym {
+	struct global_sym *next;
+	const char *name;
+	Elf_Sym *sym;
+	struct elf_module *module;
+	uint32_t hash;
+	uint32_t seq;
+};
+
+static struct global_sym **global_syms;
+static unsigned int global_syms_buckets;	/* Power of 2 */
+static unsigned int global_syms_count;
+static uint32_t global_syms_seq;
+static bool global_syms_broken;
+
+static void global_syms_rehash(void)
+{
+	unsigned int nbuckets = global_syms_buckets ? global_syms_buckets * 2 : 1024;
+	struct global_sym **buckets, *gs, *next;
+	unsigned int i;
+
+	buckets = calloc(nbuckets, sizeof *buckets);
+	if (!buckets)
+		return;			/* Just get longer chains */
+
+	for (i = 0; i < global_syms_buckets; i++) {
+		for (gs = global_syms[i]; gs; gs = next) {
+			next = gs->next;
+			gs->next = buckets[gs->hash & (nbuckets - 1)];
+			buckets[gs->hash & (nbuckets - 1)] = gs;
+		}
+	}
+
+	free(global_syms);
+	global_syms = buckets;
+	global_syms_buckets = nbuckets;
+}
+
+/*
+ * Enter the symbols a module defines into the global table; called as
+ * the module goes onto the module list.
+ */
+void global_symbols_add(struct elf_module *module)
+{
+	unsigned int i, nsyms;
+	struct global_sym *gs;
+	Elf_Sym *sym;
+	uint32_t seq;
+
+	if (global_syms_broken || !module->syment_size)
+		return;
+
+	seq = ++global_syms_seq;
+	module->symbol_seq = seq;
+	nsyms = module->symtable_size / module->syment_size;
+
+	for (i = 1; i < nsyms; i++) {
+		sym = symbol_get_entry(module, i);
+
+		if (sym->st_shndx == SHN_UNDEF)
+			continue;
+		if (ELF32_ST_BIND(sym->st_info) != STB_GLOBAL &&
+		    ELF32_ST_BIND(sym->st_info) != STB_WEAK)
+			continue;
+
+		if (global_syms_count >= 2 * global_syms_buckets)
+			global_syms_rehash();
+
+		gs = malloc(sizeof *gs);
+		if (!gs || !global_syms_buckets) {
+			free(gs);
+			global_syms_broken = true;
+			return;
+		}
+
+		gs->name = module->str_table + sym->st_name;
+		gs->hash = elf_gnu_hash((const unsigned char *)gs->name);
+		gs->sym = sym;
+		gs->module = module;
+		gs->seq = seq;
+		gs->next = global_syms[gs->hash & (global_syms_buckets - 1)];
+		global_syms[gs->hash & (global_syms_buckets - 1)] = gs;
+		global_syms_count++;
+	}
+}
+
+/* Drop the symbols of a module leaving the module list */
+void global_symbols_remove(struct elf_module *module)
+{
+	struct global_sym **gp, *gs;
+	unsigned int i;
+
+	for (i = 0; i < global_syms_buckets; i++) {
+		gp = &global_syms[i];
+		while ((gs = *gp)) {
+			if (gs->module == module) {
+				*gp = gs->next;
+				free(gs);
+				global_syms_count--;
+			} else {
+				gp = &gs->next;
+			}
+		}
+	}
+}
+
+static Elf_Sym *global_find_symbol_iterate(const char *name,
+					   struct elf_module *from,
+					   struct elf_module **module) {
 	struct elf_module *crt_module;
 	Elf_Sym *crt_sym = NULL;
 	Elf_Sym *result = NULL;
 
 	for_each_module(crt_module) {
+		// Skip the modules newer than "from"
+		if (from) {
+			if (crt_module != from)
+				continue;
+			from = NULL;
+		}
+
 		crt_sym = module_find_symbol(name, crt_module);
 
 		if (crt_sym != NULL && crt_sym->st_shndx != SHN_UNDEF) {
@@ -608,3 +945,45 @@ Elf_Sym *global_find_symbol(const char *name, struct elf_module **module) {
 
 	return result;
 }
+
+Elf_Sym *global_find_symbol(const char *name, struct elf_module **module) {
+	return global_find_symbol_from(name, NULL, module);
+}
+
+Elf_Sym *global_find_symbol_from(const char *name, struct elf_module *from,
+				 struct elf_module **module) {
+	struct global_sym *gs, *global = NULL, *weak = NULL;
+	uint32_t hash;
+
+	if (global_syms_broken)
+		return global_find_symbol_iterate(name, from, module);
+
+	if (!global_syms_buckets)
+		return NULL;
+
+	hash = elf_gnu_hash((const unsigned char *)name);
+
+	for (gs = global_syms[hash & (global_syms_buckets - 1)]; gs;
+	     gs = gs->next) {
+		if (gs->hash != hash || strcmp(gs->name, name))
+			continue;
+		if (from && gs->seq > from->symbol_seq)
+			continue;
+
+		if (ELF32_ST_BIND(gs->sym->st_info) == STB_GLOBAL) {
+			if (!global || gs->seq > global->seq)
+				global = gs;
+		} else {
+			if (!weak || gs->seq > weak->seq)
+				weak = gs;
+		}
+	}
+
+	gs = global ? global : weak;
+	if (!gs)
+		return NULL;
+
+	if (module != NULL)
+		*module = gs->module;
+	return gs->sym;
+}
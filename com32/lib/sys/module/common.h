@@ -68,5 +68,22 @@ extern int clear_dependency(struct elf_module *req, struct elf_module *dep);
 
 extern int check_symbols(struct elf_module *module);
 
+extern void module_free(struct elf_module *module);
+
+/*
+ * Resident module cache
+ */
+
+extern void module_cache_track(struct elf_module *module);
+extern bool module_cache_prepare(struct elf_module *module);
+extern void module_cache_add(struct elf_module *module);
+extern struct elf_module *module_cache_get(const char *name);
+
+/*
+ * Module bundles
+ */
+
+extern const void *module_bundle_find(const char *name, size_t *size);
+
 
 #endif /* COMMON_H_ */
@@ -16,6 +16,7 @@
 #include <linux/list.h>
 #include <sys/module.h>
 #include <sys/exec.h>
+#include <syslinux/trace.h>
 
 #include "elfutils.h"
 #include "common.h"
@@ -41,12 +42,6 @@ static int check_header(Elf_Ehdr *elf_hdr) {
 	return 0;
 }
 
-/*
- *
- * The implementation assumes that the loadable segments are present
- * in the PHT sorted by their offsets, so that only forward seeks would
- * be necessary.
- */
 extern int load_segments(struct elf_module *module, Elf_Ehdr *elf_hdr);
 
 static int prepare_dynlinking(struct elf_module *module) {
@@ -178,6 +173,23 @@ static int extract_operations(struct elf_module *module) {
 	return 0;
 }
 
+/*
+ * The name of a DT_NEEDED module, stripped of everything but the last
+ * component, or NULL if empty.
+ */
+static char *needed_name(struct elf_module *module, int i)
+{
+	char *dep = module->str_table + module->needed[i];
+
+	if (!strlen(dep))
+		return NULL;
+
+	if (strchr(dep, '/'))
+		return strrchr(dep, '/') + 1;
+
+	return dep;
+}
+
 // Loads the module into the system
 int module_load(struct elf_module *module) {
 	int res;
@@ -192,11 +204,14 @@ int module_load(struct elf_module *module) {
 		return EEXIST;
 	}
 
+	trace_str(TRACE_MODULE, "module_load", module->name, 0, 0);
+
 	// Get a mapping/copy of the ELF file in memory
 	res = image_load(module);
 
 	if (res < 0) {
 		dprintf("Image load failed for %s\n", module->name);
+		trace_str(TRACE_MODULE, "module_fail", module->name, -res, 0);
 		return res;
 	}
 
@@ -230,21 +245,13 @@ int module_load(struct elf_module *module) {
 		 * reverse order.
 		 */
 		for (i = module->nr_needed - 1; i >= 0; i--) {
-			char *dep, *p;
+			char *p;
 			char *argv[2] = { NULL, NULL };
 
-			dep = module->str_table + module->needed[i];
-
-			/* strip everything but the last component */
-			if (!strlen(dep))
+			p = needed_name(module, i);
+			if (!p)
 				continue;
 
-			if (strchr(dep, '/')) {
-				p = strrchr(dep, '/');
-				p++;
-			} else
-				p = dep;
-
 			argv[0] = p;
 			res = spawn_load(p, 1, argv);
 			if (res < 0) {
@@ -267,13 +274,34 @@ int module_load(struct elf_module *module) {
 
 	// Add the module at the beginning of the module list
 	list_add(&module->list, &modules_head);
+	global_symbols_add(module);
 
 	// Perform the relocations
 	resolve_symbols(module);
 
+	/*
+	 * Calls bound lazily may end up in any of the DT_NEEDED modules,
+	 * so those have to stay around as long as we do.
+	 */
+	if (module->str_table) {
+		struct elf_module *dep;
+		char *p;
+		int i;
+
+		for (i = 0; i < module->nr_needed; i++) {
+			p = needed_name(module, i);
+			dep = p ? module_find(p) : NULL;
+			if (dep && dep != module)
+				enforce_dependency(dep, module);
+		}
+	}
+
 	// Obtain constructors and destructors
 	CHECKED(res, extract_operations(module), error);
 
+	// Keep what's needed to reuse the image once it is unloaded
+	module_cache_track(module);
+
 	//dprintf("module->symtable_size = %d\n", module->symtable_size);
 
 	//print_elf_symbols(module);
@@ -289,6 +317,9 @@ int module_load(struct elf_module *module) {
 			(module->exit_func == NULL) ? NULL : *(module->exit_func));
 	*/
 
+	trace_str(TRACE_MODULE, "module_loaded", module->name,
+		  module->base_addr, module->module_size);
+
 	for (ctor = module->ctors; ctor && *ctor; ctor++)
 		(*ctor) ();
 
@@ -300,6 +331,7 @@ error:
 
 	// Remove the module from the module list (if applicable)
 	list_del_init(&module->list);
+	global_symbols_remove(module);
 
 	if (module->module_addr != NULL) {
 		elf_free(module->module_addr);
@@ -311,6 +343,7 @@ error:
 	// Clear the execution part of the module buffer
 	memset(&module->u, 0, sizeof module->u);
 
+	trace_str(TRACE_MODULE, "module_fail", module->name, -res, 0);
 	return res;
 }
 
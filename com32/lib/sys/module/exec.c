@@ -28,6 +28,8 @@ int get_module_type(struct elf_module *module)
 
 jmp_buf __process_exit_jmp;
 
+extern struct elf_module *module_cache_get(const char *name);
+
 #if 0
 int spawnv(const char *name, const char **argv)
 {
@@ -159,7 +161,7 @@ int spawn_load(const char *name, int argc, char **argv)
 	struct elf_module *previous;
 	//malloc_tag_t prev_mem_tag;
 	struct elf_module *module = module_alloc(name);
-	struct elf_module *cur_module;
+	struct elf_module *cur_module, *cached;
 	int type;
 
 	dprintf("enter: name = %s\n", name);
@@ -182,10 +184,17 @@ int spawn_load(const char *name, int argc, char **argv)
 		module_unload(cur_module);
 	}
 
-	res = module_load(module);
-	if (res != 0) {
-		dprintf("failed to load module %s\n", module->name);
-		goto out;
+	cached = module_cache_get(module->name);
+	if (cached) {
+		free(module);
+		module = cached;
+		res = 0;
+	} else {
+		res = module_load(module);
+		if (res != 0) {
+			dprintf("failed to load module %s\n", module->name);
+			goto out;
+		}
 	}
 
 	type = get_module_type(module);
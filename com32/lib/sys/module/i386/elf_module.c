@@ -21,10 +21,8 @@
 #include "../common.h"
 
 /*
- *
- * The implementation assumes that the loadable segments are present
- * in the PHT sorted by their offsets, so that only forward seeks would
- * be necessary.
+ * The whole file is in memory (see image_load()), so the segments can
+ * be copied in whatever order the PHT lists them.
  */
 int load_segments(struct elf_module *module, Elf_Ehdr *elf_hdr) {
 	int i;
@@ -40,6 +38,7 @@ int load_segments(struct elf_module *module, Elf_Ehdr *elf_hdr) {
 	Elf32_Addr min_alloc, max_alloc;   // Min. and max. aligned allocables
 
 	Elf32_Addr dyn_addr = 0x00000000;
+	Elf32_Addr data_start = 0, data_fileend = 0, data_memend = 0;
 
 	// Get to the PHT
 	image_seek(elf_hdr->e_phoff, module);
@@ -65,6 +64,16 @@ int load_segments(struct elf_module *module, Elf_Ehdr *elf_hdr) {
 
 			max_addr = MAX(max_addr, cr_pht->p_vaddr + cr_pht->p_memsz);
 			max_align = MAX(max_align, cr_pht->p_align);
+
+			// Note where the writable data is, for the module cache
+			if (cr_pht->p_flags & PF_W) {
+				if (data_memend == 0 || cr_pht->p_vaddr < data_start)
+					data_start = cr_pht->p_vaddr;
+				data_fileend = MAX(data_fileend,
+						   cr_pht->p_vaddr + cr_pht->p_filesz);
+				data_memend = MAX(data_memend,
+						  cr_pht->p_vaddr + cr_pht->p_memsz);
+			}
 			break;
 		case PT_DYNAMIC:
 			dyn_addr = cr_pht->p_vaddr;
@@ -97,9 +106,14 @@ int load_segments(struct elf_module *module, Elf_Ehdr *elf_hdr) {
 
 	if (elf_malloc(&module->module_addr,
 			max_align,
-			max_alloc-min_alloc) != 0) {
+			max_alloc-min_alloc) != 0 &&
+	    (!module_cache_flush() ||
+	     elf_malloc(&module->module_addr,
+			max_align,
+			max_alloc-min_alloc) != 0)) {
 
 		DBG_PRINT("Could not allocate segments\n");
+		res = -1;
 		goto out;
 	}
 
@@ -114,28 +128,15 @@ int load_segments(struct elf_module *module, Elf_Ehdr *elf_hdr) {
 
 		if (cr_pht->p_type == PT_LOAD) {
 			// Copy the segment at its destination
-			if (cr_pht->p_offset < module->u.l._cr_offset) {
-				// The segment contains data before the current offset
-				// It can be discarded without worry - it would contain only
-				// headers
-				Elf32_Off aux_off = module->u.l._cr_offset - cr_pht->p_offset;
-
-				if (image_read((char *)module_get_absolute(cr_pht->p_vaddr, module) + aux_off,
-					       cr_pht->p_filesz - aux_off, module) < 0) {
-					res = -1;
-					goto out;
-				}
-			} else {
-				if (image_seek(cr_pht->p_offset, module) < 0) {
-					res = -1;
-					goto out;
-				}
-
-				if (image_read(module_get_absolute(cr_pht->p_vaddr, module),
-						cr_pht->p_filesz, module) < 0) {
-					res = -1;
-					goto out;
-				}
+			if (image_seek(cr_pht->p_offset, module) < 0) {
+				res = -1;
+				goto out;
+			}
+
+			if (image_read(module_get_absolute(cr_pht->p_vaddr, module),
+					cr_pht->p_filesz, module) < 0) {
+				res = -1;
+				goto out;
 			}
 
 			/*
@@ -174,6 +175,12 @@ int load_segments(struct elf_module *module, Elf_Ehdr *elf_hdr) {
 	// Setup dynamic segment location
 	module->dyn_table = module_get_absolute(dyn_addr, module);
 
+	if (data_memend) {
+		module->data_addr = data_start;
+		module->data_filesz = MAX(data_fileend, data_start) - data_start;
+		module->data_memsz = data_memend - data_start;
+	}
+
 	/*
 	DBG_PRINT("Base address: 0x%08x, aligned at 0x%08x\n", module->base_addr,
 			max_align);
@@ -264,10 +271,83 @@ int perform_relocation(struct elf_module *module, Elf_Rel *rel) {
 	return 0;
 }
 
+/*
+ * Lazy binding of PLT slots.  A slot starts out pointing back into its
+ * PLT entry, which pushes the offset of its relocation and jumps to PLT0;
+ * PLT0 pushes GOT[1] and jumps to GOT[2].  So GOT[1] is the module and
+ * GOT[2] is module_lazy_bind(), which resolves the symbol, patches the
+ * slot and goes on to the function as if it had been called directly.
+ * %eax, %edx and %ecx may hold arguments (regparm), so they are kept.
+ */
+extern void module_lazy_bind(void);
+extern void undefined_symbol(void);
+
+__attribute__((used, visibility("hidden")))
+Elf32_Addr __cdecl module_lazy_resolve(struct elf_module *module,
+				       Elf32_Word offset);
+
+asm("	.pushsection .text\n"
+    "	.globl	module_lazy_bind\n"
+    "	.hidden	module_lazy_bind\n"
+    "	.type	module_lazy_bind, @function\n"
+    "module_lazy_bind:\n"
+    "	pushl	%eax\n"
+    "	pushl	%ecx\n"
+    "	pushl	%edx\n"
+    "	pushl	16(%esp)\n"	/* The relocation offset */
+    "	pushl	16(%esp)\n"	/* The module */
+    "	call	module_lazy_resolve\n"
+    "	addl	$8, %esp\n"
+    "	movl	%eax, 16(%esp)\n"	/* Return to the function instead */
+    "	popl	%edx\n"
+    "	popl	%ecx\n"
+    "	popl	%eax\n"
+    "	addl	$4, %esp\n"
+    "	ret\n"
+    "	.size	module_lazy_bind, . - module_lazy_bind\n"
+    "	.popsection");
+
+Elf32_Addr __cdecl module_lazy_resolve(struct elf_module *module,
+				       Elf32_Word offset)
+{
+	Elf32_Dyn *dyn_entry;
+	Elf32_Rel *rel = NULL;
+	Elf32_Sym *sym_ref, *sym_def;
+	struct elf_module *sym_module;
+	Elf32_Addr sym_addr;
+
+	for (dyn_entry = module->dyn_table; dyn_entry->d_tag != DT_NULL;
+	     dyn_entry++) {
+		if (dyn_entry->d_tag == DT_JMPREL)
+			rel = module_get_absolute(dyn_entry->d_un.d_ptr + offset,
+						  module);
+	}
+
+	sym_ref = symbol_get_entry(module, ELF32_R_SYM(rel->r_info));
+
+	// Bind as it would have been when the module was loaded
+	sym_def = global_find_symbol_from(module->str_table + sym_ref->st_name,
+					  module, &sym_module);
+	if (!sym_def) {
+		// A weak reference, see perform_relocation()
+		return (Elf32_Addr)undefined_symbol;
+	}
+
+	sym_addr = (Elf32_Addr)module_get_absolute(sym_def->st_value, sym_module);
+
+	if (sym_module != module)
+		enforce_dependency(sym_module, module);
+
+	*(Elf32_Word *)module_get_absolute(rel->r_offset, module) = sym_addr;
+
+	return sym_addr;
+}
+
 int resolve_symbols(struct elf_module *module) {
 	Elf32_Dyn  *dyn_entry = module->dyn_table;
 	unsigned int i;
 	int res;
+	bool lazy = true;
 
 	Elf32_Word plt_rel_size = 0;
 	char *plt_rel = NULL;
@@ -306,6 +386,19 @@ int resolve_symbols(struct elf_module *module) {
 			rel_entry = dyn_entry->d_un.d_val;
 			break;
 
+		// Binding all of the PLT up front
+		case DT_BIND_NOW:
+			lazy = false;
+			break;
+		case DT_FLAGS:
+			if (dyn_entry->d_un.d_val & DF_BIND_NOW)
+				lazy = false;
+			break;
+		case DT_FLAGS_1:
+			if (dyn_entry->d_un.d_val & DF_1_NOW)
+				lazy = false;
+			break;
+
 		// Module initialization and termination
 		case DT_INIT:
 			// TODO Implement initialization functions
@@ -332,16 +425,33 @@ int resolve_symbols(struct elf_module *module) {
 	}
 
 	if (plt_rel_size > 0) {
-		// TODO: Permit this lazily
+		Elf32_Word *got = module->got;
+
+		// Without a GOT to hook into, bind everything now
+		if (!got)
+			lazy = false;
+
 		// Process PLT relocations
 		for (i = 0; i < plt_rel_size/sizeof(Elf32_Rel); i++) {
 			crt_rel = (Elf32_Rel*)(plt_rel + i*sizeof(Elf32_Rel));
 
+			if (lazy && ELF32_R_TYPE(crt_rel->r_info) == R_386_JMP_SLOT) {
+				// Point the slot back into the PLT
+				*(Elf32_Word *)module_get_absolute(crt_rel->r_offset,
+								   module) += module->base_addr;
+				continue;
+			}
+
 			res = perform_relocation(module, crt_rel);
 
 			if (res < 0)
 				return res;
 		}
+
+		if (lazy) {
+			got[1] = (Elf32_Word)module;
+			got[2] = (Elf32_Word)module_lazy_bind;
+		}
 	}
 
 	return 0;
@@ -21,10 +21,8 @@
 #include "../common.h"
 
 /*
- *
- * The implementation assumes that the loadable segments are present
- * in the PHT sorted by their offsets, so that only forward seeks would
- * be necessary.
+ * The whole file is in memory (see image_load()), so the segments can
+ * be copied in whatever order the PHT lists them.
  */
 int load_segments(struct elf_module *module, Elf_Ehdr *elf_hdr) {
 	int i;
@@ -40,6 +38,7 @@ int load_segments(struct elf_module *module, Elf_Ehdr *elf_hdr) {
 	Elf64_Addr min_alloc, max_alloc;   // Min. and max. aligned allocables
 
 	Elf64_Addr dyn_addr = 0x0000000000000000;
+	Elf64_Addr data_start = 0, data_fileend = 0, data_memend = 0;
 
 	// Get to the PHT
 	image_seek(elf_hdr->e_phoff, module);
@@ -65,6 +64,16 @@ int load_segments(struct elf_module *module, Elf_Ehdr *elf_hdr) {
 
 			max_addr = MAX(max_addr, cr_pht->p_vaddr + cr_pht->p_memsz);
 			max_align = MAX(max_align, cr_pht->p_align);
+
+			// Note where the writable data is, for the module cache
+			if (cr_pht->p_flags & PF_W) {
+				if (data_memend == 0 || cr_pht->p_vaddr < data_start)
+					data_start = cr_pht->p_vaddr;
+				data_fileend = MAX(data_fileend,
+						   cr_pht->p_vaddr + cr_pht->p_filesz);
+				data_memend = MAX(data_memend,
+						  cr_pht->p_vaddr + cr_pht->p_memsz);
+			}
 			break;
 		case PT_DYNAMIC:
 			dyn_addr = cr_pht->p_vaddr;
@@ -97,9 +106,14 @@ int load_segments(struct elf_module *module, Elf_Ehdr *elf_hdr) {
 
 	if (elf_malloc(&module->module_addr,
 			max_align,
-			max_alloc-min_alloc) != 0) {
+			max_alloc-min_alloc) != 0 &&
+	    (!module_cache_flush() ||
+	     elf_malloc(&module->module_addr,
+			max_align,
+			max_alloc-min_alloc) != 0)) {
 
 		DBG_PRINT("Could not allocate segments\n");
+		res = -1;
 		goto out;
 	}
 
@@ -114,28 +128,15 @@ int load_segments(struct elf_module *module, Elf_Ehdr *elf_hdr) {
 
 		if (cr_pht->p_type == PT_LOAD) {
 			// Copy the segment at its destination
-			if (cr_pht->p_offset < module->u.l._cr_offset) {
-				// The segment contains data before the current offset
-				// It can be discarded without worry - it would contain only
-				// headers
-				Elf64_Off aux_off = module->u.l._cr_offset - cr_pht->p_offset;
-
-				if (image_read((char *)module_get_absolute(cr_pht->p_vaddr, module) + aux_off,
-					       cr_pht->p_filesz - aux_off, module) < 0) {
-					res = -1;
-					goto out;
-				}
-			} else {
-				if (image_seek(cr_pht->p_offset, module) < 0) {
-					res = -1;
-					goto out;
-				}
-
-				if (image_read(module_get_absolute(cr_pht->p_vaddr, module),
-						cr_pht->p_filesz, module) < 0) {
-					res = -1;
-					goto out;
-				}
+			if (image_seek(cr_pht->p_offset, module) < 0) {
+				res = -1;
+				goto out;
+			}
+
+			if (image_read(module_get_absolute(cr_pht->p_vaddr, module),
+					cr_pht->p_filesz, module) < 0) {
+				res = -1;
+				goto out;
 			}
 
 			/*
@@ -174,6 +175,12 @@ int load_segments(struct elf_module *module, Elf_Ehdr *elf_hdr) {
 	// Setup dynamic segment location
 	module->dyn_table = module_get_absolute(dyn_addr, module);
 
+	if (data_memend) {
+		module->data_addr = data_start;
+		module->data_filesz = MAX(data_fileend, data_start) - data_start;
+		module->data_memsz = data_memend - data_start;
+	}
+
 	/*
 	DBG_PRINT("Base address: 0x%08x, aligned at 0x%08x\n", module->base_addr,
 			max_align);
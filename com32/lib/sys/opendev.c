@@ -64,7 +64,6 @@ int opendev(const struct input_dev *idev,
     /* The file structure is already zeroed */
     fp->iop = &dev_error_r;
     fp->oop = &dev_error_w;
-    fp->i.datap = fp->i.buf;
 
     if (idev) {
 	if (idev->open && (e = idev->open(fp))) {
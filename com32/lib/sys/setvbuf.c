@@ -0,0 +1,53 @@
+/*
+ * sys/setvbuf.c
+ *
+ * Output is never buffered, so this only sizes the buffer a file is
+ * read through; it has to come before the first read.  Reads are in
+ * whole blocks of the file system, so that is the least a buffer can
+ * be, and what _IONBF gets.  Anything else is taken for a device that
+ * doesn't need it.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include "sys/file.h"
+
+int setvbuf(FILE *stream, char *buf, int mode, size_t size)
+{
+    int fd = fileno(stream);
+    struct file_info *fp = &__file_info[fd];
+    size_t blk;
+
+    if (fd < 0 || fd >= NFILES || !fp->iop) {
+	errno = EBADF;
+	return -1;
+    }
+
+    if (!(fp->iop->flags & __DEV_FILE))
+	return 0;
+
+    if (fp->i.buf || mode < _IOFBF || mode > _IONBF) {
+	errno = EINVAL;
+	return -1;
+    }
+
+    blk = (size_t)1 << fp->i.fd.blocklg2;
+    if (mode == _IONBF) {
+	buf = NULL;
+	size = blk;
+    } else if (buf) {
+	size &= ~(blk - 1);
+	if (!size) {
+	    errno = EINVAL;
+	    return -1;
+	}
+    } else {
+	size = (size + blk - 1) & ~(blk - 1);
+	if (!size)
+	    size = blk;
+    }
+
+    fp->i.buf = fp->i.datap = buf;
+    fp->i.bufsize = size;
+    return 0;
+}
@@ -55,7 +55,10 @@ static ssize_t __stdcon_read(struct file_info *fp, void *buf, size_t count)
 	    if (ch == '\n')
 		return n;
 	} else {
-	    fp->i.nbytes = __line_input(fp, fp->i.buf, MAXBLOCK, __rawcon_read);
+	    if (__file_buffer(fp, MAXBLOCK))
+		return n ? (ssize_t)n : -1;
+	    fp->i.nbytes = __line_input(fp, fp->i.buf, fp->i.bufsize,
+					__rawcon_read);
 	    fp->i.datap = fp->i.buf;
 
 	    if (fp->i.nbytes == 0)
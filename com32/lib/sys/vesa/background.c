@@ -26,6 +26,7 @@
  * ----------------------------------------------------------------------- */
 
 #include <stdio.h>
+#include <string.h>
 #include <png.h>
 #include <tinyjpeg.h>
 #include <com32.h>
@@ -41,15 +42,24 @@
 
 /*** FIX: This really should be alpha-blended with color index 0 ***/
 
+/*
+ * The decoders write 32-bit BGRA into __vesacon_background, which the
+ * text is blended against; __vesacon_fb_background holds the same
+ * pixels in the framebuffer format.  It is converted once whenever the
+ * background changes, so that the border, and whatever part of a text
+ * row is plain background, can go to the screen without a conversion.
+ */
+
 /* For best performance, "start" should be a multiple of 4, to assure
    aligned dwords. */
 static void draw_background_line(int line, int start, int npixels)
 {
-    uint32_t *bgptr = &__vesacon_background[line*__vesa_info.mi.h_res+start];
     unsigned int bytes_per_pixel = __vesacon_bytes_per_pixel;
+    size_t offset = line * __vesa_info.mi.h_res + start;
     size_t fbptr = line * __vesa_info.mi.logical_scan + start*bytes_per_pixel;
 
-    __vesacon_copy_to_screen(fbptr, bgptr, npixels);
+    __vesacon_copy_fb_to_screen(fbptr, (const char *)__vesacon_fb_background +
+				offset * bytes_per_pixel, npixels);
 }
 
 /* This draws the border, then redraws the text area */
@@ -60,6 +70,9 @@ static void draw_background(void)
 	(TEXT_PIXEL_ROWS % __vesacon_font_height);
     const int right_border = VIDEO_BORDER + (TEXT_PIXEL_COLS % FONT_WIDTH);
 
+    __vesacon_format_pixels(__vesacon_fb_background, __vesacon_background,
+			    __vesa_info.mi.h_res * __vesa_info.mi.v_res);
+
     for (i = 0; i < VIDEO_BORDER; i++)
 	draw_background_line(i, 0, __vesa_info.mi.h_res);
 
@@ -74,6 +87,7 @@ static void draw_background(void)
 	draw_background_line(i, 0, __vesa_info.mi.h_res);
 
     __vesacon_redraw_text();
+    __vesacon_flush_screen();
 }
 
 /*
@@ -411,10 +425,95 @@ do_run:
     return 0;
 }
 
+/*
+ * Decoded backgrounds, so that going back and forth between menus with
+ * different backgrounds doesn't decode the same images over and over.
+ * An entry is matched by file name and size, and is only good for the
+ * screen size it was decoded for.
+ */
+#define BG_CACHE_ENTRIES 4
+
+struct bg_cache {
+    char *filename;
+    off_t size;
+    int xsize, ysize;
+    uint32_t *pixels;
+    unsigned int used;		/* When last used, for LRU */
+};
+
+static struct bg_cache bg_cache[BG_CACHE_ENTRIES];
+static unsigned int bg_cache_clock;
+
+static struct bg_cache *bg_cache_find(const char *filename, off_t size)
+{
+    struct bg_cache *bc;
+
+    for (bc = bg_cache; bc < &bg_cache[BG_CACHE_ENTRIES]; bc++) {
+	if (bc->filename && bc->size == size &&
+	    bc->xsize == __vesa_info.mi.h_res &&
+	    bc->ysize == __vesa_info.mi.v_res &&
+	    !strcmp(bc->filename, filename)) {
+	    bc->used = ++bg_cache_clock;
+	    return bc;
+	}
+    }
+
+    return NULL;
+}
+
+static void bg_cache_drop(struct bg_cache *bc)
+{
+    free(bc->filename);
+    free(bc->pixels);
+    memset(bc, 0, sizeof *bc);
+}
+
+/* Remember the current background as the image in "filename" */
+static void bg_cache_add(const char *filename, off_t size)
+{
+    struct bg_cache *bc, *victim = bg_cache;
+    size_t bytes = __vesa_info.mi.h_res * __vesa_info.mi.v_res * 4;
+
+    for (bc = bg_cache; bc < &bg_cache[BG_CACHE_ENTRIES]; bc++) {
+	if (!bc->filename) {
+	    victim = bc;
+	    break;
+	}
+	if (bc->used < victim->used)
+	    victim = bc;
+    }
+
+    bg_cache_drop(victim);
+
+    victim->filename = strdup(filename);
+    victim->pixels = malloc(bytes);
+    if (!victim->filename || !victim->pixels) {
+	bg_cache_drop(victim);
+	return;
+    }
+
+    memcpy(victim->pixels, __vesacon_background, bytes);
+    victim->size = size;
+    victim->xsize = __vesa_info.mi.h_res;
+    victim->ysize = __vesa_info.mi.v_res;
+    victim->used = ++bg_cache_clock;
+}
+
+void __vesacon_flush_background_cache(void)
+{
+    struct bg_cache *bc;
+
+    for (bc = bg_cache; bc < &bg_cache[BG_CACHE_ENTRIES]; bc++)
+	bg_cache_drop(bc);
+}
+
 int vesacon_load_background(const char *filename)
 {
     FILE *fp = NULL;
     uint8_t header[8];
+    struct stat st;
+    struct bg_cache *bc;
+    off_t size = 0;
     int rv = 1;
 
     if (__vesacon_pixel_format == PXF_NONE)
@@ -425,6 +524,17 @@ int vesacon_load_background(const char *filename)
     if (!fp)
 	goto err;
 
+    /* Without a size we can't tell if the file has changed */
+    if (!fstat(fileno(fp), &st) && S_ISREG(st.st_mode))
+	size = st.st_size;
+
+    if (size > 0 && (bc = bg_cache_find(filename, size))) {
+	memcpy(__vesacon_background, bc->pixels,
+	       __vesa_info.mi.h_res * __vesa_info.mi.v_res * 4);
+	rv = 0;
+	goto draw;
+    }
+
     if (fread(header, 1, 8, fp) != 8)
 	goto err;
 
@@ -436,6 +546,10 @@ int vesacon_load_background(const char *filename)
 	rv = read_lss16_file(fp, header, 8);
     }
 
+    if (!rv && size > 0)
+	bg_cache_add(filename, size);
+
+draw:
     /* This actually displays the stuff */
     draw_background();
 
@@ -28,6 +28,7 @@
 #include <inttypes.h>
 #include <colortbl.h>
 #include <string.h>
+#include <stdlib.h>
 #include "vesa.h"
 #include "video.h"
 #include "fill.h"
@@ -45,38 +46,71 @@ static inline void *copy_dword(void *dst, void *src, size_t dword_count)
     return dst;			/* Updated destination pointer */
 }
 
+/*
+ * A color ready to be blended onto the background: its linear RGB
+ * components already multiplied by its alpha, so that only the
+ * background's share is left to work out for each pixel.  A cell's
+ * colors only change with its attribute, so they are prepared once per
+ * run of cells with the same attribute rather than per pixel.
+ */
+struct blend_color {
+    uint32_t argb;
+    unsigned int r, g, b;	/* Linear, times alpha */
+    uint8_t alpha;
+};
+
+static void blend_prepare(struct blend_color *bc, uint32_t argb)
+{
+    uint8_t alpha = argb >> 24;
+
+    bc->argb = argb;
+    bc->alpha = alpha;
+    bc->r = __vesacon_srgb_to_linear[(uint8_t)(argb >> 16)] * alpha;
+    bc->g = __vesacon_srgb_to_linear[(uint8_t)(argb >> 8)] * alpha;
+    bc->b = __vesacon_srgb_to_linear[(uint8_t)argb] * alpha;
+}
+
 static inline __attribute__ ((always_inline))
-uint8_t alpha_val(uint8_t fg, uint8_t bg, uint8_t alpha)
+uint8_t alpha_val(unsigned int fg, uint8_t bg, uint8_t alpha)
 {
     unsigned int tmp;
 
-    tmp = __vesacon_srgb_to_linear[fg] * alpha;
-    tmp += __vesacon_srgb_to_linear[bg] * (255 - alpha);
+    tmp = fg + __vesacon_srgb_to_linear[bg] * (255 - alpha);
 
     return __vesacon_linear_to_srgb[tmp >> 12];
 }
 
-static uint32_t alpha_pixel(uint32_t fg, uint32_t bg)
+static uint32_t alpha_pixel(const struct blend_color *fg, uint32_t bg)
 {
-    uint8_t alpha = fg >> 24;
-    uint8_t fg_r = fg >> 16;
-    uint8_t fg_g = fg >> 8;
-    uint8_t fg_b = fg;
+    uint8_t alpha = fg->alpha;
     uint8_t bg_r = bg >> 16;
     uint8_t bg_g = bg >> 8;
     uint8_t bg_b = bg;
 
+    /*
+     * Most pixels are fully one or the other, and the tables round trip
+     * exactly, so these give the same result as blending.
+     */
+    if (alpha == 0xff)
+	return fg->argb & 0xffffff;
+    else if (!alpha)
+	return bg & 0xffffff;
+
     return
-	(alpha_val(fg_r, bg_r, alpha) << 16) |
-	(alpha_val(fg_g, bg_g, alpha) << 8) | (alpha_val(fg_b, bg_b, alpha));
+	(alpha_val(fg->r, bg_r, alpha) << 16) |
+	(alpha_val(fg->g, bg_g, alpha) << 8) | (alpha_val(fg->b, bg_b, alpha));
 }
 
 static void vesacon_update_characters(int row, int col, int nrows, int ncols)
 {
     const int height = __vesacon_font_height;
     const int width = FONT_WIDTH;
-    uint32_t *bgrowptr, *bgptr, bgval, fgval;
-    uint32_t fgcolor = 0, bgcolor = 0, color;
+    uint32_t *bgrowptr, *bgptr, bgval;
+    const char *fbbgrowptr;
+    uint32_t color;
+    struct blend_color fgcolor, bgcolor;
+    const struct blend_color *fgval;
+    int attr;
     uint8_t chbits = 0, chxbits = 0, chsbits = 0;
     int i, j, jx, pixrow, pixsrow;
     struct vesa_char *rowptr, *rowsptr, *cptr, *csptr;
@@ -84,12 +118,16 @@ static void vesacon_update_characters(int row, int col, int nrows, int ncols)
     unsigned long pixel_offset;
     uint32_t row_buffer[__vesa_info.mi.h_res], *rowbufptr;
     size_t fbrowptr;
+    const int npixels = width * ncols + 2;
+    int x0, x1, x;
     uint8_t sha;
 
     pixel_offset = ((row * height + VIDEO_BORDER) * __vesa_info.mi.h_res) +
 	(col * width + VIDEO_BORDER);
 
     bgrowptr = &__vesacon_background[pixel_offset];
+    fbbgrowptr = (const char *)__vesacon_fb_background +
+	pixel_offset * bytes_per_pixel;
     fbrowptr = (row * height + VIDEO_BORDER) * __vesa_info.mi.logical_scan +
 	(col * width + VIDEO_BORDER) * bytes_per_pixel;
 
@@ -98,10 +136,13 @@ static void vesacon_update_characters(int row, int col, int nrows, int ncols)
     rowsptr = rowptr - ((__vesacon_text_cols+2)+1);
     pixrow = 0;
     pixsrow = height - 1;
+    attr = -1;
 
     for (i = height * nrows; i >= 0; i--) {
 	bgptr = bgrowptr;
 	rowbufptr = row_buffer;
+	x0 = npixels;
+	x1 = 0;
 
 	cptr = rowptr;
 	csptr = rowsptr;
@@ -134,8 +175,11 @@ static void vesacon_update_characters(int row, int col, int nrows, int ncols)
 		chxbits = chbits;
 		chxbits &= (sha & 0x02) ? 0xff : 0x00;
 		chxbits ^= (sha & 0x01) ? 0xff : 0x00;
-		fgcolor = console_color_table[cptr->attr].argb_fg;
-		bgcolor = console_color_table[cptr->attr].argb_bg;
+		if (cptr->attr != attr) {
+		    attr = cptr->attr;
+		    blend_prepare(&fgcolor, console_color_table[attr].argb_fg);
+		    blend_prepare(&bgcolor, console_color_table[attr].argb_bg);
+		}
 		cptr++;
 		jx--;
 		break;
@@ -160,7 +204,7 @@ static void vesacon_update_characters(int row, int col, int nrows, int ncols)
 	    bgptr++;
 
 	    /* If this pixel is set, use the fg color, else the bg color */
-	    fgval = (chbits & 0x80) ? fgcolor : bgcolor;
+	    fgval = (chbits & 0x80) ? &fgcolor : &bgcolor;
 
 	    /* Produce the combined color pixel value */
 	    color = alpha_pixel(fgval, bgval);
@@ -171,13 +215,36 @@ static void vesacon_update_characters(int row, int col, int nrows, int ncols)
 		color &= 0x3f3f3f;
 	    }
 
+	    /* Keep track of where the row differs from the background */
+	    if (color != (bgptr[-1] & 0xffffff)) {
+		x = rowbufptr - row_buffer;
+		if (!x1)
+		    x0 = x;
+		x1 = x + 1;
+	    }
+
 	    *rowbufptr++ = color;
 	}
 
-	/* Copy to frame buffer */
-	__vesacon_copy_to_screen(fbrowptr, row_buffer, rowbufptr - row_buffer);
+	/*
+	 * Copy to frame buffer.  Only the pixels from x0 to x1 need to be
+	 * converted; on either side of them the row is just background,
+	 * which we already have in the frame buffer format.
+	 */
+	if (x1 < x0)
+	    x1 = x0;
+	if (x0)
+	    __vesacon_copy_fb_to_screen(fbrowptr, fbbgrowptr, x0);
+	if (x1 > x0)
+	    __vesacon_copy_to_screen(fbrowptr + x0 * bytes_per_pixel,
+				     row_buffer + x0, x1 - x0);
+	if (x1 < npixels)
+	    __vesacon_copy_fb_to_screen(fbrowptr + x1 * bytes_per_pixel,
+					fbbgrowptr + x1 * bytes_per_pixel,
+					npixels - x1);
 
 	bgrowptr += __vesa_info.mi.h_res;
+	fbbgrowptr += __vesa_info.mi.h_res * bytes_per_pixel;
 	fbrowptr += __vesa_info.mi.logical_scan;
 
 	if (++pixrow == height) {
@@ -191,18 +258,68 @@ static void vesacon_update_characters(int row, int col, int nrows, int ncols)
     }
 }
 
-/* Bounding box for changed text.  The (x1, y1) coordinates are +1! */
-static unsigned int upd_x0 = -1U, upd_x1, upd_y0 = -1U, upd_y1;
+/*
+ * Changed text, as a span of columns for each row, so that changes in
+ * different parts of the screen don't add up to a redraw of everything
+ * in between.  upd_y0..upd_y1 bounds the rows with a span.  The x1 and
+ * y1 coordinates are +1!  Without a span array (out of memory) whole
+ * rows are redrawn.
+ */
+struct upd_span {
+    uint16_t x0, x1;		/* Nothing to do if x1 <= x0 */
+};
 
-/* Update the range already touched by various variables */
+static struct upd_span *upd_span;
+static unsigned int upd_rows;
+static unsigned int upd_y0 = -1U, upd_y1;
+
+void __vesacon_init_update(int rows)
+{
+    free(upd_span);
+    upd_span = calloc(rows, sizeof *upd_span);
+    upd_rows = upd_span ? rows : 0;
+    upd_y0 = -1U;
+    upd_y1 = 0;
+}
+
+/* Update the ranges already touched by various variables */
 void __vesacon_doit(void)
 {
-    if (upd_x1 > upd_x0 && upd_y1 > upd_y0) {
-	vesacon_update_characters(upd_y0, upd_x0, upd_y1 - upd_y0,
-				  upd_x1 - upd_x0);
-	upd_x0 = upd_y0 = -1U;
-	upd_x1 = upd_y1 = 0;
+    unsigned int y, y0;
+    struct upd_span *sp;
+
+    if (upd_y1 <= upd_y0)
+	return;
+
+    if (!upd_span) {
+	vesacon_update_characters(upd_y0, 0, upd_y1 - upd_y0,
+				  __vesacon_text_cols);
+	goto done;
+    }
+
+    /* One rectangle for each run of rows with the same span */
+    y = upd_y0;
+    while (y < upd_y1) {
+	sp = &upd_span[y];
+	if (sp->x1 <= sp->x0) {
+	    y++;
+	    continue;
+	}
+
+	y0 = y;
+	while (++y < upd_y1 &&
+	       upd_span[y].x0 == sp->x0 && upd_span[y].x1 == sp->x1)
+	    ;
+
+	vesacon_update_characters(y0, sp->x0, y - y0, sp->x1 - sp->x0);
     }
+
+    memset(&upd_span[upd_y0], 0, (upd_y1 - upd_y0) * sizeof *upd_span);
+
+done:
+    upd_y0 = -1U;
+    upd_y1 = 0;
+    __vesacon_flush_screen();
 }
 
 /* Mark a range for update; note argument sequence is the same as
@@ -213,15 +330,34 @@ static inline void vesacon_touch(int row, int col, int rows, int cols)
     unsigned int x0 = col;
     unsigned int y1 = y0 + rows;
     unsigned int x1 = x0 + cols;
+    unsigned int y;
+    struct upd_span *sp;
+
+    if (y1 > upd_rows && upd_span)
+	y1 = upd_rows;
+    if (y0 >= y1)
+	return;
 
     if (y0 < upd_y0)
 	upd_y0 = y0;
     if (y1 > upd_y1)
 	upd_y1 = y1;
-    if (x0 < upd_x0)
-	upd_x0 = x0;
-    if (x1 > upd_x1)
-	upd_x1 = x1;
+
+    if (!upd_span)
+	return;
+
+    for (y = y0; y < y1; y++) {
+	sp = &upd_span[y];
+	if (sp->x1 <= sp->x0) {
+	    sp->x0 = x0;
+	    sp->x1 = x1;
+	} else {
+	    if (x0 < sp->x0)
+		sp->x0 = x0;
+	    if (x1 > sp->x1)
+		sp->x1 = x1;
+	}
+    }
 }
 
 /* Erase a region of the screen */
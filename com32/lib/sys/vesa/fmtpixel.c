@@ -32,6 +32,10 @@
  */
 
 #include <inttypes.h>
+#include <com32.h>
+#include <cpufeature.h>
+#include <sys/cpu.h>
+#include <sys/fpu.h>
 #include "video.h"
 
 /*
@@ -91,6 +95,258 @@ static const void *format_pxf_le_rgb15_555(void *ptr, const uint32_t * p,
     return ptr;
 }
 
+/*
+ * MMX and SSE2 versions of the above, producing the same bits; they
+ * convert as many pixels as fit their registers and leave the rest of
+ * the line to the plain version.  The register clobbers can only be
+ * named when the compiler itself knows about the registers, but then
+ * again it only uses them if it does.  The SSE2 loops switch SSE on
+ * only while they run; see <sys/fpu.h>.
+ */
+#ifdef __SSE2__
+# define XMM_CLOBBERS , "xmm0", "xmm1", "xmm2", "xmm3", \
+			"xmm4", "xmm5", "xmm6", "xmm7"
+#else
+# define XMM_CLOBBERS
+#endif
+#ifdef __MMX__
+# define MM_CLOBBERS , "mm0", "mm1", "mm2", "mm3", \
+		       "mm4", "mm5", "mm6", "mm7"
+#else
+# define MM_CLOBBERS
+#endif
+
+/* Each mask four times over, so the MMX code can use the first half */
+static const uint32_t bgr24_masks[16] = {
+    0x00ffffff, 0, 0x00ffffff, 0,		/* Pixel in a qword */
+    0xff000000, 0x0000ffff, 0xff000000, 0x0000ffff, /* Next pixel */
+    0xffffffff, 0x0000ffff, 0, 0,		/* First 6 bytes */
+    0, 0xffff0000, 0xffffffff, 0,		/* Next 6 bytes */
+};
+
+static const uint32_t rgb16_565_masks[12] = {
+    0x001f, 0x001f, 0x001f, 0x001f,
+    0x07e0, 0x07e0, 0x07e0, 0x07e0,
+    0xf800, 0xf800, 0xf800, 0xf800,
+};
+
+static const uint32_t rgb15_555_masks[12] = {
+    0x001f, 0x001f, 0x001f, 0x001f,
+    0x03e0, 0x03e0, 0x03e0, 0x03e0,
+    0x7c00, 0x7c00, 0x7c00, 0x7c00,
+};
+
+/*
+ * Four pixels per loop: squeeze each pair of pixels into 6 bytes of
+ * its qword, then the two halves together.  The 16-byte store runs 4
+ * bytes past the 12 we produce, which the next loop (or the plain
+ * code) overwrites.
+ */
+static const void *format_pxf_bgr24_sse2(void *ptr, const uint32_t * p,
+					 size_t n)
+{
+    char *q = ptr;
+    size_t loops = n >> 2;
+    struct x86_sse_state sse;
+
+    if (loops) {
+	x86_sse_begin(&sse);
+	asm volatile ("movdqu   (%[m]), %%xmm4\n\t"
+		      "movdqu 16(%[m]), %%xmm5\n\t"
+		      "movdqu 32(%[m]), %%xmm6\n\t"
+		      "movdqu 48(%[m]), %%xmm7\n"
+		      "1:\n\t"
+		      "movdqu (%[p]), %%xmm0\n\t"
+		      "movdqa %%xmm0, %%xmm1\n\t"
+		      "psrlq $8, %%xmm1\n\t"
+		      "pand %%xmm4, %%xmm0\n\t"
+		      "pand %%xmm5, %%xmm1\n\t"
+		      "por %%xmm1, %%xmm0\n\t"
+		      "movdqa %%xmm0, %%xmm1\n\t"
+		      "psrldq $2, %%xmm1\n\t"
+		      "pand %%xmm6, %%xmm0\n\t"
+		      "pand %%xmm7, %%xmm1\n\t"
+		      "por %%xmm1, %%xmm0\n\t"
+		      "movdqu %%xmm0, (%[q])\n\t"
+		      "add $16, %[p]\n\t"
+		      "add $12, %[q]\n\t"
+		      "dec %[n]\n\t"
+		      "jnz 1b"
+		      : [p] "+r" (p), [q] "+r" (q), [n] "+r" (loops)
+		      : [m] "r" (bgr24_masks)
+		      : "memory" XMM_CLOBBERS);
+	x86_sse_end(&sse);
+    }
+
+    format_pxf_bgr24(q, p, n & 3);
+    return ptr;
+}
+
+/* Two pixels per loop, stored with 2 bytes to spare */
+static const void *format_pxf_bgr24_mmx(void *ptr, const uint32_t * p,
+					size_t n)
+{
+    char *q = ptr;
+    size_t loops = n >> 1;
+
+    if (loops) {
+	asm volatile ("movq   (%[m]), %%mm4\n\t"
+		      "movq 16(%[m]), %%mm5\n"
+		      "1:\n\t"
+		      "movq (%[p]), %%mm0\n\t"
+		      "movq %%mm0, %%mm1\n\t"
+		      "psrlq $8, %%mm1\n\t"
+		      "pand %%mm4, %%mm0\n\t"
+		      "pand %%mm5, %%mm1\n\t"
+		      "por %%mm1, %%mm0\n\t"
+		      "movq %%mm0, (%[q])\n\t"
+		      "add $8, %[p]\n\t"
+		      "add $6, %[q]\n\t"
+		      "dec %[n]\n\t"
+		      "jnz 1b\n\t"
+		      "emms"
+		      : [p] "+r" (p), [q] "+r" (q), [n] "+r" (loops)
+		      : [m] "r" (bgr24_masks)
+		      : "memory" MM_CLOBBERS);
+    }
+
+    format_pxf_bgr24(q, p, n & 1);
+    return ptr;
+}
+
+/*
+ * 16-bit formats, eight pixels per loop: shift and mask each field into
+ * place in the dwords, then sign extend the low word so the saturating
+ * pack leaves it alone.
+ */
+#define RGB16_SSE2_FIELDS(x)				\
+		      "movdqa %%" x ", %%xmm1\n\t"	\
+		      "movdqa %%" x ", %%xmm2\n\t"	\
+		      "psrld $3, %%" x "\n\t"		\
+		      "psrld $5, %%xmm1\n\t"		\
+		      "psrld %[rs], %%xmm2\n\t"	\
+		      "pand %%xmm5, %%" x "\n\t"	\
+		      "pand %%xmm6, %%xmm1\n\t"	\
+		      "pand %%xmm7, %%xmm2\n\t"	\
+		      "por %%xmm1, %%" x "\n\t"	\
+		      "por %%xmm2, %%" x "\n\t"	\
+		      "pslld $16, %%" x "\n\t"	\
+		      "psrad $16, %%" x "\n\t"
+
+#define RGB16_SSE2(q, p, loops, masks, rshift)		\
+	asm volatile ("movdqu   (%[m]), %%xmm5\n\t"	\
+		      "movdqu 16(%[m]), %%xmm6\n\t"	\
+		      "movdqu 32(%[m]), %%xmm7\n"	\
+		      "1:\n\t"				\
+		      "movdqu   (%[p]), %%xmm0\n\t"	\
+		      "movdqu 16(%[p]), %%xmm3\n\t"	\
+		      RGB16_SSE2_FIELDS("xmm0")		\
+		      RGB16_SSE2_FIELDS("xmm3")		\
+		      "packssdw %%xmm3, %%xmm0\n\t"	\
+		      "movdqu %%xmm0, (%[q])\n\t"	\
+		      "add $32, %[p]\n\t"		\
+		      "add $16, %[q]\n\t"		\
+		      "dec %[n]\n\t"			\
+		      "jnz 1b"				\
+		      : [p] "+r" (p), [q] "+r" (q), [n] "+r" (loops) \
+		      : [m] "r" (masks), [rs] "i" (rshift)	\
+		      : "memory" XMM_CLOBBERS)
+
+/* The same with MMX, four pixels per loop */
+#define RGB16_MMX_FIELDS(x)				\
+		      "movq %%" x ", %%mm1\n\t"		\
+		      "movq %%" x ", %%mm2\n\t"		\
+		      "psrld $3, %%" x "\n\t"		\
+		      "psrld $5, %%mm1\n\t"		\
+		      "psrld %[rs], %%mm2\n\t"		\
+		      "pand %%mm5, %%" x "\n\t"		\
+		      "pand %%mm6, %%mm1\n\t"		\
+		      "pand %%mm7, %%mm2\n\t"		\
+		      "por %%mm1, %%" x "\n\t"		\
+		      "por %%mm2, %%" x "\n\t"		\
+		      "pslld $16, %%" x "\n\t"		\
+		      "psrad $16, %%" x "\n\t"
+
+#define RGB16_MMX(q, p, loops, masks, rshift)		\
+	asm volatile ("movq   (%[m]), %%mm5\n\t"	\
+		      "movq 16(%[m]), %%mm6\n\t"	\
+		      "movq 32(%[m]), %%mm7\n"		\
+		      "1:\n\t"				\
+		      "movq  (%[p]), %%mm0\n\t"		\
+		      "movq 8(%[p]), %%mm3\n\t"		\
+		      RGB16_MMX_FIELDS("mm0")		\
+		      RGB16_MMX_FIELDS("mm3")		\
+		      "packssdw %%mm3, %%mm0\n\t"	\
+		      "movq %%mm0, (%[q])\n\t"		\
+		      "add $16, %[p]\n\t"		\
+		      "add $8, %[q]\n\t"		\
+		      "dec %[n]\n\t"			\
+		      "jnz 1b\n\t"			\
+		      "emms"				\
+		      : [p] "+r" (p), [q] "+r" (q), [n] "+r" (loops) \
+		      : [m] "r" (masks), [rs] "i" (rshift)	\
+		      : "memory" MM_CLOBBERS)
+
+static const void *format_pxf_le_rgb16_565_sse2(void *ptr,
+						const uint32_t * p, size_t n)
+{
+    uint16_t *q = ptr;
+    size_t loops = n >> 3;
+    struct x86_sse_state sse;
+
+    if (loops) {
+	x86_sse_begin(&sse);
+	RGB16_SSE2(q, p, loops, rgb16_565_masks, 3 + 16 - 11);
+	x86_sse_end(&sse);
+    }
+
+    format_pxf_le_rgb16_565(q, p, n & 7);
+    return ptr;
+}
+
+static const void *format_pxf_le_rgb16_565_mmx(void *ptr,
+					       const uint32_t * p, size_t n)
+{
+    uint16_t *q = ptr;
+    size_t loops = n >> 2;
+
+    if (loops)
+	RGB16_MMX(q, p, loops, rgb16_565_masks, 3 + 16 - 11);
+
+    format_pxf_le_rgb16_565(q, p, n & 3);
+    return ptr;
+}
+
+static const void *format_pxf_le_rgb15_555_sse2(void *ptr,
+						const uint32_t * p, size_t n)
+{
+    uint16_t *q = ptr;
+    size_t loops = n >> 3;
+    struct x86_sse_state sse;
+
+    if (loops) {
+	x86_sse_begin(&sse);
+	RGB16_SSE2(q, p, loops, rgb15_555_masks, 3 + 16 - 10);
+	x86_sse_end(&sse);
+    }
+
+    format_pxf_le_rgb15_555(q, p, n & 7);
+    return ptr;
+}
+
+static const void *format_pxf_le_rgb15_555_mmx(void *ptr,
+					       const uint32_t * p, size_t n)
+{
+    uint16_t *q = ptr;
+    size_t loops = n >> 2;
+
+    if (loops)
+	RGB16_MMX(q, p, loops, rgb15_555_masks, 3 + 16 - 10);
+
+    format_pxf_le_rgb15_555(q, p, n & 3);
+    return ptr;
+}
+
 __vesacon_format_pixels_t __vesacon_format_pixels;
 
 const __vesacon_format_pixels_t __vesacon_format_pixels_list[PXF_NONE] = {
@@ -99,3 +355,36 @@ const __vesacon_format_pixels_t __vesacon_format_pixels_list[PXF_NONE] = {
     [PXF_LE_RGB16_565] = format_pxf_le_rgb16_565,
     [PXF_LE_RGB15_555] = format_pxf_le_rgb15_555,
 };
+
+static const __vesacon_format_pixels_t format_pixels_sse2[PXF_NONE] = {
+    [PXF_BGRA32] = format_pxf_bgra32,
+    [PXF_BGR24] = format_pxf_bgr24_sse2,
+    [PXF_LE_RGB16_565] = format_pxf_le_rgb16_565_sse2,
+    [PXF_LE_RGB15_555] = format_pxf_le_rgb15_555_sse2,
+};
+
+static const __vesacon_format_pixels_t format_pixels_mmx[PXF_NONE] = {
+    [PXF_BGRA32] = format_pxf_bgra32,
+    [PXF_BGR24] = format_pxf_bgr24_mmx,
+    [PXF_LE_RGB16_565] = format_pxf_le_rgb16_565_mmx,
+    [PXF_LE_RGB15_555] = format_pxf_le_rgb15_555_mmx,
+};
+
+/*
+ * Pick the pixel formatter for a mode, preferring the SIMD versions if
+ * the CPU can run them.
+ */
+void __vesacon_init_format_pixels(enum vesa_pixel_format pxf)
+{
+    uint32_t features = 0;
+
+    if (cpu_has_eflag(EFLAGS_ID) && cpuid_eax(0) >= 1)
+	features = cpuid_edx(1);
+
+    if ((features & (1 << X86_FEATURE_XMM2)) && x86_has_sse())
+	__vesacon_format_pixels = format_pixels_sse2[pxf];
+    else if (features & (1 << X86_FEATURE_MMX))
+	__vesacon_format_pixels = format_pixels_mmx[pxf];
+    else
+	__vesacon_format_pixels = __vesacon_format_pixels_list[pxf];
+}
@@ -54,7 +54,8 @@ enum vesa_pixel_format __vesacon_pixel_format = PXF_NONE;
 unsigned int __vesacon_bytes_per_pixel;
 uint8_t __vesacon_graphics_font[FONT_MAX_CHARS][FONT_MAX_HEIGHT];
 
-uint32_t *__vesacon_background, *__vesacon_shadowfb;
+uint32_t *__vesacon_background;
+void *__vesacon_fb_background;
 
 static void unpack_font(uint8_t * dst, uint8_t * src, int height)
 {
@@ -79,14 +80,14 @@ static int vesacon_set_mode(int *x, int *y)
     debug("Hello, World!\r\n");
 
     /* Free any existing data structures */
+    if (__vesacon_fb_background != __vesacon_background)
+	free(__vesacon_fb_background);
+    __vesacon_fb_background = NULL;
     if (__vesacon_background) {
 	free(__vesacon_background);
 	__vesacon_background = NULL;
     }
-    if (__vesacon_shadowfb) {
-	free(__vesacon_shadowfb);
-	__vesacon_shadowfb = NULL;
-    }
+    __vesacon_flush_background_cache();
 
     rv = firmware->vesa->set_mode(&__vesa_info, x, y, &bestpxf);
     if (rv)
@@ -94,7 +95,7 @@ static int vesacon_set_mode(int *x, int *y)
 
     mi = &__vesa_info.mi;
     __vesacon_bytes_per_pixel = (mi->bpp + 7) >> 3;
-    __vesacon_format_pixels = __vesacon_format_pixels_list[bestpxf];
+    __vesacon_init_format_pixels(bestpxf);
 
     /* Download the SYSLINUX- or firmware-provided font */
     __vesacon_font_height = syslinux_font_query(&rom_font);
@@ -105,7 +106,13 @@ static int vesacon_set_mode(int *x, int *y)
 		__vesacon_font_height);
 
     __vesacon_background = calloc(mi->h_res*mi->v_res, 4);
-    __vesacon_shadowfb = calloc(mi->h_res*mi->v_res, 4);
+
+    /* The same, converted; formatting may write 4 bytes past the end */
+    if (bestpxf == PXF_BGRA32)
+	__vesacon_fb_background = __vesacon_background;
+    else
+	__vesacon_fb_background =
+	    calloc(mi->h_res*mi->v_res*__vesacon_bytes_per_pixel + 4, 1);
 
     __vesacon_init_copy_to_screen();
 
@@ -154,6 +161,7 @@ static int init_text_display(void)
 
     vesacon_fill(ptr, def_char, nchars);
     __vesacon_init_cursor(__vesacon_font_height);
+    __vesacon_init_update(__vesacon_text_rows);
 
     return 0;
 }
@@ -75,3 +75,17 @@ void __vesacon_copy_to_screen(size_t dst, const uint32_t * src, size_t npixels)
     s = (const uint32_t *)__vesacon_format_pixels(rowbuf, src, npixels);
     firmware->vesa->screencpy(dst, s, bytes, &wi);
 }
+
+/* Copy pixels that are already in the framebuffer format */
+void __vesacon_copy_fb_to_screen(size_t dst, const void *src, size_t npixels)
+{
+    firmware->vesa->screencpy(dst, src, npixels * __vesacon_bytes_per_pixel,
+			      &wi);
+}
+
+/* Called when a redraw is complete */
+void __vesacon_flush_screen(void)
+{
+    if (firmware->vesa->flush)
+	firmware->vesa->flush();
+}
@@ -74,6 +74,7 @@ typedef const void *(*__vesacon_format_pixels_t)
     (void *, const uint32_t *, size_t);
 extern __vesacon_format_pixels_t __vesacon_format_pixels;
 extern const __vesacon_format_pixels_t __vesacon_format_pixels_list[PXF_NONE];
+void __vesacon_init_format_pixels(enum vesa_pixel_format);
 
 extern struct vesa_char *__vesacon_text_display;
 
@@ -82,15 +83,17 @@ extern int __vesacon_text_rows;
 extern int __vesacon_text_cols;
 extern uint8_t __vesacon_graphics_font[FONT_MAX_CHARS][FONT_MAX_HEIGHT];
 extern uint32_t *__vesacon_background;
-extern uint32_t *__vesacon_shadowfb;
+extern void *__vesacon_fb_background;
 
 extern const uint16_t __vesacon_srgb_to_linear[256];
 extern const uint8_t __vesacon_linear_to_srgb[4080];
 
 int __vesacon_init_background(void);
 int vesacon_load_background(const char *);
+void __vesacon_flush_background_cache(void);
 int __vesacon_init(int *, int *);
 void __vesacon_init_cursor(int);
+void __vesacon_init_update(int);
 void __vesacon_erase(int, int, int, int, attr_t);
 void __vesacon_scroll_up(int, attr_t);
 void __vesacon_write_char(int, int, uint8_t, attr_t);
@@ -98,7 +101,9 @@ void __vesacon_redraw_text(void);
 void __vesacon_doit(void);
 void __vesacon_set_cursor(int, int, bool);
 void __vesacon_copy_to_screen(size_t, const uint32_t *, size_t);
+void __vesacon_copy_fb_to_screen(size_t, const void *, size_t);
 void __vesacon_init_copy_to_screen(void);
+void __vesacon_flush_screen(void);
 
 int __vesacon_i915resolution(int x, int y);
 
@@ -0,0 +1,75 @@
+/*
+ * x86_init_mem.c
+ *
+ * Choose how memcpy(), memmove() and memset() handle large transfers
+ * on this CPU; see <sys/memops.h>.  Until this has run they always
+ * take the generic path, which works on anything.
+ *
+ * Only REP MOVSB/STOSB and MOVNTI are used.  Neither touches the
+ * SSE registers, which nobody saves across a thread switch or an
+ * interrupt, and MOVNTI and SFENCE work even if the OS-level SSE
+ * support bits in CR4 were never set.
+ */
+
+#include <stdint.h>
+#include <com32.h>
+#include <cpufeature.h>
+#include <sys/cpu.h>
+#include <sys/memops.h>
+
+#define CPUID7_EBX_ERMS		(1 << 9)	/* Enhanced REP MOVSB/STOSB */
+#define CPUID7_EDX_FSRM		(1 << 4)	/* Fast short REP MOVSB */
+
+/* REP MOVSB beats dword moves from about here on with ERMSB alone */
+#define MEM_ERMS_MIN		256
+
+struct mem_tune __mem_tune = { SIZE_MAX, SIZE_MAX };
+
+/*
+ * The size of the outermost cache we can find, in bytes.  A copy
+ * larger than this can't leave anything useful behind in the cache,
+ * so it may as well not evict what is there.  Intel doesn't report
+ * the L3 in leaf 0x80000006, so guess at four times the L2 there.
+ */
+static size_t mem_cache_size(void)
+{
+    uint32_t eax, ebx, ecx, edx;
+    size_t l2, l3;
+
+    if (cpuid_eax(0x80000000) < 0x80000006)
+	return 0;
+
+    cpuid(0x80000006, &eax, &ebx, &ecx, &edx);
+    l2 = (size_t)(ecx >> 16) << 10;
+    l3 = (size_t)(edx >> 18) << 19;
+
+    return l3 ? l3 : l2 * 4;
+}
+
+void x86_init_mem(void)
+{
+    uint32_t eax, ebx, ecx, edx, max;
+    size_t cache;
+
+#if __SIZEOF_POINTER__ == 4
+    if (!cpu_has_eflag(EFLAGS_ID))
+	return;
+#endif
+
+    max = cpuid_eax(0);
+    if (max < 1)
+	return;
+
+    if (max >= 7) {
+	cpuid_count(7, 0, &eax, &ebx, &ecx, &edx);
+	if (edx & CPUID7_EDX_FSRM)
+	    __mem_tune.rep = MEM_DISPATCH_MIN;
+	else if (ebx & CPUID7_EBX_ERMS)
+	    __mem_tune.rep = MEM_ERMS_MIN;
+    }
+
+    if (cpuid_edx(1) & (1 << X86_FEATURE_XMM2)) {
+	cache = mem_cache_size();
+	__mem_tune.nt = cache >= (1 << 20) ? cache : (1 << 20);
+    }
+}
@@ -30,9 +30,19 @@
  *
  * Raw writing to the serial port; \n -> \r\n translation, and
  * convert \1# sequences.
+ *
+ * Once the application clears the screen, it is evidently driving a
+ * full-screen display, and until it scrolls we keep a shadow of what
+ * the terminal should show and what we have actually sent it.  At the end
+ * of each write only the cells that changed are sent, with the cursor
+ * motion and SGR sequences needed to get there.  Menus that redraw the
+ * screen or a whole row to move a highlight then cost a fraction of
+ * the bytes, which matters a lot at 9600 baud.
  */
 
 #include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <com32.h>
 #include <core.h>
@@ -40,75 +50,398 @@
 #include <colortbl.h>
 #include <syslinux/config.h>
 #include "file.h"
+#include "ansi.h"
+
+/* Send a real clear rather than this many blanks */
+#define SHADOW_CLEAR_MIN	64
+
+/* A cell is ch | attr << 8; 0 means we don't know */
+#define CELL_VT		(1 << 19)	/* ch is in the DEC VT graphics set */
+#define CELL_ATTR(c)	(((c) >> 8) & 0x7ff)
 
 static void emit(char ch)
 {
     write_serial(ch);
 }
 
-ssize_t __xserial_write(struct file_info *fp, const void *buf, size_t count)
+static void emit_str(const char *p)
+{
+    while (*p)
+	emit(*p++);
+}
+
+static void sh_erase(const struct term_state *, int, int, int, int);
+static void sh_write_char(int, int, uint8_t, const struct term_state *);
+static void sh_showcursor(const struct term_state *);
+static void sh_scroll_up(const struct term_state *);
+static void sh_set_cursor(int, int, bool);
+static void sh_beep(void);
+
+static const struct ansi_ops sh_ops = {
+    .erase = sh_erase,
+    .write_char = sh_write_char,
+    .showcursor = sh_showcursor,
+    .scroll_up = sh_scroll_up,
+    .set_cursor = sh_set_cursor,
+    .beep = sh_beep,
+};
+
+static struct {
+    struct term_state ts;
+    struct term_info ti;
+    uint32_t *want;		/* What the application has drawn */
+    uint32_t *have;		/* What we have sent */
+    bool engaged;		/* Sending differences, not the raw stream */
+    uint8_t raw;		/* Byte being interpreted */
+    int clear_attr;		/* Screen cleared in this write, or -1 */
+    int hx, hy;			/* Terminal cursor, or -1 if not known */
+    int hattr;			/* Terminal SGR state, or -1 */
+    int hvt;			/* Terminal shifted to VT graphics, or -1 */
+    int hcursor;		/* Terminal cursor shown, or -1 */
+} sh = {
+    .ti = { .ts = &sh.ts, .op = &sh_ops },
+};
+
+static unsigned int sh_attr(const struct term_state *st)
+{
+    return st->fg | (st->bg << 3) | (st->intensity << 6) |
+	(st->underline << 8) | (st->blink << 9) | (st->reverse << 10);
+}
+
+static inline uint32_t sh_blank(const struct term_state *st)
+{
+    return ' ' | (sh_attr(st) << 8);
+}
+
+static void sh_fill(uint32_t *p, uint32_t cell, int n)
+{
+    while (n--)
+	*p++ = cell;
+}
+
+static void sh_erase(const struct term_state *st,
+		     int x0, int y0, int x1, int y1)
+{
+    const int cols = sh.ti.cols;
+    uint32_t blank = sh_blank(st);
+    int y;
+
+    if (!x0 && !y0 && x1 == cols - 1 && y1 == sh.ti.rows - 1) {
+	if (sh.engaged) {
+	    sh.clear_attr = sh_attr(st);
+	} else {
+	    /*
+	     * The terminal has just been sent the same clear, so from
+	     * here on we know what it shows.
+	     */
+	    sh_fill(sh.have, blank, sh.ti.rows * cols);
+	    sh.hx = sh.hy = -1;
+	    sh.hattr = -1;
+	    sh.hvt = st->vtgraphics;
+	    sh.hcursor = st->cursor;
+	    sh.clear_attr = -1;
+	    sh.engaged = true;
+	}
+    }
+
+    for (y = y0; y <= y1; y++)
+	sh_fill(&sh.want[y * cols + x0], blank, x1 - x0 + 1);
+}
+
+static void sh_write_char(int x, int y, uint8_t ch,
+			  const struct term_state *st)
+{
+    uint32_t cell = sh_attr(st) << 8;
+
+    /* Send line drawing as the terminal's own VT graphics, not CP437 */
+    if (st->vtgraphics && (sh.raw & 0xe0) == 0x60)
+	cell |= sh.raw | CELL_VT;
+    else
+	cell |= ch;
+
+    sh.want[y * sh.ti.cols + x] = cell;
+}
+
+static void sh_showcursor(const struct term_state *st)
+{
+    (void)st;			/* Picked up from sh.ts when syncing */
+}
+
+static void sh_sync(void);
+
+static void sh_scroll_up(const struct term_state *st)
+{
+    const int cols = sh.ti.cols;
+    const int n = (sh.ti.rows - 1) * cols;
+
+    /*
+     * Output that scrolls is line-oriented, and the terminal may not
+     * have the same number of rows as we do; catch up, let it scroll
+     * itself, and go back to passing the stream through until the
+     * next clear.
+     */
+    if (sh.engaged) {
+	sh_sync();
+	emit('\r');
+	emit('\n');
+	sh.engaged = false;
+    }
+
+    memmove(sh.want, sh.want + cols, n * sizeof *sh.want);
+    sh_fill(sh.want + n, sh_blank(st), cols);
+}
+
+static void sh_set_cursor(int x, int y, bool visible)
+{
+    (void)x;			/* Picked up from sh.ts when syncing */
+    (void)y;
+    (void)visible;
+}
+
+static void sh_beep(void)
+{
+    if (sh.engaged)
+	emit('\a');
+}
+
+/*
+ * Move the terminal cursor to (x,y) in as few bytes as we can manage.
+ */
+static void sh_goto(int x, int y)
+{
+    const uint32_t *row = &sh.have[y * sh.ti.cols];
+    char buf[32];
+    int i;
+
+    if (sh.hy == y && sh.hx == x)
+	return;
+
+    if (sh.hy == y && x > sh.hx && x - sh.hx <= 6) {
+	/* Cheaper to send a few cells again, if no SGR or SO/SI is needed */
+	for (i = sh.hx; i < x; i++) {
+	    if ((int)CELL_ATTR(row[i]) != sh.hattr ||
+		!!(row[i] & CELL_VT) != sh.hvt || !row[i])
+		break;
+	}
+	if (i == x) {
+	    for (i = sh.hx; i < x; i++)
+		emit(row[i] & 0xff);
+	    sh.hx = x;
+	    return;
+	}
+    }
+
+    if (sh.hy == y && !x) {
+	emit('\r');
+    } else if (sh.hy >= 0 && sh.hy + 1 == y && !x) {
+	emit('\r');
+	emit('\n');
+    } else {
+	if (sh.hy == y && x > sh.hx)
+	    snprintf(buf, sizeof buf, "\033[%dC", x - sh.hx);
+	else
+	    snprintf(buf, sizeof buf, "\033[%d;%dH", y + 1, x + 1);
+	emit_str(buf);
+    }
+
+    sh.hx = x;
+    sh.hy = y;
+}
+
+static void sh_sgr(unsigned int attr)
+{
+    static const char pc2ansi[8] = "04261537";
+    unsigned int intensity = (attr >> 6) & 3;
+    char buf[24], *p = buf;
+
+    p = stpcpy(p, "\033[0");
+    if (intensity == 2)
+	p = stpcpy(p, ";1");
+    else if (intensity == 0)
+	p = stpcpy(p, ";2");
+    if (attr & (1 << 8))
+	p = stpcpy(p, ";4");
+    if (attr & (1 << 9))
+	p = stpcpy(p, ";5");
+    if (attr & (1 << 10))
+	p = stpcpy(p, ";7");
+    *p++ = ';';
+    *p++ = '3';
+    *p++ = pc2ansi[attr & 7];
+    *p++ = ';';
+    *p++ = '4';
+    *p++ = pc2ansi[(attr >> 3) & 7];
+    *p++ = 'm';
+    *p = '\0';
+
+    emit_str(buf);
+    sh.hattr = attr;
+}
+
+/*
+ * Bring the terminal up to date with the shadow.
+ */
+static void sh_sync(void)
+{
+    const int cols = sh.ti.cols;
+    const int ncells = sh.ti.rows * cols;
+    uint32_t cell;
+    int i, n;
+
+    if (sh.clear_attr >= 0) {
+	uint32_t blank = ' ' | (sh.clear_attr << 8);
+
+	for (i = n = 0; i < ncells; i++)
+	    n += sh.want[i] == blank && sh.have[i] != blank;
+
+	if (n >= SHADOW_CLEAR_MIN) {
+	    if (sh.hattr != sh.clear_attr)
+		sh_sgr(sh.clear_attr);
+	    emit_str("\033[2J");
+	    sh_fill(sh.have, blank, ncells);
+	}
+	sh.clear_attr = -1;
+    }
+
+    for (i = 0; i < ncells; i++) {
+	cell = sh.want[i];
+	if (cell == sh.have[i])
+	    continue;
+
+	sh_goto(i % cols, i / cols);
+
+	if ((int)CELL_ATTR(cell) != sh.hattr)
+	    sh_sgr(CELL_ATTR(cell));
+	if (!!(cell & CELL_VT) != sh.hvt) {
+	    sh.hvt = !!(cell & CELL_VT);
+	    emit(sh.hvt ? 14 : 15);	/* SO/SI */
+	}
+
+	emit(cell & 0xff);
+	sh.have[i] = cell;
+
+	/* Terminals differ on where the cursor is after the last column */
+	if (++sh.hx >= cols)
+	    sh.hx = sh.hy = -1;
+    }
+
+    sh_goto(sh.ts.xy.x, sh.ts.xy.y);
+
+    if (sh.hcursor != sh.ts.cursor) {
+	sh.hcursor = sh.ts.cursor;
+	emit_str(sh.hcursor ? "\033[?25h" : "\033[?25l");
+    }
+}
+
+/*
+ * Make sure the shadow matches the console size.  Returns false if we
+ * have no shadow, in which case the stream is just passed through.
+ */
+static bool sh_setup(const struct file_info *fp)
+{
+    int rows = fp->o.rows ? fp->o.rows : 25;
+    int cols = fp->o.cols ? fp->o.cols : 80;
+
+    if (sh.want && rows == sh.ti.rows && cols == sh.ti.cols)
+	return true;
+
+    free(sh.want);
+    free(sh.have);
+    sh.want = calloc(rows * cols, sizeof *sh.want);
+    sh.have = calloc(rows * cols, sizeof *sh.have);
+    if (!sh.want || !sh.have) {
+	free(sh.want);
+	free(sh.have);
+	sh.want = sh.have = NULL;
+	sh.engaged = false;
+	return false;
+    }
+
+    sh.ti.rows = rows;
+    sh.ti.cols = cols;
+    sh.engaged = false;
+    __ansi_init(&sh.ti);
+    return true;
+}
+
+/*
+ * The stream as the terminal gets it when we are not engaged.
+ */
+static void xserial_putchar(unsigned char ch)
 {
-    const char *bufp = buf;
-    size_t n = 0;
     static enum { st_init, st_tbl, st_tblc } state = st_init;
     static int ndigits;
     static int ncolor = 0;
     int num;
     const char *p;
 
-    (void)fp;
-
-    if (!syslinux_serial_console_info()->iobase)
-	return count;		/* Nothing to do */
+    switch (state) {
+    case st_init:
+	if (ch >= 1 && ch <= 5) {
+	    state = st_tbl;
+	    ndigits = ch;
+	} else if (ch == '\n') {
+	    emit('\r');
+	    emit('\n');
+	} else {
+	    emit(ch);
+	}
+	break;
 
-    while (count--) {
-	unsigned char ch = *bufp++;
-
-	switch (state) {
-	case st_init:
-	    if (ch >= 1 && ch <= 5) {
-		state = st_tbl;
-		ndigits = ch;
-	    } else if (ch == '\n') {
-		emit('\r');
-		emit('\n');
-	    } else {
-		emit(ch);
-	    }
-	    break;
+    case st_tbl:
+	if (ch == '#') {
+	    state = st_tblc;
+	    ncolor = 0;
+	} else {
+	    state = st_init;
+	}
+	break;
 
-	case st_tbl:
-	    if (ch == '#') {
-		state = st_tblc;
-		ncolor = 0;
-	    } else {
-		state = st_init;
-	    }
-	    break;
-
-	case st_tblc:
-	    num = ch - '0';
-	    if (num < 10) {
-		ncolor = (ncolor * 10) + num;
-		if (--ndigits == 0) {
-		    if (ncolor < console_color_table_size) {
-			emit('\033');
-			emit('[');
-			emit('0');
-			emit(';');
-			for (p = console_color_table[ncolor].ansi; *p; p++)
-			    emit(*p);
-			emit('m');
-		    }
-		    state = st_init;
+    case st_tblc:
+	num = ch - '0';
+	if (num < 10) {
+	    ncolor = (ncolor * 10) + num;
+	    if (--ndigits == 0) {
+		if (ncolor < console_color_table_size) {
+		    emit('\033');
+		    emit('[');
+		    emit('0');
+		    emit(';');
+		    for (p = console_color_table[ncolor].ansi; *p; p++)
+			emit(*p);
+		    emit('m');
 		}
-	    } else {
 		state = st_init;
 	    }
-	    break;
+	} else {
+	    state = st_init;
+	}
+	break;
+    }
+}
+
+ssize_t __xserial_write(struct file_info *fp, const void *buf, size_t count)
+{
+    const unsigned char *bufp = buf;
+    bool shadow;
+    size_t n;
+
+    if (!syslinux_serial_console_info()->iobase)
+	return count;		/* Nothing to do */
+
+    shadow = sh_setup(fp);
+
+    for (n = 0; n < count; n++) {
+	if (!sh.engaged)
+	    xserial_putchar(bufp[n]);
+	if (shadow) {
+	    sh.raw = bufp[n];
+	    __ansi_putchar(&sh.ti, bufp[n]);
 	}
-	n++;
     }
 
-    return n;
+    if (sh.engaged)
+	sh_sync();
+
+    return count;
 }
@@ -30,6 +30,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <pmapi.h>
 #include <syslinux/zio.h>
 
 #include "file.h"
@@ -44,6 +45,19 @@
 
 int __file_get_block(struct file_info *fp);
 int __file_close(struct file_info *fp);
+int __lz4_file_init(struct file_info *fp);
+
+/*
+ * Compressed input is read in blocks of this size, whatever size of
+ * file buffer it started out in: inflate() gets to run longer per call,
+ * and the file system is asked for data less often.
+ */
+#define GZIP_INBUF	65536
+
+struct gzip_file {
+    z_stream zs;
+    unsigned char in[GZIP_INBUF];
+};
 
 static ssize_t gzip_file_read(struct file_info *, void *, size_t);
 static int gzip_file_close(struct file_info *);
@@ -59,12 +73,14 @@ static const struct input_dev gzip_file_dev = {
 
 static int gzip_file_init(struct file_info *fp)
 {
-    z_streamp zs = calloc(1, sizeof(z_stream));
+    struct gzip_file *gz = calloc(1, sizeof(struct gzip_file));
+    z_streamp zs;
 
-    if (!zs)
+    if (!gz)
 	return -1;
 
-    fp->i.pvt = zs;
+    fp->i.pvt = gz;
+    zs = &gz->zs;
 
     zs->next_in = (void *)fp->i.datap;
     zs->avail_in = fp->i.nbytes;
@@ -80,9 +96,28 @@ static int gzip_file_init(struct file_info *fp)
     return 0;
 }
 
+/* Refill the input buffer */
+static int gzip_get_block(struct file_info *fp)
+{
+    struct gzip_file *gz = fp->i.pvt;
+    size_t bytes_read;
+
+    bytes_read = pmapi_read_file(&fp->i.fd.handle, gz->in,
+				 GZIP_INBUF >> fp->i.fd.blocklg2);
+    if (!bytes_read) {
+	errno = EIO;
+	return -1;
+    }
+
+    gz->zs.next_in = gz->in;
+    gz->zs.avail_in = bytes_read;
+    return 0;
+}
+
 static ssize_t gzip_file_read(struct file_info *fp, void *ptr, size_t n)
 {
-    z_streamp zs = fp->i.pvt;
+    struct gzip_file *gz = fp->i.pvt;
+    z_streamp zs = &gz->zs;
     int rv;
     ssize_t bytes;
     ssize_t nout = 0;
@@ -93,11 +128,8 @@ static ssize_t gzip_file_read(struct file_info *fp, void *ptr, size_t n)
 	zs->avail_out = n;
 
 	if (!zs->avail_in && fp->i.fd.handle) {
-	    if (__file_get_block(fp))
+	    if (gzip_get_block(fp))
 		return nout ? nout : -1;
-
-	    zs->next_in = (void *)fp->i.datap;
-	    zs->avail_in = fp->i.nbytes;
 	}
 
 	rv = inflate(zs, Z_SYNC_FLUSH);
@@ -130,10 +162,10 @@ static ssize_t gzip_file_read(struct file_info *fp, void *ptr, size_t n)
 
 static int gzip_file_close(struct file_info *fp)
 {
-    z_streamp zs = fp->i.pvt;
+    struct gzip_file *gz = fp->i.pvt;
 
-    inflateEnd(zs);
-    free(zs);
+    inflateEnd(&gz->zs);
+    free(gz);
     return __file_close(fp);
 }
 
@@ -159,6 +191,12 @@ int zopen(const char *pathname, int flags, ...)
 	(uint8_t) fp->i.buf[1] == 0213 &&	/* gzip */
 	fp->i.buf[2] == 8)	/* deflate */
 	rv = gzip_file_init(fp);
+    else if (fp->i.nbytes >= 7 &&
+	     (uint8_t) fp->i.buf[0] == 0x04 &&
+	     (uint8_t) fp->i.buf[1] == 0x22 &&
+	     (uint8_t) fp->i.buf[2] == 0x4d &&
+	     (uint8_t) fp->i.buf[3] == 0x18)	/* LZ4 frame */
+	rv = __lz4_file_init(fp);
     else
 	rv = 0;			/* Plain file */
 
@@ -25,6 +25,7 @@
  *
  * ----------------------------------------------------------------------- */
 
+#include <syslinux/adv.h>
 #include <syslinux/boot.h>
 #include <syslinux/config.h>
 #include <syslinux/pxe_api.h>
@@ -33,6 +34,8 @@
 
 void syslinux_final_cleanup(uint16_t flags)
 {
+    syslinux_save_history();
+
     if (syslinux_filesystem() == SYSLINUX_FS_PXELINUX)
 	unload_pxe(flags);
 
@@ -39,6 +39,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <syslinux/disk.h>
+#include <pmapi.h>
 
 /**
  * Call int 13h, but with retry on failure.  Especially floppies need this.
@@ -73,74 +74,45 @@ int disk_int13_retry(const com32sys_t * inreg, com32sys_t * outreg)
  */
 int disk_get_params(int disk, struct disk_info *const diskinfo)
 {
-    static com32sys_t inreg, outreg;
-    struct disk_ebios_eparam *eparam;
-    int rv = 0;
+    struct com32_disk_probe probe;
+    struct disk_ebios_eparam eparam;
 
     memset(diskinfo, 0, sizeof *diskinfo);
     diskinfo->disk = disk;
     diskinfo->bps = SECTOR;
 
-    /* Get EBIOS support */
-    memset(&inreg, 0, sizeof inreg);
-    inreg.eax.b[1] = 0x41;
-    inreg.ebx.w[0] = 0x55aa;
-    inreg.edx.b[0] = disk;
-    inreg.eflags.b[0] = 0x3;	/* CF set */
-
-    __intcall(0x13, &inreg, &outreg);
+    /*
+     * The core asks the BIOS once per drive (AH=41h, AH=48h if EBIOS,
+     * AH=08h) and keeps the answers
+     */
+    pmapi_disk_probe(disk, &probe);
 
-    if (!(outreg.eflags.l & EFLAGS_CF) &&
-	outreg.ebx.w[0] == 0xaa55 && (outreg.ecx.b[0] & 1)) {
+    /* Get EBIOS support */
+    if ((probe.flags & COM32_DISK_EBIOS) && (probe.edd_subset & 1))
 	diskinfo->ebios = 1;
-    }
-
-    eparam = lmalloc(sizeof *eparam);
-    if (!eparam)
-	return -1;
 
     /* Get extended disk parameters if ebios == 1 */
-    if (diskinfo->ebios) {
-	memset(&inreg, 0, sizeof inreg);
-	inreg.eax.b[1] = 0x48;
-	inreg.edx.b[0] = disk;
-	inreg.esi.w[0] = OFFS(eparam);
-	inreg.ds = SEG(eparam);
-
-	memset(eparam, 0, sizeof *eparam);
-	eparam->len = sizeof *eparam;
-
-	__intcall(0x13, &inreg, &outreg);
-
-	if (!(outreg.eflags.l & EFLAGS_CF)) {
-	    diskinfo->lbacnt = eparam->lbacnt;
-	    if (eparam->bps)
-		diskinfo->bps = eparam->bps;
-	    /*
-	     * don't think about using geometry data returned by
-	     * 48h, as it can differ from 08h a lot ...
-	     */
-	}
+    if (diskinfo->ebios && (probe.flags & COM32_DISK_EDD)) {
+	memcpy(&eparam, probe.edd_params, sizeof eparam);
+	diskinfo->lbacnt = eparam.lbacnt;
+	if (eparam.bps)
+	    diskinfo->bps = eparam.bps;
+	/*
+	 * don't think about using geometry data returned by
+	 * 48h, as it can differ from 08h a lot ...
+	 */
     }
     /*
      * Get disk parameters the old way - really only useful for hard
      * disks, but if we have a partitioned floppy it's actually our best
      * chance...
      */
-    memset(&inreg, 0, sizeof inreg);
-    inreg.eax.b[1] = 0x08;
-    inreg.edx.b[0] = disk;
-
-    __intcall(0x13, &inreg, &outreg);
+    if (!(probe.flags & COM32_DISK_CHS))
+	return diskinfo->ebios ? 0 : -1;
 
-    if (outreg.eflags.l & EFLAGS_CF) {
-	rv = diskinfo->ebios ? 0 : -1;
-	goto out;
-    }
-
-    diskinfo->spt = 0x3f & outreg.ecx.b[0];
-    diskinfo->head = 1 + outreg.edx.b[1];
-    diskinfo->cyl = 1 + (outreg.ecx.b[1] | ((outreg.ecx.b[0] & 0xc0u) << 2));
+    diskinfo->spt = 0x3f & probe.chs_cx;
+    diskinfo->head = 1 + (probe.chs_dx >> 8);
+    diskinfo->cyl = 1 + ((probe.chs_cx >> 8) | ((probe.chs_cx & 0xc0u) << 2));
 
     if (diskinfo->spt)
 	diskinfo->cbios = 1;	/* Valid geometry */
@@ -153,9 +125,7 @@ int disk_get_params(int disk, struct disk_info *const diskinfo)
     if (!diskinfo->lbacnt)
 	diskinfo->lbacnt = diskinfo->cyl * diskinfo->head * diskinfo->spt;
 
-out:
-    lfree(eparam);
-    return rv;
+    return 0;
 }
 
 /**
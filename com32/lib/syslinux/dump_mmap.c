@@ -41,7 +41,7 @@ void syslinux_dump_memmap(struct syslinux_memmap *memmap)
     dprintf("%10s %10s %10s\n"
 	    "--------------------------------\n", "Start", "Length", "Type");
     while (memmap->next) {
-	dprintf("0x%08x 0x%08x %10d\n", memmap->start,
+	dprintf("0x%08" PRIxADDR " 0x%08" PRIxADDR " %10d\n", memmap->start,
 		memmap->next->start - memmap->start, memmap->type);
 	memmap = memmap->next;
     }
@@ -42,7 +42,8 @@ void syslinux_dump_movelist(struct syslinux_movelist *ml)
     dprintf("%10s %10s %10s\n"
 	    "--------------------------------\n", "Dest", "Src", "Length");
     while (ml) {
-	dprintf("0x%08x 0x%08x 0x%08x\n", ml->dst, ml->src, ml->len);
+	dprintf("0x%08" PRIxADDR " 0x%08" PRIxADDR " 0x%08" PRIxADDR "\n",
+		ml->dst, ml->src, ml->len);
 	ml = ml->next;
     }
 }
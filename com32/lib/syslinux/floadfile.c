@@ -37,6 +37,7 @@
 #include <string.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <minmax.h>
 
 #include <syslinux/loadfile.h>
 
@@ -47,7 +48,7 @@ int floadfile(FILE * f, void **ptr, size_t * len, const void *prefix,
 {
     struct stat st;
     void *data, *dp;
-    size_t alen, clen, rlen, xlen;
+    size_t alen, clen, rlen, xlen, grow;
 
     clen = alen = 0;
     data = NULL;
@@ -66,8 +67,18 @@ int floadfile(FILE * f, void **ptr, size_t * len, const void *prefix,
 	    memcpy(data, prefix, prefix_len);
 	}
 
+	/*
+	 * st_size may carry a guess at the length (a decompressor's
+	 * record of the original size, say).  Allocate that much plus
+	 * the zero padding, so that a right guess is read in one go and
+	 * the data never moves; otherwise grow geometrically, so a big
+	 * file is only copied a few times.
+	 */
+	grow = st.st_size > 0 ? st.st_size + LOADFILE_ZERO_PAD
+			      : INCREMENTAL_CHUNK;
 	do {
-	    alen += INCREMENTAL_CHUNK;
+	    alen += grow;
+	    grow = max(alen, (size_t)INCREMENTAL_CHUNK);
 	    dp = realloc(data, alen);
 	    if (!dp)
 		goto err;
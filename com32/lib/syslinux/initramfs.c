@@ -46,6 +46,56 @@ struct initramfs *initramfs_init(void)
     return ir;
 }
 
+/*
+ * Set aside size bytes, as high as they go without passing limit, for
+ * the archives loaded next: initramfs_load_archive() reads them
+ * straight in there, which is where bios_boot_linux() would put them,
+ * so that there is nothing left to move at boot time.
+ */
+int initramfs_reserve(struct initramfs *ihead, size_t size, size_t limit)
+{
+    char *p;
+
+    if (ihead->rsv || !size)
+	return -1;
+
+    p = malloc_high(size, INITRAMFS_MAX_ALIGN, limit);
+    if (!p)
+	return -1;
+
+    ihead->rsv = p;
+    ihead->rsv_len = size;
+    ihead->rsv_used = 0;
+    return 0;
+}
+
+/*
+ * If the whole initramfs sits in the space initramfs_reserve() set
+ * aside, each chunk where the boot code would lay it out, and ends at
+ * or below limit, return where it starts; NULL if it has to be copied.
+ */
+void *initramfs_reserved_base(struct initramfs *ihead, size_t limit)
+{
+    struct initramfs *ip;
+    size_t size = initramfs_size(ihead);
+    uintptr_t base = (uintptr_t) ihead->rsv;
+    uintptr_t addr = base;
+
+    if (!base || (base & (INITRAMFS_MAX_ALIGN - 1)) ||
+	size > ihead->rsv_len || base + size - 1 > limit)
+	return NULL;
+
+    for (ip = ihead->next; ip->len; ip = ip->next) {
+	if (ip->data_len && (uintptr_t) ip->data != addr)
+	    return NULL;
+	addr += ip->len;
+	if (ip->next->len)
+	    addr += -addr & (ip->next->align - 1);
+    }
+
+    return ihead->rsv;
+}
+
 int initramfs_add_data(struct initramfs *ihead, const void *data,
 		       size_t data_len, size_t len, size_t align)
 {
@@ -65,6 +115,7 @@ int initramfs_add_data(struct initramfs *ihead, const void *data,
     in->len = len;
     in->data = data;
     in->data_len = data_len;
+    in->path = NULL;
     in->align = align;
 
     in->next = ihead;
@@ -31,17 +31,56 @@
  * Utility function to load an initramfs archive.
  */
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <sys/stat.h>
 #include <syslinux/loadfile.h>
 #include <syslinux/linux.h>
 
+#define ARCHIVE_ALIGN	4
+
+/*
+ * Read the file into the space initramfs_reserve() set aside, if it
+ * fits there; returns 1 if it doesn't.
+ */
+static int load_reserved(struct initramfs *ihead, FILE *f,
+			 void **data, size_t *len)
+{
+    struct stat st;
+    size_t off = (ihead->rsv_used + ARCHIVE_ALIGN - 1) & ~(ARCHIVE_ALIGN - 1);
+
+    if (!ihead->rsv || off > ihead->rsv_len ||
+	fstat(fileno(f), &st) || !S_ISREG(st.st_mode) ||
+	st.st_size > (off_t)(ihead->rsv_len - off))
+	return 1;
+
+    *data = ihead->rsv + off;
+    *len = st.st_size;
+    if (fread(*data, 1, *len, f) != *len)
+	return -1;
+
+    ihead->rsv_used = off + *len;
+    return 0;
+}
+
 int initramfs_load_archive(struct initramfs *ihead, const char *filename)
 {
+    FILE *f;
     void *data;
     size_t len;
+    int rv;
+
+    f = fopen(filename, "r");
+    if (!f)
+	return -1;
+
+    rv = load_reserved(ihead, f, &data, &len);
+    if (rv > 0)
+	rv = floadfile(f, &data, &len, NULL, 0);
+    fclose(f);
 
-    if (loadfile(filename, &data, &len))
+    if (rv)
 	return -1;
 
-    return initramfs_add_data(ihead, data, len, len, 4);
+    return initramfs_add_data(ihead, data, len, len, ARCHIVE_ALIGN);
 }
@@ -31,15 +31,47 @@
  * Load a single file into an initramfs image.
  */
 
+#include <stdio.h>
+#include <sys/stat.h>
 #include <syslinux/linux.h>
 #include <syslinux/loadfile.h>
 
+/* Get the size of the file; returns -1 if it isn't a regular one */
+static int file_size(const char *filename, size_t *size)
+{
+    struct stat st;
+    FILE *f;
+    int rv = -1;
+
+    f = fopen(filename, "r");
+    if (!f)
+	return -1;
+
+    if (!fstat(fileno(f), &st) && S_ISREG(st.st_mode)) {
+	*size = st.st_size;
+	rv = 0;
+    }
+
+    fclose(f);
+    return rv;
+}
+
 int initramfs_load_file(struct initramfs *ihead, const char *src_filename,
 			const char *dst_filename, int do_mkdir, uint32_t mode)
 {
     void *data;
     size_t len;
 
+    /* Files we know the size of are read at boot time, into place */
+    if (!file_size(src_filename, &len)) {
+	if (initramfs_mknod(ihead, dst_filename, do_mkdir,
+			    (mode & S_IFMT) ? mode : mode | S_IFREG,
+			    len, 0, 1))
+	    return -1;
+
+	return initramfs_add_path(ihead, src_filename, len, len, 4);
+    }
+
     if (loadfile(src_filename, &data, &len))
 	return -1;
 
@@ -0,0 +1,140 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Permission is hereby granted, free of charge, to any person
+ *   obtaining a copy of this software and associated documentation
+ *   files (the "Software"), to deal in the Software without
+ *   restriction, including without limitation the rights to use,
+ *   copy, modify, merge, publish, distribute, sublicense, and/or
+ *   sell copies of the Software, and to permit persons to whom
+ *   the Software is furnished to do so, subject to the following
+ *   conditions:
+ *
+ *   The above copyright notice and this permission notice shall
+ *   be included in all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *   OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *   HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *   OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * initramfs_stream.c
+ *
+ * initramfs chunks that stay in their files until boot time.  By then
+ * the whole layout is known, so they can be read in right where the
+ * kernel is going to look for them, with the chunks already in memory
+ * copied in around them; the shuffle then has nothing left to move.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslinux/linux.h>
+
+int initramfs_add_path(struct initramfs *ihead, const char *path,
+		       size_t data_len, size_t len, size_t align)
+{
+    char *p;
+
+    if (!data_len)
+	return initramfs_add_data(ihead, NULL, 0, len, align);
+
+    p = strdup(path);
+    if (!p)
+	return -1;
+
+    if (initramfs_add_data(ihead, NULL, data_len, len, align)) {
+	free(p);
+	return -1;
+    }
+
+    ihead->prev->path = p;
+    return 0;
+}
+
+/* Read data_len bytes of ip->path to dst */
+static int read_chunk(struct initramfs *ip, void *dst)
+{
+    FILE *f;
+    size_t n;
+
+    f = fopen(ip->path, "r");
+    if (!f)
+	return -1;
+
+    n = fread(dst, 1, ip->data_len, f);
+    fclose(f);
+
+    if (n != ip->data_len) {
+	errno = EIO;		/* The file changed size on us */
+	return -1;
+    }
+
+    free(ip->path);
+    ip->path = NULL;
+    ip->data = dst;
+    return 0;
+}
+
+/*
+ * Read in every chunk that is still in its file.  If limit is nonzero,
+ * try to put the whole initramfs together below it, as
+ * bios_boot_linux() would lay it out; if there isn't room for that,
+ * each chunk gets a buffer of its own.
+ */
+int initramfs_resolve(struct initramfs *ihead, size_t limit)
+{
+    struct initramfs *ip;
+    char *base = NULL, *dst;
+    size_t size, off;
+    void *buf;
+
+    for (ip = ihead->next; ip->len; ip = ip->next) {
+	if (ip->path)
+	    break;
+    }
+    if (!ip->len)
+	return 0;		/* Nothing to do */
+
+    size = initramfs_size(ihead);
+    if (limit)
+	base = malloc_high(size, INITRAMFS_MAX_ALIGN, limit);
+
+    off = 0;
+    for (ip = ihead->next; ip->len; ip = ip->next) {
+	dst = base ? base + off : NULL;
+	off += ip->len;
+	if (ip->next->len)
+	    off = (off + ip->next->align - 1) & ~(ip->next->align - 1);
+
+	if (ip->path) {
+	    buf = base ? dst : malloc(ip->data_len);
+	    if (!buf)
+		return -1;
+	    if (read_chunk(ip, buf)) {
+		if (!base)
+		    free(buf);
+		return -1;
+	    }
+	} else if (base && ip->data_len) {
+	    memcpy(dst, ip->data, ip->data_len);
+	    ip->data = dst;
+	}
+    }
+
+    if (base) {
+	/* Whatever initramfs_reserve() set aside is all copied out now */
+	free(ihead->rsv);
+	ihead->rsv = base;
+	ihead->rsv_len = ihead->rsv_used = size;
+    }
+
+    return 0;
+}
@@ -42,6 +42,7 @@
 #include <suffix_number.h>
 #include <dprintf.h>
 
+#include <syslinux/adv.h>
 #include <syslinux/align.h>
 #include <syslinux/linux.h>
 #include <syslinux/bootrm.h>
@@ -49,6 +50,8 @@
 #include <syslinux/firmware.h>
 #include <syslinux/video.h>
 #include <syslinux/config.h>
+#include <syslinux/boottime.h>
+#include <syslinux/dmesg.h>
 
 #define BOOT_MAGIC 0xAA55
 #define LINUX_MAGIC ('H' + ('d' << 8) + ('r' << 16) + ('S' << 24))
@@ -125,6 +128,64 @@ static int map_initramfs(struct syslinux_movelist **fraglist,
     return 0;
 }
 
+/*
+ * If the initramfs was read into memory set aside by initramfs_reserve(),
+ * each chunk already where map_initramfs() would put it, return its
+ * base address, or 0 if it has to be moved into place.
+ */
+static addr_t initramfs_in_place(struct syslinux_memmap *amap,
+				 struct initramfs *initramfs,
+				 addr_t irf_size, addr_t addr_max)
+{
+    addr_t base = (addr_t) initramfs_reserved_base(initramfs, addr_max);
+
+    if (!base || syslinux_memmap_type(amap, base, irf_size) != SMT_FREE)
+	return 0;
+
+    return base;
+}
+
+/*
+ * Put one setup_data entry at the top of free memory and chain it in
+ * after *prev_ptr.
+ */
+static int place_setup_data(struct syslinux_memmap **amap,
+			    struct syslinux_movelist **fraglist,
+			    uint64_t **prev_ptr,
+			    struct setup_data_header *sdh, const void *data)
+{
+    struct syslinux_memmap *ml;
+    const addr_t align_mask = 15; /* Header is 16 bytes */
+    addr_t best_addr = 0;
+    size_t size = sdh->len + sizeof *sdh;
+
+    for (ml = *amap; ml->type != SMT_END; ml = ml->next) {
+	addr_t adj_start = (ml->start + align_mask) & ~align_mask;
+	addr_t adj_end = ml->next->start & ~align_mask;
+
+	if (ml->type == SMT_FREE && adj_end - adj_start >= size)
+	    best_addr = (adj_end - size) & ~align_mask;
+    }
+
+    if (!best_addr)
+	return -1;
+
+    sdh->next = 0;
+    **prev_ptr = best_addr;
+    *prev_ptr = &sdh->next;
+
+    if (syslinux_add_memmap(amap, best_addr, size, SMT_ALLOC) ||
+	syslinux_add_movelist(fraglist, best_addr,
+			      (addr_t)sdh, sizeof *sdh) ||
+	syslinux_add_movelist(fraglist, best_addr + sizeof *sdh,
+			      (addr_t)data, sdh->len)) {
+	errno = ENOMEM;
+	return -1;
+    }
+
+    return 0;
+}
+
 static size_t calc_cmdline_offset(const struct syslinux_memmap *mmap,
 				  const struct linux_header *hdr,
 				  size_t cmdline_size, addr_t base,
@@ -161,6 +222,12 @@ int bios_boot_linux(void *kernel_buf, size_t kernel_size,
     addr_t irf_size;
     size_t cmdline_size, cmdline_offset;
     struct setup_data *sdp;
+    static struct setup_data_header times_hdr;
+    const struct boot_times *times = boot_times_get();
+    static struct setup_data_header dmesg_hdr;
+    void *dmesg = NULL;
+    size_t dmesg_len;
+    uint64_t *prev_ptr;
     struct syslinux_rm_regs regs;
     struct syslinux_movelist *fraglist = NULL;
     struct syslinux_memmap *mmap = NULL;
@@ -401,11 +468,17 @@ int bios_boot_linux(void *kernel_buf, size_t kernel_size,
 	const addr_t align_mask = INITRAMFS_MAX_ALIGN - 1;
 
 	if (irf_size) {
-	    for (ml = amap; ml->type != SMT_END; ml = ml->next) {
-		addr_t adj_start = (ml->start + align_mask) & ~align_mask;
-		addr_t adj_end = ml->next->start & ~align_mask;
-		if (ml->type == SMT_FREE && adj_end - adj_start >= irf_size)
-		    best_addr = (adj_end - irf_size) & ~align_mask;
+	    /* Already read in where it goes, nothing to move */
+	    best_addr = initramfs_in_place(amap, initramfs, irf_size,
+					   hdr.initrd_addr_max);
+
+	    if (!best_addr) {
+		for (ml = amap; ml->type != SMT_END; ml = ml->next) {
+		    addr_t adj_start = (ml->start + align_mask) & ~align_mask;
+		    addr_t adj_end = ml->next->start & ~align_mask;
+		    if (ml->type == SMT_FREE && adj_end - adj_start >= irf_size)
+			best_addr = (adj_end - irf_size) & ~align_mask;
+		}
 	    }
 
 	    if (!best_addr) {
@@ -428,15 +501,10 @@ int bios_boot_linux(void *kernel_buf, size_t kernel_size,
 	}
     }
 
-    if (setup_data) {
-	uint64_t *prev_ptr = &whdr->setup_data;
+    prev_ptr = &whdr->setup_data;
 
+    if (setup_data) {
 	for (sdp = setup_data->next; sdp != setup_data; sdp = sdp->next) {
-	    struct syslinux_memmap *ml;
-	    const addr_t align_mask = 15; /* Header is 16 bytes */
-	    addr_t best_addr = 0;
-	    size_t size = sdp->hdr.len + sizeof(sdp->hdr);
-
 	    if (!sdp->data || !sdp->hdr.len)
 		continue;
 
@@ -446,35 +514,29 @@ int bios_boot_linux(void *kernel_buf, size_t kernel_size,
 		goto bail;
 	    }
 
-	    for (ml = amap; ml->type != SMT_END; ml = ml->next) {
-		addr_t adj_start = (ml->start + align_mask) & ~align_mask;
-		addr_t adj_end = ml->next->start & ~align_mask;
-
-		if (ml->type == SMT_FREE && adj_end - adj_start >= size)
-		    best_addr = (adj_end - size) & ~align_mask;
-	    }
-
-	    if (!best_addr)
+	    if (place_setup_data(&amap, &fraglist, &prev_ptr,
+				 &sdp->hdr, sdp->data))
 		goto bail;
+	}
+    }
 
-	    *prev_ptr = best_addr;
-	    prev_ptr = &sdp->hdr.next;
+    /*
+     * The boot phase timestamps go last.  The shuffler copies them
+     * from the live table, so the final stamp below still makes it.
+     */
+    if (times && hdr.version >= 0x0209) {
+	times_hdr.type = SETUP_BOOT_TIMES;
+	times_hdr.len = sizeof *times;
+	if (place_setup_data(&amap, &fraglist, &prev_ptr, &times_hdr, times))
+	    goto bail;
+    }
 
-	    if (syslinux_add_memmap(&amap, best_addr, size, SMT_ALLOC)) {
-		errno = ENOMEM;
-		goto bail;
-	    }
-	    if (syslinux_add_movelist(&fraglist, best_addr,
-				      (addr_t)&sdp->hdr, sizeof sdp->hdr)) {
-		errno = ENOMEM;
-		goto bail;
-	    }
-	    if (syslinux_add_movelist(&fraglist, best_addr + sizeof sdp->hdr,
-				      (addr_t)sdp->data, sdp->hdr.len)) {
-		errno = ENOMEM;
-		goto bail;
-	    }
-	}
+    /* And the debug log, as far as it has got */
+    if (hdr.version >= 0x0209 && (dmesg = dmesg_snapshot(&dmesg_len))) {
+	dmesg_hdr.type = SETUP_DMESG;
+	dmesg_hdr.len = dmesg_len;
+	if (place_setup_data(&amap, &fraglist, &prev_ptr, &dmesg_hdr, dmesg))
+	    goto bail;
     }
 
     /* Set up the registers on entry */
@@ -505,24 +567,73 @@ int bios_boot_linux(void *kernel_buf, size_t kernel_size,
 	dprintf("*** vga=current, not calling syslinux_force_text_mode()...\n");
     }
 
+    boot_time_stamp(BOOT_PHASE_SHUFFLE);
     syslinux_shuffle_boot_rm(fraglist, mmap, bootflags, &regs);
     dprintf("shuffle_boot_rm failed\n");
 
 bail:
+    free(dmesg);
     syslinux_free_movelist(fraglist);
     syslinux_free_memmap(mmap);
     syslinux_free_memmap(amap);
     return -1;
 }
 
+/*
+ * Highest address the kernel can take an initramfs at, for
+ * initramfs_reserve(); 0 if we don't know.  Both bios_boot_linux()
+ * and efi_boot_linux() take an initramfs that is already in place.
+ */
+size_t syslinux_linux_initrd_max(const void *kernel_buf, size_t kernel_size,
+				 const char *cmdline)
+{
+    const struct linux_header *hdr = kernel_buf;
+    size_t addr_max;
+    unsigned long long memlimit = 0;
+    const char *arg;
+
+    if (kernel_size < 2 * 512 ||
+	hdr->boot_flag != BOOT_MAGIC || hdr->header != LINUX_MAGIC ||
+	hdr->version < 0x0200)
+	return 0;
+
+    addr_max = hdr->initrd_addr_max;
+    if (hdr->version < 0x0203 || !addr_max)
+	addr_max = 0x37ffffff;
+
+    /* A 64-bit loader can go above 4 GB, if the kernel says it may */
+    if (sizeof(size_t) > 4 && hdr->version >= 0x020c &&
+	(hdr->xloadflags & XLF_CAN_BE_LOADED_ABOVE_4G))
+	addr_max = (size_t)-1;
+
+    if ((arg = find_argument(cmdline, "mem=")))
+	memlimit = suffix_number(arg);
+    if (memlimit && memlimit - 1 < addr_max)
+	addr_max = memlimit - 1;
+
+    return addr_max;
+}
+
 int syslinux_boot_linux(void *kernel_buf, size_t kernel_size,
 			struct initramfs *initramfs,
 			struct setup_data *setup_data,
 			char *cmdline)
 {
-    if (firmware->boot_linux)
+    if (initramfs) {
+	if (initramfs_resolve(initramfs,
+			      syslinux_linux_initrd_max(kernel_buf,
+							kernel_size,
+							cmdline)))
+	    return -1;
+	boot_time_stamp(BOOT_PHASE_INITRD_LOADED);
+    }
+
+    if (firmware->boot_linux) {
+	/* The BIOS path saves it in syslinux_final_cleanup() */
+	syslinux_save_history();
 	return firmware->boot_linux(kernel_buf, kernel_size, initramfs,
 				    setup_data, cmdline);
+    }
 
     return bios_boot_linux(kernel_buf, kernel_size, initramfs,
 			   setup_data, cmdline);
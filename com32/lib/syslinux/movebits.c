@@ -36,12 +36,18 @@
  * which are pointers to a pointer to a list, or part of the list.
  * They can be pointers to a variable holding the list root pointer,
  * or pointers to a next field of a previous entry.
+ *
+ * The working copy of the memory map is a syslinux_memmap list like
+ * any other, but every zone in it is also indexed by address and
+ * every free zone by size, so that the questions we keep asking it
+ * don't each cost a walk of the whole list.
  */
 
 #include <assert.h>
 #include <stdio.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <inttypes.h>
 #include <setjmp.h>
 #include <minmax.h>
@@ -82,12 +88,305 @@ static struct syslinux_movelist *dup_movelist(struct syslinux_movelist *src)
     return dst;
 }
 
+/*
+ * Treaps, threaded through the zones of the working memory map
+ */
+struct tnode {
+    struct tnode *left, *right;
+    uint32_t prio;
+};
+
+typedef bool (*tnode_less)(const struct tnode *, const struct tnode *);
+
+static struct tnode *tnode_merge(struct tnode *a, struct tnode *b)
+{
+    if (!a)
+	return b;
+    if (!b)
+	return a;
+
+    if (a->prio > b->prio) {
+	a->right = tnode_merge(a->right, b);
+	return a;
+    } else {
+	b->left = tnode_merge(a, b->left);
+	return b;
+    }
+}
+
+/* Split t into the nodes before x and the rest */
+static void tnode_split(struct tnode *t, const struct tnode *x,
+			tnode_less less, struct tnode **l, struct tnode **r)
+{
+    if (!t) {
+	*l = *r = NULL;
+    } else if (less(t, x)) {
+	*l = t;
+	tnode_split(t->right, x, less, &t->right, r);
+    } else {
+	*r = t;
+	tnode_split(t->left, x, less, l, &t->left);
+    }
+}
+
+static struct tnode *tnode_insert(struct tnode *t, struct tnode *x,
+				  tnode_less less)
+{
+    if (!t || x->prio > t->prio) {
+	tnode_split(t, x, less, &x->left, &x->right);
+	return x;
+    }
+
+    if (less(x, t))
+	t->left = tnode_insert(t->left, x, less);
+    else
+	t->right = tnode_insert(t->right, x, less);
+    return t;
+}
+
+static struct tnode *tnode_remove(struct tnode *t, const struct tnode *x,
+				  tnode_less less)
+{
+    if (t == x)
+	return tnode_merge(t->left, t->right);
+
+    if (less(x, t))
+	t->left = tnode_remove(t->left, x, less);
+    else
+	t->right = tnode_remove(t->right, x, less);
+    return t;
+}
+
+struct mzone {
+    struct syslinux_memmap m;	/* Must be first */
+    struct mzone *prev;		/* NULL for the zone at address 0 */
+    struct tnode by_addr;	/* All zones but the end marker */
+    struct tnode by_size;	/* SMT_FREE zones, if sized */
+    addr_t size;		/* Key in by_size */
+    bool sized;
+};
+
+#define mzone_next(z)	((struct mzone *)(z)->m.next)
+#define mzone_of(t, f)	((struct mzone *)((char *)(t) - offsetof(struct mzone, f)))
+
+struct zone_index {
+    struct mzone *head, *end;
+    struct tnode *by_addr, *by_size;
+    uint32_t seed;
+};
+
+static bool addr_less(const struct tnode *a, const struct tnode *b)
+{
+    return mzone_of(a, by_addr)->m.start < mzone_of(b, by_addr)->m.start;
+}
+
+static bool size_less(const struct tnode *a, const struct tnode *b)
+{
+    const struct mzone *za = mzone_of(a, by_size);
+    const struct mzone *zb = mzone_of(b, by_size);
+
+    if (za->size != zb->size)
+	return za->size < zb->size;
+    return za->m.start < zb->m.start;
+}
+
+static struct mzone *new_zone(struct zone_index *zi, addr_t start,
+			      enum syslinux_memmap_types type)
+{
+    struct mzone *z = malloc(sizeof(struct mzone));
+
+    if (!z)
+	longjmp(new_movelist_bail, 1);
+
+    z->m.start = start;
+    z->m.type = type;
+    z->m.next = NULL;
+    z->prev = NULL;
+    z->sized = false;
+
+    zi->seed = zi->seed * 1103515245 + 12345;
+    z->by_addr.prio = zi->seed;
+    zi->seed = zi->seed * 1103515245 + 12345;
+    z->by_size.prio = zi->seed;
+
+    return z;
+}
+
+/* Link z in front of mp */
+static void link_zone(struct zone_index *zi, struct mzone *z, struct mzone *mp)
+{
+    z->prev = mp->prev;
+    z->m.next = &mp->m;
+    if (mp->prev)
+	mp->prev->m.next = &z->m;
+    else
+	zi->head = z;
+    mp->prev = z;
+
+    zi->by_addr = tnode_insert(zi->by_addr, &z->by_addr, addr_less);
+}
+
+static void unlink_zone(struct zone_index *zi, struct mzone *z)
+{
+    struct mzone *next = mzone_next(z);
+
+    if (z->sized)
+	zi->by_size = tnode_remove(zi->by_size, &z->by_size, size_less);
+    zi->by_addr = tnode_remove(zi->by_addr, &z->by_addr, addr_less);
+
+    next->prev = z->prev;
+    if (z->prev)
+	z->prev->m.next = &next->m;
+    else
+	zi->head = next;
+
+    free(z);
+}
+
+/* Refile z by size after its type or its length changed */
+static void resize_zone(struct zone_index *zi, struct mzone *z)
+{
+    if (z->sized) {
+	zi->by_size = tnode_remove(zi->by_size, &z->by_size, size_less);
+	z->sized = false;
+    }
+
+    if (z->m.type == SMT_FREE) {
+	z->size = z->m.next->start - z->m.start;
+	zi->by_size = tnode_insert(zi->by_size, &z->by_size, size_less);
+	z->sized = true;
+    }
+}
+
+/* The zone containing addr */
+static struct mzone *zone_at(const struct zone_index *zi, addr_t addr)
+{
+    const struct tnode *t = zi->by_addr;
+    struct mzone *z, *best = zi->head;
+
+    while (t) {
+	z = mzone_of(t, by_addr);
+	if (z->m.start <= addr) {
+	    best = z;
+	    t = t->right;
+	} else {
+	    t = t->left;
+	}
+    }
+
+    return best;
+}
+
+/* The smallest, then lowest, free zone of at least len bytes */
+static struct mzone *zone_fit(const struct zone_index *zi, addr_t len)
+{
+    const struct tnode *t = zi->by_size;
+    struct mzone *z, *best = NULL;
+
+    while (t) {
+	z = mzone_of(t, by_size);
+	if (z->size >= len) {
+	    best = z;
+	    t = t->left;
+	} else {
+	    t = t->right;
+	}
+    }
+
+    return best;
+}
+
+static void init_zones(struct zone_index *zi)
+{
+    zi->by_addr = zi->by_size = NULL;
+    zi->seed = 1;
+
+    zi->head = new_zone(zi, 0, SMT_UNDEFINED);
+    zi->end = new_zone(zi, 0, SMT_END);	/* Wrap around... */
+
+    zi->head->m.next = &zi->end->m;
+    zi->end->prev = zi->head;
+    zi->by_addr = tnode_insert(NULL, &zi->head->by_addr, addr_less);
+}
+
+static void free_zones(struct zone_index *zi)
+{
+    struct mzone *z, *next;
+
+    for (z = zi->head; z; z = next) {
+	next = mzone_next(z);
+	free(z);
+    }
+    zi->head = NULL;
+}
+
+/*
+ * syslinux_add_memmap(), step for step, on the indexed working map;
+ * the result has to be the same list that would have produced.
+ */
 static void
-add_freelist(struct syslinux_memmap **mmap, addr_t start,
+add_freelist(struct zone_index *zi, addr_t start,
 	     addr_t len, enum syslinux_memmap_types type)
 {
-    if (syslinux_add_memmap(mmap, start, len, type))
-	longjmp(new_movelist_bail, 1);
+    addr_t last;
+    struct mzone *mp, *range, *first;
+    enum syslinux_memmap_types oldtype;
+
+    if (len == 0)
+	return;
+
+    last = start + len - 1;
+
+    /* The first zone at or above start */
+    mp = zone_at(zi, start);
+    if (mp->m.start < start)
+	mp = mzone_next(mp);
+    oldtype = mp->prev ? mp->prev->m.type : SMT_END;
+    first = mp->prev ? mp->prev : mp;
+
+    if (start < mp->m.start || mp->m.type == SMT_END) {
+	if (type != oldtype) {
+	    /* Splice in a new start token */
+	    range = new_zone(zi, start, type);
+	    link_zone(zi, range, mp);
+	}
+    } else {
+	/* mp is exactly aligned with the start of our region */
+	if (type != oldtype) {
+	    /* Reclaim this entry as our own boundary marker */
+	    oldtype = mp->m.type;
+	    mp->m.type = type;
+	    mp = mzone_next(mp);
+	}
+    }
+
+    while (last > mp->m.start - 1) {
+	range = mzone_next(mp);
+	oldtype = mp->m.type;
+	unlink_zone(zi, mp);
+	mp = range;
+    }
+
+    if (last < mp->m.start - 1) {
+	if (oldtype != type) {
+	    /* Need a new end token */
+	    range = new_zone(zi, last + 1, oldtype);
+	    link_zone(zi, range, mp);
+	}
+    } else {
+	if (mp->m.type == type) {
+	    /* Merge this region with the following one */
+	    unlink_zone(zi, mp);
+	}
+    }
+
+    /* Only the zones from first up to the one at last + 1 changed */
+    resize_zone(zi, first);
+    for (mp = mzone_next(first); mp != zi->end; mp = mzone_next(mp)) {
+	resize_zone(zi, mp);
+	if (mp->m.start > last)
+	    break;
+    }
 }
 
 /*
@@ -144,18 +443,37 @@ static void free_movelist(struct syslinux_movelist **parentptr)
 
 /*
  * Scan the freelist looking for a particular chunk of memory.  Returns
- * the memmap chunk containing to the first byte of the region.
+ * the first memmap chunk of the free (or terminal) run the region is in.
  */
-static const struct syslinux_memmap *is_free_zone(const struct syslinux_memmap
-						  *list, addr_t start,
-						  addr_t len)
+static const struct syslinux_memmap *is_free_zone(const struct zone_index *zi,
+						  addr_t start, addr_t len)
 {
+    const struct syslinux_memmap *list;
+    const struct mzone *z;
     addr_t last, llast;
 
-    dprintf("f: 0x%08x bytes at 0x%08x\n", len, start);
+    dprintf("f: 0x%08" PRIxADDR " bytes at 0x%08" PRIxADDR "\n", len, start);
 
     last = start + len - 1;
 
+    if (last >= start) {
+	/* Back up to the start of the run, then walk it forward */
+	z = zone_at(zi, start);
+	if (!valid_terminal_type(z->m.type))
+	    return NULL;
+	while (z->prev && valid_terminal_type(z->prev->m.type))
+	    z = z->prev;
+
+	for (list = &z->m; valid_terminal_type(list->type);
+	     list = list->next) {
+	    if (list->next->start - 1 >= last)
+		return &z->m;
+	}
+	return NULL;
+    }
+
+    /* Empty or wrapping regions: the way it always was */
+    list = &zi->head->m;
     while (list->type != SMT_END) {
 	if (list->start <= start) {
 	    const struct syslinux_memmap *ilist = list;
@@ -179,40 +497,48 @@ static const struct syslinux_memmap *is_free_zone(const struct syslinux_memmap
  * Scan the freelist looking for the smallest chunk of memory which
  * can fit X bytes; returns the length of the block on success.
  */
-static addr_t free_area(const struct syslinux_memmap *mmap,
+static addr_t free_area(const struct zone_index *zi,
 			addr_t len, addr_t * start)
 {
-    const struct syslinux_memmap *best = NULL;
-    const struct syslinux_memmap *s;
-    addr_t slen, best_len = -1;
-
-    for (s = mmap; s->type != SMT_END; s = s->next) {
-	if (s->type != SMT_FREE)
-	    continue;
-	slen = s->next->start - s->start;
-	if (slen >= len) {
-	    if (!best || best_len > slen) {
-		best = s;
-		best_len = slen;
-	    }
-	}
-    }
+    const struct mzone *best = zone_fit(zi, len);
 
     if (best) {
-	*start = best->start;
-	return best_len;
+	*start = best->m.start;
+	return best->size;
     } else {
 	return 0;
     }
 }
 
+/*
+ * Find the largest free chunk, the lowest one of those of that size.
+ * Returns -1 if there is no free memory at all.
+ */
+static int largest_area(const struct zone_index *zi,
+			addr_t * start, addr_t * len)
+{
+    const struct tnode *t = zi->by_size;
+    const struct mzone *best;
+
+    if (!t)
+	return -1;
+
+    while (t->right)
+	t = t->right;
+    best = zone_fit(zi, mzone_of(t, by_size)->size);
+
+    *start = best->m.start;
+    *len = best->size;
+    return 0;
+}
+
 /*
  * Remove a chunk from the freelist
  */
 static void
-allocate_from(struct syslinux_memmap **mmap, addr_t start, addr_t len)
+allocate_from(struct zone_index *zi, addr_t start, addr_t len)
 {
-    syslinux_add_memmap(mmap, start, len, SMT_ALLOC);
+    add_freelist(zi, start, len, SMT_ALLOC);
 }
 
 /*
@@ -238,11 +564,13 @@ static void shuffle_dealias(struct syslinux_movelist **fraglist,
      */
     mpp = fraglist;
     while ((mp = *mpp)) {
-	dprintf("mp -> (%#x,%#x,%#x)\n", mp->dst, mp->src, mp->len);
+	dprintf("mp -> (%#" PRIxADDR ",%#" PRIxADDR ",%#" PRIxADDR ")\n",
+		mp->dst, mp->src, mp->len);
 	ps = mp->src;
 	pe = mp->src + mp->len - 1;
 	for (mx = *fraglist; mx != mp; mx = mx->next) {
-	    dprintf("mx -> (%#x,%#x,%#x)\n", mx->dst, mx->src, mx->len);
+	    dprintf("mx -> (%#" PRIxADDR ",%#" PRIxADDR ",%#" PRIxADDR ")\n",
+		    mx->dst, mx->src, mx->len);
 	    /*
 	     * If there is any overlap between mx and mp, mp should be
 	     * modified and possibly split.
@@ -250,7 +578,8 @@ static void shuffle_dealias(struct syslinux_movelist **fraglist,
 	    xs = mx->src;
 	    xe = mx->src + mx->len - 1;
 
-	    dprintf("?: %#x..%#x (inside %#x..%#x)\n", ps, pe, xs, xe);
+	    dprintf("?: %#" PRIxADDR "..%#" PRIxADDR " (inside %#" PRIxADDR
+		    "..%#" PRIxADDR ")\n", ps, pe, xs, xe);
 
 	    if (pe <= xs || ps >= xe)
 		continue;	/* No overlap */
@@ -282,7 +611,8 @@ static void shuffle_dealias(struct syslinux_movelist **fraglist,
 
 	    assert(ps >= xs && pe <= xe);
 
-	    dprintf("Overlap: %#x..%#x (inside %#x..%#x)\n", ps, pe, xs, xe);
+	    dprintf("Overlap: %#" PRIxADDR "..%#" PRIxADDR
+		    " (inside %#" PRIxADDR "..%#" PRIxADDR ")\n", ps, pe, xs, xe);
 
 	    mp->src = mx->dst + (ps - xs);
 	    mp->next = *postcopy;
@@ -310,7 +640,7 @@ restart:
  */
 static void
 move_chunk(struct syslinux_movelist ***moves,
-	   struct syslinux_memmap **mmap,
+	   struct zone_index *mmap,
 	   struct syslinux_movelist **fp, addr_t copylen)
 {
     addr_t copydst, copysrc;
@@ -335,7 +665,8 @@ move_chunk(struct syslinux_movelist ***moves,
     copydst = f->dst;
     copysrc = f->src;
 
-    dprintf("Q: copylen = 0x%08x, needlen = 0x%08x\n", copylen, needlen);
+    dprintf("Q: copylen = 0x%08" PRIxADDR ", needlen = 0x%08" PRIxADDR "\n",
+	    copylen, needlen);
 
     if (copylen < needlen) {
 	if (reverse) {
@@ -343,7 +674,8 @@ move_chunk(struct syslinux_movelist ***moves,
 	    copysrc += (f->len - copylen);
 	}
 
-	dprintf("X: 0x%08x bytes at 0x%08x -> 0x%08x\n",
+	dprintf("X: 0x%08" PRIxADDR " bytes at 0x%08" PRIxADDR
+		" -> 0x%08" PRIxADDR "\n",
 		copylen, copysrc, copydst);
 
 	/* Didn't get all we wanted, so we have to split the chunk */
@@ -352,7 +684,8 @@ move_chunk(struct syslinux_movelist ***moves,
     }
 
     mv = new_movelist(f->dst, f->src, f->len);
-    dprintf("A: 0x%08x bytes at 0x%08x -> 0x%08x\n", mv->len, mv->src, mv->dst);
+    dprintf("A: 0x%08" PRIxADDR " bytes at 0x%08" PRIxADDR
+	    " -> 0x%08" PRIxADDR "\n", mv->len, mv->src, mv->dst);
     **moves = mv;
     *moves = &mv->next;
 
@@ -368,7 +701,8 @@ move_chunk(struct syslinux_movelist ***moves,
 	freebase = f->dst + f->len;
     }
 
-    dprintf("F: 0x%08x bytes at 0x%08x\n", freelen, freebase);
+    dprintf("F: 0x%08" PRIxADDR " bytes at 0x%08" PRIxADDR "\n",
+	    freelen, freebase);
 
     add_freelist(mmap, freebase, freelen, SMT_FREE);
 
@@ -384,7 +718,7 @@ syslinux_compute_movelist(struct syslinux_movelist **moves,
 			  struct syslinux_movelist *ifrags,
 			  struct syslinux_memmap *memmap)
 {
-    struct syslinux_memmap *mmap = NULL;
+    struct zone_index zones, *mmap = &zones;
     const struct syslinux_memmap *mm, *ep;
     struct syslinux_movelist *frags = NULL;
     struct syslinux_movelist *postcopy = NULL;
@@ -402,18 +736,16 @@ syslinux_compute_movelist(struct syslinux_movelist **moves,
     dprintf("entering syslinux_compute_movelist()...\n");
 
     if (setjmp(new_movelist_bail)) {
-nomem:
 	dprintf("Out of working memory!\n");
 	goto bail;
     }
 
     *moves = NULL;
+    zones.head = NULL;
 
     /* Create our memory map.  Anything that is SMT_FREE or SMT_ZERO is
        fair game, but mark anything used by source material as SMT_ALLOC. */
-    mmap = syslinux_init_memmap();
-    if (!mmap)
-	goto nomem;
+    init_zones(mmap);
 
     frags = dup_movelist(ifrags);
 
@@ -421,17 +753,17 @@ nomem:
     shuffle_dealias(&frags, &postcopy);
 
     for (mm = memmap; mm->type != SMT_END; mm = mm->next)
-	add_freelist(&mmap, mm->start, mm->next->start - mm->start,
+	add_freelist(mmap, mm->start, mm->next->start - mm->start,
 		     mm->type == SMT_ZERO ? SMT_FREE : mm->type);
 
     for (f = frags; f; f = f->next)
-	add_freelist(&mmap, f->src, f->len, SMT_ALLOC);
+	add_freelist(mmap, f->src, f->len, SMT_ALLOC);
 
     /* As long as there are unprocessed fragments in the chain... */
     while ((fp = &frags, f = *fp)) {
 
 	dprintf("Current free list:\n");
-	syslinux_dump_memmap(mmap);
+	syslinux_dump_memmap(&mmap->head->m);
 	dprintf("Current frag list:\n");
 	syslinux_dump_movelist(frags);
 
@@ -472,18 +804,20 @@ nomem:
 
 	    if (is_free_zone(mmap, needbase, needlen)) {
 		fp = op, f = o;
-		dprintf("!: 0x%08x bytes at 0x%08x -> 0x%08x\n",
+		dprintf("!: 0x%08" PRIxADDR " bytes at 0x%08" PRIxADDR
+			" -> 0x%08" PRIxADDR "\n",
 			f->len, f->src, f->dst);
 		copysrc = f->src;
 		copylen = needlen;
-		allocate_from(&mmap, needbase, copylen);
+		allocate_from(mmap, needbase, copylen);
 		goto move_chunk;
 	    }
 	}
 
 	/* Ok, bother.  Need to do real work at least with one chunk. */
 
-	dprintf("@: 0x%08x bytes at 0x%08x -> 0x%08x\n",
+	dprintf("@: 0x%08" PRIxADDR " bytes at 0x%08" PRIxADDR
+		" -> 0x%08" PRIxADDR "\n",
 		f->len, f->src, f->dst);
 
 	/* See if we can move this chunk into place by claiming
@@ -509,8 +843,8 @@ nomem:
 	    cbyte = f->dst;
 	}
 
-	dprintf("need: base = 0x%08x, len = 0x%08x, "
-		"reverse = %d, cbyte = 0x%08x\n",
+	dprintf("need: base = 0x%08" PRIxADDR ", len = 0x%08" PRIxADDR ", "
+		"reverse = %d, cbyte = 0x%08" PRIxADDR "\n",
 		needbase, needlen, reverse, cbyte);
 
 	ep = is_free_zone(mmap, cbyte, 1);
@@ -527,14 +861,15 @@ nomem:
 	if (avail) {
 	    /* We can move at least part of this chunk into place without
 	       further ado */
-	    dprintf("space: start 0x%08x, len 0x%08x, free 0x%08x\n",
+	    dprintf("space: start 0x%08" PRIxADDR ", len 0x%08" PRIxADDR
+		    ", free 0x%08" PRIxADDR "\n",
 		    ep->start, ep_len, avail);
 	    copylen = min(needlen, avail);
 
 	    if (reverse)
-		allocate_from(&mmap, needbase + needlen - copylen, copylen);
+		allocate_from(mmap, needbase + needlen - copylen, copylen);
 	    else
-		allocate_from(&mmap, needbase, copylen);
+		allocate_from(mmap, needbase, copylen);
 
 	    goto move_chunk;
 	}
@@ -545,7 +880,8 @@ nomem:
 	   Then move a chunk of ourselves into place. */
 	for (op = &f->next, o = *op; o; op = &o->next, o = *op) {
 
-	    dprintf("O: 0x%08x bytes at 0x%08x -> 0x%08x\n",
+	    dprintf("O: 0x%08" PRIxADDR " bytes at 0x%08" PRIxADDR
+		    " -> 0x%08" PRIxADDR "\n",
 		    o->len, o->src, o->dst);
 
 	    if (!(o->src <= cbyte && o->src + o->len > cbyte))
@@ -565,7 +901,7 @@ nomem:
 		copylen = o->len;
 	    } else {
 		/* Well, copy as much as we can... */
-		if (syslinux_memmap_largest(mmap, SMT_FREE, &fstart, &flen)) {
+		if (largest_area(mmap, &fstart, &flen)) {
 		    dprintf("No free memory at all!\n");
 		    goto bail;	/* Stuck! */
 		}
@@ -580,7 +916,7 @@ nomem:
 		    copylen = min(flen, o->len - (cbyte - o->src));
 		}
 	    }
-	    allocate_from(&mmap, copydst, copylen);
+	    allocate_from(mmap, copydst, copylen);
 
 	    if (copylen < o->len) {
 		op = split_movelist(copysrc, copylen, op);
@@ -588,7 +924,8 @@ nomem:
 	    }
 
 	    mv = new_movelist(copydst, copysrc, copylen);
-	    dprintf("C: 0x%08x bytes at 0x%08x -> 0x%08x\n",
+	    dprintf("C: 0x%08" PRIxADDR " bytes at 0x%08" PRIxADDR
+		    " -> 0x%08" PRIxADDR "\n",
 		    mv->len, mv->src, mv->dst);
 	    *moves = mv;
 	    moves = &mv->next;
@@ -598,11 +935,11 @@ nomem:
 	    if (copylen > needlen) {
 		/* We don't need all the memory we freed up.  Mark it free. */
 		if (copysrc < needbase) {
-		    add_freelist(&mmap, copysrc, needbase - copysrc, SMT_FREE);
+		    add_freelist(mmap, copysrc, needbase - copysrc, SMT_FREE);
 		    copylen -= (needbase - copysrc);
 		}
 		if (copylen > needlen) {
-		    add_freelist(&mmap, copysrc + needlen, copylen - needlen,
+		    add_freelist(mmap, copysrc + needlen, copylen - needlen,
 				 SMT_FREE);
 		    copylen = needlen;
 		}
@@ -614,7 +951,7 @@ nomem:
 	goto bail;		/* Stuck! */
 
 move_chunk:
-	move_chunk(&moves, &mmap, fp, copylen);
+	move_chunk(&moves, mmap, fp, copylen);
     }
 
     /* Finally, append the postcopy chain to the end of the moves list */
@@ -624,8 +961,8 @@ move_chunk:
 
     rv = 0;
 bail:
-    if (mmap)
-	syslinux_free_memmap(mmap);
+    if (zones.head)
+	free_zones(mmap);
     if (frags)
 	free_movelist(&frags);
     if (postcopy)
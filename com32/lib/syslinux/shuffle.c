@@ -105,7 +105,8 @@ int syslinux_do_shuffle(struct syslinux_movelist *fraglist,
 
     syslinux_free_memmap(rxmap);
 
-    dprintf("desczone = 0x%08x, descfree = 0x%08x\n", desczone, descfree);
+    dprintf("desczone = 0x%08" PRIxADDR ", descfree = 0x%08" PRIxADDR "\n",
+	    desczone, descfree);
 
     rxmap = syslinux_dup_memmap(memmap);
     if (!rxmap)
@@ -165,8 +166,8 @@ int syslinux_do_shuffle(struct syslinux_movelist *fraglist,
     {
 	addr_t descoffs = descaddr - (addr_t) dbuf;
 
-	dprintf("nmoves = %d, nzero = %d, dbuf = %p, offs = 0x%08x\n",
-		nmoves, nzero, dbuf, descoffs);
+	dprintf("nmoves = %d, nzero = %d, dbuf = %p, offs = 0x%08"
+		PRIxADDR "\n", nmoves, nzero, dbuf, descoffs);
     }
 #endif
 
@@ -186,7 +187,7 @@ int syslinux_do_shuffle(struct syslinux_movelist *fraglist,
     for (ml = memmap; ml->type != SMT_END; ml = ml->next) {
 	if (ml->type == SMT_ZERO) {
 	    dp->dst = ml->start;
-	    dp->src = (addr_t) - 1;	/* bzero region */
+	    dp->src = (uint32_t) - 1;	/* bzero region */
 	    dp->len = ml->next->start - ml->start;
 	    dprintf2("[ %08x %08x %08x ]\n", dp->dst, dp->src, dp->len);
 	    dp++;
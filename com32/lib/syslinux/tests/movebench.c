@@ -0,0 +1,350 @@
+/*
+ * movebench.c
+ *
+ * Time syslinux_compute_movelist() on the sort of loads it gets at
+ * boot, and on some it ought to survive, and count what the plan it
+ * comes up with costs: how many moves, and how many bytes they copy.
+ * The plan is also played out on a map of the memory, a page at a
+ * time, and every page checked to have ended up where it belongs.
+ *
+ *   multiboot  - hundreds of modules, loaded low, to be packed in
+ *                behind the kernel over where they were loaded
+ *   e820       - a kernel and an initrd read in 64K pieces into a
+ *                memory map full of small reserved holes
+ *   initrd     - several initrds loaded end to end and each moved up
+ *                by a little more than the one before, so that every
+ *                one lands on top of the next
+ *   reverse    - a region full of chunks to be put back in reverse
+ *                order, with hardly any free memory to do it in
+ *   shuffle    - the same, in a random order
+ *
+ * Not one of the tests: run it, with "make bench", before and after a
+ * change to the planner.
+ */
+
+#include "unittest/unittest.h"
+#include "unittest/memmap.h"
+#include <setjmp.h>
+#include <time.h>
+#include </usr/include/string.h>
+
+#include "../../../include/minmax.h"
+#include "../zonelist.c"
+#include "test-harness.c"
+
+#define PAGE		0x1000
+#define MEM_TOP		0x40000000	/* Nothing goes above 1G */
+#define NPAGES		(MEM_TOP / PAGE)
+
+struct load {
+    const char *name;
+    struct syslinux_memmap *mmap;
+    struct syslinux_movelist *frags;
+    size_t nfrags;
+    addr_t bytes;
+};
+
+static uint32_t rnd_state;
+
+static uint32_t rnd(void)
+{
+    rnd_state = rnd_state * 1103515245 + 12345;
+    return rnd_state >> 8;
+}
+
+/* A number of pages between lo and hi, weighted towards lo */
+static addr_t rnd_pages(addr_t lo, addr_t hi)
+{
+    addr_t span = hi - lo + 1;
+
+    return (lo + (rnd() % span) * (rnd() % span) / span) * PAGE;
+}
+
+static void add_frag(struct load *l, addr_t dst, addr_t src, addr_t len)
+{
+    if (syslinux_add_movelist(&l->frags, dst, src, len)) {
+	fprintf(stderr, "movebench: out of memory\n");
+	exit(1);
+    }
+    l->nfrags++;
+    l->bytes += len;
+}
+
+static void add_mem(struct load *l, addr_t start, addr_t len,
+		    enum syslinux_memmap_types type)
+{
+    if (syslinux_add_memmap(&l->mmap, start, len, type)) {
+	fprintf(stderr, "movebench: out of memory\n");
+	exit(1);
+    }
+}
+
+static void gen_multiboot(struct load *l)
+{
+    addr_t dst = 0x100000, src = 0x1000000, len;
+    int i;
+
+    add_mem(l, 0x100000, MEM_TOP - 0x100000, SMT_FREE);
+
+    /* The kernel, then 300 modules packed in after it */
+    for (i = 0; i <= 300; i++) {
+	len = i ? rnd_pages(1, 256) : 0x400000;
+	add_frag(l, dst, src, len);
+	dst += len;
+	src += len + PAGE;	/* The heap's headers, in between */
+    }
+}
+
+static void gen_e820(struct load *l)
+{
+    static addr_t chunk[(64 << 20) / 0x10000 + (12 << 20) / 0x10000];
+    addr_t a, hole, src, len;
+    addr_t t;
+    int i, j;
+
+    /* Below 32M and above 448M clean; in between, holes every few M */
+    add_mem(l, 0x100000, 0x20000000 - 0x100000, SMT_FREE);
+    for (a = 0x2000000; a < 0x1c000000; a += rnd_pages(512, 2048)) {
+	hole = rnd_pages(1, 64);
+	add_mem(l, a, hole, SMT_RESERVED);
+    }
+
+    /* The pieces go wherever there is room, in a random order */
+    for (i = 0; i < (int)(sizeof chunk / sizeof chunk[0]); i++)
+	chunk[i] = i;
+    for (i = sizeof chunk / sizeof chunk[0] - 1; i > 0; i--) {
+	j = rnd() % (i + 1);
+	t = chunk[i];
+	chunk[i] = chunk[j];
+	chunk[j] = t;
+    }
+
+    src = 0x2000000;
+    for (i = 0; i < (int)(sizeof chunk / sizeof chunk[0]); i++) {
+	len = 0x10000;
+	while (syslinux_memmap_type(l->mmap, src, len) != SMT_FREE)
+	    src += PAGE;
+
+	/* The kernel at 1M, the initrd at the top */
+	if (chunk[i] < (12 << 20) / 0x10000)
+	    add_frag(l, 0x100000 + chunk[i] * len, src, len);
+	else
+	    add_frag(l, 0x1c000000 + (chunk[i] - (12 << 20) / 0x10000) * len,
+		     src, len);
+	src += len + PAGE * (rnd() % 4);
+    }
+}
+
+static void gen_initrd(struct load *l)
+{
+    addr_t src = 0x4000000, shift = 0, len;
+    int i;
+
+    add_mem(l, 0x100000, 0x10000000 - 0x100000, SMT_FREE);
+
+    for (i = 0; i < 8; i++) {
+	len = rnd_pages(1024, 8192);
+	shift += rnd_pages(1, 16);
+	add_frag(l, src + shift, src, len);
+	src += len;
+    }
+}
+
+static void gen_permute(struct load *l, bool shuffle)
+{
+    static int slot[256];
+    const addr_t base = 0x1000000, len = 0x10000;
+    int i, j, t, n = sizeof slot / sizeof slot[0];
+
+    /* The region, and only one chunk's worth of room besides */
+    add_mem(l, base, n * len, SMT_FREE);
+    add_mem(l, 0x100000, len, SMT_FREE);
+
+    for (i = 0; i < n; i++)
+	slot[i] = n - 1 - i;
+    if (shuffle) {
+	for (i = n - 1; i > 0; i--) {
+	    j = rnd() % (i + 1);
+	    t = slot[i];
+	    slot[i] = slot[j];
+	    slot[j] = t;
+	}
+    }
+
+    for (i = 0; i < n; i++)
+	add_frag(l, base + slot[i] * len, base + i * len, len);
+}
+
+static void gen_reverse(struct load *l)
+{
+    gen_permute(l, false);
+}
+
+static void gen_shuffle(struct load *l)
+{
+    gen_permute(l, true);
+}
+
+static const struct workload {
+    const char *name;
+    void (*gen)(struct load *);
+} workloads[] = {
+    { "multiboot",	gen_multiboot },
+    { "e820",		gen_e820 },
+    { "initrd",		gen_initrd },
+    { "reverse",	gen_reverse },
+    { "shuffle",	gen_shuffle },
+};
+
+/*
+ * Play the moves out on a map with a number for every page that is
+ * to be moved, and see that each number ends up where it should.
+ * Returns -1 if it didn't, 1 if the moves aren't all whole pages.
+ */
+static int check_moves(const struct load *l,
+		       const struct syslinux_movelist *moves)
+{
+    static uint32_t page[NPAGES];
+    const struct syslinux_movelist *f, *mv;
+    uint32_t n, id;
+    addr_t i;
+
+    for (mv = moves; mv; mv = mv->next) {
+	if ((mv->dst | mv->src | mv->len) & (PAGE - 1) ||
+	    mv->dst >= MEM_TOP || mv->src >= MEM_TOP ||
+	    mv->len > MEM_TOP - max(mv->dst, mv->src))
+	    return 1;
+    }
+
+    memset(page, 0, sizeof page);
+    for (f = l->frags, id = 1; f; f = f->next) {
+	for (i = 0; i < f->len / PAGE; i++)
+	    page[f->src / PAGE + i] = id++;
+    }
+
+    for (mv = moves; mv; mv = mv->next)
+	memmove(&page[mv->dst / PAGE], &page[mv->src / PAGE],
+		mv->len / PAGE * sizeof page[0]);
+
+    for (f = l->frags, n = 1; f; f = f->next) {
+	for (i = 0; i < f->len / PAGE; i++)
+	    if (page[f->dst / PAGE + i] != n++)
+		return -1;
+    }
+
+    return 0;
+}
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int run(const struct workload *w, int runs)
+{
+    struct load l = { .name = w->name };
+    struct syslinux_movelist *moves = NULL, *mv;
+    uint64_t t0, t1, best = 0;
+    size_t nmoves = 0;
+    uint64_t moved = 0;
+    const char *check;
+    int i, rv = 0;
+
+    l.mmap = syslinux_init_memmap();
+    if (!l.mmap) {
+	fprintf(stderr, "movebench: out of memory\n");
+	exit(1);
+    }
+    rnd_state = 1;
+    w->gen(&l);
+
+    for (i = 0; i < runs; i++) {
+	syslinux_free_movelist(moves);
+	moves = NULL;
+
+	t0 = now_ns();
+	rv = syslinux_compute_movelist(&moves, l.frags, l.mmap);
+	t1 = now_ns();
+
+	if (rv)
+	    break;
+	if (!i || t1 - t0 < best)
+	    best = t1 - t0;
+    }
+
+    if (rv) {
+	printf("%-10s %6zu %8u  FAILED to find a plan\n",
+	       w->name, l.nfrags, l.bytes >> 10);
+	goto out;
+    }
+
+    for (mv = moves; mv; mv = mv->next) {
+	nmoves++;
+	moved += mv->len;
+    }
+
+    switch (check_moves(&l, moves)) {
+    case 0:
+	check = "ok";
+	break;
+    case 1:
+	check = "unchecked";
+	break;
+    default:
+	check = "WRONG";
+	rv = -1;
+	break;
+    }
+
+    printf("%-10s %6zu %8u %6zu %9llu %6.2f %9.1f  %s\n",
+	   w->name, l.nfrags, l.bytes >> 10, nmoves,
+	   (unsigned long long)(moved >> 10),
+	   l.bytes ? (double)moved / l.bytes : 0.0, best / 1000.0, check);
+
+out:
+    syslinux_free_movelist(moves);
+    syslinux_free_movelist(l.frags);
+    syslinux_free_memmap(l.mmap);
+    return rv;
+}
+
+int main(int argc, char **argv)
+{
+    int runs = 5, err = 0;
+    size_t i, j;
+
+    if (argc > 1 && !strcmp(argv[1], "-n") && argc > 2) {
+	runs = atoi(argv[2]);
+	argc -= 2;
+	argv += 2;
+    }
+    if (runs < 1) {
+	fprintf(stderr, "Usage: movebench [-n runs] [workload...]\n");
+	return 1;
+    }
+
+    /*
+     * frags: fragments asked for, and their size in K; moves: the moves
+     * in the plan, and what they copy in K; ratio: bytes copied for each
+     * byte asked for; us: the planner's time, best of the runs
+     */
+    printf("%-10s %6s %8s %6s %9s %6s %9s  %s\n", "load", "frags",
+	   "K", "moves", "moved K", "ratio", "us", "check");
+
+    for (i = 0; i < array_sz(workloads); i++) {
+	if (argc > 1) {
+	    for (j = 1; j < (size_t)argc; j++)
+		if (!strcmp(argv[j], workloads[i].name))
+		    break;
+	    if (j == (size_t)argc)
+		continue;
+	}
+	if (run(&workloads[i], runs))
+	    err = 1;
+    }
+
+    return err;
+}
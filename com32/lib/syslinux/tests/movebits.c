@@ -1,6 +1,7 @@
 #include "unittest/unittest.h"
 #include "unittest/memmap.h"
 #include <setjmp.h>
+#include </usr/include/string.h>
 
 #include "../../../include/minmax.h"
 #include "../zonelist.c"
@@ -77,10 +78,74 @@ bail:
     return rv;
 }
 
+/*
+ * Lots of fragments, to go into a memory map with lots of holes in it;
+ * play the moves out on a copy of the memory and check the result.
+ */
+static int move_many_fragments(void)
+{
+    struct syslinux_memmap *mmap;
+    struct syslinux_movelist *frags = NULL, *moves = NULL, *mv;
+    const addr_t nfrags = 64, fraglen = 0x300, memsize = 0x40000;
+    unsigned char *mem = NULL;
+    addr_t i, j, src, dst;
+    int rv = -1;
+
+    mmap = syslinux_init_memmap();
+    if (!mmap)
+	goto bail;
+
+    /* Every other 1K free below 0x20000, all free from 0x30000 on */
+    for (i = 0; i < 0x20000; i += 0x800)
+	if (syslinux_add_memmap(&mmap, i, 0x400, SMT_FREE))
+	    goto bail;
+    if (syslinux_add_memmap(&mmap, 0x30000, memsize - 0x30000, SMT_FREE))
+	goto bail;
+
+    mem = malloc(memsize);
+    if (!mem)
+	goto bail;
+    memset(mem, 0, memsize);
+
+    /* Loaded high in reverse order, each to go into one of the holes */
+    for (i = 0; i < nfrags; i++) {
+	src = 0x30000 + (nfrags - 1 - i) * fraglen;
+	dst = i * 0x800;
+	for (j = 0; j < fraglen; j++)
+	    mem[src + j] = i + j;
+	if (syslinux_add_movelist(&frags, dst, src, fraglen))
+	    goto bail;
+    }
+
+    rv = syslinux_compute_movelist(&moves, frags, mmap);
+    syslinux_assert(!rv, "Failed to move %u fragments", nfrags);
+    if (rv)
+	goto bail;
+
+    for (mv = moves; mv; mv = mv->next)
+	memmove(mem + mv->dst, mem + mv->src, mv->len);
+
+    for (i = 0; i < nfrags; i++) {
+	for (j = 0; j < fraglen; j++)
+	    if (mem[i * 0x800 + j] != (unsigned char)(i + j))
+		break;
+	syslinux_assert((j == fraglen), "Fragment %u ended up wrong", i);
+    }
+
+    rv = 0;
+bail:
+    free(mem);
+    syslinux_free_movelist(frags);
+    syslinux_free_movelist(moves);
+    syslinux_free_memmap(mmap);
+    return rv;
+}
+
 int main(int argc, char **argv)
 {
     move_to_terminal_region();
     move_to_overlapping_region();
+    move_many_fragments();
 
     return 0;
 }
@@ -0,0 +1,329 @@
+/*
+ * qsortbench.c
+ *
+ * Time com32's qsort() against the combsort it replaced, on the sort
+ * of arrays modules sort at boot, and count the calls to compar each
+ * makes.  Every result is checked to be in order, and, for the keys
+ * that carry a payload, to still hold what it started with.
+ *
+ *   random     - 4-byte ints, uniformly random
+ *   sorted     - already in order, as a readdir() of a FAT often is
+ *   reverse    - in reverse order
+ *   dups       - 4-byte ints with only 16 different values
+ *   pipe       - ascending, then descending
+ *   pointers   - strings, by pointer, as ls.c32 sorts names
+ *   ids        - 8-byte PCI vendor:device ids
+ *   records    - 12-byte records with a 4-byte key, so no fast swap
+ *
+ * Not one of the tests: run it, with "make qsortbench", before and
+ * after a change to qsort().
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include </usr/include/string.h>
+
+/* What the library has that the host's doesn't */
+static void memswap(void *m1, void *m2, size_t n)
+{
+    char *p = m1, *q = m2, tmp;
+
+    while (n--) {
+	tmp = *p;
+	*p++ = *q;
+	*q++ = tmp;
+    }
+}
+
+#define qsort com32_qsort
+#include "../../qsort.c"
+#undef qsort
+
+/* The old qsort(), for comparison */
+static inline size_t newgap(size_t gap)
+{
+    gap = (gap * 10) / 13;
+    if (gap == 9 || gap == 10)
+	gap = 11;
+
+    if (gap < 1)
+	gap = 1;
+    return gap;
+}
+
+static void combsort(void *base, size_t nmemb, size_t size,
+		     int (*compar) (const void *, const void *))
+{
+    size_t gap = nmemb;
+    size_t i, j;
+    char *p1, *p2;
+    int swapped;
+
+    if (!nmemb)
+	return;
+
+    do {
+	gap = newgap(gap);
+	swapped = 0;
+
+	for (i = 0, p1 = base; i < nmemb - gap; i++, p1 += size) {
+	    j = i + gap;
+	    if (compar(p1, p2 = (char *)base + j * size) > 0) {
+		memswap(p1, p2, size);
+		swapped = 1;
+	    }
+	}
+    } while (gap > 1 || swapped);
+}
+
+struct record {
+    uint32_t key;
+    uint32_t payload[2];
+};
+
+static unsigned long ncompares;
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+    ncompares++;
+    return x < y ? -1 : x > y;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    ncompares++;
+    return x < y ? -1 : x > y;
+}
+
+static int cmp_str(const void *a, const void *b)
+{
+    ncompares++;
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static int cmp_record(const void *a, const void *b)
+{
+    return cmp_u32(&((const struct record *)a)->key,
+		   &((const struct record *)b)->key);
+}
+
+static uint32_t rnd_state;
+
+static uint32_t rnd(void)
+{
+    rnd_state = rnd_state * 1103515245 + 12345;
+    return rnd_state >> 8;
+}
+
+struct workload {
+    const char *name;
+    size_t size;
+    int (*compar) (const void *, const void *);
+    void (*gen)(void *, size_t);
+};
+
+static void gen_random(void *v, size_t n)
+{
+    uint32_t *a = v;
+    size_t i;
+
+    for (i = 0; i < n; i++)
+	a[i] = rnd();
+}
+
+static void gen_sorted(void *v, size_t n)
+{
+    uint32_t *a = v;
+    size_t i;
+
+    for (i = 0; i < n; i++)
+	a[i] = i;
+}
+
+static void gen_reverse(void *v, size_t n)
+{
+    uint32_t *a = v;
+    size_t i;
+
+    for (i = 0; i < n; i++)
+	a[i] = n - i;
+}
+
+static void gen_dups(void *v, size_t n)
+{
+    uint32_t *a = v;
+    size_t i;
+
+    for (i = 0; i < n; i++)
+	a[i] = rnd() & 15;
+}
+
+static void gen_pipe(void *v, size_t n)
+{
+    uint32_t *a = v;
+    size_t i;
+
+    for (i = 0; i < n; i++)
+	a[i] = i < n / 2 ? i : n - i;
+}
+
+static void gen_pointers(void *v, size_t n)
+{
+    static char (*names)[16];
+    char **a = v;
+    size_t i;
+
+    free(names);
+    names = malloc(n * sizeof *names);
+    if (!names) {
+	fprintf(stderr, "qsortbench: out of memory\n");
+	exit(1);
+    }
+    for (i = 0; i < n; i++) {
+	snprintf(names[i], sizeof names[i], "file%08x.c32", rnd());
+	a[i] = names[i];
+    }
+}
+
+static void gen_ids(void *v, size_t n)
+{
+    uint64_t *a = v;
+    size_t i;
+
+    for (i = 0; i < n; i++)
+	a[i] = (uint64_t)(rnd() & 0xffff) << 32 | (rnd() & 0xffff);
+}
+
+static void gen_records(void *v, size_t n)
+{
+    struct record *a = v;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+	a[i].key = rnd() & 0xfff;
+	a[i].payload[0] = a[i].key * 3;
+	a[i].payload[1] = ~a[i].key;
+    }
+}
+
+static const struct workload workloads[] = {
+    { "random",   4, cmp_u32,    gen_random },
+    { "sorted",   4, cmp_u32,    gen_sorted },
+    { "reverse",  4, cmp_u32,    gen_reverse },
+    { "dups",     4, cmp_u32,    gen_dups },
+    { "pipe",     4, cmp_u32,    gen_pipe },
+    { "pointers", sizeof(char *), cmp_str, gen_pointers },
+    { "ids",      8, cmp_u64,    gen_ids },
+    { "records",  sizeof(struct record), cmp_record, gen_records },
+    { NULL, 0, NULL, NULL }
+};
+
+static int check(const struct workload *w, const char *a, size_t n)
+{
+    const struct record *r;
+    size_t i;
+
+    for (i = 1; i < n; i++) {
+	if (w->compar(a + (i - 1) * w->size, a + i * w->size) > 0)
+	    return -1;
+    }
+
+    if (w->gen == gen_records) {
+	for (i = 0, r = (const void *)a; i < n; i++, r++) {
+	    if (r->payload[0] != r->key * 3 || r->payload[1] != ~r->key)
+		return -1;
+	}
+    }
+
+    return 0;
+}
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Best time of runs, in ns; the compares of one run in *cmps */
+static uint64_t run(const struct workload *w, size_t n, int runs,
+		    void (*sort)(void *, size_t, size_t,
+				 int (*)(const void *, const void *)),
+		    unsigned long *cmps, int *bad)
+{
+    char *a = malloc(n * w->size);
+    uint64_t t0, t1, best = 0;
+    int i;
+
+    if (!a) {
+	fprintf(stderr, "qsortbench: out of memory\n");
+	exit(1);
+    }
+
+    for (i = 0; i < runs; i++) {
+	rnd_state = 1;
+	w->gen(a, n);
+
+	ncompares = 0;
+	t0 = now_ns();
+	sort(a, n, w->size, w->compar);
+	t1 = now_ns();
+
+	if (!i || t1 - t0 < best)
+	    best = t1 - t0;
+	*cmps = ncompares;
+	if (check(w, a, n))
+	    *bad = 1;
+    }
+
+    free(a);
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    const struct workload *w;
+    size_t n = 10000;
+    int runs = 5;
+    int opt, bad = 0, wbad;
+    unsigned long cold, cnew;
+    uint64_t told, tnew;
+
+    while ((opt = getopt(argc, argv, "n:r:")) != -1) {
+	switch (opt) {
+	case 'n':
+	    n = strtoul(optarg, NULL, 0);
+	    break;
+	case 'r':
+	    runs = atoi(optarg);
+	    break;
+	default:
+	    fprintf(stderr, "Usage: qsortbench [-n elements] [-r runs]\n");
+	    return 1;
+	}
+    }
+
+    printf("%zu elements, best of %d runs\n", n, runs);
+    printf("%-10s %10s %10s %12s %12s  %s\n", "load", "comb us",
+	   "intro us", "comb cmps", "intro cmps", "check");
+
+    for (w = workloads; w->name; w++) {
+	wbad = 0;
+	told = run(w, n, runs, combsort, &cold, &wbad);
+	tnew = run(w, n, runs, com32_qsort, &cnew, &wbad);
+	printf("%-10s %10.1f %10.1f %12lu %12lu  %s\n", w->name,
+	       told / 1000.0, tnew / 1000.0, cold, cnew,
+	       wbad ? "WRONG" : "ok");
+	bad |= wbad;
+    }
+
+    return bad;
+}
@@ -1,14 +1,122 @@
 /*
  * vdprintf.c
+ *
+ * With DEBUG_PORT, the output goes into the log ring once dmesg_init()
+ * has set it up, and from there to the serial port while the core is
+ * idle; see <syslinux/dmesg.h>.  Before that, it is written straight
+ * to the port, as it is when the ring can't be had.
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
 #include <unistd.h>
 #include <inttypes.h>
 #include <sys/io.h>
 #include <sys/cpu.h>
+#include <syslinux/clock.h>
+#include <syslinux/dmesg.h>
+
+#define DMESG_SIZE	65536	/* Of the ring; a power of two */
+#define DMESG_HDR	sizeof(struct dmesg_record)
+
+/*
+ * Offsets run freely and are taken modulo DMESG_SIZE; the records from
+ * first to next are whole.  Records are only ever dropped from the
+ * front, to make room for new ones.
+ */
+static struct {
+    char *buf;
+    uint32_t first;		/* The oldest record */
+    uint32_t next;		/* Where the next one goes */
+    uint32_t drain;		/* The record the serial port is on */
+    uint32_t drained;		/* Bytes of its text already sent */
+    uint32_t lost;		/* Records dropped */
+} dmesg;
+
+static void ring_put(uint32_t off, const void *src, uint32_t len)
+{
+    uint32_t at = off & (DMESG_SIZE - 1);
+    uint32_t n = DMESG_SIZE - at;
+
+    if (n > len)
+	n = len;
+    memcpy(dmesg.buf + at, src, n);
+    memcpy(dmesg.buf, (const char *)src + n, len - n);
+}
+
+static void ring_get(uint32_t off, void *dst, uint32_t len)
+{
+    uint32_t at = off & (DMESG_SIZE - 1);
+    uint32_t n = DMESG_SIZE - at;
+
+    if (n > len)
+	n = len;
+    memcpy(dst, dmesg.buf + at, n);
+    memcpy((char *)dst + n, dmesg.buf, len - n);
+}
+
+int dmesg_read(uint32_t *pos, uint64_t *ns, char *text, size_t size)
+{
+    struct dmesg_record rec;
+    irq_state_t irq;
+    int rv = -1;
+
+    irq = irq_save();
+
+    if (!dmesg.buf)
+	goto out;
+
+    if ((int32_t)(*pos - dmesg.first) < 0 ||
+	(int32_t)(dmesg.next - *pos) < 0)
+	*pos = dmesg.first;	/* Overwritten, or not ours */
+    if (*pos == dmesg.next)
+	goto out;
+
+    ring_get(*pos, &rec, DMESG_HDR);
+    if (size > rec.len)
+	size = rec.len;
+    ring_get(*pos + DMESG_HDR, text, size);
+
+    *ns = rec.ns;
+    *pos += DMESG_HDR + rec.len;
+    rv = size;
+
+out:
+    irq_restore(irq);
+    return rv;
+}
+
+uint32_t dmesg_lost(void)
+{
+    return dmesg.lost;
+}
+
+void *dmesg_snapshot(size_t *len)
+{
+    struct dmesg_setup *s;
+    irq_state_t irq;
+    uint32_t used;
+
+    if (!dmesg.buf)
+	return NULL;
+
+    /* Records that come while we allocate just miss the copy */
+    s = malloc(sizeof *s + DMESG_SIZE);
+    if (!s)
+	return NULL;
+
+    irq = irq_save();
+    used = dmesg.next - dmesg.first;
+    s->version = DMESG_VERSION;
+    s->lost = dmesg.lost;
+    ring_get(dmesg.first, s + 1, used);
+    irq_restore(irq);
+
+    *len = sizeof *s + used;
+    return s;
+}
 
 #ifdef DEBUG_PORT
 
@@ -30,6 +138,8 @@ enum serial_port_regs {
 };
 
 static const uint16_t debug_base = DEBUG_PORT;
+static bool debug_fifo;		/* THRE means 16 bytes of room */
+static bool debug_cr;		/* The \r of a \n has gone out */
 
 static void debug_putc(char c)
 {
@@ -41,21 +151,12 @@ static void debug_putc(char c)
     outb(c, debug_base + THR);
 }
 
-void vdprintf(const char *format, va_list ap)
+/* Returns true if there is a port to write to */
+static bool debug_port_init(void)
 {
-    int rv;
-    char buffer[BUFFER_SIZE];
-    char *p;
     static bool debug_init = false;
     static bool debug_ok   = false;
 
-    rv = vsnprintf(buffer, BUFFER_SIZE, format, ap);
-    if (rv < 0)
-	return;
-
-    if (rv > BUFFER_SIZE - 1)
-	rv = BUFFER_SIZE - 1;
-
     /*
      * This unconditionally outputs to a serial port at 0x3f8 regardless of
      * if one is enabled or not (this means we don't have to enable the real
@@ -76,7 +177,7 @@ void vdprintf(const char *format, va_list ap)
 	dll = inb(debug_base + DLL);
 	dlm = inb(debug_base + DLM);
 	lcr = inb(debug_base + LCR);
-	
+
 	outb(0x03, debug_base + LCR);
 	(void)inb(debug_base + IER);	/* Synchronize */
 
@@ -87,7 +188,7 @@ void vdprintf(const char *format, va_list ap)
 
 	if (dll != 0x01 || dlm != 0x00 || lcr != 0x83) {
 	    /* No serial port present */
-	    return;
+	    return false;
 	}
 
 	outb(0x01, debug_base + FCR);
@@ -95,12 +196,121 @@ void vdprintf(const char *format, va_list ap)
 	if (inb(debug_base + IIR) < 0xc0) {
 	    outb(0x00, debug_base + FCR); /* Disable non-functional FIFOs */
 	    (void)inb(debug_base + IER);	/* Synchronize */
+	} else {
+	    debug_fifo = true;
 	}
 
 	debug_ok = true;
     }
 
-    if (!debug_ok)
+    return debug_ok;
+}
+
+/* Make room for len more bytes of record */
+static void dmesg_make_room(uint32_t len)
+{
+    struct dmesg_record rec;
+
+    while (dmesg.next + len - dmesg.first > DMESG_SIZE) {
+	ring_get(dmesg.first, &rec, DMESG_HDR);
+	if (dmesg.drain == dmesg.first) {
+	    dmesg.drain += DMESG_HDR + rec.len;
+	    dmesg.drained = 0;
+	}
+	dmesg.first += DMESG_HDR + rec.len;
+	dmesg.lost++;
+    }
+}
+
+static void dmesg_append(const char *text, uint32_t len)
+{
+    struct dmesg_record rec;
+    irq_state_t irq;
+
+    rec.ns = clock_ns();
+    rec.len = len;
+
+    irq = irq_save();
+    dmesg_make_room(DMESG_HDR + len);
+    ring_put(dmesg.next, &rec, DMESG_HDR);
+    ring_put(dmesg.next + DMESG_HDR, text, len);
+    dmesg.next += DMESG_HDR + len;
+    irq_restore(irq);
+}
+
+void dmesg_init(void)
+{
+    dmesg.buf = malloc(DMESG_SIZE);
+}
+
+/*
+ * Hand the port as much of the log as it has room for, without waiting.
+ * Returns nonzero if there is still some left.
+ */
+int dmesg_drain(void)
+{
+    struct dmesg_record rec;
+    irq_state_t irq;
+    int room = 0, pending;
+    char c;
+
+    if (!dmesg.buf || !debug_port_init())
+	return 0;
+
+    irq = irq_save();
+
+    while (dmesg.drain != dmesg.next) {
+	ring_get(dmesg.drain, &rec, DMESG_HDR);
+	if (dmesg.drained == rec.len) {
+	    dmesg.drain += DMESG_HDR + rec.len;
+	    dmesg.drained = 0;
+	    continue;
+	}
+
+	if (!room) {
+	    if (!(inb(debug_base + LSR) & 0x20))
+		break;
+	    room = debug_fifo ? 16 : 1;
+	}
+	room--;
+
+	ring_get(dmesg.drain + DMESG_HDR + dmesg.drained, &c, 1);
+	if (c == '\n' && !debug_cr) {
+	    outb('\r', debug_base + THR);
+	    debug_cr = true;
+	    continue;
+	}
+	debug_cr = false;
+
+	outb(c, debug_base + THR);
+	dmesg.drained++;
+    }
+
+    pending = dmesg.drain != dmesg.next;
+    irq_restore(irq);
+
+    return pending;
+}
+
+void vdprintf(const char *format, va_list ap)
+{
+    int rv;
+    char buffer[BUFFER_SIZE];
+    char *p;
+
+    rv = vsnprintf(buffer, BUFFER_SIZE, format, ap);
+    if (rv < 0)
+	return;
+
+    if (rv > BUFFER_SIZE - 1)
+	rv = BUFFER_SIZE - 1;
+
+    if (dmesg.buf) {
+	dmesg_append(buffer, rv);
+	return;
+    }
+
+    if (!debug_port_init())
 	return;
 
     p = buffer;
@@ -108,4 +318,16 @@ void vdprintf(const char *format, va_list ap)
 	debug_putc(*p++);
 }
 
+#else
+
+/* No log without a port to drain it to */
+void dmesg_init(void)
+{
+}
+
+int dmesg_drain(void)
+{
+    return 0;
+}
+
 #endif /* DEBUG_PORT */
@@ -29,6 +29,77 @@
 #  define PUP(a) *++(a)
 #endif
 
+#define FAST_MARGIN (INFLATE_FAST_MIN_INPUT - 1)
+
+#ifdef INFLATE_FAST_WIDE
+#  define HOLD_BITS (8 * (unsigned)sizeof(unsigned long))
+
+/* Top up hold to at least HOLD_BITS - 8 bits with one unaligned load.
+   Input bits beyond those counted in bits may land in hold as well;
+   they are the ones the next refill puts there anyway, which is why
+   all refills below OR into hold instead of adding. */
+#  define REFILL() do { \
+        unsigned long w_; \
+        __builtin_memcpy(&w_, in + OFF, sizeof w_); \
+        hold |= w_ << bits; \
+        in += (HOLD_BITS - 1 - bits) >> 3; \
+        bits |= (HOLD_BITS - 1) & ~7U; \
+    } while (0)
+
+/* Copy a match of len bytes from dist back, 8 bytes at a time when a
+   chunk that size doesn't overlap what it is being copied to.  The last
+   chunk may run up to 7 bytes past the match, if that is still before
+   limit; the bytes past out are free to be scribbled on until then.
+   That reads past the match source too, so it is only for matches
+   copied from the output itself. */
+local unsigned char FAR *copy_match OF((unsigned char FAR *out,
+    unsigned char FAR *from, unsigned len, unsigned dist,
+    unsigned char FAR *limit));
+
+local unsigned char FAR *copy_match(out, from, len, dist, limit)
+unsigned char FAR *out;
+unsigned char FAR *from;
+unsigned len;
+unsigned dist;
+unsigned char FAR *limit;
+{
+    unsigned n;
+
+    if (dist >= 8) {
+        if (out + ((len + 7) & ~7U) <= limit) {
+            for (n = 0; n < len; n += 8)
+                __builtin_memcpy(out + OFF + n, from + OFF + n, 8);
+            return out + len;
+        }
+        while (len >= 8) {
+            __builtin_memcpy(out + OFF, from + OFF, 8);
+            out += 8;
+            from += 8;
+            len -= 8;
+        }
+    }
+    while (len > 2) {
+        PUP(out) = PUP(from);
+        PUP(out) = PUP(from);
+        PUP(out) = PUP(from);
+        len -= 3;
+    }
+    if (len) {
+        PUP(out) = PUP(from);
+        if (len > 1)
+            PUP(out) = PUP(from);
+    }
+    return out;
+}
+#else
+#  define REFILL() do { \
+        hold |= (unsigned long)(PUP(in)) << bits; \
+        bits += 8; \
+        hold |= (unsigned long)(PUP(in)) << bits; \
+        bits += 8; \
+    } while (0)
+#endif
+
 /*
    Decode literal, length, and distance codes and write out the resulting
    literal and match bytes until either not enough input or output is
@@ -40,7 +111,7 @@
    Entry assumptions:
 
         state->mode == LEN
-        strm->avail_in >= 6
+        strm->avail_in >= INFLATE_FAST_MIN_INPUT
         strm->avail_out >= 258
         start >= strm->avail_out
         state->bits < 8
@@ -57,7 +128,8 @@
       length code, 5 bits for the length extra, 15 bits for the distance code,
       and 13 bits for the distance extra.  This totals 48 bits, or six bytes.
       Therefore if strm->avail_in >= 6, then there is enough input to avoid
-      checking for available input while decoding.
+      checking for available input while decoding.  The word-at-a-time
+      refill of INFLATE_FAST_WIDE reads ahead, and needs some more.
 
     - The maximum bytes that a single length/distance pair can output is 258
       bytes, which is the maximum length that can be coded.  inflate_fast()
@@ -97,7 +169,7 @@ unsigned start;         /* inflate()'s starting value for strm->avail_out */
     /* copy state to local variables */
     state = (struct inflate_state FAR *)strm->state;
     in = strm->next_in - OFF;
-    last = in + (strm->avail_in - 5);
+    last = in + (strm->avail_in - FAST_MARGIN);
     out = strm->next_out - OFF;
     beg = out - (start - strm->avail_out);
     end = out + (strm->avail_out - 257);
@@ -118,12 +190,8 @@ unsigned start;         /* inflate()'s starting value for strm->avail_out */
     /* decode literals and length/distances until end-of-block or not enough
        input data or output space */
     do {
-        if (bits < 15) {
-            hold += (unsigned long)(PUP(in)) << bits;
-            bits += 8;
-            hold += (unsigned long)(PUP(in)) << bits;
-            bits += 8;
-        }
+        if (bits < 15)
+            REFILL();
         here = lcode[hold & lmask];
       dolen:
         op = (unsigned)(here.bits);
@@ -141,7 +209,7 @@ unsigned start;         /* inflate()'s starting value for strm->avail_out */
             op &= 15;                           /* number of extra bits */
             if (op) {
                 if (bits < op) {
-                    hold += (unsigned long)(PUP(in)) << bits;
+                    hold |= (unsigned long)(PUP(in)) << bits;
                     bits += 8;
                 }
                 len += (unsigned)hold & ((1U << op) - 1);
@@ -149,12 +217,8 @@ unsigned start;         /* inflate()'s starting value for strm->avail_out */
                 bits -= op;
             }
             Tracevv((stderr, "inflate:         length %u\n", len));
-            if (bits < 15) {
-                hold += (unsigned long)(PUP(in)) << bits;
-                bits += 8;
-                hold += (unsigned long)(PUP(in)) << bits;
-                bits += 8;
-            }
+            if (bits < 15)
+                REFILL();
             here = dcode[hold & dmask];
           dodist:
             op = (unsigned)(here.bits);
@@ -165,10 +229,10 @@ unsigned start;         /* inflate()'s starting value for strm->avail_out */
                 dist = (unsigned)(here.val);
                 op &= 15;                       /* number of extra bits */
                 if (bits < op) {
-                    hold += (unsigned long)(PUP(in)) << bits;
+                    hold |= (unsigned long)(PUP(in)) << bits;
                     bits += 8;
                     if (bits < op) {
-                        hold += (unsigned long)(PUP(in)) << bits;
+                        hold |= (unsigned long)(PUP(in)) << bits;
                         bits += 8;
                     }
                 }
@@ -253,6 +317,9 @@ unsigned start;         /* inflate()'s starting value for strm->avail_out */
                             from = out - dist;  /* rest from output */
                         }
                     }
+#ifdef INFLATE_FAST_WIDE
+                    out = copy_match(out, from, len, dist, out);
+#else
                     while (len > 2) {
                         PUP(out) = PUP(from);
                         PUP(out) = PUP(from);
@@ -264,9 +331,13 @@ unsigned start;         /* inflate()'s starting value for strm->avail_out */
                         if (len > 1)
                             PUP(out) = PUP(from);
                     }
+#endif
                 }
                 else {
                     from = out - dist;          /* copy direct from output */
+#ifdef INFLATE_FAST_WIDE
+                    out = copy_match(out, from, len, dist, end + 256 + OFF);
+#else
                     do {                        /* minimum length is three */
                         PUP(out) = PUP(from);
                         PUP(out) = PUP(from);
@@ -278,6 +349,7 @@ unsigned start;         /* inflate()'s starting value for strm->avail_out */
                         if (len > 1)
                             PUP(out) = PUP(from);
                     }
+#endif
                 }
             }
             else if ((op & 64) == 0) {          /* 2nd level distance code */
@@ -315,7 +387,8 @@ unsigned start;         /* inflate()'s starting value for strm->avail_out */
     /* update state and return */
     strm->next_in = in + OFF;
     strm->next_out = out + OFF;
-    strm->avail_in = (unsigned)(in < last ? 5 + (last - in) : 5 - (in - last));
+    strm->avail_in = (unsigned)(in < last ? FAST_MARGIN + (last - in) :
+                                FAST_MARGIN - (in - last));
     strm->avail_out = (unsigned)(out < end ?
                                  257 + (end - out) : 257 - (out - end));
     state->hold = hold;
@@ -8,4 +8,14 @@
    subject to change. Applications should only use zlib.h.
  */
 
+/* On x86 the bit buffer is refilled a whole word at a time, with an
+   unaligned load, and longer matches are copied 8 bytes at a time; the
+   word load may look ahead, so more input has to be there up front. */
+#if defined(__i386__) || defined(__x86_64__)
+#  define INFLATE_FAST_WIDE
+#  define INFLATE_FAST_MIN_INPUT 24
+#else
+#  define INFLATE_FAST_MIN_INPUT 6
+#endif
+
 void ZLIB_INTERNAL inflate_fast OF((z_streamp strm, unsigned start));
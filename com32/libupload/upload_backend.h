@@ -24,6 +24,17 @@ struct upload_backend {
 
     int (*write)(struct upload_backend *);
 
+    /*
+     * Backends that can take the output a piece at a time set these
+     * instead of write; the compressed data then goes out as it is
+     * produced, rather than being gathered in memory first.
+     */
+    int (*open)(struct upload_backend *);
+    int (*send)(struct upload_backend *, const void *, size_t);
+    int (*close)(struct upload_backend *);
+    void *priv;
+    int err;			/* First error from send, or 0 */
+
     z_stream zstream;
     char *outbuf;
     size_t alloc;
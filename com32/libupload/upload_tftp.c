@@ -33,15 +33,22 @@ const char *tftp_string_error_message[]={
 
 static bool have_real_network(void);
 
-static int upload_tftp_write(struct upload_backend *be) {
+static void upload_tftp_error(int err)
+{
+    printf("upload_tftp: TFTP server returned error %d : %s\n",
+	   err, tftp_string_error_message[err]);
+}
+
+static int upload_tftp_open(struct upload_backend *be)
+{
     struct url_info url;
-    struct inode inode;
+    struct tftp_put *put;
     char url_path[255];
     int err;
 
     if (!have_real_network()) {
 	dprintf("\nNot running from the network\n");
-	return -TFTP_ERR_NO_NETWORK;
+	return TFTP_ERR_NO_NETWORK;
     }
 
     if (!strncmp(be->argv[0], "tftp://", 7))
@@ -56,13 +63,38 @@ static int upload_tftp_write(struct upload_backend *be) {
 	return err;
 
     dprintf("Connecting to %s to send %s\n", url.host, url.path);
-    err = -tftp_put(&url, 0, &inode, NULL, be->outbuf, be->zbytes);
+    err = -tftp_put_open(&url, &put);
+    if (err != TFTP_ERR_OK) {
+	upload_tftp_error(err);
+	return err;
+    }
+
+    be->priv = put;
+    return 0;
+}
+
+static int upload_tftp_send(struct upload_backend *be, const void *data,
+			    size_t len)
+{
+    int err = -tftp_put_write(be->priv, data, len);
 
     if (err != TFTP_ERR_OK) {
-	printf("upload_tftp_write: TFTP server returned error %d : %s\n",
-	       err, tftp_string_error_message[err]);
+	upload_tftp_error(err);
+	return err;
     }
 
+    return 0;
+}
+
+/* Returns TFTP_ERR_OK on success, like tftp_put() did */
+static int upload_tftp_close(struct upload_backend *be)
+{
+    int err = -tftp_put_close(be->priv);
+
+    be->priv = NULL;
+    if (err != TFTP_ERR_OK && !be->err)
+	upload_tftp_error(err);	/* Else upload_tftp_send() reported it */
+
     return err;
 }
 
@@ -70,37 +102,44 @@ struct upload_backend upload_tftp = {
     .name       = "tftp",
     .helpmsg    = "filename [tftp_server]",
     .minargs    = 1,
-    .write      = upload_tftp_write,
+    .open       = upload_tftp_open,
+    .send       = upload_tftp_send,
+    .close      = upload_tftp_close,
 };
 
 /*
  * Dummy functions to prevent link failure for non-network cores
  */
-static int _dummy_tftp_put(struct url_info *url, int flags,
-			   struct inode *inode, const char **redir,
-			   char *data, int data_length)
+static int _dummy_tftp_put_open(struct url_info *url, struct tftp_put **putp)
 {
     (void)url;
-    (void)flags;
-    (void)inode;
-    (void)redir;
-    (void)data;
-    (void)data_length;
+    (void)putp;
 
     return -TFTP_ERR_NO_NETWORK;
 }
 
-__weak int __attribute__((alias("_dummy_tftp_put")))
-tftp_put(struct url_info *url, int flags, struct inode *inode,
-	 const char **redir, char *data, int data_length);
-
-static int _dummy_tftp_put(struct url_info *url, int flags,
-			   struct inode *inode, const char **redir,
-			   char *data, int data_length);
+__weak int __attribute__((alias("_dummy_tftp_put_open")))
+tftp_put_open(struct url_info *url, struct tftp_put **putp);
 
 static bool have_real_network(void)
 {
-    return tftp_put != _dummy_tftp_put;
+    return tftp_put_open != _dummy_tftp_put_open;
+}
+
+__weak int tftp_put_write(struct tftp_put *put, const void *data, size_t len)
+{
+    (void)put;
+    (void)data;
+    (void)len;
+
+    return -TFTP_ERR_NO_NETWORK;
+}
+
+__weak int tftp_put_close(struct tftp_put *put)
+{
+    (void)put;
+
+    return -TFTP_ERR_NO_NETWORK;
 }
 
 __weak int url_set_ip(struct url_info *ui)
@@ -25,14 +25,48 @@ int init_data(struct upload_backend *be, const char *argv[])
     be->zstream.avail_out = be->alloc  = 0;
     be->dbytes = be->zbytes = 0;
 
+    be->err = 0;
+
     /* Initialize a gzip data stream */
     if (deflateInit2(&be->zstream, 9, Z_DEFLATED,
 		     16+15, 9, Z_DEFAULT_STRATEGY) < 0)
 	return -1;
 
+    if (be->send) {
+	/* One chunk of output at a time, sent whenever it fills */
+	be->outbuf = malloc(ALLOC_CHUNK);
+	if (!be->outbuf) {
+	    be->err = -1;
+	    return -1;
+	}
+	be->zstream.next_out = (void *)be->outbuf;
+	be->zstream.avail_out = be->alloc = ALLOC_CHUNK;
+
+	if ((be->err = be->open(be)) != 0) {
+	    free(be->outbuf);
+	    be->outbuf = NULL;
+	    be->zstream.next_out = NULL;
+	    be->zstream.avail_out = be->alloc = 0;
+	    return -1;
+	}
+    }
+
     return 0;
 }
 
+/* Send what is in the output buffer and start it over */
+static int send_data(struct upload_backend *be)
+{
+    if (be->zbytes && !be->err)
+	be->err = be->send(be, be->outbuf, be->zbytes);
+
+    be->zbytes = 0;
+    be->zstream.next_out = (void *)be->outbuf;
+    be->zstream.avail_out = be->alloc;
+
+    return be->err ? Z_ERRNO : Z_OK;
+}
+
 static int do_deflate(struct upload_backend *be, int flush)
 {
     int rv;
@@ -44,6 +78,12 @@ static int do_deflate(struct upload_backend *be, int flush)
 	if (be->zstream.avail_out)
 	    return rv;		   /* Not an issue of output space... */
 
+	if (be->send) {
+	    if (send_data(be) != Z_OK)
+		return Z_ERRNO;
+	    continue;
+	}
+
 	buf = realloc(be->outbuf, be->alloc + ALLOC_CHUNK);
 	if (!buf)
 	    return Z_MEM_ERROR;
@@ -59,6 +99,9 @@ int write_data(struct upload_backend *be, const void *buf, size_t len)
 {
     int rv = Z_OK;
 
+    if (be->err)
+	return -1;		/* The upload has already failed */
+
     be->zstream.next_in = (void *)buf;
     be->zstream.avail_in = len;
 
@@ -83,18 +126,27 @@ int flush_data(struct upload_backend *be)
     while (rv != Z_STREAM_END) {
 	rv = do_deflate(be, Z_FINISH);
 	if (rv < 0)
-	    return -1;
+	    break;
     }
 
 //    printf("Uploading data, %u bytes... ", be->zbytes);
 
-    if ((err=be->write(be)) != 0)
-	return err;
+    if (be->send) {
+	if (be->outbuf) {	/* Else it never opened */
+	    send_data(be);
+	    err = be->close(be);
+	}
+	if (be->err)
+	    err = be->err;
+    } else if (rv == Z_STREAM_END) {
+	err = be->write(be);
+    }
 
+    deflateEnd(&be->zstream);
     free(be->outbuf);
     be->outbuf = NULL;
     be->dbytes = be->zbytes = be->alloc = 0;
 
 //    printf("done.\n");
-    return 0;
+    return err;
 }
@@ -0,0 +1,22 @@
+#ifndef LIBUTIL_SHA256_H
+#define LIBUTIL_SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Structure to save state of computation between the single steps.  */
+struct sha256_ctx {
+    uint32_t H[8];
+
+    uint32_t total[2];
+    uint32_t buflen;
+    char buffer[128];		/* NB: always correctly aligned for uint32_t.  */
+};
+
+typedef struct sha256_ctx SHA256_CTX;
+
+void SHA256Init(SHA256_CTX *ctx);
+void SHA256Update(SHA256_CTX *ctx, const void *data, size_t len);
+void SHA256Final(unsigned char digest[32], SHA256_CTX *ctx);
+
+#endif /* LIBUTIL_SHA256_H */
@@ -0,0 +1,29 @@
+#ifndef LIBUTIL_SHANI_H
+#define LIBUTIL_SHANI_H
+
+/*
+ * SHA-1 and SHA-256 block functions using the x86 SHA extensions.
+ * Only call them if sha_ni_usable() says the CPU has them.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if (defined(__i386__) || defined(__x86_64__)) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+# define HAVE_SHA_NI 1
+#endif
+
+#ifdef HAVE_SHA_NI
+int sha_ni_usable(void);
+void sha1_blocks_ni(uint32_t state[5], const void *data, size_t nblocks);
+void sha256_blocks_ni(uint32_t state[8], const void *data, size_t nblocks,
+		      const uint32_t K[64]);
+#else
+static inline int sha_ni_usable(void)
+{
+    return 0;
+}
+#endif
+
+#endif /* LIBUTIL_SHANI_H */
@@ -82,6 +82,7 @@ A million repetitions of "a"
 #include <netinet/in.h>		/* For htonl/ntohl/htons/ntohs */
 
 #include "sha1.h"
+#include "shani.h"
 
 #define rol(value, bits) (((value) << (bits)) | ((value) >> (32 - (bits))))
 
@@ -120,6 +121,12 @@ void SHA1Transform(uint32_t state[5], const unsigned char buffer[64])
 	uint32_t l[16];
     } CHAR64LONG16;
     CHAR64LONG16 *block;
+#ifdef HAVE_SHA_NI
+    if (sha_ni_usable()) {
+	sha1_blocks_ni(state, buffer, 1);
+	return;
+    }
+#endif
 #ifdef SHA1HANDSOFF
     static unsigned char workspace[64];
     block = (CHAR64LONG16 *) workspace;
@@ -254,6 +261,14 @@ void SHA1Update(SHA1_CTX * context, const unsigned char *data, uint32_t len)
     if ((j + len) > 63) {
 	memcpy(&context->buffer[j], data, (i = 64 - j));
 	SHA1Transform(context->state, context->buffer);
+#ifdef HAVE_SHA_NI
+	if (sha_ni_usable() && i + 63 < len) {
+	    uint32_t n = (len - i) >> 6;
+
+	    sha1_blocks_ni(context->state, &data[i], n);
+	    i += n << 6;
+	}
+#endif
 	for (; i + 63 < len; i += 64) {
 	    SHA1Transform(context->state, &data[i]);
 	}
@@ -14,19 +14,12 @@
 #include <sys/types.h>
 
 #include "xcrypt.h"
+#include "sha256.h"
+#include "shani.h"
 
 #define MIN(x,y) min(x,y)
 #define MAX(x,y) max(x,y)
 
-/* Structure to save state of computation between the single steps.  */
-struct sha256_ctx {
-    uint32_t H[8];
-
-    uint32_t total[2];
-    uint32_t buflen;
-    char buffer[128];		/* NB: always correctly aligned for uint32_t.  */
-};
-
 #if __BYTE_ORDER == __LITTLE_ENDIAN
 # define SWAP(n) \
     (((n) << 24) | (((n) & 0xff00) << 8) | (((n) >> 8) & 0xff00) | ((n) >> 24))
@@ -82,6 +75,13 @@ sha256_process_block(const void *buffer, size_t len, struct sha256_ctx *ctx)
     if (ctx->total[0] < len)
 	++ctx->total[1];
 
+#ifdef HAVE_SHA_NI
+    if (sha_ni_usable()) {
+	sha256_blocks_ni(ctx->H, buffer, len / 64, K);
+	return;
+    }
+#endif
+
     /* Process all bytes in the buffer with 64 bytes in each round of
        the loop.  */
     while (nwords > 0) {
@@ -268,6 +268,22 @@ sha256_process_bytes(const void *buffer, size_t len, struct sha256_ctx *ctx)
     }
 }
 
+void SHA256Init(SHA256_CTX *ctx)
+{
+    sha256_init_ctx(ctx);
+}
+
+void SHA256Update(SHA256_CTX *ctx, const void *data, size_t len)
+{
+    sha256_process_bytes(data, len, ctx);
+}
+
+void SHA256Final(unsigned char digest[32], SHA256_CTX *ctx)
+{
+    sha256_finish_ctx(ctx, digest);
+    memset(ctx, 0, sizeof *ctx);
+}
+
 /* Define our magic string to mark salt for SHA256 "encryption"
    replacement.  */
 static const char sha256_salt_prefix[] = "$5$";
@@ -0,0 +1,220 @@
+/*
+ * shani.c
+ *
+ * SHA-1 and SHA-256 using the SHA extensions (SHA-NI), which do
+ * several rounds per instruction.  The plain C versions in
+ * sha1hash.c and sha256crypt.c call these when sha_ni_usable().
+ *
+ * This is built for i386, so each function enables the instruction
+ * sets it needs for itself.  Under COM32 SSE is only switched on while
+ * the block functions run; see <sys/fpu.h>.
+ */
+
+#include <shani.h>
+
+#ifdef HAVE_SHA_NI
+
+#include <stdint.h>
+#include <immintrin.h>
+#ifdef __COM32__
+#include <sys/cpu.h>
+#include <sys/fpu.h>
+#else
+static inline void cpuid_count(uint32_t op, uint32_t cnt,
+			       uint32_t *eax, uint32_t *ebx,
+			       uint32_t *ecx, uint32_t *edx)
+{
+    asm volatile("cpuid"
+		 : "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx)
+		 : "a" (op), "c" (cnt));
+}
+#endif
+
+#define SHA_NI_TARGET	__attribute__((target("sha,sse4.1,ssse3")))
+
+/* Feature bits in CPUID leaf 1 ECX and leaf 7 EBX */
+#define CPUID1_ECX_SSSE3	(1U << 9)
+#define CPUID1_ECX_SSE4_1	(1U << 19)
+#define CPUID7_EBX_SHA		(1U << 29)
+
+static int sha_ni = -1;		/* -1 = not probed yet */
+
+static int sha_ni_probe(void)
+{
+    uint32_t eax, ebx, ecx, edx;
+    const uint32_t need1 = CPUID1_ECX_SSSE3 | CPUID1_ECX_SSE4_1;
+
+#ifdef __COM32__
+    /* This also checks that there is a CPUID instruction at all */
+    if (!x86_has_sse())
+	return 0;
+#endif
+
+    cpuid_count(0, 0, &eax, &ebx, &ecx, &edx);
+    if (eax < 7)
+	return 0;
+
+    cpuid_count(1, 0, &eax, &ebx, &ecx, &edx);
+    if ((ecx & need1) != need1)
+	return 0;
+
+    cpuid_count(7, 0, &eax, &ebx, &ecx, &edx);
+    if (!(ebx & CPUID7_EBX_SHA))
+	return 0;
+
+    return 1;
+}
+
+int sha_ni_usable(void)
+{
+    if (__builtin_expect(sha_ni < 0, 0))
+	sha_ni = sha_ni_probe();
+
+    return sha_ni;
+}
+
+SHA_NI_TARGET __attribute__((noinline))
+static void sha1_blocks_sse(uint32_t state[5], const void *data,
+			    size_t nblocks)
+{
+    const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL,
+					0x08090a0b0c0d0e0fULL);
+    const __m128i *p = data;
+    __m128i abcd, abcd_save, e, e_save, e_prev, m[4];
+    int g;
+
+    abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0x1b);
+    e = _mm_set_epi32(state[4], 0, 0, 0);
+
+    while (nblocks--) {
+	abcd_save = abcd;
+	e_save = e;
+
+	/*
+	 * 20 groups of four rounds.  m[] holds the last four words of
+	 * the message schedule; each group finishes one word that the
+	 * next one needs and starts on the ones after that.
+	 */
+	for (g = 0; g < 20; g++) {
+	    if (g < 4)
+		m[g] = _mm_shuffle_epi8(_mm_loadu_si128(p++), mask);
+
+	    if (g == 0)
+		e = _mm_add_epi32(e, m[0]);
+	    else
+		e = _mm_sha1nexte_epu32(e_prev, m[g & 3]);
+	    e_prev = abcd;
+
+	    switch (g / 5) {
+	    case 0:
+		abcd = _mm_sha1rnds4_epu32(abcd, e, 0);
+		break;
+	    case 1:
+		abcd = _mm_sha1rnds4_epu32(abcd, e, 1);
+		break;
+	    case 2:
+		abcd = _mm_sha1rnds4_epu32(abcd, e, 2);
+		break;
+	    default:
+		abcd = _mm_sha1rnds4_epu32(abcd, e, 3);
+		break;
+	    }
+
+	    if (g >= 3 && g <= 18)
+		m[(g + 1) & 3] = _mm_sha1msg2_epu32(m[(g + 1) & 3], m[g & 3]);
+	    if (g >= 1 && g <= 16)
+		m[(g - 1) & 3] = _mm_sha1msg1_epu32(m[(g - 1) & 3], m[g & 3]);
+	    if (g >= 2 && g <= 17)
+		m[(g - 2) & 3] = _mm_xor_si128(m[(g - 2) & 3], m[g & 3]);
+	}
+
+	e = _mm_sha1nexte_epu32(e_prev, e_save);
+	abcd = _mm_add_epi32(abcd, abcd_save);
+    }
+
+    _mm_storeu_si128((__m128i *)state, _mm_shuffle_epi32(abcd, 0x1b));
+    state[4] = _mm_extract_epi32(e, 3);
+}
+
+SHA_NI_TARGET __attribute__((noinline))
+static void sha256_blocks_sse(uint32_t state[8], const void *data,
+			      size_t nblocks, const uint32_t K[64])
+{
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+					0x0405060700010203ULL);
+    const __m128i *p = data;
+    __m128i abef, cdgh, abef_save, cdgh_save, tmp, msg, m[4];
+    int g;
+
+    /* The state goes in as ABEF and CDGH */
+    tmp  = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]),
+			     0xb1);
+    cdgh = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]),
+			     0x1b);
+    abef = _mm_alignr_epi8(tmp, cdgh, 8);
+    cdgh = _mm_blend_epi16(cdgh, tmp, 0xf0);
+
+    while (nblocks--) {
+	abef_save = abef;
+	cdgh_save = cdgh;
+
+	/* 16 groups of four rounds, with the schedule as for SHA-1 */
+	for (g = 0; g < 16; g++) {
+	    if (g < 4) {
+		m[g] = _mm_shuffle_epi8(_mm_loadu_si128(p++), mask);
+	    } else {
+		tmp = _mm_alignr_epi8(m[(g + 3) & 3], m[(g + 2) & 3], 4);
+		tmp = _mm_add_epi32(_mm_sha256msg1_epu32(m[g & 3],
+							 m[(g + 1) & 3]), tmp);
+		m[g & 3] = _mm_sha256msg2_epu32(tmp, m[(g + 3) & 3]);
+	    }
+
+	    msg = _mm_add_epi32(m[g & 3],
+				_mm_loadu_si128((const __m128i *)&K[g * 4]));
+	    cdgh = _mm_sha256rnds2_epu32(cdgh, abef, msg);
+	    msg = _mm_shuffle_epi32(msg, 0x0e);
+	    abef = _mm_sha256rnds2_epu32(abef, cdgh, msg);
+	}
+
+	abef = _mm_add_epi32(abef, abef_save);
+	cdgh = _mm_add_epi32(cdgh, cdgh_save);
+    }
+
+    tmp  = _mm_shuffle_epi32(abef, 0x1b);
+    cdgh = _mm_shuffle_epi32(cdgh, 0xb1);
+    _mm_storeu_si128((__m128i *)&state[0], _mm_blend_epi16(tmp, cdgh, 0xf0));
+    _mm_storeu_si128((__m128i *)&state[4], _mm_alignr_epi8(cdgh, tmp, 8));
+}
+
+/*
+ * The SSE code lives in functions of its own, so that the compiler
+ * can't touch an XMM register before SSE is switched on.
+ */
+void sha1_blocks_ni(uint32_t state[5], const void *data, size_t nblocks)
+{
+#ifdef __COM32__
+    struct x86_sse_state sse;
+
+    x86_sse_begin(&sse);
+    sha1_blocks_sse(state, data, nblocks);
+    x86_sse_end(&sse);
+#else
+    sha1_blocks_sse(state, data, nblocks);
+#endif
+}
+
+void sha256_blocks_ni(uint32_t state[8], const void *data, size_t nblocks,
+		      const uint32_t K[64])
+{
+#ifdef __COM32__
+    struct x86_sse_state sse;
+
+    x86_sse_begin(&sse);
+    sha256_blocks_sse(state, data, nblocks, K);
+    x86_sse_end(&sse);
+#else
+    sha256_blocks_sse(state, data, nblocks, K);
+#endif
+}
+
+#endif /* HAVE_SHA_NI */
@@ -575,6 +575,7 @@ static int f_seek (lua_State *L) {
     return 1;
   }
 }
+#endif
 
 
 static int f_setvbuf (lua_State *L) {
@@ -586,7 +587,6 @@ static int f_setvbuf (lua_State *L) {
   int res = setvbuf(f, NULL, mode[op], sz);
   return luaL_fileresult(L, res == 0, NULL);
 }
-#endif
 
 
 
@@ -631,8 +631,8 @@ static const luaL_Reg flib[] = {
   {"read", f_read},
 #ifndef SYSLINUX
   {"seek", f_seek},
-  {"setvbuf", f_setvbuf},
 #endif
+  {"setvbuf", f_setvbuf},
   {"write", f_write},
   {"__gc", f_gc},
   {"__tostring", f_tostring},
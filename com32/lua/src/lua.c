@@ -7,6 +7,10 @@
 
 #ifdef SYSLINUX
 #include <console.h>
+#include <stdint.h>
+#include <zlib.h>
+#include <syslinux/loadfile.h>
+#include <syslinux/probecache.h>
 #define signal(x,y)
 #else
 #include <signal.h>
@@ -330,6 +334,144 @@ static void dotty (lua_State *L) {
 }
 
 
+#ifdef SYSLINUX
+/*
+** Scripts compiled in this boot session are kept in the core's probe
+** cache, as a list of records each holding the script's name, length
+** and CRC and its bytecode.  Running the same script again, from a
+** menu say, then skips the parser.  Precompiled scripts (luac output
+** for this Lua and number format) load directly and are not cached.
+*/
+
+#define CHUNK_CACHE_MAX		(1 << 20)
+
+struct chunk_rec {
+  size_t size;		/* of the whole record */
+  size_t srclen;
+  uint32_t crc;
+  size_t namelen;
+  size_t codelen;
+  /* followed by the name and the bytecode */
+};
+
+
+static const struct chunk_rec *chunk_find (const char *name, size_t srclen,
+                                           uint32_t crc) {
+  const char *p, *end;
+  const struct chunk_rec *r;
+  size_t len, namelen = strlen(name);
+  if ((p = probe_cache_get(PROBE_LUA_CHUNKS, &len)) == NULL)
+    return NULL;
+  end = p + len;
+  while ((size_t)(end - p) >= sizeof(*r)) {
+    r = (const struct chunk_rec *)p;
+    if (r->size < sizeof(*r) || r->size > (size_t)(end - p))
+      break;  /* not ours */
+    if (r->srclen == srclen && r->crc == crc && r->namelen == namelen &&
+        memcmp(r + 1, name, namelen) == 0)
+      return r;
+    p += r->size;
+  }
+  return NULL;
+}
+
+
+static int chunk_writer (lua_State *L, const void *b, size_t size, void *B) {
+  (void)L;
+  luaL_addlstring((luaL_Buffer *) B, (const char *)b, size);
+  return 0;
+}
+
+
+/* add the function on top of the stack to the cache */
+static void chunk_store (lua_State *L, const char *name, size_t srclen,
+                         uint32_t crc) {
+  int top = lua_gettop(L);
+  luaL_Buffer b;
+  struct chunk_rec *r;
+  const char *old, *code;
+  size_t oldlen = 0, codelen, namelen = strlen(name), size;
+  char *buf;
+  luaL_buffinit(L, &b);
+  if (lua_dump(L, chunk_writer, &b) != 0)
+    goto out;
+  luaL_pushresult(&b);
+  code = lua_tolstring(L, -1, &codelen);
+  size = (sizeof(*r) + namelen + codelen + sizeof(size_t) - 1) &
+         ~(sizeof(size_t) - 1);
+  if (size > CHUNK_CACHE_MAX)
+    goto out;
+  old = probe_cache_get(PROBE_LUA_CHUNKS, &oldlen);
+  if (old == NULL || oldlen + size > CHUNK_CACHE_MAX)
+    oldlen = 0;  /* start over */
+  if ((buf = malloc(oldlen + size)) == NULL)
+    goto out;
+  if (oldlen)
+    memcpy(buf, old, oldlen);
+  r = (struct chunk_rec *)(buf + oldlen);
+  r->size = size;
+  r->srclen = srclen;
+  r->crc = crc;
+  r->namelen = namelen;
+  r->codelen = codelen;
+  memcpy(r + 1, name, namelen);
+  memcpy((char *)(r + 1) + namelen, code, codelen);
+  probe_cache_put(PROBE_LUA_CHUNKS, buf, oldlen + size);
+  free(buf);
+out:
+  lua_settop(L, top);
+}
+
+
+/* luaL_loadfile, but reusing what this session already compiled */
+static int load_script (lua_State *L, const char *fname) {
+  const struct chunk_rec *r;
+  const char *s, *nl;
+  void *data;
+  size_t len;
+  uint32_t crc;
+  int status;
+  if (fname == NULL)
+    return luaL_loadfile(L, NULL);  /* stdin */
+  if (loadfile(fname, &data, &len)) {
+    lua_pushfstring(L, "cannot open %s", fname);
+    return LUA_ERRFILE;
+  }
+  s = data;
+  if (len && *s == '#') {  /* skip first line, but keep its newline */
+    if ((nl = memchr(s, '\n', len)) == NULL)
+      nl = s + len;
+    len -= nl - s;
+    s = nl;
+  }
+  lua_pushfstring(L, "@%s", fname);
+  if (len && *s == LUA_SIGNATURE[0]) {  /* precompiled */
+    status = luaL_loadbufferx(L, s, len, lua_tostring(L, -1), "b");
+  }
+  else {
+    crc = crc32(crc32(0, NULL, 0), (const Bytef *)s, len);
+    r = chunk_find(fname, len, crc);
+    if (r != NULL) {
+      status = luaL_loadbufferx(L, (const char *)(r + 1) + r->namelen,
+                                r->codelen, lua_tostring(L, -1), "b");
+      if (status != LUA_OK)
+        lua_pop(L, 1);  /* cached copy unusable; compile it again */
+    }
+    if (r == NULL || status != LUA_OK) {
+      status = luaL_loadbufferx(L, s, len, lua_tostring(L, -1), "t");
+      if (status == LUA_OK)
+        chunk_store(L, fname, len, crc);
+    }
+  }
+  lua_remove(L, -2);  /* chunk name */
+  free(data);
+  return status;
+}
+#else
+#define load_script	luaL_loadfile
+#endif
+
+
 static int handle_script (lua_State *L, char **argv, int n) {
   int status;
   const char *fname;
@@ -338,7 +480,7 @@ static int handle_script (lua_State *L, char **argv, int n) {
   fname = argv[n];
   if (strcmp(fname, "-") == 0 && strcmp(argv[n-1], "--") != 0)
     fname = NULL;  /* stdin */
-  status = luaL_loadfile(L, fname);
+  status = load_script(L, fname);
   lua_insert(L, -(narg+1));
   if (status == LUA_OK)
     status = docall(L, narg, LUA_MULTRET);
@@ -30,6 +30,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <syslinux/boot.h>
+#include <fs.h>
 
 #define lnetlib_c		/* Define the library */
 
@@ -251,6 +252,21 @@ static int sl_loadfile(lua_State * L)
     return 1;
 }
 
+/*
+ * Start the given files on their way in the background, where the
+ * filesystem can do that (lpxelinux); a later loadfile(), boot_linux()
+ * or initramfs load of one of them gets it from memory, waiting for
+ * it if it is still coming in.
+ */
+static int sl_prefetch(lua_State * L)
+{
+    int i, n = lua_gettop(L);
+
+    for (i = 1; i <= n; i++)
+	prefetch_file(luaL_checkstring(L, i));
+    return 0;
+}
+
 static int sl_unloadfile (lua_State *L)
 {
     syslinux_file *file = luaL_checkudata (L, 1, SYSLINUX_FILE);
@@ -445,6 +461,7 @@ static const luaL_Reg syslinuxlib[] = {
     {"sleep", sl_sleep},
     {"msleep", sl_msleep},
     {"loadfile", sl_loadfile},
+    {"prefetch", sl_prefetch},
     {"initramfs", sl_initramfs_init},
     {"boot_it", sl_boot_it},
     {"config_file", sl_config_file},
@@ -52,14 +52,23 @@ addr_t map_data(const void *data, size_t len, size_t align, int flags)
     addr_t start = (flags & MAP_HIGH) ? mboot_high_water_mark : 0x2000;
     addr_t pad = (flags & MAP_NOPAD) ? 0 : -len & (align - 1);
     addr_t xlen = len + pad;
+    addr_t here = (addr_t) data;
 
-    if (syslinux_memmap_find_type(amap, SMT_FREE, &start, &xlen, align) ||
-	syslinux_add_memmap(&amap, start, len + pad, SMT_ALLOC) ||
+    /*
+     * MAP_INPLACE: the data was read in where it may as well stay.  If
+     * that is free target memory, and high enough, take it as it is;
+     * the shuffle then has nothing to move.
+     */
+    if ((flags & MAP_INPLACE) && !(here & (align - 1)) && here >= start &&
+	syslinux_memmap_type(amap, here, len + pad) == SMT_FREE)
+	start = here;
+    else if (syslinux_memmap_find_type(amap, SMT_FREE, &start, &xlen, align))
+	goto fail;
+
+    if (syslinux_add_memmap(&amap, start, len + pad, SMT_ALLOC) ||
 	syslinux_add_movelist(&ml, start, (addr_t) data, len) ||
-	(pad && syslinux_add_memmap(&mmap, start + len, pad, SMT_ZERO))) {
-	printf("Cannot map %zu bytes\n", len + pad);
-	return 0;
-    }
+	(pad && syslinux_add_memmap(&mmap, start + len, pad, SMT_ZERO)))
+	goto fail;
 
     dprintf("Mapping 0x%08zx bytes (%#x pad) at 0x%08x\n", len, pad, start);
 
@@ -67,6 +76,10 @@ addr_t map_data(const void *data, size_t len, size_t align, int flags)
 	mboot_high_water_mark = start + len + pad;
 
     return start;
+
+fail:
+    printf("Cannot map %zu bytes\n", len + pad);
+    return 0;
 }
 
 addr_t map_string(const char *string)
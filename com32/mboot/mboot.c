@@ -42,8 +42,85 @@ struct module_data {
     void *data;
     size_t len;
     const char *cmdline;
+    const char *path;		/* Not read in yet */
 };
 
+#define MODULE_ALIGN	4096
+
+static int read_module(struct module_data *mp, void *dst)
+{
+    FILE *f;
+    size_t n;
+
+    printf("Loading %s... ", mp->path);
+    f = fopen(mp->path, "r");
+    if (!f)
+	goto fail;
+
+    n = fread(dst, 1, mp->len, f);
+    fclose(f);
+    if (n != mp->len)
+	goto fail;		/* The file changed size on us */
+
+    printf("ok\n");
+    mp->data = dst;
+    mp->path = NULL;
+    return 0;
+
+fail:
+    printf("failed!\n");
+    return -1;
+}
+
+/*
+ * Read in the modules get_modules() left in their files.  They go
+ * into one block, as high up as it fits, laid out the way
+ * map_modules() is going to map them, so that they can stay where they
+ * are; the modules that had to be decompressed are copied in between
+ * them to keep the order.  If there isn't the room for that, each gets
+ * a buffer of its own and is moved into place at boot time.
+ */
+static int load_modules(struct module_data *modules, int nmodules)
+{
+    char *base, *dst;
+    size_t size = 0;
+    int i;
+
+    for (i = 0; i < nmodules; i++) {
+	if (modules[i].path)
+	    break;
+    }
+    if (i == nmodules)
+	return 0;		/* Nothing to do */
+
+    for (i = 0; i < nmodules; i++)
+	size += (modules[i].len + MODULE_ALIGN - 1) & ~(MODULE_ALIGN - 1);
+
+    dst = base = malloc_high(size, MODULE_ALIGN, ~(size_t)0);
+
+    for (i = 0; i < nmodules; i++) {
+	struct module_data *mp = &modules[i];
+	void *buf;
+
+	if (mp->path) {
+	    buf = base ? dst : malloc(mp->len);
+	    if (!buf) {
+		error("Out of memory!\n");
+		return -1;
+	    }
+	    if (read_module(mp, buf))
+		return -1;
+	} else if (base) {
+	    memcpy(dst, mp->data, mp->len);
+	    free(mp->data);
+	    mp->data = dst;
+	}
+	dst += (mp->len + MODULE_ALIGN - 1) & ~(MODULE_ALIGN - 1);
+    }
+
+    return 0;
+}
+
 static int map_modules(struct module_data *modules, int nmodules)
 {
     struct mod_list *mod_list;
@@ -51,6 +128,9 @@ static int map_modules(struct module_data *modules, int nmodules)
     size_t list_size = nmodules * sizeof *mod_list;
     int i;
 
+    if (load_modules(modules, nmodules))
+	return -1;
+
     mod_list = malloc(list_size);
     if (!mod_list) {
 	printf("Failed to allocate module list\n");
@@ -71,7 +151,8 @@ static int map_modules(struct module_data *modules, int nmodules)
 
 	cmd_map = map_string(modules[i].cmdline);
 
-	mod_map = map_data(modules[i].data, modules[i].len, 4096, MAP_HIGH);
+	mod_map = map_data(modules[i].data, modules[i].len, MODULE_ALIGN,
+			   MAP_HIGH | MAP_INPLACE);
 	if (!mod_map) {
 	    printf("Failed to map module (memory fragmentation issue?)\n");
 	    return -1;
@@ -92,14 +173,21 @@ static int get_modules(char **argv, struct module_data **mdp)
 {
     char **argp, **argx;
     struct module_data *mp;
+    FILE *f;
+    struct stat st;
     int rv;
     int module_count = 1;
     int arglen;
     const char module_separator[] = "---";
 
+    /* Let the filesystem fetch them all at once, if it can */
+    prefetch_file(argv[0]);
     for (argp = argv; *argp; argp++) {
-	if (!strcmp(*argp, module_separator))
+	if (!strcmp(*argp, module_separator)) {
 	    module_count++;
+	    if (argp[1] && strcmp(argp[1], module_separator))
+		prefetch_file(argp[1]);
+	}
     }
 
     *mdp = mp = malloc(module_count * sizeof(struct module_data));
@@ -110,16 +198,32 @@ static int get_modules(char **argv, struct module_data **mdp)
 
     argp = argv;
     while (*argp) {
-	/* Note: it seems Grub transparently decompresses all compressed files,
-	   not just the primary kernel. */
-	printf("Loading %s... ", *argp);
-	rv = zloadfile(*argp, &mp->data, &mp->len);
-
-	if (rv) {
-	    printf("failed!\n");
-	    return -1;
+	/*
+	 * Note: it seems Grub transparently decompresses all compressed files,
+	 * not just the primary kernel.  Modules that don't need it are only
+	 * looked at here; load_modules() reads them in later, once it is
+	 * known where they go.
+	 */
+	f = zfopen(*argp, "r");
+	if (f && mp != *mdp && !fstat(fileno(f), &st) &&
+	    S_ISREG(st.st_mode) && st.st_size) {
+	    mp->data = NULL;
+	    mp->len = st.st_size;
+	    mp->path = *argp;
+	    fclose(f);
+	} else {
+	    printf("Loading %s... ", *argp);
+	    rv = f ? floadfile(f, &mp->data, &mp->len, NULL, 0) : -1;
+	    if (f)
+		fclose(f);
+
+	    if (rv) {
+		printf("failed!\n");
+		return -1;
+	    }
+	    printf("ok\n");
+	    mp->path = NULL;
 	}
-	printf("ok\n");
 
 	/* 
 	 * Note: Grub includes the kernel filename in the command line, so we
@@ -48,8 +48,10 @@
 #include <elf.h>
 #include <sys/elf64.h>
 #include <console.h>
+#include <fs.h>
 
 #include <syslinux/loadfile.h>
+#include <syslinux/zio.h>
 #include <syslinux/movebits.h>
 #include <syslinux/bootpm.h>
 #include <syslinux/config.h>
@@ -73,6 +75,7 @@ extern struct my_options {
 /* map.c */
 #define MAP_HIGH	1
 #define MAP_NOPAD	2
+#define MAP_INPLACE	4
 addr_t map_data(const void *data, size_t len, size_t align, int flags);
 addr_t map_string(const char *string);
 struct multiboot_header *map_image(void *ptr, size_t len);
@@ -29,8 +29,11 @@
 #include <limits.h>
 #include <com32.h>
 #include <core.h>
+#include <fs.h>
+#include <sys/module.h>
 #include <syslinux/adv.h>
 #include <syslinux/boot.h>
+#include <syslinux/boottime.h>
 
 #include "menu.h"
 
@@ -297,21 +300,29 @@ static int ask_passwd(const char *menu_entry)
     return rv;
 }
 
-static void draw_menu(int sel, int top, int edit_line)
+/* The rows the scrollbar covers with top at the top; 0 if there isn't one */
+static void scrollbar(int top, int *sbtop, int *sbbot)
 {
-    int x, y;
-    int sbtop = 0, sbbot = 0;
-    const char *tabmsg;
-    int tabmsg_len;
+    *sbtop = *sbbot = 0;
 
     if (cm->nentries > MENU_ROWS) {
 	int sblen = max(MENU_ROWS * MENU_ROWS / cm->nentries, 1);
-	sbtop = ((MENU_ROWS - sblen + 1) * top /
+	*sbtop = ((MENU_ROWS - sblen + 1) * top /
 	    (cm->nentries - MENU_ROWS + 1)) + VSHIFT;
-	sbbot = sbtop + sblen - 1;
-	sbtop += 4;
-	sbbot += 4;		/* Starting row of scrollbar */
+	*sbbot = *sbtop + sblen - 1;
+	*sbtop += 4;
+	*sbbot += 4;		/* Starting row of scrollbar */
     }
+}
+
+static void draw_menu(int sel, int top, int edit_line)
+{
+    int x, y;
+    int sbtop, sbbot;
+    const char *tabmsg;
+    int tabmsg_len;
+
+    scrollbar(top, &sbtop, &sbbot);
 
     printf("\033[%d;%dH\1#1\016l", VSHIFT + 1, HSHIFT + MARGIN + 1);
     for (x = 2 + HSHIFT; x <= (WIDTH - 2 * MARGIN - 1) + HSHIFT; x++)
@@ -346,8 +357,26 @@ static void draw_menu(int sel, int top, int edit_line)
     printf("\1#0\033[%d;1H", END_ROW);
 }
 
+/*
+ * Scroll the menu from where draw_menu() left it at prev_top: only the
+ * rows, which all show other entries now, and the scrollbar.  The frame,
+ * title and [Tab] message stay as they are.
+ */
+static void draw_rows(int sel, int top)
+{
+    int y, sbtop, sbbot;
+
+    scrollbar(top, &sbtop, &sbbot);
+    for (y = 4 + VSHIFT; y < 4 + VSHIFT + MENU_ROWS; y++)
+	draw_row(y, sel, top, sbtop, sbbot);
+    printf("\1#0\033[%d;1H", END_ROW);
+}
+
+static void forget_timeout_message(void);
+
 static void clear_screen(void)
 {
+    forget_timeout_message();
     fputs("\033e\033%@\033)0\033(B\1#0\033[?25l\033[2J", stdout);
 }
 
@@ -610,10 +639,65 @@ static const char *edit_cmdline(const char *input, int top)
     }
 }
 
+/* The timeout message as it is on the screen */
+static struct {
+    int row;			/* -1 if it isn't there as far as we know */
+    int len;			/* Visible characters */
+    char buf[256];
+} timeout_shown = { -1, 0, "" };
+
+static void forget_timeout_message(void)
+{
+    timeout_shown.row = -1;
+}
+
+/*
+ * Where buf and the message on the screen differ, as an offset in each,
+ * and how far along the line the difference starts; the attribute code
+ * it runs under in *attr.  Both have the same number of visible
+ * characters, so only the countdown itself has changed, as a rule.
+ */
+static int timeout_message_diff(const char *buf, int *col, const char **attr,
+				 int *end)
+{
+    const char *old = timeout_shown.buf;
+    int i = 0, j, n;
+
+    *col = 0;
+    *attr = "\2#14";
+    while (buf[i] && buf[i] == old[i]) {
+	if (buf[i] == '\2' && !strncmp(buf + i, old + i, 4)) {
+	    *attr = buf + i;
+	    i += 4;
+	} else if (buf[i] == '\2') {
+	    break;		/* A code that has changed */
+	} else {
+	    i++;
+	    ++*col;
+	}
+    }
+
+    if (!buf[i] && !old[i])
+	return -1;		/* Nothing to do */
+
+    /* What is the same at the end can stay, too */
+    n = strlen(buf);
+    *end = n;
+    if ((int)strlen(old) == n) {
+	for (j = n; j > i && buf[j - 1] == old[j - 1]; j--)
+	    ;
+	*end = j;
+    }
+
+    return i;
+}
+
 static void print_timeout_message(int tol, int row, const char *msg)
 {
-    static int last_msg_len = 0;
+    int last_msg_len = timeout_shown.len;
     char buf[256];
+    const char *attr;
+    int col, start, end;
     int nc = 0, nnc, padc;
     const char *tp = msg;
     char tc;
@@ -683,6 +767,17 @@ static void print_timeout_message(int tol, int row, const char *msg)
     }
     *tq = '\0';
 
+    /* A tick: write only what changed, which is the count */
+    if (row == timeout_shown.row && nc == last_msg_len) {
+	start = timeout_message_diff(buf, &col, &attr, &end);
+	if (start >= 0)
+	    printf("\033[%d;%dH%.4s%.*s", row,
+		   HSHIFT + 1 + ((WIDTH - nc) >> 1) + col, attr,
+		   end - start, buf + start);
+	strcpy(timeout_shown.buf, buf);
+	return;
+    }
+
     if (nc >= last_msg_len) {
 	padc = 0;
     } else {
@@ -693,7 +788,9 @@ static void print_timeout_message(int tol, int row, const char *msg)
 	   HSHIFT + 1 + ((WIDTH - nc) >> 1) - padc,
 	   padc, "", buf, padc, "");
 
-    last_msg_len = nc;
+    timeout_shown.row = row;
+    timeout_shown.len = nc;
+    strcpy(timeout_shown.buf, buf);
 }
 
 /* Set the background screen, etc. */
@@ -704,6 +801,107 @@ static void prepare_screen_for_menu(void)
     set_background(cm->menu_background);
 }
 
+/* Cut the next word off a command line, NULL at the end */
+static char *next_word(char **p)
+{
+    char *word;
+
+    while (my_isspace(**p))
+	(*p)++;
+    if (!**p)
+	return NULL;
+
+    word = *p;
+    while (**p && !my_isspace(**p))
+	(*p)++;
+    if (**p)
+	*(*p)++ = '\0';
+
+    return word;
+}
+
+/*
+ * If a command line boots a Linux kernel, have the kernel and initrds
+ * fetched in the background while we count down.
+ */
+static void prefetch_cmdline(const char *cmdline)
+{
+    char buf[MAX_CMDLINE_LEN];
+    char *p, *word, *initrd;
+
+    if (!cmdline)
+	return;
+
+    strlcpy(buf, cmdline, sizeof buf);
+    p = buf;
+
+    word = next_word(&p);
+    if (word && word[0] == '.') {
+	/* A type specifier; the kernel comes next */
+	if (strcmp(word, ".linux") && strcmp(word, ".kernel"))
+	    return;
+	word = next_word(&p);
+    }
+    if (!word)
+	return;
+    if (parse_image_type(word) != IMAGE_TYPE_KERNEL &&
+	parse_image_type(word) != IMAGE_TYPE_LINUX)
+	return;
+    prefetch_file(word);
+
+    while ((word = next_word(&p))) {
+	if (strncmp(word, "initrd=", 7))
+	    continue;
+	initrd = word + 7;
+	while ((word = strsep(&initrd, ","))) {
+	    if (*word)
+		prefetch_file(word);
+	}
+    }
+}
+
+/*
+ * With MENU PREFETCH, load the next COM32 module an entry runs into the
+ * module cache, so that it starts without touching the disk or network.
+ * Returns false once there are none left.
+ */
+static bool prefetch_module(void)
+{
+    static struct menu *m;
+    static int i;
+    static bool done;
+    char buf[MAX_CMDLINE_LEN];
+    const struct menu_entry *me;
+    char *p, *word;
+
+    if (done)
+	return false;
+    if (!m)
+	m = menu_list;
+
+    for (; m; m = m->next, i = 0) {
+	while (i < m->nentries) {
+	    me = m->menu_entries[i++];
+	    if (me->action != MA_CMD || !me->cmdline)
+		continue;
+
+	    strlcpy(buf, me->cmdline, sizeof buf);
+	    p = buf;
+	    word = next_word(&p);
+	    if (word && !strcmp(word, ".com32"))
+		word = next_word(&p);
+	    if (!word || parse_image_type(word) != IMAGE_TYPE_COM32)
+		continue;
+
+	    module_prefetch(word);
+	    return true;
+	}
+    }
+
+    done = true;
+    return false;
+}
+
 static const char *do_hidden_menu(void)
 {
     int key;
@@ -741,6 +939,31 @@ static const char *do_hidden_menu(void)
 	return cm->menu_entries[cm->defentry]->cmdline; /* Default entry */
 }
 
+/* Some postprocessing for all menus, which is fine to repeat */
+static void setup_menus(void)
+{
+    struct menu *m;
+    int rows, cols;
+    int i;
+
+    if (getscreensize(1, &rows, &cols)) {
+	/* Unknown screen size? */
+	rows = 24;
+	cols = 80;
+    }
+
+    for (m = menu_list; m; m = m->next) {
+	if (!m->mparm[P_WIDTH])
+	    m->mparm[P_WIDTH] = cols;
+
+	/* If anyone has specified negative parameters, consider them
+	   relative to the bottom row of the screen. */
+	for (i = 0; i < NPARAMS; i++)
+	    if (m->mparm[i] < 0)
+		m->mparm[i] = max(m->mparm[i] + rows, 0);
+    }
+}
+
 static const char *run_menu(void)
 {
     int key;
@@ -749,6 +972,7 @@ static const char *run_menu(void)
     int prev_entry = -1;
     volatile int top = cm->curtop;
     int prev_top = -1;
+    const char *prev_help = NULL;
     int clear = 1, to_clear;
     const char *cmdline = NULL;
     volatile clock_t key_timeout, timeout_left, this_timeout;
@@ -766,8 +990,17 @@ static const char *run_menu(void)
 	shiftkey = 0;
     }
 
+    /* The default is what a timeout boots; get it on its way */
+    if (cm->timeout) {
+	if (cm->ontimeout)
+	    prefetch_cmdline(cm->ontimeout);
+	else if (cm->menu_entries[cm->defentry]->action == MA_CMD)
+	    prefetch_cmdline(cm->menu_entries[cm->defentry]->cmdline);
+    }
+
     /* Do this before hiddenmenu handling, so we show the background */
     prepare_screen_for_menu();
+    boot_time_stamp(BOOT_PHASE_MENU);
 
     /* Handle hiddenmenu */
     if (hiddenmenu) {
@@ -827,15 +1060,20 @@ static const char *run_menu(void)
 	    prev_entry = prev_top = -1;
 	}
 
-	if (top != prev_top) {
+	/* Repaint only what differs from what is on the screen */
+	if (prev_top < 0) {
 	    draw_menu(entry, top, 1);
 	    display_help(me->helptext);
+	} else if (top != prev_top) {
+	    draw_rows(entry, top);
 	} else if (entry != prev_entry) {
 	    draw_row(prev_entry - top + 4 + VSHIFT, entry, top, 0, 0);
 	    draw_row(entry - top + 4 + VSHIFT, entry, top, 0, 0);
-	    display_help(me->helptext);
 	}
+	if (prev_top >= 0 && me->helptext != prev_help)
+	    display_help(me->helptext);
 
+	prev_help = me->helptext;
 	prev_entry = entry;
 	prev_top = top;
 	cm->curentry = entry;
@@ -859,12 +1097,17 @@ static const char *run_menu(void)
 	} else {
 	    this_timeout = min(min(key_timeout, timeout_left),
 			       (clock_t) CLK_TCK);
+	    /* Nothing to count down: look for a key between modules */
+	    if (!key_timeout && prefetchmenu && prefetch_module())
+		this_timeout = 1;
 	    key = mygetkey(this_timeout);
 
 	    if (key != KEY_NONE) {
 		timeout_left = key_timeout;
-		if (to_clear)
+		if (to_clear) {
 		    printf("\033[%d;1H\1#0\033[K", TIMEOUT_ROW);
+		    forget_timeout_message();
+		}
 	    }
 	}
 
@@ -911,6 +1154,10 @@ static const char *run_menu(void)
 		    done = 0;
 		    clear = 2;
 		    cm = me->submenu;
+		    if (cm->lazy_file) {
+			load_lazy_menu(cm);
+			setup_menus();
+		    }
 		    entry = cm->curentry;
 		    top = cm->curtop;
 		    break;
@@ -1103,9 +1350,6 @@ static const char *run_menu(void)
 int main(int argc, char *argv[])
 {
     const char *cmdline;
-    struct menu *m;
-    int rows, cols;
-    int i;
 
     (void)argc;
 
@@ -1117,23 +1361,7 @@ int main(int argc, char *argv[])
      * configuration, e.g. MENU RESOLUTION.
      */
     start_console();
-    if (getscreensize(1, &rows, &cols)) {
-	/* Unknown screen size? */
-	rows = 24;
-	cols = 80;
-    }
-
-    /* Some postprocessing for all menus */
-    for (m = menu_list; m; m = m->next) {
-	if (!m->mparm[P_WIDTH])
-	    m->mparm[P_WIDTH] = cols;
-
-	/* If anyone has specified negative parameters, consider them
-	   relative to the bottom row of the screen. */
-	for (i = 0; i < NPARAMS; i++)
-	    if (m->mparm[i] < 0)
-		m->mparm[i] = max(m->mparm[i] + rows, 0);
-    }
+    setup_menus();
 
     cm = start_menu;
 
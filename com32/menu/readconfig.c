@@ -20,11 +20,13 @@
 #include <alloca.h>
 #include <inttypes.h>
 #include <colortbl.h>
+#include <arena.h>
 #include <com32.h>
 #include <syslinux/adv.h>
 #include <syslinux/config.h>
 
 #include "menu.h"
+#include "kwdhash.h"
 
 /* Empty refstring */
 const char *empty_string;
@@ -32,10 +34,14 @@ const char *empty_string;
 /* Root menu, starting menu, hidden menu, and list of all menus */
 struct menu *root_menu, *start_menu, *hide_menu, *menu_list;
 
+/* Menus and their entries, dropped all at once on a new parse_configs() */
+static struct arena *config_arena;
+
 /* These are global parameters regardless of which menu we're displaying */
 int shiftkey = 0;		/* Only display menu if shift key pressed */
 int hiddenmenu = 0;
 int clearmenu = 0;
+int prefetchmenu = 0;		/* Load the modules the entries run, while idle */
 long long totaltimeout = 0;
 const char *hide_key[KEY_MAX];
 
@@ -48,6 +54,113 @@ static bool menusave = false;	/* True if there is any "menu save" */
 static struct menu_entry *all_entries;
 static struct menu_entry **all_entries_end = &all_entries;
 
+/*
+ * Hash index of the labels in all_entries, so that resolving a label
+ * doesn't scan every entry.  Only the first entry with a given label
+ * is indexed, which is the one a scan of all_entries would find.
+ */
+static struct menu_entry **label_hash;
+static unsigned int label_hash_size;	/* Power of 2 */
+static unsigned int label_hash_count;
+static bool label_hash_failed;	/* Out of memory, scan all_entries */
+
+static unsigned int label_hash_fn(const char *str, int len)
+{
+    unsigned int hash = 2166136261u;
+
+    while (len--) {
+	hash ^= (unsigned char)*str++;
+	hash *= 16777619;
+    }
+
+    return hash;
+}
+
+static struct menu_entry *label_lookup(const char *str, int len)
+{
+    struct menu_entry *me;
+
+    if (label_hash_failed) {
+	for (me = all_entries; me; me = me->next) {
+	    if (me->label && !strncmp(str, me->label, len) && !me->label[len])
+		return me;
+	}
+	return NULL;
+    }
+
+    if (!label_hash_size)
+	return NULL;
+
+    me = label_hash[label_hash_fn(str, len) & (label_hash_size - 1)];
+    for (; me; me = me->label_next) {
+	if (!strncmp(str, me->label, len) && !me->label[len])
+	    return me;
+    }
+
+    return NULL;
+}
+
+static void label_index(struct menu_entry *me)
+{
+    struct menu_entry **buckets, *e, *next;
+    unsigned int i, b, size, len = strlen(me->label);
+
+    if (label_hash_failed || label_lookup(me->label, len))
+	return;			/* The first one wins */
+
+    if (label_hash_count >= label_hash_size) {
+	size = label_hash_size ? label_hash_size << 1 : 256;
+	buckets = arena_zalloc(config_arena, size * sizeof *buckets);
+	if (!buckets) {
+	    if (!label_hash_size) {
+		label_hash_failed = true;
+		return;
+	    }
+	    goto insert;	/* Keep using the old table */
+	}
+
+	for (i = 0; i < label_hash_size; i++) {
+	    for (e = label_hash[i]; e; e = next) {
+		next = e->label_next;
+		b = label_hash_fn(e->label, strlen(e->label)) & (size - 1);
+		e->label_next = buckets[b];
+		buckets[b] = e;
+	    }
+	}
+
+	label_hash = buckets;
+	label_hash_size = size;
+    }
+
+insert:
+    i = label_hash_fn(me->label, len) & (label_hash_size - 1);
+    me->label_next = label_hash[i];
+    label_hash[i] = me;
+    label_hash_count++;
+}
+
+/*
+ * Submenus from MENU LAZYINCLUDE, whose files are only read when the
+ * submenu is first entered, or when a label or menu can't be found in
+ * what has been read so far.
+ */
+static int lazy_menus;		/* Number not read yet */
+
+static void load_lazy_menus(void);
+
+/* As label_lookup(), reading lazily included submenus if need be */
+static struct menu_entry *label_lookup_all(const char *str, int len)
+{
+    struct menu_entry *me;
+
+    for (;;) {
+	me = label_lookup(str, len);
+	if (me || !lazy_menus)
+	    return me;
+	load_lazy_menus();
+    }
+}
+
 static const struct messages messages[MSG_COUNT] = {
     [MSG_AUTOBOOT] = {"autoboot", "Automatic boot in # second{,s}..."},
     [MSG_TAB] = {"tabmsg", "Press [Tab] to edit options"},
@@ -84,12 +197,16 @@ static struct menu *find_menu(const char *label)
 {
     struct menu *m;
 
-    for (m = menu_list; m; m = m->next) {
-	if (!strcmp(label, m->label))
-	    return m;
-    }
+    for (;;) {
+	for (m = menu_list; m; m = m->next) {
+	    if (!strcmp(label, m->label))
+		return m;
+	}
 
-    return NULL;
+	if (!lazy_menus)
+	    return NULL;
+	load_lazy_menus();
+    }
 }
 
 #define MAX_LINE 4096
@@ -142,6 +259,27 @@ static char *looking_at(char *line, const char *kwd)
     return my_isspace(*p) ? p : NULL;	/* Must be EOL or whitespace */
 }
 
+/*
+ * Which keyword the line starts with, in one lookup of the table that
+ * genhash.pl makes of the keywords file, and where it ends.  KWD_NONE
+ * if it doesn't start with one.
+ */
+static enum keyword keyword(char *line, char **end)
+{
+    const struct keyword_slot *k;
+    uint32_t h = 0;
+    char *p;
+
+    for (p = line; !my_isspace(*p); p++)
+	h = ((h << 5) | (h >> 27)) ^ ((uint8_t)*p | 0x20);
+
+    k = &kwd_hash[(uint32_t)(h * KWD_HASH_MULT) >> (32 - KWD_HASH_BITS)];
+    if (!k->name || !(*end = looking_at(line, k->name)))
+	return KWD_NONE;
+
+    return k->kwd;
+}
+
 /* Get a single word into a new refstr; advances the input pointer */
 static char *get_word(char *str, char **word)
 {
@@ -161,7 +299,7 @@ static char *get_word(char *str, char **word)
 static struct menu *new_menu(struct menu *parent,
 			     struct menu_entry *parent_entry, const char *label)
 {
-    struct menu *m = calloc(1, sizeof(struct menu));
+    struct menu *m = arena_zalloc(config_arena, sizeof(struct menu));
     int i;
 
     m->label = label;
@@ -254,16 +392,19 @@ static struct menu_entry *new_entry(struct menu *m)
     struct menu_entry *me;
 
     if (m->nentries >= m->nentries_space) {
+	size_t oldsize = m->nentries_space * sizeof(struct menu_entry *);
+
 	if (!m->nentries_space)
 	    m->nentries_space = 1;
 	else
 	    m->nentries_space <<= 1;
 
-	m->menu_entries = realloc(m->menu_entries, m->nentries_space *
-				  sizeof(struct menu_entry *));
+	m->menu_entries = arena_realloc(config_arena, m->menu_entries, oldsize,
+					m->nentries_space *
+					sizeof(struct menu_entry *));
     }
 
-    me = calloc(1, sizeof(struct menu_entry));
+    me = arena_zalloc(config_arena, sizeof(struct menu_entry));
     me->menu = m;
     me->entry = m->nentries;
     m->menu_entries[m->nentries++] = me;
@@ -364,6 +505,9 @@ static void record(struct menu *m, struct labeldata *ld, const char *append)
 	    me->passwd = NULL;
 	}
 
+	if (me->label)
+	    label_index(me);
+
 	if (ld->menulabel)
 	    consider_for_hotkey(m, me);
 
@@ -448,7 +592,6 @@ static struct menu *end_submenu(void)
 static struct menu_entry *find_label(const char *str)
 {
     const char *p;
-    struct menu_entry *me;
     int pos;
 
     p = str;
@@ -458,12 +601,7 @@ static struct menu_entry *find_label(const char *str)
     /* p now points to the first byte beyond the kernel name */
     pos = p - str;
 
-    for (me = all_entries; me; me = me->next) {
-	if (!strncmp(str, me->label, pos) && !me->label[pos])
-	    return me;
-    }
-
-    return NULL;
+    return label_lookup_all(str, pos);
 }
 
 static const char *unlabel(const char *str)
@@ -481,13 +619,12 @@ static const char *unlabel(const char *str)
     /* p now points to the first byte beyond the kernel name */
     pos = p - str;
 
-    for (me = all_entries; me; me = me->next) {
-	if (!strncmp(str, me->label, pos) && !me->label[pos]) {
-	    /* Found matching label */
-	    rsprintf(&q, "%s%s", me->cmdline, p);
-	    refstr_put(str);
-	    return q;
-	}
+    me = label_lookup_all(str, pos);
+    if (me) {
+	/* Found matching label */
+	rsprintf(&q, "%s%s", me->cmdline, p);
+	refstr_put(str);
+	return q;
     }
 
     return str;
@@ -654,6 +791,7 @@ static void parse_config_file(FILE * f)
     enum kernel_type type = -1;
     enum message_number msgnr = -1;
     int fkeyno = 0;
+    enum keyword kwd;
     struct menu *m = current_menu;
 
     while (fgets(line, sizeof line, f)) {
@@ -665,11 +803,13 @@ static void parse_config_file(FILE * f)
 	    *p = '\0';
 
 	p = skipspace(line);
+	kwd = keyword(p, &ep);
 
-	if (looking_at(p, "menu")) {
+	if (kwd == KWD_MENU) {
 	    p = skipspace(p + 4);
+	    kwd = keyword(p, &ep);
 
-	    if (looking_at(p, "label")) {
+	    if (kwd == KWD_LABEL) {
 		if (ld.label) {
 		    refstr_put(ld.menulabel);
 		    ld.menulabel = refstrdup(skipspace(p + 5));
@@ -683,7 +823,7 @@ static void parse_config_file(FILE * f)
 			m->title = strip_caret(m->parent_entry->displayname);
 		    }
 		}
-	    } else if (looking_at(p, "title")) {
+	    } else if (kwd == KWD_TITLE) {
 		refstr_put(m->title);
 		m->title = refstrdup(skipspace(p + 5));
 		if (m->parent_entry) {
@@ -693,15 +833,15 @@ static void parse_config_file(FILE * f)
 			m->parent_entry->displayname = refstr_get(m->title);
 		    }
 		}
-	    } else if (looking_at(p, "default")) {
+	    } else if (kwd == KWD_DEFAULT) {
 		if (ld.label) {
 		    ld.menudefault = 1;
 		} else if (m->parent_entry) {
 		    m->parent->defentry = m->parent_entry->entry;
 		}
-	    } else if (looking_at(p, "hide")) {
+	    } else if (kwd == KWD_HIDE) {
 		ld.menuhide = 1;
-	    } else if (looking_at(p, "passwd")) {
+	    } else if (kwd == KWD_PASSWD) {
 		if (ld.label) {
 		    refstr_put(ld.passwd);
 		    ld.passwd = refstrdup(skipspace(p + 6));
@@ -709,47 +849,67 @@ static void parse_config_file(FILE * f)
 		    refstr_put(m->parent_entry->passwd);
 		    m->parent_entry->passwd = refstrdup(skipspace(p + 6));
 		}
-	    } else if (looking_at(p, "shiftkey")) {
+	    } else if (kwd == KWD_SHIFTKEY) {
 		shiftkey = 1;
-	    } else if (looking_at(p, "save")) {
+	    } else if (kwd == KWD_PREFETCH) {
+		prefetchmenu = 1;
+	    } else if (kwd == KWD_SAVE) {
 		menusave = true;
 		if (ld.label)
 		    ld.save = 1;
 		else
 		    m->save = true;
-	    } else if (looking_at(p, "nosave")) {
+	    } else if (kwd == KWD_NOSAVE) {
 		if (ld.label)
 		    ld.save = -1;
 		else
 		    m->save = false;
-	    } else if (looking_at(p, "immediate")) {
+	    } else if (kwd == KWD_IMMEDIATE) {
 		if (ld.label)
 		    ld.immediate = 1;
 		else
 		    m->immediate = true;
-	    } else if (looking_at(p, "noimmediate")) {
+	    } else if (kwd == KWD_NOIMMEDIATE) {
 		if (ld.label)
 		    ld.immediate = -1;
 		else
 		    m->immediate = false;
-	    } else if (looking_at(p, "onerror")) {
+	    } else if (kwd == KWD_ONERROR) {
 		refstr_put(m->onerror);
 		m->onerror = refstrdup(skipspace(p + 7));
-	    } else if (looking_at(p, "master")) {
+	    } else if (kwd == KWD_MASTER) {
 		p = skipspace(p + 6);
 		if (looking_at(p, "passwd")) {
 		    refstr_put(m->menu_master_passwd);
 		    m->menu_master_passwd = refstrdup(skipspace(p + 6));
 		}
-	    } else if ((ep = looking_at(p, "include"))) {
+	    } else if (kwd == KWD_INCLUDE) {
 		goto do_include;
-	    } else if ((ep = looking_at(p, "background"))) {
+	    } else if (kwd == KWD_LAZYINCLUDE) {
+		const char *file;
+
+		p = skipspace(ep);
+		file = refdup_word(&p);
+		p = skipspace(p);
+		if (!*p) {
+		    /* Not a submenu, so nothing to put off */
+		    refstr_put(file);
+		    goto do_include;
+		}
+
+		record(m, &ld, append);
+		m = current_menu = begin_submenu(p);
+		m->lazy_file = file;
+		m->lazy_append = refstr_get(append);
+		lazy_menus++;
+		m = current_menu = end_submenu();
+	    } else if (kwd == KWD_BACKGROUND) {
 		p = skipspace(ep);
 		refstr_put(m->menu_background);
 		m->menu_background = refdup_word(&p);
-	    } else if ((ep = looking_at(p, "hidden"))) {
+	    } else if (kwd == KWD_HIDDEN) {
 		hiddenmenu = 1;
-	    } else if (looking_at(p, "hiddenkey")) {
+	    } else if (kwd == KWD_HIDDENKEY) {
 		char *key_name, *k, *ek;
 		const char *command;
 		int key;
@@ -771,13 +931,13 @@ static void parse_config_file(FILE * f)
 		}
 		refstr_put(key_name);
 		refstr_put(command);
-	    } else if ((ep = looking_at(p, "clear"))) {
+	    } else if (kwd == KWD_CLEAR) {
 		clearmenu = 1;
-	    } else if ((ep = is_message_name(p, &msgnr))) {
+	    } else if (!kwd && (ep = is_message_name(p, &msgnr))) {
 		refstr_put(m->messages[msgnr]);
 		m->messages[msgnr] = refstrdup(skipspace(ep));
-	    } else if ((ep = looking_at(p, "color")) ||
-		       (ep = looking_at(p, "colour"))) {
+	    } else if (kwd == KWD_COLOR ||
+		       kwd == KWD_COLOUR) {
 		int i;
 		struct color_table *cptr;
 		p = skipspace(ep);
@@ -825,8 +985,8 @@ static void parse_config_file(FILE * f)
 		    }
 		    cptr++;
 		}
-	    } else if ((ep = looking_at(p, "msgcolor")) ||
-		       (ep = looking_at(p, "msgcolour"))) {
+	    } else if (kwd == KWD_MSGCOLOR ||
+		       kwd == KWD_MSGCOLOUR) {
 		unsigned int fg_mask = MSG_COLORS_DEF_FG;
 		unsigned int bg_mask = MSG_COLORS_DEF_BG;
 		enum color_table_shadow shadow = MSG_COLORS_DEF_SHADOW;
@@ -862,31 +1022,31 @@ static void parse_config_file(FILE * f)
 		    }
 		}
 		set_msg_colors_global(m->color_table, fg_mask, bg_mask, shadow);
-	    } else if (looking_at(p, "separator")) {
+	    } else if (kwd == KWD_SEPARATOR) {
 		record(m, &ld, append);
 		ld.label = refstr_get(empty_string);
 		ld.menuseparator = 1;
 		record(m, &ld, append);
-	    } else if (looking_at(p, "disable") || looking_at(p, "disabled")) {
+	    } else if (kwd == KWD_DISABLE || kwd == KWD_DISABLED) {
 		ld.menudisabled = 1;
-	    } else if (looking_at(p, "indent")) {
+	    } else if (kwd == KWD_INDENT) {
 		ld.menuindent = atoi(skipspace(p + 6));
-	    } else if (looking_at(p, "begin")) {
+	    } else if (kwd == KWD_BEGIN) {
 		record(m, &ld, append);
 		m = current_menu = begin_submenu(skipspace(p + 5));
-	    } else if (looking_at(p, "end")) {
+	    } else if (kwd == KWD_END) {
 		record(m, &ld, append);
 		m = current_menu = end_submenu();
-	    } else if (looking_at(p, "quit")) {
+	    } else if (kwd == KWD_QUIT) {
 		if (ld.label)
 		    ld.action = MA_QUIT;
-	    } else if (looking_at(p, "goto")) {
+	    } else if (kwd == KWD_GOTO) {
 		if (ld.label) {
 		    ld.action = MA_GOTO_UNRES;
 		    refstr_put(ld.kernel);
 		    ld.kernel = refstrdup(skipspace(p + 4));
 		}
-	    } else if (looking_at(p, "exit")) {
+	    } else if (kwd == KWD_EXIT) {
 		p = skipspace(p + 4);
 		if (ld.label && m->parent) {
 		    if (*p) {
@@ -899,9 +1059,9 @@ static void parse_config_file(FILE * f)
 			ld.submenu = m->parent;
 		    }
 		}
-	    } else if (looking_at(p, "start")) {
+	    } else if (kwd == KWD_START) {
 		start_menu = m;
-	    } else if (looking_at(p, "help")) {
+	    } else if (kwd == KWD_HELP) {
 		if (ld.label) {
 		    ld.action = MA_HELP;
 		    p = skipspace(p + 4);
@@ -919,7 +1079,7 @@ static void parse_config_file(FILE * f)
 			ld.append = refdup_word(&p); /* Background */
 		    }
 		}
-	    } else if ((ep = looking_at(p, "resolution"))) {
+	    } else if (kwd == KWD_RESOLUTION) {
 		int x, y;
 		x = strtoul(ep, &ep, 0);
 		y = strtoul(skipspace(ep), NULL, 0);
@@ -934,7 +1094,7 @@ static void parse_config_file(FILE * f)
 		    }
 		}
 	    }
-	} else if (looking_at(p, "text")) {
+	} else if (kwd == KWD_TEXT) {
 	    enum text_cmd {
 		TEXT_UNKNOWN,
 		TEXT_HELP
@@ -964,7 +1124,7 @@ static void parse_config_file(FILE * f)
 		    break;
 		}
 	    }
-	} else if ((ep = is_fkey(p, &fkeyno))) {
+	} else if (!kwd && (ep = is_fkey(p, &fkeyno))) {
 	    p = skipspace(ep);
 	    if (m->fkeyhelp[fkeyno].textname) {
 		refstr_put(m->fkeyhelp[fkeyno].textname);
@@ -981,7 +1141,7 @@ static void parse_config_file(FILE * f)
 		p = skipspace(p);
 		m->fkeyhelp[fkeyno].background = refdup_word(&p);
 	    }
-	} else if ((ep = looking_at(p, "include"))) {
+	} else if (kwd == KWD_INCLUDE) {
 do_include:
 	    {
 		const char *file;
@@ -999,7 +1159,7 @@ do_include:
 		}
 		refstr_put(file);
 	    }
-	} else if (looking_at(p, "append")) {
+	} else if (kwd == KWD_APPEND) {
 	    const char *a = refstrdup(skipspace(p + 6));
 	    if (ld.label) {
 		refstr_put(ld.append);
@@ -1008,7 +1168,7 @@ do_include:
 		refstr_put(append);
 		append = a;
 	    }
-	} else if (looking_at(p, "initrd")) {
+	} else if (kwd == KWD_INITRD) {
 	    const char *a = refstrdup(skipspace(p + 6));
 	    if (ld.label) {
 		refstr_put(ld.initrd);
@@ -1016,7 +1176,7 @@ do_include:
 	    } else {
 		/* Ignore */
 	    }
-	} else if (looking_at(p, "label")) {
+	} else if (kwd == KWD_LABEL) {
 	    p = skipspace(p + 5);
 	    record(m, &ld, append);
 	    ld.label = refstrdup(p);
@@ -1030,31 +1190,31 @@ do_include:
 	    ld.ipappend = ipappend;
 	    ld.menudefault = ld.menuhide = ld.menuseparator =
 		ld.menudisabled = ld.menuindent = 0;
-	} else if ((ep = is_kernel_type(p, &type))) {
+	} else if (!kwd && (ep = is_kernel_type(p, &type))) {
 	    if (ld.label) {
 		refstr_put(ld.kernel);
 		ld.kernel = refstrdup(skipspace(ep));
 		ld.type = type;
 	    }
-	} else if (looking_at(p, "timeout")) {
+	} else if (kwd == KWD_TIMEOUT) {
 	    m->timeout = (atoi(skipspace(p + 7)) * CLK_TCK + 9) / 10;
-	} else if (looking_at(p, "totaltimeout")) {
+	} else if (kwd == KWD_TOTALTIMEOUT) {
 	    totaltimeout = (atoll(skipspace(p + 13)) * CLK_TCK + 9) / 10;
-	} else if (looking_at(p, "ontimeout")) {
+	} else if (kwd == KWD_ONTIMEOUT) {
 	    m->ontimeout = refstrdup(skipspace(p + 9));
-	} else if (looking_at(p, "allowoptions")) {
+	} else if (kwd == KWD_ALLOWOPTIONS) {
 	    m->allowedit = !!atoi(skipspace(p + 12));
-	} else if ((ep = looking_at(p, "ipappend")) ||
-		   (ep = looking_at(p, "sysappend"))) {
+	} else if (kwd == KWD_IPAPPEND ||
+		   kwd == KWD_SYSAPPEND) {
 	    uint32_t s = strtoul(skipspace(ep), NULL, 0);
 	    if (ld.label)
 		ld.ipappend = s;
 	    else
 		ipappend = s;
-	} else if (looking_at(p, "default")) {
+	} else if (kwd == KWD_DEFAULT) {
 	    refstr_put(globaldefault);
 	    globaldefault = refstrdup(skipspace(p + 7));
-	} else if (looking_at(p, "ui")) {
+	} else if (kwd == KWD_UI) {
 	    has_ui = 1;
 	}
     }
@@ -1101,6 +1261,87 @@ static void resolve_gotos(void)
     }
 }
 
+/*
+ * Read the file of a MENU LAZYINCLUDE submenu, as if it had been
+ * included where the submenu was defined, and finish setting up the
+ * menus it brings in the way parse_configs() does.
+ */
+void load_lazy_menu(struct menu *m)
+{
+    const char *file = m->lazy_file;
+    const char *ontimeout = m->ontimeout;
+    const char *onerror = m->onerror;
+    const char *save_append = append;
+    struct menu *save_menu = current_menu;
+    struct menu *old_list = menu_list;
+    struct menu *new_list, *n;
+    const char *keys[KEY_MAX];
+    int k;
+
+    if (!file)
+	return;
+
+    m->lazy_file = NULL;
+    lazy_menus--;
+
+    memcpy(keys, hide_key, sizeof keys);
+
+    append = m->lazy_append;
+    m->lazy_append = NULL;
+    current_menu = m;
+
+    parse_one_config(file);
+    record(current_menu, &ld, append);
+    refstr_put(file);
+
+    refstr_put(append);
+    append = save_append;
+    current_menu = save_menu;
+
+    /*
+     * Only what the file set needs unlabel(); anything inherited from
+     * this menu has been through it already.  Looking labels up may
+     * read other lazy submenus, which take care of their own menus.
+     */
+    new_list = menu_list;
+
+    resolve_gotos();
+
+    for (n = new_list; n != old_list; n = n->next) {
+	n->curentry = n->defentry;
+
+	if (n->ontimeout && n->ontimeout != ontimeout)
+	    n->ontimeout = unlabel(n->ontimeout);
+	if (n->onerror && n->onerror != onerror)
+	    n->onerror = unlabel(n->onerror);
+    }
+
+    m->curentry = m->defentry;
+
+    if (m->ontimeout != ontimeout)
+	m->ontimeout = unlabel(m->ontimeout);
+    if (m->onerror != onerror)
+	m->onerror = unlabel(m->onerror);
+
+    for (k = 0; k < KEY_MAX; k++) {
+	if (hide_key[k] && hide_key[k] != keys[k])
+	    hide_key[k] = unlabel(hide_key[k]);
+    }
+}
+
+static void load_lazy_menus(void)
+{
+    struct menu *m;
+
+    while (lazy_menus) {
+	for (m = menu_list; m; m = m->next) {
+	    if (m->lazy_file)
+		break;
+	}
+	load_lazy_menu(m);
+    }
+}
+
 void parse_configs(char **argv)
 {
     const char *filename;
@@ -1108,8 +1349,21 @@ void parse_configs(char **argv)
     struct menu_entry *me;
     int k;
 
+    /* Configurations repeat the same strings over and over */
+    refstr_intern(true);
+
     empty_string = refstrdup("");
 
+    label_hash = NULL;
+    label_hash_size = label_hash_count = 0;
+    label_hash_failed = false;
+    lazy_menus = 0;
+
+    if (config_arena)
+	arena_reset(config_arena);
+    else
+	config_arena = arena_create(0);
+
     /* Initialize defaults for the root and hidden menus */
     hide_menu = new_menu(NULL, NULL, refstrdup(".hidden"));
     root_menu = new_menu(NULL, NULL, refstrdup(".top"));
@@ -19,8 +19,132 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include "refstr.h"
 
+/*
+ * Interned strings: while interning is on, refstrdup() and refstrndup()
+ * hand out another reference to an existing string with the same
+ * contents, if there is one, instead of a new copy.  Configuration
+ * files repeat the same APPEND lines, kernels and initrds a great
+ * many times.  Interned strings carry REFSTR_INTERNED in their count
+ * and sit in a hash table until their last reference goes away.
+ */
+#define REFSTR_INTERNED	0x80000000U
+
+struct refstr_node {
+    struct refstr_node *next;	/* Hash chain */
+    uint32_t hash;
+    unsigned int ref;		/* Must come just before str */
+    char str[];
+};
+
+static bool refstr_interning;
+static struct refstr_node **refstr_table;
+static unsigned int refstr_table_size;	/* Power of 2 */
+static unsigned int refstr_table_count;
+
+static uint32_t refstr_hash(const char *str, size_t len)
+{
+    uint32_t hash = 2166136261u;
+
+    while (len--) {
+	hash ^= (unsigned char)*str++;
+	hash *= 16777619;
+    }
+
+    return hash;
+}
+
+static bool refstr_table_grow(void)
+{
+    struct refstr_node **table, *n, *next;
+    unsigned int i, size;
+
+    size = refstr_table_size ? refstr_table_size << 1 : 256;
+    table = calloc(size, sizeof *table);
+    if (!table)
+	return false;
+
+    for (i = 0; i < refstr_table_size; i++) {
+	for (n = refstr_table[i]; n; n = next) {
+	    next = n->next;
+	    n->next = table[n->hash & (size - 1)];
+	    table[n->hash & (size - 1)] = n;
+	}
+    }
+
+    free(refstr_table);
+    refstr_table = table;
+    refstr_table_size = size;
+    return true;
+}
+
+/* Returns NULL if the string can't be interned, to make a plain copy */
+static const char *refstr_intern_str(const char *str, size_t len)
+{
+    struct refstr_node *n;
+    uint32_t hash = refstr_hash(str, len);
+
+    if (refstr_table_size) {
+	n = refstr_table[hash & (refstr_table_size - 1)];
+	for (; n; n = n->next) {
+	    if (n->hash == hash && !memcmp(n->str, str, len) && !n->str[len])
+		return refstr_get(n->str);
+	}
+    }
+
+    if (refstr_table_count >= refstr_table_size && !refstr_table_grow()) {
+	if (!refstr_table_size)
+	    return NULL;
+	/* Carry on with longer chains */
+    }
+
+    n = malloc(sizeof *n + len + 1);
+    if (!n)
+	return NULL;
+
+    n->hash = hash;
+    n->ref = REFSTR_INTERNED | 1;
+    memcpy(n->str, str, len);
+    n->str[len] = '\0';
+
+    n->next = refstr_table[hash & (refstr_table_size - 1)];
+    refstr_table[hash & (refstr_table_size - 1)] = n;
+    refstr_table_count++;
+
+    return n->str;
+}
+
+static void refstr_unintern(unsigned int *ref)
+{
+    struct refstr_node *n, **np;
+
+    n = (struct refstr_node *)((char *)ref - offsetof(struct refstr_node, ref));
+
+    np = &refstr_table[n->hash & (refstr_table_size - 1)];
+    while (*np != n)
+	np = &(*np)->next;
+
+    *np = n->next;
+    refstr_table_count--;
+    free(n);
+}
+
+/*
+ * Turn interning on or off, returning whether it was on.  Strings
+ * that are already interned stay shared either way.
+ */
+bool refstr_intern(bool on)
+{
+    bool was = refstr_interning;
+
+    refstr_interning = on;
+    return was;
+}
+
 /* Allocate space for a refstring of len bytes, plus final null */
 /* The final null is inserted in the string; the rest is uninitialized. */
 char *refstr_alloc(size_t len)
@@ -42,6 +166,13 @@ const char *refstrndup(const char *str, size_t len)
 	return NULL;
 
     len = strnlen(str, len);
+    if (refstr_interning) {
+	const char *i = refstr_intern_str(str, len);
+
+	if (i)
+	    return i;
+    }
+
     r = refstr_alloc(len);
     if (r)
 	memcpy(r, str, len);
@@ -57,6 +188,13 @@ const char *refstrdup(const char *str)
 	return NULL;
 
     len = strlen(str);
+    if (refstr_interning) {
+	const char *i = refstr_intern_str(str, len);
+
+	if (i)
+	    return i;
+    }
+
     r = refstr_alloc(len);
     if (r)
 	memcpy(r, str, len);
@@ -99,7 +237,11 @@ void refstr_put(const char *r)
     if (r) {
 	ref = (unsigned int *)r - 1;
 
-	if (!--*ref)
-	    free(ref);
+	if (!(--*ref & ~REFSTR_INTERNED)) {
+	    if (*ref & REFSTR_INTERNED)
+		refstr_unintern(ref);
+	    else
+		free(ref);
+	}
     }
 }
@@ -0,0 +1,55 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *   Boston MA 02110-1301, USA; either version 2 of the License, or
+ *   (at your option) any later version; incorporated herein by reference.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * cachestat.c
+ *
+ * Display the block cache statistics of the boot filesystem
+ */
+#include <inttypes.h>
+#include <stdio.h>
+#include <pmapi.h>
+
+static unsigned int percent(uint32_t part, uint32_t whole)
+{
+    return whole ? (unsigned int)((uint64_t)part * 100 / whole) : 0;
+}
+
+int main(void)
+{
+    struct com32_cache_stats st;
+    uint32_t lookups;
+
+    if (pmapi_cache_stats(&st)) {
+	printf("No block cache on this filesystem\n");
+	return 1;
+    }
+
+    lookups = st.hits + st.misses;
+
+    printf("Filesystem:  %s\n", st.fs_name ? st.fs_name : "unknown");
+    printf("Cache:       %" PRIu32 " blocks of %" PRIu32 " bytes (%" PRIu32
+	   " KB)\n", st.entries, st.block_size,
+	   (uint32_t)(((uint64_t)st.entries * st.block_size) >> 10));
+    printf("Lookups:     %" PRIu32 "\n", lookups);
+    printf("Hits:        %" PRIu32 " (%u%%)\n", st.hits,
+	   percent(st.hits, lookups));
+    printf("Misses:      %" PRIu32 " (%u%%)\n", st.misses,
+	   percent(st.misses, lookups));
+    printf("Evictions:   %" PRIu32 "\n", st.evictions);
+    if (st.readahead)
+	printf("Read-ahead:  %" PRIu32 " requests, %" PRIu32
+	       " blocks (window %" PRIu32 " blocks)\n",
+	       st.ra_reqs, st.ra_blocks, st.readahead);
+    else
+	printf("Read-ahead:  disabled\n");
+
+    return 0;
+}
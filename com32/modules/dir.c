@@ -14,6 +14,7 @@
 static int rows, cols;		/* Screen parameters */
 
 #define DIR_CHUNK	1024
+#define DIR_BATCH	32	/* Entries per readdir_batch() call */
 
 static const char *type_str(int type)
 {
@@ -76,6 +77,8 @@ static int display_directory(const char *dirname)
     size_t endpage;
     int maxlen = 0;
     int pos, tpos, colwidth;
+    static struct dirent batch[DIR_BATCH];
+    int n_batch = 0, b = 0;
 
     dir = opendir(dirname);
     if (!dir) {
@@ -83,9 +86,17 @@ static int display_directory(const char *dirname)
 	return -1;
     }
 
-    while ((de = readdir(dir)) != NULL) {
+    for (;;) {
 	struct dirent *nde;
 
+	if (b >= n_batch) {
+	    n_batch = readdir_batch(dir, batch, DIR_BATCH);
+	    if (n_batch <= 0)
+		break;
+	    b = 0;
+	}
+	de = &batch[b++];
+
 	if (n_de >= n_dex) {
 	    struct dirent **ndex;
 
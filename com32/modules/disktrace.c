@@ -0,0 +1,79 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *   Boston MA 02110-1301, USA; either version 2 of the License, or
+ *   (at your option) any later version; incorporated herein by reference.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * disktrace.c
+ *
+ * Display the most recent sector transfers done by the core.
+ *
+ * Usage: disktrace.c32 [count]
+ */
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syslinux/disktrace.h>
+
+static const char *source_name(uint8_t source)
+{
+    switch (source) {
+    case DISK_IO_CACHE:
+	return "cache";
+    case DISK_IO_GETFSSEC:
+	return "getfssec";
+    case DISK_IO_ADV:
+	return "adv";
+    default:
+	return "other";
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    const struct disk_trace *dt;
+    const struct disk_trace_rec *rec;
+    uint32_t n, first, i;
+    uint64_t next_lba = 0;
+    uint64_t sectors = 0;
+    uint32_t seeks = 0;
+
+    dt = disk_trace_get();
+    if (!dt) {
+	printf("Disk tracing is not available\n");
+	return 1;
+    }
+
+    n = dt->total < dt->size ? dt->total : dt->size;
+    if (argc > 1 && (uint32_t)atoi(argv[1]) < n)
+	n = atoi(argv[1]);
+    first = dt->total - n;
+
+    printf("%8s %12s %6s %2s %-8s %10s\n",
+	   "#", "LBA", "count", "rw", "source", "cycles");
+
+    for (i = 0; i < n; i++) {
+	rec = &dt->rec[(first + i) % dt->size];
+
+	if (i && rec->lba != next_lba)
+	    seeks++;
+	next_lba = rec->lba + rec->count;
+	sectors += rec->count;
+
+	printf("%8" PRIu32 " %12" PRIu64 " %6" PRIu32 " %2s %-8s %10" PRIu64
+	       "%s\n", first + i, rec->lba, rec->count,
+	       rec->is_write ? "W" : "R", source_name(rec->source),
+	       rec->tsc_end - rec->tsc_start,
+	       rec->result != (int32_t)rec->count ? " short" : "");
+    }
+
+    printf("%" PRIu32 " transfers logged, %" PRIu32 " shown: %" PRIu64
+	   " sectors, %" PRIu32 " seeks\n", dt->total, n, sectors, seeks);
+
+    return 0;
+}
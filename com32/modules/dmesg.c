@@ -0,0 +1,58 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *   Boston MA 02110-1301, USA; either version 2 of the License, or
+ *   (at your option) any later version; incorporated herein by reference.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * dmesg.c
+ *
+ * Show the core's debug log, each line with the time it was logged.
+ * There is only a log in a core built with DEBUG_PORT.
+ */
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <syslinux/dmesg.h>
+
+int main(void)
+{
+    static char text[4096];
+    uint32_t pos = 0, lost;
+    uint64_t ns;
+    bool bol = true;
+    char *p, *q, *end;
+    int len;
+
+    if ((len = dmesg_read(&pos, &ns, text, sizeof text)) < 0) {
+	printf("The debug log is empty, or this core doesn't keep one\n");
+	return 1;
+    }
+
+    if ((lost = dmesg_lost()))
+	printf("(%" PRIu32 " older records overwritten)\n", lost);
+
+    do {
+	for (p = text, end = text + len; p < end; p = q) {
+	    if (bol)
+		printf("[%5" PRIu32 ".%06" PRIu32 "] ",
+		       (uint32_t)(ns / 1000000000),
+		       (uint32_t)(ns / 1000 % 1000000));
+
+	    q = memchr(p, '\n', end - p);
+	    q = q ? q + 1 : end;
+	    printf("%.*s", (int)(q - p), p);
+	    bol = q[-1] == '\n';
+	}
+    } while ((len = dmesg_read(&pos, &ns, text, sizeof text)) >= 0);
+
+    if (!bol)
+	printf("\n");
+
+    return 0;
+}
@@ -44,24 +44,108 @@
 #include <console.h>
 #include <dprintf.h>
 
-#include <syslinux/loadfile.h>
+#include <syslinux/zio.h>
 #include <syslinux/movebits.h>
 #include <syslinux/bootpm.h>
 
 /* If we don't have this much memory for the stack, signal failure */
 #define MIN_STACK	512
 
+/* Program headers further into the file than this are not looked for */
+#define MAX_PHOFF	(1 << 20)
+
 static inline void error(const char *msg)
 {
     fputs(msg, stderr);
 }
 
-int boot_elf(void *ptr, size_t len, char **argv)
+/*
+ * The file data of a PT_LOAD or PT_PHDR segment.  The segments are
+ * read in order of their offset, in one pass over the file, so that a
+ * compressed file doesn't have to be inflated into memory whole first.
+ */
+struct segment {
+    const Elf32_Phdr *ph;
+    char *data;			/* p_filesz bytes */
+};
+
+static int segment_by_offset(const void *a, const void *b)
+{
+    const struct segment *x = a, *y = b;
+
+    return x->ph->p_offset < y->ph->p_offset ? -1 :
+	x->ph->p_offset > y->ph->p_offset ? 1 : 0;
+}
+
+/* Copy what dst [start, end) of the file has in common with src at off */
+static void copy_overlap(char *dst, size_t start, size_t end,
+			 const char *src, size_t off, size_t len)
+{
+    size_t lo = max(start, off);
+    size_t hi = min(end, off + len);
+
+    if (lo < hi)
+	memcpy(dst + (lo - start), src + (lo - off), hi - lo);
+}
+
+/*
+ * Read the data of the segments, which are sorted by offset; head is
+ * what was read of the file for the headers.  Where a segment starts
+ * before the point the file has been read to, that part was read for
+ * the headers or for an earlier segment, and is copied from there.
+ */
+static int read_segments(FILE *f, const char *head, size_t head_len,
+			 struct segment *seg, int nseg)
 {
-    char *cptr = ptr;
-    Elf32_Ehdr *eh = ptr;
+    static char skip[4096];
+    size_t pos = head_len;
+    size_t start, end, n;
+    int i, j;
+
+    for (i = 0; i < nseg; i++) {
+	start = seg[i].ph->p_offset;
+	end = start + seg[i].ph->p_filesz;
+
+	seg[i].data = malloc(seg[i].ph->p_filesz);
+	if (!seg[i].data)
+	    return -1;
+
+	if (start < pos) {
+	    copy_overlap(seg[i].data, start, min(end, pos),
+			 head, 0, head_len);
+	    for (j = 0; j < i; j++)
+		copy_overlap(seg[i].data, start, min(end, pos),
+			     seg[j].data, seg[j].ph->p_offset,
+			     seg[j].ph->p_filesz);
+	}
+
+	while (pos < start) {
+	    n = min(start - pos, sizeof skip);
+	    if (fread(skip, 1, n, f) != n)
+		return -1;
+	    pos += n;
+	}
+
+	if (end > pos) {
+	    n = end - pos;
+	    if (fread(seg[i].data + (pos - start), 1, n, f) != n)
+		return -1;
+	    pos = end;
+	}
+    }
+
+    return 0;
+}
+
+int boot_elf(FILE *f, char **argv)
+{
+    Elf32_Ehdr *eh;
     Elf32_Phdr *ph;
     unsigned int i;
+    char *head, *p;
+    size_t head_len;
+    struct segment *seg = NULL, *sp;
+    int nseg = 0;
     struct syslinux_movelist *ml = NULL;
     struct syslinux_memmap *mmap = NULL, *amap = NULL;
     struct syslinux_pm_regs regs;
@@ -85,8 +169,10 @@ int boot_elf(void *ptr, size_t len, char **argv)
      * allocated.
      */
 
-    if (len < sizeof(Elf32_Ehdr))
+    head = malloc(sizeof(Elf32_Ehdr));
+    if (!head || fread(head, 1, sizeof(Elf32_Ehdr), f) != sizeof(Elf32_Ehdr))
 	goto bail;
+    eh = (Elf32_Ehdr *) head;
 
     /* Must be ELF, 32-bit, littleendian, version 1 */
     if (memcmp(eh->e_ident, "\x7f" "ELF\1\1\1", 6))
@@ -103,7 +189,7 @@ int boot_elf(void *ptr, size_t len, char **argv)
     if (eh->e_version != EV_CURRENT)
 	goto bail;
 
-    if (eh->e_ehsize < sizeof(Elf32_Ehdr) || eh->e_ehsize >= len)
+    if (eh->e_ehsize < sizeof(Elf32_Ehdr))
 	goto bail;
 
     if (eh->e_phentsize < sizeof(Elf32_Phdr))
@@ -112,7 +198,34 @@ int boot_elf(void *ptr, size_t len, char **argv)
     if (!eh->e_phnum)
 	goto bail;
 
-    if (eh->e_phoff + eh->e_phentsize * eh->e_phnum > len)
+    /* The program headers normally follow right on; read up to their end */
+    if (eh->e_phoff < sizeof(Elf32_Ehdr) || eh->e_phoff > MAX_PHOFF)
+	goto bail;
+
+    head_len = eh->e_phoff + eh->e_phentsize * eh->e_phnum;
+    p = realloc(head, head_len);
+    if (!p)
+	goto bail;
+    head = p;
+    eh = (Elf32_Ehdr *) head;
+    if (fread(head + sizeof(Elf32_Ehdr), 1, head_len - sizeof(Elf32_Ehdr),
+	      f) != head_len - sizeof(Elf32_Ehdr))
+	goto bail;
+
+    seg = calloc(eh->e_phnum, sizeof *seg);
+    if (!seg)
+	goto bail;
+
+    ph = (Elf32_Phdr *) (head + eh->e_phoff);
+    for (i = 0; i < eh->e_phnum; i++) {
+	if ((ph->p_type == PT_LOAD || ph->p_type == PT_PHDR) &&
+	    min(ph->p_memsz, ph->p_filesz))
+	    seg[nseg++].ph = ph;
+	ph = (Elf32_Phdr *) ((char *)ph + eh->e_phentsize);
+    }
+
+    qsort(seg, nseg, sizeof *seg, segment_by_offset);
+    if (read_segments(f, head, head_len, seg, nseg))
 	goto bail;
 
     mmap = syslinux_memory_map();
@@ -123,7 +236,7 @@ int boot_elf(void *ptr, size_t len, char **argv)
     dprintf("Initial memory map:\n");
     syslinux_dump_memmap(mmap);
 
-    ph = (Elf32_Phdr *) (cptr + eh->e_phoff);
+    ph = (Elf32_Phdr *) (head + eh->e_phoff);
 
     for (i = 0; i < eh->e_phnum; i++) {
 	if (ph->p_type == PT_LOAD || ph->p_type == PT_PHDR) {
@@ -147,10 +260,11 @@ int boot_elf(void *ptr, size_t len, char **argv)
 	    if (syslinux_add_memmap(&amap, addr, dsize, SMT_ALLOC))
 		goto bail;
 
-	    if (ph->p_filesz) {
+	    if (dsize) {
 		/* Data present region.  Create a move entry for it. */
-		if (syslinux_add_movelist
-		    (&ml, addr, (addr_t) cptr + ph->p_offset, dsize))
+		for (sp = seg; sp->ph != ph; sp++)
+		    ;
+		if (syslinux_add_movelist(&ml, addr, (addr_t) sp->data, dsize))
 		    goto bail;
 	    }
 	    if (msize > dsize) {
@@ -251,6 +365,10 @@ int boot_elf(void *ptr, size_t len, char **argv)
 bail:
     if (stack_frame)
 	free(stack_frame);
+    while (nseg--)
+	free(seg[nseg].data);
+    free(seg);
+    free(head);
     syslinux_free_memmap(amap);
     syslinux_free_memmap(mmap);
     syslinux_free_movelist(ml);
@@ -260,20 +378,21 @@ bail:
 
 int main(int argc, char *argv[])
 {
-    void *data;
-    size_t data_len;
+    FILE *f;
 
     if (argc < 2) {
 	error("Usage: elf.c32 elf_file arguments...\n");
 	return 1;
     }
 
-    if (zloadfile(argv[1], &data, &data_len)) {
+    f = zfopen(argv[1], "r");
+    if (!f) {
 	error("Unable to load file\n");
 	return 1;
     }
 
-    boot_elf(data, data_len, &argv[1]);
+    boot_elf(f, &argv[1]);
+    fclose(f);
     error("Invalid ELF file or insufficient memory\n");
     return 1;
 }
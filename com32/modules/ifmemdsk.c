@@ -38,12 +38,12 @@ and is found, then the 'detected_cmd' action will be taken, else the\n\
 #include <com32.h>
 #include <console.h>
 #include <syslinux/boot.h>
+#include <pmapi.h>
 
 /* Pull in MEMDISK common structures */
 #include "../../memdisk/mstructs.h"
 
 /*** Macros */
-#define M_GET_DRIVE_PARAMS (0x08)
 #define M_SEGOFFTOPTR(seg, off) (((seg) << 4) + (off))
 #define M_INT13H M_SEGOFFTOPTR(0x0000, 0x0013 * 4)
 #define M_FREEBASEMEM M_SEGOFFTOPTR(0x0040, 0x0013)
@@ -160,35 +160,17 @@ int main(int argc, char ** argv) {
   }
 
 static const s_mdi * installation_check(int drive) {
-    com32sys_t params, results;
-    int found;
-
-    /* Set parameters for INT 0x13 call */
-    memset(&params, 0, sizeof params);
-    params.eax.w[0] = M_GET_DRIVE_PARAMS << 8;
-    params.edx.w[0] = drive;
-    /* 'ME' 'MD' 'IS' 'K?' */
-    params.eax.w[1] = 0x454D;
-    params.ecx.w[1] = 0x444D;
-    params.edx.w[1] = 0x5349;
-    params.ebx.w[1] = 0x3F4B;
-
-    /* Perform the call */
-    __intcall(0x13, &params, &results);
-
-    /* Check result */
-    found = (
-        /* '!M' 'EM' 'DI' 'SK' */
-        results.eax.w[1] == 0x4D21 &&
-        results.ecx.w[1] == 0x4D45 &&
-        results.edx.w[1] == 0x4944 &&
-        results.ebx.w[1] == 0x4B53
-      );
-
-    if (found)
-      return MK_PTR(results.es, results.edi.w[0]);
+    struct com32_disk_probe probe;
+
+    /*
+     * The core asks each drive once, MEMDISK check included, and
+     * keeps the answer for the rest of the session
+     */
+    if (pmapi_disk_probe(drive, &probe) ||
+        !(probe.flags & COM32_DISK_MEMDISK))
+      return NULL;
 
-    return NULL;
+    return (const s_mdi *) probe.memdisk_info;
   }
 
 static int scan_drives(void) {
@@ -330,6 +312,9 @@ static void memdisk_info(const s_mdi * mdi) {
         bootloadername(mdi->bootloaderid),
         cmdline
       );
+    /* A sparse image has no flat copy in memory */
+    if (!mdi->diskbuf)
+      printf("  sparse image, the disk is not in memory as a whole\n");
     return;
   }
 
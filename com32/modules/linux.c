@@ -44,9 +44,11 @@
 #include <stdio.h>
 #include <string.h>
 #include <console.h>
+#include <fs.h>
 #include <syslinux/loadfile.h>
 #include <syslinux/linux.h>
 #include <syslinux/pxe.h>
+#include <syslinux/boottime.h>
 
 enum ldmode {
     ldmode_raw,
@@ -231,6 +233,57 @@ static int process_initramfs_args(char *arg, struct initramfs *initramfs,
     return 0;
 }
 
+/* Prefetch each file of a comma-separated list, with any @target cut off */
+static void prefetch_list(const char *list)
+{
+    char *name;
+    size_t n;
+
+    for (;;) {
+	n = strcspn(list, ",");
+	if (n && (name = strndup(list, strcspn(list, ",@")))) {
+	    prefetch_file(name);
+	    free(name);
+	}
+
+	list += n;
+	if (!*list++)
+	    return;
+    }
+}
+
+/*
+ * Let the filesystem know about the files we are going to read, in the
+ * order we read them; one that can fetches them all at once.
+ */
+static void prefetch_files(const char *kernel_name, char **argv)
+{
+    char **argl, *arg;
+
+    prefetch_file(kernel_name);
+
+    if ((arg = find_argument(argv, "initrd=")))
+	prefetch_list(arg);
+
+    argl = argv;
+    while ((argl = find_arguments(argl, &arg, "initrd+="))) {
+	argl++;
+	prefetch_list(arg);
+    }
+
+    argl = argv;
+    while ((argl = find_arguments(argl, &arg, "initrdfile="))) {
+	argl++;
+	prefetch_list(arg);
+    }
+
+    argl = argv;
+    while ((argl = find_arguments(argl, &arg, "dtb="))) {
+	argl++;
+	prefetch_file(arg);
+    }
+}
+
 static int setup_data_file(struct setup_data *setup_data,
 			   uint32_t type, const char *filename,
 			   bool opt_quiet)
@@ -302,15 +355,19 @@ int main(int argc, char *argv[])
     if (find_boolean(argp, "quiet"))
 	opt_quiet = true;
 
+    prefetch_files(kernel_name, argv);
+
     if (!opt_quiet)
 	printf("Loading %s... ", kernel_name);
     errno = 0;
+    boot_time_stamp(BOOT_PHASE_KERNEL_LOAD);
     if (loadfile(kernel_name, &kernel_data, &kernel_len)) {
 	if (opt_quiet)
 	    printf("Loading %s ", kernel_name);
 	printf("failed: ");
 	goto bail;
     }
+    boot_time_stamp(BOOT_PHASE_KERNEL_LOADED);
     if (!opt_quiet)
 	printf("ok\n");
 
@@ -330,6 +387,7 @@ int main(int argc, char *argv[])
     }
 
     /* Process initramfs arguments */
+    boot_time_stamp(BOOT_PHASE_INITRD_LOAD);
     if ((arg = find_argument(argp, "initrd="))) {
 	if (process_initramfs_args(arg, initramfs, kernel_name, ldmode_raw,
 				   opt_quiet))
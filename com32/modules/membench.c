@@ -0,0 +1,152 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *   Boston MA 02110-1301, USA; either version 2 of the License, or
+ *   (at your option) any later version; incorporated herein by reference.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * membench.c
+ *
+ * Time memcpy() and memset() with each of the strategies they can
+ * use, across a range of sizes, to see where the crossovers lie on
+ * this machine and whether x86_init_mem() picked sensible ones.
+ *
+ * Usage: membench.c32 [max size in KB]
+ */
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <com32.h>
+#include <cpufeature.h>
+#include <sys/cpu.h>
+#include <sys/memops.h>
+
+#define MIN_SIZE	16
+#define DEF_MAX_KB	16384
+#define TOTAL_BYTES	(64 << 20)	/* Work per measurement */
+
+enum { GENERIC, REP, NT, NMODES };
+
+static const char * const mode_name[NMODES] = { "generic", "rep", "nt" };
+
+static const struct mem_tune mode_tune[NMODES] = {
+    [GENERIC] = { SIZE_MAX, SIZE_MAX },
+    [REP]     = { MEM_DISPATCH_MIN, SIZE_MAX },
+    [NT]      = { SIZE_MAX, MEM_DISPATCH_MIN },
+};
+
+static char *src, *dst;
+
+/* Cycles per KB for one operation of the given size */
+static uint32_t bench(int op, size_t size)
+{
+    uint32_t i, reps = TOTAL_BYTES / size;
+    uint64_t t0, t1;
+
+    if (!reps)
+	reps = 1;
+
+    t0 = rdtsc();
+    for (i = 0; i < reps; i++) {
+	if (op)
+	    memset(dst, i, size);
+	else
+	    memcpy(dst, src, size);
+    }
+    t1 = rdtsc();
+
+    return (uint32_t)((t1 - t0) * 1024 / ((uint64_t)reps * size));
+}
+
+static void run(int op, size_t max)
+{
+    struct mem_tune saved = __mem_tune;
+    uint32_t t[NMODES];
+    size_t size;
+    int m, best, prev = -1;
+
+    printf("\n%s, cycles per KB:\n%10s", op ? "memset" : "memcpy", "size");
+    for (m = 0; m < NMODES; m++)
+	printf(" %10s", mode_name[m]);
+    printf("\n");
+
+    for (size = MIN_SIZE; size <= max; size <<= 1) {
+	best = 0;
+	for (m = 0; m < NMODES; m++) {
+	    /* Sizes below the dispatch point always go the generic way */
+	    if (m != GENERIC && size < MEM_DISPATCH_MIN) {
+		t[m] = 0;
+		continue;
+	    }
+	    __mem_tune = mode_tune[m];
+	    t[m] = bench(op, size);
+	    if (t[m] < t[best])
+		best = m;
+	}
+	__mem_tune = saved;
+
+	printf("%10zu", size);
+	for (m = 0; m < NMODES; m++) {
+	    if (t[m])
+		printf(" %10" PRIu32, t[m]);
+	    else
+		printf(" %10s", "-");
+	}
+	if (prev >= 0 && best != prev)
+	    printf("  <- %s from here", mode_name[best]);
+	printf("\n");
+	prev = best;
+    }
+}
+
+static void show_limit(size_t limit)
+{
+    if (limit == SIZE_MAX)
+	printf("never");
+    else
+	printf("from %zu bytes", limit);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t max = (argc > 1 ? atoi(argv[1]) : DEF_MAX_KB) << 10;
+
+#if __SIZEOF_POINTER__ == 4
+    if (!cpu_has_eflag(EFLAGS_ID) ||
+	!(cpuid_edx(1) & (1 << X86_FEATURE_TSC))) {
+	printf("This CPU has no TSC\n");
+	return 1;
+    }
+#endif
+
+    if (max < MIN_SIZE)
+	max = MIN_SIZE;
+
+    while (!(src = malloc(max)) || !(dst = malloc(max))) {
+	free(src);
+	max >>= 1;
+	if (max < MIN_SIZE) {
+	    printf("Out of memory\n");
+	    return 1;
+	}
+    }
+    memset(src, 0xa5, max);
+
+    printf("Current choice: rep ");
+    show_limit(__mem_tune.rep);
+    printf(", nt ");
+    show_limit(__mem_tune.nt);
+    printf("\n");
+
+    run(0, max);
+    run(1, max);
+
+    free(src);
+    free(dst);
+    return 0;
+}
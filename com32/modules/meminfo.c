@@ -14,13 +14,15 @@
 /*
  * meminfo.c
  *
- * Dump the memory map of the system
+ * Dump the memory map of the system, and how the Syslinux heaps are
+ * used
  */
 #include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
 #include <console.h>
 #include <com32.h>
+#include <pmapi.h>
 
 struct e820_data {
     uint64_t base;
@@ -124,9 +126,50 @@ static void dump_legacy(void)
 	   oreg.ecx.w[0], oreg.ecx.w[0], oreg.edx.w[0], oreg.edx.w[0] << 6);
 }
 
+static void dump_heap(const char *name, const struct com32_heap_stats *hs)
+{
+    static const char *const owners[COM32_MEM_OWNERS] = {
+	[COM32_MEM_CORE]   = "core",
+	[COM32_MEM_MODULE] = "module",
+    };
+    int i, last;
+
+    printf("%s heap:", name);
+    for (i = 0; i < COM32_MEM_OWNERS; i++)
+	printf("  %s %u bytes in %u blocks", owners[i],
+	       hs->used_bytes[i], hs->used_blocks[i]);
+    printf("\n  free %u bytes in %u blocks, largest %u\n",
+	   hs->free_bytes, hs->free_blocks, hs->largest_free);
+
+    for (last = COM32_MEM_HIST - 1; last > 0; last--) {
+	if (hs->free_hist[last])
+	    break;
+    }
+    for (i = 0; hs->free_blocks && i <= last; i++) {
+	printf("  %9u%s%u", 32U << i,
+	       i == COM32_MEM_HIST - 1 ? " and up: " : ": ", hs->free_hist[i]);
+	if ((i & 3) == 3 || i == last)
+	    putchar('\n');
+    }
+}
+
+static void dump_heaps(void)
+{
+    struct com32_mem_stats st;
+
+    if (pmapi_mem_stats(&st)) {
+	printf("No heap statistics\n");
+	return;
+    }
+
+    dump_heap("High memory", &st.heap[0]);
+    dump_heap("Low memory", &st.heap[1]);
+}
+
 int main(int argc __unused, char **argv __unused)
 {
     dump_legacy();
     dump_e820();
+    dump_heaps();
     return 0;
 }
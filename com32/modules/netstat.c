@@ -0,0 +1,68 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *   Boston MA 02110-1301, USA; either version 2 of the License, or
+ *   (at your option) any later version; incorporated herein by reference.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * netstat.c
+ *
+ * Display the network transfer statistics of PXELINUX
+ */
+#include <inttypes.h>
+#include <stdio.h>
+#include <pmapi.h>
+
+/* KiB/s, for bytes moved in ms milliseconds */
+static unsigned int rate(uint64_t bytes, uint32_t ms)
+{
+    return ms ? (unsigned int)(bytes * 1000 / 1024 / ms) : 0;
+}
+
+static const char * const pool_names[COM32_NET_POOLS] = {
+    [COM32_NET_PBUF]	= "Pbufs:",
+    [COM32_NET_TCP_SEG]	= "Segments:",
+    [COM32_NET_NETBUF]	= "Netbufs:",
+};
+
+int main(void)
+{
+    struct com32_net_stats st;
+    const struct com32_net_pool_stats *p;
+    int i;
+
+    if (pmapi_net_stats(&st)) {
+	printf("Not booted from the network\n");
+	return 1;
+    }
+
+    printf("Files:       %" PRIu32 ", %" PRIu64 " bytes in %" PRIu32
+	   " ms (%u KiB/s)\n", st.files, st.bytes, st.xfer_ms,
+	   rate(st.bytes, st.xfer_ms));
+    if (st.files)
+	printf("Last file:   %" PRIu32 " bytes in %" PRIu32
+	       " ms (%u KiB/s)\n", st.last_bytes, st.last_ms,
+	       rate(st.last_bytes, st.last_ms));
+    printf("Packets:     %" PRIu32 " received, %" PRIu32 " sent\n",
+	   st.rx_packets, st.tx_packets);
+    printf("TFTP:        %" PRIu32 " timeouts, %" PRIu32
+	   " blocks out of order\n", st.tftp_timeouts, st.tftp_dupblocks);
+    printf("TCP:         %" PRIu32 " retransmits, %" PRIu32
+	   " duplicate segments, %" PRIu32 " window stalls\n",
+	   st.tcp_rexmits, st.tcp_dupsegs, st.tcp_stalls);
+
+    for (i = 0; i < COM32_NET_POOLS; i++) {
+	p = &st.pool[i];
+	if (!p->avail)
+	    continue;
+	printf("%-12s %" PRIu32 " of %" PRIu32 " in use, at most %" PRIu32
+	       ", %" PRIu32 " times none left\n", pool_names[i],
+	       p->used, p->avail, p->max, p->err);
+    }
+
+    return 0;
+}
@@ -0,0 +1,209 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *   Boston MA 02110-1301, USA; either version 2 of the License, or
+ *   (at your option) any later version; incorporated herein by reference.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * profile.c
+ *
+ * Start and stop the core's sampling profiler, and show where the
+ * samples fell, by the nearest symbol of the module they fell in.
+ *
+ * Usage: profile.c32 start [slots]
+ *        profile.c32 stop
+ *        profile.c32 [report] [count]
+ *
+ * Only the exported symbols of the core are known, so a sample in one
+ * of its static functions is shown against the exported one before it.
+ * A module that has been unloaded since can't be told apart from the
+ * core; the module that was running at the time is shown as well.
+ */
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/module.h>
+#include <syslinux/profile.h>
+
+struct hit {
+    const char *module;		/* Where the code is */
+    const char *symbol;
+    const char *context;	/* What was running */
+    uint32_t count;
+};
+
+/* The module the address is in; the core has no extent, so it is last */
+static struct elf_module *module_at(uint32_t addr)
+{
+    struct elf_module *m, *core = NULL;
+
+    for_each_module(m) {
+	if (!m->module_size) {
+	    if (!strcmp(m->name, "(core)"))
+		core = m;
+	    continue;
+	}
+	if (addr >= (uintptr_t)m->module_addr &&
+	    addr - (uintptr_t)m->module_addr < m->module_size)
+	    return m;
+    }
+
+    return core;
+}
+
+/* The function symbol of m at or before addr, or NULL */
+static const char *symbol_at(struct elf_module *m, uint32_t addr)
+{
+    const char *best = NULL;
+    uint32_t best_addr = 0, a;
+    const Elf_Sym *sym;
+    char *p, *end;
+
+    if (!m->sym_table || !m->syment_size)
+	return NULL;
+
+    p = m->sym_table;
+    end = p + m->symtable_size;
+    for (; p + m->syment_size <= end; p += m->syment_size) {
+	sym = (const Elf_Sym *)p;
+	if (ELF32_ST_TYPE(sym->st_info) != STT_FUNC || !sym->st_value)
+	    continue;
+
+	a = (uintptr_t)module_get_absolute(sym->st_value, m);
+	if (a <= addr && a >= best_addr) {
+	    best_addr = a;
+	    best = m->str_table + sym->st_name;
+	}
+    }
+
+    return best;
+}
+
+static int hit_by_place(const void *a, const void *b)
+{
+    const struct hit *x = a, *y = b;
+    int rv;
+
+    if ((rv = strcmp(x->module, y->module)))
+	return rv;
+    if ((rv = strcmp(x->symbol, y->symbol)))
+	return rv;
+    return strcmp(x->context, y->context);
+}
+
+static int hit_by_count(const void *a, const void *b)
+{
+    const struct hit *x = a, *y = b;
+
+    return x->count < y->count ? 1 : x->count > y->count ? -1 : 0;
+}
+
+static int report(const struct profile *p, uint32_t count)
+{
+    const struct profile_bucket *b;
+    struct elf_module *m;
+    struct hit *hits;
+    uint32_t i, n, nhits;
+
+    printf("%" PRIu32 " ticks%s: %" PRIu32 " sampled, %" PRIu32
+	   " in the BIOS, %" PRIu32 " dropped\n",
+	   p->ticks, p->running ? " so far" : "", p->samples,
+	   p->ticks > p->samples ? p->ticks - p->samples : 0, p->dropped);
+
+    hits = calloc(p->size, sizeof *hits);
+    if (!hits) {
+	printf("profile: out of memory\n");
+	return 1;
+    }
+
+    /* Hold still while we look */
+    profile_stop();
+
+    for (i = n = 0; i < p->size; i++) {
+	b = &p->buckets[i];
+	if (!b->count)
+	    continue;
+
+	m = module_at(b->eip);
+	hits[n].module = m ? m->name : "?";
+	hits[n].symbol = m ? symbol_at(m, b->eip) : NULL;
+	if (!hits[n].symbol)
+	    hits[n].symbol = "?";
+	hits[n].context = p->contexts[b->context];
+	hits[n].count = b->count;
+	n++;
+    }
+
+    /* Fold the addresses of each function together */
+    qsort(hits, n, sizeof *hits, hit_by_place);
+    for (i = nhits = 0; i < n; i++) {
+	if (nhits && !hit_by_place(&hits[nhits - 1], &hits[i]))
+	    hits[nhits - 1].count += hits[i].count;
+	else
+	    hits[nhits++] = hits[i];
+    }
+    qsort(hits, nhits, sizeof *hits, hit_by_count);
+
+    if (count > nhits)
+	count = nhits;
+
+    printf("%8s %6s  %-28s %-16s %s\n",
+	   "samples", "%", "function", "module", "running");
+    for (i = 0; i < count; i++) {
+	printf("%8" PRIu32 " %5" PRIu32 ".%" PRIu32 "  %-28s %-16s %s\n",
+	       hits[i].count,
+	       hits[i].count * 100 / p->samples,
+	       hits[i].count * 1000 / p->samples % 10,
+	       hits[i].symbol, hits[i].module, hits[i].context);
+    }
+
+    free(hits);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const struct profile *p;
+    const char *cmd = argc > 1 ? argv[1] : "report";
+    uint32_t count = 20;
+
+    if (!strcmp(cmd, "start")) {
+	if (profile_start(argc > 2 ? strtoul(argv[2], NULL, 0) : 4096)) {
+	    printf("profile: can't start the profiler\n");
+	    return 1;
+	}
+	return 0;
+    }
+
+    if (!strcmp(cmd, "stop")) {
+	profile_stop();
+	return 0;
+    }
+
+    if (!strcmp(cmd, "report")) {
+	if (argc > 2)
+	    count = strtoul(argv[2], NULL, 0);
+    } else if (*cmd >= '0' && *cmd <= '9') {
+	count = strtoul(cmd, NULL, 0);
+    } else {
+	printf("Usage: profile.c32 start [slots] | stop | [report] [count]\n");
+	return 1;
+    }
+
+    p = profile_get();
+    if (!p) {
+	printf("The profiler has not been started\n");
+	return 1;
+    }
+    if (!p->samples) {
+	printf("No samples yet\n");
+	return 0;
+    }
+
+    return report(p, count);
+}
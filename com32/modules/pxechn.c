@@ -41,6 +41,7 @@
 #include <getkey.h>
 #include <dhcp.h>
 #include <limits.h>
+#include <pmapi.h>
 
 
 #ifdef DEBUG
@@ -822,12 +823,51 @@ int pxechn_parse_args(int argc, char *argv[], struct pxelinux_opt *pxe,
     return rv;
 }
 
+/* pxechn_pkt_limit: Room the PXE stack has for a ptype packet
+ *	Input:
+ *	ptype	Packet type
+ *	Returns	the size of its buffer, 0 if unknown
+ */
+int pxechn_pkt_limit(int ptype)
+{
+    t_PXENV_GET_CACHED_INFO *ci;
+    int limit = 0;
+
+    if (!(ci = lzalloc(sizeof(t_PXENV_GET_CACHED_INFO))))
+	return 0;
+    ci->Status = PXENV_STATUS_FAILURE;
+    ci->PacketType = ptype;
+    pxe_call(PXENV_GET_CACHED_INFO, ci);
+    if (ci->Status == PXENV_STATUS_SUCCESS)
+	limit = ci->BufferLimit;
+    lfree(ci);
+    return limit;
+}
+
+/* pxechn_handoff: Pass what PXELINUX knows about the network (its DNS
+ *	cache, its neighbours' MAC addresses) on to a PXELINUX we chain,
+ *	so it doesn't have to ask again; an option given with -o wins
+ *	Input:
+ *	opts	Options of the packet to fill
+ */
+void pxechn_handoff(struct dhcp_option *opts)
+{
+    char buf[DHCP_OPT_LEN_MAX - 1];
+    int len;
+
+    len = pmapi_net_handoff(buf, sizeof buf);
+    if (len > 0)
+	pxechn_setopt(&opts[PXE_HANDOFF_OPT], buf, len);
+}
+
 int pxechn_args(int argc, char *argv[], struct pxelinux_opt *pxe)
 {
     pxe_bootp_t *bootp0, *bootp1;
     int ret = 0;
     struct dhcp_option *opts;
     char *str;
+    size_t len;
+    int limit;
 
     opts = pxe->opts[2];
     /* Start filling packet #1 */
@@ -841,6 +881,7 @@ int pxechn_args(int argc, char *argv[], struct pxelinux_opt *pxe)
     }
     pxe->p_unpacked[2] = 1;
     pxe->gip = bootp1->gip;
+    pxechn_handoff(opts);
 
     ret = pxechn_parse_args(argc, argv, pxe, opts);
     if (ret)
@@ -871,7 +912,17 @@ int pxechn_args(int argc, char *argv[], struct pxelinux_opt *pxe)
     }
     bootp1->gip = pxe->gip;
 
-    ret = dhcp_pack_packet(bootp1, (size_t *)&(pxe->p[5].len), opts);
+    /* The packet may grow as far as the PXE stack's buffer for it */
+    limit = min(pxechn_pkt_limit(PXENV_PACKET_TYPE_CACHED_REPLY), 2048);
+    len = (limit > pxe->p[5].len) ? limit : pxe->p[5].len;
+    ret = dhcp_pack_packet(bootp1, &len, opts);
+    if ((ret == ENOSPC) && (opts[PXE_HANDOFF_OPT].len >= 0)) {
+	/* The handoff is only a shortcut; do without it */
+	pxechn_opt_free(&opts[PXE_HANDOFF_OPT]);
+	len = (limit > pxe->p[5].len) ? limit : pxe->p[5].len;
+	ret = dhcp_pack_packet(bootp1, &len, opts);
+    }
+    pxe->p[5].len = len;
     if (ret) {
 	error("Could not pack packet\n");
 	return -ret;	/* dhcp_pack_packet always returns positive errors */
@@ -31,6 +31,7 @@
 #include <dprintf.h>
 
 #include <syslinux/loadfile.h>
+#include <syslinux/zio.h>
 #include <syslinux/movebits.h>
 #include <syslinux/bootrm.h>
 
@@ -70,20 +71,6 @@ static int boot_sdi(void *ptr, size_t len)
     struct syslinux_rm_regs regs;
     struct syslinux_movelist *ml = NULL;
 
-    /* **** Basic sanity checking **** */
-    if (hdr->Signature != SDI_SIGNATURE) {
-	fputs("No $SDI signature in file\n", stdout);
-	goto bail;
-    }
-    if (memcmp(hdr->Version, "0001", 4)) {
-	int i;
-	fputs("Warning: unknown SDI version: ", stdout);
-	for (i = 0; i < 4; i++)
-	    putchar(hdr->Version[i]);
-	putchar('\n');
-	/* Then try anyway... */
-    }
-
     /* **** Setup **** */
     mmap = syslinux_memory_map();
     amap = syslinux_dup_memmap(mmap);
@@ -141,22 +128,43 @@ bail:
 }
 
 /*
- * Check that the sum of all bytes from first 512 bytes (SDI header)
- * is 0 modulo 256.
+ * Check the SDI header, which is all that has been read of the file so
+ * far: the sum of all its bytes must be 0 modulo 256.
  */
-int has_valid_header(unsigned char *header)
+static int check_header(const struct SDIHeader *hdr)
 {
+    const unsigned char *p = (const unsigned char *)hdr;
     unsigned char checksum;
     unsigned int i;
 
+    if (hdr->Signature != SDI_SIGNATURE) {
+	error("No $SDI signature in file\n");
+	return -1;
+    }
+
     checksum = 0;
     for (i = 0; i < sizeof(struct SDIHeader); i++)
-	checksum += header[i];
-    return (!checksum);
+	checksum += p[i];
+    if (checksum) {
+	error("SDI header is corrupted\n");
+	return -1;
+    }
+
+    if (memcmp(hdr->Version, "0001", 4)) {
+	fputs("Warning: unknown SDI version: ", stdout);
+	for (i = 0; i < 4; i++)
+	    putchar(hdr->Version[i]);
+	putchar('\n');
+	/* Then try anyway... */
+    }
+
+    return 0;
 }
 
 int main(int argc, char *argv[])
 {
+    struct SDIHeader hdr;
+    FILE *f;
     void *data;
     size_t data_len;
 
@@ -168,18 +176,29 @@ int main(int argc, char *argv[])
     fputs("Loading ", stdout);
     fputs(argv[1], stdout);
     fputs("... ", stdout);
-    if (zloadfile(argv[1], &data, &data_len)) {
+
+    /* Look at the header before reading what may be hundreds of MB */
+    f = zfopen(argv[1], "r");
+    if (!f || fread(&hdr, 1, sizeof hdr, f) != sizeof hdr) {
 	error("failed!\n");
-	return 1;
+	goto bail;
     }
-    fputs("ok\n", stdout);
+    if (check_header(&hdr))
+	goto bail;
 
-    if (!has_valid_header(data)) {
-	error("SDI header is corrupted\n");
-	return 1;
+    if (floadfile(f, &data, &data_len, &hdr, sizeof hdr)) {
+	error("failed!\n");
+	goto bail;
     }
+    fclose(f);
+    fputs("ok\n", stdout);
 
     boot_sdi(data, data_len);
     error("Invalid SDI file or insufficient memory\n");
     return 1;
+
+bail:
+    if (f)
+	fclose(f);
+    return 1;
 }
@@ -0,0 +1,37 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *   Boston MA 02110-1301, USA; either version 2 of the License, or
+ *   (at your option) any later version; incorporated herein by reference.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * smp.c
+ *
+ * Wake the other CPUs to take jobs, or park them again.
+ *
+ * Usage: smp.c32 [start | park]
+ */
+#include <stdio.h>
+#include <string.h>
+#include <syslinux/smp.h>
+
+int main(int argc, char *argv[])
+{
+    const char *cmd = argc > 1 ? argv[1] : "";
+
+    if (!strcmp(cmd, "start"))
+	smp_start();
+    else if (!strcmp(cmd, "park"))
+	smp_park();
+    else if (*cmd) {
+	printf("Usage: smp.c32 [start | park]\n");
+	return 1;
+    }
+
+    printf("%d CPUs taking jobs\n", smp_cpus());
+    return 0;
+}
@@ -0,0 +1,127 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *   Boston MA 02110-1301, USA; either version 2 of the License, or
+ *   (at your option) any later version; incorporated herein by reference.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * threads.c
+ *
+ * Display how much CPU time the core threads have used, and control
+ * the context switch trace.
+ *
+ * Usage: threads.c32
+ *        threads.c32 trace <entries>|off
+ *        threads.c32 dump [count]
+ */
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslinux/threadstat.h>
+
+#define MAX_THREADS	32
+
+static struct thread_stat stats[MAX_THREADS];
+static int nstats;
+
+static const char *thread_name(const void *id)
+{
+    int i;
+
+    for (i = 0; i < nstats; i++) {
+	if (stats[i].id == id)
+	    return stats[i].name;
+    }
+
+    return "(exited)";
+}
+
+static int show_stats(void)
+{
+    const struct thread_stat *st;
+    uint64_t total = 0;
+    int i;
+
+    for (i = 0; i < nstats; i++)
+	total += stats[i].runtime;
+
+    printf("%-12s %11s %14s %5s %8s %8s %8s %10s\n", "thread", "prio",
+	   "cycles", "%", "in", "out", "blocks", "blocked ms");
+
+    for (i = 0; i < nstats; i++) {
+	st = &stats[i];
+	printf("%-12s %11d %14" PRIu64 " %5u %8" PRIu32 " %8" PRIu32
+	       " %8" PRIu32 " %10" PRIu32 "%s\n", st->name, st->prio,
+	       st->runtime,
+	       total ? (unsigned int)(st->runtime * 100 / total) : 0,
+	       st->switches_in, st->switches_out, st->blocks,
+	       st->blocked_ms, st->blocked_on ? " (asleep)" : "");
+    }
+
+    return 0;
+}
+
+static int dump_trace(const char *count)
+{
+    const struct thread_trace *tt;
+    const struct thread_trace_rec *rec;
+    uint32_t n, first, i;
+
+    tt = thread_trace_get();
+    if (!tt) {
+	printf("Switch tracing is off; use \"threads.c32 trace <entries>\"\n");
+	return 1;
+    }
+
+    n = tt->total < tt->size ? tt->total : tt->size;
+    if (count && (uint32_t)atoi(count) < n)
+	n = atoi(count);
+    first = tt->total - n;
+
+    printf("%8s %20s %-12s %-12s %s\n", "#", "tsc", "from", "to", "asleep on");
+
+    for (i = 0; i < n; i++) {
+	rec = &tt->rec[(first + i) % tt->size];
+	printf("%8" PRIu32 " %20" PRIu64 " %-12s %-12s", first + i,
+	       rec->tsc, thread_name(rec->from), thread_name(rec->to));
+	if (rec->sem)
+	    printf(" %p", rec->sem);
+	printf("\n");
+    }
+
+    printf("%" PRIu32 " switches logged, %" PRIu32 " shown\n", tt->total, n);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    nstats = thread_stats_get(stats, MAX_THREADS);
+    if (nstats > MAX_THREADS)
+	nstats = MAX_THREADS;
+
+    if (argc < 2)
+	return show_stats();
+
+    if (!strcmp(argv[1], "dump"))
+	return dump_trace(argc > 2 ? argv[2] : NULL);
+
+    if (!strcmp(argv[1], "trace") && argc > 2) {
+	unsigned int entries = strcmp(argv[2], "off") ? atoi(argv[2]) : 0;
+
+	if (thread_trace_enable(entries)) {
+	    printf("Not enough memory for %u entries\n", entries);
+	    return 1;
+	}
+	return 0;
+    }
+
+    printf("Usage: threads.c32\n"
+	   "       threads.c32 trace <entries>|off\n"
+	   "       threads.c32 dump [count]\n");
+    return 1;
+}
@@ -0,0 +1,98 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *   Boston MA 02110-1301, USA; either version 2 of the License, or
+ *   (at your option) any later version; incorporated herein by reference.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * trace.c
+ *
+ * Switch the core's tracepoint groups on and off, and display what
+ * they have logged.
+ *
+ * Usage: trace.c32			list the groups
+ *	  trace.c32 group... | -group... | all | off
+ *	  trace.c32 show [count]
+ */
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslinux/clock.h>
+#include <syslinux/trace.h>
+
+static void list_groups(void)
+{
+    const struct trace_log *tl = trace_get();
+    int i;
+
+    for (i = 0; i < TRACE_NGROUPS; i++)
+	printf("%-10s %s\n", trace_group_name(i),
+	       (trace_mask & (1U << i)) ? "on" : "off");
+
+    printf("%" PRIu32 " records logged\n", tl ? tl->total : 0);
+}
+
+static int show(const char *count)
+{
+    const struct trace_log *tl = trace_get();
+    const struct trace_rec *rec;
+    uint32_t n, first, i;
+    uint64_t tsc0 = 0;
+
+    if (!tl) {
+	printf("Nothing has been traced\n");
+	return 1;
+    }
+
+    n = tl->total < tl->size ? tl->total : tl->size;
+    if (count && (uint32_t)atoi(count) < n)
+	n = atoi(count);
+    first = tl->total - n;
+
+    printf("%8s %12s %-8s %-16s %-14s %18s %18s\n",
+	   "#", "us", "group", "tracepoint", "", "a", "b");
+
+    for (i = 0; i < n; i++) {
+	rec = &tl->rec[(first + i) % tl->size];
+	if (!i)
+	    tsc0 = rec->tsc;
+
+	printf("%8" PRIu32 " %12" PRIu64 " %-8s %-16s %-14s %#18" PRIx64
+	       " %#18" PRIx64 "\n", first + i,
+	       clock_cycles_to_ns(rec->tsc - tsc0) / 1000,
+	       trace_group_name(rec->group), rec->name, rec->str,
+	       rec->a, rec->b);
+    }
+
+    printf("%" PRIu32 " records logged, %" PRIu32 " shown\n",
+	   tl->total, n);
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int i, rv = 0;
+
+    if (argc < 2) {
+	list_groups();
+	return 0;
+    }
+
+    if (!strcmp(argv[1], "show"))
+	return show(argv[2]);
+
+    for (i = 1; i < argc; i++) {
+	if (trace_set(argv[i])) {
+	    printf("trace: %s: unknown group or out of memory\n", argv[i]);
+	    rv = 1;
+	}
+    }
+
+    return rv;
+}
@@ -0,0 +1,41 @@
+/*
+ * Dump the core disk I/O trace ring
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <syslinux/disktrace.h>
+#include "sysdump.h"
+
+void dump_disktrace(struct upload_backend *be)
+{
+    const struct disk_trace *dt;
+    struct disk_trace_rec *buf;
+    uint32_t n, first, i;
+
+    dt = disk_trace_get();
+    if (!dt)
+	return;
+
+    printf("Dumping disk trace... ");
+
+    n = dt->total < dt->size ? dt->total : dt->size;
+    first = dt->total - n;
+
+    buf = malloc((n ? n : 1) * sizeof *buf);
+    if (!buf)
+	return;			/* FAILED */
+
+    /* Unroll the ring so the file is in chronological order */
+    for (i = 0; i < n; i++)
+	buf[i] = dt->rec[(first + i) % dt->size];
+
+    cpio_mkdir(be, "disktrace");
+    cpio_writefile(be, "disktrace/total", &dt->total, sizeof dt->total);
+    cpio_writefile(be, "disktrace/records", buf, n * sizeof *buf);
+
+    free(buf);
+
+    printf("done.\n");
+}
@@ -33,7 +33,8 @@ __noreturn die(const char *msg)
 
 static void dump_all(struct upload_backend *be, const char *argv[])
 {
-    cpio_init(be, argv);
+    if (cpio_init(be, argv))
+	die("unable to start the upload");
 
     cpio_writefile(be, "sysdump", version, sizeof version-1);
 
@@ -44,6 +45,7 @@ static void dump_all(struct upload_backend *be, const char *argv[])
     dump_cpuid(be);
     dump_pci(be);
     dump_vesa_tables(be);
+    dump_disktrace(be);
 
     cpio_close(be);
     flush_data(be);
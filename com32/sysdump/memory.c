@@ -5,6 +5,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <sys/cpu.h>
 #include "sysdump.h"
 
@@ -28,15 +30,119 @@ void snapshot_lowmem(void)
     }
 }
 
-static void dump_memory_range(struct upload_backend *be, const void *where,
-			      const void *addr, size_t len)
+/*
+ * Pages that hold one 32-bit word over and over (mostly zero, some
+ * 0xffffffff) are not dumped as data.  Instead the runs of them are
+ * listed in memory/fill, one "start length word" line each, in hex;
+ * the data files around them are cut at page boundaries.
+ */
+#define DUMP_PAGE	4096
+
+struct fill {
+    size_t addr;
+    size_t len;
+    uint32_t word;
+};
+
+static struct fill *fills;
+static size_t nfills, maxfills;
+
+static bool page_fill(const void *page, uint32_t *word)
+{
+    const uint32_t *p = page;
+    uint32_t w = p[0];
+    size_t i;
+
+    for (i = 0; i < DUMP_PAGE / sizeof(uint32_t); i += 4) {
+	if ((p[i] ^ w) | (p[i + 1] ^ w) | (p[i + 2] ^ w) | (p[i + 3] ^ w))
+	    return false;
+    }
+
+    *word = w;
+    return true;
+}
+
+/* Returns false if out of memory, in which case the page gets dumped */
+static bool add_fill(size_t addr, uint32_t word)
+{
+    struct fill *f;
+
+    if (nfills) {
+	f = &fills[nfills - 1];
+	if (f->word == word && f->addr + f->len == addr) {
+	    f->len += DUMP_PAGE;
+	    return true;
+	}
+    }
+
+    if (nfills == maxfills) {
+	size_t n = maxfills ? maxfills * 2 : 64;
+
+	f = realloc(fills, n * sizeof *fills);
+	if (!f)
+	    return false;
+	fills = f;
+	maxfills = n;
+    }
+
+    f = &fills[nfills++];
+    f->addr = addr;
+    f->len = DUMP_PAGE;
+    f->word = word;
+    return true;
+}
+
+static void dump_memory_data(struct upload_backend *be, const char *where,
+			     size_t addr, size_t len)
 {
     char filename[32];
 
-    sprintf(filename, "memory/%08zx", (size_t)addr);
+    if (!len)
+	return;
+
+    sprintf(filename, "memory/%08zx", addr);
     cpio_writefile(be, filename, where, len);
 }
 
+static void dump_memory_range(struct upload_backend *be, const void *where,
+			      const void *addr, size_t len)
+{
+    const char *data = where;
+    size_t base = (size_t)addr;
+    size_t off, start = 0;
+    uint32_t word;
+
+    for (off = 0; off + DUMP_PAGE <= len; off += DUMP_PAGE) {
+	if (!page_fill(data + off, &word))
+	    continue;
+	if (!add_fill(base + off, word))
+	    break;
+
+	dump_memory_data(be, data + start, base + start, off - start);
+	start = off + DUMP_PAGE;
+    }
+
+    dump_memory_data(be, data + start, base + start, len - start);
+}
+
+static void dump_fills(struct upload_backend *be)
+{
+    char *text, *p;
+    size_t i;
+
+    text = malloc(nfills * 48 + 1);
+    if (!text)
+	return;
+
+    p = text;
+    for (i = 0; i < nfills; i++)
+	p += sprintf(p, "%08zx %08zx %08x\n",
+		     fills[i].addr, fills[i].len, fills[i].word);
+
+    cpio_writefile(be, "memory/fill", text, p - text);
+    free(text);
+}
+
 void dump_memory(struct upload_backend *be)
 {
     printf("Dumping memory... ");
@@ -46,5 +152,10 @@ void dump_memory(struct upload_backend *be)
     if (lowmem)
 	dump_memory_range(be, lowmem, zero_addr, lowmem_len);
 
+    dump_fills(be);
+    free(fills);
+    fills = NULL;
+    nfills = maxfills = 0;
+
     printf("done.\n");
 }
@@ -7,6 +7,7 @@
 #include <syslinux/memscan.h>
 #include <syslinux/firmware.h>
 #include <syslinux/video.h>
+#include <syslinux/smp.h>
 
 #include <sys/vesa/vesa.h>
 #include <sys/vesa/video.h>
@@ -376,6 +377,12 @@ static int bios_vesacon_set_mode(struct vesa_info *vesa_info, int *px, int *py,
 	goto exit;
     }
 
+    /* Let the CPU combine writes to the linear framebuffer */
+    if (mi->mode_attr & 0x0080)
+	mtrr_set_wc((uintptr_t)mi->lfb_ptr,
+		    (uint32_t)mi->logical_scan * mi->v_res,
+		    (uint32_t)vesa_info->gi.total_memory << 16);
+
 exit:
     if (vi)
 	lfree(vi);
@@ -655,6 +662,7 @@ void bios_init(void)
 	bios_free_mem = (uint16_t *)0x413;
 	syslinux_memscan_add(&bios_memscan);
 	mem_init();
+	dmesg_init();
 
 	dprintf("%s%s", syslinux_banner, copyright_str);
 
@@ -673,6 +681,9 @@ extern uint32_t OrigFDCTabPtr;
 
 static void bios_cleanup_hardware(void)
 {
+	/* The other CPUs go back to waiting for the OS */
+	smp_park();
+
 	/* Restore the original pointer to the floppy descriptor table */
 	if (OrigFDCTabPtr)
 		*((uint32_t *)(4 * 0x1e)) = OrigFDCTabPtr;
@@ -688,16 +699,22 @@ static void bios_cleanup_hardware(void)
 
 	/* If we enabled serial port interrupts, clean them up now */
 	sirq_cleanup();
+	serial_tx_flush();
+
+	/* Give the framebuffer its BIOS memory type back */
+	mtrr_cleanup();
 }
 
 extern void *bios_malloc(size_t, enum heap, size_t);
 extern void *bios_realloc(void *, size_t);
 extern void bios_free(void *);
+extern int bios_mem_stats(struct com32_mem_stats *);
 
 struct mem_ops bios_mem_ops = {
 	.malloc = bios_malloc,
 	.realloc = bios_realloc,
 	.free = bios_free,
+	.stats = bios_mem_stats,
 };
 
 struct firmware bios_fw = {
@@ -711,6 +728,7 @@ struct firmware bios_fw = {
 	.adv_ops = &bios_adv_ops,
 	.vesa = &bios_vesa_ops,
 	.mem = &bios_mem_ops,
+	.disk_probe = bios_disk_probe,
 };
 
 void syslinux_register_bios(void)
@@ -0,0 +1,63 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Permission is hereby granted, free of charge, to any person
+ *   obtaining a copy of this software and associated documentation
+ *   files (the "Software"), to deal in the Software without
+ *   restriction, including without limitation the rights to use,
+ *   copy, modify, merge, publish, distribute, sublicense, and/or
+ *   sell copies of the Software, and to permit persons to whom
+ *   the Software is furnished to do so, subject to the following
+ *   conditions:
+ *
+ *   The above copyright notice and this permission notice shall
+ *   be included in all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *   OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *   HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *   OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * boottime.c
+ *
+ * Boot phase timestamps.  See <syslinux/boottime.h>.
+ */
+
+#include <stdbool.h>
+#include <core.h>
+#include <cpufeature.h>
+#include <sys/cpu.h>
+#include <syslinux/boottime.h>
+
+static struct boot_times boot_times = {
+    .version = BOOT_TIMES_VERSION,
+    .count = BOOT_PHASE_MAX,
+};
+static bool boot_times_tsc;
+
+void boot_time_init(void)
+{
+#if __SIZEOF_POINTER__ == 4
+    boot_times_tsc = cpu_has_eflag(EFLAGS_ID) &&
+	(cpuid_edx(1) & (1 << (X86_FEATURE_TSC & 31)));
+#else
+    boot_times_tsc = true;
+#endif
+}
+
+__export void boot_time_stamp(enum boot_phase phase)
+{
+    if (boot_times_tsc && phase < BOOT_PHASE_MAX)
+	boot_times.tsc[phase] = rdtsc();
+}
+
+__export const struct boot_times *boot_times_get(void)
+{
+    return boot_times_tsc ? &boot_times : NULL;
+}
@@ -0,0 +1,170 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Permission is hereby granted, free of charge, to any person
+ *   obtaining a copy of this software and associated documentation
+ *   files (the "Software"), to deal in the Software without
+ *   restriction, including without limitation the rights to use,
+ *   copy, modify, merge, publish, distribute, sublicense, and/or
+ *   sell copies of the Software, and to permit persons to whom
+ *   the Software is furnished to do so, subject to the following
+ *   conditions:
+ *
+ *   The above copyright notice and this permission notice shall
+ *   be included in all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *   OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *   HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *   OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * clock.c
+ *
+ * The nanosecond clock.  See <syslinux/clock.h>.
+ *
+ * The TSC rate comes from CPUID leaf 15h where the CPU gives one, and
+ * is otherwise timed against PIT channel 2, the speaker channel, so
+ * the timer tick on channel 0 is left alone.  Without a TSC, or when
+ * the PIT doesn't seem to be there, the millisecond timer stands in.
+ */
+
+#include <stdbool.h>
+#include <core.h>
+#include <cpufeature.h>
+#include <timer.h>
+#include <sys/cpu.h>
+#include <sys/io.h>
+#include <syslinux/clock.h>
+
+#define PIT_HZ		1193182
+#define CLOCK_CAL_MS	10		/* How long the PIT is timed for */
+#define CLOCK_CAL_LOOPS	(1 << 20)	/* Polls before the PIT is given up on */
+#define CLOCK_SHIFT	22		/* Of clock_mult */
+
+static struct clock_info clock_info;
+static uint64_t clock_tsc0;		/* The TSC at calibration */
+static uint32_t clock_mult;		/* Nanoseconds a cycle, << CLOCK_SHIFT */
+static mstime_t clock_ms0;
+
+static bool clock_has_tsc(void)
+{
+#if __SIZEOF_POINTER__ == 4
+    return cpu_has_eflag(EFLAGS_ID) &&
+	(cpuid_edx(1) & (1 << (X86_FEATURE_TSC & 31)));
+#else
+    return true;
+#endif
+}
+
+/* The TSC rate the CPU states, or 0 if it states none */
+static uint32_t clock_cpuid_khz(void)
+{
+    uint32_t den, num, crystal, edx;
+
+    if (cpuid_eax(0) < 0x15)
+	return 0;
+
+    /* TSC/crystal ratio num/den, and the crystal in Hz if it is known */
+    cpuid(0x15, &den, &num, &crystal, &edx);
+    if (!den || !num || !crystal)
+	return 0;
+
+    return (uint64_t)crystal * num / den / 1000;
+}
+
+/* The TSC rate, timed against PIT channel 2; 0 if the PIT misbehaves */
+static uint32_t clock_pit_khz(void)
+{
+    const uint32_t latch = PIT_HZ * CLOCK_CAL_MS / 1000;
+    uint32_t loops = 0, cycles;
+    irq_state_t irq;
+    uint64_t t0;
+    uint8_t gate;
+
+    irq = irq_save();
+
+    /* Gate channel 2 on, with the speaker off */
+    gate = inb(0x61);
+    outb((gate & ~0x02) | 0x01, 0x61);
+
+    /* Channel 2, mode 0 (OUT goes high at the terminal count), binary */
+    outb(0xb0, 0x43);
+    outb(latch & 0xff, 0x42);
+    outb(latch >> 8, 0x42);
+
+    t0 = rdtsc();
+    while (!(inb(0x61) & 0x20) && loops < CLOCK_CAL_LOOPS)
+	loops++;
+    cycles = rdtsc() - t0;
+
+    outb(gate, 0x61);
+    irq_restore(irq);
+
+    /*
+     * A port that reads back as all ones is done at once; one that
+     * never changes never is.  Either way there is no PIT to go by.
+     */
+    if (loops < 1000 || loops >= CLOCK_CAL_LOOPS)
+	return 0;
+
+    return cycles / CLOCK_CAL_MS;
+}
+
+void clock_init(void)
+{
+    uint32_t khz = 0;
+
+    clock_info.source = CLOCK_MS_TIMER;
+    clock_ms0 = ms_timer();
+
+    if (!clock_has_tsc())
+	return;
+
+    if (cpuid_eax(0x80000000) >= 0x80000007)
+	clock_info.invariant = !!(cpuid_edx(0x80000007) & (1 << 8));
+
+    if ((khz = clock_cpuid_khz()))
+	clock_info.source = CLOCK_TSC_CPUID;
+    else if ((khz = clock_pit_khz()))
+	clock_info.source = CLOCK_TSC_PIT;
+    else
+	return;
+
+    /* Slower than 1 MHz, clock_mult would not fit */
+    if (khz < 1000) {
+	clock_info.source = CLOCK_MS_TIMER;
+	return;
+    }
+
+    clock_info.tsc_khz = khz;
+    clock_mult = ((uint64_t)1000000 << CLOCK_SHIFT) / khz;
+    clock_tsc0 = rdtsc();
+}
+
+__export nstime_t clock_cycles_to_ns(uint64_t cycles)
+{
+    uint32_t hi = cycles >> 32, lo = cycles;
+
+    /* 96 bits of product, without a 64-bit multiply */
+    return ((uint64_t)hi * clock_mult << (32 - CLOCK_SHIFT)) +
+	((uint64_t)lo * clock_mult >> CLOCK_SHIFT);
+}
+
+__export nstime_t clock_ns(void)
+{
+    if (clock_info.source == CLOCK_MS_TIMER)
+	return (uint64_t)(ms_timer() - clock_ms0) * 1000000;
+
+    return clock_cycles_to_ns(rdtsc() - clock_tsc0);
+}
+
+__export const struct clock_info *clock_get_info(void)
+{
+    return &clock_info;
+}
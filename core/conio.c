@@ -68,38 +68,116 @@ __export int loadkeys(const char *filename)
 	return 0;
 }
 
+/*
+ * Serial output is queued here and fed to the UART a FIFO's worth at a
+ * time, from write_serial() itself, from __idle(), and on BIOS from
+ * core_pm_hook (i.e. on every interrupt or BIOS call) while anything
+ * is queued.  The writer only waits when the ring is full.
+ */
+#define SERIAL_TX_BUF	4096	/* Power of 2 */
+
+static char serial_tx_buf[SERIAL_TX_BUF];
+static unsigned int serial_tx_head, serial_tx_tail;
+
+__export uint8_t SerialTxFifo = 1;	/* Bytes the UART takes when THRE */
+
+/*
+ * Push as much as the UART will take right now.  Interrupts must be off.
+ */
+static void serial_tx_fill(void)
+{
+	unsigned int n;
+
+	if (serial_tx_head == serial_tx_tail)
+		return;
+
+	if (!SerialPort) {
+		serial_tx_tail = serial_tx_head; /* Port went away */
+		return;
+	}
+
+	/* Wait for the transmitter (and FIFO) to be empty */
+	if (!(inb(SerialPort + 5) & 0x20))
+		return;
+
+	/* Wait for input flow control */
+	if ((inb(SerialPort + 6) & FlowInput) != FlowInput)
+		return;
+
+	for (n = SerialTxFifo; n && serial_tx_tail != serial_tx_head; n--)
+		outb(serial_tx_buf[serial_tx_tail++ % SERIAL_TX_BUF],
+		     SerialPort);
+}
+
+#ifdef __FIRMWARE_BIOS__
+static void serial_tx_pm_hook(void)
+{
+	serial_tx_fill();
+	if (serial_tx_head == serial_tx_tail)
+		core_pm_hook = core_pm_null_hook;
+}
+#endif
+
+/*
+ * serial_tx_poll: Move queued output along.  Returns nonzero if there
+ * is still some left.
+ */
+__export int serial_tx_poll(void)
+{
+	irq_state_t irq;
+	int pending;
+
+	irq = irq_save();
+	serial_tx_fill();
+	pending = serial_tx_head != serial_tx_tail;
+	irq_restore(irq);
+
+	return pending;
+}
+
+/*
+ * serial_tx_flush: Wait for all queued output to be handed to the UART.
+ */
+__export void serial_tx_flush(void)
+{
+	while (serial_tx_poll())
+		cpu_relax();
+}
+
 /*
  * write_serial: If serial output is enabled, write character on
  * serial port.
  */
 __export void write_serial(char data)
 {
+	irq_state_t irq;
+
 	if (!SerialPort)
 		return;
 
 	if (!(DisplayMask & 0x04))
 		return;
 
-	while (1) {
-		char ch;
-
-		ch = inb(SerialPort + 5); /* LSR */
-
-		/* Wait for space in transmit register */
-		if (!(ch & 0x20))
-			continue;
+	for (;;) {
+		irq = irq_save();
+		if (serial_tx_head - serial_tx_tail < SERIAL_TX_BUF)
+			break;
+		serial_tx_fill();	/* Ring full */
+		irq_restore(irq);
+		cpu_relax();
+	}
 
-		/* Wait for input flow control */
-		ch = inb(SerialPort + 6);
-		ch &= FlowInput;
-		if (ch != FlowInput)
-			continue;
+	serial_tx_buf[serial_tx_head++ % SERIAL_TX_BUF] = data;
+	serial_tx_fill();
 
-		break;
-	}
+#ifdef __FIRMWARE_BIOS__
+	/* Don't leave the tail of a message behind during a long load */
+	if (serial_tx_head != serial_tx_tail &&
+	    core_pm_hook == core_pm_null_hook)
+		core_pm_hook = serial_tx_pm_hook;
+#endif
 
-	outb(data, SerialPort);	/* Send data */
-	io_delay();
+	irq_restore(irq);
 }
 
 void pm_write_serial(com32sys_t *regs)
@@ -307,7 +307,7 @@ static void sysappend_set_sysff(const uint8_t *type)
 	return;
     
     sprintf(sysff_str+6, "%u", *type & 0x7f);
-    sysappend_strings[SYSAPPEND_SYSFF] = sysff_str;
+    sysappend_set(SYSAPPEND_SYSFF, sysff_str);
 }
 
 struct cpuflag {
@@ -358,7 +358,7 @@ static void sysappend_set_cpu(void)
 
     *p = '\0';
 
-    sysappend_strings[SYSAPPEND_CPU] = cpu_str;
+    sysappend_set(SYSAPPEND_CPU, cpu_str);
 }
 
 void dmi_init(void)
@@ -377,7 +377,7 @@ void dmi_init(void)
     for (ds = dmi_strings; ds->prefix; ds++) {
 	if (!sysappend_strings[ds->sa]) {
 	    const char *str = dmi_find_string(ds->index, ds->offset);
-	    sysappend_strings[ds->sa] = dmi_install_string(ds->prefix, str);
+	    sysappend_set(ds->sa, dmi_install_string(ds->prefix, str));
 	}
     }
 }
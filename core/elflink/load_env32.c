@@ -53,6 +53,7 @@ struct elf_module core_module = {
 void init_module_subsystem(struct elf_module *module)
 {
     list_add(&module->list, &modules_head);
+    global_symbols_add(module);
 }
 
 static int _start_ldlinux(int argc, char **argv)
@@ -80,6 +81,9 @@ again:
 			return ENOENT;
 
 		fclose(f);
+
+		/* A new configuration may bring a new PATH along */
+		module_cache_flush();
 		ldlinux = unload_modules_since(LDLINUX);
 
 		/*
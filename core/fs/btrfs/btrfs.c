@@ -28,12 +28,30 @@ union tree_buf {
 	struct btrfs_leaf leaf;
 };
 
+/*
+ * Tree nodes already translated through the chunk map and read in full,
+ * keyed by logical address.  The filesystem is read-only so entries never
+ * go stale; the least recently used one is recycled.
+ */
+#define BTRFS_NODE_CACHE	8
+
+struct btrfs_node_slot {
+	u64 logical;
+	unsigned int lru;		/* 0 = unused */
+	union tree_buf *buf;
+};
+
 /* filesystem instance structure */
 struct btrfs_info {
 	u64 fs_tree;
+	u64 csum_tree;			/* 0 = none found */
+	char *csum_buf;			/* one data block, for btrfs_verify_data() */
+	unsigned int sectorsize_shift;
 	struct btrfs_super_block sb;
 	struct btrfs_chunk_map chunk_map;
-	union tree_buf *tree_buf;
+	struct btrfs_node_slot nodes[BTRFS_NODE_CACHE];
+	unsigned int node_clock;
+	unsigned int node_hits, node_misses;
 };
 
 /* compare function used for bin_search */
@@ -165,44 +183,84 @@ static inline u64 btrfs_sb_offset(int mirror)
 	return BTRFS_SUPER_INFO_OFFSET;
 }
 
+/* btrfs stores the inverted CRC-32C of a block, little-endian */
+static inline u32 btrfs_csum_data(const void *data, size_t len)
+{
+	return ~btrfs_crc32c(~0U, data, len);
+}
+
+/* check a superblock or tree node, whose checksum covers the rest of it */
+static bool btrfs_csum_ok(const void *block, u32 size)
+{
+	u32 csum;
+
+	memcpy(&csum, block, sizeof csum);
+	return csum == btrfs_csum_data((const char *)block + BTRFS_CSUM_SIZE,
+				       size - BTRFS_CSUM_SIZE);
+}
+
+/* is FsVerify asking for checksums of this kind, and can we check them? */
+static inline bool btrfs_verifying(struct fs_info *fs, unsigned int what)
+{
+	struct btrfs_info * const bfs = fs->fs_info;
+
+	return (FsVerify & what) && bfs->sb.csum_type == BTRFS_CSUM_TYPE_CRC32;
+}
+
 /* find the most recent super block */
 static void btrfs_read_super_block(struct fs_info *fs)
 {
 	int i;
 	int ret;
 	u8 fsid[BTRFS_FSID_SIZE];
+	bool have_fsid = false;
 	u64 offset;
 	u64 transid = 0;
-	struct btrfs_super_block buf;
+	struct btrfs_super_block *buf;
 	struct btrfs_info * const bfs = fs->fs_info;
 
 	bfs->sb.total_bytes = ~0; /* Unknown as of yet */
 
+	/* the checksum covers the whole block, not just the structure */
+	buf = malloc(BTRFS_SUPER_INFO_SIZE);
+	if (!buf)
+		return;
+
 	/* find most recent super block */
 	for (i = 0; i < BTRFS_SUPER_MIRROR_MAX; i++) {
 		offset = btrfs_sb_offset(i);
 		if (offset >= bfs->sb.total_bytes)
 			break;
 
-		ret = cache_read(fs, (char *)&buf, offset, sizeof(buf));
-		if (ret < sizeof(buf))
+		ret = cache_read(fs, (char *)buf, offset, BTRFS_SUPER_INFO_SIZE);
+		if (ret < BTRFS_SUPER_INFO_SIZE)
 			break;
 
-		if (buf.bytenr != offset ||
-		    strncmp((char *)(&buf.magic), BTRFS_MAGIC,
-			    sizeof(buf.magic)))
+		if (buf->bytenr != offset ||
+		    strncmp((char *)(&buf->magic), BTRFS_MAGIC,
+			    sizeof(buf->magic)))
 			continue;
 
-		if (i == 0)
-			memcpy(fsid, buf.fsid, sizeof(fsid));
-		else if (memcmp(fsid, buf.fsid, sizeof(fsid)))
+		if (buf->csum_type == BTRFS_CSUM_TYPE_CRC32 &&
+		    !btrfs_csum_ok(buf, BTRFS_SUPER_INFO_SIZE)) {
+			printf("btrfs: bad checksum on superblock %d\n", i);
 			continue;
+		}
 
-		if (buf.generation > transid) {
-			memcpy(&bfs->sb, &buf, sizeof(bfs->sb));
-			transid = buf.generation;
+		if (!have_fsid) {
+			memcpy(fsid, buf->fsid, sizeof(fsid));
+			have_fsid = true;
+		} else if (memcmp(fsid, buf->fsid, sizeof(fsid))) {
+			continue;
+		}
+
+		if (buf->generation > transid) {
+			memcpy(&bfs->sb, buf, sizeof(bfs->sb));
+			transid = buf->generation;
 		}
 	}
+
+	free(buf);
 }
 
 static inline unsigned long btrfs_chunk_item_size(int num_stripes)
@@ -249,58 +307,96 @@ static int btrfs_comp_keys_type(const struct btrfs_disk_key *k1,
 	return 0;
 }
 
-/* seach tree directly on disk ... */
-static int search_tree(struct fs_info *fs, u64 loffset,
-		       struct btrfs_disk_key *key, struct btrfs_path *path)
+/* return the tree node at logical address loffset, reading it if needed */
+static const union tree_buf *get_node(struct fs_info *fs, u64 loffset)
 {
 	struct btrfs_info * const bfs = fs->fs_info;
-	union tree_buf *tree_buf = bfs->tree_buf;
-	int slot, ret;
+	struct btrfs_node_slot *ns, *victim = &bfs->nodes[0];
+	union tree_buf *buf;
 	u64 offset;
+	u32 size;
+	int i;
+
+	for (i = 0; i < BTRFS_NODE_CACHE; i++) {
+		ns = &bfs->nodes[i];
+		if (ns->lru && ns->logical == loffset) {
+			ns->lru = ++bfs->node_clock;
+			bfs->node_hits++;
+			return ns->buf;
+		}
+		if (ns->lru < victim->lru)
+			victim = ns;
+	}
 
+	bfs->node_misses++;
+	buf = victim->buf;
 	offset = logical_physical(fs, loffset);
-	cache_read(fs, &tree_buf->header, offset, sizeof(tree_buf->header));
-	if (tree_buf->header.level) {
-		/* inner node */
-		cache_read(fs, (char *)&tree_buf->node.ptrs[0],
-			   offset + sizeof tree_buf->header,
-			   bfs->sb.nodesize - sizeof tree_buf->header);
-		path->itemsnr[tree_buf->header.level] = tree_buf->header.nritems;
-		path->offsets[tree_buf->header.level] = loffset;
-		ret = bin_search(&tree_buf->node.ptrs[0],
-				 sizeof(struct btrfs_key_ptr),
-				 key, (cmp_func)btrfs_comp_keys,
-				 path->slots[tree_buf->header.level],
-				 tree_buf->header.nritems, &slot);
-		if (ret && slot > path->slots[tree_buf->header.level])
-			slot--;
-		path->slots[tree_buf->header.level] = slot;
-		ret = search_tree(fs, tree_buf->node.ptrs[slot].blockptr,
-				  key, path);
-	} else {
-		/* leaf node */
-		cache_read(fs, (char *)&tree_buf->leaf.items[0],
-			   offset + sizeof tree_buf->header,
-			   bfs->sb.leafsize - sizeof tree_buf->header);
-		path->itemsnr[tree_buf->header.level] = tree_buf->header.nritems;
-		path->offsets[tree_buf->header.level] = loffset;
-		ret = bin_search(&tree_buf->leaf.items[0],
-				 sizeof(struct btrfs_item),
-				 key, (cmp_func)btrfs_comp_keys,
-				 path->slots[0],
-				 tree_buf->header.nritems, &slot);
-		if (ret && slot > path->slots[tree_buf->header.level])
-			slot--;
-		path->slots[tree_buf->header.level] = slot;
-		path->item = tree_buf->leaf.items[slot];
-		cache_read(fs, (char *)&path->data,
-			   offset + sizeof tree_buf->header +
-			   tree_buf->leaf.items[slot].offset,
-			   tree_buf->leaf.items[slot].size);
+	cache_read(fs, &buf->header, offset, sizeof(buf->header));
+	size = buf->header.level ? bfs->sb.nodesize : bfs->sb.leafsize;
+	cache_read(fs, (char *)buf + sizeof buf->header,
+		   offset + sizeof buf->header, size - sizeof buf->header);
+	if (btrfs_verifying(fs, FS_VERIFY_META) &&
+	    (buf->header.bytenr != loffset || !btrfs_csum_ok(buf, size))) {
+		printf("btrfs: tree node %llu is corrupt\n",
+		       (unsigned long long)loffset);
+		/* an empty leaf: nothing can be found through it */
+		memset(buf, 0, size);
 	}
+	victim->logical = loffset;
+	victim->lru = ++bfs->node_clock;
+	dprintf("btrfs: node %llu read, %u hits %u misses\n", loffset,
+		bfs->node_hits, bfs->node_misses);
+	return buf;
+}
+
+/* search a leaf from path->slots[0] on and remember the item found */
+static int search_leaf(const union tree_buf *tree_buf, u64 loffset,
+		       struct btrfs_disk_key *key, struct btrfs_path *path)
+{
+	int slot, ret;
+
+	path->itemsnr[0] = tree_buf->header.nritems;
+	path->offsets[0] = loffset;
+	ret = bin_search((void *)&tree_buf->leaf.items[0],
+			 sizeof(struct btrfs_item),
+			 key, (cmp_func)btrfs_comp_keys,
+			 path->slots[0],
+			 tree_buf->header.nritems, &slot);
+	if (ret && slot > path->slots[0])
+		slot--;
+	path->slots[0] = slot;
+	path->item = tree_buf->leaf.items[slot];
+	memcpy(path->data, (const char *)&tree_buf->leaf.items[0] +
+	       tree_buf->leaf.items[slot].offset,
+	       tree_buf->leaf.items[slot].size);
 	return ret;
 }
 
+/* seach tree from the node at loffset down */
+static int search_tree(struct fs_info *fs, u64 loffset,
+		       struct btrfs_disk_key *key, struct btrfs_path *path)
+{
+	const union tree_buf *tree_buf = get_node(fs, loffset);
+	int slot, ret;
+
+	if (!tree_buf->header.level)
+		return search_leaf(tree_buf, loffset, key, path);
+
+	/* inner node */
+	path->itemsnr[tree_buf->header.level] = tree_buf->header.nritems;
+	path->offsets[tree_buf->header.level] = loffset;
+	ret = bin_search((void *)&tree_buf->node.ptrs[0],
+			 sizeof(struct btrfs_key_ptr),
+			 key, (cmp_func)btrfs_comp_keys,
+			 path->slots[tree_buf->header.level],
+			 tree_buf->header.nritems, &slot);
+	if (ret && slot > path->slots[tree_buf->header.level])
+		slot--;
+	path->slots[tree_buf->header.level] = slot;
+	/* tree_buf may be recycled by the descent, don't touch it after */
+	return search_tree(fs, tree_buf->node.ptrs[slot].blockptr, key, path);
+}
+
 /* return 0 if leaf found */
 static int next_leaf(struct fs_info *fs, struct btrfs_disk_key *key, struct btrfs_path *path)
 {
@@ -337,7 +433,9 @@ static int next_slot(struct fs_info *fs, struct btrfs_disk_key *key,
 	if (slot >= path->itemsnr[0])
 		return 1;
 	path->slots[0] = slot;
-	search_tree(fs, path->offsets[0], key, path);
+	/* the leaf is normally still cached, so this costs no I/O */
+	search_leaf(get_node(fs, path->offsets[0]), path->offsets[0],
+		    key, path);
 	return 0;
 }
 
@@ -419,6 +517,9 @@ static struct inode *btrfs_iget_by_inr(struct fs_info *fs, u64 inr)
 	struct btrfs_path path;
 	int ret;
 
+	if (inr == (u32)inr && (inode = revive_inode(fs, inr)))
+		return inode;
+
 	/* FIXME: some BTRFS inode member are u64, while our logical inode
            is u32, we may need change them to u64 later */
 	search_key.objectid = inr;
@@ -447,7 +548,9 @@ static struct inode *btrfs_iget_by_inr(struct fs_info *fs, u64 inr)
 		if (ret)
 			return NULL; /* impossible */
 		extent_item = *(struct btrfs_file_extent_item *)path.data;
-		if (extent_item.type == BTRFS_FILE_EXTENT_INLINE)/* inline file */
+		if (extent_item.compression)
+			offset = 0; /* btrfs_read_compressed() handles it */
+		else if (extent_item.type == BTRFS_FILE_EXTENT_INLINE)/* inline file */
 			offset = path.offsets[0] + sizeof(struct btrfs_header)
 				+ path.item.offset
 				+ offsetof(struct btrfs_file_extent_item, disk_bytenr);
@@ -494,14 +597,28 @@ static int btrfs_readlink(struct inode *inode, char *buf)
 	return inode->size;
 }
 
-static int btrfs_readdir(struct file *file, struct dirent *dirent)
+static void btrfs_fill_dirent(struct file *file, const struct btrfs_path *path,
+			      struct dirent *dirent)
+{
+	const struct btrfs_dir_item *dir_item =
+		(const struct btrfs_dir_item *)path->data;
+
+	file->offset = path->item.key.offset;
+	dirent->d_ino = dir_item->location.objectid;
+	dirent->d_off = file->offset;
+	dirent->d_reclen = offsetof(struct dirent, d_name)
+		+ dir_item->name_len + 1;
+	dirent->d_type = IFTODT(dir_item->type);
+	memcpy(dirent->d_name, dir_item + 1, dir_item->name_len);
+	dirent->d_name[dir_item->name_len] = '\0';
+}
+
+/* find the directory item following file->offset, return 0 if found */
+static int btrfs_readdir_search(struct file *file, struct btrfs_path *path)
 {
 	struct fs_info * const fs = file->fs;
 	struct btrfs_info * const bfs = fs->fs_info;
-	struct inode * const inode = file->inode;
 	struct btrfs_disk_key search_key;
-	struct btrfs_path path;
-	struct btrfs_dir_item *dir_item;
 	int ret;
 
 	/*
@@ -509,30 +626,203 @@ static int btrfs_readdir(struct file *file, struct dirent *dirent)
 	 * key that lower that offset, 0 means first search and we will search
          * -1UL, which is the biggest possible key
          */
-	search_key.objectid = inode->ino;
+	search_key.objectid = file->inode->ino;
 	search_key.type = BTRFS_DIR_ITEM_KEY;
 	search_key.offset = file->offset - 1;
-	clear_path(&path);
-	ret = search_tree(fs, bfs->fs_tree, &search_key, &path);
+	clear_path(path);
+	ret = search_tree(fs, bfs->fs_tree, &search_key, path);
 
 	if (ret) {
-		if (btrfs_comp_keys_type(&search_key, &path.item.key))
+		if (btrfs_comp_keys_type(&search_key, &path->item.key))
 			return -1;
 	}
+	return 0;
+}
 
-	dir_item = (struct btrfs_dir_item *)path.data;
-	file->offset = path.item.key.offset;
-	dirent->d_ino = dir_item->location.objectid;
-	dirent->d_off = file->offset;
-	dirent->d_reclen = offsetof(struct dirent, d_name)
-		+ dir_item->name_len + 1;
-	dirent->d_type = IFTODT(dir_item->type);
-	memcpy(dirent->d_name, dir_item + 1, dir_item->name_len);
-	dirent->d_name[dir_item->name_len] = '\0';
+static int btrfs_readdir(struct file *file, struct dirent *dirent)
+{
+	struct btrfs_path path;
+
+	if (btrfs_readdir_search(file, &path))
+		return -1;
+	btrfs_fill_dirent(file, &path, dirent);
+	return 0;
+}
+
+/*
+ * Directory items come out in descending key order, so after the first
+ * search the next ones are the slots before it in the same leaf: take
+ * those without another descent from the root.
+ */
+static int btrfs_readdir_batch(struct file *file, struct dirent *buf,
+			       int count)
+{
+	struct btrfs_path path;
+	const union tree_buf *leaf;
+	int slot, n = 0;
+
+	if (count <= 0 || btrfs_readdir_search(file, &path))
+		return 0;
+
+	for (;;) {
+		btrfs_fill_dirent(file, &path, &buf[n++]);
+		slot = path.slots[0] - 1;
+		if (n >= count || slot < 0)
+			break;
+
+		leaf = get_node(file->fs, path.offsets[0]);
+		if (leaf->leaf.items[slot].key.objectid != file->inode->ino ||
+		    leaf->leaf.items[slot].key.type != BTRFS_DIR_ITEM_KEY)
+			break;
+
+		path.slots[0] = slot;
+		path.item = leaf->leaf.items[slot];
+		memcpy(path.data, (const char *)&leaf->leaf.items[0] +
+		       path.item.offset, path.item.size);
+	}
+
+	return n;
+}
+
+/*
+ * Look up the checksum of the data block at logical address LOGICAL.
+ * Returns -1 if the checksum tree has none, as for nodatasum files.
+ * Checksum items can be bigger than path->data, so this walks the
+ * nodes itself rather than using search_tree().
+ */
+static int btrfs_lookup_csum(struct fs_info *fs, u64 logical, u32 *csum)
+{
+	struct btrfs_info * const bfs = fs->fs_info;
+	const union tree_buf *tree_buf;
+	const struct btrfs_item *item;
+	struct btrfs_disk_key key;
+	u64 loffset = bfs->csum_tree;
+	u64 index;
+	int slot;
+
+	if (!loffset)
+		return -1;
+
+	key.objectid = BTRFS_EXTENT_CSUM_OBJECTID;
+	key.type = BTRFS_EXTENT_CSUM_KEY;
+	key.offset = logical;
+
+	for (;;) {
+		tree_buf = get_node(fs, loffset);
+		if (!tree_buf->header.nritems)
+			return -1;
+		if (!tree_buf->header.level)
+			break;
+		if (bin_search((void *)&tree_buf->node.ptrs[0],
+			       sizeof(struct btrfs_key_ptr), &key,
+			       (cmp_func)btrfs_comp_keys, 0,
+			       tree_buf->header.nritems, &slot) && slot)
+			slot--;
+		loffset = tree_buf->node.ptrs[slot].blockptr;
+	}
+
+	if (bin_search((void *)&tree_buf->leaf.items[0],
+		       sizeof(struct btrfs_item), &key,
+		       (cmp_func)btrfs_comp_keys, 0,
+		       tree_buf->header.nritems, &slot) && slot)
+		slot--;
+	item = &tree_buf->leaf.items[slot];
+	if (btrfs_comp_keys_type(&key, &item->key) ||
+	    item->key.offset > logical)
+		return -1;
+
+	index = (logical - item->key.offset) >> bfs->sectorsize_shift;
+	if (index >= item->size / sizeof(u32))
+		return -1;
 
+	memcpy(csum, (const char *)&tree_buf->leaf.items[0] + item->offset +
+	       index * sizeof(u32), sizeof(u32));
 	return 0;
 }
 
+/* check one data block against the checksum tree; 0 if it is good */
+static int btrfs_check_block(struct fs_info *fs, u64 logical,
+			     const char *data)
+{
+	struct btrfs_info * const bfs = fs->fs_info;
+	u32 csum;
+
+	if (btrfs_lookup_csum(fs, logical, &csum))
+		return 0;
+	if (csum == btrfs_csum_data(data, bfs->sb.sectorsize))
+		return 0;
+
+	printf("btrfs: bad checksum on data block %llu\n",
+	       (unsigned long long)logical);
+	return -1;
+}
+
+/*
+ * Check the LEN bytes just read into BUF from file offset POS.  Blocks
+ * only partly inside BUF, at either end, are read again in full.
+ * Returns how many leading bytes of BUF are good.
+ */
+static u32 btrfs_verify_data(struct inode *inode, u32 pos, const char *buf,
+			     u32 len)
+{
+	struct fs_info * const fs = inode->fs;
+	struct btrfs_info * const bfs = fs->fs_info;
+	const u32 bsize = bfs->sb.sectorsize;
+	struct btrfs_disk_key search_key;
+	struct btrfs_file_extent_item *fi;
+	struct btrfs_path path;
+	const char *data;
+	u32 start = pos, end = pos + len;
+	u32 ext_end, blk;
+	u64 logical;
+
+	while (pos < end) {
+		search_key.objectid = inode->ino;
+		search_key.type = BTRFS_EXTENT_DATA_KEY;
+		search_key.offset = pos;
+		clear_path(&path);
+		search_tree(fs, bfs->fs_tree, &search_key, &path);
+		if (btrfs_comp_keys_type(&search_key, &path.item.key) ||
+		    path.item.key.offset > pos)
+			break;
+
+		/* inline data is covered by the leaf's own checksum */
+		fi = (struct btrfs_file_extent_item *)path.data;
+		if (fi->type == BTRFS_FILE_EXTENT_INLINE)
+			break;
+		if (path.item.key.offset + fi->num_bytes <= pos)
+			break;	/* an implied hole */
+		ext_end = min(end, (u32)(path.item.key.offset + fi->num_bytes));
+
+		/* holes and preallocated space have no checksums */
+		if (fi->type != BTRFS_FILE_EXTENT_REG || !fi->disk_bytenr) {
+			pos = ext_end;
+			continue;
+		}
+
+		for (blk = pos & ~(bsize - 1); blk < ext_end; blk += bsize) {
+			logical = fi->disk_bytenr + fi->offset +
+				(blk - path.item.key.offset);
+			if (blk >= start && blk + bsize <= end) {
+				data = buf + (blk - start);
+			} else {
+				if (!bfs->csum_buf)
+					bfs->csum_buf = malloc(bsize);
+				if (!bfs->csum_buf)
+					continue;
+				cache_read(fs, bfs->csum_buf,
+					   logical_physical(fs, logical), bsize);
+				data = bfs->csum_buf;
+			}
+			if (btrfs_check_block(fs, logical, data))
+				return blk > start ? blk - start : 0;
+		}
+		pos = ext_end;
+	}
+
+	return len;
+}
+
 static int btrfs_next_extent(struct inode *inode, uint32_t lstart)
 {
 	struct btrfs_disk_key search_key;
@@ -560,10 +850,8 @@ static int btrfs_next_extent(struct inode *inode, uint32_t lstart)
 	    printf("btrfs: found encrypted data, cannot continue!\n");
 	    return -1;
 	}
-	if (extent_item.compression) {
-	    printf("btrfs: found compressed data, cannot continue!\n");
-	    return -1;
-	}
+	if (extent_item.compression)
+		return -1; /* not addressable, btrfs_getfssec() takes over */
 
 	if (extent_item.type == BTRFS_FILE_EXTENT_INLINE) {/* inline file */
 		/* we fake a extent here, and PVT of inode will tell us */
@@ -582,8 +870,8 @@ static int btrfs_next_extent(struct inode *inode, uint32_t lstart)
 	return 0;
 }
 
-static uint32_t btrfs_getfssec(struct file *file, char *buf, int sectors,
-					bool *have_more)
+static uint32_t btrfs_getfssec_plain(struct file *file, char *buf,
+				     int sectors, bool *have_more)
 {
 	u32 ret;
 	struct fs_info *fs = file->fs;
@@ -605,6 +893,160 @@ static uint32_t btrfs_getfssec(struct file *file, char *buf, int sectors,
 	return ret;
 }
 
+/*
+ * Decompress the compressed extent holding file offset pos into
+ * PVT(inode)->cbuf.  Returns 0 on success, -1 if there is no such extent
+ * or it can't be read.
+ */
+static int btrfs_read_compressed(struct inode *inode, u32 pos)
+{
+	struct fs_info * const fs = inode->fs;
+	struct btrfs_info * const bfs = fs->fs_info;
+	struct btrfs_pvt_inode * const pvt = PVT(inode);
+	struct btrfs_disk_key search_key;
+	struct btrfs_file_extent_item *fi;
+	struct btrfs_path path;
+	const void *src;
+	void *rawbuf = NULL;
+	u32 srclen, ram, len, skip, i;
+	int ret;
+
+	search_key.objectid = inode->ino;
+	search_key.type = BTRFS_EXTENT_DATA_KEY;
+	search_key.offset = pos;
+	clear_path(&path);
+	search_tree(fs, bfs->fs_tree, &search_key, &path);
+	if (btrfs_comp_keys_type(&search_key, &path.item.key))
+		return -1;
+
+	fi = (struct btrfs_file_extent_item *)path.data;
+	if (!fi->compression || fi->encryption)
+		return -1;
+
+	ram = fi->ram_bytes;
+	if (fi->type == BTRFS_FILE_EXTENT_INLINE) {
+		/* the compressed bytes replace disk_bytenr and on */
+		src = path.data + offsetof(struct btrfs_file_extent_item,
+					   disk_bytenr);
+		srclen = path.item.size -
+			offsetof(struct btrfs_file_extent_item, disk_bytenr);
+		skip = 0;
+		len = ram;
+	} else {
+		srclen = fi->disk_num_bytes;
+		skip = fi->offset;
+		len = fi->num_bytes;
+	}
+	if (ram > BTRFS_MAX_UNCOMPRESSED || srclen > BTRFS_MAX_UNCOMPRESSED ||
+	    skip > ram || len > ram - skip) {
+		printf("btrfs: bad compressed extent at %u\n", pos);
+		return -1;
+	}
+	if (pos - path.item.key.offset >= len)
+		return -1; /* a hole past the end of the extent */
+
+	if (!pvt->cbuf) {
+		pvt->cbuf = malloc(BTRFS_MAX_UNCOMPRESSED +
+				   BTRFS_DECOMPRESS_SLACK);
+		if (!pvt->cbuf)
+			return -1;
+	}
+
+	if (fi->type != BTRFS_FILE_EXTENT_INLINE) {
+		rawbuf = malloc(srclen);
+		if (!rawbuf)
+			return -1;
+		cache_read(fs, rawbuf, logical_physical(fs, fi->disk_bytenr),
+			   srclen);
+		src = rawbuf;
+
+		/* the checksums are of the compressed blocks */
+		if (btrfs_verifying(fs, FS_VERIFY_DATA)) {
+			for (i = 0; i + bfs->sb.sectorsize <= srclen;
+			     i += bfs->sb.sectorsize) {
+				if (btrfs_check_block(fs, fi->disk_bytenr + i,
+						      (char *)rawbuf + i)) {
+					free(rawbuf);
+					return -1;
+				}
+			}
+		}
+	}
+
+	pvt->clen = 0;
+	ret = btrfs_decompress(fi->compression, src, srclen, pvt->cbuf, ram);
+	free(rawbuf);
+	if (ret)
+		return -1;
+
+	pvt->cstart = path.item.key.offset;
+	pvt->clen = len;
+	pvt->cskip = skip;
+	dprintf("btrfs: inode %llu extent @ %u: %u -> %u bytes\n",
+		inode->ino, pvt->cstart, srclen, ram);
+	return 0;
+}
+
+static uint32_t btrfs_getfssec(struct file *file, char *buf, int sectors,
+					bool *have_more)
+{
+	struct inode * const inode = file->inode;
+	struct btrfs_pvt_inode * const pvt = PVT(inode);
+	u32 sec_shift = SECTOR_SHIFT(file->fs);
+	u32 sec_size = SECTOR_SIZE(file->fs);
+	u32 total = 0;
+	u32 ret, start, good;
+	bool more = true;
+
+	/*
+	 * generic_getfssec() stops at a compressed extent, since
+	 * btrfs_next_extent() can't map it; copy those out of the
+	 * decompressed buffer instead.
+	 */
+	while (sectors > 0 && more) {
+		if (pvt->clen && file->offset >= pvt->cstart &&
+		    file->offset - pvt->cstart < pvt->clen) {
+			ret = pvt->cstart + pvt->clen - file->offset;
+			ret = min(ret, inode->size - file->offset);
+			ret = min(ret, (u32)sectors << sec_shift);
+			memcpy(buf, pvt->cbuf + pvt->cskip +
+			       (file->offset - pvt->cstart), ret);
+			file->offset += ret;
+			more = file->offset < inode->size;
+		} else {
+			start = file->offset;
+			ret = btrfs_getfssec_plain(file, buf, sectors, &more);
+			if (ret && btrfs_verifying(file->fs, FS_VERIFY_DATA)) {
+				good = btrfs_verify_data(inode, start, buf, ret);
+				if (good < ret) {
+					/* stop short, as for an I/O error */
+					file->offset = start + good;
+					total += good;
+					more = false;
+					break;
+				}
+			}
+			if (!ret) {
+				if (!more ||
+				    btrfs_read_compressed(inode, file->offset))
+					break;
+				continue;
+			}
+		}
+		total += ret;
+		buf += ret;
+		sectors -= (ret + sec_size - 1) >> sec_shift;
+	}
+
+	*have_more = more;
+	return total;
+}
+
+static void btrfs_free_inode(struct inode *inode)
+{
+	free(PVT(inode)->cbuf);
+}
+
 static void btrfs_get_fs_tree(struct fs_info *fs)
 {
 	struct btrfs_info * const bfs = fs->fs_info;
@@ -658,14 +1100,35 @@ static void btrfs_get_fs_tree(struct fs_info *fs)
 	bfs->fs_tree = tree->bytenr;
 }
 
+/* find the checksum tree, for FS_VERIFY_DATA */
+static void btrfs_get_csum_tree(struct fs_info *fs)
+{
+	struct btrfs_info * const bfs = fs->fs_info;
+	struct btrfs_disk_key search_key;
+	struct btrfs_path path;
+
+	search_key.objectid = BTRFS_CSUM_TREE_OBJECTID;
+	search_key.type = BTRFS_ROOT_ITEM_KEY;
+	search_key.offset = -1;
+	clear_path(&path);
+	search_tree(fs, bfs->sb.root, &search_key, &path);
+	if (btrfs_comp_keys_type(&search_key, &path.item.key))
+		return;
+	bfs->csum_tree = ((struct btrfs_root_item *)path.data)->bytenr;
+}
+
 /* init. the fs meta data, return the block size shift bits. */
 static int btrfs_fs_init(struct fs_info *fs)
 {
 	struct disk *disk = fs->fs_dev->disk;
 	struct btrfs_info *bfs;
+	char *bufs;
+	u32 bufsize;
+	int i;
+
+	if (btrfs_init_crc32c())
+		return -1;
 
-	btrfs_init_crc32c();
-    
 	bfs = zalloc(sizeof(struct btrfs_info));
 	if (!bfs)
 		return -1;
@@ -683,19 +1146,24 @@ static int btrfs_fs_init(struct fs_info *fs)
 	btrfs_read_super_block(fs);
 	if (bfs->sb.magic != BTRFS_MAGIC_N)
 		return -1;
-	bfs->tree_buf = malloc(max(bfs->sb.nodesize, bfs->sb.leafsize));
-	if (!bfs->tree_buf)
+	bufsize = max(bfs->sb.nodesize, bfs->sb.leafsize);
+	bufs = malloc(BTRFS_NODE_CACHE * bufsize);
+	if (!bufs)
 		return -1;
+	for (i = 0; i < BTRFS_NODE_CACHE; i++)
+		bfs->nodes[i].buf = (union tree_buf *)(bufs + i * bufsize);
 	btrfs_read_sys_chunk_array(fs);
 	btrfs_read_chunk_tree(fs);
 	btrfs_get_fs_tree(fs);
+	btrfs_get_csum_tree(fs);
+	bfs->sectorsize_shift = __builtin_ctz(bfs->sb.sectorsize);
 
 	return fs->block_shift;
 }
 
 const struct fs_ops btrfs_fs_ops = {
     .fs_name       = "btrfs",
-    .fs_flags      = 0,
+    .fs_flags      = FS_INOCACHE,
     .fs_init       = btrfs_fs_init,
     .iget_root     = btrfs_iget_root,
     .iget          = btrfs_iget,
@@ -704,7 +1172,9 @@ const struct fs_ops btrfs_fs_ops = {
     .close_file    = generic_close_file,
     .mangle_name   = generic_mangle_name,
     .next_extent   = btrfs_next_extent,
+    .free_inode    = btrfs_free_inode,
     .readdir       = btrfs_readdir,
+    .readdir_batch = btrfs_readdir_batch,
     .chdir_start   = generic_chdir_start,
     .open_config   = generic_open_config,
     .fs_uuid       = NULL,
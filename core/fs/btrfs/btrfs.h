@@ -2,6 +2,7 @@
 #define _BTRFS_H_
 
 #include <stdint.h>
+#include <stddef.h>
 #include <zconf.h>
 
 typedef uint8_t u8;
@@ -36,16 +37,21 @@ typedef u64 __le64;
 
 #define BTRFS_SUPER_FLAG_METADUMP	(1ULL << 33)
 
+#define BTRFS_CSUM_TYPE_CRC32	0
+
 #define BTRFS_DEV_ITEM_KEY	216
 #define BTRFS_CHUNK_ITEM_KEY	228
 #define BTRFS_ROOT_REF_KEY	156
 #define BTRFS_ROOT_ITEM_KEY	132
+#define BTRFS_EXTENT_CSUM_KEY	128
 #define BTRFS_EXTENT_DATA_KEY	108
 #define BTRFS_DIR_ITEM_KEY	84
 #define BTRFS_INODE_ITEM_KEY	1
 
 #define BTRFS_EXTENT_TREE_OBJECTID 2ULL
 #define BTRFS_FS_TREE_OBJECTID 5ULL
+#define BTRFS_CSUM_TREE_OBJECTID 7ULL
+#define BTRFS_EXTENT_CSUM_OBJECTID -10ULL
 
 #define BTRFS_FIRST_CHUNK_TREE_OBJECTID 256ULL
 
@@ -53,6 +59,16 @@ typedef u64 __le64;
 #define BTRFS_FILE_EXTENT_REG 1
 #define BTRFS_FILE_EXTENT_PREALLOC 2
 
+#define BTRFS_COMPRESS_NONE 0
+#define BTRFS_COMPRESS_ZLIB 1
+#define BTRFS_COMPRESS_LZO  2
+#define BTRFS_COMPRESS_ZSTD 3
+
+/* a compressed extent never expands to more than this */
+#define BTRFS_MAX_UNCOMPRESSED (128 * 1024)
+/* bytes past the end of the output buffer a decompressor may scribble on */
+#define BTRFS_DECOMPRESS_SLACK 16
+
 #define BTRFS_MAX_LEVEL 8
 #define BTRFS_MAX_CHUNK_ENTRIES 256
 
@@ -290,8 +306,17 @@ struct btrfs_root_ref {
  */
 struct btrfs_pvt_inode {
     uint64_t offset;
+    /* last compressed extent decompressed for this file */
+    char *cbuf;			/* BTRFS_MAX_UNCOMPRESSED + slack bytes */
+    uint32_t cstart;		/* file offset of the extent */
+    uint32_t clen;		/* bytes of file data in it, 0 = empty */
+    uint32_t cskip;		/* where that data starts in cbuf */
 };
 
 #define PVT(i) ((struct btrfs_pvt_inode *)((i)->pvt))
 
+/* decompress.c */
+int btrfs_decompress(int type, const void *src, size_t srclen,
+		     void *dst, size_t dstlen);
+
 #endif
@@ -0,0 +1,133 @@
+/*
+ * Derived from Linux kernel crypto/crc32c.c and lib/crc32.c
+ * Copyright (c) 2004 Cisco Systems, Inc.
+ * Copyright (c) 2008 Herbert Xu <herbert@gondor.apana.org.au>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+
+/*
+ * CRC-32C, width = 32 bits, poly = 0x1EDC6F41, reflected input and output.
+ *
+ * CPUs with SSE4.2 have a CRC32 instruction for exactly this polynomial;
+ * it works on the general registers, so it is safe anywhere in the core.
+ * Everything else goes eight bytes at a time through eight tables
+ * ("slicing-by-8"), which is several times faster than the classic one
+ * table, one byte loop and is what makes checksumming every block read
+ * affordable.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <com32.h>
+#include <cpufeature.h>
+#include <sys/cpu.h>
+#include "btrfs.h"
+
+static bool crc32c_hw;
+static u32 (*crc32c_table)[256];	/* [8][256], only without SSE4.2 */
+
+static inline u32 get_u32(const char *p)
+{
+	u32 v;
+
+	memcpy(&v, p, sizeof v);
+	return v;
+}
+
+static u32 crc32c_sse42(u32 crc, const char *data, size_t length)
+{
+#if __SIZEOF_POINTER__ == 8
+	unsigned long c = crc;
+	u64 v;
+
+	for (; length >= 8; length -= 8, data += 8) {
+		memcpy(&v, data, sizeof v);
+		asm("crc32q %1,%0" : "+r" (c) : "rm" (v));
+	}
+	crc = c;
+#endif
+	for (; length >= 4; length -= 4, data += 4)
+		asm("crc32l %1,%0" : "+r" (crc) : "rm" (get_u32(data)));
+	while (length--)
+		asm("crc32b %1,%0" : "+r" (crc) : "rm" (*data++));
+
+	return crc;
+}
+
+static u32 crc32c_sliced(u32 crc, const char *data, size_t length)
+{
+	u32 (* const t)[256] = crc32c_table;
+	u32 lo, hi;
+
+	for (; length >= 8; length -= 8, data += 8) {
+		lo = get_u32(data) ^ crc;
+		hi = get_u32(data + 4);
+		crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^
+		      t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+		      t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^
+		      t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+	}
+	while (length--)
+		crc = t[0][(u8)(crc ^ *data++)] ^ (crc >> 8);
+
+	return crc;
+}
+
+u32 crc32c_le(u32 crc, const char *data, size_t length)
+{
+	if (crc32c_hw)
+		return crc32c_sse42(crc, data, length);
+	return crc32c_sliced(crc, data, length);
+}
+
+static bool cpu_has_sse42(void)
+{
+#if __SIZEOF_POINTER__ == 4
+	if (!cpu_has_eflag(EFLAGS_ID))
+		return false;
+#endif
+	return cpuid_eax(0) >= 1 &&
+		(cpuid_ecx(1) & (1 << (X86_FEATURE_XMM4_2 & 31)));
+}
+
+int btrfs_init_crc32c(void)
+{
+	int i, j;
+	u32 v;
+	const u32 poly = 0x82F63B78; /* Bit-reflected CRC32C polynomial */
+
+	if (crc32c_hw || crc32c_table)
+		return 0;
+
+	if (cpu_has_sse42()) {
+		crc32c_hw = true;
+		return 0;
+	}
+
+	crc32c_table = malloc(8 * sizeof *crc32c_table);
+	if (!crc32c_table)
+		return -1;
+
+	for (i = 0; i < 256; i++) {
+		v = i;
+		for (j = 0; j < 8; j++) {
+			v = (v >> 1) ^ ((v & 1) ? poly : 0);
+		}
+		crc32c_table[0][i] = v;
+	}
+	for (i = 0; i < 256; i++) {
+		v = crc32c_table[0][i];
+		for (j = 1; j < 8; j++) {
+			v = crc32c_table[0][v & 0xff] ^ (v >> 8);
+			crc32c_table[j][i] = v;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,145 @@
+/*
+ * decompress.c -- compressed file extent support for the btrfs reader
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, Inc., 53 Temple Place Ste 330,
+ * Boston MA 02111-1307, USA; either version 2 of the License, or
+ * (at your option) any later version; incorporated herein by reference.
+ *
+ */
+
+#include <dprintf.h>
+#include <stdio.h>
+#include <string.h>
+#include <minmax.h>
+#include <zlib.h>
+#include "btrfs.h"
+
+/*
+ * zlib: the extent is a single zlib stream.  Returns the number of bytes
+ * produced, or -1.
+ */
+static int btrfs_inflate(const void *src, size_t srclen,
+			 void *dst, size_t dstlen)
+{
+	z_stream zs;
+	int rv;
+
+	memset(&zs, 0, sizeof zs);
+	zs.next_in = (Bytef *)src;
+	zs.avail_in = srclen;
+	zs.next_out = dst;
+	zs.avail_out = dstlen;
+
+	if (inflateInit(&zs) != Z_OK)
+		return -1;
+	rv = inflate(&zs, Z_FINISH);
+	inflateEnd(&zs);
+
+	/* A full output buffer is fine even if the stream didn't end */
+	if (rv != Z_STREAM_END && zs.avail_out)
+		return -1;
+	return dstlen - zs.avail_out;
+}
+
+#ifdef __FIRMWARE_BIOS__
+
+/* core/lzo/lzo1x_f2.S, the decoder that unpacks the core itself */
+extern int __cdecl _lzo1x_decompress_asm_fast_safe(const void *src,
+						    unsigned int src_len,
+						    void *dst,
+						    unsigned int *dst_len,
+						    void *wrkmem);
+
+#define LZO_E_INPUT_NOT_CONSUMED	(-8)
+
+/*
+ * LZO: a 32-bit total length, then segments of a 32-bit length followed
+ * by LZO1X data which each expand to at most one 4K page.  A segment
+ * header never straddles a page of the compressed stream; if fewer than
+ * four bytes are left in the page, the header starts on the next one.
+ */
+#define BTRFS_LZO_PAGE	4096
+
+static int btrfs_unlzo(const void *src, size_t srclen,
+		       void *dst, size_t dstlen)
+{
+	const u8 *in = src;
+	u8 *out = dst;
+	u32 total, seglen, pos, done = 0;
+	unsigned int outlen;
+	int rv;
+
+	if (srclen < 4)
+		return -1;
+	total = *(const __le32 *)in;
+	if (total > srclen)
+		return -1;
+
+	pos = 4;
+	while (pos < total && done < dstlen) {
+		if (BTRFS_LZO_PAGE - (pos % BTRFS_LZO_PAGE) < 4)
+			pos = (pos + BTRFS_LZO_PAGE - 1) & ~(BTRFS_LZO_PAGE - 1);
+		if (total - pos < 4)
+			break;
+		seglen = *(const __le32 *)(in + pos);
+		pos += 4;
+		if (!seglen || seglen > total - pos)
+			return -1;
+
+		outlen = min(dstlen - done, BTRFS_LZO_PAGE);
+		rv = _lzo1x_decompress_asm_fast_safe(in + pos, seglen,
+						     out + done, &outlen, NULL);
+		if (rv && rv != LZO_E_INPUT_NOT_CONSUMED) {
+			dprintf("btrfs: lzo error %d at %u\n", rv, pos);
+			return -1;
+		}
+		done += outlen;
+		pos += seglen;
+	}
+	return done;
+}
+
+#else
+
+static int btrfs_unlzo(const void *src, size_t srclen,
+		       void *dst, size_t dstlen)
+{
+	(void)src;
+	(void)srclen;
+	(void)dst;
+	(void)dstlen;
+	printf("btrfs: LZO compressed data is not supported here\n");
+	return -1;
+}
+
+#endif /* __FIRMWARE_BIOS__ */
+
+/*
+ * Decompress one extent into dst, which must have BTRFS_DECOMPRESS_SLACK
+ * bytes of room past dstlen.  Whatever the stream doesn't cover is zeroed.
+ * Returns 0 on success.
+ */
+int btrfs_decompress(int type, const void *src, size_t srclen,
+		     void *dst, size_t dstlen)
+{
+	int len;
+
+	switch (type) {
+	case BTRFS_COMPRESS_ZLIB:
+		len = btrfs_inflate(src, srclen, dst, dstlen);
+		break;
+	case BTRFS_COMPRESS_LZO:
+		len = btrfs_unlzo(src, srclen, dst, dstlen);
+		break;
+	default:
+		printf("btrfs: unknown compression type %d\n", type);
+		return -1;
+	}
+
+	if (len < 0)
+		return -1;
+	memset((char *)dst + len, 0, dstlen - len);
+	return 0;
+}
@@ -6,8 +6,56 @@
 #include <stdio.h>
 #include <string.h>
 #include <dprintf.h>
+#include <ilog2.h>
+#include <minmax.h>
+#include <syslinux/trace.h>
 #include "core.h"
 #include "cache.h"
+#include "pmapi.h"
+
+/*
+ * Metadata prefetch requests queued by the filesystem drivers, waiting
+ * to be merged and handed to cache_readahead().
+ */
+static struct cache_prefetch {
+    struct device *dev;
+    block_t block;
+    uint32_t count;
+} cache_pf_queue[CACHE_PREFETCH_QUEUE];
+static unsigned int cache_pf_count;
+
+/*
+ * Hash a block number into a bucket index.  This is a multiplicative
+ * (Fibonacci) hash, so that runs of consecutive blocks spread evenly.
+ */
+static inline uint32_t cache_hash(const struct device *dev, block_t block)
+{
+    uint32_t h = (uint32_t)block ^ (uint32_t)(block >> 32);
+
+    return (h * 0x9e370001U) >> dev->cache_hash_shift;
+}
+
+static void cache_hash_insert(struct device *dev, struct cache *cs)
+{
+    struct cache **bucket = &dev->cache_hash[cache_hash(dev, cs->block)];
+
+    cs->hnext = *bucket;
+    *bucket = cs;
+}
+
+static void cache_hash_remove(struct device *dev, struct cache *cs)
+{
+    struct cache **pp = &dev->cache_hash[cache_hash(dev, cs->block)];
+
+    while (*pp) {
+	if (*pp == cs) {
+	    *pp = cs->hnext;
+	    break;
+	}
+	pp = &(*pp)->hnext;
+    }
+    cs->hnext = NULL;
+}
 
 
 /*
@@ -19,24 +67,49 @@ void cache_init(struct device *dev, int block_size_shift)
 {
     struct cache *prev, *cur;
     char *data = dev->cache_data;
-    struct cache *head, *cache;
-    int i;
+    struct cache *head, *hot, *cache;
+    int i, hash_bits;
+    unsigned int ra, spb_shift;
 
     dev->cache_block_size = 1 << block_size_shift;
 
-    if (dev->cache_size < dev->cache_block_size + 2*sizeof(struct cache)) {
+    if (dev->cache_size < dev->cache_block_size + 3*sizeof(struct cache)
+	+ 2*sizeof(struct cache *)) {
 	dev->cache_head = NULL;
 	return;			/* Cache unusably small */
     }
 
-    /* We need one struct cache for the headnode plus one for each block */
+    /*
+     * We need two struct cache for the headnodes of the probation and
+     * protected chains plus one for each block, and (at most) one hash
+     * bucket pointer for each block, plus one so that there are always
+     * at least two buckets.
+     */
     dev->cache_entries =
-	(dev->cache_size - sizeof(struct cache))/
-	(dev->cache_block_size + sizeof(struct cache));
+	(dev->cache_size - 2*sizeof(struct cache) - sizeof(struct cache *))/
+	(dev->cache_block_size + sizeof(struct cache) + sizeof(struct cache *));
 
     dev->cache_head = head = (struct cache *)
 	(data + (dev->cache_entries << block_size_shift));
-    cache = head + 1;		/* First cache descriptor */
+    dev->cache_hot_head = hot = head + 1;
+    cache = head + 2;		/* First cache descriptor */
+
+    /*
+     * The hash table is a power of two in size, following the
+     * descriptors.  A shift by 32 would be undefined, so even a
+     * one-block cache gets two buckets.
+     */
+    hash_bits = max(ilog2(dev->cache_entries), 1);
+    dev->cache_hash_shift = 32 - hash_bits;
+    dev->cache_hash = (struct cache **)&cache[dev->cache_entries];
+    memset(dev->cache_hash, 0, sizeof(struct cache *) << hash_bits);
+
+    /* The protected chain starts out empty */
+    hot->prev = hot->next = hot;
+    hot->block = -1;
+    hot->data  = NULL;
+    dev->cache_hot_count = 0;
+    dev->cache_hot_max = dev->cache_entries - dev->cache_entries / 4;
 
     head->prev  = &cache[dev->cache_entries-1];
     head->prev->next = head;
@@ -49,64 +122,174 @@ void cache_init(struct device *dev, int block_size_shift)
         cur = &cache[i];
         cur->data  = data;
         cur->block = -1;
+        cur->hnext = NULL;
+        cur->hot   = 0;
+        cur->unref = 0;
         cur->prev  = prev;
         prev->next = cur;
         data += dev->cache_block_size;
         prev = cur++;
     }
 
+    /*
+     * Size the read-ahead window: one disk transfer's worth of blocks,
+     * and never so much that a single read-ahead would flush a large
+     * part of the cache.
+     */
+    ra = CACHE_MAX_READAHEAD;
+    if (dev->disk->maxtransfer) {
+	spb_shift = block_size_shift - dev->disk->sector_shift;
+	if ((dev->disk->maxtransfer >> spb_shift) < ra)
+	    ra = dev->disk->maxtransfer >> spb_shift;
+    }
+    if (ra > dev->cache_entries / 4)
+	ra = dev->cache_entries / 4;
+
+    free(dev->cache_ra_buf);
+    dev->cache_ra_buf = NULL;
+    dev->cache_readahead = 0;
+    if (ra > 1) {
+	dev->cache_ra_buf = malloc(ra << block_size_shift);
+	if (dev->cache_ra_buf)
+	    dev->cache_readahead = ra;
+    }
+
     dev->cache_init = 1; /* Set cache as initialized */
 }
 
+static inline void cache_unlink(struct cache *cs)
+{
+    cs->prev->next = cs->next;
+    cs->next->prev = cs->prev;
+}
+
+/* Append to the MRU end of the chain headed by HEAD */
+static inline void cache_append(struct cache *head, struct cache *cs)
+{
+    cs->prev = head->prev;
+    head->prev->next = cs;
+    cs->next = head;
+    head->prev = cs;
+}
+
 /*
  * Lock a block permanently in the cache by removing it
  * from the LRU chain.
  */
 void cache_lock_block(struct cache *cs)
 {
-    cs->prev->next = cs->next;
-    cs->next->prev = cs->prev;
+    cache_unlink(cs);
 
     cs->next = cs->prev = NULL;
 }
 
+/*
+ * The cache uses a segmented LRU (a simplified 2Q): blocks enter on
+ * the probation chain, and only move to the protected chain when they
+ * are referenced again.  Victims come from probation first, so a long
+ * stream of blocks which are only touched once (file data, large
+ * directory scans) can only cycle through the probation share of the
+ * cache without flushing hot metadata.  The protected chain is capped
+ * at three quarters of the cache; its LRU block is demoted back to
+ * probation when it overflows.
+ *
+ * A hit on the most recently inserted block is a correlated reference
+ * (e.g. several small reads out of the same block) and doesn't count
+ * as a reuse.  Neither does the first hit on a block brought in by
+ * read-ahead or prefetch: that is the block's first real reference,
+ * so it only moves to the MRU end of probation, as if it had just been
+ * read.  Otherwise every block of a stream would count as reused.
+ */
+static void cache_touch(struct device *dev, struct cache *cs)
+{
+    struct cache *head = dev->cache_head;
+    struct cache *hot = dev->cache_hot_head;
+    struct cache *demote;
+
+    if (!cs->next)
+	return;			/* Locked block */
+
+    if (cs->hot) {
+	cache_unlink(cs);
+	cache_append(hot, cs);
+    } else if (cs->unref) {
+	cs->unref = 0;
+	cache_unlink(cs);
+	cache_append(head, cs);
+    } else if (cs != head->prev) {
+	cache_unlink(cs);
+	cache_append(hot, cs);
+	cs->hot = 1;
+	if (++dev->cache_hot_count > dev->cache_hot_max) {
+	    demote = hot->next;
+	    cache_unlink(demote);
+	    cache_append(head, demote);
+	    demote->hot = 0;
+	    dev->cache_hot_count--;
+	}
+    }
+}
+
 /*
  * Check for a particular BLOCK in the block cache, 
  * and if it is already there, just do nothing and return;
  * otherwise pick a victim block and update the LRU link.
+ *
+ * A victim is removed from the hash index and returned with
+ * block == -1; it is up to the caller to fill it and enter it
+ * with the new block number via cache_set_block().
  */
 struct cache *_get_cache_block(struct device *dev, block_t block)
 {
     struct cache *head = dev->cache_head;
+    struct cache *hot = dev->cache_hot_head;
     struct cache *cs;
-    int i;
 
-    cs = dev->cache_head + 1;
-
-    for (i = 0; i < dev->cache_entries; i++) {
-	if (cs->block == block)
-	    goto found;
-	cs++;
+    for (cs = dev->cache_hash[cache_hash(dev, block)]; cs; cs = cs->hnext) {
+	if (cs->block == block) {
+	    cache_touch(dev, cs);
+	    return cs;
+	}
     }
     
-    /* Not found, pick a victim */
+    /* Not found, pick a victim: probation first, then protected */
     cs = head->next;
+    if (cs == head)
+	cs = hot->next;
+
+    if (cs->block != (block_t)-1) {
+	dev->cache_evictions++;
+	cache_hash_remove(dev, cs);
+	cs->block = -1;
+    }
 
-found:
-    /* Move to the end of the LRU chain, unless the block is already locked */
-    if (cs->next) {
-	cs->prev->next = cs->next;
-	cs->next->prev = cs->prev;
-	
-	cs->prev = head->prev;
-	head->prev->next = cs;
-	cs->next = head;
-	head->prev = cs;
+    /* The new block goes to the MRU end of the probation chain */
+    cache_unlink(cs);
+    if (cs->hot) {
+	cs->hot = 0;
+	dev->cache_hot_count--;
     }
+    cs->unref = 0;
+    cache_append(head, cs);
 
     return cs;
 }    
 
+/*
+ * Assign a block number to a cache descriptor obtained from
+ * _get_cache_block(), making it visible to later lookups.
+ */
+void cache_set_block(struct device *dev, struct cache *cs, block_t block)
+{
+    if (cs->block == block)
+	return;
+    if (cs->block != (block_t)-1)
+	cache_hash_remove(dev, cs);
+    cs->block = block;
+    if (block != (block_t)-1)
+	cache_hash_insert(dev, cs);
+}
+
 /*
  * Check for a particular BLOCK in the block cache, 
  * and if it is already there, just do nothing and return;
@@ -119,32 +302,199 @@ const void *get_cache(struct device *dev, block_t block)
 
     cs = _get_cache_block(dev, block);
     if (cs->block != block) {
-	cs->block = block;
+	dev->cache_misses++;
+	trace(TRACE_CACHE, "cache_miss", block, 0);
+	disk_io_source = DISK_IO_CACHE;
         getoneblk(dev->disk, cs->data, block, dev->cache_block_size);
+	cache_set_block(dev, cs, block);
+    } else {
+	dev->cache_hits++;
+	trace(TRACE_CACHE, "cache_hit", block, 0);
     }
 
     return cs->data;
 }
 
+/*
+ * Look up a block without disturbing the LRU order.
+ */
+static inline struct cache *cache_lookup(struct device *dev, block_t block)
+{
+    struct cache *cs;
+
+    for (cs = dev->cache_hash[cache_hash(dev, block)]; cs; cs = cs->hnext) {
+	if (cs->block == block)
+	    break;
+    }
+    return cs;
+}
+
+/*
+ * Bring the run of blocks starting at BLOCK into the cache with one
+ * disk request, stopping at the first block which is already cached,
+ * after NBLOCKS blocks, or at the read-ahead window, whichever comes
+ * first.  Returns the number of blocks actually read.
+ */
+size_t cache_readahead(struct device *dev, block_t block, size_t nblocks)
+{
+    struct disk *disk = dev->disk;
+    struct cache *cs;
+    unsigned int block_shift = ilog2(dev->cache_block_size);
+    unsigned int spb_shift = block_shift - disk->sector_shift;
+    size_t i, n, done;
+    const char *p;
+
+    if (!dev->cache_readahead || !dev->cache_head)
+	return 0;
+
+    if (nblocks > dev->cache_readahead)
+	nblocks = dev->cache_readahead;
+
+    for (n = 0; n < nblocks; n++) {
+	if (cache_lookup(dev, block + n))
+	    break;
+    }
+    if (n < 2)
+	return 0;		/* Not worth it, leave it to get_cache() */
+
+    disk_io_source = DISK_IO_CACHE;
+    done = disk->rdwr_sectors(disk, dev->cache_ra_buf,
+			      block << spb_shift, n << spb_shift, 0);
+    done >>= spb_shift;
+    if (done > n)
+	done = n;
+
+    dev->cache_ra_reqs++;
+    dev->cache_ra_blocks += done;
+    trace(TRACE_CACHE, "cache_readahead", block, done);
+
+    p = dev->cache_ra_buf;
+    for (i = 0; i < done; i++) {
+	cs = _get_cache_block(dev, block + i);
+	memcpy(cs->data, p, dev->cache_block_size);
+	cache_set_block(dev, cs, block + i);
+	cs->unref = 1;
+	p += dev->cache_block_size;
+    }
+
+    return done;
+}
+
+/*
+ * Queue NBLOCKS blocks starting at BLOCK to be brought into the cache
+ * by the next cache_prefetch_flush().  Requests that touch are merged,
+ * so that a driver queueing the pieces of its metadata one at a time
+ * still gets them in as few disk requests as possible.
+ *
+ * Flushing replaces cache blocks, so it is only done where no driver
+ * can be holding a pointer from get_cache(): the callers of the
+ * fs_ops->prefetch method flush right after it returns.  For the same
+ * reason a full queue drops the request instead of flushing; it is
+ * only a hint.
+ */
+void cache_prefetch(struct device *dev, block_t block, size_t nblocks)
+{
+    struct cache_prefetch *pf;
+    unsigned int i;
+
+    if (!dev->cache_readahead || !dev->cache_head || !nblocks)
+	return;
+
+    if (nblocks == 1 && cache_lookup(dev, block))
+	return;
+
+    for (i = 0; i < cache_pf_count; i++) {
+	pf = &cache_pf_queue[i];
+	if (pf->dev != dev)
+	    continue;
+	if (block <= pf->block + pf->count && pf->block <= block + nblocks) {
+	    block_t end = max(pf->block + pf->count, block + nblocks);
+
+	    pf->block = min(pf->block, block);
+	    pf->count = end - pf->block;
+	    return;
+	}
+    }
+
+    if (cache_pf_count >= CACHE_PREFETCH_QUEUE)
+	return;
+
+    pf = &cache_pf_queue[cache_pf_count++];
+    pf->dev   = dev;
+    pf->block = block;
+    pf->count = nblocks;
+}
+
+/*
+ * Issue everything queued by cache_prefetch(), in disk order.
+ */
+void cache_prefetch_flush(void)
+{
+    struct cache_prefetch *pf, tmp;
+    unsigned int i, j, n;
+    block_t block, end;
+    size_t done;
+
+    n = cache_pf_count;
+    cache_pf_count = 0;
+
+    /* Insertion sort, the queue is tiny */
+    for (i = 1; i < n; i++) {
+	tmp = cache_pf_queue[i];
+	for (j = i; j > 0 && cache_pf_queue[j-1].block > tmp.block; j--)
+	    cache_pf_queue[j] = cache_pf_queue[j-1];
+	cache_pf_queue[j] = tmp;
+    }
+
+    for (i = 0; i < n; i++) {
+	pf = &cache_pf_queue[i];
+	block = pf->block;
+	end = block + pf->count;
+
+	/* Requests queued out of order may only touch once sorted */
+	while (i+1 < n && cache_pf_queue[i+1].dev == pf->dev &&
+	       cache_pf_queue[i+1].block <= end) {
+	    i++;
+	    end = max(end, cache_pf_queue[i].block + cache_pf_queue[i].count);
+	}
+
+	while (block < end) {
+	    if (cache_lookup(pf->dev, block)) {
+		block++;
+		continue;
+	    }
+	    done = cache_readahead(pf->dev, block, end - block);
+	    block += done ? done : 1;
+	}
+    }
+}
+
 /*
  * Read data from the cache at an arbitrary byte offset and length.
  * This is useful for filesystems whose metadata is not necessarily
  * aligned with their blocks.
  *
- * This is still reading linearly on the disk.
+ * This is still reading linearly on the disk, but a miss pulls in
+ * the following blocks of the request (and a read-ahead window past
+ * its end) with a single disk request.
  */
 size_t cache_read(struct fs_info *fs, void *buf, uint64_t offset, size_t count)
 {
+    struct device *dev = fs->fs_dev;
     const char *cd;
     char *p = buf;
     size_t off, cnt, total;
-    block_t block;
+    block_t block, last;
 
     total = count;
+    if (count)
+	last = (offset + count - 1) >> fs->block_shift;
     while (count) {
 	block = offset >> fs->block_shift;
 	off = offset & (fs->block_size - 1);
-	cd = get_cache(fs->fs_dev, block);
+	if (dev->cache_readahead && !cache_lookup(dev, block))
+	    cache_readahead(dev, block, last - block + dev->cache_readahead);
+	cd = get_cache(dev, block);
 	if (!cd)
 	    break;
 	cnt = fs->block_size - off;
@@ -157,3 +507,28 @@ size_t cache_read(struct fs_info *fs, void *buf, uint64_t offset, size_t count)
     }
     return total - count;
 }
+
+/*
+ * Report the block cache statistics of the current filesystem.
+ * Returns -1 if the filesystem has no block cache (e.g. PXE).
+ */
+__export int pmapi_cache_stats(struct com32_cache_stats *st)
+{
+    struct device *dev = this_fs ? this_fs->fs_dev : NULL;
+
+    memset(st, 0, sizeof *st);
+    if (!dev || !dev->cache_head)
+	return -1;
+
+    st->fs_name    = this_fs->fs_ops->fs_name;
+    st->block_size = dev->cache_block_size;
+    st->entries    = dev->cache_entries;
+    st->readahead  = dev->cache_readahead;
+    st->hits       = dev->cache_hits;
+    st->misses     = dev->cache_misses;
+    st->evictions  = dev->cache_evictions;
+    st->ra_reqs    = dev->cache_ra_reqs;
+    st->ra_blocks  = dev->cache_ra_blocks;
+
+    return 0;
+}
@@ -6,10 +6,18 @@
 #include <core.h>
 #include <fs.h>
 #include <disk.h>
+#include <cache.h>
 #include <ilog2.h>
+#include <pmapi.h>
 #include <minmax.h>
+#include <cpufeature.h>
+#include <sys/cpu.h>
 
 #include <syslinux/firmware.h>
+#include <syslinux/memscan.h>
+#include <syslinux/disktrace.h>
+
+#define DISK_TRACE_ENTRIES	1024
 
 void getoneblk(struct disk *disk, char *buf, block_t block, int block_size)
 {
@@ -18,17 +26,156 @@ void getoneblk(struct disk *disk, char *buf, block_t block, int block_size)
     disk->rdwr_sectors(disk, buf, block * sec_per_block, sec_per_block, 0);
 }
 
+uint8_t disk_io_source = DISK_IO_OTHER;
+
+static struct disk_trace disk_trace;
+static int (*disk_trace_backend)(struct disk *, void *, sector_t,
+				 size_t, bool);
+static bool disk_trace_tsc;
+
+static inline uint64_t disk_trace_clock(void)
+{
+    return disk_trace_tsc ? rdtsc() : 0;
+}
+
+/*
+ * Sits in front of the firmware rdwr_sectors method and logs each
+ * transfer into the ring.
+ */
+static int trace_rdwr_sectors(struct disk *disk, void *buf, sector_t lba,
+			      size_t count, bool is_write)
+{
+    struct disk_trace_rec *rec;
+    int rv;
+
+    rec = &disk_trace.rec[disk_trace.total++ % disk_trace.size];
+    rec->lba      = lba;
+    rec->count    = count;
+    rec->is_write = is_write;
+    rec->source   = disk_io_source;
+    rec->_pad     = 0;
+
+    rec->tsc_start = disk_trace_clock();
+    rv = disk_trace_backend(disk, buf, lba, count, is_write);
+    rec->tsc_end = disk_trace_clock();
+    rec->result = rv;
+
+    /*
+     * The backend may have switched methods under us (e.g. EDD falling
+     * back to CHS); pick up the new one and put ourselves back in front.
+     */
+    if (disk->rdwr_sectors != trace_rdwr_sectors) {
+	disk_trace_backend = disk->rdwr_sectors;
+	disk->rdwr_sectors = trace_rdwr_sectors;
+    }
+
+    disk_io_source = DISK_IO_OTHER;
+    return rv;
+}
+
+static void disk_trace_init(struct disk *disk)
+{
+    if (!disk || !disk->rdwr_sectors)
+	return;
+
+    disk_trace.rec = malloc(DISK_TRACE_ENTRIES * sizeof *disk_trace.rec);
+    if (!disk_trace.rec)
+	return;			/* Tracing is optional */
+
+    disk_trace.size  = DISK_TRACE_ENTRIES;
+    disk_trace.total = 0;
+
+#if __SIZEOF_POINTER__ == 4
+    disk_trace_tsc = cpu_has_eflag(EFLAGS_ID) &&
+	(cpuid_edx(1) & (1 << (X86_FEATURE_TSC & 31)));
+#else
+    disk_trace_tsc = true;
+#endif
+
+    disk_trace_backend = disk->rdwr_sectors;
+    disk->rdwr_sectors = trace_rdwr_sectors;
+}
+
+__export const struct disk_trace *disk_trace_get(void)
+{
+    return disk_trace.size ? &disk_trace : NULL;
+}
+
+static int count_free_highmem(void *data, addr_t start, addr_t len,
+			      enum syslinux_memmap_types type)
+{
+    uint64_t *total = data;
+
+    if (type == SMT_FREE && start >= 0x100000)
+	*total += len;
+
+    return 0;
+}
+
+/*
+ * Pick a cache size based on how much memory the machine has.
+ */
+static size_t cache_size_from_memmap(void)
+{
+    uint64_t free_mem = 0;
+    uint64_t size;
+
+    if (!CACHE_SIZE_MAX)
+	return CACHE_SIZE_MIN;	/* Fixed size, as configured */
+
+    syslinux_scan_memory(count_free_highmem, &free_mem);
+
+    size = free_mem >> CACHE_MEM_SHIFT;
+    if (size < CACHE_SIZE_MIN)
+	size = CACHE_SIZE_MIN;
+    if (size > CACHE_SIZE_MAX)
+	size = CACHE_SIZE_MAX;
+
+    return size;
+}
+
 /*
  * Initialize the device structure.
  */
 struct device * device_init(void *args)
 {
     static struct device dev;
+    size_t size;
 
     dev.disk = firmware->disk_init(args);
-    dev.cache_size = 128*1024;
-    dev.cache_data = malloc(dev.cache_size);
+    disk_trace_init(dev.disk);
+
+    /*
+     * The cache lives in the high heap; if we can't get as much as we
+     * would like, back off until we hit the old fixed size.
+     */
+    size = cache_size_from_memmap();
+    for (;;) {
+	dev.cache_data = malloc(size);
+	if (dev.cache_data || size <= CACHE_SIZE_MIN)
+	    break;
+	size >>= 1;
+	if (size < CACHE_SIZE_MIN)
+	    size = CACHE_SIZE_MIN;
+    }
+    dev.cache_size = dev.cache_data ? size : 0;
     dev.cache_init = 0; /* Explicitly set cache as uninitialized */
 
+    dprintf("device_init: %u bytes of block cache\n", dev.cache_size);
+
     return &dev;
 }
+
+/*
+ * What the firmware knows about a BIOS drive; see bios_disk_probe().
+ * Returns -1 if the drive isn't there, or there is no INT 13h.
+ */
+__export int pmapi_disk_probe(int drive, struct com32_disk_probe *dp)
+{
+    memset(dp, 0, sizeof *dp);
+    dp->drive = drive;
+    if (!firmware->disk_probe)
+	return -1;
+
+    return firmware->disk_probe(drive, dp);
+}
@@ -2,6 +2,7 @@
 #include <com32.h>
 #include <fs.h>
 #include <ilog2.h>
+#include <pmapi.h>
 
 #define RETRY_COUNT 6
 
@@ -15,8 +16,12 @@ struct edd_rdwr_packet {
     uint16_t blocks;
     far_ptr_t buf;
     uint64_t lba;
+    uint64_t buf64;		/* EDD 3.0: used if buf == FFFF:FFFF */
 };
 
+/* Size of an EDD packet without the 64-bit flat buffer address */
+#define EDD_PACKET_SIZE_16	16
+
 struct edd_disk_params {
     uint16_t  len;
     uint16_t  flags;
@@ -160,10 +165,83 @@ static int chs_rdwr_sectors(struct disk *disk, void *buf,
     return done;
 }
 
+static __lowmem struct edd_rdwr_packet edd_pkt;
+
+/*
+ * Issue a single EDD read of COUNT sectors at absolute LBA, either to a
+ * real-mode buffer or (if FLAT) to a 32-bit flat address.
+ */
+static bool edd_read_once(struct disk *disk, void *buf, sector_t lba,
+			  size_t count, bool flat)
+{
+    com32sys_t ireg, oreg;
+
+    memset(&ireg, 0, sizeof ireg);
+    ireg.eax.b[1] = 0x42;
+    ireg.edx.b[0] = disk->disk_number;
+    ireg.ds       = SEG(&edd_pkt);
+    ireg.esi.w[0] = OFFS(&edd_pkt);
+
+    edd_pkt.blocks = count;
+    edd_pkt.lba    = lba;
+    if (flat) {
+	edd_pkt.size     = sizeof edd_pkt;
+	edd_pkt.buf.seg  = 0xffff;
+	edd_pkt.buf.offs = 0xffff;
+	edd_pkt.buf64    = (size_t)buf;
+    } else {
+	edd_pkt.size  = EDD_PACKET_SIZE_16;
+	edd_pkt.buf   = FAR_PTR(buf);
+	edd_pkt.buf64 = 0;
+    }
+
+    __intcall(0x13, &ireg, &oreg);
+    return !(oreg.eflags.l & EFLAGS_CF);
+}
+
+/*
+ * Many BIOSes claim EDD 3.0 without actually honoring 64-bit flat
+ * buffer addresses, so before relying on them read one sector both
+ * ways and check that the flat read really landed where it should.
+ */
+static bool edd_flat_ok(struct disk *disk, sector_t lba)
+{
+    struct bios_disk_private *priv = disk->private;
+    char *hbuf;
+    size_t bytes = disk->sector_size;
+    size_t i;
+
+    if (priv->edd_flat)
+	return priv->edd_flat > 0;
+
+    priv->edd_flat = -1;
+    if (priv->edd_version < 0x30)
+	return false;
+
+    hbuf = malloc(bytes);
+    if (!hbuf)
+	return false;
+
+    if (edd_read_once(disk, core_xfer_buf, lba, 1, false)) {
+	for (i = 0; i < bytes; i++)
+	    hbuf[i] = ~core_xfer_buf[i];
+
+	if (edd_read_once(disk, hbuf, lba, 1, true) &&
+	    !memcmp(hbuf, core_xfer_buf, bytes))
+	    priv->edd_flat = 1;
+    }
+
+    free(hbuf);
+    dprintf("EDD: 64-bit flat buffers %s\n",
+	    priv->edd_flat > 0 ? "enabled" : "disabled");
+    return priv->edd_flat > 0;
+}
+
 static int edd_rdwr_sectors(struct disk *disk, void *buf,
 			    sector_t lba, size_t count, bool is_write)
 {
-    static __lowmem struct edd_rdwr_packet pkt;
+    struct edd_rdwr_packet *pkt = &edd_pkt;
+    bool flat;
     char *ptr = buf;
     char *tptr;
     size_t chunk, freeseg;
@@ -178,8 +256,8 @@ static int edd_rdwr_sectors(struct disk *disk, void *buf,
 
     ireg.eax.b[1] = 0x42 + is_write;
     ireg.edx.b[0] = disk->disk_number;
-    ireg.ds       = SEG(&pkt);
-    ireg.esi.w[0] = OFFS(&pkt);
+    ireg.ds       = SEG(pkt);
+    ireg.esi.w[0] = OFFS(pkt);
 
     memset(&reset, 0, sizeof reset);
 
@@ -190,10 +268,16 @@ static int edd_rdwr_sectors(struct disk *disk, void *buf,
 	    chunk = maxtransfer;
 
 	freeseg = (0x10000 - ((size_t)ptr & 0xffff)) >> sector_shift;
+	flat = false;
 
 	if ((size_t)ptr <= 0xf0000 && freeseg) {
 	    /* Can do a direct load */
 	    tptr = ptr;
+	} else if (edd_flat_ok(disk, lba)) {
+	    /* EDD 3.0 flat address: no bounce and no 64K limit */
+	    tptr = ptr;
+	    flat = true;
+	    freeseg = chunk;
 	} else {
 	    /* Either accessing high memory or we're crossing a 64K line */
 	    tptr = core_xfer_buf;
@@ -210,14 +294,22 @@ static int edd_rdwr_sectors(struct disk *disk, void *buf,
 	retry = RETRY_COUNT;
 
 	for (;;) {
-	    pkt.size   = sizeof pkt;
-	    pkt.blocks = chunk;
-	    pkt.buf    = FAR_PTR(tptr);
-	    pkt.lba    = lba;
+	    pkt->blocks = chunk;
+	    pkt->lba    = lba;
+	    if (flat) {
+		pkt->size     = sizeof *pkt;
+		pkt->buf.seg  = 0xffff;
+		pkt->buf.offs = 0xffff;
+		pkt->buf64    = (size_t)tptr;
+	    } else {
+		pkt->size  = EDD_PACKET_SIZE_16;
+		pkt->buf   = FAR_PTR(tptr);
+		pkt->buf64 = 0;
+	    }
 
 	    dprintf("EDD[%02x]: %u @ %llu %04x:%04x %s %p\n",
-		    ireg.edx.b[0], pkt.blocks, pkt.lba,
-		    pkt.buf.seg, pkt.buf.offs,
+		    ireg.edx.b[0], pkt->blocks, pkt->lba,
+		    pkt->buf.seg, pkt->buf.offs,
 		    (ireg.eax.b[1] & 1) ? "<-" : "->",
 		    ptr);
 
@@ -347,6 +439,7 @@ struct disk *bios_disk_init(void *private)
 	    oreg.ebx.w[0] == 0xaa55 && (oreg.ecx.b[0] & 1)) {
 	    ebios = true;
 	    hard_max_transfer = 127;
+	    priv->edd_version = oreg.eax.b[1];
 
 	    /* Query EBIOS parameters */
 	    /* The memset() is needed once this function can be called
@@ -394,6 +487,107 @@ struct disk *bios_disk_init(void *private)
     return &disk;
 }
 
+/*
+ * Ask INT 13h about a drive: AH=08h, with the MEMDISK installation
+ * check folded into it, AH=41h, and AH=48h if that says it may.
+ * Each drive is asked once per session; disk.c32, ifmemdsk.c32 and
+ * the libraries' disk code then get the answers from here, however
+ * often they are run.
+ *
+ * Only drives that answered anything take up memory.
+ */
+static struct com32_disk_probe *disk_probes[256];
+static uint32_t disk_probed[256 / 32];
+
+static void disk_probe_drive(struct com32_disk_probe *dp)
+{
+    static __lowmem uint8_t edd_buf[COM32_DISK_EDD_LEN];
+    com32sys_t ireg, oreg;
+
+    memset(&ireg, 0, sizeof ireg);
+    ireg.eax.b[1] = 0x08;
+    ireg.edx.b[0] = dp->drive;
+    /* 'ME' 'MD' 'IS' 'K?' */
+    ireg.eax.w[1] = 0x454d;
+    ireg.ecx.w[1] = 0x444d;
+    ireg.edx.w[1] = 0x5349;
+    ireg.ebx.w[1] = 0x3f4b;
+    __intcall(0x13, &ireg, &oreg);
+
+    if (!(oreg.eflags.l & EFLAGS_CF)) {
+	dp->flags |= COM32_DISK_CHS;
+	dp->chs_type = oreg.ebx.b[0];
+	dp->chs_cx = oreg.ecx.w[0];
+	dp->chs_dx = oreg.edx.w[0];
+    }
+    /* '!M' 'EM' 'DI' 'SK' */
+    if (oreg.eax.w[1] == 0x4d21 && oreg.ecx.w[1] == 0x4d45 &&
+	oreg.edx.w[1] == 0x4944 && oreg.ebx.w[1] == 0x4b53) {
+	dp->flags |= COM32_DISK_MEMDISK;
+	dp->memdisk_info = (oreg.es << 4) + oreg.edi.w[0];
+    }
+
+    memset(&ireg, 0, sizeof ireg);
+    ireg.eax.b[1] = 0x41;
+    ireg.ebx.w[0] = 0x55aa;
+    ireg.edx.b[0] = dp->drive;
+    ireg.eflags.b[0] = 0x3;	/* CF set */
+    __intcall(0x13, &ireg, &oreg);
+
+    if (oreg.eflags.l & EFLAGS_CF || oreg.ebx.w[0] != 0xaa55)
+	return;
+
+    dp->flags |= COM32_DISK_EBIOS;
+    dp->edd_version = oreg.eax.b[1];
+    dp->edd_subset = oreg.ecx.w[0];
+
+    /* Some optical drives get confused if they haven't any geometry */
+    if (!(dp->edd_subset & 1) && !(dp->flags & COM32_DISK_CHS))
+	return;
+
+    memset(edd_buf, 0, sizeof edd_buf);
+    *(uint16_t *)edd_buf = sizeof edd_buf;
+
+    memset(&ireg, 0, sizeof ireg);
+    ireg.eax.b[1] = 0x48;
+    ireg.edx.b[0] = dp->drive;
+    ireg.ds = SEG(edd_buf);
+    ireg.esi.w[0] = OFFS(edd_buf);
+    __intcall(0x13, &ireg, &oreg);
+
+    if (!(oreg.eflags.l & EFLAGS_CF)) {
+	dp->flags |= COM32_DISK_EDD;
+	memcpy(dp->edd_params, edd_buf, sizeof edd_buf);
+    }
+}
+
+int bios_disk_probe(int drive, struct com32_disk_probe *dp)
+{
+    struct com32_disk_probe *p;
+
+    drive &= 0xff;
+
+    if (!(disk_probed[drive >> 5] & (1U << (drive & 31)))) {
+	disk_probe_drive(dp);
+	if (dp->flags) {
+	    p = malloc(sizeof *p);
+	    if (!p)
+		return 0;	/* Ask again next time, then */
+	    *p = *dp;
+	    disk_probes[drive] = p;
+	}
+	disk_probed[drive >> 5] |= 1U << (drive & 31);
+	return dp->flags ? 0 : -1;
+    }
+
+    p = disk_probes[drive];
+    if (!p)
+	return -1;
+
+    *dp = *p;
+    return 0;
+}
+
 void pm_fs_init(com32sys_t *regs)
 {
 	static struct bios_disk_private priv;
@@ -12,19 +12,28 @@
 #include <cache.h>
 #include "ext2_fs.h"
 
+/*
+ * Walk from the root in the inode down to the leaf covering BLOCK,
+ * remembering the path in the inode for next time.
+ */
 static const struct ext4_extent_header *
-ext4_find_leaf(struct fs_info *fs, const struct ext4_extent_header *eh,
-	       block_t block)
+ext4_find_leaf(struct inode *inode, block_t block)
 {
-    struct ext4_extent_idx *index;
-    block_t blk;
-    int i;
+    struct fs_info *fs = inode->fs;
+    struct ext2_pvt_inode *pvt = PVT(inode);
+    const struct ext4_extent_header *eh = &pvt->i_extent_hdr;
+    const struct ext4_extent_idx *index;
+    block_t blk = 0, parent = 0;
+    uint32_t first = 0, end = UINT32_MAX, pend = UINT32_MAX;
+    int i, pslot = 0;
+
+    pvt->ext_valid = false;
 
     while (1) {
 	if (eh->eh_magic != EXT4_EXT_MAGIC)
 	    return NULL;
 	if (eh->eh_depth == 0)
-	    return eh;
+	    break;
 
 	index = EXT4_FIRST_INDEX(eh);
 	for (i = 0; i < (int)eh->eh_entries; i++) {
@@ -34,10 +43,90 @@ ext4_find_leaf(struct fs_info *fs, const struct ext4_extent_header *eh,
 	if (--i < 0)
 	    return NULL;
 
+	pend   = end;
+	first  = index[i].ei_block;
+	if (i + 1 < (int)eh->eh_entries)
+	    end = index[i+1].ei_block;
+	parent = blk;
+	pslot  = i;
+
 	blk = index[i].ei_leaf_hi;
 	blk = (blk << 32) + index[i].ei_leaf_lo;
 	eh = get_cache(fs->fs_dev, blk);
     }
+
+    pvt->ext_leaf   = blk;
+    pvt->ext_parent = parent;
+    pvt->ext_first  = first;
+    pvt->ext_end    = end;
+    pvt->ext_pend   = pend;
+    pvt->ext_pslot  = pslot;
+    pvt->ext_slot   = 0;
+    pvt->ext_valid  = true;
+
+    return eh;
+}
+
+/*
+ * Use the cached path to find the leaf for BLOCK: either it is still
+ * the same leaf, or, reading sequentially, the next one under the same
+ * parent.  Returns NULL if we need to go back to the root.
+ */
+static const struct ext4_extent_header *
+ext4_cached_leaf(struct inode *inode, block_t block)
+{
+    struct fs_info *fs = inode->fs;
+    struct ext2_pvt_inode *pvt = PVT(inode);
+    const struct ext4_extent_header *eh;
+    const struct ext4_extent_idx *index;
+    unsigned int slot, entries;
+    uint32_t first, end;
+    block_t blk;
+
+    if (!pvt->ext_valid || block < pvt->ext_first)
+	return NULL;
+
+    if (block < pvt->ext_end) {
+	if (!pvt->ext_leaf)
+	    return &pvt->i_extent_hdr;
+	eh = get_cache(fs->fs_dev, pvt->ext_leaf);
+	return eh->eh_magic == EXT4_EXT_MAGIC && eh->eh_depth == 0 ? eh : NULL;
+    }
+
+    if (!pvt->ext_leaf || block >= pvt->ext_pend)
+	return NULL;
+
+    /* Step to the sibling leaf */
+    if (pvt->ext_parent)
+	eh = get_cache(fs->fs_dev, pvt->ext_parent);
+    else
+	eh = &pvt->i_extent_hdr;
+    if (eh->eh_magic != EXT4_EXT_MAGIC)
+	return NULL;
+
+    index = EXT4_FIRST_INDEX(eh);
+    entries = eh->eh_entries;
+    slot = pvt->ext_pslot + 1;
+    if (slot >= entries || index[slot].ei_block > block)
+	return NULL;
+    end = slot + 1 < entries ? index[slot+1].ei_block : pvt->ext_pend;
+    if (block >= end)
+	return NULL;		/* Skipped a leaf, not sequential */
+
+    first = index[slot].ei_block;
+    blk = index[slot].ei_leaf_hi;
+    blk = (blk << 32) + index[slot].ei_leaf_lo;
+    eh = get_cache(fs->fs_dev, blk);
+    if (eh->eh_magic != EXT4_EXT_MAGIC || eh->eh_depth != 0)
+	return NULL;
+
+    pvt->ext_leaf  = blk;
+    pvt->ext_first = first;
+    pvt->ext_end   = end;
+    pvt->ext_pslot = slot;
+    pvt->ext_slot  = 0;
+
+    return eh;
 }
 
 /* handle the ext4 extents to get the phsical block number */
@@ -45,20 +134,26 @@ ext4_find_leaf(struct fs_info *fs, const struct ext4_extent_header *eh,
 static block_t
 bmap_extent(struct inode *inode, uint32_t block, size_t *nblocks)
 {
-    struct fs_info *fs = inode->fs;
+    struct ext2_pvt_inode *pvt = PVT(inode);
     const struct ext4_extent_header *leaf;
     const struct ext4_extent *ext;
     int i;
     block_t start;
 
-    leaf = ext4_find_leaf(fs, &PVT(inode)->i_extent_hdr, block);
+    leaf = ext4_cached_leaf(inode, block);
+    if (!leaf)
+	leaf = ext4_find_leaf(inode, block);
     if (!leaf) {
 	printf("ERROR, extent leaf not found\n");
 	return 0;
     }
 
+    /* Reading forward, start the search where the last one ended */
     ext = EXT4_FIRST_EXTENT(leaf);
-    for (i = 0; i < leaf->eh_entries; i++) {
+    i = pvt->ext_slot;
+    if (i >= leaf->eh_entries || block < ext[i].ee_block)
+	i = 0;
+    for (; i < leaf->eh_entries; i++) {
 	if (block < ext[i].ee_block)
 	    break;
     }
@@ -66,6 +161,7 @@ bmap_extent(struct inode *inode, uint32_t block, size_t *nblocks)
 	printf("ERROR, not find the right block\n");
 	return 0;
     }
+    pvt->ext_slot = i;
 
     /* got it */
     block -= ext[i].ee_block;
@@ -226,3 +322,38 @@ int ext2_next_extent(struct inode *inode, uint32_t lstart)
     inode->next_extent.len = (nblocks << blktosec) - (lstart & blkmask);
     return 0;
 }
+
+/*
+ * Prefetch hook for getfssec: queue the extent tree blocks hanging off
+ * the root in the inode that cover the file from lstart on.  For the
+ * common depth-1 tree those are the leaves themselves, which are
+ * usually allocated next to each other and so come in with one read.
+ */
+void ext2_prefetch(struct inode *inode, uint32_t lstart)
+{
+    struct fs_info *fs = inode->fs;
+    const struct ext4_extent_header *eh = &PVT(inode)->i_extent_hdr;
+    const struct ext4_extent_idx *index;
+    uint32_t block = lstart >> (BLOCK_SHIFT(fs) - SECTOR_SHIFT(fs));
+    block_t blk;
+    int i;
+
+    if (!(inode->flags & EXT4_EXTENTS_FLAG))
+	return;
+    if (eh->eh_magic != EXT4_EXT_MAGIC || eh->eh_depth == 0)
+	return;
+
+    index = EXT4_FIRST_INDEX(eh);
+    for (i = 0; i < (int)eh->eh_entries; i++) {
+	if (block < index[i].ei_block)
+	    break;
+    }
+    if (--i < 0)
+	return;
+
+    for (; i < (int)eh->eh_entries; i++) {
+	blk = index[i].ei_leaf_hi;
+	blk = (blk << 32) + index[i].ei_leaf_lo;
+	cache_prefetch(fs->fs_dev, blk, 1);
+    }
+}
@@ -89,6 +89,31 @@ ext2_get_cache(struct inode *inode, block_t lblock)
     return get_cache(inode->fs->fs_dev, pblock);
 }
 
+/*
+ * Look for a name in the first MAXOFFSET bytes of one directory block.
+ */
+const struct ext2_dir_entry *
+ext2_scan_block(const char *data, size_t maxoffset,
+		const char *dname, size_t dname_len)
+{
+    const struct ext2_dir_entry *de;
+    size_t offset = 0;
+
+    /* The smallest possible size is 9 bytes */
+    while (offset + 8 < maxoffset) {
+	de = (const struct ext2_dir_entry *)(data + offset);
+	if (!de->d_rec_len || de->d_rec_len > maxoffset - offset)
+	    break;
+
+	if (ext2_match_entry(dname, dname_len, de))
+	    return de;
+
+	offset += de->d_rec_len;
+    }
+
+    return NULL;
+}
+
 /*
  * find a dir entry, return it if found, or return NULL.
  */
@@ -96,53 +121,94 @@ static const struct ext2_dir_entry *
 ext2_find_entry(struct fs_info *fs, struct inode *inode, const char *dname)
 {
     block_t index = 0;
-    uint32_t i = 0, offset, maxoffset;
+    uint32_t i = 0;
     const struct ext2_dir_entry *de;
     const char *data;
     size_t dname_len = strlen(dname);
 
+    /* Hashed directories: go straight to the right leaf if we can */
+    if (!ext2_htree_find_entry(inode, dname, dname_len, &de))
+	return de;
+
     while (i < inode->size) {
 	data = ext2_get_cache(inode, index++);
-	offset = 0;
-	maxoffset =  min(BLOCK_SIZE(fs), i-inode->size);
-
-	/* The smallest possible size is 9 bytes */
-	while (offset < maxoffset-8) {
-	    de = (const struct ext2_dir_entry *)(data + offset);
-	    if (de->d_rec_len > maxoffset - offset)
-		break;
 
-	    if (ext2_match_entry(dname, dname_len, de))
-		return de;
+	de = ext2_scan_block(data, min(BLOCK_SIZE(fs), inode->size - i),
+			     dname, dname_len);
+	if (de)
+	    return de;
 
-	    offset += de->d_rec_len;
-	}
 	i += BLOCK_SIZE(fs);
     }
 
     return NULL;
 }
 
+/*
+ * Keep the inode table location of every group, so that getting at an
+ * inode doesn't need the group descriptor block in the cache as well.
+ */
+static void ext2_pin_group_descs(struct fs_info *fs)
+{
+    struct ext2_sb_info *sbi = EXT2_SB(fs);
+    const struct ext2_group_desc *desc;
+    uint32_t i, block, nblocks;
+
+    if (sbi->s_groups_count > EXT2_PINNED_GROUPS_MAX)
+	return;
+
+    sbi->s_inode_tables = malloc(sbi->s_groups_count * sizeof(uint32_t));
+    if (!sbi->s_inode_tables)
+	return;
+
+    /* The table is contiguous; read it in as few requests as we can */
+    nblocks = (sbi->s_groups_count + sbi->s_desc_per_block - 1) /
+	sbi->s_desc_per_block;
+
+    for (i = 0; i < sbi->s_groups_count; i++) {
+	block = i / sbi->s_desc_per_block;
+	if (i % sbi->s_desc_per_block == 0)
+	    cache_readahead(fs->fs_dev, sbi->s_first_data_block + 1 + block,
+			    nblocks - block);
+	desc = ext2_get_group_desc(fs, i);
+	sbi->s_inode_tables[i] = desc->bg_inode_table;
+    }
+}
+
 static const struct ext2_inode *
 ext2_get_inode(struct fs_info *fs, int inr)
 {
+    struct ext2_sb_info *sbi = EXT2_SB(fs);
     const struct ext2_group_desc *desc;
     const char *data;
     uint32_t inode_group, inode_offset;
-    uint32_t block_num, block_off;
+    uint32_t table, index, block_off, left;
 
     inr--;
     inode_group  = inr / EXT2_INODES_PER_GROUP(fs);
     inode_offset = inr % EXT2_INODES_PER_GROUP(fs);
-    desc = ext2_get_group_desc(fs, inode_group);
-    if (!desc)
-	return NULL;
+    if (sbi->s_inode_tables && inode_group < sbi->s_groups_count) {
+	table = sbi->s_inode_tables[inode_group];
+    } else {
+	desc = ext2_get_group_desc(fs, inode_group);
+	if (!desc)
+	    return NULL;
+	table = desc->bg_inode_table;
+    }
 
-    block_num = desc->bg_inode_table +
-	inode_offset / EXT2_INODES_PER_BLOCK(fs);
+    index = inode_offset / EXT2_INODES_PER_BLOCK(fs);
     block_off = inode_offset % EXT2_INODES_PER_BLOCK(fs);
 
-    data = get_cache(fs->fs_dev, block_num);
+    /*
+     * The inodes of a directory's files are mostly allocated next to
+     * each other, so bring in the table blocks after this one too.
+     */
+    left = (EXT2_INODES_PER_GROUP(fs) + EXT2_INODES_PER_BLOCK(fs) - 1) /
+	EXT2_INODES_PER_BLOCK(fs) - index;
+    cache_readahead(fs->fs_dev, table + index,
+		    min(left, (uint32_t)EXT2_INODE_READAHEAD));
+
+    data = get_cache(fs->fs_dev, table + index);
 
     return (const struct ext2_inode *)
 	(data + block_off * EXT2_SB(fs)->s_inode_size);
@@ -167,6 +233,9 @@ static struct inode *ext2_iget_by_inr(struct fs_info *fs, uint32_t inr)
     const struct ext2_inode *e_inode;
     struct inode *inode;
 
+    if ((inode = revive_inode(fs, inr)))
+	return inode;
+
     e_inode = ext2_get_inode(fs, inr);
     if (!e_inode)
 	return NULL;
@@ -320,12 +389,21 @@ static int ext2_fs_init(struct fs_info *fs)
     /* Volume UUID */
     memcpy(sbi->s_uuid, sb.s_uuid, sizeof(sbi->s_uuid));
 
+    /* Hashed directories */
+    sbi->s_dir_index = !!(sb.s_feature_compat & EXT3_FEATURE_COMPAT_DIR_INDEX);
+    sbi->s_hash_unsigned = !!(sb.s_flags & EXT2_FLAGS_UNSIGNED_HASH);
+    memcpy(sbi->s_hash_seed, sb.s_hash_seed, sizeof(sbi->s_hash_seed));
+
     /* Initialize the cache, and force block zero to all zero */
     cache_init(fs->fs_dev, fs->block_shift);
     cs = _get_cache_block(fs->fs_dev, 0);
     memset(cs->data, 0, fs->block_size);
+    cache_set_block(fs->fs_dev, cs, 0);
     cache_lock_block(cs);
 
+    sbi->s_inode_tables = NULL;
+    ext2_pin_group_descs(fs);
+
     return fs->block_shift;
 }
 
@@ -366,7 +444,7 @@ static char *ext2_fs_uuid(struct fs_info *fs)
 
 const struct fs_ops ext2_fs_ops = {
     .fs_name       = "ext2",
-    .fs_flags      = FS_THISIND | FS_USEMEM,
+    .fs_flags      = FS_THISIND | FS_USEMEM | FS_INOCACHE,
     .fs_init       = ext2_fs_init,
     .searchdir     = NULL,
     .getfssec      = generic_getfssec,
@@ -379,5 +457,6 @@ const struct fs_ops ext2_fs_ops = {
     .readlink      = ext2_readlink,
     .readdir       = ext2_readdir,
     .next_extent   = ext2_next_extent,
+    .prefetch      = ext2_prefetch,
     .fs_uuid       = ext2_fs_uuid,
 };
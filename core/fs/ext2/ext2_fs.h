@@ -2,6 +2,7 @@
 #define __EXT2_FS_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #define	EXT2_SUPER_MAGIC	0xEF53
 
@@ -36,6 +37,19 @@
 #define EXT4_EXT_MAGIC     0xf30a
 #define EXT4_EXTENTS_FLAG  0x00080000
 
+/* for hashed (dir_index) directories */
+#define EXT3_FEATURE_COMPAT_DIR_INDEX	0x0020
+#define EXT2_INDEX_FL			0x00001000
+#define EXT4_CASEFOLD_FL		0x40000000
+#define EXT2_FLAGS_UNSIGNED_HASH	0x0002
+
+#define DX_HASH_LEGACY		0
+#define DX_HASH_HALF_MD4	1
+#define DX_HASH_TEA		2
+#define DX_HASH_LEGACY_UNSIGNED	3
+#define DX_HASH_HALF_MD4_UNSIGNED	4
+#define DX_HASH_TEA_UNSIGNED	5
+
 /*
  * File types and file modes
  */
@@ -214,6 +228,34 @@ struct ext2_dir_entry {
     char	d_name[EXT2_NAME_LEN];	        /* File name */
 };
 
+/*
+ * HTree index structures.  Block 0 of an indexed directory holds the
+ * "." and ".." entries, dx_root_info, and then the root dx_entry array;
+ * interior nodes start with an empty 8-byte directory entry.  The first
+ * dx_entry of each array has its hash replaced by the limit and count.
+ */
+struct dx_root_info {
+    uint32_t reserved_zero;
+    uint8_t  hash_version;
+    uint8_t  info_length;	/* 8 */
+    uint8_t  indirect_levels;
+    uint8_t  unused_flags;
+};
+
+struct dx_entry {
+    uint32_t hash;
+    uint32_t block;		/* Logical block within the directory */
+};
+
+struct dx_countlimit {
+    uint16_t limit;
+    uint16_t count;
+};
+
+#define DX_ROOT_INFO_OFFSET	24
+#define DX_NODE_OFFSET		8
+#define DX_MAX_LEVELS		3
+
 /*******************************************************************************
 #define EXT2_DIR_PAD	 4
 #define EXT2_DIR_ROUND	(EXT2_DIR_PAD - 1)
@@ -279,6 +321,10 @@ struct ext2_sb_info {
     int      s_inode_size;
     uint8_t  s_uuid[16];	/* 128-bit uuid for volume */
     int      s_desc_size;	/* size of group descriptor */
+    uint32_t s_hash_seed[4];	/* HTREE hash seed */
+    bool     s_dir_index;	/* Hashed directories may exist */
+    bool     s_hash_unsigned;	/* Use the unsigned variant of the hash */
+    uint32_t *s_inode_tables;	/* Inode table of each group, or NULL */
 };
 
 static inline struct ext2_sb_info *EXT2_SB(struct fs_info *fs)
@@ -291,6 +337,15 @@ static inline struct ext2_sb_info *EXT2_SB(struct fs_info *fs)
 #define EXT2_INODES_PER_BLOCK(fs)      (EXT2_SB(fs)->s_inodes_per_block)
 #define EXT2_DESC_PER_BLOCK(fs)        (EXT2_SB(fs)->s_desc_per_block)
 
+/*
+ * The inode table block of every group is kept in memory from mount
+ * time on, unless there are more groups than this (2 TB of 4K blocks)
+ */
+#define EXT2_PINNED_GROUPS_MAX	16384
+
+/* Inode table blocks read ahead along with the one an inode is in */
+#define EXT2_INODE_READAHEAD	8
+
 /*
  * ext2 private inode information
  */
@@ -299,6 +354,19 @@ struct ext2_pvt_inode {
 	uint32_t i_block[EXT2_N_BLOCKS];
 	struct ext4_extent_header i_extent_hdr;
     };
+
+    /*
+     * The extent leaf found by the last lookup, and how we got there,
+     * so bmap_extent() can skip the descent from the root
+     */
+    block_t  ext_leaf;		/* 0 if the leaf is the root itself */
+    block_t  ext_parent;	/* Index node above it, 0 = the root */
+    uint32_t ext_first;		/* Logical blocks covered by the leaf */
+    uint32_t ext_end;
+    uint32_t ext_pend;		/* ... and by its parent */
+    uint16_t ext_pslot;		/* Slot of the leaf in its parent */
+    uint16_t ext_slot;		/* Last extent used in the leaf */
+    bool     ext_valid;
 };
 
 #define PVT(i) ((struct ext2_pvt_inode *)((i)->pvt))
@@ -308,5 +376,14 @@ struct ext2_pvt_inode {
  */
 block_t ext2_bmap(struct inode *, block_t, size_t *);
 int ext2_next_extent(struct inode *, uint32_t);
+void ext2_prefetch(struct inode *, uint32_t);
+
+/* ext2.c */
+const struct ext2_dir_entry *ext2_scan_block(const char *, size_t,
+					     const char *, size_t);
+
+/* htree.c */
+int ext2_htree_find_entry(struct inode *, const char *, size_t,
+			  const struct ext2_dir_entry **);
 
 #endif /* ext2_fs.h */
@@ -0,0 +1,364 @@
+/*
+ * Hashed (dir_index) directory lookup.
+ *
+ * The name hashes are the ones used by the Linux ext3/ext4 driver
+ * (fs/ext4/hash.c); a directory using anything else is left to the
+ * linear scan.
+ *
+ * This file may be redistributed under the terms of the GNU Public
+ * License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <dprintf.h>
+#include <fs.h>
+#include <cache.h>
+#include "ext2_fs.h"
+
+#define HTREE_EOF_32BIT		0x7fffffffU
+
+static inline uint32_t rol32(uint32_t x, int s)
+{
+    return (x << s) | (x >> (32 - s));
+}
+
+/* TEA block cipher, 16 rounds */
+static void tea_transform(uint32_t buf[4], const uint32_t in[4])
+{
+    uint32_t sum = 0;
+    uint32_t b0 = buf[0], b1 = buf[1];
+    uint32_t a = in[0], b = in[1], c = in[2], d = in[3];
+    int n = 16;
+
+    do {
+	sum += 0x9e3779b9;
+	b0 += ((b1 << 4) + a) ^ (b1 + sum) ^ ((b1 >> 5) + b);
+	b1 += ((b0 << 4) + c) ^ (b0 + sum) ^ ((b0 >> 5) + d);
+    } while (--n);
+
+    buf[0] += b0;
+    buf[1] += b1;
+}
+
+/* Three rounds of MD4, keeping only half the state */
+#define F(x,y,z)	((z) ^ ((x) & ((y) ^ (z))))
+#define G(x,y,z)	(((x) & (y)) + (((x) ^ (y)) & (z)))
+#define H(x,y,z)	((x) ^ (y) ^ (z))
+#define ROUND(f,a,b,c,d,x,s)	(a += f(b, c, d) + (x), a = rol32(a, s))
+#define K1	0
+#define K2	013240474631U
+#define K3	015666365641U
+
+static void half_md4_transform(uint32_t buf[4], const uint32_t in[8])
+{
+    uint32_t a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+
+    ROUND(F, a, b, c, d, in[0] + K1,  3);
+    ROUND(F, d, a, b, c, in[1] + K1,  7);
+    ROUND(F, c, d, a, b, in[2] + K1, 11);
+    ROUND(F, b, c, d, a, in[3] + K1, 19);
+    ROUND(F, a, b, c, d, in[4] + K1,  3);
+    ROUND(F, d, a, b, c, in[5] + K1,  7);
+    ROUND(F, c, d, a, b, in[6] + K1, 11);
+    ROUND(F, b, c, d, a, in[7] + K1, 19);
+
+    ROUND(G, a, b, c, d, in[1] + K2,  3);
+    ROUND(G, d, a, b, c, in[3] + K2,  5);
+    ROUND(G, c, d, a, b, in[5] + K2,  9);
+    ROUND(G, b, c, d, a, in[7] + K2, 13);
+    ROUND(G, a, b, c, d, in[0] + K2,  3);
+    ROUND(G, d, a, b, c, in[2] + K2,  5);
+    ROUND(G, c, d, a, b, in[4] + K2,  9);
+    ROUND(G, b, c, d, a, in[6] + K2, 13);
+
+    ROUND(H, a, b, c, d, in[3] + K3,  3);
+    ROUND(H, d, a, b, c, in[7] + K3,  9);
+    ROUND(H, c, d, a, b, in[2] + K3, 11);
+    ROUND(H, b, c, d, a, in[6] + K3, 15);
+    ROUND(H, a, b, c, d, in[1] + K3,  3);
+    ROUND(H, d, a, b, c, in[5] + K3,  9);
+    ROUND(H, c, d, a, b, in[0] + K3, 11);
+    ROUND(H, b, c, d, a, in[4] + K3, 15);
+
+    buf[0] += a;
+    buf[1] += b;
+    buf[2] += c;
+    buf[3] += d;
+}
+
+#undef F
+#undef G
+#undef H
+#undef ROUND
+
+/* The original ext3 hash */
+static uint32_t dx_hack_hash(const char *name, size_t len, bool is_unsigned)
+{
+    uint32_t hash, hash0 = 0x12a3fe2d, hash1 = 0x37abe8f9;
+    int c;
+
+    while (len--) {
+	c = is_unsigned ? (int)(unsigned char)*name : (int)(signed char)*name;
+	name++;
+	hash = hash1 + (hash0 ^ (uint32_t)(c * 7152373));
+	if (hash & 0x80000000)
+	    hash -= 0x7fffffff;
+	hash1 = hash0;
+	hash0 = hash;
+    }
+    return hash0 << 1;
+}
+
+/* Pack up to NUM words' worth of the name, padded with its length */
+static void str2hashbuf(const char *msg, size_t len, uint32_t *buf,
+			int num, bool is_unsigned)
+{
+    uint32_t pad, val;
+    size_t i;
+    int c;
+
+    pad = (uint32_t)len | ((uint32_t)len << 8);
+    pad |= pad << 16;
+
+    val = pad;
+    if (len > (size_t)num * 4)
+	len = num * 4;
+    for (i = 0; i < len; i++) {
+	c = is_unsigned ? (int)(unsigned char)msg[i] : (int)(signed char)msg[i];
+	val = (uint32_t)c + (val << 8);
+	if ((i % 4) == 3) {
+	    *buf++ = val;
+	    val = pad;
+	    num--;
+	}
+    }
+    if (--num >= 0)
+	*buf++ = val;
+    while (--num >= 0)
+	*buf++ = pad;
+}
+
+/*
+ * Compute the directory hash of a name; returns -1 for hash versions
+ * we don't know.
+ */
+static int ext2_dirhash(const struct ext2_sb_info *sbi, int version,
+			const char *name, size_t len, uint32_t *hashp)
+{
+    uint32_t buf[4], in[8];
+    bool is_unsigned;
+    uint32_t hash;
+    int i;
+
+    buf[0] = 0x67452301;
+    buf[1] = 0xefcdab89;
+    buf[2] = 0x98badcfe;
+    buf[3] = 0x10325476;
+    for (i = 0; i < 4; i++) {
+	if (sbi->s_hash_seed[i]) {
+	    memcpy(buf, sbi->s_hash_seed, sizeof buf);
+	    break;
+	}
+    }
+
+    is_unsigned = version >= DX_HASH_LEGACY_UNSIGNED;
+
+    switch (version) {
+    case DX_HASH_LEGACY:
+    case DX_HASH_LEGACY_UNSIGNED:
+	hash = dx_hack_hash(name, len, is_unsigned);
+	break;
+
+    case DX_HASH_HALF_MD4:
+    case DX_HASH_HALF_MD4_UNSIGNED:
+	do {
+	    str2hashbuf(name, len, in, 8, is_unsigned);
+	    half_md4_transform(buf, in);
+	    name += 32;
+	} while (len > 32 && (len -= 32));
+	hash = buf[1];
+	break;
+
+    case DX_HASH_TEA:
+    case DX_HASH_TEA_UNSIGNED:
+	do {
+	    str2hashbuf(name, len, in, 4, is_unsigned);
+	    tea_transform(buf, in);
+	    name += 16;
+	} while (len > 16 && (len -= 16));
+	hash = buf[0];
+	break;
+
+    default:
+	return -1;
+    }
+
+    hash &= ~1;
+    if (hash == (HTREE_EOF_32BIT << 1))
+	hash = (HTREE_EOF_32BIT - 1) << 1;
+
+    *hashp = hash;
+    return 0;
+}
+
+/*
+ * Map a logical block of the directory, NULL if it is a hole
+ */
+static const char *dx_get_block(struct inode *dir, block_t lblock)
+{
+    block_t pblock = ext2_bmap(dir, lblock, NULL);
+
+    return pblock ? get_cache(dir->fs->fs_dev, pblock) : NULL;
+}
+
+/*
+ * Locate the dx_entry array of an index block and sanity check it
+ */
+static const struct dx_entry *dx_get_entries(struct inode *dir,
+					     const char *data,
+					     unsigned int offset,
+					     unsigned int *count)
+{
+    const struct dx_countlimit *cl;
+    unsigned int max;
+
+    if (!data || offset >= BLOCK_SIZE(dir->fs))
+	return NULL;
+
+    cl = (const struct dx_countlimit *)(data + offset);
+    max = (BLOCK_SIZE(dir->fs) - offset) / sizeof(struct dx_entry);
+    if (!cl->count || cl->count > cl->limit || cl->limit > max)
+	return NULL;
+
+    *count = cl->count;
+    return (const struct dx_entry *)cl;
+}
+
+static unsigned int dx_offset(const char *data, int level)
+{
+    const struct dx_root_info *info;
+
+    if (level)
+	return DX_NODE_OFFSET;
+
+    info = (const struct dx_root_info *)(data + DX_ROOT_INFO_OFFSET);
+    return DX_ROOT_INFO_OFFSET + info->info_length;
+}
+
+/*
+ * Look up a name through the htree index of a directory.  Returns -1 if
+ * the directory is not indexed, or the index is not one we can use, in
+ * which case the caller should do a linear scan; otherwise returns 0
+ * and sets *res to the entry, or NULL if the name doesn't exist.
+ */
+int ext2_htree_find_entry(struct inode *dir, const char *name, size_t len,
+			  const struct ext2_dir_entry **res)
+{
+    struct fs_info *fs = dir->fs;
+    const struct ext2_sb_info *sbi = EXT2_SB(fs);
+    const struct dx_root_info *info;
+    const struct dx_entry *entries;
+    struct {
+	block_t lblock;		/* Index block */
+	unsigned int at;	/* Entry we followed */
+    } frame[DX_MAX_LEVELS];
+    unsigned int count, p, q, m;
+    int level, levels, version;
+    block_t lblock;
+    uint32_t hash;
+    const char *data;
+
+    if (!sbi->s_dir_index || !(dir->flags & EXT2_INDEX_FL) ||
+	(dir->flags & EXT4_CASEFOLD_FL))
+	return -1;
+
+    /* "." and ".." live in the root block, not in the leaves */
+    if (name[0] == '.' && (len == 1 || (len == 2 && name[1] == '.')))
+	return -1;
+
+    data = dx_get_block(dir, 0);
+    if (!data)
+	return -1;
+
+    info = (const struct dx_root_info *)(data + DX_ROOT_INFO_OFFSET);
+    if (info->reserved_zero || info->info_length < 8 ||
+	info->indirect_levels >= DX_MAX_LEVELS)
+	return -1;
+
+    version = info->hash_version;
+    if (version <= DX_HASH_TEA && sbi->s_hash_unsigned)
+	version += DX_HASH_LEGACY_UNSIGNED;
+    if (ext2_dirhash(sbi, version, name, len, &hash))
+	return -1;
+
+    levels = info->indirect_levels;
+    lblock = 0;
+
+    for (level = 0; level <= levels; level++) {
+	entries = dx_get_entries(dir, data, dx_offset(data, level), &count);
+	if (!entries)
+	    return -1;
+
+	/* Find the last entry whose hash is <= ours; entry 0 has none */
+	p = 1;
+	q = count - 1;
+	while (p <= q) {
+	    m = p + (q - p) / 2;
+	    if (entries[m].hash > hash)
+		q = m - 1;
+	    else
+		p = m + 1;
+	}
+
+	frame[level].lblock = lblock;
+	frame[level].at = p - 1;
+
+	lblock = entries[p - 1].block & 0x0fffffff;
+	data = dx_get_block(dir, lblock);
+	if (!data)
+	    return -1;
+    }
+
+    for (;;) {
+	*res = ext2_scan_block(data, BLOCK_SIZE(fs), name, len);
+	if (*res)
+	    return 0;
+
+	/*
+	 * Names with the same hash may spill into the next leaf, which
+	 * is then flagged by the low bit of its hash.  Step to the next
+	 * entry, going up the tree as far as needed.
+	 */
+	for (level = levels; level >= 0; level--) {
+	    data = dx_get_block(dir, frame[level].lblock);
+	    entries = dx_get_entries(dir, data, dx_offset(data, level), &count);
+	    if (!entries)
+		return 0;
+	    if (++frame[level].at < count)
+		break;
+	}
+	if (level < 0)
+	    return 0;		/* End of the index */
+
+	if ((entries[frame[level].at].hash & ~1) != hash)
+	    return 0;		/* No more collisions */
+
+	/* ... and back down the leftmost path */
+	lblock = entries[frame[level].at].block & 0x0fffffff;
+	while (level < levels) {
+	    level++;
+	    frame[level].lblock = lblock;
+	    frame[level].at = 0;
+	    data = dx_get_block(dir, lblock);
+	    entries = dx_get_entries(dir, data, DX_NODE_OFFSET, &count);
+	    if (!entries)
+		return 0;
+	    lblock = entries[0].block & 0x0fffffff;
+	}
+
+	data = dx_get_block(dir, lblock);
+	if (!data)
+	    return 0;
+    }
+}
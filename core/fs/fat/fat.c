@@ -8,6 +8,7 @@
 #include <disk.h>
 #include <fs.h>
 #include <ilog2.h>
+#include <minmax.h>
 #include <klibc/compiler.h>
 #include "codepage.h"
 #include "fat_fs.h"
@@ -29,6 +30,58 @@ static const void *get_fat_sector(struct fs_info *fs, sector_t sector)
     return get_cache(fs->fs_dev, FAT_SB(fs)->fat + sector);
 }
 
+/*
+ * The FAT entry of a cluster, from the resident copy of the FAT
+ */
+static uint32_t get_resident_cluster(const struct fat_sb_info *sbi,
+				     uint32_t clust_num)
+{
+    const uint8_t *fat = sbi->fat_map;
+    uint32_t next_cluster;
+
+    switch (sbi->fat_type) {
+    case FAT12:
+	next_cluster = *(const uint16_t *)(fat + clust_num + (clust_num >> 1));
+	if (clust_num & 0x0001)
+	    return next_cluster >> 4;
+	return next_cluster & 0x0fff;
+    case FAT16:
+	return ((const uint16_t *)fat)[clust_num];
+    default:
+	return ((const uint32_t *)fat)[clust_num] & 0x0fffffff;
+    }
+}
+
+/*
+ * With the FAT resident, how many clusters from clust_num on, up to
+ * max, each chain to the one right after them.  FAT12 entries aren't
+ * words, so those runs are left to be followed one cluster at a time.
+ */
+static uint32_t fat_contiguous(const struct fat_sb_info *sbi,
+			       uint32_t clust_num, uint32_t max)
+{
+    const uint16_t *fat16 = sbi->fat_map;
+    const uint32_t *fat32 = sbi->fat_map;
+    uint32_t n = 0;
+
+    /* The last entry in the table can't chain on to another one */
+    max = min(max, sbi->clusters + 1 - clust_num);
+
+    switch (sbi->fat_type) {
+    case FAT16:
+	while (n < max && fat16[clust_num + n] == clust_num + n + 1)
+	    n++;
+	break;
+    case FAT32:
+	while (n < max &&
+	       (fat32[clust_num + n] & 0x0fffffff) == clust_num + n + 1)
+	    n++;
+	break;
+    }
+
+    return n;
+}
+
 static uint32_t get_next_cluster(struct fs_info *fs, uint32_t clust_num)
 {
     uint32_t next_cluster = 0;
@@ -37,6 +90,9 @@ static uint32_t get_next_cluster(struct fs_info *fs, uint32_t clust_num)
     uint32_t sector_mask = SECTOR_SIZE(fs) - 1;
     const uint8_t *data;
 
+    if (FAT_SB(fs)->fat_map)
+	return get_resident_cluster(FAT_SB(fs), clust_num);
+
     switch(FAT_SB(fs)->fat_type) {
     case FAT12:
 	offset = clust_num + (clust_num >> 1);
@@ -84,59 +140,111 @@ static uint32_t get_next_cluster(struct fs_info *fs, uint32_t clust_num)
     return next_cluster;
 }
 
+/*
+ * Walk the cluster chain until the run map covers logical cluster
+ * MCLUSTER and the run containing it has been followed to its end.
+ * Returns -1 if the chain gives out first.
+ */
+static int fat_map_extend(struct inode *inode, uint32_t mcluster,
+			  uint32_t tcluster)
+{
+    struct fs_info *fs = inode->fs;
+    struct fat_sb_info *sbi = FAT_SB(fs);
+    struct fat_pvt_inode *pvt = PVT(inode);
+    struct fat_run *run = NULL;
+    uint32_t pcluster, n;
+
+    if (pvt->nruns)
+	run = &pvt->runs[pvt->nruns - 1];
+    else
+	pvt->map_next = pvt->start_cluster;
+
+    while (pvt->mapped < tcluster) {
+	pcluster = pvt->map_next;
+
+	if (pcluster-2 >= sbi->clusters) {
+	    break;		/* End of chain, or a bogus one */
+	} else if (run && pcluster == run->pcluster + run->len) {
+	    run->len++;
+	} else if (pvt->mapped > mcluster) {
+	    break;		/* Covered, and that run is complete */
+	} else {
+	    if (pvt->nruns >= pvt->maxruns) {
+		uint32_t n = pvt->maxruns ? pvt->maxruns << 1 : 8;
+		struct fat_run *p = realloc(pvt->runs, n * sizeof *p);
+
+		if (!p)
+		    break;
+		pvt->runs    = p;
+		pvt->maxruns = n;
+	    }
+	    run = &pvt->runs[pvt->nruns++];
+	    run->lcluster = pvt->mapped;
+	    run->pcluster = pcluster;
+	    run->len      = 1;
+	}
+
+	pvt->mapped++;
+	if (sbi->fat_map) {
+	    /* Take in the rest of the run straight from the table */
+	    n = fat_contiguous(sbi, pcluster, tcluster - pvt->mapped);
+	    run->len     += n;
+	    pvt->mapped  += n;
+	    pcluster     += n;
+	}
+	pvt->map_next = get_next_cluster(fs, pcluster);
+    }
+
+    return mcluster < pvt->mapped ? 0 : -1;
+}
+
+/*
+ * Find the run containing a logical cluster which is known to be mapped
+ */
+static const struct fat_run *fat_find_run(const struct fat_pvt_inode *pvt,
+					  uint32_t lcluster)
+{
+    uint32_t lo = 0, hi = pvt->nruns, mid;
+
+    while (hi - lo > 1) {
+	mid = (lo + hi) >> 1;
+	if (pvt->runs[mid].lcluster <= lcluster)
+	    lo = mid;
+	else
+	    hi = mid;
+    }
+
+    return &pvt->runs[lo];
+}
+
 static int fat_next_extent(struct inode *inode, uint32_t lstart)
 {
     struct fs_info *fs = inode->fs;
     struct fat_sb_info *sbi = FAT_SB(fs);
     uint32_t mcluster = lstart >> sbi->clust_shift;
-    uint32_t lcluster;
-    uint32_t pcluster;
     uint32_t tcluster;
-    uint32_t xcluster;
+    uint32_t skip, secoff;
+    const struct fat_run *run;
     const uint32_t cluster_bytes = UINT32_C(1) << sbi->clust_byte_shift;
-    const uint32_t cluster_secs  = UINT32_C(1) << sbi->clust_shift;
-    sector_t data_area = sbi->data;
 
     tcluster = (inode->size + cluster_bytes - 1) >> sbi->clust_byte_shift;
     if (mcluster >= tcluster)
 	goto err;		/* Requested cluster beyond end of file */
 
-    lcluster = PVT(inode)->offset >> sbi->clust_shift;
-    pcluster = ((PVT(inode)->here - data_area) >> sbi->clust_shift) + 2;
-
-    if (lcluster > mcluster || PVT(inode)->here < data_area) {
-	lcluster = 0;
-	pcluster = PVT(inode)->start_cluster;
+    if (fat_map_extend(inode, mcluster, tcluster)) {
+	if (PVT(inode)->map_next-2 >= sbi->clusters)
+	    inode->size = (uint64_t)PVT(inode)->mapped << sbi->clust_byte_shift;
+	goto err;
     }
 
-    for (;;) {
-	if (pcluster-2 >= sbi->clusters) {
-	    inode->size = lcluster << sbi->clust_shift;
-	    goto err;
-	}
-
-	if (lcluster >= mcluster)
-	    break;
-
-	lcluster++;
-	pcluster = get_next_cluster(fs, pcluster);
-    }
+    run = fat_find_run(PVT(inode), mcluster);
+    skip = mcluster - run->lcluster;
+    secoff = lstart & sbi->clust_mask;
 
     inode->next_extent.pstart =
-	((sector_t)(pcluster-2) << sbi->clust_shift) + data_area;
-    inode->next_extent.len = cluster_secs;
-    xcluster = 0;		/* Nonsense */
-
-    while (++lcluster < tcluster) {
-	xcluster = get_next_cluster(fs, pcluster);
-	if (xcluster != ++pcluster)
-	    break;		/* Not contiguous */
-	inode->next_extent.len += cluster_secs;
-    }
-
-    /* Note: ->here is bogus if ->offset >= EOF, but that's okay */
-    PVT(inode)->offset = lcluster << sbi->clust_shift;
-    PVT(inode)->here   = ((xcluster-2) << sbi->clust_shift) + data_area;
+	((sector_t)(run->pcluster + skip - 2) << sbi->clust_shift) +
+	sbi->data + secoff;
+    inode->next_extent.len = ((run->len - skip) << sbi->clust_shift) - secoff;
 
     return 0;
 
@@ -145,6 +253,63 @@ err:
     return -1;
 }
 
+static void fat_free_inode(struct inode *inode)
+{
+    free(PVT(inode)->runs);
+}
+
+/*
+ * Byte offset of the FAT entry for a cluster
+ */
+static uint32_t fat_entry_offset(const struct fat_sb_info *sbi,
+				 uint32_t clust_num)
+{
+    switch (sbi->fat_type) {
+    case FAT12:
+	return clust_num + (clust_num >> 1);
+    case FAT16:
+	return clust_num << 1;
+    default:
+	return clust_num << 2;
+    }
+}
+
+/*
+ * Queue the FAT sectors that fat_next_extent() will walk next.  We don't
+ * know the shape of the chain without reading it, but files are mostly
+ * allocated forward, so fetch the FAT from where the cluster map ends,
+ * covering one entry per cluster left in the file.
+ */
+static void fat_prefetch(struct inode *inode, uint32_t lstart)
+{
+    struct fs_info *fs = inode->fs;
+    struct fat_sb_info *sbi = FAT_SB(fs);
+    struct fat_pvt_inode *pvt = PVT(inode);
+    uint32_t mcluster = lstart >> sbi->clust_shift;
+    uint32_t pcluster, tcluster;
+    uint32_t first, last;
+    const uint32_t cluster_bytes = UINT32_C(1) << sbi->clust_byte_shift;
+
+    if (sbi->fat_map)
+	return;			/* Nothing to read */
+
+    tcluster = (inode->size + cluster_bytes - 1) >> sbi->clust_byte_shift;
+    if (mcluster >= tcluster || mcluster < pvt->mapped)
+	return;			/* Nothing to do, or already mapped */
+
+    pcluster = pvt->nruns ? pvt->map_next : pvt->start_cluster;
+    if (pcluster-2 >= sbi->clusters)
+	return;
+
+    first = fat_entry_offset(sbi, pcluster) >> SECTOR_SHIFT(fs);
+    last  = fat_entry_offset(sbi, min(pcluster + (tcluster - pvt->mapped),
+				      sbi->clusters + 1)) >> SECTOR_SHIFT(fs);
+    if (last - first >= CACHE_MAX_READAHEAD)
+	last = first + CACHE_MAX_READAHEAD - 1;
+
+    cache_prefetch(fs->fs_dev, sbi->fat + first, last - first + 1);
+}
+
 static sector_t get_next_sector(struct fs_info* fs, uint32_t sector)
 {
     struct fat_sb_info *sbi = FAT_SB(fs);
@@ -324,25 +489,25 @@ static void mangle_dos_name(char *mangle_buf, const char *src)
 static bool vfat_match_longname(const char *str, const uint16_t *match,
 				int len)
 {
-    unsigned char c = -1;	/* Nonzero: we have not yet seen NUL */
-    uint16_t cp;
+    int n;
 
     dprintf("Matching: %s len %d\n", str, len);
 
-    while (len) {
-	cp = *match++;
-	len--;
-	if (!cp)
-	    break;
-	c = *str++;
-	if (cp != codepage.uni[0][c] && cp != codepage.uni[1][c])
-	    return false;	/* Also handles c == '\0' */
-    }
+    /* The name ends at a NUL or at the end of the buffer */
+    for (n = 0; n < len && match[n]; n++)
+	;
 
-    /* This should have been the end of the matching string */
-    if (*str)
+    /* A short str fails at its NUL, so str[n] is only read if it's there */
+    if (!fs_uni_eq(match, str, n, true) || str[n])
 	return false;
 
+    match += n;
+    len -= n;
+    if (len) {
+	match++;	/* The NUL */
+	len--;
+    }
+
     /* Any padding entries must be FFFF */
     while (len--)
 	if (*match++ != 0xffff)
@@ -435,10 +600,303 @@ static inline enum dirent_type get_inode_mode(uint8_t attr)
 }
 
 
-static struct inode *vfat_find_entry(const char *dname, struct inode *dir)
+/*
+ * Make an inode from the short directory entry DE
+ */
+static struct inode *vfat_new_inode(struct fs_info *fs,
+				    const struct fat_dir_entry *de)
 {
-    struct fs_info *fs = dir->fs;
     struct inode *inode;
+
+    inode = new_fat_inode(fs);
+    inode->size = de->file_size;
+    PVT(inode)->start_cluster = 
+	(de->first_cluster_high << 16) + de->first_cluster_low;
+    if (PVT(inode)->start_cluster == 0) {
+	/* Root directory */
+	int root_size = FAT_SB(fs)->root_size;
+
+	PVT(inode)->start_cluster = FAT_SB(fs)->root_cluster;
+	inode->size = root_size ? root_size << fs->sector_shift : ~0;
+	PVT(inode)->start = PVT(inode)->here = FAT_SB(fs)->root;
+    } else {
+	PVT(inode)->start = PVT(inode)->here = first_sector(fs, de);
+    }
+    inode->mode = get_inode_mode(de->attr);
+
+    return inode;
+}
+
+/* FNV-1a */
+static uint32_t vfat_name_hash(const char *name, size_t len)
+{
+    uint32_t h = 2166136261U;
+
+    while (len--) {
+	h ^= (uint8_t)*name++;
+	h *= 16777619U;
+    }
+    return h;
+}
+
+static bool vfat_index_add(struct fat_dir_index *idx, const char *key,
+			   size_t len, bool is_long, uint32_t pos,
+			   sector_t sector, uint16_t slot)
+{
+    struct fat_dir_name *dn;
+
+    if (idx->nnames >= idx->maxnames) {
+	uint32_t n = idx->maxnames ? idx->maxnames << 1 : 64;
+	struct fat_dir_name *p = realloc(idx->names, n * sizeof *p);
+
+	if (!p)
+	    return false;
+	idx->names    = p;
+	idx->maxnames = n;
+    }
+
+    if (idx->pool_len + len + 1 > idx->pool_max) {
+	size_t n = idx->pool_max ? idx->pool_max : 1024;
+	char *p;
+
+	while (n < idx->pool_len + len + 1)
+	    n <<= 1;
+	p = realloc(idx->pool, n);
+	if (!p)
+	    return false;
+	idx->pool     = p;
+	idx->pool_max = n;
+    }
+
+    dn = &idx->names[idx->nnames++];
+    dn->hash    = vfat_name_hash(key, len);
+    dn->next    = 0;
+    dn->pos     = pos;
+    dn->name    = idx->pool_len;
+    dn->sector  = sector;
+    dn->slot    = slot;
+    dn->is_long = is_long;
+
+    memcpy(idx->pool + idx->pool_len, key, len);
+    idx->pool[idx->pool_len + len] = '\0';
+    idx->pool_len += len + 1;
+
+    return true;
+}
+
+static void vfat_index_free(struct fat_dir_index *idx)
+{
+    free(idx->names);
+    free(idx->buckets);
+    free(idx->pool);
+    free(idx);
+}
+
+/*
+ * Read the whole directory starting at START and index every name
+ * in it.  Returns NULL if we run out of memory; the caller then falls
+ * back to scanning the directory.
+ */
+static struct fat_dir_index *vfat_index_build(struct fs_info *fs,
+					      sector_t start)
+{
+    struct fat_dir_index *idx;
+    const struct fat_dir_entry *de;
+    const struct fat_long_name_entry *long_de;
+    uint16_t long_name[261];	/* == 20*13 + 1 (to guarantee null) */
+    char name[261];
+    sector_t sector = start;
+    uint32_t pos = 0;
+    uint8_t vfat_next = 0xff, vfat_csum = 0xff;
+    uint8_t id;
+    bool long_entry = false;
+    int name_len = 0;
+    int entries, slot, i;
+
+    idx = zalloc(sizeof *idx);
+    if (!idx)
+	return NULL;
+    idx->start = start;
+
+    while (sector) {
+	de = get_cache(fs->fs_dev, sector);
+	entries = 1 << (fs->sector_shift - 5);
+
+	for (slot = 0; slot < entries; slot++, de++, pos++) {
+	    if (de->name[0] == 0)
+		goto done;	/* End of directory */
+	    if ((uint8_t)de->name[0] == 0xe5)
+		goto invalid;
+
+	    if (de->attr == 0x0f) {
+		long_de = (const struct fat_long_name_entry *)de;
+		id = long_de->id;
+
+		if (id & 0x40) {
+		    vfat_csum = long_de->checksum;
+		    id &= 0x3f;
+		    if (id > 20)
+			goto invalid; /* Too long! */
+		    memset(long_name, 0, sizeof long_name);
+		} else {
+		    if (long_de->checksum != vfat_csum || id != vfat_next)
+			goto invalid;
+		}
+
+		vfat_next = --id;
+		copy_long_chunk(long_name + id*13, de);
+
+		if (id == 0) {
+		    name_len = vfat_cvt_longname(name, long_name);
+		    long_entry = name_len > 0;
+		}
+		continue;
+	    }
+
+	    if (de->attr & 0x08) /* ignore volume labels */
+		goto invalid;
+
+	    if (!vfat_index_add(idx, de->name, 11, false, pos, sector, slot))
+		goto nomem;
+
+	    if (long_entry && get_checksum(de->name) == vfat_csum) {
+		for (i = 0; i < name_len; i++)
+		    name[i] = codepage.upper[(uint8_t)name[i]];
+		if (!vfat_index_add(idx, name, name_len, true,
+				    pos, sector, slot))
+		    goto nomem;
+	    }
+
+	invalid:
+	    long_entry = false;
+	    vfat_next = 0xff;
+	}
+
+	sector = get_next_sector(fs, sector);
+    }
+
+done:
+    idx->nbuckets = 1;
+    while (idx->nbuckets < idx->nnames)
+	idx->nbuckets <<= 1;
+    idx->buckets = zalloc(idx->nbuckets * sizeof *idx->buckets);
+    if (!idx->buckets)
+	goto nomem;
+
+    /* Insert backwards so each chain is in directory order */
+    for (i = idx->nnames; i > 0; i--) {
+	struct fat_dir_name *dn = &idx->names[i-1];
+	uint32_t *bucket = &idx->buckets[dn->hash & (idx->nbuckets - 1)];
+
+	dn->next = *bucket;
+	*bucket = i;
+    }
+
+    dprintf("vfat: indexed %u names in directory at %llu\n",
+	    idx->nnames, start);
+    return idx;
+
+nomem:
+    vfat_index_free(idx);
+    return NULL;
+}
+
+/*
+ * Find or build the index for the directory starting at START
+ */
+static struct fat_dir_index *vfat_get_index(struct fs_info *fs,
+					    sector_t start)
+{
+    struct fat_sb_info *sbi = FAT_SB(fs);
+    struct fat_dir_index *idx, *prev = NULL;
+    int n;
+
+    for (idx = sbi->dir_index; idx; prev = idx, idx = idx->next) {
+	if (idx->start == start) {
+	    if (prev) {
+		/* Move to front */
+		prev->next = idx->next;
+		idx->next = sbi->dir_index;
+		sbi->dir_index = idx;
+	    }
+	    return idx;
+	}
+    }
+
+    idx = vfat_index_build(fs, start);
+    if (!idx)
+	return NULL;
+
+    idx->next = sbi->dir_index;
+    sbi->dir_index = idx;
+
+    /* Drop the least recently used ones past the limit */
+    for (n = 1; idx->next && n < FAT_DIR_INDEX_MAX; n++)
+	idx = idx->next;
+    while (idx->next) {
+	struct fat_dir_index *dead = idx->next;
+
+	idx->next = dead->next;
+	vfat_index_free(dead);
+    }
+
+    return sbi->dir_index;
+}
+
+/*
+ * Look DNAME up in a directory index.  Returns the directory entry, or
+ * NULL if there is no such name.
+ */
+static const struct fat_dir_entry *
+vfat_index_lookup(struct fs_info *fs, const struct fat_dir_index *idx,
+		  const char *dname, const char *mangled_name)
+{
+    char folded[261];
+    const struct fat_dir_name *dn, *best = NULL;
+    uint32_t h, i;
+    size_t len = strlen(dname);
+    const char *data;
+
+    if (len < sizeof folded) {
+	for (i = 0; i < len; i++)
+	    folded[i] = codepage.upper[(uint8_t)dname[i]];
+	folded[len] = '\0';
+
+	h = vfat_name_hash(folded, len);
+	for (i = idx->buckets[h & (idx->nbuckets - 1)]; i; i = dn->next) {
+	    dn = &idx->names[i-1];
+	    if (dn->hash == h && dn->is_long &&
+		!strcmp(idx->pool + dn->name, folded)) {
+		best = dn;
+		break;
+	    }
+	}
+    }
+
+    h = vfat_name_hash(mangled_name, 11);
+    for (i = idx->buckets[h & (idx->nbuckets - 1)]; i; i = dn->next) {
+	dn = &idx->names[i-1];
+	if (dn->hash == h && !dn->is_long &&
+	    !memcmp(idx->pool + dn->name, mangled_name, 11)) {
+	    if (!best || dn->pos < best->pos)
+		best = dn;
+	    break;
+	}
+    }
+
+    if (!best)
+	return NULL;
+
+    data = get_cache(fs->fs_dev, best->sector);
+    return (const struct fat_dir_entry *)data + best->slot;
+}
+
+/*
+ * Find DNAME by reading through the directory
+ */
+static struct inode *vfat_scan_entry(const char *dname, struct inode *dir)
+{
+    struct fs_info *fs = dir->fs;
     const struct fat_dir_entry *de;
     struct fat_long_name_entry *long_de;
 
@@ -545,23 +1003,27 @@ static struct inode *vfat_find_entry(const char *dname, struct inode *dir)
     return NULL;		/* Nothing found... */
 
 found:
-    inode = new_fat_inode(fs);
-    inode->size = de->file_size;
-    PVT(inode)->start_cluster = 
-	(de->first_cluster_high << 16) + de->first_cluster_low;
-    if (PVT(inode)->start_cluster == 0) {
-	/* Root directory */
-	int root_size = FAT_SB(fs)->root_size;
+    return vfat_new_inode(fs, de);
+}
 
-	PVT(inode)->start_cluster = FAT_SB(fs)->root_cluster;
-	inode->size = root_size ? root_size << fs->sector_shift : ~0;
-	PVT(inode)->start = PVT(inode)->here = FAT_SB(fs)->root;
-    } else {
-	PVT(inode)->start = PVT(inode)->here = first_sector(fs, de);
-    }
-    inode->mode = get_inode_mode(de->attr);
+static struct inode *vfat_find_entry(const char *dname, struct inode *dir)
+{
+    struct fs_info *fs = dir->fs;
+    const struct fat_dir_index *idx;
+    const struct fat_dir_entry *de;
+    char mangled_name[12];
 
-    return inode;
+    if ((strlen(dname) + 12) / 13 > 20)
+	return NULL;		/* Name too long */
+
+    idx = vfat_get_index(fs, PVT(dir)->start);
+    if (!idx)
+	return vfat_scan_entry(dname, dir);
+
+    mangle_dos_name(mangled_name, dname);
+    de = vfat_index_lookup(fs, idx, dname, mangled_name);
+
+    return de ? vfat_new_inode(fs, de) : NULL;
 }
 
 static struct inode *vfat_iget_root(struct fs_info *fs)
@@ -720,6 +1182,41 @@ got:
 }
 
 /* init. the fs meta data, return the block size in bits */
+/*
+ * Read the whole FAT into memory, if it is small enough, with as few
+ * disk requests as the disk allows.  If that fails, it stays in the
+ * block cache like everything else.
+ */
+static void vfat_load_fat(struct fs_info *fs, uint32_t sectors_per_fat)
+{
+    struct fat_sb_info *sbi = FAT_SB(fs);
+    struct disk *disk = fs->fs_dev->disk;
+    uint32_t bytes, sectors;
+    void *map;
+
+    /* A FAT12 entry is read as a word, so the last one needs a byte more */
+    bytes = fat_entry_offset(sbi, sbi->clusters + 2);
+    if (sbi->fat_type == FAT12)
+	bytes++;
+    sectors = (bytes + SECTOR_SIZE(fs) - 1) >> SECTOR_SHIFT(fs);
+    if (sectors > sectors_per_fat)
+	return;			/* Doesn't add up; leave it to the cache */
+    if ((sectors << SECTOR_SHIFT(fs)) > FAT_RESIDENT_MAX)
+	return;
+
+    map = malloc(sectors << SECTOR_SHIFT(fs));
+    if (!map)
+	return;
+
+    if (disk->rdwr_sectors(disk, map, sbi->fat, sectors, 0) != (int)sectors) {
+	free(map);
+	return;
+    }
+
+    sbi->fat_map = map;
+    dprintf("fat: %u sectors of FAT resident\n", sectors);
+}
+
 static int vfat_fs_init(struct fs_info *fs)
 {
     struct fat_bpb fat;
@@ -738,7 +1235,7 @@ static int vfat_fs_init(struct fs_info *fs)
     /* XXX: Find better sanity checks... */
     if (!fat.bxResSectors || !fat.bxFATs)
 	return -1;
-    sbi = malloc(sizeof(*sbi));
+    sbi = zalloc(sizeof(*sbi));
     if (!sbi)
 	malloc_error("fat_sb_info structure");
     fs->fs_info = sbi;
@@ -787,6 +1284,8 @@ static int vfat_fs_init(struct fs_info *fs)
     /* Initialize the cache */
     cache_init(fs->fs_dev, fs->block_shift);
 
+    vfat_load_fat(fs, sectors_per_fat);
+
     return fs->block_shift;
 }
 
@@ -854,7 +1353,9 @@ const struct fs_ops vfat_fs_ops = {
     .readdir       = vfat_readdir,
     .iget_root     = vfat_iget_root,
     .iget          = vfat_iget,
+    .free_inode    = fat_free_inode,
     .next_extent   = fat_next_extent,
+    .prefetch      = fat_prefetch,
     .copy_super    = vfat_copy_superblock,
     .fs_uuid       = vfat_fs_uuid,
 };
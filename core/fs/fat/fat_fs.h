@@ -80,6 +80,35 @@ struct fat_bpb {
 
 } __attribute__ ((packed));
 
+/*
+ * Name lookup index of one directory, built by the first lookup in it.
+ * Each short entry gets a key for its 8.3 name and, if it has one, a
+ * key for its long name converted to the codepage and upper-cased.
+ */
+struct fat_dir_name {
+    uint32_t hash;
+    uint32_t next;		/* Next key in the bucket + 1, 0 = end */
+    uint32_t pos;		/* Entry number within the directory */
+    uint32_t name;		/* Offset of the key in the name pool */
+    sector_t sector;		/* Where the short entry lives */
+    uint16_t slot;		/* ... and which entry in that sector */
+    uint8_t  is_long;
+};
+
+struct fat_dir_index {
+    struct fat_dir_index *next;	/* Most recently used first */
+    sector_t start;		/* First sector of the directory */
+    struct fat_dir_name *names;
+    uint32_t nnames, maxnames;
+    uint32_t *buckets;		/* Heads of the hash chains, + 1 */
+    uint32_t nbuckets;		/* Power of 2 */
+    char *pool;
+    size_t pool_len, pool_max;
+};
+
+/* Directory indices kept per filesystem */
+#define FAT_DIR_INDEX_MAX	8
+
 /*
  * The fat file system info in memory 
  */
@@ -100,8 +129,21 @@ struct fat_sb_info {
 	int      fat_type;
 
 	uint32_t uuid;             /* fs UUID */
+
+	struct fat_dir_index *dir_index; /* Name lookup indices */
+
+	const void *fat_map;	  /* The whole FAT, if it is resident */
 } __attribute__ ((packed));
 
+/*
+ * A FAT up to this size is read into memory whole at mount time, and
+ * the cluster chains are followed there: all of FAT12 and FAT16, and
+ * FAT32 volumes of up to 128K clusters.  0 keeps it all in the cache.
+ */
+#ifndef FAT_RESIDENT_MAX
+# define FAT_RESIDENT_MAX	(512 << 10)
+#endif
+
 struct fat_dir_entry {
         char     name[11];
         uint8_t  attr;
@@ -145,6 +187,15 @@ static inline int root_dir_size(struct fs_info *fs, struct fat_bpb *fat)
 	>> (SECTOR_SHIFT(fs) - 5);
 }
 
+/*
+ * A run of physically contiguous clusters in a file's chain
+ */
+struct fat_run {
+    uint32_t lcluster;		/* First logical cluster in the run */
+    uint32_t pcluster;		/* ... and its cluster number */
+    uint32_t len;		/* Clusters in the run */
+};
+
 /*
  * FAT private inode information
  */
@@ -153,6 +204,12 @@ struct fat_pvt_inode {
     sector_t start;		/* Starting sector */
     sector_t offset;		/* Current sector offset */
     sector_t here;		/* Sector corresponding to offset */
+
+    /* Cluster map, built by fat_next_extent() as the chain is walked */
+    struct fat_run *runs;
+    uint32_t nruns, maxruns;
+    uint32_t mapped;		/* Logical clusters covered by runs[] */
+    uint32_t map_next;		/* Chain entry following the last run */
 };
 
 #define PVT(i) ((struct fat_pvt_inode *)((i)->pvt))
@@ -6,14 +6,20 @@
 #include <fcntl.h>
 #include <dprintf.h>
 #include <syslinux/sysappend.h>
+#include <syslinux/boottime.h>
+#include <syslinux/trace.h>
 #include "core.h"
 #include "dev.h"
 #include "fs.h"
 #include "cache.h"
+#include "pmapi.h"
 
 /* The currently mounted filesystem */
 __export struct fs_info *this_fs = NULL;		/* Root filesystem */
 
+/* Which checksums to verify on filesystems that have them, FS_VERIFY_* */
+__export uint16_t FsVerify;
+
 /* Actual file structures (we don't have malloc yet...) */
 __export struct file files[MAX_OPEN];
 
@@ -35,6 +41,80 @@ struct inode *alloc_inode(struct fs_info *fs, uint32_t ino, size_t data)
     return inode;
 }
 
+/*
+ * Recently released inodes of FS_INOCACHE filesystems, kept with their
+ * private data and extent state so that opening the same file again
+ * does not have to rebuild them.  A parked inode has no references,
+ * no parent and no name.
+ */
+#define INODE_CACHE_ENTRIES	16
+
+static struct {
+    struct inode *inode;	/* NULL = unused slot */
+    unsigned int lru;
+} inode_cache[INODE_CACHE_ENTRIES];
+static unsigned int inode_cache_clock;
+
+static void destroy_inode(struct inode *inode)
+{
+    if (inode->fs->fs_ops->free_inode)
+	inode->fs->fs_ops->free_inode(inode);
+    if (inode->name)
+	free((char *)inode->name);
+    free(inode);
+}
+
+/*
+ * Park an unreferenced inode, evicting the least recently parked one
+ */
+static void park_inode(struct inode *inode)
+{
+    int i, victim = 0;
+
+    for (i = 0; i < INODE_CACHE_ENTRIES; i++) {
+	if (!inode_cache[i].inode) {
+	    victim = i;
+	    break;
+	}
+	if (inode_cache[i].lru < inode_cache[victim].lru)
+	    victim = i;
+    }
+
+    if (inode_cache[victim].inode)
+	destroy_inode(inode_cache[victim].inode);
+
+    if (inode->name) {
+	free((char *)inode->name);
+	inode->name = NULL;
+    }
+    inode->parent = NULL;
+
+    inode_cache[victim].inode = inode;
+    inode_cache[victim].lru = ++inode_cache_clock;
+}
+
+/*
+ * Take an inode back out of the cache, with one reference;
+ * returns NULL if it isn't there.
+ */
+struct inode *revive_inode(struct fs_info *fs, uint32_t ino)
+{
+    struct inode *inode;
+    int i;
+
+    for (i = 0; i < INODE_CACHE_ENTRIES; i++) {
+	inode = inode_cache[i].inode;
+	if (inode && inode->fs == fs && inode->ino == ino) {
+	    inode_cache[i].inode = NULL;
+	    inode->refcnt = 1;
+	    dprintf("revive_inode %p ino %u\n", inode, ino);
+	    return inode;
+	}
+    }
+
+    return NULL;
+}
+
 /*
  * Free a refcounted inode
  */
@@ -47,12 +127,102 @@ void put_inode(struct inode *inode)
 	if (refcnt)
 	    break;		/* We still have references */
 	inode = dead->parent;
-	if (dead->name)
-	    free((char *)dead->name);
-	free(dead);
+	if (dead->ino && (dead->fs->fs_ops->fs_flags & FS_INOCACHE))
+	    park_inode(dead);
+	else
+	    destroy_inode(dead);
     }
 }
 
+/*
+ * Dentry cache: the result of each (directory, name) lookup done by
+ * searchdir(), including the ones that found nothing, so probing the
+ * same paths over and over only goes to the driver once.
+ *
+ * An entry holds a reference on its directory, and on the inode found
+ * if there was one, so the directory pointer stays a valid key for as
+ * long as the entry exists.
+ */
+#define DCACHE_ENTRIES	32
+
+struct dentry {
+    struct inode *dir;		/* NULL = unused slot */
+    struct inode *inode;	/* NULL = negative entry */
+    uint32_t hash;
+    unsigned int lru;
+    char *name;
+};
+
+static struct dentry dcache[DCACHE_ENTRIES];
+static unsigned int dcache_clock;
+
+static uint32_t dcache_hash(const struct inode *dir, const char *name)
+{
+    uint32_t hash = 2166136261u ^ (uint32_t)(uintptr_t)dir;
+
+    while (*name) {
+	hash ^= (unsigned char)*name++;
+	hash *= 16777619;
+    }
+
+    return hash;
+}
+
+/*
+ * Look up a name in the dentry cache; returns the entry or NULL if
+ * the name has not been looked up in this directory yet.
+ */
+static struct dentry *dcache_lookup(struct inode *dir, const char *name)
+{
+    uint32_t hash = dcache_hash(dir, name);
+    struct dentry *de;
+
+    for (de = dcache; de < &dcache[DCACHE_ENTRIES]; de++) {
+	if (de->dir == dir && de->hash == hash && !strcmp(de->name, name)) {
+	    de->lru = ++dcache_clock;
+	    return de;
+	}
+    }
+
+    return NULL;
+}
+
+/*
+ * Record the result of a lookup, replacing the least recently used
+ * entry.  Not being able to cache something is not an error.
+ */
+static void dcache_insert(struct inode *dir, const char *name,
+			  struct inode *inode)
+{
+    struct dentry *de, *victim = dcache;
+    char *dname;
+
+    for (de = dcache; de < &dcache[DCACHE_ENTRIES]; de++) {
+	if (!de->dir) {
+	    victim = de;
+	    break;
+	}
+	if (de->lru < victim->lru)
+	    victim = de;
+    }
+
+    dname = strdup(name);
+    if (!dname)
+	return;
+
+    if (victim->dir) {
+	free(victim->name);
+	put_inode(victim->inode);
+	put_inode(victim->dir);
+    }
+
+    victim->dir = get_inode(dir);
+    victim->inode = inode ? get_inode(inode) : NULL;
+    victim->hash = dcache_hash(dir, name);
+    victim->lru = ++dcache_clock;
+    victim->name = dname;
+}
+
 /*
  * Get an empty file structure
  */
@@ -125,6 +295,7 @@ size_t pmapi_read_file(uint16_t *handle, void *buf, size_t sectors)
 
     file = handle_to_file(*handle);
     bytes_read = file->fs->fs_ops->getfssec(file, buf, sectors, &have_more);
+    trace(TRACE_GETFSSEC, "getfssec", sectors, bytes_read);
 
     /*
      * If we reach EOF, the filesystem driver will have already closed
@@ -144,6 +315,7 @@ int searchdir(const char *name, int flags)
     struct file *file;
     char *path, *inode_name, *next_inode_name;
     struct inode *tmp, *inode = NULL;
+    struct dentry *dentry;
     int symlink_count = MAX_SYMLINK_CNT;
 
     dprintf("searchdir: %s  root: %p  cwd: %p\n",
@@ -153,6 +325,10 @@ int searchdir(const char *name, int flags)
 	goto err_no_close;
     file->fs = this_fs;
 
+    /* The installer may have told us where this one is */
+    if (!preload_open(name, flags, file))
+	return file_to_handle(file);
+
     /* if we have ->searchdir method, call it */
     if (file->fs->fs_ops->searchdir) {
 	file->fs->fs_ops->searchdir(name, flags, file);
@@ -235,24 +411,38 @@ int searchdir(const char *name, int flags)
 
 	/* Anything else */
 	tmp = inode;
-	inode = this_fs->fs_ops->iget(inode_name, inode);
-	if (!inode) {
-	    /* Failure.  Release the chain */
+	dentry = dcache_lookup(tmp, inode_name);
+	if (dentry) {
+	    /* Seen before; a cached inode already holds its parent */
+	    inode = dentry->inode;
+	    if (inode)
+		get_inode(inode);
 	    put_inode(tmp);
-	    break;
-	}
+	    if (!inode)
+		break;
+	    dprintf("searchdir: cached component: %s\n", inode->name);
+	} else {
+	    inode = this_fs->fs_ops->iget(inode_name, inode);
+	    if (!inode) {
+		/* Failure.  Remember it, then release the chain */
+		dcache_insert(tmp, inode_name, NULL);
+		put_inode(tmp);
+		break;
+	    }
 
-	/* Sanity-check */
-	if (inode->parent && inode->parent != tmp) {
-	    dprintf("searchdir: iget returned a different parent\n");
-	    put_inode(inode);
-	    inode = NULL;
-	    put_inode(tmp);
-	    break;
+	    /* Sanity-check */
+	    if (inode->parent && inode->parent != tmp) {
+		dprintf("searchdir: iget returned a different parent\n");
+		put_inode(inode);
+		inode = NULL;
+		put_inode(tmp);
+		break;
+	    }
+	    inode->parent = tmp;
+	    inode->name = strdup(inode_name);
+	    dprintf("searchdir: path component: %s\n", inode->name);
+	    dcache_insert(tmp, inode_name, inode);
 	}
-	inode->parent = tmp;
-	inode->name = strdup(inode_name);
-	dprintf("searchdir: path component: %s\n", inode->name);
 
 	/* Symlink handling */
 	if (inode->mode == DT_LNK) {
@@ -358,6 +548,8 @@ __export int open_file(const char *name, int flags, struct com32_filedata *filed
 	return -1;
     }
 
+    history_add(mangled_name);
+
     filedata->size	= file->inode->size;
     filedata->blocklg2	= SECTOR_SHIFT(file->fs);
     filedata->handle	= rv;
@@ -365,6 +557,50 @@ __export int open_file(const char *name, int flags, struct com32_filedata *filed
     return rv;
 }
 
+/*
+ * A hint that we are likely to open this file soon; filesystems that
+ * can fetch it in the meantime do so.  On a disk, its metadata is read
+ * now, in as few requests as the cache can merge them into.
+ */
+__export void prefetch_file(const char *name)
+{
+    char mangled_name[FILENAME_MAX];
+
+    if (!this_fs)
+	return;
+
+    mangle_name(mangled_name, name);
+    if (this_fs->fs_ops->prefetch_file)
+	this_fs->fs_ops->prefetch_file(this_fs, mangled_name);
+    else if (!(this_fs->fs_ops->fs_flags & FS_NODEV))
+	prefetch_metadata(mangled_name);
+}
+
+/*
+ * Report the network transfer statistics, if the files come from the
+ * network; returns -1 otherwise.
+ */
+__export int pmapi_net_stats(struct com32_net_stats *st)
+{
+    memset(st, 0, sizeof *st);
+    if (!this_fs || !this_fs->fs_ops->net_stats)
+	return -1;
+
+    return this_fs->fs_ops->net_stats(st);
+}
+
+/*
+ * Fill buf with what a PXELINUX we chain should know about the network
+ * (see fs/pxe/handoff.c); returns its length, 0 if there is nothing.
+ */
+__export int pmapi_net_handoff(void *buf, size_t len)
+{
+    if (!this_fs || !this_fs->fs_ops->net_handoff)
+	return 0;
+
+    return this_fs->fs_ops->net_handoff(buf, len);
+}
+
 __export void close_file(uint16_t handle)
 {
     struct file *file;
@@ -453,4 +689,5 @@ void fs_init(const struct fs_ops **ops, void *priv)
     /* Add FSUUID=... string to cmdline */
     sysappend_set_fs_uuid();
 
+    boot_time_stamp(BOOT_PHASE_FS_MOUNT);
 }
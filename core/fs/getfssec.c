@@ -56,11 +56,17 @@
  * and coalescing.  However, if the filesystem can do extent coalescing
  * very cheaply by using filesystem-specific knowledge, then that is
  * preferred (e.g. FAT).
+ *
+ * File data never goes through the block cache: each coalesced extent
+ * is read straight into the caller's buffer, in transfers as large as
+ * the device allows.  Only a buffer which doesn't meet the device's
+ * alignment requirement is staged through core_xfer_buf.
  */
 
 #include <dprintf.h>
 #include <minmax.h>
 #include "fs.h"
+#include "cache.h"
 
 static inline sector_t next_psector(sector_t psector, uint32_t skip)
 {
@@ -76,12 +82,52 @@ static inline sector_t next_pstart(const struct extent *e)
 }
 
 
+/*
+ * Read a physically contiguous run of sectors into BUF.  Returns the
+ * number of sectors actually read.
+ */
+static uint32_t read_extent(struct disk *disk, char *buf,
+			    sector_t lba, uint32_t count)
+{
+    uint32_t chunk, done, total = 0;
+    uint32_t maxchunk;
+
+    if (disk->io_align && ((uintptr_t)buf & (disk->io_align - 1))) {
+	/* Misaligned buffer, bounce it */
+	maxchunk = sizeof core_xfer_buf >> disk->sector_shift;
+	while (count) {
+	    chunk = min(count, maxchunk);
+	    disk_io_source = DISK_IO_GETFSSEC;
+	    done = disk->rdwr_sectors(disk, core_xfer_buf, lba, chunk, 0);
+	    memcpy(buf, core_xfer_buf, done << disk->sector_shift);
+	    total += done;
+	    if (done < chunk)
+		break;
+	    buf   += chunk << disk->sector_shift;
+	    lba   += chunk;
+	    count -= chunk;
+	}
+	return total;
+    }
+
+    /* Direct path; the backend splits by maxtransfer as needed */
+    disk_io_source = DISK_IO_GETFSSEC;
+    done = disk->rdwr_sectors(disk, buf, lba, count, 0);
+    return min(done, count);
+}
+
 static void get_next_extent(struct inode *inode)
 {
     /* The logical start address that we care about... */
     uint32_t lstart = inode->this_extent.lstart + inode->this_extent.len;
+    const struct fs_ops *ops = inode->fs->fs_ops;
 
-    if (inode->fs->fs_ops->next_extent(inode, lstart))
+    if (ops->prefetch) {
+	ops->prefetch(inode, lstart);
+	cache_prefetch_flush();
+    }
+
+    if (ops->next_extent(inode, lstart))
 	inode->next_extent.len = 0; /* ERROR */
     inode->next_extent.lstart = lstart;
 
@@ -178,7 +224,15 @@ uint32_t generic_getfssec(struct file *file, char *buf,
 	if (inode->this_extent.pstart == EXTENT_ZERO) {
 	    memset(buf, 0, len);
 	} else {
-	    disk->rdwr_sectors(disk, buf, inode->this_extent.pstart, chunk, 0);
+	    uint32_t done = read_extent(disk, buf, inode->this_extent.pstart,
+					chunk);
+	    if (done < chunk) {
+		/* I/O error; return what we got and invalidate the extent */
+		bytes_read += done << SECTOR_SHIFT(fs);
+		inode->this_extent.len = 0;
+		inode->next_extent.len = 0;
+		break;
+	    }
 	    inode->this_extent.pstart += chunk;
 	}
 
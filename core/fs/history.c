@@ -0,0 +1,97 @@
+/*
+ * history.c
+ *
+ * The files this boot has opened, in order, so the loader can keep
+ * the list for the next boot (ldlinux puts it in the ADV) and hand it
+ * back to prefetch_file() early on.  The list is as many whole names
+ * as fit in BOOT_HISTORY_SIZE, NUL-terminated one after the other;
+ * the first files opened are the ones kept.
+ *
+ * Filesystems without a prefetch_file method of their own get
+ * prefetch_metadata(): it looks the file up and maps its extents, so
+ * that when the file is opened for real its directory entries, inode
+ * and block map are already in the cache.
+ */
+
+#include <dprintf.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include "core.h"
+#include "fs.h"
+#include "cache.h"
+
+static char history[BOOT_HISTORY_SIZE];
+static size_t history_len;
+
+void history_add(const char *name)
+{
+    char path[FILENAME_MAX];
+    size_t len;
+    const char *p;
+
+    if (!this_fs)
+	return;
+
+    /* The next boot may not start out in the same directory */
+    if (*name == '/' ||
+	snprintf(path, sizeof path, "%s%s", this_fs->cwd_name, name) >=
+	(int)sizeof path)
+	strlcpy(path, name, sizeof path);
+
+    len = strlen(path) + 1;
+    if (history_len + len > sizeof history)
+	return;
+
+    for (p = history; p < history + history_len; p += strlen(p) + 1) {
+	if (!strcmp(p, path))
+	    return;
+    }
+
+    memcpy(history + history_len, path, len);
+    history_len += len;
+}
+
+__export const char *boot_history(size_t *len)
+{
+    *len = history_len;
+    return history;
+}
+
+void prefetch_metadata(const char *name)
+{
+    struct file *file;
+    struct inode *inode;
+    const struct fs_ops *ops;
+    uint32_t lstart, sectors;
+    int handle;
+
+    handle = searchdir(name, O_RDONLY);
+    if (handle < 0)
+	return;
+
+    file = handle_to_file(handle);
+    inode = file->inode;
+    ops = inode->fs->fs_ops;
+
+    if (inode->mode == DT_REG && ops->next_extent) {
+	sectors = (inode->size + SECTOR_SIZE(inode->fs) - 1) >>
+	    SECTOR_SHIFT(inode->fs);
+
+	for (lstart = 0; lstart < sectors;
+	     lstart += inode->next_extent.len) {
+	    if (ops->prefetch) {
+		ops->prefetch(inode, lstart);
+		cache_prefetch_flush();
+	    }
+	    if (ops->next_extent(inode, lstart) || !inode->next_extent.len)
+		break;
+	}
+
+	/* getfssec() starts over from the beginning */
+	inode->next_extent.len = 0;
+    }
+
+    dprintf("prefetch_metadata: %s\n", name);
+    _close_file(file);
+}
@@ -7,6 +7,9 @@
 #include <disk.h>
 #include <fs.h>
 #include <stdlib.h>
+#include <minmax.h>
+#include <zlib.h>
+#include "codepage.h"
 #include "iso9660_fs.h"
 #include "susp_rr.h"
 
@@ -63,39 +66,66 @@ done:
     return p - dst;
 }
 
-/* 
- * Unlike strcmp, it does return 1 on match, or reutrn 0 if not match.
+/*
+ * Compare an ISO name as it is on disk to a name folded with
+ * fs_fold_name(), the way iso_convert_name() would see it: without
+ * the version suffix or any terminal dots.  Returns true on match.
  */
 static bool iso_compare_name(const char *de_name, size_t len,
-			     const char *file_name)
+			     const char *folded, size_t flen)
 {
-    char iso_file_name[256];
-    char *p = iso_file_name;
-    char c1, c2;
-    int i;
-    
-    i = iso_convert_name(iso_file_name, de_name, len);
-    (void)i;
-    dprintf("Compare: \"%s\" to \"%s\" (len %zu)\n",
-	    file_name, iso_file_name, i);
+    size_t n;
 
-    do {
-	c1 = *p++;
-	c2 = iso_tolower(*file_name++);
+    dprintf("Compare: \"%s\" to \"%.*s\"\n", folded, (int)len, de_name);
 
-	/* compare equal except for case? */
-	if (c1 != c2)
-	    return false;
-    } while (c1);
+    if (len == 1 && (uint8_t)*de_name <= 1) {
+	/* \0 is ".", \1 is ".." */
+	n = *de_name + 1;
+	return flen == n && !memcmp(folded, "..", n);
+    }
 
-    return true;
+    for (n = 0; n < len && de_name[n] && de_name[n] != ';'; n++)
+	;
+    while (n > 1 && de_name[n-1] == '.')
+	n--;
+
+    return n == flen && fs_name_eq_fold(de_name, folded, n);
+}
+
+/*
+ * The directory record of DIR at or after byte offset *POS, skipping
+ * the unused end of each block; *POS is moved to where it is.  Returns
+ * NULL at the end of the directory.
+ */
+static const struct iso_dir_entry *
+iso_dir_record(struct inode *dir, uint32_t *pos)
+{
+    struct fs_info *fs = dir->fs;
+    const struct iso_dir_entry *de;
+    const char *data;
+    uint32_t offset;
+
+    while ((*pos >> BLOCK_SHIFT(fs)) < dir->blocks) {
+	data = get_cache(fs->fs_dev,
+			 PVT(dir)->lba + (*pos >> BLOCK_SHIFT(fs)));
+	offset = *pos & (BLOCK_SIZE(fs) - 1);
+	de = (const struct iso_dir_entry *)(data + offset);
+
+	/* Zero = end of sector, see iso_scan_entry() */
+	if (de->length >= 33 && offset + de->length <= BLOCK_SIZE(fs))
+	    return de;
+	*pos = (*pos + BLOCK_SIZE(fs)) & ~(BLOCK_SIZE(fs) - 1);
+    }
+    return NULL;
 }
 
 /*
- * Find a entry in the specified dir with name _dname_.
+ * Find a entry in the specified dir with name _dname_ by walking the
+ * directory records.  *POS is set to the offset of the record in the
+ * directory.
  */
 static const struct iso_dir_entry *
-iso_find_entry(const char *dname, struct inode *inode)
+iso_scan_entry(const char *dname, struct inode *inode, uint32_t *pos)
 {
     struct fs_info *fs = inode->fs;
     block_t dir_block = PVT(inode)->lba;
@@ -105,9 +135,14 @@ iso_find_entry(const char *dname, struct inode *inode)
     const struct iso_dir_entry *de;
     const char *data = NULL;
     char *rr_name = NULL;
+    char folded[256];
+    int flen;
 
     dprintf("iso_find_entry: \"%s\"\n", dname);
-    
+
+    /* -1 if too long to be an ISO name; it can still be a RR name */
+    flen = fs_fold_name(folded, sizeof folded, dname);
+
     while (1) {
 	if (!data) {
 	    dprintf("Getting block %d from block %llu\n", i, dir_block);
@@ -139,6 +174,7 @@ iso_find_entry(const char *dname, struct inode *inode)
 	    if (strcmp(rr_name, dname) == 0) {
 		dprintf("Found (by RR name).\n");
 		free(rr_name);
+		*pos = ((i - 1) << BLOCK_SHIFT(fs)) + offset - de_len;
 		return de;
 	    }
 	    free(rr_name);
@@ -149,59 +185,592 @@ iso_find_entry(const char *dname, struct inode *inode)
 	/* Fall back to ISO name */
 	de_name_len = de->name_len;
 	de_name = de->name;
-	if (iso_compare_name(de_name, de_name_len, dname)) {
+	if (flen >= 0 &&
+	    iso_compare_name(de_name, de_name_len, folded, flen)) {
 	    dprintf("Found (by ISO name).\n");
+	    *pos = ((i - 1) << BLOCK_SHIFT(fs)) + offset - de_len;
 	    return de;
 	}
     }
 }
 
+/* FNV-1a */
+static uint32_t iso_name_hash(const char *name, size_t len)
+{
+    uint32_t h = 2166136261U;
+
+    while (len--) {
+	h ^= codepage.upper[(uint8_t)*name++];
+	h *= 16777619U;
+    }
+    return h;
+}
+
+static bool iso_index_add(struct iso_dir_index *idx, const char *key,
+			  size_t len, bool is_rr, uint32_t block,
+			  uint16_t offset)
+{
+    struct iso_dir_name *dn;
+
+    if (idx->nnames >= idx->maxnames) {
+	uint32_t n = idx->maxnames ? idx->maxnames << 1 : 64;
+	struct iso_dir_name *p = realloc(idx->names, n * sizeof *p);
+
+	if (!p)
+	    return false;
+	idx->names    = p;
+	idx->maxnames = n;
+    }
+
+    if (idx->pool_len + len + 1 > idx->pool_max) {
+	size_t n = idx->pool_max ? idx->pool_max : 1024;
+	char *p;
+
+	while (n < idx->pool_len + len + 1)
+	    n <<= 1;
+	p = realloc(idx->pool, n);
+	if (!p)
+	    return false;
+	idx->pool     = p;
+	idx->pool_max = n;
+    }
+
+    dn = &idx->names[idx->nnames++];
+    dn->hash   = iso_name_hash(key, len);
+    dn->next   = 0;
+    dn->name   = idx->pool_len;
+    dn->block  = block;
+    dn->offset = offset;
+    dn->is_rr  = is_rr;
+
+    memcpy(idx->pool + idx->pool_len, key, len);
+    idx->pool[idx->pool_len + len] = '\0';
+    idx->pool_len += len + 1;
+
+    return true;
+}
+
+static void iso_index_free(struct iso_dir_index *idx)
+{
+    free(idx->names);
+    free(idx->buckets);
+    free(idx->pool);
+    free(idx);
+}
+
+/*
+ * Read the whole directory and index the name of every record in it:
+ * the Rock Ridge name if there is one, otherwise the converted ISO name.
+ * Returns NULL if we run out of memory; the caller then falls back to
+ * scanning the directory.
+ */
+static struct iso_dir_index *iso_index_build(struct inode *inode)
+{
+    struct fs_info *fs = inode->fs;
+    struct iso_dir_index *idx;
+    const struct iso_dir_entry *de;
+    const char *data;
+    char iso_name[256];
+    char *rr_name;
+    uint32_t block = PVT(inode)->lba;
+    uint32_t i, offset;
+    int de_len, rr_name_len, name_len, ret;
+    bool ok;
+
+    idx = zalloc(sizeof *idx);
+    if (!idx)
+	return NULL;
+    idx->lba = block;
+
+    for (i = 0; i < inode->blocks; i++, block++) {
+	data = get_cache(fs->fs_dev, block);
+
+	for (offset = 0; offset < BLOCK_SIZE(fs); offset += de_len) {
+	    de = (const struct iso_dir_entry *)(data + offset);
+	    de_len = de->length;
+
+	    /* Zero = end of sector, see iso_scan_entry() */
+	    if (de_len < 33 || offset + de_len > BLOCK_SIZE(fs))
+		break;
+
+	    rr_name = NULL;
+	    ret = susp_rr_get_nm(fs, (char *) de, &rr_name, &rr_name_len);
+	    if (ret > 0) {
+		ok = iso_index_add(idx, rr_name, rr_name_len, true,
+				   block, offset);
+		free(rr_name);
+		/* the SUSP code may have read a continuation area */
+		data = get_cache(fs->fs_dev, block);
+	    } else {
+		name_len = iso_convert_name(iso_name, de->name, de->name_len);
+		ok = iso_index_add(idx, iso_name, name_len, false,
+				   block, offset);
+	    }
+	    if (!ok)
+		goto nomem;
+	}
+    }
+
+    idx->nbuckets = 1;
+    while (idx->nbuckets < idx->nnames)
+	idx->nbuckets <<= 1;
+    idx->buckets = zalloc(idx->nbuckets * sizeof *idx->buckets);
+    if (!idx->buckets)
+	goto nomem;
+
+    /* Insert backwards so each chain is in directory order */
+    for (i = idx->nnames; i > 0; i--) {
+	struct iso_dir_name *dn = &idx->names[i-1];
+	uint32_t *bucket = &idx->buckets[dn->hash & (idx->nbuckets - 1)];
+
+	dn->next = *bucket;
+	*bucket = i;
+    }
+
+    dprintf("iso: indexed %u names in directory at %u\n",
+	    idx->nnames, idx->lba);
+    return idx;
+
+nomem:
+    iso_index_free(idx);
+    return NULL;
+}
+
+/*
+ * Find or build the index for directory INODE
+ */
+static struct iso_dir_index *iso_get_index(struct inode *inode)
+{
+    struct iso_sb_info *sbi = ISO_SB(inode->fs);
+    struct iso_dir_index *idx, *prev = NULL;
+    int n;
+
+    for (idx = sbi->dir_index; idx; prev = idx, idx = idx->next) {
+	if (idx->lba == PVT(inode)->lba) {
+	    if (prev) {
+		/* Move to front */
+		prev->next = idx->next;
+		idx->next = sbi->dir_index;
+		sbi->dir_index = idx;
+	    }
+	    return idx;
+	}
+    }
+
+    idx = iso_index_build(inode);
+    if (!idx)
+	return NULL;
+
+    idx->next = sbi->dir_index;
+    sbi->dir_index = idx;
+
+    /* Drop the least recently used ones past the limit */
+    for (n = 1; idx->next && n < ISO_DIR_INDEX_MAX; n++)
+	idx = idx->next;
+    while (idx->next) {
+	struct iso_dir_index *dead = idx->next;
+
+	idx->next = dead->next;
+	iso_index_free(dead);
+    }
+
+    return sbi->dir_index;
+}
+
+/*
+ * Find a entry in the specified dir with name _dname_.  *POS is set to
+ * the offset of the record in the directory.
+ */
+static const struct iso_dir_entry *
+iso_find_entry(const char *dname, struct inode *inode, uint32_t *pos)
+{
+    struct fs_info *fs = inode->fs;
+    const struct iso_dir_index *idx;
+    const struct iso_dir_name *dn;
+    const char *name;
+    const char *data;
+    char folded[256];
+    size_t len = strlen(dname);
+    uint32_t h, i;
+    int flen;
+
+    idx = iso_get_index(inode);
+    if (!idx)
+	return iso_scan_entry(dname, inode, pos);
+
+    flen = fs_fold_name(folded, sizeof folded, dname);
+    h = iso_name_hash(dname, len);
+    for (i = idx->buckets[h & (idx->nbuckets - 1)]; i; i = dn->next) {
+	dn = &idx->names[i-1];
+	if (dn->hash != h)
+	    continue;
+
+	name = idx->pool + dn->name;
+	if (dn->is_rr ? strcmp(name, dname) :
+	    flen < 0 || strlen(name) != (size_t)flen ||
+	    !fs_name_eq_fold(name, folded, flen))
+	    continue;
+
+	data = get_cache(fs->fs_dev, dn->block);
+	*pos = ((dn->block - idx->lba) << BLOCK_SHIFT(fs)) + dn->offset;
+	return (const struct iso_dir_entry *)(data + dn->offset);
+    }
+
+    return NULL;
+}
+
 static inline enum dirent_type get_inode_mode(uint8_t flags)
 {
-    return (flags & 0x02) ? DT_DIR : DT_REG;
+    return (flags & ISO_FLAG_DIR) ? DT_DIR : DT_REG;
 }
 
+/*
+ * Add the extents of the directory records which follow the first one
+ * of a multi-extent file, starting at offset POS of directory DIR; all
+ * but the last of the records have ISO_FLAG_MULTI_EXTENT set.  Every
+ * extent but the last is a whole number of blocks, so the file is the
+ * extents one after the other.  Returns the bytes added to the file.
+ */
+static uint64_t iso_get_extents(struct inode *inode, struct inode *dir,
+				uint32_t pos)
+{
+    struct iso9660_pvt_inode *pvt = PVT(inode);
+    struct fs_info *fs = inode->fs;
+    const struct iso_dir_entry *de;
+    struct iso_extent *ext;
+    uint32_t max = 1;
+    uint64_t size = 0;
+    uint8_t flags = ISO_FLAG_MULTI_EXTENT;
+
+    while ((flags & ISO_FLAG_MULTI_EXTENT) &&
+	   (de = iso_dir_record(dir, &pos))) {
+	if (pvt->nextents >= max) {
+	    max <<= 1;
+	    ext = malloc(max * sizeof *ext);
+	    if (!ext) {
+		malloc_error("iso9660 extent list");
+		break;
+	    }
+	    memcpy(ext, pvt->extents, pvt->nextents * sizeof *ext);
+	    if (pvt->extents != &pvt->extent)
+		free(pvt->extents);
+	    pvt->extents = ext;
+	}
+
+	ext = &pvt->extents[pvt->nextents++];
+	ext->lba    = de->extent_le;
+	ext->blocks = (de->size_le + BLOCK_SIZE(fs) - 1) >> BLOCK_SHIFT(fs);
+	size += de->size_le;
+
+	flags = de->flags;
+	pos += de->length;
+    }
+
+    dprintf("iso: %u extents\n", pvt->nextents);
+    return size;
+}
+
+/*
+ * Make the inode for directory record DE, which is at offset POS in
+ * directory DIR (DIR is NULL for the root).
+ */
 static struct inode *iso_get_inode(struct fs_info *fs,
-				   const struct iso_dir_entry *de)
+				   const struct iso_dir_entry *de,
+				   struct inode *dir, uint32_t pos)
 {
     struct inode *inode = new_iso_inode(fs);
+    struct iso9660_pvt_inode *pvt;
     int blktosec = BLOCK_SHIFT(fs) - SECTOR_SHIFT(fs);
+    int header_size, block_shift;
+    uint32_t zf_size, i;
+    uint8_t flags;
 
     if (!inode)
 	return NULL;
+    pvt = PVT(inode);
 
     dprintf("Getting inode for: %.*s\n", de->name_len, de->name);
 
-    inode->mode   = get_inode_mode(de->flags);
+    flags = de->flags;
+    inode->mode   = get_inode_mode(flags);
     inode->size   = de->size_le;
-    PVT(inode)->lba = de->extent_le;
-    inode->blocks = (inode->size + BLOCK_SIZE(fs) - 1) >> BLOCK_SHIFT(fs);
+    pvt->lba = de->extent_le;
+    pvt->extent.lba    = de->extent_le;
+    pvt->extent.blocks = (inode->size + BLOCK_SIZE(fs) - 1) >> BLOCK_SHIFT(fs);
+    pvt->extents  = &pvt->extent;
+    pvt->nextents = 1;
+    pos += de->length;
+
+    /* This may read a continuation area, so DE is not used after it */
+    if (inode->mode == DT_REG &&
+	susp_rr_get_zf(fs, (char *) de, &header_size, &block_shift,
+		       &zf_size) > 0) {
+	pvt->zf_shift  = block_shift;
+	pvt->zf_header = header_size;
+    }
+
+    /* Files of 4 GB and more take one directory record per extent */
+    if ((flags & ISO_FLAG_MULTI_EXTENT) && dir) {
+	inode->size = (uint64_t)pvt->extent.blocks << BLOCK_SHIFT(fs);
+	inode->size += iso_get_extents(inode, dir, pos);
+    }
 
-    /* We have a single extent for all data */
-    inode->next_extent.pstart = (sector_t)de->extent_le << blktosec;
-    inode->next_extent.len    = (sector_t)inode->blocks << blktosec;
+    inode->blocks = 0;
+    for (i = 0; i < pvt->nextents; i++)
+	inode->blocks += pvt->extents[i].blocks;
+
+    if (pvt->zf_shift) {
+	/* getfssec() reads the stored data through the block cache */
+	pvt->zf_size = inode->size;
+	inode->size  = zf_size;
+	dprintf("iso: zisofs, %u -> %u bytes in blocks of %u\n",
+		pvt->zf_size, zf_size, 1 << pvt->zf_shift);
+    }
+
+    /* The first extent is all the data most files have */
+    inode->next_extent.pstart = (sector_t)pvt->extent.lba << blktosec;
+    inode->next_extent.len    = (sector_t)pvt->extent.blocks << blktosec;
 
     return inode;
 }
 
+static int iso_next_extent(struct inode *inode, uint32_t lstart)
+{
+    struct fs_info *fs = inode->fs;
+    const struct iso9660_pvt_inode *pvt = PVT(inode);
+    const struct iso_extent *ext = pvt->extents;
+    int blktosec = BLOCK_SHIFT(fs) - SECTOR_SHIFT(fs);
+    uint32_t lblock = lstart >> blktosec;
+    uint32_t skip = lstart & ((1 << blktosec) - 1);
+    uint32_t i;
+
+    for (i = 0; i < pvt->nextents; i++, ext++) {
+	if (lblock < ext->blocks) {
+	    inode->next_extent.pstart =
+		((sector_t)(ext->lba + lblock) << blktosec) + skip;
+	    inode->next_extent.len =
+		((ext->blocks - lblock) << blktosec) - skip;
+	    return 0;
+	}
+	lblock -= ext->blocks;
+    }
+
+    return -1;
+}
+
+/*
+ * Read LEN bytes of the file data as it is stored, from byte POS on.
+ * Returns the number of bytes read.
+ */
+static uint32_t iso_read_stored(struct inode *inode, void *buf,
+				uint32_t pos, uint32_t len)
+{
+    struct fs_info *fs = inode->fs;
+    const struct iso9660_pvt_inode *pvt = PVT(inode);
+    const struct iso_extent *ext = pvt->extents;
+    uint32_t i, bytes, n, done = 0;
+    char *p = buf;
+
+    for (i = 0; i < pvt->nextents && len; i++, ext++) {
+	bytes = ext->blocks << BLOCK_SHIFT(fs);
+	if (pos >= bytes) {
+	    pos -= bytes;
+	    continue;
+	}
+	n = min(len, bytes - pos);
+	n = cache_read(fs, p, ((uint64_t)ext->lba << BLOCK_SHIFT(fs)) + pos, n);
+	done += n;
+	if (n < min(len, bytes - pos))
+	    break;
+	p   += n;
+	len -= n;
+	pos  = 0;
+    }
+
+    return done;
+}
+
+/*
+ * Read the zisofs file header and the block pointers which follow it:
+ * block i of the file is stored from zf_ptrs[i] to zf_ptrs[i+1], and is
+ * all zero if that is empty.
+ */
+static int zisofs_load_ptrs(struct inode *inode)
+{
+    struct iso9660_pvt_inode *pvt = PVT(inode);
+    uint32_t nblocks, i, len;
+    char hdr[16];
+
+    nblocks = (inode->size + (1 << pvt->zf_shift) - 1) >> pvt->zf_shift;
+    len = (nblocks + 1) * sizeof *pvt->zf_ptrs;
+
+    if (iso_read_stored(inode, hdr, 0, sizeof hdr) != sizeof hdr ||
+	memcmp(hdr, ZISOFS_MAGIC, 8) ||
+	(uint64_t)pvt->zf_header + len > pvt->zf_size)
+	goto bad;
+
+    pvt->zf_ptrs = malloc(len);
+    pvt->zf_buf  = malloc(1 << pvt->zf_shift);
+    if (!pvt->zf_ptrs || !pvt->zf_buf) {
+	malloc_error("zisofs buffer");
+	goto fail;
+    }
+    if (iso_read_stored(inode, pvt->zf_ptrs, pvt->zf_header, len) != len)
+	goto bad;
+
+    if (pvt->zf_ptrs[0] < pvt->zf_header + len ||
+	pvt->zf_ptrs[nblocks] > pvt->zf_size)
+	goto bad;
+    for (i = 0; i < nblocks; i++) {
+	if (pvt->zf_ptrs[i] > pvt->zf_ptrs[i+1])
+	    goto bad;
+    }
+
+    return 0;
+
+bad:
+    printf("iso: bad zisofs file header\n");
+fail:
+    free(pvt->zf_ptrs);
+    free(pvt->zf_buf);
+    pvt->zf_ptrs = NULL;
+    pvt->zf_buf  = NULL;
+    return -1;
+}
+
+/*
+ * Uncompress block BLOCK of a zisofs file into zf_buf.  Each block is
+ * a zlib stream of its own.
+ */
+static int zisofs_read_block(struct inode *inode, uint32_t block)
+{
+    struct iso9660_pvt_inode *pvt = PVT(inode);
+    uint32_t start = pvt->zf_ptrs[block];
+    uint32_t clen = pvt->zf_ptrs[block+1] - start;
+    uint32_t bsize = 1 << pvt->zf_shift;
+    uint32_t len;
+    void *raw;
+    z_stream zs;
+    int rv;
+
+    len = min(bsize, inode->size - ((uint64_t)block << pvt->zf_shift));
+    pvt->zf_block = 0;
+
+    if (!clen) {
+	memset(pvt->zf_buf, 0, len);
+	pvt->zf_block = block + 1;
+	return 0;
+    }
+
+    /* zlib never makes data much bigger than it was */
+    if (clen > 2 * bsize)
+	goto bad;
+    raw = malloc(clen);
+    if (!raw) {
+	malloc_error("zisofs block");
+	return -1;
+    }
+    if (iso_read_stored(inode, raw, start, clen) != clen) {
+	free(raw);
+	return -1;
+    }
+
+    memset(&zs, 0, sizeof zs);
+    zs.next_in   = raw;
+    zs.avail_in  = clen;
+    zs.next_out  = (Bytef *)pvt->zf_buf;
+    zs.avail_out = len;
+    rv = inflateInit(&zs);
+    if (rv == Z_OK) {
+	rv = inflate(&zs, Z_FINISH);
+	inflateEnd(&zs);
+    }
+    free(raw);
+
+    /* A full block is fine even if the stream didn't end */
+    if (zs.avail_out ||
+	(rv != Z_STREAM_END && rv != Z_OK && rv != Z_BUF_ERROR))
+	goto bad;
+
+    pvt->zf_block = block + 1;
+    return 0;
+
+bad:
+    printf("iso: bad zisofs block %u\n", block);
+    return -1;
+}
+
+static uint32_t iso_getfssec(struct file *file, char *buf, int sectors,
+			     bool *have_more)
+{
+    struct inode * const inode = file->inode;
+    struct iso9660_pvt_inode * const pvt = PVT(inode);
+    uint32_t sec_shift = SECTOR_SHIFT(file->fs);
+    uint32_t sec_size = SECTOR_SIZE(file->fs);
+    uint32_t bmask = (1 << pvt->zf_shift) - 1;
+    uint32_t total = 0;
+    uint32_t block, off, ret;
+    bool more;
+
+    if (!pvt->zf_shift)
+	return generic_getfssec(file, buf, sectors, have_more);
+
+    more = file->offset < inode->size;
+    if (!pvt->zf_ptrs && zisofs_load_ptrs(inode))
+	more = false;
+
+    while (sectors > 0 && more) {
+	block = file->offset >> pvt->zf_shift;
+	if (pvt->zf_block != block + 1 && zisofs_read_block(inode, block)) {
+	    more = false;	/* as for an I/O error */
+	    break;
+	}
+
+	off = file->offset & bmask;
+	ret = min(bmask + 1 - off, inode->size - file->offset);
+	ret = min(ret, (uint32_t)sectors << sec_shift);
+	memcpy(buf, pvt->zf_buf + off, ret);
+
+	file->offset += ret;
+	more = file->offset < inode->size;
+	total += ret;
+	buf += ret;
+	sectors -= (ret + sec_size - 1) >> sec_shift;
+    }
+
+    *have_more = more;
+    return total;
+}
+
+static void iso_free_inode(struct inode *inode)
+{
+    struct iso9660_pvt_inode *pvt = PVT(inode);
+
+    if (pvt->extents != &pvt->extent)
+	free(pvt->extents);
+    free(pvt->zf_ptrs);
+    free(pvt->zf_buf);
+}
+
 static struct inode *iso_iget_root(struct fs_info *fs)
 {
     const struct iso_dir_entry *root = &ISO_SB(fs)->root;
 
-    return iso_get_inode(fs, root);
+    return iso_get_inode(fs, root, NULL, 0);
 }
 
 static struct inode *iso_iget(const char *dname, struct inode *parent)
 {
     const struct iso_dir_entry *de;
+    uint32_t pos;
     
     dprintf("iso_iget %p %s\n", parent, dname);
 
-    de = iso_find_entry(dname, parent);
+    de = iso_find_entry(dname, parent, &pos);
     if (!de)
 	return NULL;
     
-    return iso_get_inode(parent->fs, de);
+    return iso_get_inode(parent->fs, de, parent, pos);
 }
 
 static int iso_readdir(struct file *file, struct dirent *dirent)
@@ -209,34 +778,21 @@ static int iso_readdir(struct file *file, struct dirent *dirent)
     struct fs_info *fs = file->fs;
     struct inode *inode = file->inode;
     const struct iso_dir_entry *de;
-    const char *data = NULL;
     char *rr_name = NULL;
     int name_len, ret;
-    
-    while (1) {
-	size_t offset = file->offset & (BLOCK_SIZE(fs) - 1);
+    uint8_t flags;
 
-	if (!data) {
-	    uint32_t i = file->offset >> BLOCK_SHIFT(fs);
-	    if (i >= inode->blocks)
-		return -1;
-	    data = get_cache(fs->fs_dev, PVT(inode)->lba + i);
-	}
-	de = (const struct iso_dir_entry *)(data + offset);
-	
-	if (de->length < 33 || offset + de->length > BLOCK_SIZE(fs)) {
-	    file->offset = (file->offset + BLOCK_SIZE(fs))
-		& ~(BLOCK_SIZE(fs) - 1); /* Start of the next block */
-	    data = NULL;
-	    continue;
-	}
-	break;
-    }
+    de = iso_dir_record(inode, &file->offset);
+    if (!de)
+	return -1;
     
     dirent->d_ino = 0;           /* Inode number is invalid to ISO fs */
     dirent->d_off = file->offset;
     dirent->d_type = get_inode_mode(de->flags);
 
+    flags = de->flags;
+    file->offset += de->length;  /* Update for next reading */
+
     /* Try to get Rock Ridge name */
     ret = susp_rr_get_nm(fs, (char *) de, &rr_name, &name_len);
     if (ret > 0) {
@@ -249,7 +805,12 @@ static int iso_readdir(struct file *file, struct dirent *dirent)
 
     dirent->d_reclen = offsetof(struct dirent, d_name) + 1 + name_len;
 
-    file->offset += de->length;  /* Update for next reading */
+    /* The other records of a multi-extent file have the same name */
+    while ((flags & ISO_FLAG_MULTI_EXTENT) &&
+	   (de = iso_dir_record(inode, &file->offset))) {
+	flags = de->flags;
+	file->offset += de->length;
+    }
     
     return 0;
 }
@@ -288,6 +849,7 @@ static int iso_fs_init(struct fs_info *fs)
 	return 1;
     }
     fs->fs_info = sbi;
+    sbi->dir_index = NULL;
 
     /* 
      * XXX: handling iso9660 in hybrid mode on top of a 4K-logical disk
@@ -324,13 +886,14 @@ const struct fs_ops iso_fs_ops = {
     .fs_flags      = FS_USEMEM | FS_THISIND,
     .fs_init       = iso_fs_init,
     .searchdir     = NULL, 
-    .getfssec      = generic_getfssec,
+    .getfssec      = iso_getfssec,
     .close_file    = generic_close_file,
     .mangle_name   = generic_mangle_name,
     .open_config   = iso_open_config,
     .iget_root     = iso_iget_root,
     .iget          = iso_iget,
     .readdir       = iso_readdir,
-    .next_extent   = no_next_extent,
+    .next_extent   = iso_next_extent,
+    .free_inode    = iso_free_inode,
     .fs_uuid       = NULL,
 };
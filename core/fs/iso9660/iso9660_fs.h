@@ -35,6 +35,31 @@ struct iso_dir_entry {
     char    name[0];                        /* 21 */
 } __packed;
 
+/* One name in a directory index */
+struct iso_dir_name {
+    uint32_t hash;
+    uint32_t next;		/* Next key in the bucket + 1, 0 = end */
+    uint32_t name;		/* Offset of the key in the name pool */
+    uint32_t block;		/* Where the directory record lives */
+    uint16_t offset;		/* ... and where in that block */
+    uint8_t  is_rr;		/* Rock Ridge names compare case-sensitively */
+};
+
+/* All the names of one directory, Rock Ridge ones already decoded */
+struct iso_dir_index {
+    struct iso_dir_index *next;	/* Most recently used first */
+    uint32_t lba;		/* First block of the directory */
+    struct iso_dir_name *names;
+    uint32_t nnames, maxnames;
+    uint32_t *buckets;		/* Heads of the hash chains, + 1 */
+    uint32_t nbuckets;		/* Power of 2 */
+    char *pool;
+    size_t pool_len, pool_max;
+};
+
+/* Directory indices kept per filesystem */
+#define ISO_DIR_INDEX_MAX	8
+
 struct iso_sb_info {
     struct iso_dir_entry root;
 
@@ -42,13 +67,39 @@ struct iso_sb_info {
                         2 indicates that the id of RRIP 1.12 was found.
                      */
     int susp_skip;   /* Skip length from SUSP entry SP */
+
+    struct iso_dir_index *dir_index; /* Name lookup indices */
 };
 
+/* Directory record flags */
+#define ISO_FLAG_DIR		0x02
+#define ISO_FLAG_MULTI_EXTENT	0x80	/* Another record for the file follows */
+
+/* One extent of file data, from one directory record */
+struct iso_extent {
+    uint32_t lba;
+    uint32_t blocks;
+};
+
+/* zisofs file header magic */
+#define ZISOFS_MAGIC		"\x37\xe4\x53\x96\xc9\xdb\xd6\x07"
+
 /*
  * iso9660 private inode information
  */
 struct iso9660_pvt_inode {
     uint32_t lba;		/* Starting LBA of file data area*/
+    struct iso_extent *extents;	/* All of them, in file order */
+    uint32_t nextents;
+    struct iso_extent extent;	/* ... when there is just the one */
+
+    /* zisofs compressed files */
+    uint8_t  zf_shift;		/* log2 block size, 0 = not compressed */
+    uint16_t zf_header;		/* Bytes before the block pointers */
+    uint32_t zf_size;		/* Stored (compressed) size */
+    uint32_t *zf_ptrs;		/* Block pointers, read on first use */
+    char     *zf_buf;		/* One block, uncompressed */
+    uint32_t zf_block;		/* Which block is in zf_buf, + 1 */
 };
 
 #define PVT(i) ((struct iso9660_pvt_inode *)((i)->pvt))
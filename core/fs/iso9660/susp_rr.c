@@ -428,6 +428,42 @@ int susp_rr_get_nm(struct fs_info *fs, char *dir_rec,
 }
 
 
+/* Public function. See susp_rr.h
+*/
+int susp_rr_get_zf(struct fs_info *fs, char *dir_rec,
+		   int *header_size, int *block_shift, uint32_t *size)
+{
+    char *data = NULL;
+    uint8_t *u_data;
+    int len_data, ret;
+
+    ret = susp_rr_get_entries(fs, dir_rec, "ZF", &data, &len_data, 0);
+    if (ret <= 0)
+	return ret;
+
+    /* Algorithm, header size / 4, log2 block size, size LSB then MSB */
+    u_data = (uint8_t *) data;
+    ret = 0;
+    if (len_data < 12) {
+	dprintf("susp_rr.c: Short ZF entry encountered.\n");
+	ret = -1;
+    } else if (data[0] != 'p' || data[1] != 'z') {
+	dprintf("susp_rr.c: ZF algorithm '%c%c' not supported.\n",
+		data[0], data[1]);
+    } else if (u_data[3] < 15 || u_data[3] > 17 || u_data[2] < 4) {
+	dprintf("susp_rr.c: Bad zisofs parameters in ZF entry.\n");
+	ret = -1;
+    } else {
+	*header_size = u_data[2] * 4;
+	*block_shift = u_data[3];
+	*size = susp_rr_read_lsb32(u_data + 4);
+	ret = 1;
+    }
+    free(data);
+    return ret;
+}
+
+
 /* Public function. See susp_rr.h
 */
 int susp_rr_check_signatures(struct fs_info *fs, int flag)
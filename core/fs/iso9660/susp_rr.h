@@ -81,4 +81,26 @@ int susp_rr_get_nm(struct fs_info *fs, char *dir_rec,
                    char **name, int *len_name);
 
 
+/*  Obtain the zisofs parameters of a directory record from its ZF entry.
+    Only algorithm "pz" (zlib, as written by mkzftree and libisofs) is
+    known. A file with a ZF entry of another algorithm is reported as not
+    compressed, so its data comes out as it is stored.
+
+    @param fs          The filesystem from which to read CE blocks.
+                       fs->fs_info->do_rr must be non-zero or else this
+                       function will always return 0.
+    @param dir_rec     Memory containing the whole ISO 9660 directory record.
+    @param header_size Returns the number of bytes of zisofs file header
+                       which precede the block pointers in the file data.
+    @param block_shift Returns log2 of the uncompressed block size.
+    @param size        Returns the uncompressed size of the file.
+    @return         1  Success. The file is zisofs compressed.
+                    0  No usable ZF entry found. The file is not compressed.
+                   -1  Error.
+                       Something is wrong with the ZF entry in the image.
+*/
+int susp_rr_get_zf(struct fs_info *fs, char *dir_rec,
+                   int *header_size, int *block_shift, uint32_t *size);
+
+
 #endif /* ! ISO9660_SUSP_H */
@@ -0,0 +1,91 @@
+/*
+ * namecmp.c
+ *
+ * Case-insensitive filename comparison for the filesystem drivers.
+ * Case is folded through the codepage's upper case table, and Unicode
+ * names are matched through its primary and alternate Unicode tables,
+ * so every driver agrees on what "the same name" means.
+ *
+ * A lookup folds the name it is looking for once, with fs_fold_name(),
+ * and then compares every directory entry against that.  Most entries
+ * differ in their first few bytes, and a name that does match usually
+ * has the same case on disk, so the comparison goes a word at a time
+ * and only folds the bytes of a word that don't match outright.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "codepage.h"
+#include "fs.h"
+
+/*
+ * Fold SRC into DST, which holds SIZE bytes.  Returns the length, or
+ * -1 if it doesn't fit.
+ */
+int fs_fold_name(char *dst, size_t size, const char *src)
+{
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+	dst[i] = codepage.upper[(uint8_t)src[i]];
+	if (!src[i])
+	    return i;
+    }
+
+    return -1;
+}
+
+static inline uint32_t get_word(const char *p)
+{
+    uint32_t w;
+
+    memcpy(&w, p, sizeof w);
+    return w;
+}
+
+/*
+ * Return true if the LEN bytes at NAME, folded, are the LEN bytes at
+ * FOLDED.  Neither needs to be NUL-terminated.
+ */
+bool fs_name_eq_fold(const char *name, const char *folded, size_t len)
+{
+    size_t i;
+
+    while (len >= sizeof(uint32_t)) {
+	if (get_word(name) != get_word(folded)) {
+	    for (i = 0; i < sizeof(uint32_t); i++)
+		if (codepage.upper[(uint8_t)name[i]] != (uint8_t)folded[i])
+		    return false;
+	}
+	name += sizeof(uint32_t);
+	folded += sizeof(uint32_t);
+	len -= sizeof(uint32_t);
+    }
+
+    while (len--) {
+	if (codepage.upper[(uint8_t)*name++] != (uint8_t)*folded++)
+	    return false;
+    }
+
+    return true;
+}
+
+/*
+ * Return true if the LEN UTF-16 units at UNI spell the LEN bytes at
+ * NAME, either exactly or, if NOCASE, in the other case.
+ */
+bool fs_uni_eq(const uint16_t *uni, const char *name, size_t len, bool nocase)
+{
+    uint8_t c;
+
+    while (len--) {
+	c = *name++;
+	if (*uni != codepage.uni[0][c] &&
+	    (!nocase || *uni != codepage.uni[1][c]))
+	    return false;
+	uni++;
+    }
+
+    return true;
+}
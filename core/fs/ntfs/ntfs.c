@@ -17,8 +17,6 @@
  * 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
 */
 
-/* Note: No support for compressed files */
-
 #include <dprintf.h>
 #include <stdio.h>
 #include <string.h>
@@ -28,6 +26,7 @@
 #include <disk.h>
 #include <fs.h>
 #include <ilog2.h>
+#include <minmax.h>
 #include <klibc/compiler.h>
 #include <ctype.h>
 
@@ -180,6 +179,59 @@ out:
     return -1;
 }
 
+/*
+ * Return a copy of MFT record file if it has been looked up before.  The
+ * caller owns (and frees) the copy, as with a record fresh off the disk.
+ */
+static struct ntfs_mft_record *ntfs_mft_cache_get(struct fs_info *fs,
+                                                  uint32_t file)
+{
+    struct ntfs_sb_info *sbi = NTFS_SB(fs);
+    struct ntfs_mft_cache_entry *ce;
+    uint8_t *buf;
+    int i;
+
+    if (!sbi->mft_cache)
+        return NULL;
+
+    for (i = 0; i < NTFS_MFT_CACHE_ENTRIES; i++) {
+        ce = &sbi->mft_cache[i];
+        if (ce->lru && ce->mft_no == file) {
+            buf = malloc(sbi->mft_record_size);
+            if (!buf)
+                malloc_error("uint8_t *");
+            memcpy(buf, ce->rec, sbi->mft_record_size);
+            ce->lru = ++sbi->mft_cache_clock;
+            return (struct ntfs_mft_record *)buf;
+        }
+    }
+
+    return NULL;
+}
+
+/* Remember a freshly read, fixed-up MFT record */
+static void ntfs_mft_cache_put(struct fs_info *fs, uint32_t file,
+                               const struct ntfs_mft_record *mrec)
+{
+    struct ntfs_sb_info *sbi = NTFS_SB(fs);
+    struct ntfs_mft_cache_entry *ce, *victim;
+    int i;
+
+    if (!sbi->mft_cache)
+        return;
+
+    victim = &sbi->mft_cache[0];
+    for (i = 0; i < NTFS_MFT_CACHE_ENTRIES; i++) {
+        ce = &sbi->mft_cache[i];
+        if (ce->lru < victim->lru)
+            victim = ce;
+    }
+
+    memcpy(victim->rec, mrec, sbi->mft_record_size);
+    victim->mft_no = file;
+    victim->lru = ++sbi->mft_cache_clock;
+}
+
 /* AndyAlex: read and validate single MFT record. Keep in mind that MFT itself can be fragmented */
 static struct ntfs_mft_record *ntfs_mft_record_lookup_any(struct fs_info *fs,
                                                 uint32_t file, block_t *out_blk, bool is_v31)
@@ -206,6 +258,13 @@ static struct ntfs_mft_record *ntfs_mft_record_lookup_any(struct fs_info *fs,
     /* determine MFT record's LCN */
     uint64_t vcn = (file << mft_record_shift >> clust_byte_shift);
     dprintf("in %s(%s)\n", __func__,(is_v31?"v3.1":"v3.0"));
+
+    mrec = ntfs_mft_cache_get(fs, file);
+    if (mrec) {
+      if (out_blk)
+        *out_blk = (file << mft_record_shift >> BLOCK_SHIFT(fs));
+      return mrec;
+    }
     if (0==vcn) {
       lcn = NTFS_SB(fs)->mft_lcn;
     } else do {
@@ -268,6 +327,7 @@ static struct ntfs_mft_record *ntfs_mft_record_lookup_any(struct fs_info *fs,
     if (mrec->magic != NTFS_MAGIC_FILE) mrec = NULL;
     if (mrec && is_v31) if (mrec->mft_record_no != file) mrec = NULL;
     if (mrec!=NULL) {
+      ntfs_mft_cache_put(fs, file, mrec);
       if (out_blk) {
         *out_blk = (file << mft_record_shift >> BLOCK_SHIFT(fs));   /* update record starting block */
       }
@@ -296,7 +356,6 @@ static bool ntfs_filename_cmp(const char *dname, struct ntfs_idx_entry *ie)
 {
     const uint16_t *entry_fn;
     uint8_t entry_fn_len;
-    unsigned i;
 
     dprintf("in %s()\n", __func__);
 
@@ -307,17 +366,8 @@ static bool ntfs_filename_cmp(const char *dname, struct ntfs_idx_entry *ie)
         return false;
 
     /* Do case-sensitive compares for Posix file names */
-    if (ie->key.file_name.file_name_type == FILE_NAME_POSIX) {
-        for (i = 0; i < entry_fn_len; i++)
-            if (entry_fn[i] != dname[i])
-                return false;
-    } else {
-        for (i = 0; i < entry_fn_len; i++)
-            if (tolower(entry_fn[i]) != tolower(dname[i]))
-                return false;
-    }
-
-    return true;
+    return fs_uni_eq(entry_fn, dname, entry_fn_len,
+                     ie->key.file_name.file_name_type != FILE_NAME_POSIX);
 }
 
 static inline uint8_t *mapping_chunk_init(struct ntfs_attr_record *attr,
@@ -381,6 +431,12 @@ static int parse_data_run(const void *stream, uint32_t *offset,
     byte = (uint8_t *)buf + v + l;
     count = l;
 
+    /* no LCN bytes at all means a sparse run; the LCN doesn't move */
+    if (!l) {
+        chunk->flags |= MAP_UNALLOCATED;
+        goto done;
+    }
+
     mask = 0xFFFFFFFF;
     res = 0LL;
     if (*byte & 0x80)
@@ -396,6 +452,8 @@ static int parse_data_run(const void *stream, uint32_t *offset,
     else
         chunk->flags |= MAP_ALLOCATED;
 
+done:
+
     *offset += v + l + 1;
 
     return 0;
@@ -404,6 +462,154 @@ out:
     return -1;
 }
 
+/* Append the runs of one extent of a non-resident attribute */
+static int ntfs_decode_runs(struct ntfs_attr_record *attr,
+                            struct runlist *rlist)
+{
+    uint8_t *attr_len = (uint8_t *)attr + attr->len;
+    struct runlist_element run;
+    struct mapping_chunk chunk;
+    uint32_t offset;
+    uint8_t *stream;
+
+    stream = mapping_chunk_init(attr, &chunk, &offset);
+    chunk.vcn = attr->data.non_resident.lowest_vcn;
+    for (;;) {
+        if (parse_data_run(stream, &offset, attr_len, &chunk))
+            return -1;
+        if (chunk.flags & MAP_END)
+            break;
+
+        run.vcn = chunk.vcn;
+        run.len = chunk.len;
+        run.lcn = chunk.flags & MAP_UNALLOCATED ? RUNLIST_LCN_HOLE : chunk.lcn;
+        if (runlist_append(rlist, &run))
+            return -1;
+
+        chunk.vcn += chunk.len;
+    }
+
+    return 0;
+}
+
+/*
+ * Read len bytes of a non-resident attribute's value described by rlist,
+ * from byte start of the value on
+ */
+static int ntfs_read_runs(struct fs_info *fs, const struct runlist *rlist,
+                          uint64_t start, uint8_t *buf, uint32_t len)
+{
+    const uint32_t clust_byte_shift = NTFS_SB(fs)->clust_byte_shift;
+    const uint32_t clust_mask = (1 << clust_byte_shift) - 1;
+    const uint32_t blk_mask = BLOCK_SIZE(fs) - 1;
+    const struct runlist_element *run;
+    const uint8_t *data;
+    uint32_t pos, chunk;
+    uint64_t vcn, byte, at;
+
+    for (pos = 0; pos < len; pos += chunk) {
+        at = start + pos;
+        vcn = at >> clust_byte_shift;
+        run = runlist_find(rlist, vcn);
+        if (!run || run->lcn == RUNLIST_LCN_HOLE)
+            return -1;
+
+        byte = ((run->lcn + (vcn - run->vcn)) << clust_byte_shift) +
+            (at & clust_mask);
+        chunk = min(len - pos, BLOCK_SIZE(fs) - (uint32_t)(byte & blk_mask));
+        chunk = min(chunk, (clust_mask + 1) - (uint32_t)(at & clust_mask));
+
+        data = get_cache(fs->fs_dev, byte >> BLOCK_SHIFT(fs));
+        if (!data)
+            return -1;
+        memcpy(buf + pos, data + (byte & blk_mask), chunk);
+    }
+
+    return 0;
+}
+
+/*
+ * A fragmented attribute can be spread over several MFT records, each
+ * extent holding the runs from its lowest_vcn on.  Decode all of them,
+ * in the order the base record's $ATTRIBUTE_LIST gives them.
+ */
+static int ntfs_decode_attr_list_runs(struct fs_info *fs,
+                                      struct ntfs_mft_record *mrec,
+                                      uint32_t type, struct runlist *rlist)
+{
+    struct ntfs_attr_record *attr, *list_attr = NULL;
+    struct ntfs_attr_list_entry *entry;
+    struct ntfs_mft_record *emrec;
+    struct runlist list_runs = { NULL, 0, 0 };
+    uint8_t *value, *buf = NULL;
+    uint32_t len;
+    int err = -1;
+
+    attr = (struct ntfs_attr_record *)((uint8_t *)mrec + mrec->attrs_offset);
+    for (; attr->type != NTFS_AT_END;
+         attr = (struct ntfs_attr_record *)((uint8_t *)attr + attr->len)) {
+        if (attr->type == NTFS_AT_ATTR_LIST) {
+            list_attr = attr;
+            break;
+        }
+    }
+    if (!list_attr)
+        return -1;
+
+    if (!list_attr->non_resident) {
+        value = (uint8_t *)list_attr + list_attr->data.resident.value_offset;
+        len = list_attr->data.resident.value_len;
+    } else {
+        len = list_attr->data.non_resident.data_size;
+        buf = malloc(len);
+        if (!buf)
+            malloc_error("attribute list");
+        if (ntfs_decode_runs(list_attr, &list_runs) ||
+            ntfs_read_runs(fs, &list_runs, 0, buf, len))
+            goto out;
+        value = buf;
+    }
+
+    runlist_free(rlist);
+    for (entry = (struct ntfs_attr_list_entry *)value;
+         (uint8_t *)entry + sizeof *entry <= value + len && entry->length;
+         entry = (struct ntfs_attr_list_entry *)((uint8_t *)entry +
+                                                 entry->length)) {
+        if (entry->type != type || entry->name_length)
+            continue;
+
+        if ((uint32_t)entry->mft_ref == mrec->mft_record_no) {
+            emrec = mrec;
+        } else {
+            emrec = NTFS_SB(fs)->mft_record_lookup(fs, entry->mft_ref, NULL);
+            if (!emrec)
+                goto out;
+        }
+
+        attr = (struct ntfs_attr_record *)((uint8_t *)emrec +
+                                           emrec->attrs_offset);
+        for (; attr->type != NTFS_AT_END;
+             attr = (struct ntfs_attr_record *)((uint8_t *)attr + attr->len)) {
+            if (attr->type == type && !attr->name_len && attr->non_resident &&
+                attr->data.non_resident.lowest_vcn == entry->lowest_vcn)
+                break;
+        }
+
+        err = attr->type == NTFS_AT_END ? -1 : ntfs_decode_runs(attr, rlist);
+        if (emrec != mrec)
+            free(emrec);
+        if (err)
+            goto out;
+    }
+
+    err = runlist_is_empty(rlist) ? -1 : 0;
+
+out:
+    runlist_free(&list_runs);
+    free(buf);
+    return err;
+}
+
 static struct ntfs_mft_record *
 ntfs_attr_list_lookup(struct fs_info *fs, struct ntfs_attr_record *attr,
                       uint32_t type, struct ntfs_mft_record *mrec)
@@ -614,11 +820,6 @@ static int index_inode_setup(struct fs_info *fs, unsigned long mft_no,
     struct ntfs_mft_record *mrec, *lmrec;
     struct ntfs_attr_record *attr;
     enum dirent_type d_type;
-    uint8_t *attr_len;
-    struct mapping_chunk chunk;
-    int err;
-    uint8_t *stream;
-    uint32_t offset;
 
     dprintf("in %s()\n", __func__);
 
@@ -675,35 +876,39 @@ static int index_inode_setup(struct fs_info *fs, unsigned long mft_no,
                 (uint32_t)((uint8_t *)attr + attr->data.resident.value_offset);
             inode->size = attr->data.resident.value_len;
         } else {
-            attr_len = (uint8_t *)attr + attr->len;
+            struct runlist *rlist = &NTFS_PVT(inode)->data.non_resident.rlist;
+            const uint32_t clust_byte_shift = NTFS_SB(fs)->clust_byte_shift;
 
-            stream = mapping_chunk_init(attr, &chunk, &offset);
-            NTFS_PVT(inode)->data.non_resident.rlist = NULL;
-            for (;;) {
-                err = parse_data_run(stream, &offset, attr_len, &chunk);
-                if (err) {
-                    printf("parse_data_run()\n");
-                    goto out;
-                }
+            if (ntfs_decode_runs(attr, rlist)) {
+                printf("parse_data_run()\n");
+                goto out;
+            }
 
-                if (chunk.flags & MAP_UNALLOCATED)
-                    continue;
-                if (chunk.flags & MAP_END)
-                    break;
-                if (chunk.flags &  MAP_ALLOCATED) {
-                    /* append new run to the runlist */
-                    runlist_append(&NTFS_PVT(inode)->data.non_resident.rlist,
-                                    (struct runlist_element *)&chunk);
-                    /* update for next VCN */
-                    chunk.vcn += chunk.len;
-                }
+            /* the rest of the runs live in other MFT records */
+            if ((int64_t)(attr->data.non_resident.highest_vcn + 1) <<
+                clust_byte_shift < attr->data.non_resident.allocated_size &&
+                ntfs_decode_attr_list_runs(fs, lmrec, NTFS_AT_DATA, rlist)) {
+                printf("Cannot map all of the $DATA extents\n");
+                goto out;
             }
 
-            if (runlist_is_empty(NTFS_PVT(inode)->data.non_resident.rlist)) {
+            if (runlist_is_empty(rlist)) {
                 printf("No mapping found\n");
                 goto out;
             }
 
+            /* LZNT1 is only used with clusters of up to 4K */
+            if (attr->flags & ATTR_COMPRESSION_MASK) {
+                if (!(attr->flags & ATTR_IS_COMPRESSED) ||
+                    !attr->data.non_resident.compression_unit ||
+                    clust_byte_shift > 12) {
+                    printf("Unsupported compressed file\n");
+                    goto out;
+                }
+                NTFS_PVT(inode)->cu_shift = clust_byte_shift +
+                    attr->data.non_resident.compression_unit;
+            }
+
             inode->size = attr->data.non_resident.initialized_size;
         }
     }
@@ -915,8 +1120,9 @@ static int ntfs_next_extent(struct inode *inode, uint32_t lstart)
     struct fs_info *fs = inode->fs;
     struct ntfs_sb_info *sbi = NTFS_SB(fs);
     sector_t pstart = 0;
-    struct runlist *rlist;
-    struct runlist *ret;
+    const struct runlist_element *run;
+    uint64_t vcn;
+    uint32_t delta;
     const uint32_t sec_size = SECTOR_SIZE(fs);
     const uint32_t sec_shift = SECTOR_SHIFT(fs);
 
@@ -927,35 +1133,220 @@ static int ntfs_next_extent(struct inode *inode, uint32_t lstart)
                 sec_shift;
         inode->next_extent.len = (inode->size + sec_size - 1) >> sec_shift;
     } else {
-        rlist = NTFS_PVT(inode)->data.non_resident.rlist;
+        vcn = (uint64_t)lstart << sec_shift >> sbi->clust_byte_shift;
+        run = runlist_find(&NTFS_PVT(inode)->data.non_resident.rlist, vcn);
+        if (!run)
+            goto out;
 
-        if (!lstart || lstart >= NTFS_PVT(inode)->here) {
-            if (runlist_is_empty(rlist))
-                goto out;   /* nothing to do ;-) */
+        delta = lstart - (run->vcn << sbi->clust_byte_shift >> sec_shift);
+        if (run->lcn == RUNLIST_LCN_HOLE)
+            pstart = EXTENT_ZERO;
+        else
+            pstart = (run->lcn << sbi->clust_shift) + delta;
+        inode->next_extent.len =
+            (run->len << sbi->clust_byte_shift >> sec_shift) - delta;
+    }
 
-            ret = runlist_remove(&rlist);
+    inode->next_extent.pstart = pstart;
 
-            NTFS_PVT(inode)->here =
-                ((ret->run.len << sbi->clust_byte_shift) >> sec_shift);
+    return 0;
 
-            pstart = ret->run.lcn << sbi->clust_shift;
-            inode->next_extent.len =
-                ((ret->run.len << sbi->clust_byte_shift) + sec_size - 1) >>
-                sec_shift;
+out:
+    return -1;
+}
+
+/*
+ * Uncompress the LZNT1 data of one compression unit: a run of chunks,
+ * each starting with a 16-bit header holding its stored length less 3
+ * and, in bit 15, whether it is compressed.  Each chunk expands to
+ * NTFS_LZNT1_CHUNK_SIZE bytes; a short one is padded with zeroes.
+ * Returns the number of bytes produced, or -1.
+ */
+static int ntfs_lznt1_decompress(const uint8_t *src, uint32_t srclen,
+                                 uint8_t *dst, uint32_t dstlen)
+{
+    const uint8_t *send = src + srclen;
+    const uint8_t *cend;
+    uint8_t *d = dst;
+    uint8_t *dend = dst + dstlen;
+    uint8_t *chunk;
+    uint32_t len, off, lbits;
+    uint16_t hdr, token;
+    uint8_t flags;
+    int i;
+
+    while (send - src >= 2) {
+        hdr = src[0] | (src[1] << 8);
+        if (!hdr)
+            break;          /* end of the unit's data */
+        src += 2;
+
+        len = (hdr & 0x0FFF) + 1;
+        if (len > (uint32_t)(send - src) || d >= dend)
+            return -1;
+        cend = src + len;
+        chunk = d;
+
+        if (!(hdr & 0x8000)) {
+            /* stored as it is */
+            if (len > (uint32_t)(dend - d))
+                return -1;
+            memcpy(d, src, len);
+            d += len;
+            src = cend;
+            continue;
+        }
+
+        while (src < cend) {
+            flags = *src++;
+            for (i = 0; i < 8 && src < cend; i++, flags >>= 1) {
+                if (!(flags & 1)) {
+                    if (d >= dend)
+                        return -1;
+                    *d++ = *src++;
+                    continue;
+                }
+
+                /* back-reference: the further into the chunk, the more
+                 * bits of the token go to the offset */
+                if (cend - src < 2 || d == chunk)
+                    return -1;
+                token = src[0] | (src[1] << 8);
+                src += 2;
+                for (lbits = 12, off = d - chunk - 1; off >= 0x10; off >>= 1)
+                    lbits--;
+                off = (token >> lbits) + 1;
+                len = (token & ((1 << lbits) - 1)) + 3;
+                if (off > (uint32_t)(d - chunk) || len > (uint32_t)(dend - d))
+                    return -1;
+                while (len--) {
+                    *d = d[-(int)off];
+                    d++;
+                }
+            }
+        }
+
+        len = min((uint32_t)(dend - chunk), (uint32_t)NTFS_LZNT1_CHUNK_SIZE);
+        if ((uint32_t)(d - chunk) < len) {
+            memset(d, 0, chunk + len - d);
+            d = chunk + len;
+        }
+    }
+
+    return d - dst;
+}
 
-            NTFS_PVT(inode)->data.non_resident.rlist = rlist;
+/*
+ * Bring compression unit unit of a compressed file into cu_buf.  A unit
+ * whose clusters are all allocated is stored as it is; one with none
+ * is all zeroes; otherwise its LZNT1 data is in the clusters before the
+ * first hole.
+ */
+static int ntfs_read_cunit(struct inode *inode, uint64_t unit)
+{
+    struct fs_info *fs = inode->fs;
+    struct ntfs_inode *pvt = NTFS_PVT(inode);
+    const struct runlist *rlist = &pvt->data.non_resident.rlist;
+    const uint32_t clust_byte_shift = NTFS_SB(fs)->clust_byte_shift;
+    const uint32_t unit_size = 1 << pvt->cu_shift;
+    const uint32_t nclust = unit_size >> clust_byte_shift;
+    const struct runlist_element *run;
+    uint64_t vcn = unit << (pvt->cu_shift - clust_byte_shift);
+    bool hole = false;
+    uint32_t n = 0;
+    uint8_t *raw;
+    int ret;
+
+    pvt->cu_unit = 0;
+    if (!pvt->cu_buf) {
+        pvt->cu_buf = malloc(unit_size);
+        if (!pvt->cu_buf)
+            malloc_error("compression unit buffer");
+    }
 
-            free(ret);
-            ret = NULL;
+    while (n < nclust) {
+        run = runlist_find(rlist, vcn + n);
+        if (!run)
+            break;
+        if (run->lcn == RUNLIST_LCN_HOLE) {
+            hole = true;
+            break;
         }
+        n += min(run->vcn + run->len - (vcn + n), (uint64_t)(nclust - n));
     }
 
-    inode->next_extent.pstart = pstart;
+    dprintf("ntfs: unit %llu, %u of %u clusters%s\n",
+            (unsigned long long)unit, n, nclust,
+            hole ? " (compressed)" : "");
+
+    if (!n) {
+        memset(pvt->cu_buf, 0, unit_size);
+    } else if (!hole) {
+        if (ntfs_read_runs(fs, rlist, vcn << clust_byte_shift, pvt->cu_buf,
+                           n << clust_byte_shift))
+            return -1;
+        memset(pvt->cu_buf + (n << clust_byte_shift), 0,
+               unit_size - (n << clust_byte_shift));
+    } else {
+        raw = malloc(n << clust_byte_shift);
+        if (!raw)
+            malloc_error("compressed data buffer");
+        ret = ntfs_read_runs(fs, rlist, vcn << clust_byte_shift, raw,
+                             n << clust_byte_shift);
+        if (!ret)
+            ret = ntfs_lznt1_decompress(raw, n << clust_byte_shift,
+                                        pvt->cu_buf, unit_size);
+        free(raw);
+        if (ret < 0) {
+            printf("Corrupt compressed data in unit %llu\n",
+                   (unsigned long long)unit);
+            return -1;
+        }
+        memset(pvt->cu_buf + ret, 0, unit_size - ret);
+    }
 
+    pvt->cu_unit = unit + 1;
     return 0;
+}
 
-out:
-    return -1;
+/*
+ * generic_getfssec() would hand back the compressed data; copy it out of
+ * one uncompressed compression unit at a time instead.
+ */
+static uint32_t ntfs_getfssec_compressed(struct file *file, char *buf,
+                                         int sectors, bool *have_more)
+{
+    struct inode *inode = file->inode;
+    struct ntfs_inode *pvt = NTFS_PVT(inode);
+    const uint32_t sec_shift = SECTOR_SHIFT(file->fs);
+    const uint32_t sec_size = SECTOR_SIZE(file->fs);
+    const uint32_t unit_mask = (1 << pvt->cu_shift) - 1;
+    uint32_t total = 0;
+    uint32_t off, ret;
+    uint64_t unit;
+    bool more = file->offset < inode->size;
+
+    while (sectors > 0 && more) {
+        unit = file->offset >> pvt->cu_shift;
+        if (pvt->cu_unit != unit + 1 && ntfs_read_cunit(inode, unit)) {
+            more = false;   /* as for an I/O error */
+            break;
+        }
+
+        off = file->offset & unit_mask;
+        ret = min(unit_mask + 1 - off, (uint32_t)(inode->size - file->offset));
+        ret = min(ret, (uint32_t)sectors << sec_shift);
+        memcpy(buf, pvt->cu_buf + off, ret);
+
+        file->offset += ret;
+        more = file->offset < inode->size;
+        total += ret;
+        buf += ret;
+        sectors -= (ret + sec_size - 1) >> sec_shift;
+    }
+
+    *have_more = more;
+    return total;
 }
 
 static uint32_t ntfs_getfssec(struct file *file, char *buf, int sectors,
@@ -973,6 +1364,9 @@ static uint32_t ntfs_getfssec(struct file *file, char *buf, int sectors,
 
     non_resident = NTFS_PVT(inode)->non_resident;
 
+    if (NTFS_PVT(inode)->cu_shift)
+        return ntfs_getfssec_compressed(file, buf, sectors, have_more);
+
     ret = generic_getfssec(file, buf, sectors, have_more);
     if (!ret)
         return ret;
@@ -1010,6 +1404,13 @@ out:
     return 0;
 }
 
+static void ntfs_free_inode(struct inode *inode)
+{
+    if (NTFS_PVT(inode)->non_resident)
+        runlist_free(&NTFS_PVT(inode)->data.non_resident.rlist);
+    free(NTFS_PVT(inode)->cu_buf);
+}
+
 static inline bool is_filename_printable(const char *s)
 {
     return s && (*s != '.' && *s != '$');
@@ -1295,6 +1696,8 @@ static int ntfs_fs_init(struct fs_info *fs)
     struct ntfs_sb_info *sbi;
     struct disk *disk = fs->fs_dev->disk;
     uint8_t mft_record_shift;
+    uint8_t *mft_cache_buf;
+    int i;
 
     dprintf("in %s()\n", __func__);
 
@@ -1331,6 +1734,20 @@ static int ntfs_fs_init(struct fs_info *fs)
     sbi->mft_record_size        = 1 << mft_record_shift;
     sbi->clust_per_idx_record   = ntfs.clust_per_idx_record;
 
+    /* Without memory for it, go without the MFT record cache */
+    sbi->mft_cache_clock = 0;
+    sbi->mft_cache = zalloc(NTFS_MFT_CACHE_ENTRIES *
+                            sizeof(struct ntfs_mft_cache_entry));
+    mft_cache_buf = malloc(NTFS_MFT_CACHE_ENTRIES << mft_record_shift);
+    if (sbi->mft_cache && mft_cache_buf) {
+        for (i = 0; i < NTFS_MFT_CACHE_ENTRIES; i++)
+            sbi->mft_cache[i].rec = mft_cache_buf + (i << mft_record_shift);
+    } else {
+        free(sbi->mft_cache);
+        free(mft_cache_buf);
+        sbi->mft_cache = NULL;
+    }
+
     BLOCK_SHIFT(fs) = ilog2(ntfs.clust_per_idx_record) + sbi->clust_byte_shift;
     BLOCK_SIZE(fs) = 1 << BLOCK_SHIFT(fs);
 
@@ -1372,5 +1789,6 @@ const struct fs_ops ntfs_fs_ops = {
     .iget_root      = ntfs_iget_root,
     .iget           = ntfs_iget,
     .next_extent    = ntfs_next_extent,
+    .free_inode     = ntfs_free_inode,
     .fs_uuid        = NULL,
 };
@@ -55,6 +55,15 @@ struct ntfs_mft_record;
 typedef struct ntfs_mft_record *f_mft_record_lookup(struct fs_info *,
                                                     uint32_t, block_t *);
 
+/* A fixed-up MFT record kept by ntfs_mft_record_lookup_any() */
+#define NTFS_MFT_CACHE_ENTRIES  32
+
+struct ntfs_mft_cache_entry {
+    uint32_t mft_no;
+    uint32_t lru;                   /* 0 = unused */
+    uint8_t *rec;                   /* mft_record_size bytes */
+};
+
 struct ntfs_sb_info {
     block_t mft_blk;                /* The first MFT record block */
     uint64_t mft_lcn;               /* LCN of the first MFT record */
@@ -75,6 +84,9 @@ struct ntfs_sb_info {
 
     /* NTFS-version-dependent MFT record lookup function to use */
     f_mft_record_lookup *mft_record_lookup;
+
+    struct ntfs_mft_cache_entry *mft_cache; /* NULL if none */
+    uint32_t mft_cache_clock;
 } __attribute__((__packed__));
 
 /* The NTFS in-memory inode structure */
@@ -90,13 +102,17 @@ struct ntfs_inode {
             uint32_t offset;    /* Data offset */
         } resident;
         struct {            /* Used only if non_resident is set */
-            struct runlist *rlist;
+            struct runlist rlist;   /* Decoded, all extents */
         } non_resident;
     } data;
     uint32_t start_cluster; /* Starting cluster address */
     sector_t start;         /* Starting sector */
     sector_t offset;        /* Current sector offset */
     sector_t here;          /* Sector corresponding to offset */
+    uint8_t cu_shift;       /* log2 bytes per compression unit, 0 if the
+                             * $DATA attribute isn't compressed */
+    uint8_t *cu_buf;        /* One compression unit, uncompressed */
+    uint64_t cu_unit;       /* Which unit is in cu_buf, + 1 */
 };
 
 /* This is structure is used to keep a state for ntfs_readdir() callers.
@@ -270,6 +286,17 @@ enum {
     ATTR_DEF_ALWAYS_LOG         = 0x80,
 };
 
+/* Attribute record flags */
+enum {
+    ATTR_IS_COMPRESSED          = 0x0001,
+    ATTR_COMPRESSION_MASK       = 0x00FF,
+    ATTR_IS_ENCRYPTED           = 0x4000,
+    ATTR_IS_SPARSE              = 0x8000,
+};
+
+/* LZNT1 compresses in chunks of this many bytes */
+#define NTFS_LZNT1_CHUNK_SIZE   4096
+
 struct ntfs_attr_record {
     uint32_t type;      /* Attr. type code */
     uint32_t len;
@@ -20,64 +20,92 @@
 #ifndef _RUNLIST_H_
 #define _RUNLIST_H_
 
+#include <stdbool.h>
+#include <stdint.h>
+
+/* lcn of a run that isn't backed by clusters (sparse) */
+#define RUNLIST_LCN_HOLE    (-1LL)
+
 struct runlist_element {
     uint64_t vcn;
     int64_t lcn;
     uint64_t len;
 };
 
+/* Decoded mapping pairs of an attribute, sorted by VCN */
 struct runlist {
-    struct runlist_element run;
-    struct runlist *next;
+    struct runlist_element *runs;
+    uint32_t count;
+    uint32_t max;
 };
 
-static struct runlist *tail;
-
-static inline bool runlist_is_empty(struct runlist *rlist)
+static inline bool runlist_is_empty(const struct runlist *rlist)
 {
-    return !rlist;
+    return !rlist->count;
 }
 
-static inline struct runlist *runlist_alloc(void)
+static inline void runlist_free(struct runlist *rlist)
 {
-    struct runlist *rlist;
-
-    rlist = malloc(sizeof *rlist);
-    if (!rlist)
-        malloc_error("runlist structure");
-
-    rlist->next = NULL;
-
-    return rlist;
+    free(rlist->runs);
+    rlist->runs = NULL;
+    rlist->count = rlist->max = 0;
 }
 
-static inline void runlist_append(struct runlist **rlist,
-                                struct runlist_element *elem)
+/* Runs must be appended in VCN order; returns -1 if one isn't */
+static inline int runlist_append(struct runlist *rlist,
+                                 const struct runlist_element *elem)
 {
-    struct runlist *n = runlist_alloc();
-
-    n->run = *elem;
+    struct runlist_element *last, *runs;
+
+    if (!elem->len)
+        return 0;
+
+    if (rlist->count) {
+        last = &rlist->runs[rlist->count - 1];
+        if (elem->vcn < last->vcn + last->len)
+            return -1;
+
+        /* Merge physically contiguous runs */
+        if (elem->vcn == last->vcn + last->len &&
+            ((elem->lcn == RUNLIST_LCN_HOLE && last->lcn == RUNLIST_LCN_HOLE) ||
+             (elem->lcn != RUNLIST_LCN_HOLE && last->lcn != RUNLIST_LCN_HOLE &&
+              elem->lcn == last->lcn + (int64_t)last->len))) {
+            last->len += elem->len;
+            return 0;
+        }
+    }
 
-    if (runlist_is_empty(*rlist)) {
-        *rlist = n;
-        tail = n;
-    } else {
-        tail->next = n;
-        tail = n;
+    if (rlist->count == rlist->max) {
+        rlist->max = rlist->max ? rlist->max << 1 : 16;
+        runs = realloc(rlist->runs, rlist->max * sizeof *runs);
+        if (!runs)
+            malloc_error("runlist array");
+        rlist->runs = runs;
     }
-}
 
-static inline struct runlist *runlist_remove(struct runlist **rlist)
-{
-    struct runlist *ret;
+    rlist->runs[rlist->count++] = *elem;
 
-    if (runlist_is_empty(*rlist))
-        return NULL;
+    return 0;
+}
 
-    ret = *rlist;
-    *rlist = ret->next;
+/* Return the run holding vcn, or NULL if it is past the end of the list */
+static inline const struct runlist_element *
+runlist_find(const struct runlist *rlist, uint64_t vcn)
+{
+    uint32_t lo = 0, hi = rlist->count;
+    uint32_t mid;
+
+    while (lo < hi) {
+        mid = (lo + hi) >> 1;
+        if (vcn < rlist->runs[mid].vcn)
+            hi = mid;
+        else if (vcn >= rlist->runs[mid].vcn + rlist->runs[mid].len)
+            lo = mid + 1;
+        else
+            return &rlist->runs[mid];
+    }
 
-    return ret;
+    return NULL;
 }
 
 #endif /* _RUNLIST_H_ */
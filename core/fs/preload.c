@@ -0,0 +1,305 @@
+/*
+ * preload.c
+ *
+ * Files the installer has mapped for us.  extlinux records in
+ * ldlinux.sys where on the disk ldlinux.c32 is, with its size and a
+ * checksum, so opening it doesn't need a walk through the directories.
+ *
+ * The first open reads the whole file and checks it against the
+ * checksum; if it doesn't match, because the file has been replaced
+ * or moved since it was installed, the entry is dropped and the file
+ * is looked up in the filesystem as usual.  A file that has passed
+ * is read straight from its extents when it is opened again.
+ */
+
+#include <dprintf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <minmax.h>
+#include "core.h"
+#include "disk.h"
+#include "fs.h"
+
+/*
+ * The map, at PreloadMap in ldlinux.sys; libinstaller/syslxint.h has
+ * the same layout.  Extents are in 512-byte sectors from the start of
+ * the partition, and each file's extents cover it in order.
+ */
+#define PRELOAD_MAGIC		0x4c455250	/* "PREL" */
+#define PRELOAD_MAP_SIZE	512		/* PRELOAD_MAX in diskstart.inc */
+#define PRELOAD_SECTOR_SHIFT	9
+#define PRELOAD_FILES		2
+#define PRELOAD_NAME_MAX	16
+
+struct preload_extent {
+    uint64_t lba;
+    uint32_t len;
+} __attribute__((packed));
+
+struct preload_file {
+    char name[PRELOAD_NAME_MAX];	/* In the install directory */
+    uint32_t size;
+    uint32_t csum;			/* preload_csum() of the contents */
+    uint16_t ext;			/* First extent */
+    uint16_t next;			/* Number of extents */
+} __attribute__((packed));
+
+struct preload_map {
+    uint32_t magic;
+    uint16_t nfiles;
+    uint16_t nextents;
+    struct preload_file file[PRELOAD_FILES];
+    struct preload_extent ext[];
+} __attribute__((packed));
+
+#define PRELOAD_EXTENTS \
+    ((PRELOAD_MAP_SIZE - sizeof(struct preload_map)) / \
+     sizeof(struct preload_extent))
+
+/* Per-file state: 0 = not checked yet */
+#define PRELOAD_GOOD	1
+#define PRELOAD_BAD	2
+
+static uint8_t preload_state[PRELOAD_FILES];
+
+struct preload_pvt {
+    const struct preload_file *pf;
+    char *data;			/* The contents, on the first open only */
+};
+
+#define PRELOAD_PVT(i) ((struct preload_pvt *)((i)->pvt))
+
+static struct fs_info preload_fs;
+
+/* FNV-1a */
+static uint32_t preload_csum(const void *data, uint32_t len)
+{
+    const uint8_t *p = data;
+    uint32_t h = 2166136261U;
+
+    while (len--) {
+	h ^= *p++;
+	h *= 16777619;
+    }
+
+    return h;
+}
+
+static const struct preload_map *preload_map(void)
+{
+    const struct preload_map *map = (const struct preload_map *)PreloadMap;
+    struct disk *disk;
+
+    if (!PreloadMap || map->magic != PRELOAD_MAGIC ||
+	map->nfiles > PRELOAD_FILES || map->nextents > PRELOAD_EXTENTS)
+	return NULL;
+
+    /* The map doesn't mean anything on another kind of disk */
+    if (!this_fs->fs_dev || this_fs->fs_ops->fs_flags & FS_NODEV)
+	return NULL;
+    disk = this_fs->fs_dev->disk;
+    if (disk->sector_shift != PRELOAD_SECTOR_SHIFT ||
+	SECTOR_SHIFT(this_fs) != PRELOAD_SECTOR_SHIFT)
+	return NULL;
+
+    return map;
+}
+
+/* Compare two paths, taking a run of slashes as one */
+static bool preload_path_eq(const char *a, const char *b)
+{
+    for (;;) {
+	if (*a == '/' && *b == '/') {
+	    while (*a == '/')
+		a++;
+	    while (*b == '/')
+		b++;
+	    continue;
+	}
+	if (*a != *b)
+	    return false;
+	if (!*a)
+	    return true;
+	a++;
+	b++;
+    }
+}
+
+/*
+ * Does NAME, as searchdir() would resolve it, name FILE in the
+ * install directory?
+ */
+static bool preload_match(const char *name, const char *file)
+{
+    char want[FILENAME_MAX], got[FILENAME_MAX];
+
+    if (!memchr(file, '\0', PRELOAD_NAME_MAX) || !*file)
+	return false;
+
+    if (snprintf(want, sizeof want, "%s/%s", CurrentDirName, file)
+	>= (int)sizeof want)
+	return false;
+    if (snprintf(got, sizeof got, "%s%s",
+		 name[0] == '/' ? "" : this_fs->cwd_name, name)
+	>= (int)sizeof got)
+	return false;
+
+    return preload_path_eq(want, got);
+}
+
+/*
+ * Read the file PF describes into a new buffer, and check it.
+ */
+static char *preload_read(const struct preload_map *map,
+			  const struct preload_file *pf)
+{
+    struct disk *disk = this_fs->fs_dev->disk;
+    const struct preload_extent *ex = &map->ext[pf->ext];
+    uint32_t left = (pf->size + (1 << PRELOAD_SECTOR_SHIFT) - 1)
+	>> PRELOAD_SECTOR_SHIFT;
+    uint32_t n;
+    char *data, *p;
+    int i;
+
+    data = p = malloc(left << PRELOAD_SECTOR_SHIFT);
+    if (!data)
+	return NULL;
+
+    for (i = 0; i < pf->next && left; i++, ex++) {
+	n = min(ex->len, left);
+	disk_io_source = DISK_IO_GETFSSEC;
+	if (disk->rdwr_sectors(disk, p, ex->lba, n, 0) != (int)n)
+	    goto bad;
+	p += n << PRELOAD_SECTOR_SHIFT;
+	left -= n;
+    }
+
+    if (left || preload_csum(data, pf->size) != pf->csum)
+	goto bad;
+
+    return data;
+
+bad:
+    free(data);
+    return NULL;
+}
+
+static uint32_t preload_getfssec(struct file *file, char *buf,
+				 int sectors, bool *have_more)
+{
+    struct inode *inode = file->inode;
+    const char *data = PRELOAD_PVT(inode)->data;
+    uint32_t bytes;
+
+    if (!data)
+	return generic_getfssec(file, buf, sectors, have_more);
+
+    bytes = min((uint32_t)sectors << PRELOAD_SECTOR_SHIFT,
+		(uint32_t)inode->size - file->offset);
+    memcpy(buf, data + file->offset, bytes);
+    file->offset += bytes;
+    *have_more = file->offset < inode->size;
+
+    return bytes;
+}
+
+static int preload_next_extent(struct inode *inode, uint32_t lstart)
+{
+    const struct preload_map *map = (const struct preload_map *)PreloadMap;
+    const struct preload_file *pf = PRELOAD_PVT(inode)->pf;
+    const struct preload_extent *ex = &map->ext[pf->ext];
+    uint32_t skip = lstart;
+    int i;
+
+    for (i = 0; i < pf->next; i++, ex++) {
+	if (skip < ex->len) {
+	    inode->next_extent.pstart = ex->lba + skip;
+	    inode->next_extent.len = ex->len - skip;
+	    return 0;
+	}
+	skip -= ex->len;
+    }
+
+    return -1;
+}
+
+static void preload_free_inode(struct inode *inode)
+{
+    free(PRELOAD_PVT(inode)->data);
+}
+
+static const struct fs_ops preload_fs_ops = {
+    .fs_name       = "preload",
+    .fs_flags      = 0,
+    .getfssec      = preload_getfssec,
+    .close_file    = generic_close_file,
+    .next_extent   = preload_next_extent,
+    .free_inode    = preload_free_inode,
+};
+
+/*
+ * Open NAME from the map, if it is there; returns 0 if it is, with
+ * FILE set up to read it.
+ */
+int preload_open(const char *name, int flags, struct file *file)
+{
+    const struct preload_map *map;
+    const struct preload_file *pf;
+    struct inode *inode;
+    char *data = NULL;
+    int i;
+
+    if (flags & O_DIRECTORY)
+	return -1;
+
+    map = preload_map();
+    if (!map)
+	return -1;
+
+    for (i = 0, pf = map->file; i < map->nfiles; i++, pf++) {
+	if (preload_state[i] != PRELOAD_BAD &&
+	    preload_match(name, pf->name))
+	    break;
+    }
+    if (i >= map->nfiles)
+	return -1;
+
+    if (!pf->next || pf->ext + pf->next > map->nextents) {
+	preload_state[i] = PRELOAD_BAD;
+	return -1;
+    }
+
+    if (preload_state[i] != PRELOAD_GOOD) {
+	data = preload_read(map, pf);
+	if (!data) {
+	    dprintf("preload: %s doesn't match, looking it up\n", name);
+	    preload_state[i] = PRELOAD_BAD;
+	    return -1;
+	}
+	preload_state[i] = PRELOAD_GOOD;
+    }
+
+    if (!preload_fs.fs_ops) {
+	preload_fs = *this_fs;
+	preload_fs.fs_ops = &preload_fs_ops;
+    }
+
+    inode = alloc_inode(&preload_fs, 0, sizeof(struct preload_pvt));
+    if (!inode) {
+	free(data);
+	return -1;
+    }
+    inode->mode = DT_REG;
+    inode->size = pf->size;
+    PRELOAD_PVT(inode)->pf = pf;
+    PRELOAD_PVT(inode)->data = data;
+
+    dprintf("preload: %s from the map%s\n", name, data ? ", checked" : "");
+
+    file->fs     = &preload_fs;
+    file->inode  = inode;
+    file->offset = 0;
+    return 0;
+}
@@ -2,8 +2,13 @@
 #include <lwip/api.h>
 #include <lwip/tcpip.h>
 #include <lwip/dns.h>
+#include <lwip/stats.h>
+#include <lwip/memp.h>
+#include <lwip/netif.h>
+#include <netif/etharp.h>
 #include <core.h>
 #include <net.h>
+#include <syslinux/trace.h>
 #include "pxe.h"
 
 #include <dprintf.h>
@@ -56,6 +61,58 @@ void core_udp_close(struct pxe_pvt_inode *socket)
     }
 }
 
+/**
+ * Open a socket receiving what is sent to a multicast group
+ *
+ * @param:socket, the socket to open
+ * @param:group, the group address
+ * @param:port, the port number, host-byte order
+ *
+ * @out: error code, 0 on success, -1 on failure
+ */
+int core_udp_join(struct pxe_pvt_inode *socket, uint32_t group,
+		  uint16_t port)
+{
+    struct net_private_lwip *priv = &socket->net.lwip;
+    struct ip_addr addr;
+    int err;
+
+    priv->conn = netconn_new(NETCONN_UDP);
+    if (!priv->conn)
+	return -1;
+
+    priv->conn->recv_timeout = 15; /* A 15 ms recv timeout... */
+    addr.addr = group;
+    err = netconn_bind(priv->conn, NULL, port);
+    if (!err)
+	err = netconn_join_leave_group(priv->conn, &addr, NULL, NETCONN_JOIN);
+    if (err) {
+	ddprintf("core_udp_join error %d\n", err);
+	core_udp_close(socket);
+	return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Leave the multicast group and close the socket
+ *
+ * @param:socket, the socket opened by core_udp_join()
+ * @param:group, the group address
+ */
+void core_udp_leave(struct pxe_pvt_inode *socket, uint32_t group)
+{
+    struct net_private_lwip *priv = &socket->net.lwip;
+    struct ip_addr addr;
+
+    if (priv->conn) {
+	addr.addr = group;
+	netconn_join_leave_group(priv->conn, &addr, NULL, NETCONN_LEAVE);
+    }
+    core_udp_close(socket);
+}
+
 /**
  * Establish a connection on an open socket
  *
@@ -97,6 +154,27 @@ void core_udp_disconnect(struct pxe_pvt_inode *socket)
  */
 int core_udp_recv(struct pxe_pvt_inode *socket, void *buf, uint16_t *buf_len,
 		  uint32_t *src_ip, uint16_t *src_port)
+{
+    return core_udp_recv_split(socket, NULL, 0, buf, buf_len,
+			       src_ip, src_port);
+}
+
+/**
+ * Read a UDP packet, the first hdr_len bytes into hdr and the rest
+ * into buf.  Packets shorter than hdr_len are dropped.
+ *
+ * @param:socket, the open socket
+ * @param:hdr, buffer for the start of the packet
+ * @param:hdr_len, how much of the packet goes there
+ * @param:buf, buffer for the rest of the packet
+ * @param:buf_len, size of buf; on return, bytes stored there
+ * @param:src_ip, ip address of the data source
+ * @param:src_port, port number of the data source, host-byte order
+ */
+int core_udp_recv_split(struct pxe_pvt_inode *socket,
+			void *hdr, uint16_t hdr_len,
+			void *buf, uint16_t *buf_len,
+			uint32_t *src_ip, uint16_t *src_port)
 {
     struct net_private_lwip *priv = &socket->net.lwip;
     struct netbuf *nbuf;
@@ -115,10 +193,18 @@ int core_udp_recv(struct pxe_pvt_inode *socket, void *buf, uint16_t *buf_len,
 
     netbuf_first(nbuf);		/* XXX needed? */
     nbuf_len = netbuf_len(nbuf);
-    if (nbuf_len <= *buf_len)
-	netbuf_copy(nbuf, buf, nbuf_len);
-    else
+    if (nbuf_len < hdr_len) {
+	netbuf_delete(nbuf);
+	return -1;
+    }
+    nbuf_len -= hdr_len;
+    if (nbuf_len <= *buf_len) {
+	if (hdr_len)
+	    netbuf_copy(nbuf, hdr, hdr_len);
+	netbuf_copy_partial(nbuf, buf, nbuf_len, hdr_len);
+    } else {
 	nbuf_len = 0; /* impossible mtu < PKTBUF_SIZE */
+    }
     netbuf_delete(nbuf);
 
     *buf_len = nbuf_len;
@@ -234,6 +320,86 @@ void net_core_init(void)
     }
 }
 
+unsigned int net_core_mtu(void)
+{
+    return pxe_undi_info.MaxTranUnit;
+}
+
+/* The pools as com32_net_pool */
+static const memp_t net_core_pools[COM32_NET_POOLS] = {
+    [COM32_NET_PBUF]	= MEMP_PBUF_POOL,
+    [COM32_NET_TCP_SEG]	= MEMP_TCP_SEG,
+    [COM32_NET_NETBUF]	= MEMP_NETBUF,
+};
+
+void net_core_stats(struct com32_net_stats *st)
+{
+    const struct stats_mem *m;
+    int i;
+
+    st->rx_packets  = lwip_stats.link.recv;
+    st->tx_packets  = lwip_stats.link.xmit;
+    st->tcp_rexmits = lwip_stats.tcp_xfer.rexmit;
+    st->tcp_dupsegs = lwip_stats.tcp_xfer.dupseg;
+    st->tcp_stalls  = lwip_stats.tcp_xfer.zerownd;
+
+    for (i = 0; i < COM32_NET_POOLS; i++) {
+	m = &lwip_stats.memp[net_core_pools[i]];
+	st->pool[i].avail = m->avail;
+	st->pool[i].used  = m->used;
+	st->pool[i].max   = m->max;
+	st->pool[i].err   = m->err;
+    }
+}
+
+bool net_core_arp_lookup(uint32_t ip, uint8_t *mac)
+{
+    struct eth_addr *eth;
+    ip_addr_t *ipp;
+
+    if (!netif_default ||
+	etharp_find_addr(netif_default, (ip_addr_t *)&ip, &eth, &ipp) < 0)
+	return false;
+
+    memcpy(mac, eth->addr, ETHARP_HWADDR_LEN);
+    return true;
+}
+
+void net_core_arp_add(uint32_t ip, const uint8_t *mac)
+{
+    struct eth_addr eth;
+
+    if (!netif_default)
+	return;
+
+    memcpy(eth.addr, mac, ETHARP_HWADDR_LEN);
+    etharp_add_entry(netif_default, (ip_addr_t *)&ip, &eth);
+}
+
+static void net_core_arp_query(void *arg)
+{
+    ip_addr_t ip;
+
+    ip.addr = (uintptr_t)arg;
+    etharp_query(netif_default, &ip, NULL);
+}
+
+/*
+ * The cached DHCP packets are only the BOOTP part, so the addresses
+ * of the hosts we'll talk to aren't in them: ask, and let the replies
+ * come in while the config file and modules are looked for.  The
+ * table then stays fresh from the traffic itself (ETHARP_TRUST_IP_MAC).
+ */
+void net_core_arp_prime(uint32_t ip)
+{
+    if (!netif_default || !(netif_default->flags & NETIF_FLAG_ETHARP))
+	return;
+    if (!ip || ip == IPInfo.myip || gateway(ip))
+	return;			/* Not a neighbour */
+
+    tcpip_callback_with_block(net_core_arp_query, (void *)(uintptr_t)ip, 1);
+}
+
 void probe_undi(void)
 {
     /* Probe UNDI information */
@@ -327,6 +493,7 @@ void core_tcp_fill_buffer(struct inode *inode)
 	    socket->tftp_goteof = 1;
 	    if (inode->size == -1)
 		inode->size = socket->tftp_filepos;
+	    trace(TRACE_NET, "tcp_eof", socket->tftp_filepos, -err);
 	    socket->ops->close(inode);
 	    return;
 	}
@@ -340,5 +507,6 @@ void core_tcp_fill_buffer(struct inode *inode)
     socket->tftp_dataptr = data;
     socket->tftp_filepos += len;
     socket->tftp_bytesleft = len;
+    trace(TRACE_NET, "tcp_fill", socket->tftp_filepos, len);
     return;
 }
@@ -4,6 +4,7 @@
 #include <sys/cpu.h>
 #include <lwip/opt.h>		/* DNS_MAX_SERVERS */
 #include <dprintf.h>
+#include <syslinux/pxe.h>	/* PXE_HANDOFF_OPT */
 #include "pxe.h"
 
 char LocalDomain[256];
@@ -152,7 +153,8 @@ static const struct dhcp_options dhcp_opts[] = {
     {97,  uuid_client_identifier},
     {209, pxelinux_configfile},
     {210, pxelinux_pathprefix},
-    {211, pxelinux_reboottime}
+    {211, pxelinux_reboottime},
+    {PXE_HANDOFF_OPT, pxe_handoff_option}
 };
 
 /*
@@ -0,0 +1,98 @@
+/*
+ * dnscache.c
+ *
+ * Answers of the resolver, kept for as long as their TTL says, so
+ * that a menu full of http://server/... URLs asks for the server once.
+ * Names that don't resolve are remembered for DNS_CACHE_NEG_TTL.
+ */
+
+#include <string.h>
+#include <core.h>
+#include "pxe.h"
+
+struct dns_cache_entry {
+    mstime_t expires;		/* ms_timer() */
+    uint32_t ip;		/* 0 if the name doesn't resolve */
+    char name[DNS_CACHE_NAME];	/* "" if the slot is free */
+};
+
+static struct dns_cache_entry dns_cache[DNS_CACHE_SIZE];
+
+static bool dns_cache_live(const struct dns_cache_entry *e, mstime_t now)
+{
+    return e->name[0] && (int32_t)(e->expires - now) > 0;
+}
+
+/*
+ * Look for name in the cache.  Returns true if it is there, with the
+ * address in *ip, 0 for a name known not to resolve.
+ */
+bool dns_cache_lookup(const char *name, uint32_t *ip)
+{
+    mstime_t now = ms_timer();
+    struct dns_cache_entry *e;
+
+    for (e = dns_cache; e < dns_cache + DNS_CACHE_SIZE; e++) {
+	if (dns_cache_live(e, now) && !strcasecmp(e->name, name)) {
+	    *ip = e->ip;
+	    return true;
+	}
+    }
+
+    return false;
+}
+
+/*
+ * Remember the answer for name, ttl seconds long.  It takes the place
+ * of an old answer for the name or a dead one, or else of the one that
+ * is going to die first.
+ */
+void dns_cache_add(const char *name, uint32_t ip, uint32_t ttl)
+{
+    mstime_t now = ms_timer();
+    struct dns_cache_entry *e, *slot = NULL;
+
+    if (!ttl || strlen(name) >= DNS_CACHE_NAME)
+	return;
+
+    for (e = dns_cache; e < dns_cache + DNS_CACHE_SIZE; e++) {
+	if (!dns_cache_live(e, now) || !strcasecmp(e->name, name)) {
+	    slot = e;
+	    break;
+	}
+	if (!slot || (int32_t)(e->expires - slot->expires) < 0)
+	    slot = e;
+    }
+
+    if (ttl > DNS_CACHE_MAX_TTL)
+	ttl = DNS_CACHE_MAX_TTL;
+
+    strcpy(slot->name, name);
+    slot->ip = ip;
+    slot->expires = now + ttl * 1000;
+}
+
+/*
+ * Walk the live answers, starting with *pos = 0; each call gives the
+ * next one, with the seconds it has left in *ttl.  Returns false at
+ * the end.
+ */
+bool dns_cache_next(int *pos, const char **name, uint32_t *ip,
+		    uint32_t *ttl)
+{
+    mstime_t now = ms_timer();
+    const struct dns_cache_entry *e;
+
+    while (*pos < DNS_CACHE_SIZE) {
+	e = &dns_cache[(*pos)++];
+	if (dns_cache_live(e, now)) {
+	    *name = e->name;
+	    *ip = e->ip;
+	    *ttl = (e->expires - now) / 1000;
+	    if (*ttl)
+		return true;
+	}
+    }
+
+    return false;
+}
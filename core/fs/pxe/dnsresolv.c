@@ -116,9 +116,16 @@ __export uint32_t pxe_dns(const char *name)
 	name = fullname;
     }
 
+    if (dns_cache_lookup(name, &ip.addr))
+	return ip.addr;
+
     err = netconn_gethostbyname(name, &ip);
-    if (err)
+    if (err) {
+	/* lwIP doesn't tell NXDOMAIN from a timeout; both stick a while */
+	dns_cache_add(name, 0, DNS_CACHE_NEG_TTL);
 	return 0;
+    }
 
+    dns_cache_add(name, ip.addr, dns_ttl(name));
     return ip.addr;
 }
@@ -28,53 +28,58 @@
 #include "url.h"
 #include "net.h"
 
-static int ftp_cmd_response(struct inode *inode, const char *cmd,
-			    const char *cmd_arg,
-			    uint8_t *pasv_data, int *pn_ptr)
+#define FTP_IDLE_MAX	2	/* Logged-in control connections kept */
+
+/*
+ * Format one command line into buf; returns its length, or -1 if it
+ * doesn't fit
+ */
+static int ftp_format(char *buf, size_t size, const char *cmd,
+		      const char *cmd_arg)
 {
-    struct pxe_pvt_inode *socket = PVT(inode);
-    int c;
-    int pos, code;
-    int pb, pn;
-    bool ps;
-    bool first_line, done;
-    char cmd_buf[4096];
-    int cmd_len;
+    size_t cmd_len;
     const char *p;
     char *q;
-    int err;
 
-    if (cmd) {
-	cmd_len = strlcpy(cmd_buf, cmd, sizeof cmd_buf);
-	if (cmd_len >= sizeof cmd_buf - 3)
-	    return -1;
-	q = cmd_buf + cmd_len;
-
-	if (cmd_arg) {
-	    p = cmd_arg;
-
-	    *q++ = ' ';
-	    cmd_len++;
-	    while (*p) {
-		if (++cmd_len < sizeof cmd_buf) *q++ = *p;
-		if (*p == '\r')
-		    if (++cmd_len < sizeof cmd_buf) *q++ = '\0';
-		p++;
-	    }
-
-	    if (cmd_len >= sizeof cmd_buf - 2)
-		return -1;
+    cmd_len = strlcpy(buf, cmd, size);
+    if (cmd_len >= size - 3)
+	return -1;
+    q = buf + cmd_len;
+
+    if (cmd_arg) {
+	p = cmd_arg;
+
+	*q++ = ' ';
+	cmd_len++;
+	while (*p) {
+	    if (++cmd_len < size) *q++ = *p;
+	    if (*p == '\r')
+		if (++cmd_len < size) *q++ = '\0';
+	    p++;
 	}
 
-	*q++ = '\r';
-	*q++ = '\n';
-	cmd_len += 2;
-
-	err = core_tcp_write(socket, cmd_buf, cmd_len, true);
-	if (err)
+	if (cmd_len >= size - 2)
 	    return -1;
     }
 
+    *q++ = '\r';
+    *q++ = '\n';
+    cmd_len += 2;
+
+    return cmd_len;
+}
+
+/*
+ * Read one (possibly multi-line) response; returns its code, or -1
+ */
+static int ftp_response(struct inode *inode, uint8_t *pasv_data, int *pn_ptr)
+{
+    int c;
+    int pos, code;
+    int pb, pn;
+    bool ps;
+    bool first_line, done;
+
     pos = code = pn = pb = 0;
     ps = false;
     first_line = true;
@@ -148,13 +153,84 @@ static int ftp_cmd_response(struct inode *inode, const char *cmd,
     return -1;
 }
 
+static int ftp_cmd_response(struct inode *inode, const char *cmd,
+			    const char *cmd_arg,
+			    uint8_t *pasv_data, int *pn_ptr)
+{
+    char cmd_buf[4096];
+    int cmd_len;
+
+    if (cmd) {
+	cmd_len = ftp_format(cmd_buf, sizeof cmd_buf, cmd, cmd_arg);
+	if (cmd_len < 0)
+	    return -1;
+	if (core_tcp_write(PVT(inode), cmd_buf, cmd_len, true))
+	    return -1;
+    }
+
+    return ftp_response(inode, pasv_data, pn_ptr);
+}
+
+/*
+ * Control connections whose transfer is done, oldest first.  They
+ * stay logged in, and the next file from the same server and user
+ * goes over one of them.
+ */
+static struct inode *ftp_idle[FTP_IDLE_MAX];
+static int ftp_idle_count;
+
+static void ftp_ctl_free(struct inode *ctl, bool quit)
+{
+    struct pxe_pvt_inode *ctlsock = PVT(ctl);
+
+    if (core_tcp_is_connected(ctlsock)) {
+	if (quit)
+	    core_tcp_write(ctlsock, "QUIT\r\n", 6, false);
+	core_tcp_close_file(ctl);
+    }
+    free(ctlsock->ftp_login);
+    free_socket(ctl);
+}
+
+static void ftp_idle_put(struct inode *ctl)
+{
+    if (ftp_idle_count == FTP_IDLE_MAX) {
+	ftp_ctl_free(ftp_idle[0], true);
+	ftp_idle_count--;
+	memmove(&ftp_idle[0], &ftp_idle[1],
+		ftp_idle_count * sizeof ftp_idle[0]);
+    }
+    ftp_idle[ftp_idle_count++] = ctl;
+}
+
+static struct inode *ftp_idle_get(uint32_t ip, uint16_t port,
+				  const char *login)
+{
+    struct pxe_pvt_inode *ctlsock;
+    struct inode *ctl;
+    int i;
+
+    for (i = ftp_idle_count - 1; i >= 0; i--) {
+	ctl = ftp_idle[i];
+	ctlsock = PVT(ctl);
+	if (ctlsock->http_ip == ip && ctlsock->http_port == port &&
+	    !strcmp(ctlsock->ftp_login, login)) {
+	    ftp_idle_count--;
+	    memmove(&ftp_idle[i], &ftp_idle[i+1],
+		    (ftp_idle_count - i) * sizeof ftp_idle[0]);
+	    return ctl;
+	}
+    }
+
+    return NULL;
+}
+
 static void ftp_free(struct inode *inode)
 {
     struct pxe_pvt_inode *socket = PVT(inode);
 
     if (socket->ctl) {
-	core_tcp_close_file(socket->ctl);
-	free_socket(socket->ctl);
+	ftp_ctl_free(socket->ctl, false);
 	socket->ctl = NULL;
     }
     core_tcp_close_file(inode);
@@ -167,10 +243,19 @@ static void ftp_close_file(struct inode *inode)
     int resp;
 
     ctlsock = socket->ctl ? PVT(socket->ctl) : NULL;
-    if (core_tcp_is_connected(ctlsock)) {
-	resp = ftp_cmd_response(socket->ctl, "QUIT", NULL, NULL, NULL);
-	while (resp == 226) {
-	    resp = ftp_cmd_response(socket->ctl, NULL, NULL, NULL, NULL);
+    if (ctlsock && core_tcp_is_connected(ctlsock)) {
+	if (socket->tftp_goteof) {
+	    /* All of it came in; keep the connection if the server agrees */
+	    resp = ftp_response(socket->ctl, NULL, NULL);
+	    if (resp == 226 || resp == 250) {
+		ftp_idle_put(socket->ctl);
+		socket->ctl = NULL;
+	    }
+	} else {
+	    resp = ftp_cmd_response(socket->ctl, "QUIT", NULL, NULL, NULL);
+	    while (resp == 226) {
+		resp = ftp_cmd_response(socket->ctl, NULL, NULL, NULL, NULL);
+	    }
 	}
     }
     ftp_free(inode);
@@ -182,15 +267,138 @@ static const struct pxe_conn_ops ftp_conn_ops = {
     .readdir		= ftp_readdir,
 };
 
-void ftp_open(struct url_info *url, int flags, struct inode *inode,
-	      const char **redir)
+/*
+ * Open a control connection and wait for the greeting
+ */
+static struct inode *ftp_ctl_open(struct inode *inode, struct url_info *url,
+				  const char *login)
 {
-    struct pxe_pvt_inode *socket = PVT(inode);
+    struct inode *ctl;
     struct pxe_pvt_inode *ctlsock;
+    int resp = -1;
+
+    ctl = new_socket(inode->fs);
+    if (!ctl)
+	return NULL;
+    ctlsock = PVT(ctl);
+    ctlsock->ops = &tcp_conn_ops; /* The control connection is just TCP */
+    ctlsock->http_ip = url->ip;
+    ctlsock->http_port = url->port;
+    ctlsock->ftp_login = strdup(login);
+    if (!ctlsock->ftp_login)
+	goto err;
+
+    if (core_tcp_open(ctlsock))
+	goto err;
+    if (core_tcp_connect(ctlsock, url->ip, url->port))
+	goto err;
+
+    do {
+	resp = ftp_response(ctl, NULL, NULL);
+    } while (resp == 120);
+    if (resp != 220)
+	goto err;
+
+    return ctl;
+
+err:
+    ftp_ctl_free(ctl, resp > 0);
+    return NULL;
+}
+
+/*
+ * Start the transfer over socket->ctl, logging in first on a fresh
+ * connection.  The commands up to PASV go out in one go, and the data
+ * connection is set up while the server works on the RETR.  Returns
+ * 0 on success, 1 if the server refused, -1 if the connection broke.
+ */
+static int ftp_start(struct inode *inode, struct url_info *url, int flags,
+		     bool login)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+    struct inode *ctl = socket->ctl;
+    char cmd_buf[4096];
     uint8_t pasv_data[6];
-    int pasv_bytes;
+    int pasv_bytes = 0;
+    int len = 0, n;
+    bool user_ok = false;
     int resp;
-    err_t err;
+
+    if (login) {
+	n = ftp_format(cmd_buf, sizeof cmd_buf, "USER", url->user);
+	if (n < 0)
+	    return 1;
+	len += n;
+	n = ftp_format(cmd_buf + len, sizeof cmd_buf - len,
+		       "PASS", url->passwd);
+	if (n < 0)
+	    return 1;
+	len += n;
+    }
+    if (!(flags & O_DIRECTORY)) {
+	n = ftp_format(cmd_buf + len, sizeof cmd_buf - len, "TYPE", "I");
+	if (n < 0)
+	    return 1;
+	len += n;
+    }
+    n = ftp_format(cmd_buf + len, sizeof cmd_buf - len, "PASV", NULL);
+    if (n < 0)
+	return 1;
+    len += n;
+
+    if (core_tcp_write(PVT(ctl), cmd_buf, len, true))
+	return -1;
+
+    if (login) {
+	resp = ftp_response(ctl, NULL, NULL);
+	if (resp == 202 || resp == 230)
+	    user_ok = true;	/* PASS was not needed; ignore its answer */
+	else if (resp != 331)
+	    return resp < 0 ? -1 : 1;
+
+	resp = ftp_response(ctl, NULL, NULL);
+	if (resp < 0)
+	    return -1;
+	if (!user_ok && resp != 202 && resp != 230)
+	    return 1;
+    }
+
+    if (!(flags & O_DIRECTORY)) {
+	resp = ftp_response(ctl, NULL, NULL);
+	if (resp != 200)
+	    return resp < 0 || resp == 421 ? -1 : 1;
+    }
+
+    resp = ftp_response(ctl, pasv_data, &pasv_bytes);
+    if (resp != 227 || pasv_bytes != 6)
+	return resp < 0 || resp == 421 ? -1 : 1;
+
+    n = ftp_format(cmd_buf, sizeof cmd_buf,
+		   (flags & O_DIRECTORY) ? "LIST" : "RETR", url->path);
+    if (n < 0)
+	return 1;
+    if (core_tcp_write(PVT(ctl), cmd_buf, n, true))
+	return -1;
+
+    if (core_tcp_open(socket))
+	return 1;
+    if (core_tcp_connect(socket, *(uint32_t*)&pasv_data[0],
+			 ntohs(*(uint16_t *)&pasv_data[4])))
+	return 1;
+
+    resp = ftp_response(ctl, NULL, NULL);
+    if (resp != 125 && resp != 150)
+	return 1;
+
+    return 0;
+}
+
+void ftp_open(struct url_info *url, int flags, struct inode *inode,
+	      const char **redir)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+    char login[2*FILENAME_MAX];
+    int err = -1;
 
     (void)redir;		/* FTP does not redirect */
 
@@ -203,71 +411,36 @@ void ftp_open(struct url_info *url, int flags, struct inode *inode,
 
     socket->ops = &ftp_conn_ops;
 
-    /* Set up the control connection */
-    socket->ctl = alloc_inode(inode->fs, 0, sizeof(struct pxe_pvt_inode));
-    if (!socket->ctl)
-	return;
-    ctlsock = PVT(socket->ctl);
-    ctlsock->ops = &tcp_conn_ops; /* The control connection is just TCP */
-    if (core_tcp_open(ctlsock))
-	goto err_free;
-    err = core_tcp_connect(ctlsock, url->ip, url->port);
-    if (err)
-	goto err_delete;
-
-    do {
-	resp = ftp_cmd_response(socket->ctl, NULL, NULL, NULL, NULL);
-    } while (resp == 120);
-    if (resp != 220)
-	goto err_disconnect;
-
     if (!url->user)
 	url->user = "anonymous";
     if (!url->passwd)
 	url->passwd = "syslinux@";
+    snprintf(login, sizeof login, "%s\n%s", url->user, url->passwd);
 
-    resp = ftp_cmd_response(socket->ctl, "USER", url->user, NULL, NULL);
-    if (resp != 202 && resp != 230) {
-	if (resp != 331)
-	    goto err_disconnect;
-
-	resp = ftp_cmd_response(socket->ctl, "PASS", url->passwd, NULL, NULL);
-	if (resp != 230)
-	    goto err_disconnect;
+    /* A connection that is still logged in, if the server kept it */
+    socket->ctl = ftp_idle_get(url->ip, url->port, login);
+    if (socket->ctl) {
+	err = ftp_start(inode, url, flags, false);
+	if (err < 0) {
+	    ftp_ctl_free(socket->ctl, false);
+	    socket->ctl = NULL;
+	}
     }
 
-    if (!(flags & O_DIRECTORY)) {
-	resp = ftp_cmd_response(socket->ctl, "TYPE", "I", NULL, NULL);
-	if (resp != 200)
-	    goto err_disconnect;
+    if (!socket->ctl) {
+	socket->ctl = ftp_ctl_open(inode, url, login);
+	if (!socket->ctl)
+	    return;
+	err = ftp_start(inode, url, flags, true);
     }
 
-    resp = ftp_cmd_response(socket->ctl, "PASV", NULL, pasv_data, &pasv_bytes);
-    if (resp != 227 || pasv_bytes != 6)
-	goto err_disconnect;
-
-    err = core_tcp_open(socket);
-    if (err)
-	goto err_disconnect;
-    err = core_tcp_connect(socket, *(uint32_t*)&pasv_data[0],
-			   ntohs(*(uint16_t *)&pasv_data[4]));
-    if (err)
-	goto err_disconnect;
-
-    resp = ftp_cmd_response(socket->ctl,
-			    (flags & O_DIRECTORY) ? "LIST" : "RETR",
-			    url->path, NULL, NULL);
-    if (resp != 125 && resp != 150)
-	goto err_disconnect;
+    if (err) {
+	ftp_ctl_free(socket->ctl, true);
+	socket->ctl = NULL;
+	if (core_tcp_is_connected(socket))
+	    core_tcp_close_file(inode);
+	return;
+    }
 
     inode->size = -1;
-    return;			/* Sucess! */
-
-err_disconnect:
-    core_tcp_write(ctlsock, "QUIT\r\n", 6, false);
-    core_tcp_close_file(inode);
-err_delete:
-    core_tcp_close_file(socket->ctl);
-err_free:
-    free_socket(socket->ctl);
 }
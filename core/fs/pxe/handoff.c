@@ -0,0 +1,188 @@
+/*
+ * handoff.c
+ *
+ * What a PXELINUX chained from another one would otherwise have to
+ * find out over the network again.  pxechn.c32 asks for the block
+ * with pmapi_net_handoff() and puts it in the cached DHCP reply as
+ * option PXE_HANDOFF_OPT; the new instance finds it there as it
+ * parses its DHCP packets, and takes from it
+ *
+ *   - the DNS cache, with what is left of each answer's TTL, and
+ *   - the Ethernet addresses of the hosts it talks to directly: the
+ *     gateway, the boot server and the DNS servers, where lwIP had
+ *     them (the PXE stack keeps its own ARP table, and it stays).
+ *
+ * The addresses and DNS servers themselves are in the DHCP packets
+ * anyway.  Open connections can't be handed on: they belong to the
+ * TCP stack of the instance that goes away.
+ *
+ * The option is a magic number and a version, then records of a type
+ * byte, a length byte and the data.  The option number is one of the
+ * site-specific ones, so the magic is what tells it from a site's own
+ * use; anything that doesn't look right is ignored.
+ */
+
+#include <string.h>
+#include <core.h>
+#include <net.h>
+#include <dprintf.h>
+#include <lwip/opt.h>		/* DNS_MAX_SERVERS */
+#include <syslinux/pxe.h>	/* PXE_HANDOFF_OPT */
+#include "pxe.h"
+
+#define PXE_HANDOFF_MAGIC	0x4f484c53	/* "SLHO" */
+#define PXE_HANDOFF_VERSION	1
+#define PXE_HANDOFF_MAX		255		/* One DHCP option */
+
+enum pxe_handoff_type {
+    HANDOFF_ARP = 1,		/* IP, MAC */
+    HANDOFF_DNS = 2,		/* IP, TTL in seconds (16 bits), name */
+};
+
+#define HANDOFF_ARP_LEN		(4 + 6)
+#define HANDOFF_DNS_LEN		(4 + 2)
+
+static uint8_t handoff[PXE_HANDOFF_MAX];
+static int handoff_len;
+
+static uint8_t *put_rec(uint8_t *p, const uint8_t *end, uint8_t type,
+			const void *a, int alen, const void *b, int blen)
+{
+    if (!p || end - p < 2 + alen + blen)
+	return NULL;
+
+    *p++ = type;
+    *p++ = alen + blen;
+    memcpy(p, a, alen);
+    if (blen)
+	memcpy(p + alen, b, blen);
+    return p + alen + blen;
+}
+
+static uint8_t *put_arp(uint8_t *p, const uint8_t *end, uint32_t ip)
+{
+    uint8_t rec[HANDOFF_ARP_LEN];
+    const uint8_t *q;
+
+    if (!ip || ip == IPInfo.myip || gateway(ip))
+	return p;		/* Not a neighbour */
+
+    /* Once is enough */
+    for (q = handoff + 5; q < p; q += 2 + q[1]) {
+	if (q[0] == HANDOFF_ARP && !memcmp(q + 2, &ip, 4))
+	    return p;
+    }
+
+    memcpy(rec, &ip, 4);
+    if (!net_core_arp_lookup(ip, rec + 4))
+	return p;
+
+    q = put_rec(p, end, HANDOFF_ARP, rec, sizeof rec, NULL, 0);
+    return q ? (uint8_t *)q : p;
+}
+
+/*
+ * Fill buf with the option data, as much of it as fits in len or in
+ * one option; returns how much that is.
+ */
+int pxe_net_handoff(void *buf, size_t len)
+{
+    const uint8_t *end;
+    uint8_t *p = handoff, *np;
+    uint32_t magic = PXE_HANDOFF_MAGIC;
+    const char *name;
+    uint32_t ip, ttl;
+    uint8_t rec[HANDOFF_DNS_LEN];
+    int i, pos;
+
+    if (len > PXE_HANDOFF_MAX)
+	len = PXE_HANDOFF_MAX;
+    if (len < 5)
+	return 0;
+    end = handoff + len;
+
+    memcpy(p, &magic, 4);
+    p[4] = PXE_HANDOFF_VERSION;
+    p += 5;
+
+    /* The gateway first; most of the rest goes through it */
+    p = put_arp(p, end, IPInfo.gateway);
+    p = put_arp(p, end, IPInfo.serverip);
+    for (i = 0; i < DNS_MAX_SERVERS; i++)
+	p = put_arp(p, end, dns_server[i]);
+
+    for (pos = 0; dns_cache_next(&pos, &name, &ip, &ttl);) {
+	if (ttl > 0xffff)
+	    ttl = 0xffff;
+	memcpy(rec, &ip, 4);
+	rec[4] = ttl;
+	rec[5] = ttl >> 8;
+	np = put_rec(p, end, HANDOFF_DNS, rec, sizeof rec,
+		     name, strlen(name));
+	if (np)
+	    p = np;
+	p = put_arp(p, end, ip);
+    }
+
+    memcpy(buf, handoff, p - handoff);
+    return p - handoff;
+}
+
+/*
+ * The option, as parse_dhcp() comes across it; kept until the network
+ * stack is up for pxe_handoff_apply().
+ */
+void pxe_handoff_option(const void *data, int opt_len)
+{
+    uint32_t magic;
+
+    if (opt_len < 5 || opt_len > PXE_HANDOFF_MAX)
+	return;
+    memcpy(&magic, data, 4);
+    if (magic != PXE_HANDOFF_MAGIC ||
+	((const uint8_t *)data)[4] != PXE_HANDOFF_VERSION)
+	return;
+
+    memcpy(handoff, data, opt_len);
+    handoff_len = opt_len;
+}
+
+void pxe_handoff_apply(void)
+{
+    const uint8_t *p = handoff + 5, *end = handoff + handoff_len;
+    char name[DNS_CACHE_NAME];
+    uint32_t ip;
+    int len;
+
+    if (!handoff_len)
+	return;
+    handoff_len = 0;
+
+    while (end - p >= 2 && end - p >= 2 + p[1]) {
+	len = p[1];
+
+	switch (p[0]) {
+	case HANDOFF_ARP:
+	    if (len == HANDOFF_ARP_LEN) {
+		memcpy(&ip, p + 2, 4);
+		dprintf("handoff: ARP %08x\n", ntohl(ip));
+		net_core_arp_add(ip, p + 6);
+	    }
+	    break;
+	case HANDOFF_DNS:
+	    if (len > HANDOFF_DNS_LEN) {
+		memcpy(&ip, p + 2, 4);
+		len -= HANDOFF_DNS_LEN;
+		memcpy(name, p + 2 + HANDOFF_DNS_LEN, len);
+		name[len] = '\0';
+		dprintf("handoff: DNS %s\n", name);
+		dns_cache_add(name, ip, p[6] | p[7] << 8);
+	    }
+	    break;
+	default:
+	    break;
+	}
+
+	p += 2 + p[1];
+    }
+}
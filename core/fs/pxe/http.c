@@ -1,5 +1,8 @@
 #include <syslinux/sysappend.h>
+#include <syslinux/firmware.h>
 #include <ctype.h>
+#include <minmax.h>
+#include <zlib.h>
 #include <lwip/api.h>
 #include "pxe.h"
 #include "version.h"
@@ -8,6 +11,22 @@
 
 #define HTTP_PORT	80
 
+/* Idle connections kept open for the next request to the same server */
+#define HTTP_IDLE_MAX	4
+
+/* Where we are in the body of a response (socket->http_state) */
+enum http_body {
+    HTTP_BODY_RAW,		/* Runs until the server closes */
+    HTTP_BODY_DATA,		/* http_left bytes of Content-Length */
+    HTTP_CHUNK_SIZE,		/* Chunk size line */
+    HTTP_CHUNK_EXT,		/* Rest of the chunk size line */
+    HTTP_CHUNK_DATA,		/* http_left bytes of chunk */
+    HTTP_CHUNK_END,		/* CRLF after the chunk */
+    HTTP_CHUNK_TRAILER,		/* Start of a trailer line */
+    HTTP_CHUNK_TRAILER_LINE,	/* Rest of a trailer line */
+    HTTP_BODY_DONE,
+};
+
 static bool is_tspecial(int ch)
 {
     bool tspecial = false;
@@ -146,21 +165,336 @@ __export void http_bake_cookies(void)
     http_do_bake_cookies(cookie_buf);
 }
 
+/*
+ * The idle pool, oldest first.  Each entry is a socket of its own,
+ * which holds nothing but the connection.
+ */
+static struct inode *http_idle[HTTP_IDLE_MAX];
+static int http_idle_count;
+
+static void http_idle_drop(int i)
+{
+    http_idle_count--;
+    memmove(&http_idle[i], &http_idle[i+1],
+	    (http_idle_count - i) * sizeof http_idle[0]);
+}
+
+/*
+ * Park the connection of a socket whose response is done
+ */
+static void http_idle_put(struct inode *inode)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+    struct inode *idle;
+
+    idle = new_socket(inode->fs);
+    if (!idle) {
+	core_tcp_close_file(inode);
+	return;
+    }
+
+    PVT(idle)->net = socket->net;
+    PVT(idle)->http_ip = socket->http_ip;
+    PVT(idle)->http_port = socket->http_port;
+    memset(&socket->net, 0, sizeof socket->net);
+
+    if (http_idle_count == HTTP_IDLE_MAX) {
+	core_tcp_close_file(http_idle[0]);
+	free_socket(http_idle[0]);
+	http_idle_drop(0);
+    }
+    http_idle[http_idle_count++] = idle;
+}
+
+/*
+ * Take over an idle connection to this server, if there is one
+ */
+static bool http_idle_get(struct pxe_pvt_inode *socket,
+			  uint32_t ip, uint16_t port)
+{
+    struct inode *idle;
+    int i;
+
+    for (i = http_idle_count - 1; i >= 0; i--) {
+	idle = http_idle[i];
+	if (PVT(idle)->http_ip == ip && PVT(idle)->http_port == port) {
+	    socket->net = PVT(idle)->net;
+	    free_socket(idle);
+	    http_idle_drop(i);
+	    return true;
+	}
+    }
+
+    return false;
+}
+
+/*
+ * Consume one byte of chunked framing; returns -1 if it is garbage
+ */
+static int http_chunk_byte(struct pxe_pvt_inode *socket, int ch)
+{
+    int digit;
+
+    switch (socket->http_state) {
+    case HTTP_CHUNK_SIZE:
+	digit = tolower(ch);
+	digit = (digit >= '0' && digit <= '9') ? digit - '0' :
+	    (digit >= 'a' && digit <= 'f') ? digit - 'a' + 10 : -1;
+	if (digit >= 0) {
+	    if (socket->http_left > 0x0fffffff)
+		return -1;	/* Way too big */
+	    socket->http_left = (socket->http_left << 4) + digit;
+	    break;
+	} else if (ch == ';' || ch == ' ' || ch == '\t') {
+	    socket->http_state = HTTP_CHUNK_EXT;
+	    break;
+	}
+	/* fall through */
+    case HTTP_CHUNK_EXT:
+	if (ch == '\n')
+	    socket->http_state = socket->http_left ? HTTP_CHUNK_DATA
+						   : HTTP_CHUNK_TRAILER;
+	else if (ch != '\r' && socket->http_state == HTTP_CHUNK_SIZE)
+	    return -1;
+	break;
+
+    case HTTP_CHUNK_END:
+	if (ch == '\n')
+	    socket->http_state = HTTP_CHUNK_SIZE;
+	else if (ch != '\r')
+	    return -1;
+	break;
+
+    case HTTP_CHUNK_TRAILER:
+	if (ch == '\n')
+	    socket->http_state = HTTP_BODY_DONE;
+	else if (ch != '\r')
+	    socket->http_state = HTTP_CHUNK_TRAILER_LINE;
+	break;
+
+    case HTTP_CHUNK_TRAILER_LINE:
+	if (ch == '\n')
+	    socket->http_state = HTTP_CHUNK_TRAILER;
+	break;
+    }
+
+    return 0;
+}
+
+/*
+ * Eat framing bytes already received, up to the next data or the end
+ */
+static int http_frame(struct pxe_pvt_inode *socket)
+{
+    while (socket->http_rawleft &&
+	   socket->http_state != HTTP_BODY_DATA &&
+	   socket->http_state != HTTP_CHUNK_DATA &&
+	   socket->http_state != HTTP_BODY_DONE) {
+	if (http_chunk_byte(socket, *socket->http_rawptr))
+	    return -1;
+	socket->http_rawptr++;
+	socket->http_rawleft--;
+    }
+
+    return 0;
+}
+
+/*
+ * The body is complete: hand the connection on if we can
+ */
+static void http_done(struct inode *inode)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+    char *tail;
+
+    if (socket->tftp_bytesleft) {
+	/* The last data can't stay in a buffer of the connection */
+	tail = malloc(socket->tftp_bytesleft);
+	if (!tail)
+	    return;		/* Try again once it is consumed */
+	memcpy(tail, socket->tftp_dataptr, socket->tftp_bytesleft);
+	free(socket->tftp_pktbuf);
+	socket->tftp_pktbuf = socket->tftp_dataptr = tail;
+    }
+
+    if (socket->http_keepalive && !socket->http_rawleft)
+	http_idle_put(inode);
+    else
+	core_tcp_close_file(inode);
+
+    socket->tftp_goteof = 1;
+    inode->size = socket->tftp_filepos;
+}
+
+/*
+ * Hand out the body as framed by Content-Length or chunking, leaving
+ * the connection positioned at the end of the response.
+ */
+static void http_fill_buffer(struct inode *inode)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+    uint32_t len;
+
+    if (socket->http_state == HTTP_BODY_RAW) {
+	core_tcp_fill_buffer(inode);
+	return;
+    }
+
+    for (;;) {
+	if (http_frame(socket)) {
+	    /* Lost track of the framing; all we can do is stop */
+	    core_tcp_close_file(inode);
+	    socket->tftp_goteof = 1;
+	    inode->size = socket->tftp_filepos;
+	    return;
+	}
+
+	if (socket->http_state == HTTP_BODY_DONE) {
+	    http_done(inode);
+	    return;
+	}
+
+	if (socket->http_rawleft) {
+	    len = min(socket->http_rawleft, socket->http_left);
+	    socket->tftp_dataptr = socket->http_rawptr;
+	    socket->tftp_bytesleft = len;
+	    socket->tftp_filepos += len;
+	    socket->http_rawptr += len;
+	    socket->http_rawleft -= len;
+	    socket->http_left -= len;
+	    if (!socket->http_left)
+		socket->http_state = socket->http_state == HTTP_CHUNK_DATA ?
+		    HTTP_CHUNK_END : HTTP_BODY_DONE;
+
+	    /* If the end is already here, finish now rather than later */
+	    if (!http_frame(socket) &&
+		socket->http_state == HTTP_BODY_DONE)
+		http_done(inode);
+	    return;
+	}
+
+	core_tcp_fill_buffer(inode);
+	if (socket->tftp_goteof)
+	    return;		/* The server closed early */
+	socket->tftp_filepos -= socket->tftp_bytesleft;
+	socket->http_rawptr = socket->tftp_dataptr;
+	socket->http_rawleft = socket->tftp_bytesleft;
+	socket->tftp_bytesleft = 0;
+    }
+}
+
 static const struct pxe_conn_ops http_conn_ops = {
-    .fill_buffer	= core_tcp_fill_buffer,
+    .fill_buffer	= http_fill_buffer,
     .close		= core_tcp_close_file,
     .readdir		= http_readdir,
 };
 
-void http_open(struct url_info *url, int flags, struct inode *inode,
-	       const char **redir)
+/* The longest ETag or Last-Modified we keep a file's copy by */
+#define HTTP_VALIDATOR_MAX	128
+
+/*
+ * What we need to know of a response
+ */
+struct http_response {
+    uint32_t content_length;	/* -1 if not given */
+    uint32_t range_start;	/* Of Content-Range, -1 if not given */
+    bool chunked;
+    bool ranges;		/* Accept-Ranges: bytes */
+    bool gzip;			/* Content-Encoding: gzip */
+    int connection;		/* Connection: close 0, keep-alive 1 */
+    char httpver[10];
+    char *location;
+    char etag[HTTP_VALIDATOR_MAX];	/* Empty if not given */
+    char last_modified[HTTP_VALIDATOR_MAX];
+};
+
+static uint32_t http_parse_number(const char **p)
+{
+    const char *next = *p;
+    uint32_t n = 0;
+
+    for (;(*next >= '0' && *next <= '9'); next++) {
+	if ((n * 10) < n)
+	    return -1;
+	n = (n * 10) + (*next - '0');
+    }
+
+    *p = next;
+    return n;
+}
+
+/*
+ * Take note of a response header field
+ */
+static void http_header_field(const char *name, const char *value,
+			      struct http_response *resp)
 {
-    struct pxe_pvt_inode *socket = PVT(inode);
-    int header_bytes;
     const char *next;
+
+    /* Skip leading whitespace */
+    while (isspace(*value))
+	value++;
+
+    if (strcasecmp(name, "Content-Length") == 0) {
+	next = value;
+	resp->content_length = http_parse_number(&next);
+	/* In the case of overflow or other error ignore
+	 * Content-Length.
+	 */
+	if (*next)
+	    resp->content_length = -1;
+    }
+    else if (strcasecmp(name, "Content-Range") == 0) {
+	/* bytes first-last/total; we only check where it starts */
+	if (!strncasecmp(value, "bytes ", 6)) {
+	    next = value + 6;
+	    resp->range_start = http_parse_number(&next);
+	    if (*next != '-')
+		resp->range_start = -1;
+	}
+    }
+    else if (strcasecmp(name, "Location") == 0) {
+	strlcpy(resp->location, value, FILENAME_MAX);
+    }
+    else if (strcasecmp(name, "ETag") == 0) {
+	if (strlen(value) < HTTP_VALIDATOR_MAX)
+	    strcpy(resp->etag, value);
+    }
+    else if (strcasecmp(name, "Last-Modified") == 0) {
+	if (strlen(value) < HTTP_VALIDATOR_MAX)
+	    strcpy(resp->last_modified, value);
+    }
+    else if (strcasecmp(name, "Transfer-Encoding") == 0) {
+	resp->chunked = strcasecmp(value, "chunked") == 0;
+    }
+    else if (strcasecmp(name, "Content-Encoding") == 0) {
+	resp->gzip = strcasecmp(value, "gzip") == 0 ||
+	    strcasecmp(value, "x-gzip") == 0;
+    }
+    else if (strcasecmp(name, "Accept-Ranges") == 0) {
+	resp->ranges = strcasecmp(value, "bytes") == 0;
+    }
+    else if (strcasecmp(name, "Connection") == 0) {
+	if (strcasecmp(value, "close") == 0)
+	    resp->connection = 0;
+	else if (strcasecmp(value, "keep-alive") == 0)
+	    resp->connection = 1;
+    }
+}
+
+/*
+ * Send a request to the server of the socket, on an idle connection
+ * if there is one, and read the response header.  For a response with
+ * a body the socket is then set up to read it.  Returns the status, 0
+ * if there was no sensible response, -1 if we could not even connect.
+ */
+static int http_request(struct inode *inode, const char *req, int req_len,
+			struct http_response *resp)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
     char field_name[20];
     char field_value[1024];
-    size_t field_name_len, field_value_len;
+    size_t httpver_len, field_name_len, field_value_len;
     enum state {
 	st_httpver,
 	st_stcode,
@@ -172,84 +506,73 @@ void http_open(struct url_info *url, int flags, struct inode *inode,
 	st_skip_fieldvalue,
 	st_eoh,
     } state;
-    static char location[FILENAME_MAX];
-    uint32_t content_length; /* same as inode->size */
+    bool reused;
     size_t response_size;
     int status;
     int pos;
     int err;
 
-    (void)flags;
-
-    if (!header_buf)
-	return;			/* http is broken... */
-
-    /* This is a straightforward TCP connection after headers */
-    socket->ops = &http_conn_ops;
-
+retry:
     /* Reset all of the variables */
-    inode->size = content_length = -1;
+    inode->size = -1;
+    socket->ops = &http_conn_ops;
+    socket->http_state = HTTP_BODY_RAW;
+    socket->tftp_goteof = 0;
+    socket->tftp_filepos = 0;
+    socket->tftp_bytesleft = 0;
 
-    /* Start the http connection */
-    err = core_tcp_open(socket);
-    if (err)
-        return;
+    /* Start the http connection, or pick up one left open */
+    reused = http_idle_get(socket, socket->http_ip, socket->http_port);
+    if (!reused) {
+	err = core_tcp_open(socket);
+	if (err)
+	    return -1;
 
-    if (!url->port)
-	url->port = HTTP_PORT;
-
-    err = core_tcp_connect(socket, url->ip, url->port);
-    if (err)
-	goto fail;
-
-    strcpy(header_buf, "GET /");
-    header_bytes = 5;
-    header_bytes += url_escape_unsafe(header_buf+5, url->path,
-				      header_len - 5);
-    if (header_bytes >= header_len)
-	goto fail;		/* Buffer overflow */
-    header_bytes += snprintf(header_buf + header_bytes,
-			     header_len - header_bytes,
-			     " HTTP/1.0\r\n"
-			     "Host: %s",
-			     url->host);
-    if (header_bytes >= header_len)
-	goto fail;		/* Buffer overflow */
-    if (url->port != HTTP_PORT) {
-	header_bytes += snprintf(header_buf + header_bytes,
-			     header_len - header_bytes,
-			     ":%d", url->port);
-	if (header_bytes >= header_len)
-	    goto fail;		/* Buffer overflow */
+	err = core_tcp_connect(socket, socket->http_ip, socket->http_port);
+	if (err)
+	    return 0;
     }
-    header_bytes += snprintf(header_buf + header_bytes,
-			     header_len - header_bytes,
-			     "\r\n"
-			     "User-Agent: Syslinux/" VERSION_STR "\r\n"
-			     "Connection: close\r\n"
-			     "%s"
-			     "\r\n",
-			     cookie_buf ? cookie_buf : "");
-    if (header_bytes >= header_len)
-	goto fail;		/* Buffer overflow */
 
-    err = core_tcp_write(socket, header_buf, header_bytes, false);
-    if (err)
-	goto fail;
+    err = core_tcp_write(socket, req, req_len, false);
+    if (err) {
+	if (reused) {
+	    /* The server let it go in the meantime */
+	    core_tcp_close_file(inode);
+	    goto retry;
+	}
+	return 0;
+    }
 
     /* Parse the HTTP header */
     state = st_httpver;
     pos = 0;
     status = 0;
     response_size = 0;
+    httpver_len = 0;
     field_value_len = 0;
+    field_value[0] = '\0';
     field_name_len = 0;
+    field_name[0] = '\0';
+    resp->content_length = -1;
+    resp->range_start = -1;
+    resp->chunked = false;
+    resp->ranges = false;
+    resp->gzip = false;
+    resp->connection = -1;
+    resp->httpver[0] = '\0';
+    resp->location[0] = '\0';
+    resp->etag[0] = '\0';
+    resp->last_modified[0] = '\0';
 
     while (state != st_eoh) {
 	int ch = pxe_getc(inode);
 	/* Eof before I finish paring the header */
-	if (ch == -1)
-	    goto fail;
+	if (ch == -1) {
+	    /* A kept-alive connection may have been closed by now */
+	    if (reused && !response_size)
+		goto retry;
+	    return 0;
+	}
 #if 0
         printf("%c", ch);
 #endif
@@ -261,12 +584,14 @@ void http_open(struct url_info *url, int flags, struct inode *inode,
 	    if (ch == ' ') {
 		state = st_stcode;
 		pos = 0;
+	    } else {
+		append_ch(resp->httpver, sizeof resp->httpver, &httpver_len, ch);
 	    }
 	    break;
 
 	case st_stcode:
 	    if (ch < '0' || ch > '9')
-	       goto fail;
+	       return 0;
 	    status = (status*10) + (ch - '0');
 	    if (++pos == 3)
 		state = st_skipline;
@@ -278,8 +603,10 @@ void http_open(struct url_info *url, int flags, struct inode *inode,
 	    break;
 
 	case st_fieldfirst:
-	    if (ch == '\n')
+	    if (ch == '\n') {
+		http_header_field(field_name, field_value, resp);
 		state = st_eoh;
+	    }
 	    else if (isspace(ch)) {
 		/* A continuation line */
 		state = st_fieldvalue;
@@ -287,30 +614,7 @@ void http_open(struct url_info *url, int flags, struct inode *inode,
 	    }
 	    else if (is_token(ch)) {
 		/* Process the previous field before starting on the next one */
-		if (strcasecmp(field_name, "Content-Length") == 0) {
-		    next = field_value;
-		    /* Skip leading whitespace */
-		    while (isspace(*next))
-			next++;
-		    content_length = 0;
-		    for (;(*next >= '0' && *next <= '9'); next++) {
-			if ((content_length * 10) < content_length)
-			    break;
-			content_length = (content_length * 10) + (*next - '0');
-		    }
-		    /* In the case of overflow or other error ignore
-		     * Content-Length.
-		     */
-		    if (*next)
-			content_length = -1;
-		}
-		else if (strcasecmp(field_name, "Location") == 0) {
-		    next = field_value;
-		    /* Skip leading whitespace */
-		    while (isspace(*next))
-			next++;
-		    strlcpy(location, next, sizeof location);
-		}
+		http_header_field(field_name, field_value, resp);
 		/* Start the field name and field value afress */
 		field_name_len = 1;
 		field_name[0] = ch;
@@ -373,33 +677,853 @@ void http_open(struct url_info *url, int flags, struct inode *inode,
     }
 
     if (state != st_eoh)
-	status = 0;
+	return 0;
 
-    switch (status) {
-    case 200:
-	/*
-	 * All OK, need to mark header data consumed and set up a file
-	 * structure...
-	 */
+    if (status != 200 && status != 206)
+	return status;
+
+    /*
+     * All OK, need to mark header data consumed and set up a file
+     * structure.  HTTP/1.1 keeps the connection unless told otherwise,
+     * 1.0 only if asked to; either way we have to know where the body
+     * ends.
+     */
+    socket->http_keepalive = resp->connection > 0 ||
+	(resp->connection < 0 && !strcmp(resp->httpver, "HTTP/1.1"));
+
+    if (resp->chunked) {
+	socket->http_state = HTTP_CHUNK_SIZE;
+	socket->http_left = 0;
+    } else if (resp->content_length != (uint32_t)-1) {
+	inode->size = resp->content_length;
+	socket->http_state = resp->content_length ? HTTP_BODY_DATA
+						  : HTTP_BODY_DONE;
+	socket->http_left = resp->content_length;
+    } else {
 	/* Treat the remainder of the bytes as data */
+	socket->http_keepalive = false;
 	socket->tftp_filepos -= response_size;
-	break;
+	return status;
+    }
+
+    /* What came after the header is the start of the body */
+    socket->http_rawptr = socket->tftp_dataptr;
+    socket->http_rawleft = socket->tftp_bytesleft;
+    socket->tftp_bytesleft = 0;
+    socket->tftp_filepos = 0;
+    if (socket->http_state == HTTP_BODY_DONE)
+	http_done(inode);
+
+    return status;
+}
+
+/*
+ * Large files come down over several connections at once, each
+ * asking for its own HTTP_RANGE_CHUNK of the file in turn.  lwIP
+ * receives on all of them while we read one, so every connection has
+ * its chunk on the way at any time; the chunks are handed out in order
+ * by cycling through the connections.  Between them they get one
+ * TCP_WND, which is what the pbuf pool is sized for.
+ */
+#define HTTP_RANGE_CONNS	4
+#define HTTP_RANGE_CHUNK	(TCP_WND / HTTP_RANGE_CONNS)
+#define HTTP_RANGE_MIN		(16 * HTTP_RANGE_CHUNK)
+
+static char http_location[FILENAME_MAX];
+
+/*
+ * Where redirects have sent us this session.  When the file asked for
+ * and the one redirected to have the same name, the directories they
+ * are in map onto each other: other files under the first are then
+ * asked for straight from the second, without the round trip.  Should
+ * that fail, the mapping goes, and pxe_fetch()'s retry asks the server
+ * that redirected again.  Both ends are "host:port/path", without the
+ * slash at the end.
+ */
+#define HTTP_REDIR_MAX	8
+
+struct http_redir {
+    char *from;
+    char *to;
+};
+
+static struct http_redir http_redirs[HTTP_REDIR_MAX];
+static int http_redir_next;		/* The slot to use next */
+
+/* Is url dir itself, or under it? */
+static bool http_under(const char *dir, const char *url)
+{
+    size_t len = strlen(dir);
+
+    return !strncmp(dir, url, len) && (!url[len] || url[len] == '/');
+}
+
+static struct http_redir *http_redir_find(const char *key)
+{
+    int i;
+
+    for (i = 0; i < HTTP_REDIR_MAX; i++) {
+	if (http_redirs[i].from && http_under(http_redirs[i].from, key))
+	    return &http_redirs[i];
+    }
+    return NULL;
+}
+
+static void http_redir_add(const char *key, const char *location)
+{
+    char buf[FILENAME_MAX], from[FILENAME_MAX], to[FILENAME_MAX];
+    struct http_redir *r;
+    struct url_info url;
+    char *fname, *tname;
+
+    strlcpy(buf, location, sizeof buf);
+    parse_url(&url, buf);
+    if (url.type != URL_NORMAL || strcmp(url.scheme, "http") || url.user)
+	return;
+    if (snprintf(to, sizeof to, "%s:%u/%s", url.host,
+		 url.port ? url.port : HTTP_PORT, url.path) >= (int)sizeof to)
+	return;
+    strlcpy(from, key, sizeof from);
+    if (strchr(from, '?') || strchr(to, '?'))
+	return;			/* Not a file in a directory */
+
+    fname = strrchr(from, '/');
+    tname = strrchr(to, '/');
+    if (strcmp(fname, tname))
+	return;
+    *fname = *tname = '\0';
+
+    /* One inside the other would apply to its own result */
+    if (http_under(from, to) || http_under(to, from))
+	return;
+
+    r = &http_redirs[http_redir_next];
+    free(r->from);
+    free(r->to);
+    r->from = strdup(from);
+    r->to = strdup(to);
+    if (!r->from || !r->to) {
+	free(r->from);
+	free(r->to);
+	r->from = r->to = NULL;
+	return;
+    }
+
+    dprintf("http: redirect cache %s -> %s\n", r->from, r->to);
+    http_redir_next = (http_redir_next + 1) % HTTP_REDIR_MAX;
+}
+
+/* A request for key failed; forget the mappings that sent it there */
+static void http_redir_drop(const char *key)
+{
+    struct http_redir *r;
+
+    for (r = http_redirs; r < http_redirs + HTTP_REDIR_MAX; r++) {
+	if (r->to && http_under(r->to, key)) {
+	    dprintf("http: redirect cache drops %s\n", r->from);
+	    free(r->from);
+	    free(r->to);
+	    r->from = r->to = NULL;
+	}
+    }
+}
+
+struct http_range {
+    char *req;			/* Request, up to where Range: goes */
+    int req_len;
+    uint32_t next;		/* Start of the next chunk to ask for */
+    int nconn;
+    int cur;			/* Connection the data comes from now */
+    struct inode *conn[HTTP_RANGE_CONNS];
+};
+
+static void http_range_free(struct inode *inode)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+    struct http_range *r = socket->http_range;
+    int i;
+
+    for (i = 0; i < r->nconn; i++) {
+	if (!PVT(r->conn[i])->tftp_goteof &&
+	    core_tcp_is_connected(PVT(r->conn[i])))
+	    core_tcp_close_file(r->conn[i]);
+	free_socket(r->conn[i]);
+    }
+
+    free(r->req);
+    free(r);
+    socket->http_range = NULL;
+}
+
+/*
+ * Ask for the next chunk on connection i; returns 0 on success
+ */
+static int http_range_request(struct inode *inode, int i)
+{
+    struct http_range *r = PVT(inode)->http_range;
+    struct inode *conn = r->conn[i];
+    struct http_response resp;
+    uint32_t start, end;
+    int len;
+
+    start = r->next;
+    end = min(start + HTTP_RANGE_CHUNK, inode->size);
+
+    len = r->req_len + sprintf(r->req + r->req_len,
+			       "Range: bytes=%u-%u\r\n\r\n", start, end - 1);
+
+    resp.location = http_location;
+    if (http_request(conn, r->req, len, &resp) != 206 ||
+	resp.range_start != start || conn->size != end - start)
+	return -1;
+
+    r->next = end;
+    return 0;
+}
+
+static void http_range_done(struct inode *inode)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+    char *tail;
+
+    /* The last data may be in a buffer of one of the connections */
+    if (socket->tftp_bytesleft) {
+	tail = malloc(socket->tftp_bytesleft);
+	if (!tail)
+	    return;		/* Try again once it is consumed */
+	memcpy(tail, socket->tftp_dataptr, socket->tftp_bytesleft);
+	free(socket->tftp_pktbuf);
+	socket->tftp_pktbuf = socket->tftp_dataptr = tail;
+    }
+
+    http_range_free(inode);
+    socket->tftp_goteof = 1;
+}
+
+static void http_range_fill_buffer(struct inode *inode)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+    struct http_range *r = socket->http_range;
+    struct pxe_pvt_inode *cs;
+    struct inode *conn;
+
+    for (;;) {
+	if (socket->tftp_filepos >= inode->size) {
+	    http_range_done(inode);
+	    return;
+	}
+
+	conn = r->conn[r->cur];
+	cs = PVT(conn);
+	if (!cs->tftp_bytesleft && !cs->tftp_goteof)
+	    cs->ops->fill_buffer(conn);
+
+	if (cs->tftp_bytesleft) {
+	    socket->tftp_dataptr = cs->tftp_dataptr;
+	    socket->tftp_bytesleft = cs->tftp_bytesleft;
+	    socket->tftp_filepos += cs->tftp_bytesleft;
+	    cs->tftp_bytesleft = 0;
+	    if (socket->tftp_filepos >= inode->size)
+		http_range_done(inode);
+	    return;
+	}
+
+	/* This chunk is done; have the connection go for another */
+	if (cs->tftp_filepos != conn->size ||
+	    (r->next < inode->size && http_range_request(inode, r->cur))) {
+	    printf("HTTP: ranged transfer failed\n");
+	    inode->size = socket->tftp_filepos;
+	    http_range_free(inode);
+	    socket->tftp_goteof = 1;
+	    return;
+	}
+
+	r->cur = (r->cur + 1) % r->nconn;
+    }
+}
+
+static void http_range_close_file(struct inode *inode)
+{
+    http_range_free(inode);
+}
+
+static const struct pxe_conn_ops http_range_conn_ops = {
+    .fill_buffer	= http_range_fill_buffer,
+    .close		= http_range_close_file,
+};
+
+/*
+ * Spread the rest of a big download over more connections.  The one
+ * we have is already sending the whole file; it gives us the first
+ * chunk and then goes away.
+ */
+static void http_range_start(struct inode *inode, int req_len)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+    struct http_range *r;
+    struct inode *conn;
+    int i;
+
+    r = zalloc(sizeof *r);
+    if (!r)
+	return;
+    r->req = malloc(req_len + 64);	/* Room for the Range: line */
+    if (!r->req)
+	goto bail;
+    memcpy(r->req, header_buf, req_len);
+    r->req_len = req_len;
+    socket->http_range = r;
+
+    for (i = 0; i < HTTP_RANGE_CONNS; i++) {
+	conn = new_socket(inode->fs);
+	if (!conn)
+	    break;
+	PVT(conn)->http_ip = socket->http_ip;
+	PVT(conn)->http_port = socket->http_port;
+	r->conn[i] = conn;
+	r->nconn = i + 1;
+
+	if (i == 0) {
+	    /* Hand our connection over, cut short at the first chunk */
+	    *PVT(conn) = *socket;
+	    PVT(conn)->tftp_pktbuf = NULL;
+	    PVT(conn)->http_range = NULL;
+	    PVT(conn)->http_left = HTTP_RANGE_CHUNK;
+	    PVT(conn)->http_keepalive = false;
+	    conn->size = HTTP_RANGE_CHUNK;
+	    memset(&socket->net, 0, sizeof socket->net);
+	    r->next = HTTP_RANGE_CHUNK;
+	} else if (http_range_request(inode, i)) {
+	    /* Do with what we have */
+	    if (core_tcp_is_connected(PVT(conn)))
+		core_tcp_close_file(conn);
+	    free_socket(conn);
+	    r->nconn = i;
+	    break;
+	}
+    }
+
+    if (r->nconn >= 2) {
+	socket->ops = &http_range_conn_ops;
+	return;
+    }
+
+    /* Not worth it; take the connection back if we gave it away */
+    if (r->nconn) {
+	socket->net = PVT(r->conn[0])->net;
+	free_socket(r->conn[0]);
+    }
+    free(r->req);
+bail:
+    free(r);
+    socket->http_range = NULL;
+}
+
+/*
+ * A gzip Content-Encoding is undone on the way to pxe_getfssec(): the
+ * body as framed by the ops underneath is fed through inflate, and
+ * what comes out is the file.  Its size is only known at the end.
+ */
+#define HTTP_GZIP_OUT	16384	/* Must fit tftp_bytesleft */
+
+struct http_gzip {
+    z_stream zs;
+    const struct pxe_conn_ops *inner;	/* What gets us the body */
+    uint32_t rawpos;		/* tftp_filepos of the inner ops */
+    bool raweof;		/* The body is all in */
+    char *out;
+};
+
+static const struct pxe_conn_ops http_gzip_conn_ops;
+
+/*
+ * Get the next piece of the encoded body into the decoder
+ */
+static void http_gzip_raw(struct inode *inode)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+    struct http_gzip *g = socket->http_gzip;
+    uint32_t filepos = socket->tftp_filepos;
+
+    /* The inner ops own the socket while they run */
+    socket->ops = g->inner;
+    socket->tftp_filepos = g->rawpos;
+    socket->tftp_bytesleft = 0;
+    socket->ops->fill_buffer(inode);
+
+    g->rawpos = socket->tftp_filepos;
+    g->raweof = socket->tftp_goteof;
+    g->zs.next_in = (Bytef *)socket->tftp_dataptr;
+    g->zs.avail_in = socket->tftp_bytesleft;
+
+    socket->ops = &http_gzip_conn_ops;
+    socket->tftp_filepos = filepos;
+    socket->tftp_bytesleft = 0;
+    socket->tftp_goteof = 0;
+    inode->size = -1;
+}
+
+static void http_gzip_free(struct inode *inode)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+    struct http_gzip *g = socket->http_gzip;
+
+    inflateEnd(&g->zs);
+    free(g->out);
+    free(g);
+    socket->http_gzip = NULL;
+}
+
+static void http_gzip_done(struct inode *inode, bool ok)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+    struct http_gzip *g = socket->http_gzip;
+
+    if (!ok) {
+	printf("HTTP: bad gzip data\n");
+	if (!g->raweof)
+	    g->inner->close(inode);
+	g->raweof = true;
+    }
+
+    /* Let the response run to its end so the connection can be reused */
+    while (!g->raweof)
+	http_gzip_raw(inode);
+
+    /* The last data stays in g->out; make it the packet buffer */
+    free(socket->tftp_pktbuf);
+    socket->tftp_pktbuf = g->out;
+    g->out = NULL;
+
+    socket->ops = g->inner;
+    http_gzip_free(inode);
+    socket->tftp_goteof = 1;
+    inode->size = socket->tftp_filepos;
+}
+
+static void http_gzip_fill_buffer(struct inode *inode)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+    struct http_gzip *g = socket->http_gzip;
+    uint32_t len;
+    int rv;
+
+    g->zs.next_out = (Bytef *)g->out;
+    g->zs.avail_out = HTTP_GZIP_OUT;
+
+    for (;;) {
+	if (!g->zs.avail_in) {
+	    if (g->raweof) {
+		rv = Z_DATA_ERROR;	/* Cut short */
+		break;
+	    }
+	    http_gzip_raw(inode);
+	    continue;
+	}
+
+	rv = inflate(&g->zs, Z_NO_FLUSH);
+	if (rv != Z_OK || g->zs.avail_out != HTTP_GZIP_OUT)
+	    break;
+    }
+
+    len = HTTP_GZIP_OUT - g->zs.avail_out;
+    socket->tftp_dataptr = g->out;
+    socket->tftp_bytesleft = len;
+    socket->tftp_filepos += len;
+
+    if (rv != Z_OK)
+	http_gzip_done(inode, rv == Z_STREAM_END);
+}
+
+static void http_gzip_close_file(struct inode *inode)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+    struct http_gzip *g = socket->http_gzip;
+
+    if (!g->raweof)
+	g->inner->close(inode);
+    http_gzip_free(inode);
+}
+
+static const struct pxe_conn_ops http_gzip_conn_ops = {
+    .fill_buffer	= http_gzip_fill_buffer,
+    .close		= http_gzip_close_file,
+    .readdir		= http_readdir,
+};
+
+/*
+ * Put the decoder in front of a response whose body is gzipped.  If
+ * we can't, the file is passed on as it came.
+ */
+static void http_gzip_start(struct inode *inode)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+    struct http_gzip *g;
+
+    g = zalloc(sizeof *g);
+    if (!g)
+	return;
+    g->out = malloc(HTTP_GZIP_OUT);
+    if (!g->out)
+	goto bail;
+    if (inflateInit2(&g->zs, 16 + MAX_WBITS) != Z_OK)
+	goto bail;
+
+    /* Whatever came with the header is the first of the input */
+    g->inner = socket->ops;
+    g->rawpos = socket->tftp_filepos;
+    g->raweof = socket->tftp_goteof;
+    g->zs.next_in = (Bytef *)socket->tftp_dataptr;
+    g->zs.avail_in = socket->tftp_bytesleft;
+
+    socket->http_gzip = g;
+    socket->ops = &http_gzip_conn_ops;
+    socket->tftp_filepos = 0;
+    socket->tftp_bytesleft = 0;
+    socket->tftp_goteof = 0;
+    inode->size = -1;
+    return;
+
+bail:
+    free(g->out);
+    free(g);
+}
+
+/*
+ * Files kept from one boot to the next by firmware->netcache, where
+ * there is one.  A request for a file there is a copy of asks whether
+ * it is still good, and on a 304 the copy is read instead.  Otherwise
+ * a response of known length and no Content-Encoding is written to it
+ * on the way to pxe_getfssec(), and kept if it all came.
+ */
+#define HTTP_CACHE_BUF	32768	/* Must fit tftp_bytesleft */
+
+struct http_cache {
+    void *h;			/* Of firmware->netcache */
+    const struct pxe_conn_ops *inner;	/* What gets us the body */
+    uint32_t size;		/* Of the file, as it should come */
+    char validator[HTTP_VALIDATOR_MAX];
+};
+
+static const struct pxe_conn_ops http_cache_read_conn_ops;
+static const struct pxe_conn_ops http_cache_tee_conn_ops;
+
+/* Quoted, or W/ and quoted, is an ETag; anything else is a date */
+static bool http_is_etag(const char *validator)
+{
+    return validator[0] == '"' || !strncmp(validator, "W/", 2);
+}
+
+/*
+ * The file is done with, or all of it has been written: keep the new
+ * copy if it is a whole one
+ */
+static void http_cache_end(struct inode *inode)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+    struct http_cache *c = socket->http_cache;
+    bool whole;
+
+    whole = socket->ops == &http_cache_tee_conn_ops &&
+	socket->tftp_goteof && socket->tftp_filepos == c->size;
+    firmware->netcache->close(c->h, whole ? c->validator : NULL, c->size);
+    if (socket->ops == &http_cache_tee_conn_ops)
+	socket->ops = c->inner;
+
+    free(c);
+    socket->http_cache = NULL;
+}
+
+static uint32_t http_cache_read(struct inode *inode, char *buf, uint32_t len)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+    struct http_cache *c = socket->http_cache;
+
+    len = firmware->netcache->read(c->h, buf, len, socket->tftp_filepos);
+    socket->tftp_filepos += len;
+    if (!len || socket->tftp_filepos >= inode->size) {
+	/* A copy that reads short is cut short */
+	inode->size = socket->tftp_filepos;
+	socket->tftp_goteof = 1;
+	http_cache_end(inode);
+    }
+    return len;
+}
+
+static void http_cache_fill_buffer(struct inode *inode)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+
+    if (!socket->tftp_pktbuf) {
+	socket->tftp_pktbuf = malloc(HTTP_CACHE_BUF);
+	if (!socket->tftp_pktbuf) {
+	    inode->size = socket->tftp_filepos;
+	    socket->tftp_goteof = 1;
+	    http_cache_end(inode);
+	    return;
+	}
+    }
+
+    socket->tftp_dataptr = socket->tftp_pktbuf;
+    socket->tftp_bytesleft = http_cache_read(inode, socket->tftp_pktbuf,
+					     HTTP_CACHE_BUF);
+}
+
+static const struct pxe_conn_ops http_cache_read_conn_ops = {
+    .fill_buffer	= http_cache_fill_buffer,
+    .read_direct	= http_cache_read,
+    .close		= http_cache_end,
+    .readdir		= http_readdir,
+};
+
+/* What the ops underneath have just put in the buffer goes to the copy */
+static void http_cache_write(struct inode *inode)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+    struct http_cache *c = socket->http_cache;
+
+    if (socket->tftp_bytesleft)
+	firmware->netcache->write(c->h, socket->tftp_dataptr,
+				  socket->tftp_bytesleft,
+				  socket->tftp_filepos - socket->tftp_bytesleft);
+    if (socket->tftp_goteof)
+	http_cache_end(inode);
+}
+
+static void http_cache_tee_fill_buffer(struct inode *inode)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+    struct http_cache *c = socket->http_cache;
+
+    /* The inner ops own the socket while they run */
+    socket->ops = c->inner;
+    socket->ops->fill_buffer(inode);
+    c->inner = socket->ops;
+    socket->ops = &http_cache_tee_conn_ops;
+
+    http_cache_write(inode);
+}
+
+static void http_cache_tee_close_file(struct inode *inode)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+    const struct pxe_conn_ops *inner = socket->http_cache->inner;
+
+    http_cache_end(inode);
+    inner->close(inode);
+}
+
+static const struct pxe_conn_ops http_cache_tee_conn_ops = {
+    .fill_buffer	= http_cache_tee_fill_buffer,
+    .close		= http_cache_tee_close_file,
+    .readdir		= http_readdir,
+};
+
+/*
+ * Serve the file from the copy that the server says is still good
+ */
+static void http_cache_serve(struct inode *inode, void *h, uint32_t size)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+    struct http_cache *c;
+
+    c = zalloc(sizeof *c);
+    if (!c) {
+	firmware->netcache->close(h, NULL, 0);
+	inode->size = 0;
+	return;
+    }
+    c->h = h;
+
+    dprintf("http: %u bytes from the cache\n", size);
+    socket->http_cache = c;
+    socket->ops = &http_cache_read_conn_ops;
+    socket->tftp_filepos = 0;
+    socket->tftp_bytesleft = 0;
+    socket->tftp_goteof = 0;
+    inode->size = size;
+    if (!size) {
+	socket->tftp_goteof = 1;
+	http_cache_end(inode);
+    }
+}
+
+/*
+ * Write the body on its way to a new copy, if it is one we can tell
+ * came whole
+ */
+static void http_cache_start(struct inode *inode, const char *key,
+			     const struct http_response *resp)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+    const char *validator;
+    struct http_cache *c;
+
+    validator = resp->etag[0] ? resp->etag : resp->last_modified;
+    if (!validator[0] || resp->gzip || inode->size == (uint32_t)-1)
+	return;
+
+    c = zalloc(sizeof *c);
+    if (!c)
+	return;
+    c->h = firmware->netcache->create(key);
+    if (!c->h) {
+	free(c);
+	return;
+    }
+    c->inner = socket->ops;
+    c->size = inode->size;
+    strcpy(c->validator, validator);
+
+    socket->http_cache = c;
+    socket->ops = &http_cache_tee_conn_ops;
+
+    /* Whatever is in the buffer already, and perhaps the end */
+    http_cache_write(inode);
+}
+
+void http_open(struct url_info *url, int flags, struct inode *inode,
+	       const char **redir)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+    struct netcache_ops *nc = firmware->netcache;
+    struct http_response resp;
+    struct http_redir *r;
+    char key[FILENAME_MAX];
+    char validator[HTTP_VALIDATOR_MAX];
+    void *cached = NULL;
+    uint32_t cached_size;
+    int header_bytes;
+    int req_len;
+    int status;
+
+    if (!header_buf)
+	return;			/* http is broken... */
+
+    if (!url->port)
+	url->port = HTTP_PORT;
+
+    if (snprintf(key, sizeof key, "%s:%u/%s", url->host, url->port,
+		 url->path) >= (int)sizeof key)
+	key[0] = '\0';		/* Too long to look up */
+    else if ((r = http_redir_find(key))) {
+	/* Where it went last time; the searchdir loop follows it */
+	snprintf(http_location, sizeof http_location, "http://%s%s",
+		 r->to, key + strlen(r->from));
+	*redir = http_location;
+	goto fail;
+    }
+
+    /* A directory listed before this session is served as it was */
+    if ((flags & O_DIRECTORY) && key[0] && http_listing_get(inode, key))
+	return;
+
+    if (nc && key[0])
+	cached = nc->open(key, validator, sizeof validator, &cached_size);
+
+    socket->http_ip = url->ip;
+    socket->http_port = url->port;
+
+    strcpy(header_buf, "GET /");
+    header_bytes = 5;
+    header_bytes += url_escape_unsafe(header_buf+5, url->path,
+				      header_len - 5);
+    if (header_bytes >= header_len)
+	goto fail;		/* Buffer overflow */
+    header_bytes += snprintf(header_buf + header_bytes,
+			     header_len - header_bytes,
+			     " HTTP/1.1\r\n"
+			     "Host: %s",
+			     url->host);
+    if (header_bytes >= header_len)
+	goto fail;		/* Buffer overflow */
+    if (url->port != HTTP_PORT) {
+	header_bytes += snprintf(header_buf + header_bytes,
+			     header_len - header_bytes,
+			     ":%d", url->port);
+	if (header_bytes >= header_len)
+	    goto fail;		/* Buffer overflow */
+    }
+    header_bytes += snprintf(header_buf + header_bytes,
+			     header_len - header_bytes,
+			     "\r\n"
+			     "User-Agent: Syslinux/" VERSION_STR "\r\n"
+			     "%s",
+			     cookie_buf ? cookie_buf : "");
+    req_len = header_bytes;	/* Ranged requests go on from here */
+    if (cached) {
+	header_bytes += snprintf(header_buf + header_bytes,
+				 header_len - header_bytes, "%s: %s\r\n",
+				 http_is_etag(validator) ? "If-None-Match"
+							 : "If-Modified-Since",
+				 validator);
+	if (header_bytes >= header_len)
+	    goto fail;		/* Buffer overflow */
+    }
+    header_bytes += snprintf(header_buf + header_bytes,
+			     header_len - header_bytes,
+			     "Accept-Encoding: gzip\r\n"
+			     "\r\n");
+    if (header_bytes >= header_len)
+	goto fail;		/* Buffer overflow */
+
+    resp.location = http_location;
+    status = http_request(inode, header_buf, header_bytes, &resp);
+
+    switch (status) {
+    case -1:
+	http_redir_drop(key);
+	if (cached)
+	    nc->close(cached, NULL, 0);
+	return;
+    case 200:
+	if (cached) {
+	    nc->close(cached, NULL, 0);	/* It has changed */
+	    cached = NULL;
+	}
+	if (resp.gzip) {
+	    if (!socket->tftp_goteof || socket->tftp_bytesleft)
+		http_gzip_start(inode);
+	} else if (resp.ranges && socket->http_state == HTTP_BODY_DATA &&
+		   inode->size >= HTTP_RANGE_MIN) {
+	    http_range_start(inode, req_len);
+	}
+	if (nc && key[0])
+	    http_cache_start(inode, key, &resp);
+	if (flags & O_DIRECTORY)
+	    http_listing_read(inode, key);
+	return;
+    case 304:
+	/* Not Modified: the copy we asked about is still good */
+	if (!cached)
+	    goto fail;
+	if (core_tcp_is_connected(socket))
+	    core_tcp_close_file(inode);
+	http_cache_serve(inode, cached, cached_size);
+	if (flags & O_DIRECTORY)
+	    http_listing_read(inode, key);
+	return;
     case 301:
     case 302:
     case 303:
     case 307:
 	/* A redirect */
-	if (!location[0])
+	if (!http_location[0])
 	    goto fail;
-	*redir = location;
+	if (key[0])
+	    http_redir_add(key, http_location);
+	*redir = http_location;
 	goto fail;
     default:
+	http_redir_drop(key);
 	goto fail;
 	break;
     }
-    return;
 fail:
+    if (cached)
+	nc->close(cached, NULL, 0);
     inode->size = 0;
-    core_tcp_close_file(inode);
+    if (core_tcp_is_connected(socket))
+	core_tcp_close_file(inode);
     return;
 }
@@ -17,50 +17,6 @@
 #include <dprintf.h>
 #include "pxe.h"
 
-enum http_readdir_state {
-    st_start,			/*  0 Initial state */
-    st_open,			/*  1 "<" */
-    st_a,			/*  2 "<a" */
-    st_attribute,		/*  3 "<a " */
-    st_h,			/*  4 "<a h" */
-    st_hr,			/*  5 */
-    st_hre,			/*  6 */
-    st_href,			/*  7 */
-    st_hrefeq,			/*  8 */
-    st_hrefqu,			/*  9 */
-    st_badtag,			/* 10 */
-    st_badtagqu,		/* 11 */
-    st_badattr,			/* 12 */
-    st_badattrqu,		/* 13 */
-};
-
-struct machine {
-    char xchar;
-    uint8_t st_xchar;
-    uint8_t st_left;		/* < */
-    uint8_t st_right;		/* > */
-    uint8_t st_space;		/* white */
-    uint8_t st_other;		/* anything else */
-};
-
-static const struct machine statemachine[] = {
-    /* xchar	st_xchar	st_left		st_right	st_space	st_other */
-    { 0,	0,		st_open,	st_start,	st_start,	st_start },
-    { 'a',	st_a,		st_badtag,	st_start,	st_open,	st_badtag },
-    { 0,	0,		st_open,	st_open,	st_attribute,	st_badtag },
-    { 'h',	st_h,		st_open,	st_start,	st_attribute,	st_badattr },
-    { 'r',	st_hr,		st_open,	st_start,	st_attribute,	st_badattr },
-    { 'e',	st_hre,		st_open,	st_start,	st_attribute,	st_badattr },
-    { 'f',	st_href,	st_open,	st_start,	st_attribute,	st_badattr },
-    { '=',	st_hrefeq,	st_open,	st_start,	st_attribute,	st_badattr },
-    { '\"',	st_hrefqu,	st_open,	st_start,	st_attribute,	st_hrefeq },
-    { '\"',	st_attribute,	st_hrefqu,	st_hrefqu,	st_hrefqu,	st_hrefqu },
-    { '\"',	st_badtagqu,	st_open,	st_start,	st_badtag,	st_badtag },
-    { '\"',	st_badtag,	st_badtagqu,	st_badtagqu,	st_badtagqu,	st_badtagqu },
-    { '\"',	st_badattrqu,	st_open,	st_start,	st_attribute,	st_badattr },
-    { '\"',	st_attribute,	st_badattrqu,	st_badattrqu,	st_badattrqu,	st_badattrqu },
-};
-
 struct html_entity {
     uint16_t ucs;
     const char entity[9];
@@ -382,90 +338,324 @@ static char *emit(char *p, int c, struct entity_state *st)
     return p;
 }
 
-static const char *http_get_filename(struct inode *inode, char *buf)
+/*
+ * A directory page, read and parsed whole: the names readdir hands out,
+ * each as its d_type, the name and a NUL.  The listings of the last few
+ * directories are kept by URL for the rest of the session, so listing
+ * one again doesn't go back to the server.
+ */
+struct http_listing {
+    int refcnt;
+    uint32_t size;		/* Of the page */
+    uint32_t len;		/* Of names */
+    char *names;
+    char key[];
+};
+
+#define HTTP_LISTINGS_MAX	8
+#define HTTP_PAGE_MAX		(4 << 20)	/* Bytes of HTML we look at */
+
+static struct http_listing *http_listings[HTTP_LISTINGS_MAX]; /* MRU first */
+
+static void http_listing_fill_buffer(struct inode *inode)
 {
-    int c, lc;
-    char *p;
-    const struct machine *sm;
-    struct entity_state es;
-    enum http_readdir_state state = st_start;
-    enum http_readdir_state pstate = st_start;
+    PVT(inode)->tftp_goteof = 1;
+}
 
-    memset(&es, 0, sizeof es);
+static void http_listing_close(struct inode *inode)
+{
+    (void)inode;
+}
 
-    p = buf;
-    for (;;) {
-	c = pxe_getc(inode);
-	if (c == -1)
-	    return NULL;
-
-	lc = tolower(c);
-
-	sm = &statemachine[state];
-
-	if (lc == sm->xchar)
-	    state = sm->st_xchar;
-	else if (c == '<')
-	    state = sm->st_left;
-	else if (c == '>')
-	    state = sm->st_right;
-	else if (isspace(c))
-	    state = sm->st_space;
-	else
-	    state = sm->st_other;
-
-	if (state == st_hrefeq || state == st_hrefqu) {
-	    if (state != pstate)
-		p = buf;
-	    else if (p < buf + FILENAME_MAX)
-		p = emit(p, c, &es);
-	    pstate = state;
-	} else {
-	    if (pstate != st_start)
-		pstate = st_start;
-	    if (p != buf && state == st_start) {
-		*p = '\0';
-		return buf;
+static const struct pxe_conn_ops http_listing_conn_ops = {
+    .fill_buffer	= http_listing_fill_buffer,
+    .close		= http_listing_close,
+    .readdir		= http_readdir,
+};
+
+static void http_listing_unref(struct http_listing *l)
+{
+    if (--l->refcnt)
+	return;
+    free(l->names);
+    free(l);
+}
+
+void http_listing_put(struct inode *inode)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+
+    http_listing_unref(socket->http_listing);
+    socket->http_listing = NULL;
+}
+
+static void http_listing_attach(struct inode *inode, struct http_listing *l)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+
+    socket->http_listing = l;
+    socket->http_listpos = 0;
+    socket->ops = &http_listing_conn_ops;
+    socket->tftp_goteof = 1;
+    socket->tftp_bytesleft = 0;
+    inode->size = l->size;
+}
+
+/*
+ * Serve a directory from the listing kept for key, if there is one
+ */
+bool http_listing_get(struct inode *inode, const char *key)
+{
+    struct http_listing *l;
+    int i;
+
+    for (i = 0; i < HTTP_LISTINGS_MAX && http_listings[i]; i++) {
+	l = http_listings[i];
+	if (strcmp(l->key, key))
+	    continue;
+
+	memmove(&http_listings[1], &http_listings[0], i * sizeof l);
+	http_listings[0] = l;
+	l->refcnt++;
+	http_listing_attach(inode, l);
+	dprintf("http: listing of %s from the cache\n", key);
+	return true;
+    }
+
+    return false;
+}
+
+static void http_listing_keep(struct http_listing *l)
+{
+    int i;
+
+    for (i = 0; i < HTTP_LISTINGS_MAX - 1 && http_listings[i]; i++) {
+	if (!strcmp(http_listings[i]->key, l->key))
+	    break;		/* Replace an older copy */
+    }
+    if (http_listings[i])
+	http_listing_unref(http_listings[i]);
+
+    memmove(&http_listings[1], &http_listings[0], i * sizeof l);
+    http_listings[0] = l;
+    l->refcnt++;
+}
+
+/*
+ * Find the next href value of an <a> tag from *pp on, and set *pp past
+ * it.  Tags are found with memchr() rather than by looking at every
+ * byte; a value may be quoted, and may then contain '>'.
+ */
+static const char *http_next_href(const char **pp, const char *end,
+				  const char **vend)
+{
+    const char *p = *pp;
+    const char *name, *val;
+    bool is_href;
+    char q;
+
+    while ((p = memchr(p, '<', end - p))) {
+	p++;
+	if (end - p < 2 || (*p | 0x20) != 'a' || !isspace((unsigned char)p[1]))
+	    continue;
+	p += 2;
+
+	while (p < end && *p != '>' && *p != '<') {
+	    if (isspace((unsigned char)*p)) {
+		p++;
+		continue;
+	    }
+
+	    name = p;
+	    while (p < end && *p != '=' && *p != '>' && *p != '<' &&
+		   !isspace((unsigned char)*p))
+		p++;
+	    if (p >= end || *p != '=')
+		continue;
+	    is_href = p - name == 4 && !strncasecmp(name, "href", 4);
+
+	    p++;
+	    if (p < end && (*p == '"' || *p == '\'')) {
+		q = *p++;
+		val = p;
+		p = memchr(p, q, end - p);
+		if (!p)
+		    return NULL;
+		*vend = p++;
+	    } else {
+		val = p;
+		while (p < end && *p != '>' && !isspace((unsigned char)*p))
+		    p++;
+		*vend = p;
+	    }
+
+	    if (is_href) {
+		*pp = p;
+		return val;
 	    }
 	}
     }
+
+    return NULL;
 }
 
-int http_readdir(struct inode *inode, struct dirent *dirent)
+/*
+ * The length of the directory entry name fn stands for, and its type;
+ * -1 if it isn't one
+ */
+static int http_dirent_name(const char *fn, int *type)
+{
+    const char *sp;
+
+    /* Ignore entries with http special characters */
+    if (strchr(fn, '#'))
+	return -1;
+    if (strchr(fn, '?'))
+	return -1;
+
+    /* A slash if present has to be the last character, and not the first */
+    sp = strchr(fn, '/');
+    if (sp) {
+	if (sp == fn || sp[1])
+	    return -1;
+    } else {
+	sp = strchr(fn, '\0');
+    }
+
+    if (sp > fn + NAME_MAX)
+	return -1;
+
+    *type = *sp == '/' ? DT_DIR : DT_REG;
+    return sp - fn;
+}
+
+static bool http_listing_add(struct http_listing *l, uint32_t *max,
+			     const char *fn)
 {
+    int len, type;
+    char *names;
+
+    len = http_dirent_name(fn, &type);
+    if (len < 0)
+	return true;
+
+    if (l->len + len + 2 > *max) {
+	uint32_t n = *max ? *max : 1024;
+
+	while (n < l->len + len + 2)
+	    n <<= 1;
+	names = realloc(l->names, n);
+	if (!names)
+	    return false;
+	l->names = names;
+	*max = n;
+    }
+
+    l->names[l->len] = type;
+    memcpy(l->names + l->len + 1, fn, len);
+    l->names[l->len + len + 1] = '\0';
+    l->len += len + 2;
+    return true;
+}
+
+/*
+ * Read the rest of the directory page, parse it, and from now on serve
+ * readdir from the result.  If key isn't empty the listing is kept for
+ * the next time that directory is opened.
+ */
+void http_listing_read(struct inode *inode, const char *key)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+    struct http_listing *l;
+    struct entity_state es;
     char buf[FILENAME_MAX + 6];
-    const char *fn, *sp;
+    char *page = NULL;
+    char *np, *p;
+    const char *v, *vend, *pp, *end;
+    size_t len = 0, max = 0, n;
+    uint32_t nmax = 0;
+    bool full = false;
 
+    /* All of it, so that the connection is finished with */
     for (;;) {
-	fn = http_get_filename(inode, buf);
+	while (!socket->tftp_bytesleft && !socket->tftp_goteof)
+	    socket->ops->fill_buffer(inode);
+	n = socket->tftp_bytesleft;
+	if (!n)
+	    break;
 
-	if (!fn)
-	    return -1;		/* End of directory */
-
-	/* Ignore entries with http special characters */
-	if (strchr(fn, '#'))
-	    continue;
-	if (strchr(fn, '?'))
-	    continue;
+	if (!full && len + n > max) {
+	    size_t m = max ? max : 16384;
 
-	/* A slash if present has to be the last character, and not the first */
-	sp = strchr(fn, '/');
-	if (sp) {
-	    if (sp == fn || sp[1])
-		continue;
-	} else {
-	    sp = strchr(fn, '\0');
+	    while (m < len + n)
+		m <<= 1;
+	    np = m <= HTTP_PAGE_MAX ? realloc(page, m) : NULL;
+	    if (np) {
+		page = np;
+		max = m;
+	    } else {
+		full = true;	/* Make do with the first part */
+	    }
+	}
+	if (!full) {
+	    memcpy(page + len, socket->tftp_dataptr, n);
+	    len += n;
 	}
+	socket->tftp_dataptr += n;
+	socket->tftp_bytesleft = 0;
+    }
 
-	if (sp > fn + NAME_MAX)
-	    continue;
+    l = malloc(sizeof *l + strlen(key) + 1);
+    if (!l) {
+	free(page);
+	return;
+    }
+    l->refcnt = 1;
+    l->size = inode->size;
+    l->len = 0;
+    l->names = NULL;
+    strcpy(l->key, key);
 
-	dirent->d_ino = 0;	/* Not applicable */
-	dirent->d_off = 0;	/* Not applicable */
-	dirent->d_reclen = offsetof(struct dirent, d_name) + (sp-fn) + 1;
-	dirent->d_type = *sp == '/' ? DT_DIR : DT_REG;
-	memcpy(dirent->d_name, fn, sp-fn);
-	dirent->d_name[sp-fn] = '\0';
-	return 0;
+    pp = page;
+    end = page + len;
+    while (page && (v = http_next_href(&pp, end, &vend))) {
+	memset(&es, 0, sizeof es);
+	for (p = buf; v < vend && p < buf + FILENAME_MAX; v++)
+	    p = emit(p, *v, &es);
+	*p = '\0';
+	if (!http_listing_add(l, &nmax, buf))
+	    break;
     }
+    free(page);
+
+    dprintf("http: %zu bytes of listing, %u bytes of names\n", len, l->len);
+
+    http_listing_attach(inode, l);
+    if (key[0])
+	http_listing_keep(l);
+}
+
+int http_readdir(struct inode *inode, struct dirent *dirent)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+    const struct http_listing *l;
+    const char *p;
+    size_t len;
+
+    if (!socket->http_listing)
+	http_listing_read(inode, "");
+    l = socket->http_listing;
+    if (!l || socket->http_listpos >= l->len)
+	return -1;		/* End of directory */
+
+    p = l->names + socket->http_listpos;
+    len = strlen(p + 1);
+    socket->http_listpos += len + 2;
+
+    dirent->d_ino = 0;	/* Not applicable */
+    dirent->d_off = 0;	/* Not applicable */
+    dirent->d_reclen = offsetof(struct dirent, d_name) + len + 1;
+    dirent->d_type = p[0];
+    memcpy(dirent->d_name, p + 1, len + 1);
+    return 0;
 }
@@ -9,6 +9,7 @@
 #include "thread.h"
 #include "pxe.h"
 #include <string.h>
+#include <minmax.h>
 #include <sys/cpu.h>
 #include <sys/io.h>
 
@@ -16,8 +17,21 @@ extern uint8_t pxe_irq_pending;
 extern volatile uint8_t pxe_need_poll;
 static DECLARE_INIT_SEMAPHORE(pxe_receive_thread_sem, 0);
 static DECLARE_INIT_SEMAPHORE(pxe_poll_thread_sem, 0);
+static DECLARE_INIT_SEMAPHORE(pxe_poll_nap_sem, 0);
 static struct thread *pxe_thread, *poll_thread;
 
+/*
+ * When polling, this many polls in a row must come up empty before the
+ * poll thread starts napping between polls.  Naps start at the minimum
+ * and double up to the maximum; they end on a timer tick (every 55 ms),
+ * with the CPU halted in the idle thread in the meantime.
+ */
+#ifndef PXE_POLL_SPIN
+#  define PXE_POLL_SPIN		256
+#endif
+#define PXE_POLL_NAP_MIN	1	/* ms */
+#define PXE_POLL_NAP_MAX	128	/* ms */
+
 #ifndef PXE_POLL_FORCE
 #  define PXE_POLL_FORCE 0
 #endif
@@ -140,6 +154,12 @@ static void pxe_poll_wakeups(void)
     }
 }
 
+/*
+ * Drain every frame the UNDI stack has for us, then hand them to lwIP
+ * in one batch.  Each PXENV_UNDI_ISR call would normally reschedule on
+ * the way back from real mode; we are the thread that would be picked
+ * anyway, so that is put off until the drain is done.
+ */
 static void pxe_process_irq(void)
 {
     static __lowmem t_PXENV_UNDI_ISR isr;
@@ -147,6 +167,8 @@ static void pxe_process_irq(void)
     uint16_t func = PXENV_UNDI_ISR_IN_PROCESS; /* First time */
     bool done = false;
 
+    core_pm_hook = core_pm_null_hook;
+
     while (!done) {
         memset(&isr, 0, sizeof isr);
         isr.FuncFlag = func;
@@ -178,6 +200,9 @@ static void pxe_process_irq(void)
 	    break;
         }
     }
+
+    core_pm_hook = __schedule;
+    undiif_input_flush();
 }
 
 static void pxe_receive_thread(void *dummy)
@@ -202,6 +227,9 @@ static bool pxe_isr_poll(void)
 
 static void pxe_poll_thread(void *dummy)
 {
+    unsigned int empty = 0;
+    mstime_t nap = 0;
+
     (void)dummy;
 
     /* Block indefinitely unless activated */
@@ -209,15 +237,44 @@ static void pxe_poll_thread(void *dummy)
 
     for (;;) {
 	cli();
-	if (pxe_receive_thread_sem.count < 0 && pxe_isr_poll())
+	if (pxe_receive_thread_sem.count >= 0) {
+	    /* The receive thread is still busy with the last lot */
+	    __schedule();
+	} else if (pxe_isr_poll()) {
 	    sem_up(&pxe_receive_thread_sem);
-	else
+	    empty = 0;
+	    nap = 0;
+	} else if (++empty < PXE_POLL_SPIN) {
 	    __schedule();
+	} else {
+	    /* Idle link: sleep until a timer tick or pxe_poll_kick() */
+	    nap = nap ? min(nap << 1, PXE_POLL_NAP_MAX) : PXE_POLL_NAP_MIN;
+	    sti();
+	    if (sem_down(&pxe_poll_nap_sem, nap) != (mstime_t)-1) {
+		empty = 0;
+		nap = 0;
+	    }
+	    continue;
+	}
 	sti();
 	cpu_relax();
     }
 }
 
+/*
+ * We just sent something, so there is likely to be an answer soon;
+ * go back to polling flat out.
+ */
+void pxe_poll_kick(void)
+{
+    irq_state_t irq = irq_save();
+
+    if (pxe_poll_nap_sem.count < 0)
+	sem_up(&pxe_poll_nap_sem);
+
+    irq_restore(irq);
+}
+
 /*
  * This does preparations and enables the PXE thread
  */
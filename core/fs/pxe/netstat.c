@@ -0,0 +1,84 @@
+/*
+ * netstat.c
+ *
+ * How the network transfers went: per file counters kept here, UDP and
+ * TCP counters from the network stack.  netstat.c32 shows them, and
+ * SYSAPPEND 0x80000 passes a summary on to the kernel.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <core.h>
+#include <net.h>
+#include <syslinux/sysappend.h>
+#include "pxe.h"
+
+struct pxe_net_counters pxe_net_counters;
+
+/*
+ * NETSTAT=files,KiB,ms,tftp timeouts,tftp duplicates,
+ *         tcp retransmits,tcp duplicates,tcp stalls
+ */
+static char netstat_str[8 + 8 * 11];
+
+static void netstat_sysappend(void)
+{
+    struct com32_net_stats st;
+
+    pxe_net_stats(&st);
+    snprintf(netstat_str, sizeof netstat_str,
+	     "NETSTAT=%u,%llu,%u,%u,%u,%u,%u,%u",
+	     st.files, (unsigned long long)(st.bytes >> 10), st.xfer_ms,
+	     st.tftp_timeouts, st.tftp_dupblocks,
+	     st.tcp_rexmits, st.tcp_dupsegs, st.tcp_stalls);
+    sysappend_set(SYSAPPEND_NETSTAT, netstat_str);
+}
+
+/*
+ * A file was opened over the network at ms_timer() == start
+ */
+void pxe_stats_open(struct inode *inode, uint32_t start)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+
+    socket->stat_opened = start;
+    socket->stat_counted = 1;
+}
+
+/*
+ * Called as a socket goes away; sockets not marked by pxe_stats_open()
+ * (files handed out of memory by prefetch.c, say) don't count.
+ */
+void pxe_stats_close(struct inode *inode)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+    struct pxe_net_counters *c = &pxe_net_counters;
+
+    if (!socket->stat_counted)
+	return;
+
+    c->files++;
+    c->last_bytes = socket->tftp_filepos;
+    c->last_ms = ms_timer() - socket->stat_opened;
+    c->bytes += c->last_bytes;
+    c->xfer_ms += c->last_ms;
+
+    netstat_sysappend();
+}
+
+int pxe_net_stats(struct com32_net_stats *st)
+{
+    const struct pxe_net_counters *c = &pxe_net_counters;
+
+    memset(st, 0, sizeof *st);
+    st->bytes          = c->bytes;
+    st->files          = c->files;
+    st->xfer_ms        = c->xfer_ms;
+    st->last_bytes     = c->last_bytes;
+    st->last_ms        = c->last_ms;
+    st->tftp_timeouts  = c->tftp_timeouts;
+    st->tftp_dupblocks = c->tftp_dupblocks;
+    net_core_stats(st);
+
+    return 0;
+}
@@ -0,0 +1,333 @@
+/*
+ * core/fs/pxe/prefetch.c
+ *
+ * Background prefetch: files we are told are going to be wanted soon
+ * (the default entry while a menu counts down, or the kernel, initrds
+ * and modules a loader is about to read one after the other) are read
+ * into memory by a few threads of their own, several at a time, each
+ * over a connection of its own.  If they are asked for, they come from
+ * there; the first open of anything else drops whatever was
+ * prefetched, so that the network is left to the open.
+ *
+ * A prefetched file stays until it has been read to the end: loaders
+ * often open a file once just to see how big it is.
+ *
+ * This needs the lwIP stack: the prefetch threads only get to run
+ * because the menu and the network both keep passing through the
+ * scheduler.
+ */
+
+#include <dprintf.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <minmax.h>
+#include <core.h>
+#include <fs.h>
+#include <sys/cpu.h>
+#include "pxe.h"
+#include "thread.h"
+#include "url.h"
+
+#define PREFETCH_MAX	64	/* Files queued at a time */
+#define PREFETCH_THREADS 4	/* Files fetched at a time */
+
+enum prefetch_state {
+    PF_FREE,
+    PF_QUEUED,
+    PF_BUSY,
+    PF_DONE,
+    PF_FAILED,
+};
+
+struct prefetch {
+    volatile uint8_t state;	/* enum prefetch_state */
+    uint8_t stale;		/* Not to be handed out again */
+    uint16_t users;		/* Sockets reading buf */
+    char *name;			/* Full path */
+    char *buf;
+    uint32_t size;
+};
+
+static struct prefetch prefetch_list[PREFETCH_MAX];
+static struct fs_info *prefetch_fs;
+static int prefetch_threads;
+static volatile bool prefetch_cancel;
+static DECLARE_INIT_SEMAPHORE(prefetch_work, 0);
+static DECLARE_INIT_SEMAPHORE(prefetch_done, 0);
+
+static bool prefetch_path(struct fs_info *fs, char *dst, const char *name)
+{
+    return snprintf(dst, FILENAME_MAX, "%s%s",
+		    url_type(name) == URL_SUFFIX ? fs->cwd_name : "",
+		    name) < FILENAME_MAX;
+}
+
+static struct prefetch *prefetch_find(const char *path)
+{
+    struct prefetch *e;
+
+    for (e = prefetch_list; e < prefetch_list + PREFETCH_MAX; e++) {
+	if (e->state != PF_FREE && !e->stale && !strcmp(e->name, path))
+	    return e;
+    }
+
+    return NULL;
+}
+
+static void prefetch_free(struct prefetch *e)
+{
+    free(e->buf);
+    e->buf = NULL;
+    free(e->name);
+    e->name = NULL;
+    e->stale = false;
+    e->state = PF_FREE;
+}
+
+/* Free it now, or if it is being read, when the last reader is done */
+static void prefetch_drop(struct prefetch *e)
+{
+    if (e->users)
+	e->stale = true;
+    else
+	prefetch_free(e);
+}
+
+/* The first file in the queue, now ours to fetch */
+static struct prefetch *prefetch_claim(void)
+{
+    struct prefetch *e;
+    irq_state_t irq = irq_save();
+
+    for (e = prefetch_list; e < prefetch_list + PREFETCH_MAX; e++) {
+	if (e->state == PF_QUEUED) {
+	    e->state = PF_BUSY;
+	    break;
+	}
+    }
+
+    irq_restore(irq);
+    return e < prefetch_list + PREFETCH_MAX ? e : NULL;
+}
+
+/*
+ * Read a whole file into memory; returns true if all of it came in
+ */
+static bool prefetch_read(struct prefetch *e)
+{
+    struct file file;
+    struct inode *inode;
+    struct pxe_pvt_inode *socket;
+    uint32_t len = 0, alloc = 0;
+    char *buf;
+    bool ok = false;
+
+    memset(&file, 0, sizeof file);
+    file.fs = prefetch_fs;
+    pxe_fetch(e->name, O_RDONLY, &file);
+    inode = file.inode;
+    if (!inode)
+	return false;
+    socket = PVT(inode);
+
+    if (inode->size != (uint64_t)-1)
+	alloc = inode->size;
+
+    for (;;) {
+	if (prefetch_cancel)
+	    break;
+
+	if (!socket->tftp_bytesleft) {
+	    if (socket->tftp_goteof) {
+		ok = len == inode->size;
+		break;
+	    }
+	    socket->ops->fill_buffer(inode);
+	    continue;
+	}
+
+	if (len + socket->tftp_bytesleft > alloc || !e->buf) {
+	    /* Size unknown, or more than we were told */
+	    alloc = max(max(alloc, 2 * len), len + socket->tftp_bytesleft);
+	    buf = realloc(e->buf, alloc);
+	    if (!buf)
+		break;
+	    e->buf = buf;
+	}
+
+	memcpy(e->buf + len, socket->tftp_dataptr, socket->tftp_bytesleft);
+	len += socket->tftp_bytesleft;
+	socket->tftp_bytesleft = 0;
+    }
+
+    if (!socket->tftp_goteof)
+	socket->ops->close(inode);
+    free_socket(inode);
+
+    e->size = len;
+    return ok && len;
+}
+
+static void prefetch_thread_func(void *dummy)
+{
+    struct prefetch *e;
+
+    (void)dummy;
+
+    for (;;) {
+	sem_down(&prefetch_work, 0);
+
+	/* One file per sem_up(), whichever thread gets there first */
+	e = prefetch_claim();
+	if (!e)
+	    continue;
+
+	if (!prefetch_cancel && prefetch_read(e)) {
+	    dprintf("prefetch: %s, %u bytes\n", e->name, e->size);
+	    e->state = PF_DONE;
+	} else {
+	    e->state = PF_FAILED;
+	}
+	sem_up(&prefetch_done);
+    }
+}
+
+/*
+ * Cut the threads short and drop everything they have
+ */
+static void prefetch_drop_all(void)
+{
+    struct prefetch *e;
+
+    prefetch_cancel = true;
+    for (e = prefetch_list; e < prefetch_list + PREFETCH_MAX; e++) {
+	while (e->state == PF_QUEUED || e->state == PF_BUSY)
+	    sem_down(&prefetch_done, 0);
+	if (e->state != PF_FREE)
+	    prefetch_drop(e);
+    }
+    prefetch_cancel = false;
+}
+
+/*
+ * Queue a file for fetching in the background
+ */
+void pxe_prefetch_file(struct fs_info *fs, const char *name)
+{
+    char path[FILENAME_MAX];
+    struct prefetch *e;
+
+    if (!prefetch_path(fs, path, name) || prefetch_find(path))
+	return;
+
+    for (e = prefetch_list; e < prefetch_list + PREFETCH_MAX; e++) {
+	if (e->state == PF_FREE)
+	    break;
+    }
+    if (e == prefetch_list + PREFETCH_MAX)
+	return;			/* Enough is queued already */
+
+    /* One more thread for each file queued, up to PREFETCH_THREADS */
+    if (prefetch_threads < PREFETCH_THREADS) {
+	prefetch_fs = fs;
+	/* Same priority as the menu, so they all take turns */
+	if (start_thread("pxe prefetch", 16384, 0,
+			 prefetch_thread_func, NULL))
+	    prefetch_threads++;
+	if (!prefetch_threads)
+	    return;
+    }
+
+    e->name = strdup(path);
+    if (!e->name)
+	return;
+    e->size = 0;
+    e->state = PF_QUEUED;
+    sem_up(&prefetch_work);
+}
+
+static void prefetch_fill_buffer(struct inode *inode)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+    uint32_t len;
+
+    /* tftp_bytesleft is 16 bits; hand the buffer out in pieces */
+    len = min(inode->size - socket->tftp_filepos, 0x8000);
+    socket->tftp_dataptr = socket->prefetch->buf + socket->tftp_filepos;
+    socket->tftp_bytesleft = len;
+    socket->tftp_filepos += len;
+    if (socket->tftp_filepos == inode->size)
+	socket->tftp_goteof = 1;
+}
+
+static void prefetch_close_file(struct inode *inode)
+{
+    (void)inode;		/* pxe_prefetch_put() does it all */
+}
+
+static const struct pxe_conn_ops prefetch_conn_ops = {
+    .fill_buffer	= prefetch_fill_buffer,
+    .close		= prefetch_close_file,
+};
+
+/*
+ * Called on every open: hand out the file if we have it, waiting for
+ * it if it is still on its way.  Returns false if the open has to go
+ * to the network after all.
+ */
+bool pxe_prefetch_take(const char *filename, int flags, struct file *file)
+{
+    char path[FILENAME_MAX];
+    struct prefetch *e = NULL;
+    struct inode *inode;
+    struct pxe_pvt_inode *socket;
+
+    if (!prefetch_threads)
+	return false;		/* Nothing was ever asked for */
+
+    if (!(flags & O_DIRECTORY) && prefetch_path(file->fs, path, filename))
+	e = prefetch_find(path);
+    if (!e) {
+	prefetch_drop_all();
+	return false;
+    }
+
+    while (e->state == PF_QUEUED || e->state == PF_BUSY)
+	sem_down(&prefetch_done, 0);
+
+    if (e->state != PF_DONE) {
+	prefetch_drop(e);
+	return false;
+    }
+
+    inode = new_socket(file->fs);
+    if (!inode)
+	return false;
+
+    /* The buffer stays ours; the socket only reads it */
+    socket = PVT(inode);
+    socket->ops = &prefetch_conn_ops;
+    socket->prefetch = e;
+    inode->size = e->size;
+    inode->mode = DT_REG;
+    file->inode = inode;
+    e->users++;
+    return true;
+}
+
+/*
+ * Called by free_socket(): a socket pxe_prefetch_take() handed out is
+ * going away.  If it was read to the end, the file is done with.
+ */
+void pxe_prefetch_put(struct inode *inode)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+    struct prefetch *e = socket->prefetch;
+
+    socket->prefetch = NULL;
+    if (socket->tftp_goteof && !socket->tftp_bytesleft)
+	e->stale = true;
+    if (!--e->users && e->stale)
+	prefetch_free(e);
+}
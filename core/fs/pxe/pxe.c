@@ -5,11 +5,13 @@
 #include <fs.h>
 #include <fcntl.h>
 #include <sys/cpu.h>
+#include <slab.h>
 #include "pxe.h"
 #include "thread.h"
 #include "url.h"
 #include "tftp.h"
 #include <net.h>
+#include <lwip/opt.h>		/* DNS_MAX_SERVERS */
 
 __lowmem t_PXENV_UNDI_GET_INFORMATION pxe_undi_info;
 __lowmem t_PXENV_UNDI_GET_IFACE_INFO  pxe_undi_iface;
@@ -23,13 +25,37 @@ char path_prefix[256];		   /* From DHCP */
 
 bool have_uuid = false;
 
+/*
+ * Every file, idle and control connection is one of these; they come
+ * and go with each open, so they have a slab cache of their own.
+ */
+#define PXE_SOCKET_CHUNK	8
+
+static DECLARE_SLAB_CACHE(pxe_socket_slab,
+			  sizeof(struct inode) + sizeof(struct pxe_pvt_inode),
+			  PXE_SOCKET_CHUNK);
+
+/*
+ * Get a new socket inode; must be released with free_socket()
+ */
+struct inode *new_socket(struct fs_info *fs)
+{
+    struct inode *inode = slab_zalloc(&pxe_socket_slab);
+
+    if (inode) {
+	inode->fs = fs;
+	inode->refcnt = 1;
+    }
+    return inode;
+}
+
 /*
  * Allocate a local UDP port structure and assign it a local port number.
  * Return the inode pointer if success, or null if failure
  */
 static struct inode *allocate_socket(struct fs_info *fs)
 {
-    struct inode *inode = alloc_inode(fs, 0, sizeof(struct pxe_pvt_inode));
+    struct inode *inode = new_socket(fs);
 
     if (!inode) {
 	malloc_error("socket structure");
@@ -44,8 +70,13 @@ void free_socket(struct inode *inode)
 {
     struct pxe_pvt_inode *socket = PVT(inode);
 
+    pxe_stats_close(inode);
+    if (socket->prefetch)
+	pxe_prefetch_put(inode);
+    if (socket->http_listing)
+	http_listing_put(inode);
     free(socket->tftp_pktbuf);	/* If we allocated a buffer, free it now */
-    free_inode(inode);
+    slab_free(&pxe_socket_slab, inode);
 }
 
 static void pxe_close_file(struct file *file)
@@ -204,6 +235,18 @@ static uint32_t pxe_getfssec(struct file *file, char *buf,
 
     count <<= TFTP_BLOCKSIZE_LG2;
     while (count) {
+	/* Skip the bounce through the packet buffer if we can */
+	if (!socket->tftp_bytesleft && !socket->tftp_goteof &&
+	    socket->ops->read_direct) {
+	    chunk = socket->ops->read_direct(inode, buf, count);
+	    if (chunk) {
+		buf += chunk;
+		bytes_read += chunk;
+		count -= chunk;
+		continue;
+	    }
+	}
+
         fill_buffer(inode); /* If we have no 'fresh' buffer, get it */
         if (!socket->tftp_bytesleft)
             break;
@@ -270,15 +313,25 @@ __export int url_set_ip(struct url_info *url)
 static void __pxe_searchdir(const char *filename, int flags, struct file *file);
 extern uint16_t PXERetry;
 
-static void pxe_searchdir(const char *filename, int flags, struct file *file)
+void pxe_fetch(const char *filename, int flags, struct file *file)
 {
     int i = PXERetry;
+    uint32_t start = ms_timer();
 
     do {
 	dprintf("PXE: file = %p, retries left = %d: ", file, i);
 	__pxe_searchdir(filename, flags, file);
 	dprintf("%s\n", file->inode ? "ok" : "failed");
     } while (!file->inode && i--);
+
+    if (file->inode)
+	pxe_stats_open(file->inode, start);
+}
+
+static void pxe_searchdir(const char *filename, int flags, struct file *file)
+{
+    if (!pxe_prefetch_take(filename, flags, file))
+	pxe_fetch(filename, flags, file);
 }
 static void __pxe_searchdir(const char *filename, int flags, struct file *file)
 {
@@ -312,6 +365,8 @@ static void __pxe_searchdir(const char *filename, int flags, struct file *file)
 	    parse_url(&url, fullpath);
 	}
 
+	if (inode)
+	    free_socket(inode);		/* The one that was redirected */
 	inode = allocate_socket(fs);
 	if (!inode)
 	    return;			/* Allocation failure */
@@ -439,14 +494,36 @@ static int pxe_chdir_start(void)
 	return 0;
 }
 
+/*
+ * Ask the server about all the config file candidates in dir at once;
+ * only TFTP can do that.  Returns the index of the first candidate to
+ * try opening, n if there is none to try.
+ */
+static int pxe_probe_config(const char *dir, const char * const *names,
+			    int n)
+{
+    char fullpath[2*FILENAME_MAX];
+    struct url_info url;
+
+    snprintf(fullpath, sizeof fullpath, "%s%s", this_fs->cwd_name, dir);
+    parse_url(&url, fullpath);
+    if (!url.scheme || strcmp(url.scheme, "tftp"))
+	return 0;
+    if (url_set_ip(&url) != -ntohs(TFTP_OK))
+	return 0;
+
+    return tftp_probe(&url, names, n);
+}
+
 /* Load the config file, return -1 if failed, or 0 */
 static int pxe_open_config(struct com32_filedata *filedata)
 {
     const char *cfgprefix = "pxelinux.cfg/";
-    const char *default_str = "default";
+    const char *names[TFTP_PROBE_MAX];
+    char hexip[8][9];
     char *config_file;
-    char *last;
-    int tries = 8;
+    int n = 0;
+    int i;
 
     chdir(path_prefix);
     if (DHCPMagic & 0x02) {
@@ -456,37 +533,26 @@ static int pxe_open_config(struct com32_filedata *filedata)
     }
 
     /*
-     * Have to guess config file name ...
+     * Have to guess config file name: by UUID, by MAC address, by
+     * hexadecimal IP prefixes, and finally "default".
      */
-    config_file = stpcpy(ConfigName, cfgprefix);
-
-    /* Try loading by UUID */
-    if (sysappend_strings[SYSAPPEND_SYSUUID]) {
-	strcpy(config_file, sysappend_strings[SYSAPPEND_SYSUUID]+8);
-	if (open_file(ConfigName, O_RDONLY, filedata) >= 0)
-            return 0;
+    if (sysappend_strings[SYSAPPEND_SYSUUID])
+	names[n++] = sysappend_strings[SYSAPPEND_SYSUUID]+8;
+    names[n++] = sysappend_strings[SYSAPPEND_BOOTIF]+7;
+    for (i = 0; i < 8; i++) {
+	sprintf(hexip[i], "%08X", ntohl(IPInfo.myip));
+	hexip[i][8 - i] = '\0';	/* Drop one more character each time */
+	names[n++] = hexip[i];
     }
+    names[n++] = "default";
 
-    /* Try loading by MAC address */
-    strcpy(config_file, sysappend_strings[SYSAPPEND_BOOTIF]+7);
-    if (open_file(ConfigName, O_RDONLY, filedata) >= 0)
-        return 0;
-
-    /* Nope, try hexadecimal IP prefixes... */
-    sprintf(config_file, "%08X", ntohl(IPInfo.myip));
-    last = &config_file[8];
-    while (tries) {
-        *last = '\0';        /* Zero-terminate string */
+    /* Ask for all of them at once, then open the first one there */
+    config_file = stpcpy(ConfigName, cfgprefix);
+    for (i = pxe_probe_config(cfgprefix, names, n); i < n; i++) {
+	strcpy(config_file, names[i]);
 	if (open_file(ConfigName, O_RDONLY, filedata) >= 0)
-            return 0;
-        last--;           /* Drop one character */
-        tries--;
-    };
-
-    /* Final attempt: "default" string */
-    strcpy(config_file, default_str);
-    if (open_file(ConfigName, O_RDONLY, filedata) >= 0)
-        return 0;
+	    return 0;
+    }
 
     ddprintf("%-68s\n", "Unable to locate configuration file");
     kaboom();
@@ -507,7 +573,7 @@ static void make_bootif_string(void)
     for (i = MAC_len; i; i--)
 	dst += sprintf(dst, "-%02x", *src++);
 
-    sysappend_strings[SYSAPPEND_BOOTIF] = bootif_str;
+    sysappend_set(SYSAPPEND_BOOTIF, bootif_str);
 }
 
 /*
@@ -530,7 +596,7 @@ static void genipopt(void)
     }
     *--p = '\0';
 
-    sysappend_strings[SYSAPPEND_IP] = ip_option;
+    sysappend_set(SYSAPPEND_IP, ip_option);
 }
 
 
@@ -552,6 +618,8 @@ static void ip_init(void)
  */
 static void network_init(void)
 {
+    int i;
+
     net_parse_dhcp();
 
     make_bootif_string();
@@ -569,6 +637,15 @@ static void network_init(void)
         DHCPMagic = 0;
 
     net_core_init();
+
+    /* What a PXELINUX that chained us already knew */
+    pxe_handoff_apply();
+
+    /* The rest, asked for now so the answers are in by the first packet */
+    net_core_arp_prime(IPInfo.gateway);
+    net_core_arp_prime(IPInfo.serverip);
+    for (i = 0; i < DNS_MAX_SERVERS; i++)
+	net_core_arp_prime(dns_server[i]);
 }
 
 /*
@@ -586,6 +663,8 @@ static int pxe_fs_init(struct fs_info *fs)
     fs->sector_shift = fs->block_shift = TFTP_BLOCKSIZE_LG2;
     fs->sector_size  = fs->block_size  = 1 << TFTP_BLOCKSIZE_LG2;
 
+    slab_prefill(&pxe_socket_slab, PXE_SOCKET_CHUNK);
+
     /* Find the PXE stack */
     if (pxe_init(false))
 	kaboom();
@@ -707,5 +786,8 @@ const struct fs_ops pxe_fs_ops = {
     .chdir_start   = pxe_chdir_start,
     .open_config   = pxe_open_config,
     .readdir	   = pxe_readdir,
+    .prefetch_file = pxe_prefetch_file,
+    .net_stats     = pxe_net_stats,
+    .net_handoff   = pxe_net_handoff,
     .fs_uuid       = NULL,
 };
@@ -108,12 +108,16 @@ struct bootp_t {
 struct netconn;
 struct netbuf;
 struct efi_binding;
+struct prefetch;
+struct http_listing;
 
 /*
  * Our inode private information -- this includes the packet buffer!
  */
 struct pxe_conn_ops {
     void (*fill_buffer)(struct inode *inode);
+    /* Optional: receive straight into buf, 0 if it can't */
+    uint32_t (*read_direct)(struct inode *inode, char *buf, uint32_t len);
     void (*close)(struct inode *inode);
     int (*readdir)(struct inode *inode, struct dirent *dirent);
 };    
@@ -130,6 +134,8 @@ union net_private {
     struct net_private_efi {
 	struct efi_binding *binding; /* EFI binding for protocol */
 	uint16_t localport;          /* Local port number (0=not in use) */
+	struct efi_udp_rx *rx;       /* Posted UDP receives, if any */
+	struct efi_tcp_rx *tcp_rx;   /* Posted TCP receives, if any */
     } efi;
 };
 
@@ -142,9 +148,32 @@ struct pxe_pvt_inode {
     uint16_t tftp_lastpkt;        /* Sequence number of last packet (HBO) */
     char    *tftp_dataptr;        /* Pointer to available data */
     uint8_t  tftp_goteof;         /* 1 if the EOF packet received */
-    uint8_t  tftp_unused[3];      /* Currently unused */
+    uint8_t  tftp_timing;         /* Timing the reply to tftp_acktime */
+    uint16_t tftp_windowsize;     /* Blocks per ACK (RFC 7440) */
+    uint16_t tftp_winleft;        /* Blocks still due before the next ACK */
+    uint32_t tftp_acktime;        /* ms_timer() when the last ACK went */
+    uint32_t tftp_srtt;           /* Smoothed round trip, ms * 8 */
+    uint32_t tftp_rttvar;         /* Round trip variation, ms * 4 */
+    uint16_t tftp_rto;            /* Retransmit timeout, ms; 0 = unknown */
     char    *tftp_pktbuf;         /* Packet buffer */
+    struct tftp_mcast *tftp_mcast; /* Multicast transfer state, if any */
     struct inode *ctl;	          /* Control connection (for FTP) */
+    char    *ftp_login;           /* "user\npassword" it is logged in as */
+    char    *http_rawptr;         /* Received bytes not yet framed (HTTP) */
+    uint32_t http_rawleft;
+    uint32_t http_left;           /* Bytes left in the body or chunk */
+    uint8_t  http_state;          /* Body framing, see http.c */
+    uint8_t  http_keepalive;      /* Connection reusable after the body */
+    uint16_t http_port;           /* Server, for the idle connection pool */
+    uint32_t http_ip;
+    struct http_range *http_range; /* Ranged download state, if any */
+    struct http_gzip *http_gzip;  /* Content-Encoding decoder, if any */
+    struct http_cache *http_cache; /* Kept copy being read or written */
+    struct http_listing *http_listing; /* Parsed directory page, if any */
+    uint32_t http_listpos;        /* Next name in it to hand out */
+    uint32_t stat_opened;         /* ms_timer() at the open, see netstat.c */
+    uint8_t  stat_counted;        /* Fetched from the network */
+    struct prefetch *prefetch;    /* Prefetched file read, see prefetch.c */
     const struct pxe_conn_ops *ops;
 };
 
@@ -218,22 +247,56 @@ extern void pxe_poll(void);
 /* isr.c */
 void pxe_init_isr(void);
 void pxe_start_isr(void);
+void pxe_poll_kick(void);
 int reset_pxe(void);
 
 /* pxe.c */
 struct url_info;
 bool ip_ok(uint32_t);
+void pxe_fetch(const char *filename, int flags, struct file *file);
 int pxe_getc(struct inode *inode);
+struct inode *new_socket(struct fs_info *fs);
 void free_socket(struct inode *inode);
 
 /* undiif.c */
 int undiif_start(uint32_t ip, uint32_t netmask, uint32_t gw);
 void undiif_input(t_PXENV_UNDI_ISR *isr);
+void undiif_input_flush(void);
 
 /* dhcp_options.c */
 void parse_dhcp_options(const void *, int, uint8_t);
 void parse_dhcp(const void *, size_t, int);
 
+/* dnscache.c */
+#define DNS_CACHE_SIZE		16
+#define DNS_CACHE_NAME		256	/* Longest name kept, with the null */
+#define DNS_CACHE_NEG_TTL	30	/* Seconds a failed lookup sticks */
+#define DNS_CACHE_MAX_TTL	86400
+bool dns_cache_lookup(const char *name, uint32_t *ip);
+void dns_cache_add(const char *name, uint32_t ip, uint32_t ttl);
+bool dns_cache_next(int *pos, const char **name, uint32_t *ip,
+		    uint32_t *ttl);
+
+/* handoff.c */
+int pxe_net_handoff(void *buf, size_t len);
+void pxe_handoff_option(const void *data, int opt_len);
+void pxe_handoff_apply(void);
+
+/* netstat.c */
+struct pxe_net_counters {
+    uint64_t bytes;
+    uint32_t files;
+    uint32_t xfer_ms;
+    uint32_t last_bytes;
+    uint32_t last_ms;
+    uint32_t tftp_timeouts;
+    uint32_t tftp_dupblocks;
+};
+extern struct pxe_net_counters pxe_net_counters;
+void pxe_stats_open(struct inode *inode, uint32_t start);
+void pxe_stats_close(struct inode *inode);
+int pxe_net_stats(struct com32_net_stats *st);
+
 /* idle.c */
 void pxe_idle_init(void);
 void pxe_idle_cleanup(void);
@@ -241,6 +304,7 @@ void pxe_idle_cleanup(void);
 /* tftp.c */
 void tftp_open(struct url_info *url, int flags, struct inode *inode,
 	       const char **redir);
+int tftp_probe(struct url_info *url, const char * const *names, int n);
 
 /* gpxeurl.c */
 void gpxe_open(struct inode *inode, const char *url);
@@ -256,6 +320,9 @@ void http_open(struct url_info *url, int flags, struct inode *inode,
 
 /* http_readdir.c */
 int http_readdir(struct inode *inode, struct dirent *dirent);
+bool http_listing_get(struct inode *inode, const char *key);
+void http_listing_read(struct inode *inode, const char *key);
+void http_listing_put(struct inode *inode);
 
 /* ftp.c */
 void ftp_open(struct url_info *url, int flags, struct inode *inode,
@@ -264,6 +331,11 @@ void ftp_open(struct url_info *url, int flags, struct inode *inode,
 /* ftp_readdir.c */
 int ftp_readdir(struct inode *inode, struct dirent *dirent);
 
+/* prefetch.c */
+void pxe_prefetch_file(struct fs_info *fs, const char *name);
+bool pxe_prefetch_take(const char *filename, int flags, struct file *file);
+void pxe_prefetch_put(struct inode *inode);
+
 /* tcp.c */
 const struct pxe_conn_ops tcp_conn_ops;
 
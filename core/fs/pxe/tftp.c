@@ -1,5 +1,7 @@
+#include <stdio.h>
 #include <minmax.h>
 #include <net.h>
+#include <syslinux/trace.h>
 #include "pxe.h"
 #include "url.h"
 #include "tftp.h"
@@ -8,6 +10,10 @@ const uint8_t TimeoutTable[] = {
     2, 2, 3, 3, 4, 5, 6, 7, 9, 10, 12, 15, 18, 21, 26, 31, 37, 44,
     53, 64, 77, 92, 110, 132, 159, 191, 229, 255, 255, 255, 255, 0
 };
+/* How long to wait for the first block before trying a smaller blksize */
+static const uint8_t ProbeTimeoutTable[] = {
+    2, 2, 3, 3, 4, 5, 6, 7, 9, 10, 0
+};
 struct tftp_packet {
     uint16_t opcode;
     uint16_t serial;
@@ -72,89 +78,159 @@ static void ack_packet(struct inode *inode, uint16_t ack_num)
 }
 
 /*
- * Get a fresh packet if the buffer is drained, and we haven't hit
- * EOF yet.  The buffer should be filled immediately after draining!
+ * ACK the last block received, which has the server send the next
+ * window of blocks after it.
  */
-static void tftp_get_packet(struct inode *inode)
+static void ack_window(struct inode *inode)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+
+    ack_packet(inode, socket->tftp_lastpkt);
+    socket->tftp_winleft = socket->tftp_windowsize;
+    socket->tftp_acktime = ms_timer();
+    socket->tftp_timing = 1;
+}
+
+/*
+ * Fold in how long the server took to answer an ACK, and derive the
+ * retransmit timeout from it (RFC 6298, in Jacobson's scaled form).
+ */
+static void tftp_rtt_sample(struct pxe_pvt_inode *socket, uint32_t rtt)
+{
+    int32_t delta;
+    uint32_t rto;
+
+    rtt = min(rtt, TFTP_RTO_MAX);
+
+    if (!socket->tftp_rto) {
+	socket->tftp_srtt = rtt << 3;
+	socket->tftp_rttvar = rtt << 1;
+    } else {
+	delta = rtt - (socket->tftp_srtt >> 3);
+	socket->tftp_srtt += delta;
+	if (delta < 0)
+	    delta = -delta;
+	delta -= socket->tftp_rttvar >> 2;
+	socket->tftp_rttvar += delta;
+    }
+
+    rto = (socket->tftp_srtt >> 3) + socket->tftp_rttvar;
+    socket->tftp_rto = min(max(rto, TFTP_RTO_MIN), TFTP_RTO_MAX);
+}
+
+/*
+ * How long to wait after a retransmit: twice as long as last time
+ * once we know the round trip, else the next step of the table.
+ */
+static uint32_t tftp_backoff(struct pxe_pvt_inode *socket, uint8_t timeout)
+{
+    if (!socket->tftp_rto)
+	return timeout * TFTP_TICK_MS;
+
+    socket->tftp_rto = min(socket->tftp_rto << 1, TFTP_RTO_MAX);
+    return socket->tftp_rto;
+}
+
+/*
+ * Receive the next block's data into data, which has room for a full
+ * block, giving up when timeout_ptr runs out; returns 0 on success,
+ * -1 on timeout.  Each
+ * entry of the table allows one retransmit; how long each waits comes
+ * from the measured round trip if we have one.
+ */
+static int tftp_recv_packet(struct inode *inode, const uint8_t *timeout_ptr,
+			    char *data)
 {
-    uint16_t last_pkt;
-    const uint8_t *timeout_ptr;
     uint8_t timeout;
+    uint32_t wait;
     uint16_t buffersize;
     uint16_t serial;
-    jiffies_t oldtime;
-    struct tftp_packet *pkt = NULL;
+    mstime_t oldtime;
+    struct tftp_packet hdr;
     uint16_t buf_len;
     struct pxe_pvt_inode *socket = PVT(inode);
     uint16_t src_port;
     uint32_t src_ip;
+    bool resynced = false;
     int err;
 
     /*
-     * Start by ACKing the previous packet; this should cause
-     * the next packet to be sent.
+     * Start by ACKing the previous packet if it ended a window; this
+     * should cause the next packets to be sent.  Otherwise the next
+     * one is already on its way.
      */
-    timeout_ptr = TimeoutTable;
     timeout = *timeout_ptr++;
-    oldtime = jiffies();
+    wait = socket->tftp_rto ? socket->tftp_rto : timeout * TFTP_TICK_MS;
+    oldtime = ms_timer();
 
- ack_again:
-    ack_packet(inode, socket->tftp_lastpkt);
+    if (!socket->tftp_winleft)
+	ack_window(inode);
 
     while (timeout) {
-	buf_len = socket->tftp_blksize + 4;
-	err = core_udp_recv(socket, socket->tftp_pktbuf, &buf_len,
-			    &src_ip, &src_port);
+	buf_len = socket->tftp_blksize;
+	err = core_udp_recv_split(socket, &hdr, sizeof hdr, data, &buf_len,
+				  &src_ip, &src_port);
 	if (err) {
-	    jiffies_t now = jiffies();
+	    mstime_t now = ms_timer();
 
-	    if (now-oldtime >= timeout) {
+	    if (now-oldtime >= wait) {
 		oldtime = now;
+		pxe_net_counters.tftp_timeouts++;
+		trace(TRACE_NET, "tftp_timeout", socket->tftp_filepos, wait);
 		timeout = *timeout_ptr++;
 		if (!timeout)
 		    break;
-		goto ack_again;
+		wait = tftp_backoff(socket, timeout);
+		ack_window(inode);
+		socket->tftp_timing = 0;	/* Can't tell which ACK it answers */
 	    }
             continue;
 	}
 
-	if (buf_len < 4)	/* Bad size for a DATA packet */
-	    continue;
-
-        pkt = (struct tftp_packet *)(socket->tftp_pktbuf);
-        if (pkt->opcode != TFTP_DATA)    /* Not a data packet */
+        if (hdr.opcode != TFTP_DATA)    /* Not a data packet */
             continue;
 
-        /* If goes here, recevie OK, break */
-        break;
-    }
+	serial = ntohs(hdr.serial);
+	if (serial == (uint16_t)(socket->tftp_lastpkt + 1))
+	    break;		/* It's the packet we want */
 
-    /* time runs out */
-    if (timeout == 0)
-	kaboom();
+	pxe_net_counters.tftp_dupblocks++;
 
-    last_pkt = socket->tftp_lastpkt;
-    last_pkt++;
-    serial = ntohs(pkt->serial);
-    if (serial != last_pkt) {
         /*
-         * Wrong packet, ACK the packet and try again.
-         * This is presumably because the ACK got lost,
-         * so the server just resent the previous packet.
+         * Wrong packet, ACK the last good one and try again.  Either
+         * the ACK got lost and the server resent old blocks, or a
+         * block of the window went missing; the server starts over
+         * after the block we ACK.  With a window, the rest of it is
+         * already on the wire, so only ACK once.
          */
 #if 0
 	printf("Wrong packet, wanted %04x, got %04x\n", \
-               htons(last_pkt), htons(*(uint16_t *)(data+2)));
+               socket->tftp_lastpkt + 1, serial);
 #endif
-        goto ack_again;
+	if (socket->tftp_windowsize == 1 || !resynced) {
+	    ack_window(inode);
+	    socket->tftp_timing = 0;
+	    resynced = true;
+	}
+    }
+
+    /* time runs out */
+    if (timeout == 0)
+	return -1;
+
+    if (socket->tftp_timing) {
+	tftp_rtt_sample(socket, ms_timer() - socket->tftp_acktime);
+	socket->tftp_timing = 0;
     }
 
     /* It's the packet we want.  We're also EOF if the size < blocksize */
-    socket->tftp_lastpkt = last_pkt;    /* Update last packet number */
-    buffersize = buf_len - 4;		/* Skip TFTP header */
-    socket->tftp_dataptr = socket->tftp_pktbuf + 4;
+    socket->tftp_lastpkt = serial;      /* Update last packet number */
+    socket->tftp_winleft--;
+    buffersize = buf_len;
+    socket->tftp_dataptr = data;
     socket->tftp_filepos += buffersize;
     socket->tftp_bytesleft = buffersize;
+    trace(TRACE_NET, "tftp_block", socket->tftp_filepos, buffersize);
     if (buffersize < socket->tftp_blksize) {
         /* it's the last block, ACK packet immediately */
         ack_packet(inode, serial);
@@ -164,13 +240,422 @@ static void tftp_get_packet(struct inode *inode)
         socket->tftp_goteof	= 1;
         tftp_close_file(inode);
     }
+
+    return 0;
+}
+
+/*
+ * Get a fresh packet if the buffer is drained, and we haven't hit
+ * EOF yet.  The buffer should be filled immediately after draining!
+ */
+static void tftp_get_packet(struct inode *inode)
+{
+    if (tftp_recv_packet(inode, TimeoutTable, PVT(inode)->tftp_pktbuf + 4))
+	kaboom();
+}
+
+/*
+ * With room for a whole block in the caller's buffer, have the block
+ * land there rather than in tftp_pktbuf; returns the bytes stored.
+ */
+static uint32_t tftp_read_direct(struct inode *inode, char *buf, uint32_t len)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+
+    if (len < socket->tftp_blksize)
+	return 0;
+
+    if (tftp_recv_packet(inode, TimeoutTable, buf))
+	kaboom();
+
+    /* Nothing is left in the packet buffer for pxe_getfssec() */
+    len = socket->tftp_bytesleft;
+    socket->tftp_bytesleft = 0;
+    return len;
+}
+
+/*
+ * The blksize to ask for: as much as fits in one unfragmented datagram
+ * on our interface and in our packet buffers.
+ */
+static unsigned int tftp_pick_blksize(void)
+{
+    unsigned int mtu = net_core_mtu();
+
+    if (!mtu)
+	return TFTP_BLKSIZE_SAFE;
+    if (mtu < TFTP_BLOCKSIZE + TFTP_BLKSIZE_OVERHEAD)
+	return TFTP_BLOCKSIZE;
+
+    return min(mtu - TFTP_BLKSIZE_OVERHEAD, TFTP_BLKSIZE_MAX);
+}
+
+/*
+ * Build a read request with our options; returns its length
+ */
+static int tftp_build_rrq(char *buf, const char *path, unsigned int blksize,
+			  bool mcast)
+{
+    char *p = buf;
+
+    *(uint16_t *)p = TFTP_RRQ;  /* TFTP opcode */
+    p += 2;
+
+    p = stpcpy(p, path) + 1;	/* Point *past* each final NULL */
+    p = stpcpy(p, "octet") + 1;
+    p = stpcpy(p, "tsize") + 1;
+    p = stpcpy(p, "0") + 1;
+    p = stpcpy(p, "blksize") + 1;
+    p += sprintf(p, "%u", blksize) + 1;
+    p = stpcpy(p, "windowsize") + 1;
+    p += sprintf(p, "%u", TFTP_WINDOWSIZE) + 1;
+    if (mcast) {
+	p = stpcpy(p, "multicast") + 1;
+	*p++ = '\0';		/* Empty value: let the server pick */
+    }
+
+    return p - buf;
 }
 
 const struct pxe_conn_ops tftp_conn_ops = {
     .fill_buffer	= tftp_get_packet,
+    .read_direct	= tftp_read_direct,
     .close		= tftp_close_file,
 };
 
+/*
+ * Multicast TFTP (RFC 2090).  The server sends the file to a group;
+ * the client it names master ACKs as usual, all others just collect
+ * blocks and fill their gaps once the server makes them master in
+ * turn.  Blocks arrive in any order, so the whole file is gathered in
+ * memory and handed out from there.  Only files of up to 65535 blocks
+ * are taken this way, so that block numbers never wrap.
+ */
+struct tftp_mcast {
+    struct pxe_pvt_inode group;	/* Socket joined to the group */
+    uint32_t ip;			/* Group address */
+    uint16_t port;			/* Group port, host byte order */
+    uint32_t server;			/* Only take blocks from here */
+    bool master;			/* We ACK, the others listen */
+    bool resynced;			/* ACKed the current gap already */
+    bool complete;			/* Have it all, sockets closed */
+    uint16_t acked;			/* Last block ACKed as master */
+    uint16_t nblocks;			/* Blocks in the file */
+    uint16_t have;			/* How many we have */
+    uint16_t contig;			/* We have all of 1..contig */
+    uint16_t next;			/* Next block for fill_buffer */
+    uint8_t *map;			/* Bitmap of blocks received */
+    char *data;				/* The whole file */
+};
+
+/* Set once joining a group has failed, so we stop asking */
+static bool tftp_mcast_broken;
+
+static inline bool tftp_mcast_have(const struct tftp_mcast *mc, uint16_t blk)
+{
+    return mc->map[blk >> 3] & (1 << (blk & 7));
+}
+
+static uint32_t tftp_mcast_blklen(struct inode *inode, uint16_t blk)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+
+    if (blk < socket->tftp_mcast->nblocks)
+	return socket->tftp_blksize;
+    return inode->size - (uint32_t)(blk - 1) * socket->tftp_blksize;
+}
+
+/*
+ * Parse "addr,port,mc"; an empty addr or port keeps the current one
+ */
+static bool tftp_mcast_parse(const char *val, uint32_t *ip, uint16_t *port,
+			     bool *master)
+{
+    uint32_t n, addr = 0;
+    int i;
+
+    if (*val != ',') {
+	for (i = 0; i < 4; i++) {
+	    for (n = 0; *val >= '0' && *val <= '9'; val++)
+		n = n * 10 + *val - '0';
+	    if (n > 255 || *val != (i < 3 ? '.' : ','))
+		return false;
+	    addr = (addr << 8) | n;
+	    val++;
+	}
+	*ip = htonl(addr);
+    } else {
+	val++;
+    }
+
+    if (*val != ',') {
+	for (n = 0; *val >= '0' && *val <= '9'; val++)
+	    n = n * 10 + *val - '0';
+	if (!n || n > 65535 || *val != ',')
+	    return false;
+	*port = n;
+    }
+    val++;
+
+    if ((*val != '0' && *val != '1') || val[1])
+	return false;
+    *master = *val == '1';
+
+    return true;
+}
+
+static void tftp_mcast_ack(struct inode *inode)
+{
+    struct tftp_mcast *mc = PVT(inode)->tftp_mcast;
+
+    ack_packet(inode, mc->contig);
+    mc->acked = mc->contig;
+}
+
+/*
+ * Drop the sockets once we have everything, or are giving up
+ */
+static void tftp_mcast_finish(struct inode *inode)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+    struct tftp_mcast *mc = socket->tftp_mcast;
+
+    if (mc->complete)
+	return;
+
+    core_udp_leave(&mc->group, mc->ip);
+    core_udp_close(socket);
+    mc->complete = true;
+}
+
+static void tftp_mcast_free(struct inode *inode)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+    struct tftp_mcast *mc = socket->tftp_mcast;
+
+    tftp_mcast_finish(inode);
+    free(mc->map);
+    free(mc->data);
+    free(mc);
+    socket->tftp_mcast = NULL;
+}
+
+static void tftp_mcast_block(struct inode *inode, uint16_t blk,
+			     const char *data, uint32_t len)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+    struct tftp_mcast *mc = socket->tftp_mcast;
+
+    if (!blk || blk > mc->nblocks || len != tftp_mcast_blklen(inode, blk))
+	return;
+
+    if (!tftp_mcast_have(mc, blk)) {
+	memcpy(mc->data + (uint32_t)(blk - 1) * socket->tftp_blksize,
+	       data, len);
+	mc->map[blk >> 3] |= 1 << (blk & 7);
+	mc->have++;
+	while (mc->contig < mc->nblocks &&
+	       tftp_mcast_have(mc, mc->contig + 1)) {
+	    mc->contig++;
+	    mc->resynced = false;
+	}
+    } else {
+	pxe_net_counters.tftp_dupblocks++;
+    }
+
+    if (mc->have == mc->nblocks) {
+	/* Whether or not we are master, tell the server we are done */
+	ack_packet(inode, mc->nblocks);
+	tftp_mcast_finish(inode);
+	return;
+    }
+
+    if (!mc->master)
+	return;
+
+    if (blk > mc->contig + 1 && !mc->resynced) {
+	/* A gap; the server starts over after the block we ACK */
+	tftp_mcast_ack(inode);
+	mc->resynced = true;
+    } else if ((uint16_t)(mc->contig - mc->acked) >=
+	       socket->tftp_windowsize) {
+	tftp_mcast_ack(inode);
+    }
+}
+
+/*
+ * The server names a new master with another OACK
+ */
+static void tftp_mcast_oack(struct inode *inode, char *pkt, int len)
+{
+    struct tftp_mcast *mc = PVT(inode)->tftp_mcast;
+    char *p = pkt + 2, *end = pkt + len;
+    const char *opt, *val;
+    uint32_t ip = mc->ip;
+    uint16_t port = mc->port;
+    bool master;
+
+    while (p < end) {
+	opt = p;
+	p = memchr(p, '\0', end - p);
+	if (!p)
+	    return;
+	val = ++p;
+	p = memchr(p, '\0', end - p);
+	if (!p)
+	    return;
+	p++;
+
+	if (strcasecmp(opt, "multicast") ||
+	    !tftp_mcast_parse(val, &ip, &port, &master))
+	    continue;
+	if (ip != mc->ip || port != mc->port)
+	    continue;		/* Not moving groups mid-transfer */
+
+	mc->master = master;
+	if (master)
+	    tftp_mcast_ack(inode);	/* Where we want it to go on */
+    }
+}
+
+/*
+ * Collect blocks until block mc->next is here
+ */
+static void tftp_mcast_recv(struct inode *inode)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+    struct tftp_mcast *mc = socket->tftp_mcast;
+    struct tftp_packet *pkt = (struct tftp_packet *)socket->tftp_pktbuf;
+    const uint8_t *timeout_ptr = TimeoutTable;
+    uint8_t timeout = *timeout_ptr++;
+    jiffies_t oldtime = jiffies();
+    struct pxe_pvt_inode *from;
+    uint16_t buf_len, src_port;
+    uint32_t src_ip;
+    int i;
+
+    while (!tftp_mcast_have(mc, mc->next)) {
+	for (i = 0; i < 2 && !mc->complete; i++) {
+	    from = i ? socket : &mc->group;
+	    buf_len = socket->tftp_blksize + 4;
+	    if (core_udp_recv(from, pkt, &buf_len, &src_ip, &src_port))
+		continue;
+	    if (src_ip != mc->server || buf_len < 4)
+		continue;
+
+	    timeout_ptr = TimeoutTable;
+	    timeout = *timeout_ptr++;
+	    oldtime = jiffies();
+
+	    if (pkt->opcode == TFTP_DATA)
+		tftp_mcast_block(inode, ntohs(pkt->serial), pkt->data,
+				 buf_len - 4);
+	    else if (pkt->opcode == TFTP_OACK && from == socket)
+		tftp_mcast_oack(inode, (char *)pkt, buf_len);
+	}
+
+	if (tftp_mcast_have(mc, mc->next))
+	    break;
+
+	if (jiffies() - oldtime >= timeout) {
+	    oldtime = jiffies();
+	    pxe_net_counters.tftp_timeouts++;
+	    timeout = *timeout_ptr++;
+	    if (!timeout)
+		kaboom();
+	    if (mc->master)
+		tftp_mcast_ack(inode);
+	}
+    }
+}
+
+static void tftp_mcast_get_packet(struct inode *inode)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+    struct tftp_mcast *mc = socket->tftp_mcast;
+    uint32_t len;
+
+    tftp_mcast_recv(inode);
+
+    len = tftp_mcast_blklen(inode, mc->next);
+    socket->tftp_dataptr = mc->data +
+	(uint32_t)(mc->next - 1) * socket->tftp_blksize;
+    socket->tftp_bytesleft = len;
+    socket->tftp_filepos += len;
+
+    if (mc->next++ == mc->nblocks) {
+	/* The file buffer is going away with the rest of the state */
+	memcpy(socket->tftp_pktbuf, socket->tftp_dataptr, len);
+	socket->tftp_dataptr = socket->tftp_pktbuf;
+	socket->tftp_goteof = 1;
+	tftp_mcast_free(inode);
+    }
+}
+
+static void tftp_mcast_close_file(struct inode *inode)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+
+    if (!socket->tftp_mcast->complete)
+	tftp_error(inode, 0, "No error, file close");
+    tftp_mcast_free(inode);
+}
+
+static const struct pxe_conn_ops tftp_mcast_conn_ops = {
+    .fill_buffer	= tftp_mcast_get_packet,
+    .close		= tftp_mcast_close_file,
+};
+
+/*
+ * Switch an opened transfer over to the group the server named;
+ * returns 0 on success.
+ */
+static int tftp_mcast_start(struct inode *inode, const char *val,
+			    uint32_t server)
+{
+    struct pxe_pvt_inode *socket = PVT(inode);
+    struct tftp_mcast *mc;
+    uint32_t nblocks;
+
+    if (inode->size == (uint32_t)-1)
+	return -1;		/* Need tsize to lay the file out */
+
+    nblocks = inode->size / socket->tftp_blksize + 1;
+    if (nblocks > 65535)
+	return -1;
+
+    mc = zalloc(sizeof *mc);
+    if (!mc)
+	return -1;
+
+    mc->server = server;
+    mc->nblocks = nblocks;
+    mc->next = 1;
+    mc->map = zalloc(nblocks / 8 + 1);
+    mc->data = malloc(inode->size ? inode->size : 1);
+    if (!mc->map || !mc->data ||
+	!tftp_mcast_parse(val, &mc->ip, &mc->port, &mc->master) ||
+	!mc->ip || !mc->port)
+	goto bail;
+
+    if (core_udp_join(&mc->group, mc->ip, mc->port)) {
+	tftp_mcast_broken = true;
+	goto bail;
+    }
+
+    socket->tftp_mcast = mc;
+    socket->ops = &tftp_mcast_conn_ops;
+    if (mc->master)
+	tftp_mcast_ack(inode);	/* ACK 0 starts the transfer */
+    return 0;
+
+bail:
+    free(mc->map);
+    free(mc->data);
+    free(mc);
+    return -1;
+}
+
 /**
  * Open a TFTP connection to the server
  *
@@ -186,14 +671,13 @@ void tftp_open(struct url_info *url, int flags, struct inode *inode,
 	       const char **redir)
 {
     struct pxe_pvt_inode *socket = PVT(inode);
-    char *buf;
     uint16_t buf_len;
     char *p;
     char *options;
     char *data;
-    static const char rrq_tail[] = "octet\0""tsize\0""0\0""blksize\0""1408";
-    char rrq_packet_buf[2+2*FILENAME_MAX+sizeof rrq_tail];
+    char rrq_packet_buf[2+2*FILENAME_MAX+TFTP_RRQ_OPTIONS_MAX];
     char reply_packet_buf[PKTBUF_SIZE];
+    unsigned int blksize;
     int err;
     int buffersize;
     int rrq_len;
@@ -205,6 +689,8 @@ void tftp_open(struct url_info *url, int flags, struct inode *inode,
     uint64_t opdata;
     uint16_t src_port;
     uint32_t src_ip;
+    const char *mcast;
+    bool want_mcast;
 
     (void)redir;		/* TFTP does not redirect */
     (void)flags;
@@ -221,20 +707,14 @@ void tftp_open(struct url_info *url, int flags, struct inode *inode,
 	url->port = TFTP_PORT;
 
     socket->ops = &tftp_conn_ops;
+    blksize = tftp_pick_blksize();
+    want_mcast = !tftp_mcast_broken;
+
+restart:
     if (core_udp_open(socket))
 	return;
 
-    buf = rrq_packet_buf;
-    *(uint16_t *)buf = TFTP_RRQ;  /* TFTP opcode */
-    buf += 2;
-
-    buf = stpcpy(buf, url->path);
-
-    buf++;			/* Point *past* the final NULL */
-    memcpy(buf, rrq_tail, sizeof rrq_tail);
-    buf += sizeof rrq_tail;
-
-    rrq_len = buf - rrq_packet_buf;
+    rrq_len = tftp_build_rrq(rrq_packet_buf, url->path, blksize, want_mcast);
 
     timeout_ptr = TimeoutTable;   /* Reset timeout */
 sendreq:
@@ -280,6 +760,12 @@ wait_pkt:
     /* filesize <- -1 == unknown */
     inode->size = -1;
     socket->tftp_blksize = TFTP_BLOCKSIZE;
+    socket->tftp_windowsize = 1;
+    socket->tftp_lastpkt = 0;
+    socket->tftp_winleft = 0;
+    socket->tftp_timing = 0;
+    socket->tftp_rto = 0;
+    mcast = NULL;
     buffersize = buf_len - 2;	  /* bytes after opcode */
 
     /*
@@ -288,6 +774,14 @@ wait_pkt:
     opcode = *(uint16_t *)reply_packet_buf;
     switch (opcode) {
     case TFTP_ERROR:
+	if (buf_len >= 4 && (blksize > TFTP_BLKSIZE_SAFE || want_mcast) &&
+	    ((struct tftp_error *)reply_packet_buf)->errcode == TFTP_EOPTNEG) {
+	    /* Refused our options; see if the old ones do */
+	    core_udp_close(socket);
+	    blksize = TFTP_BLKSIZE_SAFE;
+	    want_mcast = false;
+	    goto restart;
+	}
         inode->size = 0;
 	goto done;        /* ERROR reply; don't try again */
 
@@ -355,7 +849,7 @@ wait_pkt:
 	     * discard the rest.
 	     */
 	    if (!*opt)
-		goto done;
+		break;
 
             while (buffersize) {
                 if (!*p)
@@ -373,6 +867,18 @@ wait_pkt:
 	    if (!buffersize)
 		break;		/* No option data */
 
+	    if (want_mcast && !strcmp(opt, "multicast")) {
+		/* "addr,port,mc"; taken apart once we know the blksize */
+		while (buffersize) {
+		    buffersize--;
+		    if (!*p++) {
+			mcast = opt + strlen(opt) + 1;
+			break;
+		    }
+		}
+		continue;
+	    }
+
 	    opdata = 0;
 
             /* do convert a number-string to decimal number, just like atoi */
@@ -390,6 +896,11 @@ wait_pkt:
 		inode->size = opdata;
 	    else if (!strcmp(opt, "blksize"))
 		socket->tftp_blksize = opdata;
+	    else if (!strcmp(opt, "windowsize")) {
+		if (!opdata || opdata > TFTP_WINDOWSIZE)
+		    goto err_reply;	/* Can't go above what we asked for */
+		socket->tftp_windowsize = opdata;
+	    }
 	    else
 		goto err_reply; /* Non-negotitated option returned,
 				   no idea what it means ...*/
@@ -397,15 +908,48 @@ wait_pkt:
 
 	}
 
-	if (socket->tftp_blksize < 64 || socket->tftp_blksize > PKTBUF_SIZE)
+	if (socket->tftp_blksize < 64 || socket->tftp_blksize > blksize)
 	    goto err_reply;
 
 	/* Parsing successful, allocate buffer */
 	socket->tftp_pktbuf = malloc(socket->tftp_blksize + 4);
 	if (!socket->tftp_pktbuf)
 	    goto err_reply;
-	else
-	    goto done;
+
+	if (mcast) {
+	    if (!tftp_mcast_start(inode, mcast, src_ip))
+		return;
+
+	    /* Can't do it after all; ask again for a plain transfer */
+	    dprintf("tftp_open: multicast refused, retrying\n");
+	    tftp_error(inode, TFTP_EUNDEF, "Retrying without multicast");
+	    free(socket->tftp_pktbuf);
+	    socket->tftp_pktbuf = NULL;
+	    core_udp_close(socket);
+	    want_mcast = false;
+	    goto restart;
+	}
+
+	/*
+	 * Blocks larger than we used to ask for may not make it through
+	 * everything between us and the server; get the first one here,
+	 * and go back to the old size if it never arrives.
+	 */
+	if (socket->tftp_blksize > TFTP_BLKSIZE_SAFE) {
+	    if (!tftp_recv_packet(inode, ProbeTimeoutTable,
+				  socket->tftp_pktbuf + 4))
+		return;
+
+	    dprintf("tftp_open: blksize %u timed out, retrying\n",
+		    socket->tftp_blksize);
+	    tftp_error(inode, TFTP_EUNDEF, "Retrying with a smaller blksize");
+	    free(socket->tftp_pktbuf);
+	    socket->tftp_pktbuf = NULL;
+	    core_udp_close(socket);
+	    blksize = TFTP_BLKSIZE_SAFE;
+	    goto restart;
+	}
+	goto done;
 
     default:
 	printf("TFTP unknown opcode %d\n", ntohs(opcode));
@@ -424,42 +968,306 @@ done:
     return;
 }
 
+/*
+ * Find out which of several files in one directory the server has, by
+ * asking for all of them at once: a miss then costs one round trip for
+ * the lot rather than one each.  The requests carry no options, so the
+ * server answers each with an ERROR or the first block, and we cut any
+ * transfer short right away.  Returns the index of the first of names
+ * that the server has, n if none; 0 if we can't tell.
+ */
+int tftp_probe(struct url_info *url, const char * const *names, int n)
+{
+    static const struct {
+	uint16_t err_op;
+	uint16_t err_num;
+	char err_msg[1];
+    } __packed abort_pkt = { TFTP_ERROR, TFTP_EUNDEF, "" };
+    struct pxe_pvt_inode sock[TFTP_PROBE_MAX];
+    int8_t state[TFTP_PROBE_MAX];	/* 0 = no answer, 1 = has it, -1 = not */
+    char rrq_packet_buf[2+2*FILENAME_MAX+8];
+    char reply_packet_buf[PKTBUF_SIZE];
+    const uint8_t *timeout_ptr = TimeoutTable;
+    jiffies_t timeout = 0;
+    jiffies_t oldtime = 0;
+    uint16_t buf_len;
+    uint16_t opcode;
+    uint16_t src_port;
+    uint32_t src_ip;
+    char *p;
+    int opened;
+    int i;
 
-/**
- * Send a file to a TFTP  server
- *
- * @param:inode, the inode to store our state in
- * @param:ip, the ip to contact to get the file
- * @param:filename, the file we wanna push
+    if (n > TFTP_PROBE_MAX)
+	return 0;
+
+    if (url->type != URL_OLD_TFTP)
+	url_unescape(url->path, ';');
+    if (!url->port)
+	url->port = TFTP_PORT;
+
+    memset(sock, 0, sizeof sock);
+    memset(state, 0, sizeof state);
+    for (opened = 0; opened < n; opened++) {
+	if (core_udp_open(&sock[opened]))
+	    break;
+    }
+    if (opened < n) {
+	i = 0;			/* Out of sockets; do it the slow way */
+	goto done;
+    }
+
+    for (;;) {
+	/* Settled once everything before the first hit is a miss */
+	for (i = 0; i < n && state[i] < 0; i++)
+	    ;
+	if (i == n || state[i] > 0)
+	    break;
+
+	if (jiffies() - oldtime >= timeout) {
+	    timeout = *timeout_ptr++;
+	    if (!timeout) {
+		/* Those still quiet count as misses */
+		while (i < n && state[i] <= 0)
+		    i++;
+		break;
+	    }
+	    oldtime = jiffies();
+
+	    for (i = 0; i < n; i++) {
+		if (state[i])
+		    continue;
+		*(uint16_t *)rrq_packet_buf = TFTP_RRQ;
+		p = rrq_packet_buf + 2;
+		p += snprintf(p, 2*FILENAME_MAX, "%s%s", url->path, names[i]);
+		p = stpcpy(p + 1, "octet") + 1;
+		core_udp_sendto(&sock[i], rrq_packet_buf, p - rrq_packet_buf,
+				url->ip, url->port);
+	    }
+	}
+
+	for (i = 0; i < n; i++) {
+	    if (state[i])
+		continue;
+	    buf_len = sizeof reply_packet_buf;
+	    if (core_udp_recv(&sock[i], reply_packet_buf, &buf_len,
+			      &src_ip, &src_port) ||
+		src_ip != url->ip || buf_len < 2)
+		continue;
+
+	    opcode = *(uint16_t *)reply_packet_buf;
+	    if (opcode == TFTP_ERROR) {
+		state[i] = -1;
+	    } else if (opcode == TFTP_DATA || opcode == TFTP_OACK) {
+		state[i] = 1;
+		core_udp_sendto(&sock[i], &abort_pkt, sizeof abort_pkt,
+				src_ip, src_port);
+	    }
+	}
+    }
+
+done:
+    while (opened--)
+	core_udp_close(&sock[opened]);
+
+    return i;
+}
+
+
+/*
+ * Uploads.  The data goes out as it is written, in windows of blocks
+ * (RFC 7440) when the server agrees to that; the blocks the server
+ * has not ACKed yet are kept for resending, and nothing else, so an
+ * upload of any size takes a window's worth of memory.  Block n is in
+ * slot n % windowsize; n counts from 1 and, unlike the block number
+ * on the wire, does not wrap.
  *
- * @out: open_file_t structure, stores in file->open_file
- * @out: the lenght of this file, stores in file->file_len
+ * Like tftp_put(), these return -ntohs(TFTP_OK) on success and
+ * -ntohs(code) on failure.
+ */
+#define TFTP_PUT_OK	(-ntohs(TFTP_OK))
+
+struct tftp_put {
+    struct inode *inode;	/* Holds the connection */
+    char *win;			/* windowsize slots of 4 + blksize bytes */
+    uint16_t blksize;
+    uint16_t windowsize;
+    uint32_t acked;		/* Last block the server has ACKed */
+    uint32_t sent;		/* Last block sent */
+    uint32_t last;		/* Final block once closing, else 0 */
+    uint16_t fill;		/* Bytes in block sent + 1 so far */
+    int err;			/* Sticky; TFTP_PUT_OK while all is well */
+};
+
+static char *tftp_put_slot(struct tftp_put *put, uint32_t blk)
+{
+    return put->win + (blk % put->windowsize) * (put->blksize + 4);
+}
+
+static void tftp_put_send(struct tftp_put *put, uint32_t blk)
+{
+    char *pkt = tftp_put_slot(put, blk);
+    uint16_t len = blk == put->last ? put->fill : put->blksize;
+
+    *(uint16_t *)pkt = TFTP_DATA;
+    *(uint16_t *)(pkt + 2) = htons((uint16_t)blk);
+    core_udp_send(PVT(put->inode), pkt, 4 + len);
+}
+
+/* Send everything after the last block the server ACKed again */
+static void tftp_put_resend(struct tftp_put *put)
+{
+    uint32_t blk;
+
+    for (blk = put->acked + 1; blk <= put->sent; blk++)
+	tftp_put_send(put, blk);
+    PVT(put->inode)->tftp_timing = 0;	/* Can't tell which answers what */
+}
+
+/* Send the next block, and time the server's answer if it ends a window */
+static void tftp_put_next(struct tftp_put *put)
+{
+    struct pxe_pvt_inode *socket = PVT(put->inode);
+
+    tftp_put_send(put, ++put->sent);
+    if (put->sent == put->last ||
+	put->sent - put->acked == put->windowsize) {
+	socket->tftp_acktime = ms_timer();
+	socket->tftp_timing = 1;
+    }
+}
+
+/*
+ * Wait for the server to ACK more of what we sent; returns TFTP_PUT_OK
+ * once it has.  If it ACKs less than all of it, a block went missing,
+ * and the server expects the rest again.
+ */
+static int tftp_put_wait(struct tftp_put *put)
+{
+    struct pxe_pvt_inode *socket = PVT(put->inode);
+    const uint8_t *timeout_ptr = TimeoutTable;
+    uint8_t timeout = *timeout_ptr++;
+    uint32_t wait = socket->tftp_rto ? socket->tftp_rto : timeout * TFTP_TICK_MS;
+    mstime_t oldtime = ms_timer();
+    char pkt[4 + TFTP_BLOCKSIZE];
+    uint16_t len, src_port, ack;
+    uint32_t src_ip;
+    bool resynced = false;
+
+    for (;;) {
+	len = sizeof pkt;
+	if (core_udp_recv(socket, pkt, &len, &src_ip, &src_port)) {
+	    mstime_t now = ms_timer();
+
+	    if (now - oldtime < wait)
+		continue;
+	    oldtime = now;
+	    pxe_net_counters.tftp_timeouts++;
+	    timeout = *timeout_ptr++;
+	    if (!timeout)
+		return -ntohs(TFTP_ECONNECT);
+	    wait = tftp_backoff(socket, timeout);
+	    tftp_put_resend(put);
+	    continue;
+	}
+
+	if (len < 4)
+	    continue;
+	if (*(uint16_t *)pkt == TFTP_ERROR)
+	    return -ntohs(((struct tftp_error *)pkt)->errcode);
+	if (*(uint16_t *)pkt != TFTP_ACK)
+	    continue;
+
+	ack = ntohs(*(uint16_t *)(pkt + 2)) - (uint16_t)put->acked;
+	if (ack > put->sent - put->acked)
+	    continue;		/* Stale */
+	if (!ack) {
+	    /* The block after the one it ACKed again is missing */
+	    pxe_net_counters.tftp_dupblocks++;
+	    if (!resynced) {
+		tftp_put_resend(put);
+		resynced = true;
+	    }
+	    continue;
+	}
+
+	if (socket->tftp_timing) {
+	    tftp_rtt_sample(socket, ms_timer() - socket->tftp_acktime);
+	    socket->tftp_timing = 0;
+	}
+	put->acked += ack;
+	if (put->acked != put->sent)
+	    tftp_put_resend(put);
+	return TFTP_PUT_OK;
+    }
+}
+
+/*
+ * Parse the OACK to a write request; returns false if it has anything
+ * we didn't ask for.
+ */
+static bool tftp_put_oack(struct tftp_put *put, char *p, int len)
+{
+    char *end = p + len;
+    const char *opt;
+    unsigned long val;
+    char *num;
+
+    while (p < end && *p) {
+	opt = p;
+	while (p < end && *p)
+	    p++;
+	if (++p >= end)
+	    return false;	/* No value */
+
+	num = p;
+	while (p < end && *p)
+	    p++;
+	if (p++ >= end)
+	    return false;	/* Unterminated value */
+
+	val = strtoul(num, &num, 10);
+	if (*num)
+	    return false;
+
+	if (!strcasecmp(opt, "blksize")) {
+	    if (val < 8 || val > put->blksize)
+		return false;
+	    put->blksize = val;
+	} else if (!strcasecmp(opt, "windowsize")) {
+	    if (!val || val > put->windowsize)
+		return false;
+	    put->windowsize = val;
+	} else {
+	    return false;
+	}
+    }
+
+    return true;
+}
+
+/**
+ * Start sending a file to a TFTP server
  *
+ * @url:	where to put it
+ * @putp:	the upload, for tftp_put_write() and tftp_put_close()
  */
-__export int tftp_put(struct url_info *url, int flags, struct inode *inode,
-	       const char **redir, char *data, int data_length)
+__export int tftp_put_open(struct url_info *url, struct tftp_put **putp)
 {
-    struct pxe_pvt_inode *socket = PVT(inode);
-    char *buf;
-    uint16_t buf_len;
-    static const char wrq_tail[] = "octet";
-    char wrq_packet_buf[512+4+6];
+    struct tftp_put *put;
+    struct pxe_pvt_inode *socket;
+    char wrq_packet_buf[2+FILENAME_MAX+TFTP_RRQ_OPTIONS_MAX];
     char reply_packet_buf[PKTBUF_SIZE];
-    int err;
-    int wrq_len;
-    const uint8_t  *timeout_ptr;
+    const uint8_t *timeout_ptr;
     jiffies_t timeout;
     jiffies_t oldtime;
-    uint16_t opcode;
-    uint16_t src_port = url->port;
+    uint16_t buf_len;
+    uint16_t port = url->port ? url->port : TFTP_PORT;
+    uint16_t src_port;
     uint32_t src_ip;
-    uint16_t seq = 0;
-    size_t chunk = 0;
-    int len = data_length;
-    int return_code = -ntohs(TFTP_EUNDEF);
-
-    (void)redir;		/* TFTP does not redirect */
-    (void)flags;
+    bool options = true;
+    char *p;
+    int err = -ntohs(TFTP_EUNDEF);
 
     if (url->type != URL_OLD_TFTP) {
 	/*
@@ -469,127 +1277,200 @@ __export int tftp_put(struct url_info *url, int flags, struct inode *inode,
 	url_unescape(url->path, ';');
     }
 
-    if (!src_port)
-	src_port = TFTP_PORT;
+    put = zalloc(sizeof *put);
+    if (!put)
+	return err;
+    put->inode = zalloc(sizeof(struct inode) + sizeof(struct pxe_pvt_inode));
+    if (!put->inode) {
+	free(put);
+	return err;
+    }
+    socket = PVT(put->inode);
 
-//    socket->ops = &tftp_conn_ops;
+restart:
     if (core_udp_open(socket))
-	return return_code;
-
-    buf = wrq_packet_buf;
-    *(uint16_t *)buf = TFTP_WRQ;  /* TFTP opcode */
-    buf += 2;
-
-    buf += strlcpy(buf, url->path, 512);
-
-    buf++;			/* Point *past* the final NULL */
-    memcpy(buf, wrq_tail, sizeof wrq_tail);
-    buf += sizeof wrq_tail;
-
-    wrq_len = buf - wrq_packet_buf;
+	goto fail;
+
+    put->blksize = min(tftp_pick_blksize(), TFTP_BLKSIZE_SAFE);
+    put->windowsize = TFTP_WINDOWSIZE;
+
+    p = wrq_packet_buf;
+    *(uint16_t *)p = TFTP_WRQ;  /* TFTP opcode */
+    p += 2;
+    p += strlcpy(p, url->path, FILENAME_MAX - 1) + 1;
+    p = stpcpy(p, "octet") + 1;
+    if (options) {
+	p = stpcpy(p, "blksize") + 1;
+	p += sprintf(p, "%u", put->blksize) + 1;
+	p = stpcpy(p, "windowsize") + 1;
+	p += sprintf(p, "%u", put->windowsize) + 1;
+    }
 
     timeout_ptr = TimeoutTable;   /* Reset timeout */
 sendreq:
     timeout = *timeout_ptr++;
-    if (!timeout)
-	return return_code;			/* No file available... */
+    if (!timeout) {
+	err = -ntohs(TFTP_ECONNECT);
+	goto fail_close;
+    }
     oldtime = jiffies();
 
-    core_udp_sendto(socket, wrq_packet_buf, wrq_len, url->ip, src_port);
+    core_udp_sendto(socket, wrq_packet_buf, p - wrq_packet_buf,
+		    url->ip, port);
 
-    /* If the WRITE call fails, we let the timeout take care of it... */
     for (;;) {
 	buf_len = sizeof(reply_packet_buf);
 
-	err = core_udp_recv(socket, reply_packet_buf, &buf_len,
-			    &src_ip, &src_port);
-	if (err) {
-	    jiffies_t now = jiffies();
-	    if (now - oldtime >= timeout)
-		 goto sendreq;
-	} else {
-	    /* Make sure the packet actually came from the server and
-	       is long enough for a TFTP opcode */
-	    dprintf("tftp_put: got packet buflen=%d from server %u.%u.%u.%u(%u.%u.%u.%u)\n",
-			buf_len,
-			((uint8_t *)&src_ip)[0],
-			((uint8_t *)&src_ip)[1],
-			((uint8_t *)&src_ip)[2],
-			((uint8_t *)&src_ip)[3],
-			((uint8_t *)&url->ip)[0],
-			((uint8_t *)&url->ip)[1],
-			((uint8_t *)&url->ip)[2],
-			((uint8_t *)&url->ip)[3]);
-	    if ((src_ip == url->ip) && (buf_len >= 2))
-		break;
+	if (core_udp_recv(socket, reply_packet_buf, &buf_len,
+			  &src_ip, &src_port)) {
+	    if (jiffies() - oldtime >= timeout)
+		goto sendreq;
+	} else if (src_ip == url->ip && buf_len >= 4) {
+	    break;
 	}
     }
 
     core_udp_disconnect(socket);
     core_udp_connect(socket, src_ip, src_port);
 
-    /* filesize <- -1 == unknown */
-    inode->size = -1;
-    socket->tftp_blksize = TFTP_BLOCKSIZE;
-
-    /*
-     * Get the opcode type, and parse it
-     */
-    opcode = *(uint16_t *)reply_packet_buf;
-    switch (opcode) {
+    switch (*(uint16_t *)reply_packet_buf) {
     case TFTP_ERROR:
-	dprintf("tftp_push: received a TFTP_ERROR\n");
-	struct tftp_error *te = (struct tftp_error *)(reply_packet_buf+1);
-	return_code = -ntohs(te->errcode);
-        inode->size = 0;
-	goto done;        /* ERROR reply; don't try again */
+	err = -ntohs(((struct tftp_error *)reply_packet_buf)->errcode);
+	if (options && err == -ntohs(TFTP_EOPTNEG)) {
+	    /* Refused our options; do without */
+	    core_udp_close(socket);
+	    options = false;
+	    goto restart;
+	}
+	goto fail_close;
 
     case TFTP_ACK:
-	dprintf("tftp_push: received a TFTP_ACK\n");
-	/* We received a ACK packet, sending the associated data packet */
+	/* No options: one block of the default size at a time */
+	if (*(uint16_t *)(reply_packet_buf + 2) != 0)
+	    goto bad_reply;
+	put->blksize = TFTP_BLOCKSIZE;
+	put->windowsize = 1;
+	break;
 
-	/* If data was completly sent, we can stop here */
-	if (len == 0) {
-		return_code = -ntohs(TFTP_OK);
-		goto done;
-	}
+    case TFTP_OACK:
+	if (!tftp_put_oack(put, reply_packet_buf + 2, buf_len - 2))
+	    goto bad_reply;
+	break;
 
-	/* If the server sequence is not aligned with our, we have an issue
-	 * Let's break the transmission for now but could be improved later */
-	uint16_t srv_seq = ntohs(*(uint16_t *)(reply_packet_buf+2));
-	if (srv_seq != seq) {
-		printf("tftp_push: server sequence (%"PRIu16") is not aligned with our sequence (%"PRIu16"\n", srv_seq, seq);
-		return_code = -ntohs(TFTP_EBADOP);
-		goto done;
+    default:
+	goto bad_reply;
+    }
+
+    put->win = malloc(put->windowsize * (put->blksize + 4));
+    if (!put->win) {
+	tftp_error(put->inode, TFTP_EUNDEF, "Out of memory");
+	goto fail_close;
+    }
+
+    socket->tftp_rto = 0;
+    socket->tftp_timing = 0;
+    put->err = TFTP_PUT_OK;
+    *putp = put;
+    return TFTP_PUT_OK;
+
+bad_reply:
+    tftp_error(put->inode, TFTP_EOPTNEG, "TFTP protocol error");
+    err = -ntohs(TFTP_EOPTNEG);
+fail_close:
+    core_udp_close(socket);
+fail:
+    free(put->inode);
+    free(put);
+    return err;
+}
+
+/**
+ * Queue data for upload, sending each block as it fills up; waits for
+ * the server only when a whole window is out.
+ */
+__export int tftp_put_write(struct tftp_put *put, const void *data,
+			    size_t len)
+{
+    size_t chunk;
+
+    while (len && put->err == TFTP_PUT_OK) {
+	if (put->sent - put->acked == put->windowsize) {
+	    put->err = tftp_put_wait(put);
+	    continue;
 	}
 
-	/* Let's transmit the data block */
-	chunk = len >= 512 ? 512 : len;
-	buf = wrq_packet_buf;
-	*(uint16_t *)buf = TFTP_DATA;  /* TFTP opcode */
-	*((uint16_t *)(buf+2)) = htons(++seq);
-	memcpy(buf+4, data, chunk);
-	wrq_len = chunk + 4;
-	data += chunk;
+	chunk = min(len, (size_t)(put->blksize - put->fill));
+	memcpy(tftp_put_slot(put, put->sent + 1) + 4 + put->fill, data,
+	       chunk);
+	data = (const char *)data + chunk;
 	len -= chunk;
-	timeout_ptr = TimeoutTable;   /* Reset timeout */
-	goto sendreq;
+	put->fill += chunk;
 
-    default:
-	dprintf("tftp_push: unknown opcode %d\n", ntohs(opcode));
-	return_code = -ntohs(TFTP_EOPTNEG);
-	goto err_reply;
+	if (put->fill == put->blksize) {
+	    tftp_put_next(put);
+	    put->fill = 0;
+	}
     }
 
-err_reply:
-    /* Build the TFTP error packet */
-    dprintf("tftp_push: Failure\n");
-    tftp_error(inode, TFTP_EOPTNEG, "TFTP protocol error");
-    inode->size = 0;
+    return put->err;
+}
 
-done:
-    if (!inode->size)
-	core_udp_close(socket);
+/**
+ * Send the final, short block and wait for all of it to be ACKed, then
+ * free the upload.  After an error this only cleans up.
+ */
+__export int tftp_put_close(struct tftp_put *put)
+{
+    struct pxe_pvt_inode *socket = PVT(put->inode);
+    int err = put->err;
+
+    if (err == TFTP_PUT_OK) {
+	while (err == TFTP_PUT_OK &&
+	       put->sent - put->acked == put->windowsize)
+	    err = tftp_put_wait(put);
+    }
+
+    if (err == TFTP_PUT_OK) {
+	put->last = put->sent + 1;
+	tftp_put_next(put);
+	while (err == TFTP_PUT_OK && put->acked != put->sent)
+	    err = tftp_put_wait(put);
+    }
+
+    if (err == -ntohs(TFTP_ECONNECT))
+	tftp_error(put->inode, TFTP_EUNDEF, "Upload timed out");
+
+    core_udp_close(socket);
+    free(put->win);
+    free(put->inode);
+    free(put);
+    return err;
+}
+
+/**
+ * Send a file to a TFTP server in one go
+ *
+ * @url:	where to put it
+ * @inode:	unused; the upload keeps its own
+ * @data:	the file
+ * @data_length: its length
+ */
+__export int tftp_put(struct url_info *url, int flags, struct inode *inode,
+	       const char **redir, char *data, int data_length)
+{
+    struct tftp_put *put;
+    int err, close_err;
+
+    (void)flags;
+    (void)inode;
+    (void)redir;		/* TFTP does not redirect */
+
+    err = tftp_put_open(url, &put);
+    if (err != TFTP_PUT_OK)
+	return err;
+
+    err = tftp_put_write(put, data, data_length);
+    close_err = tftp_put_close(put);
 
-    return return_code;
+    return err != TFTP_PUT_OK ? err : close_err;
 }
@@ -28,6 +28,35 @@
 #define TFTP_BLOCKSIZE_LG2 9
 #define TFTP_BLOCKSIZE  (1 << TFTP_BLOCKSIZE_LG2)
 
+/*
+ * blksize we ask for when the link MTU is unknown, and fall back to
+ * when a larger one fails; the largest we ask for has to leave room
+ * for link headers in a PKTBUF_SIZE receive buffer
+ */
+#define TFTP_BLKSIZE_SAFE	1408
+#define TFTP_BLKSIZE_MAX	(PKTBUF_SIZE - 64)
+#define TFTP_BLKSIZE_OVERHEAD	(20 + 8 + 4)	/* IP, UDP and TFTP headers */
+
+/*
+ * Largest number of blocks the server may send per ACK (RFC 7440)
+ */
+#define TFTP_WINDOWSIZE	 16
+
+/*
+ * Bounds on the retransmission timeout, in ms, once we have measured
+ * the round trip (RFC 6298); until then the timeout tables go by
+ * timer ticks of about TFTP_TICK_MS
+ */
+#define TFTP_RTO_MIN	 100
+#define TFTP_RTO_MAX	 15000
+#define TFTP_TICK_MS	 55
+
+/* Most files tftp_probe() asks about at once */
+#define TFTP_PROBE_MAX		16
+
+/* Room for the options tftp_open() puts in its RRQ */
+#define TFTP_RRQ_OPTIONS_MAX	64
+
 /*
  * TFTP operation codes
  */
@@ -64,4 +93,10 @@ struct tftp_error {
 int tftp_put(struct url_info *url, int flags, struct inode *inode,
 	     const char **redir, char *data, int data_length);
 
+/* Streaming uploads; see tftp.c */
+struct tftp_put;
+int tftp_put_open(struct url_info *url, struct tftp_put **putp);
+int tftp_put_write(struct tftp_put *put, const void *data, size_t len);
+int tftp_put_close(struct tftp_put *put);
+
 #endif /* PXE_TFTP_H */
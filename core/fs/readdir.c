@@ -45,6 +45,35 @@ __export struct dirent *readdir(DIR *dir)
     return rv < 0 ? NULL : &buf;
 }
 
+/*
+ * Read up to count directory entries into buf in one call; returns the
+ * number read, 0 at the end of the directory or -1 on a bad handle.
+ * Drivers without a batched method are called once per entry.
+ */
+__export int readdir_batch(DIR *dir, struct dirent *buf, int count)
+{
+    struct file *dd_dir = (struct file *)dir;
+    const struct fs_ops *ops;
+    int n;
+
+    if (!dd_dir || !dd_dir->fs)
+	return -1;
+
+    ops = dd_dir->fs->fs_ops;
+    if (ops->readdir_batch)
+	return ops->readdir_batch(dd_dir, buf, count);
+
+    if (!ops->readdir)
+	return 0;
+
+    for (n = 0; n < count; n++) {
+	if (ops->readdir(dd_dir, &buf[n]) < 0)
+	    break;
+    }
+
+    return n;
+}
+
 /*
  * Close a directory
  */
@@ -0,0 +1,202 @@
+/*
+ * cachetest.c
+ *
+ * Checks of the block cache (cache.c) on the host, against a disk
+ * whose every block is filled with its own block number, so that what
+ * the cache hands back can be verified and the disk requests counted.
+ *
+ * Usage: cachetest
+ *
+ * Prints one line per check and exits with 1 if any of them failed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ilog2.h>
+#include "core.h"
+#include "disk.h"
+#include "fs.h"
+#include "cache.h"
+
+#define TEST_BLOCK_SHIFT	10
+#define TEST_BLOCK_SIZE	(1 << TEST_BLOCK_SHIFT)
+
+/*
+ * What the rest of the core would provide
+ */
+uint8_t disk_io_source;
+uint32_t trace_mask;
+struct fs_info *this_fs;
+
+void __trace(int group, const char *name, const char *str,
+	     uint64_t a, uint64_t b)
+{
+    (void)group;
+    (void)name;
+    (void)str;
+    (void)a;
+    (void)b;
+}
+
+static unsigned int disk_requests;
+
+static void fill_block(char *buf, block_t block)
+{
+    uint32_t *p = (uint32_t *)buf;
+    unsigned int i;
+
+    for (i = 0; i < TEST_BLOCK_SIZE / sizeof *p; i++)
+	p[i] = block;
+}
+
+static int test_rdwr_sectors(struct disk *disk, void *buf, sector_t lba,
+			     size_t count, bool is_write)
+{
+    unsigned int spb_shift = TEST_BLOCK_SHIFT - disk->sector_shift;
+    char *p = buf;
+    size_t i;
+
+    if (is_write)
+	return 0;
+
+    disk_requests++;
+    for (i = 0; i < count >> spb_shift; i++) {
+	fill_block(p, (lba >> spb_shift) + i);
+	p += TEST_BLOCK_SIZE;
+    }
+    return count;
+}
+
+void getoneblk(struct disk *disk, char *buf, block_t block, int block_size)
+{
+    int sec_per_block = block_size >> disk->sector_shift;
+
+    disk->rdwr_sectors(disk, buf, block * sec_per_block, sec_per_block, 0);
+}
+
+static struct disk test_disk = {
+    .sector_size   = 512,
+    .sector_shift  = 9,
+    .maxtransfer   = 127,
+    .rdwr_sectors  = test_rdwr_sectors,
+};
+
+/* A cache of ENTRIES blocks */
+static struct device *new_device(unsigned int entries)
+{
+    static struct device dev;
+
+    free(dev.cache_data);
+    free(dev.cache_ra_buf);
+    memset(&dev, 0, sizeof dev);
+    dev.disk = &test_disk;
+    dev.cache_size = 2*sizeof(struct cache) + sizeof(struct cache *) +
+	entries * (TEST_BLOCK_SIZE + sizeof(struct cache) +
+		   sizeof(struct cache *));
+    dev.cache_data = malloc(dev.cache_size);
+    cache_init(&dev, TEST_BLOCK_SHIFT);
+
+    return &dev;
+}
+
+static int failures;
+
+static void check(const char *what, bool ok)
+{
+    printf("%-60s %s\n", what, ok ? "ok" : "FAILED");
+    if (!ok)
+	failures++;
+}
+
+static bool block_ok(const void *data, block_t block)
+{
+    char buf[TEST_BLOCK_SIZE];
+
+    fill_block(buf, block);
+    return data && !memcmp(data, buf, TEST_BLOCK_SIZE);
+}
+
+/* A cache with room for a single block must still work */
+static void test_one_entry(void)
+{
+    struct device *dev = new_device(1);
+    bool ok;
+
+    ok = dev->cache_entries == 1;
+    ok = ok && block_ok(get_cache(dev, 7), 7);
+    ok = ok && block_ok(get_cache(dev, 0x12345), 0x12345);
+    ok = ok && block_ok(get_cache(dev, 7), 7);
+    check("one-block cache", ok);
+}
+
+/*
+ * Streaming a file several times the size of the cache through
+ * cache_read(), with read-ahead, must leave a block which was used
+ * twice before (metadata) in the cache.
+ */
+static void test_stream(void)
+{
+    const unsigned int entries = 64;
+    const block_t meta = 1000000;
+    struct device *dev = new_device(entries);
+    struct fs_info fs;
+    char buf[4 * TEST_BLOCK_SIZE];
+    uint64_t offset;
+    unsigned int requests;
+    bool ok = true;
+
+    memset(&fs, 0, sizeof fs);
+    fs.fs_dev = dev;
+    fs.block_shift = TEST_BLOCK_SHIFT;
+    fs.block_size = TEST_BLOCK_SIZE;
+
+    get_cache(dev, meta);
+    get_cache(dev, meta + 1);
+    get_cache(dev, meta);
+
+    for (offset = 0; offset < 4 * entries * TEST_BLOCK_SIZE;
+	 offset += sizeof buf) {
+	ok = ok && cache_read(&fs, buf, offset, sizeof buf) == sizeof buf;
+	ok = ok && block_ok(buf, offset >> TEST_BLOCK_SHIFT);
+    }
+    check("stream through cache_read() reads the right data", ok);
+    check("stream through cache_read() uses read-ahead",
+	  dev->cache_ra_reqs > 0);
+
+    requests = disk_requests;
+    ok = block_ok(get_cache(dev, meta), meta);
+    check("block used twice survives a stream 4x the cache",
+	  ok && disk_requests == requests);
+}
+
+/*
+ * Queued prefetches must wait for cache_prefetch_flush(): a driver
+ * holding a block from get_cache() while it reads another can't have
+ * the first one replaced under it.
+ */
+static void test_prefetch_held(void)
+{
+    const unsigned int entries = 8;
+    struct device *dev = new_device(entries);
+    const void *held;
+
+    held = get_cache(dev, 500);
+    cache_prefetch(dev, 0, 8 * entries);
+    get_cache(dev, 600);
+    check("prefetch leaves a held block alone until flushed",
+	  block_ok(held, 500));
+
+    cache_prefetch_flush();
+    check("prefetch flush brings the blocks in",
+	  dev->cache_ra_blocks >= entries / 2);
+}
+
+int main(void)
+{
+    test_one_entry();
+    test_stream();
+    test_prefetch_held();
+
+    return failures ? 1 : 0;
+}
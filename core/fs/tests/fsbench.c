@@ -0,0 +1,478 @@
+/*
+ * fsbench.c
+ *
+ * Run the core filesystem drivers on the host, against an image file,
+ * and measure what each operation costs: how many disk requests and
+ * sectors it took, how the block cache did, and the CPU time spent in
+ * the driver.  The disk can be given a per-request latency and a
+ * bandwidth, so the I/O time a real BIOS disk would have taken can be
+ * estimated without booting anything.
+ *
+ * Usage: fsbench [options] image fstype command...
+ *
+ *   fstype    vfat, ext2 (also ext3/ext4), iso, xfs, btrfs, ntfs, ufs
+ *
+ *   -o lba    partition start, in sectors (default 0)
+ *   -S size   sector size (default 2048 for iso, else 512)
+ *   -m count  max sectors per disk request (default 127)
+ *   -c kb     block cache size (default 4096)
+ *   -l usec   latency of each disk request (default 0)
+ *   -b kb/s   disk bandwidth (default unlimited)
+ *   -n count  run each command this many times (default 1)
+ *
+ * Commands:
+ *
+ *   lookup path   find path and close it again
+ *   readdir path  list a directory
+ *   read path     read a file from start to end
+ *   drop          empty the block cache
+ *
+ * Everything is built for the host, which is 64 bits, so the block
+ * cache holds a few less blocks for the same size than on the target.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <ilog2.h>
+#include <dev.h>
+#include <sys/file.h>
+#include <syslinux/boottime.h>
+#include "core.h"
+#include "disk.h"
+#include "fs.h"
+#include "cache.h"
+#include "iso9660/iso9660_fs.h"
+
+/* The core's codepage is read-only; ours is filled in at startup */
+#define codepage codepage_table
+#include "codepage.h"
+#undef codepage
+
+#define DEF_CACHE_KB	4096
+#define DEF_MAXTRANSFER	127
+#define READ_CHUNK	65536	/* Bytes per getfssec() call, as loadfile */
+
+extern const struct fs_ops vfat_fs_ops, ext2_fs_ops, iso_fs_ops,
+    xfs_fs_ops, btrfs_fs_ops, ntfs_fs_ops, ufs_fs_ops;
+
+static const struct {
+    const char *name;
+    const struct fs_ops *ops;
+} fs_types[] = {
+    { "vfat",  &vfat_fs_ops },
+    { "fat",   &vfat_fs_ops },
+    { "ext2",  &ext2_fs_ops },
+    { "ext3",  &ext2_fs_ops },
+    { "ext4",  &ext2_fs_ops },
+    { "iso",   &iso_fs_ops },
+    { "xfs",   &xfs_fs_ops },
+    { "btrfs", &btrfs_fs_ops },
+    { "ntfs",  &ntfs_fs_ops },
+    { "ufs",   &ufs_fs_ops },
+};
+
+/*
+ * What the rest of the core would provide
+ */
+char core_xfer_buf[65536];
+char CurrentDirName[FILENAME_MAX];
+char SubvolName[FILENAME_MAX];
+char ConfigName[FILENAME_MAX];
+uint8_t disk_io_source;
+uint32_t trace_mask;
+struct iso_boot_info iso_boot_info;
+struct codepage_table codepage;
+struct file_info __file_info[1];
+const struct input_dev __file_dev;
+
+int opendev(const struct input_dev *idev, const struct output_dev *odev,
+	    int flags)
+{
+    (void)idev;
+    (void)odev;
+    (void)flags;
+    return -1;
+}
+
+/* The config file search isn't something we measure */
+int search_dirs(struct com32_filedata *filedata,
+		const char *search_directores[], const char *filenames[],
+		char *realname)
+{
+    (void)filedata;
+    (void)search_directores;
+    (void)filenames;
+    (void)realname;
+    return -1;
+}
+
+void __trace(int group, const char *name, const char *str,
+	     uint64_t a, uint64_t b)
+{
+    (void)group;
+    (void)name;
+    (void)str;
+    (void)a;
+    (void)b;
+}
+
+void *zalloc(size_t size)
+{
+    return calloc(1, size);
+}
+
+/* Not in every host C library */
+size_t strlcpy(char *dst, const char *src, size_t size)
+{
+    size_t len = strlen(src);
+
+    if (size) {
+	size_t n = len < size - 1 ? len : size - 1;
+	memcpy(dst, src, n);
+	dst[n] = '\0';
+    }
+    return len;
+}
+
+void _kaboom(void)
+{
+    fprintf(stderr, "fsbench: kaboom\n");
+    exit(1);
+}
+
+void sysappend_set_fs_uuid(void)
+{
+}
+
+void boot_time_stamp(enum boot_phase phase)
+{
+    (void)phase;
+}
+
+void getoneblk(struct disk *disk, char *buf, block_t block, int block_size)
+{
+    int sec_per_block = block_size / disk->sector_size;
+
+    disk->rdwr_sectors(disk, buf, block * sec_per_block, sec_per_block, 0);
+}
+
+/* Case tables for plain ASCII, instead of a loaded codepage */
+static void codepage_init(void)
+{
+    int c;
+
+    for (c = 0; c < 256; c++) {
+	codepage.upper[c] = (c >= 'a' && c <= 'z') ? c - 0x20 : c;
+	codepage.lower[c] = (c >= 'A' && c <= 'Z') ? c + 0x20 : c;
+	codepage.uni[0][c] = c;
+	codepage.uni[1][c] = (c >= 'a' && c <= 'z') ? c - 0x20 :
+	    (c >= 'A' && c <= 'Z') ? c + 0x20 : c;
+    }
+    codepage.magic = CODEPAGE_MAGIC;
+}
+
+/*
+ * The disk: an image file, with the cost of each request tallied
+ */
+static struct {
+    int fd;
+    uint32_t latency_us;
+    uint32_t kbps;		/* 0 = unlimited */
+    uint64_t requests;
+    uint64_t sectors;
+    double io_us;		/* Simulated time spent on the disk */
+} image;
+
+static int image_rdwr_sectors(struct disk *disk, void *buf, sector_t lba,
+			      size_t count, bool is_write)
+{
+    size_t bytes = count << disk->sector_shift;
+    off_t offset = (off_t)(lba + disk->part_start) << disk->sector_shift;
+    ssize_t rv;
+
+    if (is_write)
+	return 0;		/* The image is never written */
+
+    image.requests++;
+    image.sectors += count;
+    image.io_us += image.latency_us;
+    if (image.kbps)
+	image.io_us += bytes * 1000000.0 / ((double)image.kbps * 1024);
+
+    rv = pread(image.fd, buf, bytes, offset);
+    if (rv < 0)
+	return 0;
+    if ((size_t)rv < bytes)
+	memset((char *)buf + rv, 0, bytes - rv); /* Past the end reads 0 */
+
+    disk_io_source = DISK_IO_OTHER;
+    return count;
+}
+
+static struct disk bench_disk = {
+    .sector_size   = 512,
+    .sector_shift  = 9,
+    .maxtransfer   = DEF_MAXTRANSFER,
+    .rdwr_sectors  = image_rdwr_sectors,
+};
+
+static size_t cache_bytes = DEF_CACHE_KB << 10;
+
+struct device *device_init(void *args)
+{
+    static struct device dev;
+
+    (void)args;
+    dev.disk = &bench_disk;
+    dev.cache_data = malloc(cache_bytes);
+    dev.cache_size = dev.cache_data ? cache_bytes : 0;
+    dev.cache_init = 0;
+
+    return &dev;
+}
+
+/* Reached if the driver doesn't recognize the image */
+static int no_fs_init(struct fs_info *fs)
+{
+    (void)fs;
+    fprintf(stderr, "fsbench: the image doesn't hold this filesystem\n");
+    exit(1);
+}
+
+static const struct fs_ops no_fs_ops = {
+    .fs_name = "none",
+    .fs_flags = FS_NODEV,
+    .fs_init = no_fs_init,
+};
+
+/*
+ * The measurements
+ */
+struct sample {
+    uint64_t requests, sectors;
+    uint32_t hits, misses, ra_blocks;
+    double io_us;
+    double cpu_us;
+};
+
+static double cpu_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void sample(struct sample *s)
+{
+    struct device *dev = this_fs->fs_dev;
+
+    s->requests = image.requests;
+    s->sectors = image.sectors;
+    s->io_us = image.io_us;
+    s->hits = dev ? dev->cache_hits : 0;
+    s->misses = dev ? dev->cache_misses : 0;
+    s->ra_blocks = dev ? dev->cache_ra_blocks : 0;
+    s->cpu_us = cpu_now();
+}
+
+static void report(const char *op, const char *path, int result,
+		   const struct sample *a, const struct sample *b)
+{
+    uint32_t hits = b->hits - a->hits;
+    uint32_t lookups = hits + (b->misses - a->misses);
+
+    printf("%-7s %-28s %8d %7" PRIu64 " %8" PRIu64 " %7u %7u %5.1f%% "
+	   "%10.1f %10.1f\n", op, path, result,
+	   b->requests - a->requests, b->sectors - a->sectors,
+	   hits, b->ra_blocks - a->ra_blocks,
+	   lookups ? 100.0 * hits / lookups : 0.0,
+	   b->cpu_us - a->cpu_us, b->io_us - a->io_us);
+}
+
+/*
+ * The operations; each returns a count, or -1 on failure
+ */
+static int do_lookup(const char *path)
+{
+    int handle = searchdir(path, O_RDONLY);
+
+    if (handle < 0)
+	return -1;
+    close_file(handle);
+    return 1;
+}
+
+static int do_readdir(const char *path)
+{
+    struct dirent de;
+    struct file *file;
+    int handle, n = 0;
+
+    handle = searchdir(path, O_RDONLY | O_DIRECTORY);
+    if (handle < 0)
+	return -1;
+
+    file = handle_to_file(handle);
+    if (file->inode->mode == DT_DIR && file->fs->fs_ops->readdir) {
+	while (file->fs->fs_ops->readdir(file, &de) >= 0)
+	    n++;
+    } else {
+	n = -1;
+    }
+
+    close_file(handle);
+    return n;
+}
+
+static int do_read(const char *path)
+{
+    static char buf[READ_CHUNK];
+    struct com32_filedata fd;
+    uint16_t handle;
+    size_t total = 0;
+    int rv;
+
+    rv = open_file(path, O_RDONLY, &fd);
+    if (rv < 0)
+	return -1;
+
+    handle = rv;
+    while (handle)
+	total += pmapi_read_file(&handle, buf,
+				 READ_CHUNK >> SECTOR_SHIFT(this_fs));
+
+    return total > fd.size ? (int)fd.size : (int)total;
+}
+
+static void do_drop(void)
+{
+    struct device *dev = this_fs->fs_dev;
+
+    if (dev && dev->cache_head)
+	cache_init(dev, ilog2(dev->cache_block_size));
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+	    "Usage: fsbench [-o lba] [-S sector size] [-m max sectors]"
+	    " [-c cache kb]\n"
+	    "               [-l latency usec] [-b kb/s] [-n count]"
+	    " image fstype command...\n"
+	    "Commands: lookup path, readdir path, read path, drop\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    const struct fs_ops *ops[3] = { NULL, &no_fs_ops, NULL };
+    struct sample a, b;
+    unsigned int sector_size = 0, i;
+    int opt, repeat = 1, n, result;
+    const char *op, *path;
+
+    while ((opt = getopt(argc, argv, "o:S:m:c:l:b:n:")) != -1) {
+	switch (opt) {
+	case 'o':
+	    bench_disk.part_start = strtoull(optarg, NULL, 0);
+	    break;
+	case 'S':
+	    sector_size = strtoul(optarg, NULL, 0);
+	    break;
+	case 'm':
+	    bench_disk.maxtransfer = strtoul(optarg, NULL, 0);
+	    break;
+	case 'c':
+	    cache_bytes = strtoul(optarg, NULL, 0) << 10;
+	    break;
+	case 'l':
+	    image.latency_us = strtoul(optarg, NULL, 0);
+	    break;
+	case 'b':
+	    image.kbps = strtoul(optarg, NULL, 0);
+	    break;
+	case 'n':
+	    repeat = atoi(optarg);
+	    break;
+	default:
+	    usage();
+	}
+    }
+    if (argc - optind < 3)
+	usage();
+
+    image.fd = open(argv[optind], O_RDONLY);
+    if (image.fd < 0) {
+	fprintf(stderr, "fsbench: %s: %s\n", argv[optind], strerror(errno));
+	return 1;
+    }
+
+    for (i = 0; i < sizeof fs_types / sizeof fs_types[0]; i++) {
+	if (!strcmp(argv[optind + 1], fs_types[i].name))
+	    ops[0] = fs_types[i].ops;
+    }
+    if (!ops[0]) {
+	fprintf(stderr, "fsbench: unknown filesystem %s\n", argv[optind + 1]);
+	return 1;
+    }
+
+    if (!sector_size)
+	sector_size = ops[0] == &iso_fs_ops ? 2048 : 512;
+    if (sector_size & (sector_size - 1) || sector_size < 512) {
+	fprintf(stderr, "fsbench: bad sector size %u\n", sector_size);
+	return 1;
+    }
+    bench_disk.sector_size = sector_size;
+    bench_disk.sector_shift = ilog2(sector_size);
+
+    codepage_init();
+    strcpy(CurrentDirName, "/");
+
+    memset(&a, 0, sizeof a);
+    a.cpu_us = cpu_now();
+    fs_init(ops, NULL);
+    sample(&b);
+
+    printf("%-7s %-28s %8s %7s %8s %7s %7s %6s %10s %10s\n",
+	   "op", "path", "result", "reqs", "sectors", "hits", "ra",
+	   "hit%", "cpu us", "io us");
+    report("mount", this_fs->fs_ops->fs_name, this_fs->block_size, &a, &b);
+
+    for (i = optind + 2; i < (unsigned int)argc; i++) {
+	op = argv[i];
+	path = "";
+	if (strcmp(op, "drop")) {
+	    if (i + 1 >= (unsigned int)argc)
+		usage();
+	    path = argv[++i];
+	}
+
+	if (!strcmp(op, "drop")) {
+	    do_drop();
+	    continue;
+	}
+
+	for (n = 0; n < repeat; n++) {
+	    sample(&a);
+	    if (!strcmp(op, "lookup"))
+		result = do_lookup(path);
+	    else if (!strcmp(op, "readdir"))
+		result = do_readdir(path);
+	    else if (!strcmp(op, "read"))
+		result = do_read(path);
+	    else
+		usage();
+	    sample(&b);
+	    report(op, path, result, &a, &b);
+	}
+    }
+
+    close(image.fd);
+    return 0;
+}
@@ -0,0 +1,35 @@
+#ifndef _BYTESWAP_H
+#define _BYTESWAP_H
+
+/*
+ * The host's <byteswap.h> lacks the unaligned little-endian accessors
+ * the drivers use; the host is little-endian, like the target.
+ */
+#include <stdint.h>
+#include <string.h>
+
+static inline uint16_t get_le16(const uint16_t *p)
+{
+    uint16_t v;
+
+    memcpy(&v, p, sizeof v);
+    return v;
+}
+
+static inline uint32_t get_le32(const uint32_t *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof v);
+    return v;
+}
+
+static inline uint64_t get_le64(const uint64_t *p)
+{
+    uint64_t v;
+
+    memcpy(&v, p, sizeof v);
+    return v;
+}
+
+#endif /* _BYTESWAP_H */
@@ -0,0 +1,9 @@
+#ifndef _DEV_H
+#define _DEV_H
+
+struct input_dev;
+struct output_dev;
+
+int opendev(const struct input_dev *, const struct output_dev *, int);
+
+#endif /* _DEV_H */
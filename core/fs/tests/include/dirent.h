@@ -0,0 +1 @@
+#include <sys/dirent.h>
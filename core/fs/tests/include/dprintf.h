@@ -0,0 +1,8 @@
+#ifndef _DPRINTF_H_
+#define _DPRINTF_H_
+
+#include <stdio.h>		/* Before we hide its dprintf() */
+
+#define dprintf(...)	((void)0)
+
+#endif /* _DPRINTF_H_ */
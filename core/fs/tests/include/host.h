@@ -0,0 +1,25 @@
+/*
+ * Included ahead of everything else when building the filesystem code
+ * on the host: pull in the C library first, then rename the core
+ * functions whose names clash with it.
+ */
+#ifndef HOST_H
+#define HOST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#undef FILENAME_MAX
+
+/* Not in every host C library; fsbench.c provides it */
+size_t strlcpy(char *dst, const char *src, size_t size);
+
+#define realpath	core_realpath
+#define getchar		core_getchar
+#define opendir		core_opendir
+#define readdir		core_readdir
+#define closedir	core_closedir
+
+#endif /* HOST_H */
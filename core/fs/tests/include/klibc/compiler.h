@@ -0,0 +1,18 @@
+#ifndef _COMPILER_H_
+#define _COMPILER_H_
+
+#define __export
+#define __packed	__attribute__((packed))
+#define __weak		__attribute__((weak))
+#define __cdecl
+#define __noreturn	void __attribute__((noreturn))
+#define __constfunc	__attribute__((const))
+#define __unusedfunc	__attribute__((unused))
+#define __bss16
+#define __likely(x)	__builtin_expect(!!(x), 1)
+#define __unlikely(x)	__builtin_expect(!!(x), 0)
+#define __lowmem
+#define likely(x)	__builtin_expect(!!(x), 1)
+#define unlikely(x)	__builtin_expect(!!(x), 0)
+
+#endif /* _COMPILER_H_ */
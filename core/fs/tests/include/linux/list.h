@@ -0,0 +1,2 @@
+#undef container_of
+#include "../../../../../com32/include/linux/list.h"
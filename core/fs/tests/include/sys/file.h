@@ -0,0 +1,25 @@
+#ifndef _SYS_FILE_H
+#define _SYS_FILE_H
+
+/*
+ * Just enough of com32/lib/sys/file.h for fs.c's open_config(),
+ * which the benchmark never calls.
+ */
+#include <syslinux/pmapi.h>
+
+struct input_dev {
+    int dummy;
+};
+
+struct file_info {
+    struct {
+	struct com32_filedata fd;
+	size_t offset;
+	size_t nbytes;
+    } i;
+};
+
+extern struct file_info __file_info[];
+extern const struct input_dev __file_dev;
+
+#endif /* _SYS_FILE_H */
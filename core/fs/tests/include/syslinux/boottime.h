@@ -0,0 +1 @@
+#include "../../../../../com32/include/syslinux/boottime.h"
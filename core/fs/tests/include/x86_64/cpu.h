@@ -0,0 +1 @@
+#include "../../../../../com32/include/sys/x86_64/cpu.h"
@@ -36,19 +36,20 @@ get_blkaddr (const uint8_t *blk, uint32_t index, uint32_t shift)
  * then return the initial value.
  */
 static uint64_t
-scan_set_nblocks(const uint8_t *map, uint32_t index, uint32_t addr_shift,
-		  unsigned int count, size_t *nblocks)
+scan_set_nblocks(struct fs_info *fs, const uint8_t *map, uint32_t index,
+		 uint32_t addr_shift, unsigned int count, size_t *nblocks)
 {
     uint64_t addr;
     uint64_t blk = get_blkaddr(map, index, addr_shift);
 
     /*
-     * Block spans 8 fragments, then address is interleaved by 8.
-     * This code works for either 32/64 sized addresses.
+     * Block spans (1 << c_blk_frag_shift) fragments, then address is
+     * interleaved by that.  This code works for either 32/64 sized
+     * addresses.
      */
     if (nblocks) {
-	uint32_t skip = blk ? FRAGMENTS_PER_BLK : 0;
-	uint32_t next = blk + skip;
+	uint32_t skip = blk ? 1 << UFS_SB(fs)->c_blk_frag_shift : 0;
+	uint64_t next = blk + skip;
 	size_t   cnt = 1;
 
 	/* Get address of starting blk pointer */
@@ -73,7 +74,7 @@ scan_set_nblocks(const uint8_t *map, uint32_t index, uint32_t addr_shift,
 	}
 	*nblocks = cnt;
 	ufs_debug("[scan] nblocks: %u\n", cnt);
-	ufs_debug("[scan] end blk: %u\n", next - FRAGMENTS_PER_BLK);
+	ufs_debug("[scan] end blk: %u\n", next - skip);
     }
 
     return blk;
@@ -83,20 +84,33 @@ scan_set_nblocks(const uint8_t *map, uint32_t index, uint32_t addr_shift,
  * The actual indirect block map handling - the block passed in should
  * be relative to the beginning of the particular block hierarchy.
  *
+ * The lowest-level map block found is remembered in the inode, so that
+ * walking on through the blocks it maps skips the upper levels.
+ *
  * @shft_per_blk: shift to get nr. of addresses in a block.
  * @mask_per_blk: mask to limit the max nr. of addresses in a block.
  * @addr_count:   nr. of addresses in a block.
  */
 static uint64_t
-bmap_indirect(struct fs_info *fs, uint64_t start, uint32_t block,
+bmap_indirect(struct inode *inode, uint64_t start, uint32_t block,
 	      int levels, size_t *nblocks)
 {
+    struct fs_info *fs = inode->fs;
+    struct ufs_inode_pvt *pvt = PVT(inode);
     uint32_t shft_per_blk = fs->block_shift - UFS_SB(fs)->addr_shift;
     uint32_t addr_count = (1 << shft_per_blk);
     uint32_t mask_per_blk = addr_count - 1;
+    uint32_t tree = levels;
     const uint8_t *blk = NULL;
     uint32_t index = 0;
 
+    if (pvt->map_frag && pvt->map_levels == tree &&
+	pvt->map_first == (block & ~mask_per_blk)) {
+	blk = get_cache(fs->fs_dev, frag_to_blk(fs, pvt->map_frag));
+	index = block & mask_per_blk;
+	goto scan;
+    }
+
     while (levels--) {
 	if (!start) {
 	    if (nblocks)
@@ -104,12 +118,19 @@ bmap_indirect(struct fs_info *fs, uint64_t start, uint32_t block,
 	    return 0;
 	}
 
+	if (!levels) {
+	    pvt->map_frag = start;
+	    pvt->map_first = block & ~mask_per_blk;
+	    pvt->map_levels = tree;
+	}
+
 	blk = get_cache(fs->fs_dev, frag_to_blk(fs, start));
 	index = (block >> (levels * shft_per_blk)) & mask_per_blk;
 	start = get_blkaddr(blk, index, UFS_SB(fs)->addr_shift);
     }
 
-    return scan_set_nblocks(blk, index, UFS_SB(fs)->addr_shift,
+scan:
+    return scan_set_nblocks(fs, blk, index, UFS_SB(fs)->addr_shift,
 			    addr_count - index, nblocks);
 }
 
@@ -139,26 +160,26 @@ uint64_t ufs_bmap (struct inode *inode, block_t block, size_t *nblocks)
      * was extended to 64 bits.
      */
     if (block < UFS_DIRECT_BLOCKS)
-	return scan_set_nblocks((uint8_t *) PVT(inode)->direct_blk_ptr,
+	return scan_set_nblocks(fs, (uint8_t *) PVT(inode)->direct_blk_ptr,
 				block, UFS2_ADDR_SHIFT,
 				UFS_DIRECT_BLOCKS - block, nblocks);
 
     /* indirect blocks */
     block -= UFS_DIRECT_BLOCKS;
     if (block < indir_blks)
-	return bmap_indirect(fs, PVT(inode)->indirect_blk_ptr,
+	return bmap_indirect(inode, PVT(inode)->indirect_blk_ptr,
 			     block, 1, nblocks);
 
     /* double indirect blocks */
     block -= indir_blks;
     if (block < double_blks)
-	return bmap_indirect(fs, PVT(inode)->double_indirect_blk_ptr,
+	return bmap_indirect(inode, PVT(inode)->double_indirect_blk_ptr,
 			     block, 2, nblocks);
 
     /* triple indirect blocks */
     block -= double_blks;
     if (block < triple_blks)
-	return bmap_indirect(fs, PVT(inode)->triple_indirect_blk_ptr,
+	return bmap_indirect(inode, PVT(inode)->triple_indirect_blk_ptr,
 			     block, 3, nblocks);
 
     /* This can't happen... */
@@ -168,6 +189,10 @@ uint64_t ufs_bmap (struct inode *inode, block_t block, size_t *nblocks)
 /*
  * Next extent for getfssec
  * "Remaining sectors" means (lstart & blkmask).
+ *
+ * A run found by ufs_bmap() ends with the block map it came from; keep
+ * appending the runs after it for as long as they carry on physically
+ * (or are all holes), so a contiguous file reads as a few large extents.
  */
 int ufs_next_extent(struct inode *inode, uint32_t lstart)
 {
@@ -175,13 +200,28 @@ int ufs_next_extent(struct inode *inode, uint32_t lstart)
     int blktosec =  BLOCK_SHIFT(fs) - SECTOR_SHIFT(fs);
     int frag_shift = BLOCK_SHIFT(fs) - UFS_SB(fs)->c_blk_frag_shift;
     int blkmask = (1 << blktosec) - 1;
-    block_t block;
-    size_t nblocks = 0;
+    uint32_t frags = 1 << UFS_SB(fs)->c_blk_frag_shift;
+    block_t lblock = lstart >> blktosec;
+    block_t fblocks = (inode->size + BLOCK_SIZE(fs) - 1) >> BLOCK_SHIFT(fs);
+    block_t block, next;
+    size_t nblocks = 0, more;
 
     ufs_debug("ufs_next_extent:\n");
-    block = ufs_bmap(inode, lstart >> blktosec, &nblocks);
+    block = ufs_bmap(inode, lblock, &nblocks);
     ufs_debug("blk: %u\n", block);
 
+    while (nblocks < UFS_MAX_EXTENT_BLKS && lblock + nblocks < fblocks) {
+	more = 0;
+	next = ufs_bmap(inode, lblock + nblocks, &more);
+	if (!more)
+	    break;
+	if (block ? next != block + nblocks * frags : next != 0)
+	    break;
+	nblocks += more;
+    }
+    if (nblocks > UFS_MAX_EXTENT_BLKS)
+	nblocks = UFS_MAX_EXTENT_BLKS;
+
     if (!block) // Sparse block
 	inode->next_extent.pstart = EXTENT_ZERO;
     else
@@ -199,4 +239,4 @@ int ufs_next_extent(struct inode *inode, uint32_t lstart)
      */
     inode->next_extent.len = (nblocks << blktosec) - (lstart & blkmask);
     return 0;
-}
\ No newline at end of file
+}
@@ -460,6 +460,7 @@ static int ufs_fs_init(struct fs_info *fs)
     cache_init(fs->fs_dev, sb.block_shift);
     cs = _get_cache_block(fs->fs_dev, 0);
     memset(cs->data, 0, fs->block_size);
+    cache_set_block(fs->fs_dev, cs, 0);
     cache_lock_block(cs);
 
     /* For debug purposes */
@@ -46,6 +46,9 @@
 /* Blocks span 8 fragments */
 #define FRAGMENTS_PER_BLK 8
 
+/* Longest extent ufs_next_extent() will build, in blocks */
+#define UFS_MAX_EXTENT_BLKS 0x10000
+
 /* UFS types */
 typedef enum {
     NONE,
@@ -212,6 +215,11 @@ struct ufs_inode_pvt {
     uint64_t indirect_blk_ptr;
     uint64_t double_indirect_blk_ptr;
     uint64_t triple_indirect_blk_ptr;
+
+    /* Last lowest-level map block used by bmap_indirect() */
+    uint64_t map_frag;		/* Its fragment address, 0 = none */
+    uint32_t map_first;		/* First block it maps, in its tree */
+    uint32_t map_levels;	/* Which tree: 1, 2 or 3 levels deep */
 };
 
 struct ufs_dir_entry {
@@ -27,6 +27,25 @@
 
 #include "xfs_dinode.h"
 
+/* Inodes are allocated in chunks of this many, at aligned numbers */
+#define XFS_INODES_PER_CHUNK	64
+
+/*
+ * The files of a directory mostly have their inodes in the same chunk,
+ * so when one is looked up, read in the blocks of the whole chunk with
+ * one request, and the others are in the block cache when asked for.
+ */
+static void xfs_dinode_readahead(struct fs_info *fs, xfs_ino_t ino)
+{
+    xfs_ino_t first = ino & ~(xfs_ino_t)(XFS_INODES_PER_CHUNK - 1);
+    block_t blk = ino_to_bytes(fs, first) >> BLOCK_SHIFT(fs);
+    size_t nblocks = ((uint64_t)XFS_INODES_PER_CHUNK <<
+		      XFS_INFO(fs)->inode_shift) >> BLOCK_SHIFT(fs);
+
+    if (nblocks > 1)
+	cache_readahead(fs->fs_dev, blk, nblocks);
+}
+
 xfs_dinode_t *xfs_dinode_get_core(struct fs_info *fs, xfs_ino_t ino)
 {
     block_t blk;
@@ -46,6 +65,7 @@ xfs_dinode_t *xfs_dinode_get_core(struct fs_info *fs, xfs_ino_t ino)
     xfs_debug("blk %llu block offset 0x%llx", blk, blk << BLOCK_SHIFT(fs));
     xfs_debug("inode offset in block (in bytes) is 0x%llx", offset);
 
+    xfs_dinode_readahead(fs, ino);
     core = (xfs_dinode_t *)((uint8_t *)get_cache(fs->fs_dev, blk) + offset);
     if (be16_to_cpu(core->di_magic) !=
 	be16_to_cpu(*(uint16_t *)XFS_DINODE_MAGIC)) {
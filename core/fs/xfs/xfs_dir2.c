@@ -18,6 +18,7 @@
 #include <cache.h>
 #include <core.h>
 #include <fs.h>
+#include <ilog2.h>
 
 #include "xfs_types.h"
 #include "xfs_sb.h"
@@ -28,16 +29,34 @@
 
 #include "xfs_dir2.h"
 
-#define XFS_DIR2_DIRBLKS_CACHE_SIZE 128
+/*
+ * Directory blocks are kept in a hashed LRU of malloc'd buffers.  It may
+ * hold a fraction of what the block cache got, so it scales with memory
+ * like that does.  The XFS_DIR2_DIRBLKS_KEEP most recently used entries
+ * are never evicted, since lookups hold on to a couple of buffers (node,
+ * leaf) while fetching the data blocks.
+ */
+#define XFS_DIR2_DIRBLKS_MIN_BYTES	(256 << 10)
+#define XFS_DIR2_DIRBLKS_KEEP		8
 
 struct xfs_dir2_dirblks_cache {
+    struct xfs_dir2_dirblks_cache *dc_hnext;	/* Hash chain */
+    struct xfs_dir2_dirblks_cache *dc_prev;	/* LRU list, MRU first */
+    struct xfs_dir2_dirblks_cache *dc_next;
     block_t        dc_startblock;
     xfs_filblks_t  dc_blkscount;
+    size_t         dc_len;
     void          *dc_area;
 };
 
-static struct xfs_dir2_dirblks_cache dirblks_cache[XFS_DIR2_DIRBLKS_CACHE_SIZE];
-static unsigned char                 dirblks_cached_count = 0;
+static struct {
+    struct xfs_dir2_dirblks_cache **hash;
+    unsigned int hash_shift;
+    struct xfs_dir2_dirblks_cache lru;	/* List head */
+    size_t bytes, max_bytes;
+    unsigned int count;
+    unsigned int hits, misses, evictions;
+} dirblks;
 
 uint32_t xfs_dir2_da_hashname(const uint8_t *name, int namelen)
 {
@@ -88,88 +107,124 @@ static void *get_dirblks(struct fs_info *fs, block_t startblock,
     return buf;
 }
 
-void *xfs_dir2_dirblks_get_cached(struct fs_info *fs, block_t startblock,
-				  xfs_filblks_t c)
+static inline struct xfs_dir2_dirblks_cache **
+dirblks_bucket(block_t startblock)
 {
-    unsigned char i;
-    void *buf;
+    uint32_t h = (uint32_t)startblock ^ (uint32_t)(startblock >> 32);
 
-    xfs_debug("fs %p startblock %llu (0x%llx) blkscount %lu", fs, startblock,
-	      startblock, c);
+    return &dirblks.hash[(h * 0x9e370001U) >> dirblks.hash_shift];
+}
 
-    if (!dirblks_cached_count) {
-	buf = get_dirblks(fs, startblock, c);
-	if (!buf)
-	    return NULL;
+static void dirblks_init(struct fs_info *fs)
+{
+    unsigned int entries, hash_bits;
+
+    dirblks.max_bytes = fs->fs_dev->cache_size >> 2;
+    if (dirblks.max_bytes < XFS_DIR2_DIRBLKS_MIN_BYTES)
+	dirblks.max_bytes = XFS_DIR2_DIRBLKS_MIN_BYTES;
+
+    entries = dirblks.max_bytes / XFS_INFO(fs)->dirblksize;
+    hash_bits = entries > 16 ? ilog2(entries) : 4;
+    dirblks.hash = zalloc(sizeof(*dirblks.hash) << hash_bits);
+    if (!dirblks.hash)
+	malloc_error("dirblks hash table");
+    dirblks.hash_shift = 32 - hash_bits;
+    dirblks.lru.dc_prev = dirblks.lru.dc_next = &dirblks.lru;
+
+    xfs_debug("dirblks cache: %zu bytes, %u buckets", dirblks.max_bytes,
+	      1U << hash_bits);
+}
 
-	dirblks_cache[dirblks_cached_count].dc_startblock = startblock;
-	dirblks_cache[dirblks_cached_count].dc_blkscount = c;
-	dirblks_cache[dirblks_cached_count].dc_area = buf;
+static void dirblks_lru_unlink(struct xfs_dir2_dirblks_cache *dc)
+{
+    dc->dc_prev->dc_next = dc->dc_next;
+    dc->dc_next->dc_prev = dc->dc_prev;
+}
 
-	return dirblks_cache[dirblks_cached_count++].dc_area;
-    } else if (dirblks_cached_count == XFS_DIR2_DIRBLKS_CACHE_SIZE) {
-	for (i = 0; i < XFS_DIR2_DIRBLKS_CACHE_SIZE / 2; i++) {
-	    unsigned char k = XFS_DIR2_DIRBLKS_CACHE_SIZE - (i + 1);
+static void dirblks_lru_add(struct xfs_dir2_dirblks_cache *dc)
+{
+    struct xfs_dir2_dirblks_cache *head = &dirblks.lru;
 
-	    free(dirblks_cache[i].dc_area);
-	    dirblks_cache[i] = dirblks_cache[k];
-	    memset(&dirblks_cache[k], 0, sizeof(dirblks_cache[k]));
-	}
+    dc->dc_prev = head;
+    dc->dc_next = head->dc_next;
+    head->dc_next->dc_prev = dc;
+    head->dc_next = dc;
+}
 
-	buf = get_dirblks(fs, startblock, c);
-	if (!buf)
-	    return NULL;
+static void dirblks_drop(struct xfs_dir2_dirblks_cache *dc)
+{
+    struct xfs_dir2_dirblks_cache **pp = dirblks_bucket(dc->dc_startblock);
 
-	dirblks_cache[XFS_DIR2_DIRBLKS_CACHE_SIZE / 2].dc_startblock =
-	    startblock;
-	dirblks_cache[XFS_DIR2_DIRBLKS_CACHE_SIZE / 2].dc_blkscount = c;
-	dirblks_cache[XFS_DIR2_DIRBLKS_CACHE_SIZE / 2].dc_area = buf;
+    while (*pp != dc)
+	pp = &(*pp)->dc_hnext;
+    *pp = dc->dc_hnext;
+    dirblks_lru_unlink(dc);
 
-	dirblks_cached_count = XFS_DIR2_DIRBLKS_CACHE_SIZE / 2;
+    dirblks.bytes -= dc->dc_len;
+    dirblks.count--;
+    free(dc->dc_area);
+    free(dc);
+}
 
-	return dirblks_cache[dirblks_cached_count++].dc_area;
-    } else {
-	block_t block;
-	xfs_filblks_t count;
+void *xfs_dir2_dirblks_get_cached(struct fs_info *fs, block_t startblock,
+				  xfs_filblks_t c)
+{
+    struct xfs_dir2_dirblks_cache **bucket, *dc;
+    void *buf;
 
-	block = dirblks_cache[dirblks_cached_count - 1].dc_startblock;
-	count = dirblks_cache[dirblks_cached_count - 1].dc_blkscount;
+    xfs_debug("fs %p startblock %llu (0x%llx) blkscount %lu", fs, startblock,
+	      startblock, c);
 
-	if (block == startblock && count == c) {
-	    return dirblks_cache[dirblks_cached_count - 1].dc_area;
-	} else {
-	    for (i = 0; i < dirblks_cached_count; i++) {
-		block = dirblks_cache[i].dc_startblock;
-		count = dirblks_cache[i].dc_blkscount;
+    if (!dirblks.hash)
+	dirblks_init(fs);
 
-		if (block == startblock && count == c)
-		    return dirblks_cache[i].dc_area;
-	    }
+    bucket = dirblks_bucket(startblock);
+    for (dc = *bucket; dc; dc = dc->dc_hnext) {
+	if (dc->dc_startblock == startblock && dc->dc_blkscount == c) {
+	    dirblks.hits++;
+	    dirblks_lru_unlink(dc);
+	    dirblks_lru_add(dc);
+	    return dc->dc_area;
+	}
+    }
 
-	    buf = get_dirblks(fs, startblock, c);
-	    if (!buf)
-		return NULL;
+    dirblks.misses++;
+    buf = get_dirblks(fs, startblock, c);
+    if (!buf)
+	return NULL;
+
+    dc = malloc(sizeof *dc);
+    if (!dc)
+	malloc_error("dirblks cache entry");
+    dc->dc_startblock = startblock;
+    dc->dc_blkscount = c;
+    dc->dc_len = c * XFS_INFO(fs)->dirblksize;
+    dc->dc_area = buf;
+    dc->dc_hnext = *bucket;
+    *bucket = dc;
+    dirblks_lru_add(dc);
+    dirblks.bytes += dc->dc_len;
+    dirblks.count++;
+
+    while (dirblks.bytes > dirblks.max_bytes &&
+	   dirblks.count > XFS_DIR2_DIRBLKS_KEEP) {
+	dirblks_drop(dirblks.lru.dc_prev);
+	dirblks.evictions++;
+    }
 
-	    dirblks_cache[dirblks_cached_count].dc_startblock = startblock;
-	    dirblks_cache[dirblks_cached_count].dc_blkscount = c;
-	    dirblks_cache[dirblks_cached_count].dc_area = buf;
+    xfs_debug("dirblks cache: %u hits %u misses %u evictions",
+	      dirblks.hits, dirblks.misses, dirblks.evictions);
 
-	    return dirblks_cache[dirblks_cached_count++].dc_area;
-	}
-    }
-    return NULL;
+    return buf;
 }
 
 void xfs_dir2_dirblks_flush_cache(void)
 {
-    unsigned char i;
-
-    for (i = 0; i < dirblks_cached_count; i++) {
-	free(dirblks_cache[i].dc_area);
-	memset(&dirblks_cache[i], 0, sizeof(dirblks_cache[i]));
-    }
+    if (!dirblks.hash)
+	return;
 
-    dirblks_cached_count = 0;
+    while (dirblks.lru.dc_next != &dirblks.lru)
+	dirblks_drop(dirblks.lru.dc_next);
 }
 
 struct inode *xfs_dir2_local_find_entry(const char *dname, struct inode *parent,
@@ -118,8 +118,6 @@ int xfs_readdir_dir2_local(struct file *file, struct dirent *dirent,
     return retval;
 
 out:
-    xfs_dir2_dirblks_flush_cache();
-
     return -1;
 }
 
@@ -200,8 +198,6 @@ int xfs_readdir_dir2_block(struct file *file, struct dirent *dirent,
     return retval;
 
 out:
-    xfs_dir2_dirblks_flush_cache();
-
     return -1;
 }
 
@@ -291,8 +287,6 @@ int xfs_readdir_dir2_leaf(struct file *file, struct dirent *dirent,
     return retval;
 
 out:
-    xfs_dir2_dirblks_flush_cache();
-
     return -1;
 }
 
@@ -424,8 +418,6 @@ try_next_btree:
     return retval;
 
 out:
-    xfs_dir2_dirblks_flush_cache();
-
     XFS_PVT(inode)->i_btree_offset = 0;
     XFS_PVT(inode)->i_leaf_ent_offset = 0;
 
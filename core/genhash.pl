@@ -2,25 +2,105 @@
 #
 # Generate hash values for keywords
 #
+# With -c, generate a C header instead: an enum of the keywords, and a
+# table indexed by the top KWD_HASH_BITS of hash * KWD_HASH_MULT, the
+# multiplier picked so that no two keywords share a slot.  Looking a
+# word up is then one hash, one slot and one compare.
+#
 
 eval { use bytes; };
 
+$cmode = (defined($ARGV[0]) && $ARGV[0] eq '-c');
+
+sub keyword_hash($)
+{
+    my($keywd) = @_;
+    my($i, $c);
+    my $h = 0;
+
+    for ( $i = 0 ; $i < length($keywd) ; $i++ ) {
+	$c = ord(substr($keywd,$i,1)) | 0x20;
+	$h = ((($h << 5)|($h >> 27)) ^ $c) & 0xFFFFFFFF;
+    }
+
+    return $h;
+}
+
 while ( defined($keywd = <STDIN>) ) {
     chomp $keywd;
+    next if ( $cmode && $keywd =~ /^\s*(\#.*)?$/ );
 
     ($keywd,$keywdname) = split(/\s+/, $keywd);
     $keywdname = $keywd unless ( $keywdname );
 
-    $l = length($keywd);
-    $h = 0;
-    for ( $i = 0 ; $i < $l ; $i++ ) {
-	$c = ord(substr($keywd,$i,1)) | 0x20;
-	$h = ((($h << 5)|($h >> 27)) ^ $c) & 0xFFFFFFFF;
-    }
+    $h = keyword_hash($keywd);
     if ( $seenhash{$h} ) {
 	printf STDERR "$0: hash collision (0x%08x) %s %s\n",
 	$h, $keywd, $seenhash{$h};
+	exit 1 if ( $cmode );
     }
     $seenhash{$h} = $keywd;
-    printf("%-23s equ 0x%08x\n", "hash_${keywdname}", $h);
+
+    if ( $cmode ) {
+	push(@keywds, $keywd);
+	push(@names, "KWD_\U$keywdname");
+	push(@hashes, $h);
+    } else {
+	printf("%-23s equ 0x%08x\n", "hash_${keywdname}", $h);
+    }
+}
+
+exit 0 unless ( $cmode );
+
+# Multiply, and take the top bits: a power of two, so no divide
+sub slot($$$)
+{
+    my($h, $mult, $bits) = @_;
+    my $x = ($h * ($mult & 0xffff) +
+	     ((($h * ($mult >> 16)) & 0xffff) << 16)) & 0xFFFFFFFF;
+
+    return $x >> (32 - $bits);
+}
+
+$n = scalar(@keywds);
+for ( $bits = 1 ; (1 << $bits) < $n ; $bits++ ) { }
+$mult = 0;
+for ( ; $bits <= 16 && !$mult ; $bits++ ) {
+    $m = 0x9e3779b1;
+    for ( $try = 0 ; $try < 100000 ; $try++ ) {
+	%slot = ();
+	foreach $h ( @hashes ) {
+	    last if ( defined($slot{slot($h, $m, $bits)}) );
+	    $slot{slot($h, $m, $bits)} = 1;
+	}
+	if ( scalar(keys %slot) == $n ) {
+	    $mult = $m;
+	    last;
+	}
+	$m = ($m * 69069 + 1) % 4294967296 | 1;
+    }
+}
+$bits--;
+if ( !$mult ) {
+    print STDERR "$0: no collision-free table for $n keywords\n";
+    exit 1;
+}
+
+print "/* Generated by genhash.pl -c; do not edit */\n\n";
+print "enum keyword {\n";
+print "    KWD_NONE,\n";
+foreach $name ( @names ) {
+    print "    $name,\n";
+}
+print "};\n\n";
+printf("#define KWD_HASH_BITS %d\n", $bits);
+printf("#define KWD_HASH_MULT 0x%08x\n\n", $mult);
+print "static const struct keyword_slot {\n";
+print "    const char *name;\n";
+print "    enum keyword kwd;\n";
+print "} kwd_hash[1 << KWD_HASH_BITS] = {\n";
+for ( $i = 0 ; $i < $n ; $i++ ) {
+    printf("    [%d] = { \"%s\", %s },\n",
+	   slot($hashes[$i], $mult, $bits), $keywds[$i], $names[$i]);
 }
+print "};\n";
@@ -37,6 +37,10 @@ void reset_idle(void)
 
 __export void __idle(void)
 {
+    /* Keep the serial ports busy rather than halting with output queued */
+    if (serial_tx_poll() | dmesg_drain())
+	return;
+
     if (jiffies() - _IdleTimer < TICKS_TO_IDLE)
 	return;
 
@@ -6,19 +6,47 @@
 #include "disk.h"
 #include "fs.h"
 
+/*
+ * Upper bound on the number of blocks fetched by a single read-ahead;
+ * the actual window is further limited by the disk's maxtransfer.
+ */
+#define CACHE_MAX_READAHEAD	16
+
+/* Pending cache_prefetch() requests; more are dropped until a flush */
+#define CACHE_PREFETCH_QUEUE	8
+
+/*
+ * The block cache is sized at device_init() time to a 1/2^CACHE_MEM_SHIFT
+ * share of the free high memory, clamped to [CACHE_SIZE_MIN,
+ * CACHE_SIZE_MAX].  CACHE_SIZE_MAX is set at build time (make
+ * CACHE_SIZE_MAX=bytes); 0 gives the old fixed-size cache.
+ */
+#define CACHE_SIZE_MIN		(128 << 10)
+#ifndef CACHE_SIZE_MAX
+# define CACHE_SIZE_MAX		(64 << 20)
+#endif
+#define CACHE_MEM_SHIFT		5
+
 /* The cache structure */
 struct cache {
     block_t block;
     struct cache *prev;
     struct cache *next;
+    struct cache *hnext;	/* Next descriptor in the same hash bucket */
     void *data;
+    uint8_t hot;		/* On the protected chain */
+    uint8_t unref;		/* Read ahead, not referenced yet */
 };
 
 /* functions defined in cache.c */
 void cache_init(struct device *, int);
 const void *get_cache(struct device *, block_t);
 struct cache *_get_cache_block(struct device *, block_t);
+void cache_set_block(struct device *, struct cache *, block_t);
 void cache_lock_block(struct cache *);
+size_t cache_readahead(struct device *, block_t, size_t);
+void cache_prefetch(struct device *, block_t, size_t);
+void cache_prefetch_flush(void);
 size_t cache_read(struct fs_info *, void *, uint64_t, size_t);
 
 #endif /* cache.h */
@@ -43,6 +43,9 @@ extern __weak uint16_t BIOSName;
 extern __weak char KernelName[];
 extern __weak char StackBuf[];
 
+/* Only ldlinux.sys has this; see fs/preload.c */
+extern __weak char PreloadMap[];
+
 extern uint8_t KbdMap[256];
 
 extern const uint16_t IPAppends[];
@@ -53,6 +56,7 @@ extern uint16_t BaudDivisor;
 extern uint8_t FlowOutput;
 extern uint8_t FlowInput;
 extern uint8_t FlowIgnore;
+extern uint8_t SerialTxFifo;
 
 extern uint8_t ScrollAttribute;
 extern uint16_t DisplayCon;
@@ -63,6 +67,7 @@ extern void getlinsec(void);
 /* pm.inc */
 void core_pm_null_hook(void);
 extern void (*core_pm_hook)(void);
+extern void (*core_tick_hook)(uint32_t eip);
 
 /* getc.inc */
 extern void core_open(void);
@@ -71,6 +76,20 @@ extern void core_open(void);
 extern void adv_init(void);
 extern void adv_write(void);
 
+/* boottime.c */
+extern void boot_time_init(void);
+
+/* clock.c */
+extern void clock_init(void);
+
+/* com32/lib/vdprintf.c */
+extern void dmesg_init(void);
+extern int dmesg_drain(void);
+
+/* mtrr.c */
+extern void mtrr_set_wc(uint32_t base, uint32_t used, uint32_t vram);
+extern void mtrr_cleanup(void);
+
 /* hello.c */
 extern void myputs(const char*);
 
@@ -92,6 +111,8 @@ extern const char *sysappend_strings[SYSAPPEND_MAX];
 extern uint32_t SysAppends;
 extern void sysappend_set_uuid(const uint8_t *uuid);
 extern void sysappend_set_fs_uuid(void);
+extern void sysappend_set(enum syslinux_sysappend type, const char *str);
+extern const char *sysappend_line(size_t *len);
 
 void __cdecl core_intcall(uint8_t, const com32sys_t *, com32sys_t *);
 void __cdecl core_farcall(uint32_t, const com32sys_t *, com32sys_t *);
@@ -125,6 +146,8 @@ extern int start_ldlinux(int argc, char **argv);
 extern int create_args_and_load(char *);
 
 extern void write_serial(char data);
+extern int serial_tx_poll(void);
+extern void serial_tx_flush(void);
 extern void writestr(char *str);
 extern void writechr(char data);
 extern void crlf(void);
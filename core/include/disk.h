@@ -5,12 +5,15 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <core.h>
+#include <syslinux/disktrace.h>
 
 typedef uint64_t sector_t;
 typedef uint64_t block_t;
 
 struct bios_disk_private {
 	com32sys_t *regs;
+	uint8_t edd_version;	/* From INT 13h AH=41h, 0 if no EBIOS */
+	int8_t edd_flat;	/* 64-bit flat buffers: 1 ok, -1 no, 0 untested */
 };
 
 /*
@@ -30,14 +33,22 @@ struct disk {
 
     sector_t part_start;   /* the start address of this partition(in sectors) */
 
+    /* Returns the number of sectors transferred */
     int (*rdwr_sectors)(struct disk *, void *, sector_t, size_t, bool);
+
+    unsigned int io_align;	/* Required buffer alignment, 0 = any */
 };
 
 extern void read_sectors(char *, sector_t, int);
 extern void getoneblk(struct disk *, char *, block_t, int);
 
+/* Tag for the trace ring, reset to DISK_IO_OTHER after each transfer */
+extern uint8_t disk_io_source;
+
 /* diskio.c */
 struct disk *bios_disk_init(void *);
+struct com32_disk_probe;
+int bios_disk_probe(int, struct com32_disk_probe *);
 struct device *device_init(void *);
 
 #endif /* DISK_H */
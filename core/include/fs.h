@@ -46,6 +46,7 @@ enum fs_flags {
     FS_NODEV   = 1 << 0,
     FS_USEMEM  = 1 << 1,        /* If we need a malloc routine, set it */
     FS_THISIND = 1 << 2,        /* Set cwd based on config file location */
+    FS_INOCACHE = 1 << 3,       /* Released inodes can be revived by number */
 };
 
 struct fs_ops {
@@ -66,11 +67,30 @@ struct fs_ops {
     struct inode * (*iget_root)(struct fs_info *);
     struct inode * (*iget)(const char *, struct inode *);
     int	     (*readlink)(struct inode *, char *);
+    /* Optional: release private data hanging off the inode */
+    void     (*free_inode)(struct inode *);
 
     /* the _dir_ stuff */
     int	     (*readdir)(struct file *, struct dirent *);
+    /* Optional; fills up to count entries, returns how many, 0 at the end */
+    int	     (*readdir_batch)(struct file *, struct dirent *, int count);
 
     int      (*next_extent)(struct inode *, uint32_t);
+    /*
+     * Optional: queue (with cache_prefetch()) the metadata next_extent()
+     * is going to want for the extents from the given sector on.  The
+     * caller flushes the queue once this returns.
+     */
+    void     (*prefetch)(struct inode *, uint32_t);
+    /*
+     * Optional: start reading the named file in the background, so
+     * that a searchdir() for it soon after finds it in memory.
+     */
+    void     (*prefetch_file)(struct fs_info *, const char *);
+    /* Optional: network transfer statistics; 0 on success */
+    int      (*net_stats)(struct com32_net_stats *);
+    /* Optional: what to hand a chained loader; returns the length */
+    int      (*net_handoff)(void *, size_t);
 
     int      (*copy_super)(void *buf);
 
@@ -135,10 +155,24 @@ struct device {
     /* the cache stuff */
     uint8_t cache_init; /* cache initialized state */
     char *cache_data;
-    struct cache *cache_head;
-    uint16_t cache_block_size;
-    uint16_t cache_entries;
+    struct cache *cache_head;	/* Probation chain */
+    struct cache *cache_hot_head;	/* Protected chain */
+    struct cache **cache_hash;	/* Hash buckets, indexed by block number */
+    char *cache_ra_buf;		/* Staging buffer for read-ahead */
+    uint32_t cache_block_size;
+    uint32_t cache_entries;
     uint32_t cache_size;
+    uint8_t cache_hash_shift;	/* 32 - log2(number of hash buckets) */
+    uint16_t cache_readahead;	/* Max blocks per read-ahead, 0 = off */
+    uint32_t cache_hot_count;	/* Blocks on the protected chain */
+    uint32_t cache_hot_max;
+
+    /* cache statistics */
+    uint32_t cache_hits;
+    uint32_t cache_misses;
+    uint32_t cache_evictions;	/* Valid blocks thrown out for new ones */
+    uint32_t cache_ra_reqs;	/* Read-ahead disk requests */
+    uint32_t cache_ra_blocks;	/* Blocks brought in by read-ahead */
 };
 
 /*
@@ -153,6 +187,7 @@ static inline bool not_whitespace(char c)
  * Inode allocator/deallocator
  */
 struct inode *alloc_inode(struct fs_info *fs, uint32_t ino, size_t data);
+struct inode *revive_inode(struct fs_info *fs, uint32_t ino);
 static inline void free_inode(struct inode * inode)
 {
     free(inode);
@@ -205,6 +240,7 @@ int searchdir(const char *name, int flags);
 void _close_file(struct file *);
 size_t pmapi_read_file(uint16_t *handle, void *buf, size_t sectors);
 int open_file(const char *name, int flags, struct com32_filedata *filedata);
+void prefetch_file(const char *name);
 void pm_open_file(com32sys_t *);
 void close_file(uint16_t handle);
 void pm_close_file(com32sys_t *);
@@ -213,6 +249,21 @@ char *fs_uuid(void);
 
 extern uint16_t SectorShift;
 
+#define FS_VERIFY_META	1	/* Tree nodes and other metadata blocks */
+#define FS_VERIFY_DATA	2	/* File contents */
+
+extern uint16_t FsVerify;
+
+/* history.c */
+#define BOOT_HISTORY_SIZE	255	/* What one ADV tag holds */
+
+void history_add(const char *name);
+const char *boot_history(size_t *len);
+void prefetch_metadata(const char *name);
+
+/* preload.c */
+int preload_open(const char *name, int flags, struct file *file);
+
 /* chdir.c */
 void pm_realpath(com32sys_t *regs);
 size_t realpath(char *dst, const char *src, size_t bufsize);
@@ -221,6 +272,7 @@ int chdir(const char *src);
 /* readdir.c */
 DIR *opendir(const char *pathname);
 struct dirent *readdir(DIR *dir);
+int readdir_batch(DIR *dir, struct dirent *buf, int count);
 int closedir(DIR *dir);
 
 /* getcwd.c */
@@ -236,6 +288,11 @@ int generic_chdir_start(void);
 /* mangle.c */
 void generic_mangle_name(char *, const char *);
 
+/* namecmp.c */
+int fs_fold_name(char *dst, size_t size, const char *src);
+bool fs_name_eq_fold(const char *name, const char *folded, size_t len);
+bool fs_uni_eq(const uint16_t *uni, const char *name, size_t len, bool nocase);
+
 /* loadconfig.c */
 int search_dirs(struct com32_filedata *filedata,
 		const char *search_directores[], const char *filenames[],
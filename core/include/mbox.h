@@ -34,6 +34,9 @@ struct mailbox {
 void mbox_init(struct mailbox *mbox, size_t size);
 int mbox_post(struct mailbox *mbox, void *msg, mstime_t timeout);
 mstime_t mbox_fetch(struct mailbox *mbox, void **msg, mstime_t timeout);
+int mbox_post_many(struct mailbox *mbox, void **msgs, int n, mstime_t timeout);
+int mbox_fetch_many(struct mailbox *mbox, void **msgs, int max,
+		    mstime_t timeout);
 
 /*
  * This marks a mailbox object as unusable; it will remain unusable
@@ -20,12 +20,37 @@ void core_udp_disconnect(struct pxe_pvt_inode *socket);
 int core_udp_recv(struct pxe_pvt_inode *socket, void *buf, uint16_t *buf_len,
 		  uint32_t *src_ip, uint16_t *src_port);
 
+/* As core_udp_recv(), but the first hdr_len bytes go to hdr instead */
+int core_udp_recv_split(struct pxe_pvt_inode *socket,
+			void *hdr, uint16_t hdr_len,
+			void *buf, uint16_t *buf_len,
+			uint32_t *src_ip, uint16_t *src_port);
+
 void core_udp_send(struct pxe_pvt_inode *socket,
 		   const void *data, size_t len);
 
 void core_udp_sendto(struct pxe_pvt_inode *socket, const void *data, size_t len,
 		     uint32_t ip, uint16_t port);
 
+/* Receive-only sockets on a multicast group; join fails if unsupported */
+int core_udp_join(struct pxe_pvt_inode *socket, uint32_t group,
+		  uint16_t port);
+void core_udp_leave(struct pxe_pvt_inode *socket, uint32_t group);
+
+/* Largest IP datagram the interface carries, 0 if unknown */
+unsigned int net_core_mtu(void);
+
+/* Fill in the packet and TCP counters the network stack keeps */
+struct com32_net_stats;
+void net_core_stats(struct com32_net_stats *st);
+
+/* The stack's ARP table, for handing on to a chained PXELINUX */
+bool net_core_arp_lookup(uint32_t ip, uint8_t *mac);
+void net_core_arp_add(uint32_t ip, const uint8_t *mac);
+
+/* Start resolving ip, if it is a neighbour, ahead of the first packet */
+void net_core_arp_prime(uint32_t ip);
+
 void probe_undi(void);
 void pxe_init_isr(void);
 
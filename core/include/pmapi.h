@@ -4,5 +4,10 @@
 #include <syslinux/pmapi.h>
 
 size_t pmapi_read_file(uint16_t *, void *, size_t);
+int pmapi_cache_stats(struct com32_cache_stats *);
+int pmapi_net_stats(struct com32_net_stats *);
+int pmapi_net_handoff(void *, size_t);
+int pmapi_mem_stats(struct com32_mem_stats *);
+int pmapi_disk_probe(int, struct com32_disk_probe *);
 
 #endif /* PMAPI_H */
@@ -0,0 +1,30 @@
+#ifndef _SLAB_H
+#define _SLAB_H
+
+#include <stddef.h>
+
+/*
+ * A cache of objects of one size that are allocated and released over
+ * and over, such as network sockets.  Objects are carved out of the
+ * heap a chunk at a time and go back on the cache's own free list
+ * when released, so they never fragment the general heap.
+ */
+struct slab_cache {
+    const char *name;		/* For debugging */
+    size_t size;		/* Object size */
+    unsigned int per_chunk;	/* Objects carved per heap allocation */
+    unsigned int total;		/* Objects carved so far */
+    unsigned int nfree;		/* Objects on the free list */
+    void *free;			/* Linked through the first word */
+};
+
+#define DECLARE_SLAB_CACHE(var, sz, chunk)				\
+    struct slab_cache var = { .name = #var, .size = (sz),		\
+			      .per_chunk = (chunk) }
+
+void *slab_alloc(struct slab_cache *cache);
+void *slab_zalloc(struct slab_cache *cache);
+void slab_free(struct slab_cache *cache, void *obj);
+int slab_prefill(struct slab_cache *cache, unsigned int count);
+
+#endif /* _SLAB_H */
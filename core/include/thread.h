@@ -32,6 +32,7 @@ struct thread_stack {
 
 struct thread_block {
     struct thread_list list;
+    struct thread_list tlist;	/* On the timeout queue iff tlist.next */
     struct thread *thread;
     struct semaphore *semaphore;
     mstime_t block_time;
@@ -41,20 +42,45 @@ struct thread_block {
 
 #define THREAD_MAGIC 0x3568eb7d
 
+/* See <syslinux/threadstat.h> */
+struct thread_acct {
+    uint64_t runtime;		/* TSC cycles */
+    uint64_t last_in;		/* TSC when last switched in, 0 if unknown */
+    uint32_t switches_in, switches_out;
+    uint32_t blocks;
+    mstime_t blocked_ms;
+};
+
 struct thread {
     struct thread_stack *esp;	/* Must be first; stack pointer */
     unsigned int thread_magic;
     const char *name;		/* Name (for debugging) */
     struct thread_list  list;
+    struct thread_list  rq;	/* On the run queue iff rq.next */
     struct thread_block *blocked;
     void *stack, *rmstack;	/* Stacks, iff allocated by malloc/lmalloc */
     void *pvt; 			/* For the benefit of lwIP */
     int prio;
+    struct thread_acct acct;
 };
 
 extern void (*sched_hook_func)(void);
 
+/*
+ * The runnable threads, by priority; threads of the same priority in
+ * the order they became runnable.  Interrupts must be off to touch it.
+ */
+extern struct thread_list __run_queue;
+void __thread_runnable(struct thread *);
+void __thread_unrunnable(struct thread *);
+
+/*
+ * The blocks with a timeout, soonest first.  Interrupts must be off.
+ */
+void __thread_timeout_add(struct thread_block *);
+void __thread_timeout_del(struct thread_block *);
 void __thread_process_timeouts(void);
+void __thread_account_switch(struct thread *, struct thread *);
 void __schedule(void);
 void __switch_to(struct thread *);
 void thread_yield(void);
@@ -82,6 +108,8 @@ struct semaphore {
 mstime_t sem_down(struct semaphore *, mstime_t);
 void sem_up(struct semaphore *);
 void sem_init(struct semaphore *, int);
+int sem_trydown_many(struct semaphore *, int);
+void sem_up_many(struct semaphore *, int);
 
 /*
  * This marks a semaphore object as unusable; it will remain unusable
@@ -5,8 +5,15 @@
 #include <bios.h>
 #include <syslinux/memscan.h>
 #include <syslinux/firmware.h>
+#include <syslinux/boottime.h>
+#include <sys/memops.h>
 
 void init(void)
 {
+	x86_init_mem();
+	clock_init();
+	boot_time_init();
+	boot_time_stamp(BOOT_PHASE_CORE_INIT);
+
 	firmware->init();
 }
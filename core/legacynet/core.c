@@ -8,6 +8,9 @@
 /* Common receive buffer */
 static __lowmem char packet_buf[PKTBUF_SIZE] __aligned(16);
 
+/* For net_core_stats() */
+static uint32_t rx_packets, tx_packets;
+
 extern uint16_t get_port(void);
 extern void free_port(uint16_t);
 
@@ -84,6 +87,19 @@ void core_udp_disconnect(struct pxe_pvt_inode *socket __unused)
  */
 int core_udp_recv(struct pxe_pvt_inode *socket, void *buf, uint16_t *buf_len,
 		  uint32_t *src_ip, uint16_t *src_port)
+{
+    return core_udp_recv_split(socket, NULL, 0, buf, buf_len,
+			       src_ip, src_port);
+}
+
+/**
+ * Read a UDP packet, the first hdr_len bytes into hdr and the rest
+ * into buf.  Packets shorter than hdr_len are dropped.
+ */
+int core_udp_recv_split(struct pxe_pvt_inode *socket,
+			void *hdr, uint16_t hdr_len,
+			void *buf, uint16_t *buf_len,
+			uint32_t *src_ip, uint16_t *src_port)
 {
     static __lowmem struct s_PXENV_UDP_READ  udp_read;
     struct net_private_tftp *priv = &socket->net.tftp;
@@ -103,12 +119,17 @@ int core_udp_recv(struct pxe_pvt_inode *socket, void *buf, uint16_t *buf_len,
     if (udp_read.status)
 	return udp_read.status;
 
-    bytes = min(udp_read.buffer_size, *buf_len);
-    memcpy(buf, packet_buf, bytes);
+    if (udp_read.buffer_size < hdr_len)
+	return -1;
+
+    bytes = min(udp_read.buffer_size - hdr_len, *buf_len);
+    memcpy(hdr, packet_buf, hdr_len);
+    memcpy(buf, packet_buf + hdr_len, bytes);
 
     *src_ip = udp_read.src_ip;
     *src_port = ntohs(udp_read.s_port);
     *buf_len = bytes;
+    rx_packets++;
 
     return 0;
 }
@@ -142,6 +163,7 @@ void core_udp_send(struct pxe_pvt_inode *socket, const void *data, size_t len)
     udp_write.buffer_size = len;
 
     pxe_call(PXENV_UDP_WRITE, &udp_write);
+    tx_packets++;
 
     lfree(lbuf);
 }
@@ -178,11 +200,26 @@ void core_udp_sendto(struct pxe_pvt_inode *socket, const void *data, size_t len,
     udp_write.buffer_size = len;
 
     pxe_call(PXENV_UDP_WRITE, &udp_write);
+    tx_packets++;
 
     lfree(lbuf);
 }
 
 
+/*
+ * The PXE UDP API has no way of joining a multicast group
+ */
+int core_udp_join(struct pxe_pvt_inode *socket __unused,
+		  uint32_t group __unused, uint16_t port __unused)
+{
+    return -1;
+}
+
+void core_udp_leave(struct pxe_pvt_inode *socket __unused,
+		    uint32_t group __unused)
+{
+}
+
 /**
  * Network stack-specific initialization
  *
@@ -201,6 +238,41 @@ void net_core_init(void)
     }
 }
 
+/*
+ * The PXE stack does UDP for us, and what size datagrams it can take
+ * is its own business, so don't guess.
+ */
+unsigned int net_core_mtu(void)
+{
+    return 0;
+}
+
+/*
+ * The PXE stack only hands us UDP, so that is all we can count
+ */
+void net_core_stats(struct com32_net_stats *st)
+{
+    st->rx_packets = rx_packets;
+    st->tx_packets = tx_packets;
+}
+
+/*
+ * The PXE stack does ARP, and its table outlives us, so there is
+ * nothing to hand on or take over
+ */
+bool net_core_arp_lookup(uint32_t ip __unused, uint8_t *mac __unused)
+{
+    return false;
+}
+
+void net_core_arp_add(uint32_t ip __unused, const uint8_t *mac __unused)
+{
+}
+
+void net_core_arp_prime(uint32_t ip __unused)
+{
+}
+
 void probe_undi(void)
 {
 }
@@ -223,6 +295,14 @@ int reset_pxe(void)
 
 #if GPXE
 
+/*
+ * gPXE and iPXE fill as much of the buffer as they have data for on each
+ * PXENV_FILE_READ, and each call is a trip through real mode, so a file
+ * gets a big buffer of its own in low memory and is read straight into
+ * it.  The size has to fit the 16-bit BufferSize.
+ */
+#define GPXE_BUFSIZE	32768
+
 static void gpxe_close_file(struct inode *inode)
 {
     struct pxe_pvt_inode *socket = PVT(inode);
@@ -245,8 +325,8 @@ static void gpxe_get_packet(struct inode *inode)
 
     while (1) {
         file_read.FileHandle  = socket->tftp_remoteport;
-        file_read.Buffer      = FAR_PTR(packet_buf);
-        file_read.BufferSize  = PKTBUF_SIZE;
+        file_read.Buffer      = FAR_PTR(socket->tftp_pktbuf);
+        file_read.BufferSize  = socket->tftp_blksize;
         err = pxe_call(PXENV_FILE_READ, &file_read);
         if (!err)  /* successed */
             break;
@@ -255,8 +335,6 @@ static void gpxe_get_packet(struct inode *inode)
 	    kaboom();
     }
 
-    memcpy(socket->tftp_pktbuf, packet_buf, file_read.BufferSize);
-
     socket->tftp_dataptr   = socket->tftp_pktbuf;
     socket->tftp_bytesleft = file_read.BufferSize;
     socket->tftp_filepos  += file_read.BufferSize;
@@ -296,9 +374,15 @@ void gpxe_open(struct inode *inode, const char *url)
     struct pxe_pvt_inode *socket = PVT(inode);
     int err;
 
-    socket->tftp_pktbuf = malloc(PKTBUF_SIZE);
-    if (!socket->tftp_pktbuf)
-	return;
+    /* Fall back to a packet's worth if low memory is tight */
+    socket->tftp_blksize = GPXE_BUFSIZE;
+    socket->tftp_pktbuf = lmalloc(GPXE_BUFSIZE);
+    if (!socket->tftp_pktbuf) {
+	socket->tftp_blksize = PKTBUF_SIZE;
+	socket->tftp_pktbuf = lmalloc(PKTBUF_SIZE);
+	if (!socket->tftp_pktbuf)
+	    return;
+    }
 
     snprintf(lowurl, sizeof lowurl, "%s", url);
     file_open.Status        = PXENV_STATUS_BAD_FUNC;
@@ -321,3 +405,26 @@ void gpxe_open(struct inode *inode, const char *url)
 }
 
 #endif /* GPXE */
+
+/*
+ * Without lwIP nothing else gets to run while we poll the network, so
+ * there is no prefetching in the background
+ */
+void pxe_prefetch_file(struct fs_info *fs __unused, const char *name __unused)
+{
+}
+
+bool pxe_prefetch_take(const char *filename __unused, int flags __unused,
+		       struct file *file __unused)
+{
+    return false;
+}
+
+void pxe_prefetch_put(struct inode *inode __unused)
+{
+}
+
+/* Nor HTTP, so no directory listings */
+void http_listing_put(struct inode *inode __unused)
+{
+}
@@ -205,8 +205,6 @@ static bool parse_dotquad(const char *ip_str, uint32_t *res)
  * Points to a null-terminated or :-terminated string in _name_
  * and returns the ip addr in _ip_ if it exists and can be found.
  * If _ip_ = 0 on exit, the lookup failed. _name_ will be updated
- *
- * XXX: probably need some caching here.
  */
 __export uint32_t __weak pxe_dns(const char *name)
 {
@@ -231,6 +229,8 @@ __export uint32_t __weak pxe_dns(const char *name)
     static __lowmem struct s_PXENV_UDP_READ  udp_read;
     uint16_t local_port;
     uint32_t result = 0;
+    uint32_t ttl = 0;
+    bool answered = false;
 
     /*
      * Return failure on an empty input... this can happen during
@@ -248,6 +248,9 @@ __export uint32_t __weak pxe_dns(const char *name)
     if (!dns_server[0])
 	return 0;
 
+    if (dns_cache_lookup(name, &result))
+	return result;
+
     /* Get a local port number */
     local_port = get_port();
 
@@ -334,6 +337,7 @@ __export uint32_t __weak pxe_dns(const char *name)
 		case TYPE_A:
 		    if (rd_len == 4) {
 			result = *(uint32_t *)rr->rdata;
+			ttl = ntohl(rr->ttl);
 			goto done;
 		    }
 		    break;
@@ -375,6 +379,7 @@ __export uint32_t __weak pxe_dns(const char *name)
         if (hd2->flags == htons(0x480))
             continue;
 
+        answered = true;
         break; /* failed */
 
     again:
@@ -384,5 +389,10 @@ __export uint32_t __weak pxe_dns(const char *name)
 done:
     free_port(local_port);	/* Return port number to the free pool */
 
+    if (result)
+	dns_cache_add(name, result, ttl);
+    else if (answered)
+	dns_cache_add(name, 0, DNS_CACHE_NEG_TTL);
+
     return result;
 }
@@ -74,6 +74,10 @@ static void
 tcpip_thread(void *arg)
 {
   struct tcpip_msg *msg;
+#ifdef SYS_ARCH_MBOX_TRYFETCH_MANY
+  void *batch[TCPIP_MBOX_BATCH];
+  int nbatch = 0, ibatch = 0;
+#endif /* SYS_ARCH_MBOX_TRYFETCH_MANY */
   LWIP_UNUSED_ARG(arg);
 
   if (tcpip_init_done != NULL) {
@@ -84,8 +88,21 @@ tcpip_thread(void *arg)
   while (1) {                          /* MAIN Loop */
     UNLOCK_TCPIP_CORE();
     LWIP_TCPIP_THREAD_ALIVE();
+#ifdef SYS_ARCH_MBOX_TRYFETCH_MANY
+    if (ibatch < nbatch) {
+      /* the rest of a burst taken in one go */
+      msg = (struct tcpip_msg *)batch[ibatch++];
+    } else {
+      /* wait for a message, timeouts are processed while waiting */
+      sys_timeouts_mbox_fetch(&mbox, (void **)&msg);
+      /* and take whatever has queued up behind it */
+      nbatch = sys_arch_mbox_tryfetch_many(&mbox, batch, TCPIP_MBOX_BATCH);
+      ibatch = 0;
+    }
+#else /* SYS_ARCH_MBOX_TRYFETCH_MANY */
     /* wait for a message, timeouts are processed while waiting */
     sys_timeouts_mbox_fetch(&mbox, (void **)&msg);
+#endif /* SYS_ARCH_MBOX_TRYFETCH_MANY */
     LOCK_TCPIP_CORE();
     switch (msg->type) {
 #if LWIP_NETCONN
@@ -0,0 +1,121 @@
+/*
+ * chksum.c
+ *
+ * The Internet checksum, as LWIP_CHKSUM and LWIP_CHKSUM_COPY.  lwIP's
+ * own loop adds up two bytes at a time, one instruction after another;
+ * these add four at a time, sixteen to a pass, into a wider sum, and
+ * fold it down to 16 bits once at the end.  On i386 the carries go
+ * round through adc, so it is one instruction per four bytes.  x86
+ * doesn't mind unaligned loads, so where the data starts only matters
+ * to the speed.  There is no SSE: the core is built -msoft-float, and
+ * the threads don't save the vector registers.
+ *
+ * As lwIP expects, the result is the sum of the data as 16-bit words
+ * in memory order, not inverted; stored as it is, it reads in network
+ * byte order.
+ */
+
+#include <string.h>
+#include "lwip/opt.h"
+#include "lwip/inet_chksum.h"
+
+static inline u16_t fold64(uint64_t sum)
+{
+    u32_t s;
+
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    s = sum;
+    s = FOLD_U32T(s);
+    return FOLD_U32T(s);
+}
+
+static inline u32_t load32(const u8_t *p)
+{
+    u32_t v;
+
+    memcpy(&v, p, 4);
+    return v;
+}
+
+/* What is left over after the 16-byte blocks: under 16 bytes */
+static inline uint64_t sum_tail(uint64_t sum, const u8_t *p, int len)
+{
+    u16_t w;
+
+    for (; len >= 4; p += 4, len -= 4)
+	sum += load32(p);
+    if (len >= 2) {
+	memcpy(&w, p, 2);
+	sum += w;
+	p += 2;
+    }
+    if (len & 1)
+	sum += *p;		/* The low byte, being the first */
+    return sum;
+}
+
+u16_t lwip_arch_chksum(const void *dataptr, int len)
+{
+    const u8_t *p = dataptr;
+    uint64_t sum = 0;
+    int blocks = len >> 4;
+
+    if (blocks) {
+#ifdef __i386__
+	u32_t s = 0;
+
+	/* lea and dec leave CF alone, so the carry runs round the loop */
+	asm("clc\n"
+	    "1:\n\t"
+	    "adcl (%1),%0\n\t"
+	    "adcl 4(%1),%0\n\t"
+	    "adcl 8(%1),%0\n\t"
+	    "adcl 12(%1),%0\n\t"
+	    "lea 16(%1),%1\n\t"
+	    "dec %2\n\t"
+	    "jnz 1b\n\t"
+	    "adcl $0,%0"
+	    : "+r" (s), "+r" (p), "+r" (blocks)
+	    : "m" (*(const char (*)[len])dataptr)
+	    : "cc");
+	sum = s;
+#else
+	for (; blocks; blocks--, p += 16)
+	    sum += (uint64_t)load32(p) + load32(p + 4) +
+		load32(p + 8) + load32(p + 12);
+#endif
+    }
+
+    return fold64(sum_tail(sum, p, len & 15));
+}
+
+/*
+ * Copy and sum in one pass, for data going out: the source is read
+ * once, and the copy is still to hand when the checksum would have
+ * read it again.
+ */
+u16_t lwip_arch_chksum_copy(void *dst, const void *src, u16_t len)
+{
+    const u8_t *s = src;
+    u8_t *d = dst;
+    uint64_t sum = 0;
+    u32_t a, b, c, e;
+    int n;
+
+    for (n = len >> 4; n; n--, s += 16, d += 16) {
+	a = load32(s);
+	b = load32(s + 4);
+	c = load32(s + 8);
+	e = load32(s + 12);
+	memcpy(d, &a, 4);
+	memcpy(d + 4, &b, 4);
+	memcpy(d + 8, &c, 4);
+	memcpy(d + 12, &e, 4);
+	sum += (uint64_t)a + b + c + e;
+    }
+
+    n = len & 15;
+    memcpy(d, s, n);
+    return fold64(sum_tail(sum, d, n));
+}
@@ -1,8 +1,12 @@
 #include "arch/sys_arch.h"
 #include "lwip/sys.h"
 #include "lwip/mem.h"
+#include "lwip/memp.h"
 #include <stdlib.h>
+#include <minmax.h>
+#include <dprintf.h>
 #include <thread.h>
+#include <pmapi.h>
 
 void sys_init(void)
 {
@@ -129,3 +133,48 @@ sys_thread_t sys_thread_new(const char *name, lwip_thread_fn thread,
     return start_thread(name, stacksize, prio, thread, arg);
 }
 
+/*
+ * The pools that grow with the memory there is: the pbufs hold what
+ * the connections have been sent and not read yet, and the segments
+ * and netbufs go with them.  They get up to MEMP_SCALE_MAX times their
+ * MEMP_NUM_*, so long as all the pools together take no more than
+ * 1/MEMP_SHARE of the largest free block of high memory; the rest is
+ * for the kernel and initrd.
+ */
+#define MEMP_SCALE_MAX	8
+#define MEMP_SHARE	16
+
+static const memp_t memp_scaled[] = {
+    MEMP_PBUF_POOL, MEMP_TCP_SEG, MEMP_NETBUF
+};
+#define MEMP_NSCALED (sizeof memp_scaled / sizeof memp_scaled[0])
+
+void *sys_memp_alloc(u16_t *num, const u32_t *size)
+{
+    struct com32_mem_stats ms;
+    size_t least = MEM_ALIGNMENT - 1, grown = 0, budget = 0;
+    unsigned int scale = 1;
+    void *mem;
+    unsigned int i;
+
+    for (i = 0; i < MEMP_MAX; i++)
+	least += num[i] * size[i];
+    for (i = 0; i < MEMP_NSCALED; i++)
+	grown += num[memp_scaled[i]] * size[memp_scaled[i]];
+
+    if (!pmapi_mem_stats(&ms))
+	budget = ms.heap[0].largest_free / MEMP_SHARE;
+    if (budget > least)
+	scale = min(MEMP_SCALE_MAX, 1 + (budget - least) / grown);
+
+    /* If that much isn't there after all, the least will do */
+    while (!(mem = malloc(least + (scale - 1) * grown)) && scale > 1)
+	scale = 1;
+
+    for (i = 0; i < MEMP_NSCALED; i++)
+	num[memp_scaled[i]] *= scale;
+
+    dprintf("lwip: pools %zu bytes, %ux MEMP_NUM_*, %u pbufs\n",
+	    least + (scale - 1) * grown, scale, num[MEMP_PBUF_POOL]);
+    return mem;
+}
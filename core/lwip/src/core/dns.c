@@ -483,6 +483,31 @@ dns_lookup(const char *name)
   return IPADDR_NONE;
 }
 
+/**
+ * Seconds left to live for a resolved hostname in the dns_table.
+ *
+ * @note Only reads a word of the table, so it may be used outside the
+ * tcpip thread to learn the TTL of a name just resolved through the
+ * netconn API.
+ *
+ * @param name the hostname to look up
+ * @return the TTL in seconds, or 0 if the hostname is not in the table
+ */
+u32_t
+dns_ttl(const char *name)
+{
+  u8_t i;
+
+  for (i = 0; i < DNS_TABLE_SIZE; ++i) {
+    if ((dns_table[i].state == DNS_STATE_DONE) &&
+        (strcmp(name, dns_table[i].name) == 0)) {
+      return dns_table[i].ttl;
+    }
+  }
+
+  return 0;
+}
+
 #if DNS_DOES_NAME_CHECK
 /**
  * Compare the "dotted" name "query" with the encoded name "response"
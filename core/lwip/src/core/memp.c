@@ -134,7 +134,12 @@ const u16_t memp_sizes[MEMP_MAX] = {
 #if !MEMP_MEM_MALLOC /* don't build if not configured for use in lwipopts.h */
 
 /** This array holds the number of elements in each pool. */
-static const u16_t memp_num[MEMP_MAX] = {
+#if !MEMP_RUNTIME_SIZE
+static const
+#else
+static
+#endif
+u16_t memp_num[MEMP_MAX] = {
 #define LWIP_MEMPOOL(name,num,size,desc)  (num),
 #include "lwip/memp_std.h"
 };
@@ -164,6 +169,11 @@ static u8_t *const memp_bases[] = {
 #include "lwip/memp_std.h"
 };
 
+#elif MEMP_RUNTIME_SIZE
+
+/** The memory used by the pools, from sys_memp_alloc() in memp_init(). */
+static u8_t *memp_memory;
+
 #else /* MEMP_SEPARATE_POOLS */
 
 /** This is the actual memory used by the pools (all pools in one big block). */
@@ -338,6 +348,15 @@ memp_init(void)
 {
   struct memp *memp;
   u16_t i, j;
+#if MEMP_RUNTIME_SIZE
+  u32_t size[MEMP_MAX];
+
+  for (i = 0; i < MEMP_MAX; ++i) {
+    size[i] = MEMP_SIZE + memp_sizes[i];
+  }
+  memp_memory = (u8_t *)sys_memp_alloc(memp_num, size);
+  LWIP_ASSERT("memp_init: no memory for the pools", memp_memory != NULL);
+#endif /* MEMP_RUNTIME_SIZE */
 
   for (i = 0; i < MEMP_MAX; ++i) {
     MEMP_STATS_AVAIL(used, i, 0);
@@ -466,4 +485,17 @@ memp_free(memp_t type, void *mem)
   SYS_ARCH_UNPROTECT(old_level);
 }
 
+/**
+ * The number of elements in a pool, as memp_init() made it.
+ *
+ * @param type the pool to count
+ */
+u16_t
+memp_count(memp_t type)
+{
+  LWIP_ERROR("memp_count: type < MEMP_MAX", (type < MEMP_MAX), return 0;);
+
+  return memp_num[type];
+}
+
 #endif /* MEMP_MEM_MALLOC */
@@ -103,7 +103,7 @@ tcp_output_alloc_header(struct tcp_pcb *pcb, u16_t optlen, u16_t datalen,
     tcphdr->seqno = seqno_be;
     tcphdr->ackno = htonl(pcb->rcv_nxt);
     TCPH_HDRLEN_FLAGS_SET(tcphdr, (5 + optlen / 4), TCP_ACK);
-    tcphdr->wnd = htons(pcb->rcv_ann_wnd);
+    tcphdr->wnd = htons(TCPWND16(RCV_WND_SCALE(pcb, pcb->rcv_ann_wnd)));
     tcphdr->chksum = 0;
     tcphdr->urgp = 0;
 
@@ -735,6 +735,19 @@ tcp_enqueue_flags(struct tcp_pcb *pcb, u8_t flags)
 
   if (flags & TCP_SYN) {
     optflags = TF_SEG_OPTS_MSS;
+#if LWIP_WND_SCALE
+    if ((pcb->state != SYN_RCVD) || (pcb->flags & TF_WND_SCALE)) {
+      /* In a <SYN,ACK> (sent in state SYN_RCVD), the window scale option may only
+         be sent if we received a window scale option from the remote host. */
+      optflags |= TF_SEG_OPTS_WND_SCALE;
+    }
+#endif /* LWIP_WND_SCALE */
+#if LWIP_TCP_SACK
+    /* Likewise, SACK-permitted only answers one */
+    if ((pcb->state != SYN_RCVD) || (pcb->flags & TF_SACK)) {
+      optflags |= TF_SEG_OPTS_SACK_PERM;
+    }
+#endif /* LWIP_TCP_SACK */
   }
 #if LWIP_TCP_TIMESTAMPS
   if ((pcb->flags & TF_TIMESTAMP)) {
@@ -828,6 +841,63 @@ tcp_build_timestamp_option(struct tcp_pcb *pcb, u32_t *opts)
 }
 #endif
 
+#if LWIP_TCP_SACK
+/**
+ * Describe what is queued on ->ooseq as SACK blocks (RFC 2018): pairs
+ * of the first sequence number of a run of data and the one after it.
+ * The run holding the segment that arrived last goes first, as the RFC
+ * asks, and the rest follow lowest first, since the lowest holes are
+ * the ones holding up the application.
+ *
+ * @param pcb tcp_pcb
+ * @param blocks where to put the pairs, in host byte order
+ * @param max the most blocks there is room for
+ * @return the number of blocks
+ */
+static u8_t
+tcp_sack_blocks(struct tcp_pcb *pcb, u32_t *blocks, u8_t max)
+{
+  struct tcp_seg *seg;
+  u32_t left, right;
+  u8_t n = 1, recent = 0, i;
+
+  if (max == 0) {
+    return 0;
+  }
+
+  for (seg = pcb->ooseq; seg != NULL; ) {
+    left = seg->tcphdr->seqno;
+    right = left + TCP_TCPLEN(seg);
+    for (seg = seg->next;
+         seg != NULL && TCP_SEQ_LEQ(seg->tcphdr->seqno, right);
+         seg = seg->next) {
+      if (TCP_SEQ_GT(seg->tcphdr->seqno + TCP_TCPLEN(seg), right)) {
+        right = seg->tcphdr->seqno + TCP_TCPLEN(seg);
+      }
+    }
+
+    if (!recent && TCP_SEQ_BETWEEN(pcb->sack_recent, left, right - 1)) {
+      blocks[0] = left;
+      blocks[1] = right;
+      recent = 1;
+    } else if (n < max) {
+      blocks[2 * n] = left;
+      blocks[2 * n + 1] = right;
+      n++;
+    }
+  }
+
+  if (!recent) {
+    /* The last arrival was merged into data now in sequence */
+    n--;
+    for (i = 0; i < 2 * n; i++) {
+      blocks[i] = blocks[i + 2];
+    }
+  }
+  return n;
+}
+#endif /* LWIP_TCP_SACK */
+
 /** Send an ACK without data.
  *
  * @param pcb Protocol control block for the TCP connection to send the ACK
@@ -838,12 +908,26 @@ tcp_send_empty_ack(struct tcp_pcb *pcb)
   struct pbuf *p;
   struct tcp_hdr *tcphdr;
   u8_t optlen = 0;
+#if LWIP_TCP_SACK
+  u32_t sacks[2 * LWIP_TCP_SACK_MAX];
+  u8_t nsacks = 0;
+  u32_t *opts;
+  u8_t i;
+#endif
 
 #if LWIP_TCP_TIMESTAMPS
   if (pcb->flags & TF_TIMESTAMP) {
     optlen = LWIP_TCP_OPT_LENGTH(TF_SEG_OPTS_TS);
   }
 #endif
+#if LWIP_TCP_SACK
+  if ((pcb->flags & TF_SACK) && pcb->ooseq != NULL) {
+    nsacks = tcp_sack_blocks(pcb, sacks, (40 - optlen - 4) / 8);
+    if (nsacks) {
+      optlen += 4 + 8 * nsacks;
+    }
+  }
+#endif
 
   p = tcp_output_alloc_header(pcb, optlen, 0, htonl(pcb->snd_nxt));
   if (p == NULL) {
@@ -865,6 +949,17 @@ tcp_send_empty_ack(struct tcp_pcb *pcb)
   }
 #endif 
 
+#if LWIP_TCP_SACK
+  if (nsacks) {
+    /* After the timestamp, if there is one */
+    opts = (u32_t *)(void *)((u8_t *)(tcphdr + 1) + optlen - 4 - 8 * nsacks);
+    *opts++ = htonl(0x01010500 | (2 + 8 * nsacks));
+    for (i = 0; i < 2 * nsacks; i++) {
+      *opts++ = htonl(sacks[i]);
+    }
+  }
+#endif /* LWIP_TCP_SACK */
+
 #if CHECKSUM_GEN_TCP
   tcphdr->chksum = inet_chksum_pseudo(p, &(pcb->local_ip), &(pcb->remote_ip),
         IP_PROTO_TCP, p->tot_len);
@@ -1057,7 +1152,16 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb)
   seg->tcphdr->ackno = htonl(pcb->rcv_nxt);
 
   /* advertise our receive window size in this TCP segment */
-  seg->tcphdr->wnd = htons(pcb->rcv_ann_wnd);
+#if LWIP_WND_SCALE
+  if (seg->flags & TF_SEG_OPTS_WND_SCALE) {
+    /* The Window field in a SYN segment itself (the only type where we send
+       the window scale option) is never scaled. */
+    seg->tcphdr->wnd = htons(TCPWND16(pcb->rcv_ann_wnd));
+  } else
+#endif /* LWIP_WND_SCALE */
+  {
+    seg->tcphdr->wnd = htons(TCPWND16(RCV_WND_SCALE(pcb, pcb->rcv_ann_wnd)));
+  }
 
   pcb->rcv_ann_right_edge = pcb->rcv_nxt + pcb->rcv_ann_wnd;
 
@@ -1077,6 +1181,20 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb)
     opts += 3;
   }
 #endif
+#if LWIP_WND_SCALE
+  if (seg->flags & TF_SEG_OPTS_WND_SCALE) {
+    /* Pad with one NOP option to make everything nicely aligned */
+    *opts = PP_HTONL(0x01030300 | TCP_RCV_SCALE);
+    opts += 1;
+  }
+#endif /* LWIP_WND_SCALE */
+#if LWIP_TCP_SACK
+  if (seg->flags & TF_SEG_OPTS_SACK_PERM) {
+    /* Two NOPs in front, for the same reason */
+    *opts = PP_HTONL(0x01010402);
+    opts += 1;
+  }
+#endif /* LWIP_TCP_SACK */
 
   /* Set retransmission timer running if it is not currently enabled 
      This must be set before checking the route. */
@@ -1204,7 +1322,7 @@ tcp_rst(u32_t seqno, u32_t ackno,
   tcphdr->seqno = htonl(seqno);
   tcphdr->ackno = htonl(ackno);
   TCPH_HDRLEN_FLAGS_SET(tcphdr, TCP_HLEN/4, TCP_RST | TCP_ACK);
-  tcphdr->wnd = PP_HTONS(TCP_WND);
+  tcphdr->wnd = PP_HTONS(TCPWND16(TCP_WND));
   tcphdr->chksum = 0;
   tcphdr->urgp = 0;
 
@@ -1237,7 +1355,10 @@ tcp_rexmit_rto(struct tcp_pcb *pcb)
   }
 
   /* Move all unacked segments to the head of the unsent queue */
-  for (seg = pcb->unacked; seg->next != NULL; seg = seg->next);
+  TCP_STATS_INC(tcp_xfer.rexmit);
+  for (seg = pcb->unacked; seg->next != NULL; seg = seg->next) {
+    TCP_STATS_INC(tcp_xfer.rexmit);
+  }
   /* concatenate unsent queue after unacked queue */
   seg->next = pcb->unsent;
   /* unsent queue is the concatenated queue (of unacked, unsent) */
@@ -1292,6 +1413,7 @@ tcp_rexmit(struct tcp_pcb *pcb)
 
   /* Do the actual retransmission. */
   snmp_inc_tcpretranssegs();
+  TCP_STATS_INC(tcp_xfer.rexmit);
   /* No need to call tcp_output: we are always called from tcp_input()
      and thus tcp_output directly returns. */
 }
@@ -1317,7 +1439,7 @@ tcp_rexmit_fast(struct tcp_pcb *pcb)
     /* Set ssthresh to half of the minimum of the current
      * cwnd and the advertised window */
     if (pcb->cwnd > pcb->snd_wnd) {
-      pcb->ssthresh = pcb->snd_wnd / 2;
+      pcb->ssthresh = (u16_t)(pcb->snd_wnd / 2);
     } else {
       pcb->ssthresh = pcb->cwnd / 2;
     }
@@ -18,6 +18,17 @@ static inline void sys_sem_signal(sys_sem_t *sem)
 
 #define sys_now ms_timer
 
+/*
+ * Take up to n messages that are already in the mailbox, without
+ * waiting; the tcpip thread uses this to drain bursts.
+ */
+static inline int sys_arch_mbox_tryfetch_many(sys_mbox_t *mbox, void **msgs,
+					      int n)
+{
+    return mbox ? mbox_fetch_many(*mbox, msgs, n, -1) : 0;
+}
+#define SYS_ARCH_MBOX_TRYFETCH_MANY 1
+
 #define SYS_MBOX_NULL	NULL
 #define SYS_SEM_NULL	NULL
 
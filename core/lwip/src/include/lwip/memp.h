@@ -99,6 +99,11 @@ struct memp_malloc_helper
 
 void  memp_init(void);
 
+#if MEMP_RUNTIME_SIZE
+/* From the port: num[] in and out, size[] the bytes of each element */
+void *sys_memp_alloc(u16_t *num, const u32_t *size);
+#endif /* MEMP_RUNTIME_SIZE */
+
 #if MEMP_OVERFLOW_CHECK
 void *memp_malloc_fn(memp_t type, const char* file, const int line);
 #define memp_malloc(t) memp_malloc_fn((t), __FILE__, __LINE__)
@@ -106,6 +111,7 @@ void *memp_malloc_fn(memp_t type, const char* file, const int line);
 void *memp_malloc(memp_t type);
 #endif
 void  memp_free(memp_t type, void *mem);
+u16_t memp_count(memp_t type);
 
 #endif /* MEMP_MEM_MALLOC */
 
@@ -141,6 +141,17 @@
 #define MEMP_SEPARATE_POOLS             0
 #endif
 
+/**
+ * MEMP_RUNTIME_SIZE==1: the pools are sized when memp_init() runs, not
+ * when lwIP is built.  The port's sys_memp_alloc() is given, for each
+ * pool, MEMP_NUM_* as the least it may have and the size of an element;
+ * it may raise the counts, and returns the block they are carved from.
+ * Not with MEMP_SEPARATE_POOLS or MEMP_OVERFLOW_CHECK.
+ */
+#ifndef MEMP_RUNTIME_SIZE
+#define MEMP_RUNTIME_SIZE               0
+#endif
+
 /**
  * MEMP_OVERFLOW_CHECK: memp overflow protection reserves a configurable
  * amount of bytes before and after each memp element in every pool and fills
@@ -899,6 +910,28 @@
 #define TCP_WND                         (4 * TCP_MSS)
 #endif 
 
+/**
+ * LWIP_WND_SCALE and TCP_RCV_SCALE:
+ * Set LWIP_WND_SCALE to 1 to enable window scaling (RFC 7323), which
+ * allows a TCP_WND above 0xffff.
+ * Set TCP_RCV_SCALE to the desired scaling factor (shift count in the
+ * range of [0..14]).
+ */
+#ifndef LWIP_WND_SCALE
+#define LWIP_WND_SCALE                  0
+#define TCP_RCV_SCALE                   0
+#endif
+
+/**
+ * LWIP_TCP_SACK==1: Offer selective acknowledgement (RFC 2018) as a
+ * receiver: a peer that agrees is told, in the ACKs, which data past a
+ * hole is already queued on ->ooseq, so that it only has to send the
+ * holes again.  SACK blocks from the peer are not used.
+ */
+#ifndef LWIP_TCP_SACK
+#define LWIP_TCP_SACK                   0
+#endif
+
 /**
  * TCP_MAXRTX: Maximum number of retransmissions of data segments.
  */
@@ -1222,6 +1255,16 @@
 #define TCPIP_MBOX_SIZE                 0
 #endif
 
+/**
+ * TCPIP_MBOX_BATCH: How many messages the tcpip thread takes out of its
+ * mailbox at a time, if the port provides sys_arch_mbox_tryfetch_many()
+ * (and defines SYS_ARCH_MBOX_TRYFETCH_MANY).  Timeouts are only
+ * processed between batches.
+ */
+#ifndef TCPIP_MBOX_BATCH
+#define TCPIP_MBOX_BATCH                16
+#endif
+
 /**
  * SLIPIF_THREAD_NAME: The name assigned to the slipif_loop thread.
  */
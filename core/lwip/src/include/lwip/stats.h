@@ -70,6 +70,13 @@ struct stats_proto {
   STAT_COUNTER cachehit;
 };
 
+/* Syslinux: how TCP transfers went, for netstat.c32 */
+struct stats_tcp_xfer {
+  u32_t rexmit;                  /* Segments we retransmitted. */
+  u32_t dupseg;                  /* Segments received a second time. */
+  u32_t zerownd;                 /* Times our receive window filled up. */
+};
+
 struct stats_igmp {
   STAT_COUNTER xmit;             /* Transmitted packets. */
   STAT_COUNTER recv;             /* Received packets. */
@@ -134,6 +141,7 @@ struct stats_ {
 #endif
 #if TCP_STATS
   struct stats_proto tcp;
+  struct stats_tcp_xfer tcp_xfer;
 #endif
 #if MEM_STATS
   struct stats_mem mem;
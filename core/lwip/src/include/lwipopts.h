@@ -3,6 +3,8 @@
 
 #include <byteswap.h>
 #include <netinet/in.h>
+#include <stdint.h>
+#include <timer.h>
 
 #define SYS_LIGHTWEIGHT_PROT	1
 #define LWIP_NETIF_API		1
@@ -11,19 +13,24 @@
 #define LWIP_TCP		1
 #define LWIP_SO_RCVTIMEO	1
 #define LWIP_ICMP		1
+#define LWIP_IGMP		1	/* For multicast TFTP */
+
+/* Only used to spread out IGMP query responses */
+#define LWIP_RAND()		((u32_t)ms_timer())
 
 #define TCPIP_MBOX_SIZE         	512
 #define TCPIP_THREAD_PRIO		-10
 #define TCPIP_THREAD_STACKSIZE		32768
 
 #define DEFAULT_UDP_RECVMBOX_SIZE	16
-#define DEFAULT_TCP_RECVMBOX_SIZE	128
+#define DEFAULT_TCP_RECVMBOX_SIZE	1024	/* A full window of segments */
 #define DEFAULT_ACCEPTMBOX_SIZE		4
 
 #define LWIP_SOCKET			0
 
 #define MEM_LIBC_MALLOC			0
 #define MEMP_MEM_MALLOC			0
+#define MEMP_RUNTIME_SIZE		1	/* MEMP_NUM_* are the least */
 
 #define MEMP_NUM_TCP_PCB		64
 #define MEMP_NUM_TCP_SEG		256
@@ -33,7 +40,7 @@
 #define MEMP_NUM_TCPIP_MSG_API		64
 #define MEMP_NUM_TCPIP_MSG_INPKT	64
 #define MEMP_NUM_NETBUF			128
-#define PBUF_POOL_SIZE			256
+#define PBUF_POOL_SIZE			1024	/* Has to hold TCP_WND */
 #define ARP_TABLE_SIZE			16
 #define IP_REASS_MAX_PBUFS		64
 #define IP_REASS_MAXAGE			10
@@ -44,9 +51,13 @@
 #define DNS_TABLE_SIZE		16
 #define DNS_MAX_SERVERS		4
 #define TCP_MSS			1460
-#define TCP_WND			64000
+#define TCP_WND			(1024*1024)
+#define LWIP_WND_SCALE		1
+#define TCP_RCV_SCALE		5	/* Up to a 2 MB window */
+#define TCP_WND_UPDATE_THRESHOLD (4*TCP_MSS)
 #define TCP_SND_BUF		(4*TCP_MSS)
 #define LWIP_TCP_TIMESTAMPS	1
+#define LWIP_TCP_SACK		1	/* Losses cost only the holes */
 
 /*
  * IANA says to use dynamic port numbers above 49152, but some
@@ -57,10 +68,18 @@
 #define UDP_LOCAL_PORT_RANGE_START 49152
 #define UDP_LOCAL_PORT_RANGE_END   57343
 
-#define ETHARP_TRUST_IP_MAC	0
+#define ETHARP_TRUST_IP_MAC	1	/* Neighbours' packets refresh them */
  
 #define LWIP_STATS		1
 #define LWIP_STATS_DISPLAY	1
+#define LWIP_STATS_LARGE	1	/* Packet counts for netstat.c32 */
+
+/* Checksums come from arch/chksum.c, and are summed as data is copied */
+#define LWIP_CHKSUM		lwip_arch_chksum
+#define LWIP_CHECKSUM_ON_COPY	1
+#define LWIP_CHKSUM_COPY(dst, src, len) lwip_arch_chksum_copy(dst, src, len)
+uint16_t lwip_arch_chksum(const void *, int);
+uint16_t lwip_arch_chksum_copy(void *, const void *, uint16_t);
 
 #define LWIP_PLATFORM_BYTESWAP	1
 #define LWIP_PLATFORM_HTONS(x)	bswap_16(x)
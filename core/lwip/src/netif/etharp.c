@@ -599,6 +599,23 @@ etharp_find_addr(struct netif *netif, ip_addr_t *ipaddr,
   return -1;
 }
 
+/**
+ * Add an ordinary (not static) entry, as if a reply had just come in
+ * from the host; it ages like any other.  For addresses learned by
+ * whoever ran before us (a PXELINUX that chained this one).
+ *
+ * @param netif the interface the host is on
+ * @param ipaddr IP address of the host
+ * @param ethaddr its Ethernet address
+ * @return @see return values of update_arp_entry
+ */
+err_t
+etharp_add_entry(struct netif *netif, ip_addr_t *ipaddr,
+         struct eth_addr *ethaddr)
+{
+  return update_arp_entry(netif, ipaddr, ethaddr, ETHARP_FLAG_TRY_HARD);
+}
+
 #if ETHARP_TRUST_IP_MAC
 /**
  * Updates the ARP table using the given IP packet.
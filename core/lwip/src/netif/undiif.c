@@ -68,6 +68,7 @@
 
 #include "lwip/def.h"
 #include "lwip/mem.h"
+#include "lwip/memp.h"
 #include "lwip/pbuf.h"
 #include "lwip/sys.h"
 #include <lwip/stats.h>
@@ -87,6 +88,7 @@
 #include "ipv4/lwip/icmp.h"
 #include "lwip/tcp_impl.h"
 #include "lwip/udp.h"
+#include "lwip/igmp.h"
 
 #if LWIP_AUTOIP
 #error "AUTOIP not supported"
@@ -386,6 +388,55 @@ int snprintf_udp_hdr(char *str, size_t size, char head[],
 }
 #endif /* UNDIIF_ID_FULL_DEBUG */
 
+#if LWIP_IGMP
+/*
+ * Keep the UNDI multicast address list in step with the groups lwIP
+ * has joined.  IPv4 groups map onto 01:00:5e plus the low 23 bits.
+ */
+static err_t
+undi_igmp_mac_filter(struct netif *netif, ip_addr_t *group, u8_t action)
+{
+  static __lowmem t_PXENV_UNDI_SET_MCAST_ADDR set_mcast;
+  static mac_addr_t mcast[MAXNUM_MCADDR];
+  static int mcast_count;
+  mac_addr_t mac;
+  int i;
+
+  (void)netif;
+
+  memset(mac, 0, sizeof mac);	/* mac_addr_t has room for any media */
+  mac[0] = 0x01;
+  mac[1] = 0x00;
+  mac[2] = 0x5e;
+  mac[3] = ip4_addr2(group) & 0x7f;
+  mac[4] = ip4_addr3(group);
+  mac[5] = ip4_addr4(group);
+
+  for (i = 0; i < mcast_count; i++)
+    if (!memcmp(mcast[i], mac, sizeof mac))
+      break;
+
+  if (action == IGMP_ADD_MAC_FILTER) {
+    if (i < mcast_count)
+      return ERR_OK;	/* Two groups can share a MAC address */
+    if (mcast_count >= MAXNUM_MCADDR)
+      return ERR_MEM;
+    memcpy(mcast[mcast_count++], mac, sizeof mac);
+  } else {
+    if (i >= mcast_count)
+      return ERR_OK;
+    memmove(mcast[i], mcast[i+1], (--mcast_count - i) * sizeof mac);
+  }
+
+  memset(&set_mcast, 0, sizeof set_mcast);
+  set_mcast.R_Mcast_Buf.MCastAddrCount = mcast_count;
+  memcpy(set_mcast.R_Mcast_Buf.McastAddr, mcast, mcast_count * sizeof mac);
+  pxe_call(PXENV_UNDI_SET_MCAST_ADDR, &set_mcast);
+
+  return set_mcast.Status ? ERR_IF : ERR_OK;
+}
+#endif /* LWIP_IGMP */
+
 /**
  * In this function, the hardware should be initialized.
  * Called from undiif_init().
@@ -435,6 +486,14 @@ low_level_init(struct netif *netif)
   /* don't set NETIF_FLAG_ETHARP if this device is not an ethernet one */
   if (undi_is_ethernet(netif))
     netif->flags |= NETIF_FLAG_ETHARP;
+#if LWIP_IGMP
+  /* Only if UNDI can be told which multicast addresses to take */
+  if (undi_is_ethernet(netif) &&
+      (pxe_undi_iface.ServiceFlags & PXE_UNDI_IFACE_FLAG_MCAST)) {
+    netif->flags |= NETIF_FLAG_IGMP;
+    netif_set_igmp_mac_filter(netif, undi_igmp_mac_filter);
+  }
+#endif
 
   /* Install the interrupt vector */
   pxe_start_isr();
@@ -532,6 +591,7 @@ undi_transmit(struct netif *netif, struct pbuf *pbuf,
     pxe_call(PXENV_UNDI_TRANSMIT, &pxe.xmit);
   } while (pxe.xmit.Status == PXENV_STATUS_OUT_OF_RESOURCES);
 
+  pxe_poll_kick();
   LINK_STATS_INC(link.xmit);
 
   return ERR_OK;
@@ -1133,7 +1193,7 @@ static void get_packet_fragment(t_PXENV_UNDI_ISR *isr)
 {
   do {
     isr->FuncFlag = PXENV_UNDI_ISR_IN_GET_NEXT;
-    pxe_call(PXENV_UNDI_ISR, &isr);
+    pxe_call(PXENV_UNDI_ISR, isr);
   } while (isr->FuncFlag != PXENV_UNDI_ISR_OUT_RECEIVE);
 }
 
@@ -1436,12 +1496,108 @@ undiarp_input(struct netif *netif, struct pbuf *p)
   pbuf_free(p);
 }
 
+/*
+ * Received frames wait here for the tcpip thread, which takes all of
+ * them in one go when it gets to run.  The receive thread is the only
+ * one to add frames and the tcpip thread the only one to take them.
+ * Every frame holds at least one pool pbuf, so with a slot per pool
+ * pbuf, and the pool sized as memp_init() found it, there is always
+ * room.
+ */
+
+enum undiif_rx_type {
+  UNDIIF_RX_ETH,                /* Whole Ethernet frame */
+  UNDIIF_RX_IP,                 /* Link level header removed */
+  UNDIIF_RX_ARP,
+};
+
+static struct undiif_rxq_entry {
+  struct pbuf *p;
+  u8_t type;                    /* enum undiif_rx_type */
+} *undiif_rxq;
+static u16_t undiif_rxq_size;
+static volatile u16_t undiif_rxq_head, undiif_rxq_tail;
+static volatile u8_t undiif_rxq_posted;
+
+static void
+undiif_rxq_init(void)
+{
+  undiif_rxq_size = memp_count(MEMP_PBUF_POOL) + 1;
+  undiif_rxq = malloc(undiif_rxq_size * sizeof *undiif_rxq);
+  LWIP_ASSERT("undiif_rxq_init: no memory", undiif_rxq != NULL);
+}
+
+static void
+undiif_rxq_put(struct pbuf *p, u8_t type)
+{
+  u16_t tail = undiif_rxq_tail;
+  u16_t next = tail + 1 == undiif_rxq_size ? 0 : tail + 1;
+
+  if (next == undiif_rxq_head) {
+    LINK_STATS_INC(link.drop);
+    pbuf_free(p);
+    return;
+  }
+  undiif_rxq[tail].p = p;
+  undiif_rxq[tail].type = type;
+  asm volatile("" : : : "memory");  /* Entry before index */
+  undiif_rxq_tail = next;
+}
+
+/**
+ * Hand the queued frames to the stack; runs in the tcpip thread.
+ */
+static void
+undiif_rxq_run(void *arg)
+{
+  struct undiif_rxq_entry *e;
+  u16_t head;
+
+  LWIP_UNUSED_ARG(arg);
+
+  /* Frames queued from now on need another callback */
+  undiif_rxq_posted = 0;
+  asm volatile("" : : : "memory");
+
+  for (head = undiif_rxq_head; head != undiif_rxq_tail;) {
+    e = &undiif_rxq[head];
+    switch (e->type) {
+    case UNDIIF_RX_ETH:
+      ethernet_input(e->p, &undi_netif);
+      break;
+    case UNDIIF_RX_IP:
+      ip_input(e->p, &undi_netif);
+      break;
+    case UNDIIF_RX_ARP:
+      undiarp_input(&undi_netif, e->p);
+      break;
+    }
+    head = head + 1 == undiif_rxq_size ? 0 : head + 1;
+    undiif_rxq_head = head;
+  }
+}
+
+/**
+ * Called once the receive thread has drained the UNDI stack: one
+ * message to the tcpip thread covers everything queued since the last.
+ */
+void undiif_input_flush(void)
+{
+  if (undiif_rxq_posted || undiif_rxq_head == undiif_rxq_tail)
+    return;
+
+  undiif_rxq_posted = 1;
+  if (tcpip_callback_with_block(undiif_rxq_run, NULL, 0) != ERR_OK)
+    undiif_rxq_posted = 0;      /* Try again after the next frame */
+}
+
 /**
  * This function should be called when a packet is ready to be read
  * from the interface. It uses the function low_level_input() that
  * should handle the actual reception of bytes from the network
  * interface. Then the type of the received packet is determined and
- * the appropriate input function is called.
+ * it is queued for the appropriate input function; see
+ * undiif_input_flush().
  *
  * @param netif the lwip network interface structure for this undiif
  */
@@ -1494,12 +1650,8 @@ void undiif_input(t_PXENV_UNDI_ISR *isr)
     case ETHTYPE_PPPOEDISC:
     case ETHTYPE_PPPOE:
 #endif /* PPPOE_SUPPORT */
-      /* full packet send to tcpip_thread to process */
-      if (tcpip_input(p, &undi_netif)!=ERR_OK)
-       { LWIP_DEBUGF(UNDIIF_NET_DEBUG | UNDIIF_DEBUG, ("undiif_input: IP input error\n"));
-         pbuf_free(p);
-         p = NULL;
-       }
+      /* full packet for the tcpip_thread to process */
+      undiif_rxq_put(p, UNDIIF_RX_ETH);
       break;
 
     default:
@@ -1516,12 +1668,12 @@ void undiif_input(t_PXENV_UNDI_ISR *isr)
       switch(undi_prot) {
       case P_IP:
         /* pass to IP layer */
-        tcpip_input(p, &undi_netif);
+        undiif_rxq_put(p, UNDIIF_RX_IP);
         break;
       
       case P_ARP:
         /* pass p to ARP module */
-        undiarp_input(&undi_netif, p);
+        undiif_rxq_put(p, UNDIIF_RX_ARP);
         break;
 
       default:
@@ -1570,6 +1722,7 @@ undiif_init(struct netif *netif)
   netif->linkoutput = undi_send_unknown;
 
   /* initialize the hardware */
+  undiif_rxq_init();
   low_level_init(netif);
 
   return ERR_OK;
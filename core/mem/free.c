@@ -5,6 +5,7 @@
  */
 
 #include <syslinux/firmware.h>
+#include <syslinux/trace.h>
 #include <stdlib.h>
 #include <dprintf.h>
 #include "malloc.h"
@@ -15,14 +16,13 @@ static struct free_arena_header *
 __free_block(struct free_arena_header *ah)
 {
     struct free_arena_header *pah, *nah;
-    struct free_arena_header *head =
-	&__core_malloc_head[ARENA_HEAP_GET(ah->a.attrs)];
 
     pah = ah->a.prev;
     nah = ah->a.next;
     if ( ARENA_TYPE_GET(pah->a.attrs) == ARENA_TYPE_FREE &&
            (char *)pah+ARENA_SIZE_GET(pah->a.attrs) == (char *)ah ) {
-        /* Coalesce into the previous block */
+        /* Coalesce into the previous block; it changes size, so lists */
+        __free_list_remove(pah);
         ARENA_SIZE_SET(pah->a.attrs, ARENA_SIZE_GET(pah->a.attrs) +
 		ARENA_SIZE_GET(ah->a.attrs));
         pah->a.next = nah;
@@ -33,16 +33,9 @@ __free_block(struct free_arena_header *ah)
 #endif
 
         ah = pah;
-        pah = ah->a.prev;
     } else {
-        /* Need to add this block to the free chain */
         ARENA_TYPE_SET(ah->a.attrs, ARENA_TYPE_FREE);
         ah->a.tag = MALLOC_FREE;
-
-        ah->next_free = head->next_free;
-        ah->prev_free = head;
-        head->next_free = ah;
-        ah->next_free->prev_free = ah;
     }
 
     /* In either of the previous cases, we might be able to merge
@@ -53,8 +46,7 @@ __free_block(struct free_arena_header *ah)
 		ARENA_SIZE_GET(nah->a.attrs));
 
         /* Remove the old block from the chains */
-        nah->next_free->prev_free = nah->prev_free;
-        nah->prev_free->next_free = nah->next_free;
+        __free_list_remove(nah);
         ah->a.next = nah->a.next;
         nah->a.next->a.prev = ah;
 
@@ -63,6 +55,9 @@ __free_block(struct free_arena_header *ah)
 #endif
     }
 
+    /* File the result under its final size */
+    __free_list_insert(ah);
+
     /* Return the block that contains the called block */
     return ah;
 }
@@ -82,6 +77,7 @@ void bios_free(void *ptr)
 	dprintf("invalid arena type: %d\n", ARENA_TYPE_GET(ah->a.attrs));
 #endif
 
+    __malloc_account(ah, false);
     __free_block(ah);
 }
 
@@ -94,6 +90,8 @@ __export void free(void *ptr)
     if ( !ptr )
         return;
 
+    trace(TRACE_MALLOC, "free", (uintptr_t)ptr, 0);
+
     sem_down(&__malloc_semaphore, 0);
     firmware->mem->free(ptr);
     sem_up(&__malloc_semaphore);
@@ -163,8 +161,10 @@ static void __free_tagged(malloc_tag_t tag) {
 	head = &__core_malloc_head[i];
 	for (fp = head->a.next ; fp != head ; fp = fp->a.next) {
 	    if (ARENA_TYPE_GET(fp->a.attrs) == ARENA_TYPE_USED &&
-		fp->a.tag == tag)
+		fp->a.tag == tag) {
+		__malloc_account(fp, false);
 		fp = __free_block(fp);
+	    }
 	}
     }
 
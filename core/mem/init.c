@@ -7,6 +7,7 @@
 #include <dprintf.h>
 
 struct free_arena_header __core_malloc_head[NHEAP];
+struct free_arena_header __core_malloc_bins[NHEAP][MALLOC_NBINS];
 
 //static __hugebss char main_heap[128 << 10];
 extern char __lowmem_heap[];
@@ -20,7 +21,8 @@ int scan_highmem_area(void *data, addr_t start, addr_t len,
 
 	(void)data;
 
-	dprintf("start = %x, len = %x, type = %d", start, len, type);
+	dprintf("start = %" PRIxADDR ", len = %" PRIxADDR ", type = %d",
+		start, len, type);
 
 	if (start < 0x100000 || start > E820_MEM_MAX
 			     || type != SMT_FREE)
@@ -40,7 +42,8 @@ int scan_highmem_area(void *data, addr_t start, addr_t len,
 		fp->a.magic = ARENA_MAGIC;
 #endif
 		ARENA_SIZE_SET(fp->a.attrs, len);
-		dprintf("will inject a block start:0x%x size 0x%x", start, len);
+		dprintf("will inject a block start:0x%" PRIxADDR
+			" size 0x%" PRIxADDR, start, len);
 		__inject_free_block(fp);
 	}
 
@@ -51,31 +54,34 @@ int scan_highmem_area(void *data, addr_t start, addr_t len,
 #if 0
 static void mpool_dump(enum heap heap)
 {
-	struct free_arena_header *head = &__core_malloc_head[heap];
+	struct free_arena_header *head;
 	struct free_arena_header *fp;
-	int size, type, i = 0;
+	int size, type, i = 0, bin;
 	addr_t start, end;
 
-	fp = head->next_free;
-	while (fp != head) {
-		size = ARENA_SIZE_GET(fp->a.attrs);
-		type = ARENA_TYPE_GET(fp->a.attrs);
-		start = (addr_t)fp;
-		end = start + size;
-		printf("area[%d]: start = 0x%08x, end = 0x%08x, type = %d\n",
-			i++, start, end, type);
-		fp = fp->next_free;
+	for (bin = 0; bin < MALLOC_NBINS; bin++) {
+		head = &__core_malloc_bins[heap][bin];
+		fp = head->next_free;
+		while (fp != head) {
+			size = ARENA_SIZE_GET(fp->a.attrs);
+			type = ARENA_TYPE_GET(fp->a.attrs);
+			start = (addr_t)fp;
+			end = start + size;
+			printf("area[%d]: start = 0x%08x, end = 0x%08x, type = %d\n",
+				i++, start, end, type);
+			fp = fp->next_free;
+		}
 	}
 }
 #endif
 
-uint16_t *bios_free_mem;
-void mem_init(void)
+/*
+ * Empty heaps, for the firmware to put memory into
+ */
+void __mem_init_heads(void)
 {
 	struct free_arena_header *fp;
-	int i;
-
-	//dprintf("enter");
+	int i, j;
 
 	/* Initialize the head nodes */
 	fp = &__core_malloc_head[0];
@@ -85,7 +91,27 @@ void mem_init(void)
 	fp->a.tag = MALLOC_HEAD;
 	fp++;
 	}
-	
+
+	/* ... and the free lists */
+	for (i = 0 ; i < NHEAP ; i++) {
+		for (j = 0 ; j < MALLOC_NBINS ; j++) {
+			fp = &__core_malloc_bins[i][j];
+			fp->next_free = fp->prev_free = fp;
+			fp->a.attrs = ARENA_TYPE_HEAD | (i << ARENA_HEAP_POS);
+			fp->a.tag = MALLOC_HEAD;
+		}
+	}
+}
+
+uint16_t *bios_free_mem;
+void mem_init(void)
+{
+	struct free_arena_header *fp;
+
+	//dprintf("enter");
+
+	__mem_init_heads();
+
 	//dprintf("__lowmem_heap = 0x%p bios_free = 0x%p",
 	//	__lowmem_heap, *bios_free_mem);
 	
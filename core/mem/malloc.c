@@ -1,10 +1,12 @@
 /*
  * malloc.c
  *
- * Very simple linked-list based malloc()/free().
+ * Very simple linked-list based malloc()/free(), with the free
+ * blocks sorted into lists by size.
  */
 
 #include <syslinux/firmware.h>
+#include <syslinux/trace.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
@@ -49,43 +51,183 @@ static void *__malloc_from_block(struct free_arena_header *fp,
         na->a.prev = nfp;
         fp->a.next = nfp;
 
-        /* Replace current block on free chain */
-        nfp->next_free = fp->next_free;
-        nfp->prev_free = fp->prev_free;
-        fp->next_free->prev_free = nfp;
-        fp->prev_free->next_free = nfp;
+        /* Replace current block on free chain, on the list for its size */
+        __free_list_remove(fp);
+        __free_list_insert(nfp);
     } else {
         /* Allocate the whole block */
         ARENA_TYPE_SET(fp->a.attrs, ARENA_TYPE_USED);
         fp->a.tag = tag;
 
         /* Remove from free chain */
-        fp->next_free->prev_free = fp->prev_free;
-        fp->prev_free->next_free = fp->next_free;
+        __free_list_remove(fp);
     }
 
+    __malloc_account(fp, true);
     return (void *)(&fp->a + 1);
 }
 
 void *bios_malloc(size_t size, enum heap heap, malloc_tag_t tag)
 {
-    struct free_arena_header *fp;
-    struct free_arena_header *head = &__core_malloc_head[heap];
-    void *p = NULL;
+    struct free_arena_header *fp, *head;
+    unsigned int bin;
 
-    if (size) {
-	/* Add the obligatory arena header, and round up */
-	size = (size + 2 * sizeof(struct arena_header) - 1) & ARENA_SIZE_MASK;
+    if (!size)
+	return NULL;
 
+    /* Add the obligatory arena header, and round up */
+    size = (size + 2 * sizeof(struct arena_header) - 1) & ARENA_SIZE_MASK;
+
+    /*
+     * Every block on a list past our own is big enough, so only the
+     * list for our own size (if it is a power-of-two one) is searched.
+     */
+    for (bin = __malloc_bin(size); bin < MALLOC_NBINS; bin++) {
+	head = &__core_malloc_bins[heap][bin];
 	for ( fp = head->next_free ; fp != head ; fp = fp->next_free ) {
 	    if ( ARENA_SIZE_GET(fp->a.attrs) >= size ) {
 		/* Found fit -- allocate out of this block */
-		p = __malloc_from_block(fp, size, tag);
-		break;
+		return __malloc_from_block(fp, size, tag);
 	    }
-        }
+	}
+    }
+
+    return NULL;
+}
+
+/*
+ * Where in the free block fp the data of a malloc_high() allocation
+ * can start, or 0 if it doesn't fit.  The block is split in up to three,
+ * so the pieces before and after have to be free blocks of their own.
+ */
+static uintptr_t __high_fit(struct free_arena_header *fp, size_t size,
+			    size_t align, uintptr_t limit)
+{
+    uintptr_t start = (uintptr_t)fp;
+    uintptr_t end = start + ARENA_SIZE_GET(fp->a.attrs);
+    uintptr_t top = limit < end - 1 ? limit + 1 : end;
+    uintptr_t data, front;
+
+    if (top <= start || top - start < size + sizeof(struct arena_header))
+	return 0;
+
+    for (data = (top - size) & ~(align - 1);
+	 data >= start + sizeof(struct arena_header);
+	 data -= align) {
+	front = data - sizeof(struct arena_header) - start;
+	if (!front || front >= 2 * sizeof(struct arena_header))
+	    return data;
+	if (data < align)
+	    break;
+    }
+
+    return 0;
+}
+
+static void *__malloc_high(size_t size, size_t align, uintptr_t limit)
+{
+    struct free_arena_header *fp, *head, *best = NULL;
+    struct free_arena_header *ah, *nfp, *na;
+    uintptr_t data, best_data = 0;
+    size_t bsize, tail;
+    unsigned int bin;
+
+    for (bin = 0; bin < MALLOC_NBINS; bin++) {
+	head = &__core_malloc_bins[HEAP_MAIN][bin];
+	for (fp = head->next_free; fp != head; fp = fp->next_free) {
+	    data = __high_fit(fp, size, align, limit);
+	    if (data > best_data) {
+		best = fp;
+		best_data = data;
+	    }
+	}
+    }
+
+    if (!best)
+	return NULL;
+
+    fp = best;
+    na = fp->a.next;
+    ah = (struct free_arena_header *)
+	((struct arena_header *)best_data - 1);
+    bsize = (size + 2 * sizeof(struct arena_header) - 1) & ARENA_SIZE_MASK;
+    tail = (uintptr_t)fp + ARENA_SIZE_GET(fp->a.attrs) -
+	((uintptr_t)ah + bsize);
+    if (tail < 2 * sizeof(struct arena_header)) {
+	bsize += tail;		/* Too little to be a block of its own */
+	tail = 0;
+    }
+
+    __free_list_remove(fp);
+    if (ah != fp) {
+	/* The front stays free, and smaller */
+	ARENA_SIZE_SET(fp->a.attrs, (uintptr_t)ah - (uintptr_t)fp);
+	__free_list_insert(fp);
+	fp->a.next = ah;
+	ah->a.prev = fp;
+    }
+
+    ah->a.attrs = 0;
+    ARENA_TYPE_SET(ah->a.attrs, ARENA_TYPE_USED);
+    ARENA_HEAP_SET(ah->a.attrs, HEAP_MAIN);
+    ARENA_SIZE_SET(ah->a.attrs, bsize);
+    ah->a.tag = MALLOC_CORE;
+#ifdef DEBUG_MALLOC
+    ah->a.magic = ARENA_MAGIC;
+#endif
+    ah->a.next = na;
+    na->a.prev = ah;
+
+    if (tail) {
+	nfp = (struct free_arena_header *)((char *)ah + bsize);
+	nfp->a.attrs = 0;
+	ARENA_TYPE_SET(nfp->a.attrs, ARENA_TYPE_FREE);
+	ARENA_HEAP_SET(nfp->a.attrs, HEAP_MAIN);
+	ARENA_SIZE_SET(nfp->a.attrs, tail);
+	nfp->a.tag = MALLOC_FREE;
+#ifdef DEBUG_MALLOC
+	nfp->a.magic = ARENA_MAGIC;
+#endif
+	nfp->a.prev = ah;
+	nfp->a.next = na;
+	ah->a.next = nfp;
+	na->a.prev = nfp;
+	__free_list_insert(nfp);
     }
 
+    __malloc_account(ah, true);
+    return (void *)best_data;
+}
+
+/*
+ * Allocate size bytes, aligned to align (a power of two), as high in
+ * the main heap as they fit without reaching past the address limit.
+ * For data that is going to be moved to the top of memory anyway: put
+ * there to begin with, it doesn't have to be moved at all.
+ */
+__export void *malloc_high(size_t size, size_t align, size_t limit)
+{
+    void *p;
+
+    if (!size)
+	return NULL;
+
+    align = max(align, sizeof(struct arena_header));
+
+    sem_down(&__malloc_semaphore, 0);
+    p = __malloc_high(size, align, limit);
+    sem_up(&__malloc_semaphore);
+
+    /* The firmware may be able to give us more memory where we want it */
+    if (!p && firmware->mem->grow_below &&
+	!firmware->mem->grow_below(size + align +
+				   4 * sizeof(struct arena_header), limit)) {
+	sem_down(&__malloc_semaphore, 0);
+	p = __malloc_high(size, align, limit);
+	sem_up(&__malloc_semaphore);
+    }
+
+    trace(TRACE_MALLOC, "malloc_high", size, (uintptr_t)p);
     return p;
 }
 
@@ -102,6 +244,9 @@ static void *_malloc(size_t size, enum heap heap, malloc_tag_t tag)
     p = firmware->mem->malloc(size, heap, tag);
     sem_up(&__malloc_semaphore);
 
+    trace(TRACE_MALLOC, heap == HEAP_LOWMEM ? "lmalloc" : "malloc",
+	  size, (uintptr_t)p);
+
 #ifdef DEBUG_MALLOC
     dprintf("%p\n", p);
 #endif
@@ -147,8 +292,6 @@ void *bios_realloc(void *ptr, size_t size)
     ah = (struct free_arena_header *)
 	((struct arena_header *)ptr - 1);
 
-	head = &__core_malloc_head[ARENA_HEAP_GET(ah->a.attrs)];
-
 #ifdef DEBUG_MALLOC
     if (ah->a.magic != ARENA_MAGIC)
 	dprintf("failed realloc() magic check: %p\n", ptr);
@@ -166,6 +309,8 @@ void *bios_realloc(void *ptr, size_t size)
 	/* This allocation is close enough already. */
 	return ptr;
     } else {
+	/* Counted in again at its new size, below */
+	__malloc_account(ah, false);
 	xsize = oldsize;
 
 	nah = ah->a.next;
@@ -177,8 +322,7 @@ void *bios_realloc(void *ptr, size_t size)
 	    /* Merge in subsequent free block */
 	    ah->a.next = nah->a.next;
 	    ah->a.next->a.prev = ah;
-	    nah->next_free->prev_free = nah->prev_free;
-	    nah->prev_free->next_free = nah->next_free;
+	    __free_list_remove(nah);
 	    ARENA_SIZE_SET(ah->a.attrs, ARENA_SIZE_GET(ah->a.attrs) +
 			   ARENA_SIZE_GET(nah->a.attrs));
 	    xsize = ARENA_SIZE_GET(ah->a.attrs);
@@ -214,21 +358,21 @@ void *bios_realloc(void *ptr, size_t size)
 		       which has already been grown at least once.  As such, put
 		       it at the *end* of the freelist instead of the beginning;
 		       trying to save it for future realloc()s of the same block. */
+		    head = __malloc_bin_head(nah);
 		    nah->prev_free = head->prev_free;
 		    nah->next_free = head;
 		    head->prev_free = nah;
 		    nah->prev_free->next_free = nah;
 		} else {
-		    nah->next_free = head->next_free;
-		    nah->prev_free = head;
-		    head->next_free = nah;
-		    nah->next_free->prev_free = nah;
+		    __free_list_insert(nah);
 		}
    	    }
 	    /* otherwise, use up the whole block */
+	    __malloc_account(ah, true);
 	    return ptr;
 	} else {
 	    /* Last resort: need to allocate a new block and copy */
+	    __malloc_account(ah, true);
 	    oldsize -= sizeof(struct arena_header);
 	    newptr = malloc(size);
 	    if (newptr) {
@@ -242,7 +386,11 @@ void *bios_realloc(void *ptr, size_t size)
 
 __export void *realloc(void *ptr, size_t size)
 {
-    return firmware->mem->realloc(ptr, size);
+    void *newptr;
+
+    newptr = firmware->mem->realloc(ptr, size);
+    trace(TRACE_MALLOC, "realloc", size, (uintptr_t)newptr);
+    return newptr;
 }
 
 __export void *zalloc(size_t size)
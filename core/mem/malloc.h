@@ -4,6 +4,9 @@
  * Internals for the memory allocator
  */
 
+#ifndef _CORE_MEM_MALLOC_H
+#define _CORE_MEM_MALLOC_H
+
 #include <stdint.h>
 #include <stddef.h>
 #include "core.h"
@@ -96,3 +99,96 @@ struct free_arena_header {
 
 extern struct free_arena_header __core_malloc_head[NHEAP];
 void __inject_free_block(struct free_arena_header *ah);
+void __mem_init_heads(void);
+
+/* The allocator proper, for the firmware's mem_ops */
+struct com32_mem_stats;
+void *bios_malloc(size_t size, enum heap heap, malloc_tag_t tag);
+void *bios_realloc(void *ptr, size_t size);
+void bios_free(void *ptr);
+int bios_mem_stats(struct com32_mem_stats *st);
+
+/*
+ * Free blocks are kept on one of MALLOC_NBINS lists per heap, by size:
+ * a list for each size up to MALLOC_EXACT_BINS alignment units, so a
+ * small request is served off the front of its own list (or the next
+ * one that isn't empty), and a list for each power of two above that.
+ * Only the next_free/prev_free links of the list heads are used.
+ */
+#define MALLOC_EXACT_BINS	32
+#define MALLOC_NBINS		(MALLOC_EXACT_BINS + 24)
+
+extern struct free_arena_header __core_malloc_bins[NHEAP][MALLOC_NBINS];
+
+static inline unsigned int __malloc_bin(size_t size)
+{
+    size_t units = size / sizeof(struct arena_header);
+    unsigned int bin;
+
+    if (units < MALLOC_EXACT_BINS)
+	return units;
+
+    /* log2(units) - log2(MALLOC_EXACT_BINS), on top of the exact bins */
+    bin = MALLOC_EXACT_BINS + __builtin_clzl(MALLOC_EXACT_BINS) -
+	__builtin_clzl(units);
+    return bin < MALLOC_NBINS ? bin : MALLOC_NBINS - 1;
+}
+
+static inline struct free_arena_header *
+__malloc_bin_head(struct free_arena_header *ah)
+{
+    return &__core_malloc_bins[ARENA_HEAP_GET(ah->a.attrs)]
+	[__malloc_bin(ARENA_SIZE_GET(ah->a.attrs))];
+}
+
+static inline void __free_list_remove(struct free_arena_header *ah)
+{
+    ah->next_free->prev_free = ah->prev_free;
+    ah->prev_free->next_free = ah->next_free;
+}
+
+/* Put a free block at the front of the list for its size */
+static inline void __free_list_insert(struct free_arena_header *ah)
+{
+    struct free_arena_header *head = __malloc_bin_head(ah);
+
+    ah->next_free = head->next_free;
+    ah->prev_free = head;
+    head->next_free = ah;
+    ah->next_free->prev_free = ah;
+}
+
+/*
+ * Running totals of the blocks in use, per heap and owner tag; the
+ * tag and size of a block have to be set before it is counted in and
+ * still be those it was counted with when it is counted out.
+ */
+#define MALLOC_OWNERS	(MALLOC_MODULE + 1)
+
+struct malloc_owner_stats {
+    size_t bytes;
+    size_t blocks;
+};
+
+extern struct malloc_owner_stats __malloc_owner_stats[NHEAP][MALLOC_OWNERS];
+
+static inline void __malloc_account(const struct free_arena_header *ah,
+				    bool in_use)
+{
+    struct malloc_owner_stats *st;
+    size_t size = ARENA_SIZE_GET(ah->a.attrs);
+
+    if (ah->a.tag >= MALLOC_OWNERS)
+	return;
+
+    st = &__malloc_owner_stats[ARENA_HEAP_GET(ah->a.attrs)][ah->a.tag];
+    if (in_use) {
+	st->bytes += size;
+	st->blocks++;
+    } else {
+	st->bytes -= size;
+	st->blocks--;
+    }
+}
+
+#endif /* _CORE_MEM_MALLOC_H */
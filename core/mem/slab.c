@@ -0,0 +1,109 @@
+/*
+ * slab.c
+ *
+ * Fixed-size object caches on top of malloc().  The memory of a cache
+ * is never given back to the heap; a cache is as large as the most
+ * objects that were ever live at once.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dprintf.h>
+#include <sys/cpu.h>
+#include <slab.h>
+
+#define SLAB_ALIGN	16	/* Same as the heap's own alignment */
+
+static size_t slab_objsize(const struct slab_cache *cache)
+{
+    size_t size = cache->size;
+
+    if (size < sizeof(void *))
+	size = sizeof(void *);
+    return (size + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1);
+}
+
+/*
+ * Carve another chunk of objects and put them on the free list
+ */
+static int slab_grow(struct slab_cache *cache)
+{
+    size_t objsize = slab_objsize(cache);
+    unsigned int n = cache->per_chunk ? cache->per_chunk : 1;
+    irq_state_t irq;
+    char *chunk;
+
+    chunk = malloc(n * objsize);
+    if (!chunk)
+	return -1;
+
+    dprintf("slab %s: %u more objects of %zu bytes\n",
+	    cache->name, n, objsize);
+
+    irq = irq_save();
+    cache->total += n;
+    cache->nfree += n;
+    while (n--) {
+	*(void **)chunk = cache->free;
+	cache->free = chunk;
+	chunk += objsize;
+    }
+    irq_restore(irq);
+
+    return 0;
+}
+
+void *slab_alloc(struct slab_cache *cache)
+{
+    irq_state_t irq;
+    void *obj;
+
+    for (;;) {
+	irq = irq_save();
+	obj = cache->free;
+	if (obj) {
+	    cache->free = *(void **)obj;
+	    cache->nfree--;
+	}
+	irq_restore(irq);
+
+	if (obj || slab_grow(cache))
+	    return obj;
+    }
+}
+
+void *slab_zalloc(struct slab_cache *cache)
+{
+    void *obj = slab_alloc(cache);
+
+    if (obj)
+	memset(obj, 0, cache->size);
+    return obj;
+}
+
+void slab_free(struct slab_cache *cache, void *obj)
+{
+    irq_state_t irq;
+
+    if (!obj)
+	return;
+
+    irq = irq_save();
+    *(void **)obj = cache->free;
+    cache->free = obj;
+    cache->nfree++;
+    irq_restore(irq);
+}
+
+/*
+ * Make sure at least count objects can be had without going to the heap
+ */
+int slab_prefill(struct slab_cache *cache, unsigned int count)
+{
+    while (cache->nfree < count) {
+	if (slab_grow(cache))
+	    return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,77 @@
+/*
+ * stats.c
+ *
+ * What the heaps are used for and how broken up what is left of them
+ * is, for meminfo.c32.
+ */
+
+#include <syslinux/firmware.h>
+#include <syslinux/pmapi.h>
+#include <string.h>
+#include <minmax.h>
+#include "malloc.h"
+#include "pmapi.h"
+
+struct malloc_owner_stats __malloc_owner_stats[NHEAP][MALLOC_OWNERS];
+
+/* Owner tags as com32_mem_owner */
+static const malloc_tag_t mem_owner_tags[COM32_MEM_OWNERS] = {
+    [COM32_MEM_CORE]	= MALLOC_CORE,
+    [COM32_MEM_MODULE]	= MALLOC_MODULE,
+};
+
+static void heap_stats(struct com32_heap_stats *hs, enum heap heap)
+{
+    struct free_arena_header *fp, *head;
+    const struct malloc_owner_stats *os;
+    unsigned int bin, slot;
+    size_t size;
+    int i;
+
+    for (i = 0; i < COM32_MEM_OWNERS; i++) {
+	os = &__malloc_owner_stats[heap][mem_owner_tags[i]];
+	hs->used_bytes[i] = os->bytes;
+	hs->used_blocks[i] = os->blocks;
+    }
+
+    for (bin = 0; bin < MALLOC_NBINS; bin++) {
+	head = &__core_malloc_bins[heap][bin];
+	for (fp = head->next_free; fp != head; fp = fp->next_free) {
+	    size = ARENA_SIZE_GET(fp->a.attrs);
+
+	    hs->free_bytes += size;
+	    hs->free_blocks++;
+	    if (size > hs->largest_free)
+		hs->largest_free = size;
+
+	    slot = __builtin_clzl(32) - __builtin_clzl(size);
+	    hs->free_hist[min(slot, COM32_MEM_HIST - 1)]++;
+	}
+    }
+
+    /* What an allocation out of the largest block actually gets */
+    if (hs->largest_free)
+	hs->largest_free -= sizeof(struct arena_header);
+}
+
+int bios_mem_stats(struct com32_mem_stats *st)
+{
+    sem_down(&__malloc_semaphore, 0);
+    heap_stats(&st->heap[0], HEAP_MAIN);
+    heap_stats(&st->heap[1], HEAP_LOWMEM);
+    sem_up(&__malloc_semaphore);
+
+    return 0;
+}
+
+/*
+ * Returns -1 if the firmware's allocator keeps no statistics
+ */
+__export int pmapi_mem_stats(struct com32_mem_stats *st)
+{
+    memset(st, 0, sizeof *st);
+    if (!firmware->mem->stats)
+	return -1;
+
+    return firmware->mem->stats(st);
+}
@@ -0,0 +1,766 @@
+/*
+ * mallocbench.c
+ *
+ * Replay allocation traces through the core heap, on the host, and
+ * report how fast it went, the slowest single call, and how broken up
+ * the heap was left.  malloc.c, free.c and init.c are built in as they
+ * are, so a change to the allocator can be measured before it ships.
+ *
+ * Run with no arguments, it replays three built-in workloads:
+ *
+ *   menu  - a menu session: the config file parsed into many small,
+ *           long-lived strings and entries, with line buffers and
+ *           redraw strings freed as soon as they are used
+ *   http  - a kernel and initrd loaded over HTTP with lwIP: packet
+ *           buffers coming and going a window at a time, and the file
+ *           grown with realloc() as it arrives
+ *   lua   - a Lua script: small objects with short, random lifetimes,
+ *           tables grown by doubling, and collections that free about
+ *           half of what is live
+ *
+ * These are models, from a fixed seed, of what those loads ask of the
+ * heap.  Any other trace can be given as a file, one call per line:
+ *
+ *   m ID SIZE [HEAP]	malloc(SIZE), HEAP 1 for lmalloc()
+ *   r ID SIZE		realloc()
+ *   f ID		free()
+ *
+ * ID is any word that names the block until it is freed, so the
+ * pointers from a DEBUG_MALLOC log serve as they are:
+ *
+ *   awk '/^_malloc\(/ { gsub(/[(),]/, " "); print "m", $NF, $2, $3 }
+ *        /^free\(/    { gsub(/[()]/, " "); print "f", $2 }' serial.log
+ *
+ * The host's arena headers are twice the size of the target's, so the
+ * overhead figures are for comparing one allocator with another, not
+ * for predicting the bytes free on a real machine.
+ */
+
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * The allocator's own malloc(), free() and so on mustn't take the
+ * place of the host's.
+ */
+#define malloc		core_malloc
+#define free		core_free
+#define realloc		core_realloc
+#define zalloc		core_zalloc
+
+void *malloc(size_t);
+void free(void *);
+
+#include <com32.h>
+
+/* Fake data objects, for init.c */
+struct com32_sys_args __com32;
+char __lowmem_heap[32];
+char free_high_memory[32];
+
+/* No threads here */
+struct semaphore {
+    int count;
+};
+#define DECLARE_INIT_SEMAPHORE(sem, cnt) struct semaphore sem = { (cnt) }
+#define sem_down(sem, timeout)	((void)(sem), (void)(timeout))
+#define sem_up(sem)		((void)(sem))
+
+#include "../init.c"
+#include "../malloc.c"
+#include "../free.c"
+
+/* Tracing is never switched on here */
+uint32_t trace_mask;
+
+void __trace(int group, const char *name, const char *str,
+	     uint64_t a, uint64_t b)
+{
+    (void)group;
+    (void)name;
+    (void)str;
+    (void)a;
+    (void)b;
+}
+
+/* The firmware is the BIOS one, as far as the heap goes */
+static struct mem_ops bench_mem_ops = {
+    .malloc = bios_malloc,
+    .realloc = bios_realloc,
+    .free = bios_free,
+};
+
+static struct firmware bench_firmware = {
+    .mem = &bench_mem_ops,
+};
+
+struct firmware *firmware = &bench_firmware;
+
+#undef malloc
+#undef free
+#undef realloc
+#undef zalloc
+
+struct malloc_owner_stats __malloc_owner_stats[NHEAP][MALLOC_OWNERS];
+
+int syslinux_scan_memory(scan_memory_callback_t callback, void *data)
+{
+    (void)callback;
+    (void)data;
+    return 0;
+}
+
+/* Sizes of the heaps; the low one is about what is left below 640K */
+#define MAIN_HEAP_SIZE		(256 << 20)
+#define LOWMEM_HEAP_SIZE	(448 << 10)
+
+static char *heap_base[NHEAP];
+static const size_t heap_size[NHEAP] = {
+    [HEAP_MAIN]		= MAIN_HEAP_SIZE,
+    [HEAP_LOWMEM]	= LOWMEM_HEAP_SIZE,
+};
+
+/* Start from empty heaps, as mem_init() leaves them */
+static void heap_reset(void)
+{
+    struct free_arena_header *fp;
+    int heap;
+
+    __mem_init_heads();
+    memset(__malloc_owner_stats, 0, sizeof __malloc_owner_stats);
+
+    for (heap = 0; heap < NHEAP; heap++) {
+	if (!heap_base[heap]) {
+	    heap_base[heap] = aligned_alloc(4096, heap_size[heap]);
+	    if (!heap_base[heap]) {
+		fprintf(stderr, "mallocbench: no memory for the heaps\n");
+		exit(1);
+	    }
+	    /* Fault it all in now, not while an allocation is timed */
+	    memset(heap_base[heap], 0, heap_size[heap]);
+	}
+
+	fp = (struct free_arena_header *)heap_base[heap];
+	fp->a.attrs = ARENA_TYPE_USED | (heap << ARENA_HEAP_POS);
+#ifdef DEBUG_MALLOC
+	fp->a.magic = ARENA_MAGIC;
+#endif
+	ARENA_SIZE_SET(fp->a.attrs, heap_size[heap]);
+	__inject_free_block(fp);
+    }
+}
+
+/*
+ * Traces
+ */
+enum op_type {
+    OP_MALLOC,
+    OP_REALLOC,
+    OP_FREE,
+    OP_TYPES
+};
+
+struct op {
+    uint8_t type;
+    uint8_t heap;
+    uint32_t id;		/* Slot in the block table */
+    size_t size;
+};
+
+struct trace {
+    const char *name;
+    struct op *ops;
+    size_t nops, maxops;
+    uint32_t nids;		/* Slots used */
+};
+
+static void trace_add(struct trace *t, enum op_type type, uint32_t id,
+		      size_t size, enum heap heap)
+{
+    struct op *op;
+
+    if (t->nops == t->maxops) {
+	t->maxops = t->maxops ? t->maxops * 2 : 4096;
+	t->ops = realloc(t->ops, t->maxops * sizeof *t->ops);
+	if (!t->ops) {
+	    fprintf(stderr, "mallocbench: out of memory\n");
+	    exit(1);
+	}
+    }
+
+    op = &t->ops[t->nops++];
+    op->type = type;
+    op->heap = heap;
+    op->id = id;
+    op->size = size;
+    if (id >= t->nids)
+	t->nids = id + 1;
+}
+
+/*
+ * The workloads hand out block numbers from a free list of their own,
+ * so the table the replay keeps is no bigger than the most blocks
+ * ever live at once.
+ */
+struct ids {
+    uint32_t *free;
+    uint32_t nfree, next;
+};
+
+static uint32_t id_get(struct ids *ids)
+{
+    if (ids->nfree)
+	return ids->free[--ids->nfree];
+    return ids->next++;
+}
+
+static void id_put(struct ids *ids, uint32_t id)
+{
+    ids->free = realloc(ids->free, (ids->nfree + 1) * sizeof *ids->free);
+    ids->free[ids->nfree++] = id;
+}
+
+static uint32_t rnd_state;
+
+static uint32_t rnd(void)
+{
+    rnd_state = rnd_state * 1103515245 + 12345;
+    return rnd_state >> 8;
+}
+
+/* A size between lo and hi, weighted towards lo */
+static size_t rnd_size(size_t lo, size_t hi)
+{
+    size_t span = hi - lo + 1;
+
+    return lo + (rnd() % span) * (rnd() % span) / span;
+}
+
+static uint32_t t_malloc(struct trace *t, struct ids *ids, size_t size,
+			 enum heap heap)
+{
+    uint32_t id = id_get(ids);
+
+    trace_add(t, OP_MALLOC, id, size, heap);
+    return id;
+}
+
+static void t_free(struct trace *t, struct ids *ids, uint32_t id)
+{
+    trace_add(t, OP_FREE, id, 0, HEAP_MAIN);
+    id_put(ids, id);
+}
+
+static void gen_menu(struct trace *t)
+{
+    struct ids ids = { 0 };
+    uint32_t line, tmp;
+    int entry, i;
+
+    /* The config file, and then every entry in it */
+    for (entry = 0; entry < 400; entry++) {
+	for (i = 0; i < 6; i++) {
+	    line = t_malloc(t, &ids, 256, HEAP_MAIN);
+	    t_malloc(t, &ids, rnd_size(8, 96), HEAP_MAIN);
+	    if (i == 5)
+		t_malloc(t, &ids, rnd_size(64, 512), HEAP_MAIN);
+	    t_free(t, &ids, line);
+	}
+	t_malloc(t, &ids, 168, HEAP_MAIN);	/* struct menu_entry */
+    }
+
+    /* Moving around the menu: a string or two for each redraw */
+    for (i = 0; i < 2000; i++) {
+	tmp = t_malloc(t, &ids, rnd_size(16, 160), HEAP_MAIN);
+	if (rnd() & 1) {
+	    line = t_malloc(t, &ids, rnd_size(80, 320), HEAP_MAIN);
+	    t_free(t, &ids, line);
+	}
+	t_free(t, &ids, tmp);
+    }
+
+    /* Booting an entry: a command line in low memory, and its kernel */
+    t_malloc(t, &ids, 4096, HEAP_LOWMEM);
+    tmp = t_malloc(t, &ids, 1 << 20, HEAP_MAIN);
+    for (i = 2; i <= 6; i++)
+	trace_add(t, OP_REALLOC, tmp, (size_t)i << 20, HEAP_MAIN);
+}
+
+static void gen_http(struct trace *t)
+{
+    struct ids ids = { 0 };
+    uint32_t window[16], file, seg;
+    size_t have, want, cap;
+    int f, i, n = 0;
+
+    for (f = 0; f < 2; f++) {
+	want = f ? (24 << 20) : (6 << 20);	/* An initrd and a kernel */
+	cap = 64 << 10;
+	file = t_malloc(t, &ids, cap, HEAP_MAIN);
+
+	for (have = 0; have < want; have += 1460) {
+	    /* A pbuf for each segment, a TCP segment record now and then */
+	    window[n % 16] = t_malloc(t, &ids, 1536, HEAP_MAIN);
+	    if (!(rnd() % 4)) {
+		seg = t_malloc(t, &ids, 40, HEAP_MAIN);
+		t_free(t, &ids, seg);
+	    }
+	    if (++n >= 16)
+		t_free(t, &ids, window[n % 16]);
+
+	    /* The buffer for the file is doubled as it fills */
+	    if (have + 1460 > cap) {
+		cap *= 2;
+		trace_add(t, OP_REALLOC, file, cap, HEAP_MAIN);
+	    }
+	}
+
+	for (i = 0; i < 15; i++)
+	    t_free(t, &ids, window[++n % 16]);
+	n = 0;
+
+	trace_add(t, OP_REALLOC, file, want, HEAP_MAIN);
+    }
+}
+
+static void gen_lua(struct trace *t)
+{
+    struct ids ids = { 0 };
+    uint32_t *live = NULL;
+    size_t *size = NULL;
+    size_t nlive = 0, i, j;
+    int step;
+
+    for (step = 0; step < 200000; step++) {
+	if (!(rnd() % 16) && nlive) {
+	    /* A table growing */
+	    i = rnd() % nlive;
+	    if (size[i] < (64 << 10)) {
+		size[i] *= 2;
+		trace_add(t, OP_REALLOC, live[i], size[i], HEAP_MAIN);
+	    }
+	} else {
+	    /* A string, a closure or an empty table */
+	    live = realloc(live, (nlive + 1) * sizeof *live);
+	    size = realloc(size, (nlive + 1) * sizeof *size);
+	    size[nlive] = rnd_size(16, 128);
+	    live[nlive] = t_malloc(t, &ids, size[nlive], HEAP_MAIN);
+	    nlive++;
+	}
+
+	/* A collection, now and then: about half of it is garbage */
+	if (nlive >= 8192) {
+	    for (i = j = 0; i < nlive; i++) {
+		if (rnd() & 1) {
+		    t_free(t, &ids, live[i]);
+		} else {
+		    live[j] = live[i];
+		    size[j] = size[i];
+		    j++;
+		}
+	    }
+	    nlive = j;
+	}
+    }
+}
+
+static const struct workload {
+    const char *name;
+    void (*gen)(struct trace *);
+} workloads[] = {
+    { "menu", gen_menu },
+    { "http", gen_http },
+    { "lua",  gen_lua },
+};
+
+#define NWORKLOADS (sizeof workloads / sizeof workloads[0])
+
+/*
+ * A trace file, with the IDs in it numbered as they come
+ */
+struct name {
+    char *name;
+    uint32_t id;
+};
+
+static uint32_t name_id(struct name **names, size_t *nnames,
+			uint32_t *nextid, const char *name, bool create)
+{
+    size_t i;
+
+    for (i = *nnames; i--; ) {
+	if (!strcmp((*names)[i].name, name))
+	    return (*names)[i].id;
+    }
+
+    if (!create)
+	return UINT32_MAX;
+
+    *names = realloc(*names, (*nnames + 1) * sizeof **names);
+    (*names)[*nnames].name = strdup(name);
+    (*names)[*nnames].id = (*nextid)++;
+    return (*names)[(*nnames)++].id;
+}
+
+static void name_drop(struct name *names, size_t *nnames, uint32_t id)
+{
+    size_t i;
+
+    for (i = 0; i < *nnames; i++) {
+	if (names[i].id == id) {
+	    free(names[i].name);
+	    names[i] = names[--*nnames];
+	    return;
+	}
+    }
+}
+
+static int load_trace(struct trace *t, const char *file)
+{
+    struct name *names = NULL;
+    size_t nnames = 0;
+    uint32_t nextid = 0, id;
+    char line[256], op, name[128];
+    unsigned long size;
+    unsigned int heap;
+    unsigned int lineno = 0;
+    int n;
+    FILE *f;
+
+    f = fopen(file, "r");
+    if (!f) {
+	perror(file);
+	return -1;
+    }
+
+    t->name = file;
+    while (fgets(line, sizeof line, f)) {
+	lineno++;
+	heap = HEAP_MAIN;
+	n = sscanf(line, " %c %127s %lu %u", &op, name, &size, &heap);
+	if (n < 1 || op == '#')
+	    continue;
+
+	switch (op) {
+	case 'm':
+	    if (n < 3 || heap >= NHEAP)
+		goto bad;
+	    if (name_id(&names, &nnames, &nextid, name, false) != UINT32_MAX)
+		goto bad;
+	    id = name_id(&names, &nnames, &nextid, name, true);
+	    trace_add(t, OP_MALLOC, id, size, heap);
+	    break;
+	case 'r':
+	case 'f':
+	    if (n < (op == 'r' ? 3 : 2))
+		goto bad;
+	    id = name_id(&names, &nnames, &nextid, name, false);
+	    if (id == UINT32_MAX)
+		goto bad;
+	    if (op == 'r') {
+		trace_add(t, OP_REALLOC, id, size, HEAP_MAIN);
+	    } else {
+		trace_add(t, OP_FREE, id, 0, HEAP_MAIN);
+		name_drop(names, &nnames, id);
+	    }
+	    break;
+	default:
+	    goto bad;
+	}
+    }
+
+    fclose(f);
+    return 0;
+
+bad:
+    fprintf(stderr, "%s:%u: bad or unmatched line\n", file, lineno);
+    fclose(f);
+    return -1;
+}
+
+/*
+ * Replaying
+ */
+struct result {
+    size_t ops, failed;
+    double ns;				/* Best of the timed runs */
+    uint64_t worst[OP_TYPES];		/* Slowest call, in ns */
+    size_t peak_live;			/* Bytes asked for, at most */
+    size_t peak_used;			/* Furthest into the main heap */
+    size_t holes, hole_bytes, largest_hole;
+};
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void *do_op(const struct op *op, void **ptr)
+{
+    void *p;
+
+    switch (op->type) {
+    case OP_MALLOC:
+	return ptr[op->id] = bios_malloc(op->size, op->heap, MALLOC_CORE);
+    case OP_REALLOC:
+	p = bios_realloc(ptr[op->id], op->size);
+	if (p)
+	    ptr[op->id] = p;
+	return p;
+    default:
+	if (ptr[op->id])
+	    bios_free(ptr[op->id]);
+	return ptr[op->id] = NULL;
+    }
+}
+
+/*
+ * The free blocks in the main heap, but for the one at the top that
+ * nothing has reached yet: the holes a larger allocation can't use.
+ */
+static void heap_holes(struct result *r)
+{
+    struct free_arena_header *head = &__core_malloc_head[HEAP_MAIN];
+    struct free_arena_header *fp;
+    size_t size;
+
+    for (fp = head->a.next; fp != head; fp = fp->a.next) {
+	if (ARENA_TYPE_GET(fp->a.attrs) != ARENA_TYPE_FREE ||
+	    fp->a.next == head)
+	    continue;
+
+	size = ARENA_SIZE_GET(fp->a.attrs);
+	r->hole_bytes += size;
+	r->holes++;
+	if (size > r->largest_hole)
+	    r->largest_hole = size;
+    }
+}
+
+/* Once everything is freed, each heap should be one free block again */
+static bool heap_whole(void)
+{
+    struct free_arena_header *head, *fp;
+    int heap;
+
+    for (heap = 0; heap < NHEAP; heap++) {
+	head = &__core_malloc_head[heap];
+	fp = head->a.next;
+	if (fp->a.next != head ||
+	    ARENA_TYPE_GET(fp->a.attrs) != ARENA_TYPE_FREE ||
+	    ARENA_SIZE_GET(fp->a.attrs) != heap_size[heap])
+	    return false;
+    }
+
+    return true;
+}
+
+static void free_all(const struct trace *t, void **ptr)
+{
+    uint32_t id;
+
+    for (id = 0; id < t->nids; id++) {
+	if (ptr[id])
+	    bios_free(ptr[id]);
+    }
+}
+
+/*
+ * Replay the trace with each call timed, and return the slowest of each
+ * kind.  The first time, also see what is live and what it leaves.
+ */
+static void timed_run(const struct trace *t, void **ptr, size_t *live,
+		      uint64_t *worst, struct result *r)
+{
+    const struct op *op;
+    uint64_t t0, t1;
+    size_t i, total = 0;
+    char *p, *end;
+
+    memset(ptr, 0, t->nids * sizeof *ptr);
+    heap_reset();
+
+    for (i = 0, op = t->ops; i < t->nops; i++, op++) {
+	t0 = now_ns();
+	p = do_op(op, ptr);
+	t1 = now_ns();
+
+	if (t1 - t0 > worst[op->type])
+	    worst[op->type] = t1 - t0;
+
+	if (!r)
+	    continue;
+
+	if (op->type == OP_FREE || p) {
+	    total -= live[op->id];
+	    live[op->id] = 0;
+	}
+	if (op->type != OP_FREE) {
+	    if (!p) {
+		r->failed++;
+		continue;
+	    }
+	    live[op->id] = op->size;
+	    total += op->size;
+	    if (total > r->peak_live)
+		r->peak_live = total;
+
+	    end = p + op->size;
+	    if (op->heap == HEAP_MAIN &&
+		(size_t)(end - heap_base[HEAP_MAIN]) > r->peak_used)
+		r->peak_used = end - heap_base[HEAP_MAIN];
+	}
+    }
+
+    if (r)
+	heap_holes(r);
+}
+
+static int replay(const struct trace *t, int runs, struct result *r)
+{
+    uint64_t worst[OP_TYPES], t0, t1;
+    const struct op *op;
+    void **ptr;
+    size_t *live;
+    size_t i;
+    int run, k;
+
+    memset(r, 0, sizeof *r);
+    r->ops = t->nops;
+    ptr = calloc(t->nids, sizeof *ptr);
+    live = calloc(t->nids, sizeof *live);
+    if (t->nids && (!ptr || !live)) {
+	fprintf(stderr, "mallocbench: out of memory\n");
+	exit(1);
+    }
+
+    /*
+     * The worst case is the slowest call of the run where it was least
+     * slow: anything the host does to us now and then, like a timer
+     * interrupt, is unlikely to land on the same call every time.
+     */
+    for (run = 0; run < runs; run++) {
+	memset(worst, 0, sizeof worst);
+	timed_run(t, ptr, live, worst, run ? NULL : r);
+	for (k = 0; k < OP_TYPES; k++) {
+	    if (!run || worst[k] < r->worst[k])
+		r->worst[k] = worst[k];
+	}
+
+	free_all(t, ptr);
+	if (!heap_whole()) {
+	    fprintf(stderr, "%s: heap not whole again after freeing it all\n",
+		    t->name);
+	    return -1;
+	}
+    }
+
+    /* Then for throughput alone */
+    for (run = 0; run < runs; run++) {
+	memset(ptr, 0, t->nids * sizeof *ptr);
+	heap_reset();
+
+	t0 = now_ns();
+	for (i = 0, op = t->ops; i < t->nops; i++, op++)
+	    do_op(op, ptr);
+	t1 = now_ns();
+
+	if (!run || t1 - t0 < r->ns)
+	    r->ns = t1 - t0;
+	free_all(t, ptr);
+    }
+
+    free(ptr);
+    free(live);
+    return 0;
+}
+
+static void report(const struct trace *t, const struct result *r)
+{
+    printf("%-8s %8zu %7.2f %8llu %8llu %8llu %8zu %8zu %6zu %7zu %4.0f%%",
+	   t->name, r->ops, r->ns ? r->ops / (r->ns / 1000.0) : 0.0,
+	   (unsigned long long)r->worst[OP_MALLOC],
+	   (unsigned long long)r->worst[OP_REALLOC],
+	   (unsigned long long)r->worst[OP_FREE],
+	   r->peak_live >> 10, r->peak_used >> 10,
+	   r->holes, r->hole_bytes >> 10,
+	   r->hole_bytes ? 100.0 - 100.0 * r->largest_hole / r->hole_bytes
+			 : 0.0);
+    if (r->failed)
+	printf("  %zu FAILED", r->failed);
+    putchar('\n');
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mallocbench [-n runs] [trace...]\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    struct trace t;
+    struct result r;
+    int runs = 5, err = 0;
+    unsigned int i;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+	switch (opt) {
+	case 'n':
+	    runs = atoi(optarg);
+	    if (runs < 1)
+		usage();
+	    break;
+	default:
+	    usage();
+	}
+    }
+
+    /*
+     * worst: the slowest malloc(), realloc() and free(), in ns
+     * live, used: the most bytes allocated at once, and the most of
+     *   the heap that was needed for them, in K
+     * holes: the free blocks left below the top of what was used, at
+     *   the end of the trace; frag is how much of that free space is
+     *   not in the largest of them
+     */
+    printf("%-8s %8s %7s %8s %8s %8s %8s %8s %6s %7s %5s\n",
+	   "trace", "ops", "Mops/s", "malloc", "realloc", "free",
+	   "live K", "used K", "holes", "holes K", "frag");
+
+    if (optind == argc) {
+	for (i = 0; i < NWORKLOADS; i++) {
+	    memset(&t, 0, sizeof t);
+	    t.name = workloads[i].name;
+	    rnd_state = 1;
+	    workloads[i].gen(&t);
+	    if (replay(&t, runs, &r))
+		err = 1;
+	    else
+		report(&t, &r);
+	    free(t.ops);
+	}
+    }
+
+    for (; optind < argc; optind++) {
+	memset(&t, 0, sizeof t);
+	if (load_trace(&t, argv[optind]) || replay(&t, runs, &r))
+	    err = 1;
+	else
+	    report(&t, &r);
+	free(t.ops);
+    }
+
+    return err;
+}
@@ -0,0 +1,179 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Permission is hereby granted, free of charge, to any person
+ *   obtaining a copy of this software and associated documentation
+ *   files (the "Software"), to deal in the Software without
+ *   restriction, including without limitation the rights to use,
+ *   copy, modify, merge, publish, distribute, sublicense, and/or
+ *   sell copies of the Software, and to permit persons to whom
+ *   the Software is furnished to do so, subject to the following
+ *   conditions:
+ *
+ *   The above copyright notice and this permission notice shall
+ *   be included in all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *   OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *   HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *   OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * mtrr.c
+ *
+ * Map the linear framebuffer write-combining.  The BIOS normally leaves
+ * it uncached, and then every pixel written is a separate bus cycle.
+ *
+ * We run without paging, so the PAT doesn't apply and a variable MTRR
+ * is the only way to do this.  We only take one if it is free, the
+ * range can be described exactly by one and no other variable MTRR
+ * touches it (the result of WC overlapping anything but UC is
+ * undefined, and overlapping UC makes it pointless).  The MTRR is
+ * given back before the OS is started, so it sees what the BIOS set up.
+ */
+
+#include <stdbool.h>
+#include <core.h>
+#include <cpufeature.h>
+#include <sys/cpu.h>
+
+#define MSR_MTRRCAP		0x0fe
+#define MSR_MTRR_DEF_TYPE	0x2ff
+#define MSR_MTRR_PHYSBASE(n)	(0x200 + 2*(n))
+#define MSR_MTRR_PHYSMASK(n)	(0x201 + 2*(n))
+
+#define MTRRCAP_VCNT		0x0ff
+#define MTRRCAP_WC		0x400
+#define MTRR_DEF_TYPE_E		0x800
+#define MTRR_PHYSMASK_V		0x800
+#define MTRR_TYPE_WC		1
+
+#define CR0_NW			0x20000000
+#define CR0_CD			0x40000000
+
+static int wc_mtrr = -1;	/* The MTRR we took, or -1 */
+static uint64_t wc_old_base, wc_old_mask;
+
+static inline uint32_t get_cr0(void)
+{
+    uint32_t v;
+    asm volatile("movl %%cr0,%0" : "=r" (v));
+    return v;
+}
+
+static inline void set_cr0(uint32_t v)
+{
+    asm volatile("movl %0,%%cr0" : : "r" (v));
+}
+
+/* The physical address bits an MTRR mask has to cover */
+static uint64_t mtrr_addr_mask(void)
+{
+    unsigned int bits = 36;
+
+    if (cpuid_eax(0x80000000) >= 0x80000008)
+	bits = cpuid_eax(0x80000008) & 0xff;
+
+    return ((1ULL << bits) - 1) & ~0xfffULL;
+}
+
+/* The procedure from the Intel SDM, section "MTRR Considerations in MP Systems" */
+static void mtrr_write(int n, uint64_t base, uint64_t mask)
+{
+    irq_state_t irq;
+    uint64_t deftype;
+    uint32_t cr0;
+
+    irq = irq_save();
+    cr0 = get_cr0();
+    set_cr0((cr0 | CR0_CD) & ~CR0_NW);
+    asm volatile("wbinvd" : : : "memory");
+
+    deftype = rdmsr(MSR_MTRR_DEF_TYPE);
+    wrmsr(deftype & ~MTRR_DEF_TYPE_E, MSR_MTRR_DEF_TYPE);
+    wrmsr(base, MSR_MTRR_PHYSBASE(n));
+    wrmsr(mask, MSR_MTRR_PHYSMASK(n));
+
+    asm volatile("wbinvd" : : : "memory");
+    wrmsr(deftype, MSR_MTRR_DEF_TYPE);
+    set_cr0(cr0);
+    irq_restore(irq);
+}
+
+/*
+ * Make the framebuffer at "base", of which "used" bytes are displayed,
+ * write-combining.  "vram" is how much memory the card has behind it;
+ * we round up to a power of two, but never past that.
+ */
+void mtrr_set_wc(uint32_t base, uint32_t used, uint32_t vram)
+{
+    uint64_t addr_mask, mask, mbase, mmask;
+    uint32_t size;
+    unsigned int i, vcnt;
+    int spare = -1;
+
+    mtrr_cleanup();
+
+    if (!cpu_has_eflag(EFLAGS_ID) || cpuid_eax(0) < 1 ||
+	!(cpuid_edx(1) & (1 << X86_FEATURE_MTRR)))
+	return;
+
+    if (!(rdmsr(MSR_MTRRCAP) & MTRRCAP_WC) ||
+	!(rdmsr(MSR_MTRR_DEF_TYPE) & MTRR_DEF_TYPE_E))
+	return;
+
+    if (!used || used > 0x80000000)
+	return;
+
+    size = 1U << (31 - __builtin_clz(used));
+    if (size < used)
+	size <<= 1;
+
+    /* An MTRR range must be naturally aligned */
+    if (size < 4096 || size > vram || (base & (size - 1)))
+	return;
+
+    addr_mask = mtrr_addr_mask();
+    mask = ~(uint64_t)(size - 1) & addr_mask;
+
+    vcnt = rdmsr(MSR_MTRRCAP) & MTRRCAP_VCNT;
+    for (i = 0; i < vcnt; i++) {
+	mbase = rdmsr(MSR_MTRR_PHYSBASE(i));
+	mmask = rdmsr(MSR_MTRR_PHYSMASK(i));
+
+	if (!(mmask & MTRR_PHYSMASK_V)) {
+	    if (spare < 0)
+		spare = i;
+	    continue;
+	}
+
+	/* Two aligned power-of-two ranges overlap iff they agree on
+	   the address bits both of them look at */
+	if (!((mbase ^ base) & mmask & mask & addr_mask))
+	    return;
+    }
+
+    if (spare < 0)
+	return;
+
+    wc_mtrr = spare;
+    wc_old_base = rdmsr(MSR_MTRR_PHYSBASE(spare));
+    wc_old_mask = rdmsr(MSR_MTRR_PHYSMASK(spare));
+
+    mtrr_write(spare, base | MTRR_TYPE_WC, mask | MTRR_PHYSMASK_V);
+}
+
+/* Give back the MTRR we took, if any */
+void mtrr_cleanup(void)
+{
+    if (wc_mtrr < 0)
+	return;
+
+    mtrr_write(wc_mtrr, wc_old_base, wc_old_mask);
+    wc_mtrr = -1;
+}
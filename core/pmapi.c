@@ -16,6 +16,7 @@
 #include <syslinux/pmapi.h>
 #include "core.h"
 #include "fs.h"
+#include "pmapi.h"
 
 const struct com32_pmapi pm_api_vector =
 {
@@ -43,4 +44,10 @@ const struct com32_pmapi pm_api_vector =
 
     .sysappend_count	= SYSAPPEND_MAX,
     .sysappend_strings	= sysappend_strings,
+
+    .cache_stats	= pmapi_cache_stats,
+    .net_stats		= pmapi_net_stats,
+    .mem_stats		= pmapi_mem_stats,
+    .net_handoff	= pmapi_net_handoff,
+    .disk_probe		= pmapi_disk_probe,
 };
@@ -0,0 +1,69 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Permission is hereby granted, free of charge, to any person
+ *   obtaining a copy of this software and associated documentation
+ *   files (the "Software"), to deal in the Software without
+ *   restriction, including without limitation the rights to use,
+ *   copy, modify, merge, publish, distribute, sublicense, and/or
+ *   sell copies of the Software, and to permit persons to whom
+ *   the Software is furnished to do so, subject to the following
+ *   conditions:
+ *
+ *   The above copyright notice and this permission notice shall
+ *   be included in all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *   OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *   HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *   OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * probecache.c
+ *
+ * Firmware probe results shared between modules.
+ * See <syslinux/probecache.h>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <klibc/compiler.h>
+#include <syslinux/probecache.h>
+
+static struct {
+    void *data;
+    size_t len;
+} probe_cache[PROBE_CACHE_KEYS];
+
+__export const void *probe_cache_get(enum probe_cache_key key, size_t *len)
+{
+    if (key >= PROBE_CACHE_KEYS || !probe_cache[key].data)
+	return NULL;
+
+    *len = probe_cache[key].len;
+    return probe_cache[key].data;
+}
+
+__export int probe_cache_put(enum probe_cache_key key, const void *data,
+			     size_t len)
+{
+    void *p;
+
+    if (key >= PROBE_CACHE_KEYS)
+	return -1;
+
+    p = malloc(len ? len : 1);
+    if (!p)
+	return -1;
+    memcpy(p, data, len);
+
+    free(probe_cache[key].data);
+    probe_cache[key].data = p;
+    probe_cache[key].len = len;
+    return 0;
+}
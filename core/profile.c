@@ -0,0 +1,157 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Permission is hereby granted, free of charge, to any person
+ *   obtaining a copy of this software and associated documentation
+ *   files (the "Software"), to deal in the Software without
+ *   restriction, including without limitation the rights to use,
+ *   copy, modify, merge, publish, distribute, sublicense, and/or
+ *   sell copies of the Software, and to permit persons to whom
+ *   the Software is furnished to do so, subject to the following
+ *   conditions:
+ *
+ *   The above copyright notice and this permission notice shall
+ *   be included in all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *   OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *   HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *   OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * profile.c
+ *
+ * The timer-tick sampling profiler.  See <syslinux/profile.h>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <core.h>
+#include <timer.h>
+#include <sys/module.h>
+#include <syslinux/profile.h>
+
+#define PROFILE_PROBES	8	/* Slots tried before a sample is dropped */
+
+static struct profile profile;
+static uint32_t profile_shift;	/* 32 - log2(profile.size) */
+static jiffies_t profile_jiffies; /* At the start */
+static uint32_t profile_last;	/* Context of the last sample */
+
+/* Which of contexts[] the module m is, adding it if it is new */
+static uint32_t profile_context(const struct elf_module *m)
+{
+    const char *name = m ? m->name : "(core)";
+    const char *p = strrchr(name, '/');
+    uint32_t i;
+
+    if (p)
+	name = p + 1;
+
+    if (!strncmp(profile.contexts[profile_last], name, PROFILE_NAME - 1))
+	return profile_last;
+
+    for (i = 0; i < profile.ncontexts; i++) {
+	if (!strncmp(profile.contexts[i], name, PROFILE_NAME - 1))
+	    return profile_last = i;
+    }
+
+    if (i == PROFILE_CONTEXTS)
+	return profile_last = i - 1;
+    if (i == PROFILE_CONTEXTS - 1)
+	name = "(others)";
+
+    strlcpy(profile.contexts[i], name, PROFILE_NAME);
+    profile.ncontexts++;
+    return profile_last = i;
+}
+
+/* core_tick_hook, so in the interrupt */
+static void profile_tick(uint32_t eip)
+{
+    struct profile_bucket *b;
+    uint32_t context, h, i;
+
+    profile.samples++;
+    context = profile_context(__syslinux_current);
+
+    h = ((eip ^ context) * 0x9e3779b1) >> profile_shift;
+    for (i = 0; i < PROFILE_PROBES; i++) {
+	b = &profile.buckets[(h + i) & (profile.size - 1)];
+	if (!b->count) {
+	    b->eip = eip;
+	    b->context = context;
+	}
+	if (b->eip == eip && b->context == context) {
+	    b->count++;
+	    return;
+	}
+    }
+
+    profile.dropped++;
+}
+
+__export void profile_stop(void)
+{
+#ifdef __FIRMWARE_BIOS__
+    if (!profile.running)
+	return;
+
+    core_tick_hook = (void (*)(uint32_t))core_pm_null_hook;
+    profile.ticks = jiffies() - profile_jiffies;
+    profile.running = 0;
+#endif
+}
+
+__export int profile_start(uint32_t slots)
+{
+#ifdef __FIRMWARE_BIOS__
+    struct profile_bucket *buckets;
+    uint32_t size = 64;
+
+    profile_stop();
+
+    while (size < slots && size < (1 << 24))
+	size <<= 1;
+
+    free(profile.buckets);
+    profile.buckets = NULL;
+    profile.size = 0;
+
+    buckets = calloc(size, sizeof *buckets);
+    if (!buckets)
+	return -1;
+
+    memset(&profile, 0, sizeof profile);
+    strcpy(profile.contexts[0], "(core)");
+    profile.ncontexts = 1;
+    profile.buckets = buckets;
+    profile.size = size;
+    profile_shift = 32 - __builtin_ctz(size);
+    profile_last = 0;
+
+    profile_jiffies = jiffies();
+    profile.running = 1;
+    core_tick_hook = profile_tick;
+    return 0;
+#else
+    (void)slots;
+    (void)profile_tick;
+    return -1;
+#endif
+}
+
+__export const struct profile *profile_get(void)
+{
+    if (!profile.size)
+	return NULL;
+
+    if (profile.running)
+	profile.ticks = jiffies() - profile_jiffies;
+    return &profile;
+}
@@ -0,0 +1,303 @@
+/*
+ * smp.c
+ *
+ * The application processors, and the job queue they work from.
+ * See <syslinux/smp.h>.
+ *
+ * The APs are woken by INIT, SIPI, SIPI broadcast to all but ourselves,
+ * as they are left by the BIOS; there is no MP or MADT table to go by
+ * here.  Those that check in spin on the queue with interrupts off, and
+ * smp_park() sends them another INIT, so the OS finds them as the BIOS
+ * left them.  EFI firmware keeps the APs to itself, so there only the
+ * queue is here, worked by the boot CPU.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <core.h>
+#include <cpufeature.h>
+#include <sys/cpu.h>
+#include <syslinux/clock.h>
+#include <syslinux/smp.h>
+
+#define SMP_MAX_APS	63		/* Any more stay halted */
+#define SMP_STACK_SIZE	8192
+
+static struct smp_job * volatile smp_queue;
+static struct smp_job * volatile *smp_queue_tail = &smp_queue;
+static volatile int smp_queue_lock;
+static int smp_nr_aps;			/* Taking jobs */
+
+static inline int xchg(volatile int *p, int v)
+{
+    asm volatile("xchgl %0,%1" : "+r" (v), "+m" (*p) : : "memory");
+    return v;
+}
+
+static inline void atomic_inc(volatile int *p)
+{
+    asm volatile("lock; incl %0" : "+m" (*p) : : "memory");
+}
+
+static irq_state_t smp_lock(void)
+{
+    irq_state_t irq = irq_save();
+
+    while (xchg(&smp_queue_lock, 1)) {
+	while (smp_queue_lock)
+	    cpu_relax();
+    }
+
+    return irq;
+}
+
+static void smp_unlock(irq_state_t irq)
+{
+    xchg(&smp_queue_lock, 0);
+    irq_restore(irq);
+}
+
+static struct smp_job *smp_take(void)
+{
+    struct smp_job *job;
+    irq_state_t irq;
+
+    if (!smp_queue)
+	return NULL;
+
+    irq = smp_lock();
+    job = smp_queue;
+    if (job) {
+	smp_queue = job->next;
+	if (!smp_queue)
+	    smp_queue_tail = &smp_queue;
+    }
+    smp_unlock(irq);
+
+    return job;
+}
+
+static void smp_run(struct smp_job *job)
+{
+    job->func(job->arg);
+    asm volatile("" : : : "memory");
+    job->done = 1;
+}
+
+__export void smp_submit(struct smp_job *job)
+{
+    irq_state_t irq;
+
+    job->done = 0;
+    job->next = NULL;
+
+    irq = smp_lock();
+    *smp_queue_tail = job;
+    smp_queue_tail = &job->next;
+    smp_unlock(irq);
+}
+
+__export void smp_wait(struct smp_job *job)
+{
+    struct smp_job *other;
+
+    while (!job->done) {
+	if ((other = smp_take()))
+	    smp_run(other);
+	else
+	    cpu_relax();
+    }
+}
+
+__export void smp_run_jobs(struct smp_job *jobs, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+	smp_submit(&jobs[i]);
+    for (i = 0; i < n; i++)
+	smp_wait(&jobs[i]);
+}
+
+__export int smp_cpus(void)
+{
+    return 1 + smp_nr_aps;
+}
+
+#ifdef __FIRMWARE_BIOS__
+
+#define MSR_APIC_BASE		0x1b
+#define APIC_BASE_BSP		(1 << 8)
+#define APIC_BASE_EXTD		(1 << 10)	/* x2APIC mode */
+#define APIC_BASE_ENABLE	(1 << 11)
+
+#define APIC_ICR_LOW		(0x300 >> 2)
+#define APIC_ICR_HIGH		(0x310 >> 2)
+#define ICR_INIT		0x00000500
+#define ICR_SIPI		0x00000600
+#define ICR_PENDING		0x00001000
+#define ICR_ASSERT		0x00004000
+#define ICR_ALL_BUT_SELF	0x000c0000
+
+extern char smp_trampoline[], smp_trampoline_end[];
+extern char smp_trampoline_gdt[], smp_trampoline_gdt_desc[];
+
+/* For smp_asm.S */
+volatile int smp_ap_count;		/* APs that have started */
+int smp_ap_max;				/* Of them, how many have a stack */
+uint32_t smp_ap_esp[SMP_MAX_APS];
+void smp_ap_main(int cpu);
+
+static volatile uint32_t *smp_apic;
+static volatile bool smp_parking;
+static volatile int smp_parked;
+static void *smp_stacks, *smp_low;
+
+static void smp_udelay(uint32_t us)
+{
+    nstime_t end = clock_ns() + us * 1000ULL;
+
+    while (clock_ns() < end)
+	cpu_relax();
+}
+
+static void smp_ipi(uint32_t icr)
+{
+    smp_apic[APIC_ICR_HIGH] = 0;
+    smp_apic[APIC_ICR_LOW] = icr;
+    while (smp_apic[APIC_ICR_LOW] & ICR_PENDING)
+	cpu_relax();
+}
+
+void smp_ap_main(int cpu)
+{
+    struct smp_job *job;
+
+    (void)cpu;
+
+    for (;;) {
+	if ((job = smp_take())) {
+	    smp_run(job);
+	} else if (smp_parking) {
+	    atomic_inc(&smp_parked);
+	    for (;;)
+		asm volatile("cli; hlt");
+	} else {
+	    cpu_relax();
+	}
+    }
+}
+
+__export int smp_start(void)
+{
+    uint64_t base;
+    size_t len = smp_trampoline_end - smp_trampoline;
+    char *page;
+    int i;
+
+    if (smp_apic)
+	return smp_cpus();
+
+    if (!cpu_has_eflag(EFLAGS_ID) ||
+	(cpuid_edx(1) & ((1 << (X86_FEATURE_APIC & 31)) |
+			 (1 << (X86_FEATURE_MSR & 31)))) !=
+	((1 << (X86_FEATURE_APIC & 31)) | (1 << (X86_FEATURE_MSR & 31))))
+	return smp_cpus();
+
+    /*
+     * In x2APIC mode the MMIO window is dead, and the ICR is an MSR;
+     * leave such machines to run on one CPU.
+     */
+    base = rdmsr(MSR_APIC_BASE);
+    if (!(base & APIC_BASE_ENABLE) || !(base & APIC_BASE_BSP) ||
+	(base & APIC_BASE_EXTD) || (base >> 32))
+	return smp_cpus();
+
+    /* The SIPI vector is a page number, so the page must be below 1 MB */
+    smp_low = lmalloc(2 * 4096);
+    smp_stacks = malloc(SMP_MAX_APS * SMP_STACK_SIZE);
+    if (!smp_low || !smp_stacks)
+	goto fail;
+
+    page = (char *)(((uintptr_t)smp_low + 4095) & ~4095);
+    memcpy(page, smp_trampoline, len);
+    *(uint32_t *)(page + (smp_trampoline_gdt_desc - smp_trampoline) + 2) =
+	(uintptr_t)page + (smp_trampoline_gdt - smp_trampoline);
+
+    for (i = 0; i < SMP_MAX_APS; i++)
+	smp_ap_esp[i] = (uintptr_t)smp_stacks + (i + 1) * SMP_STACK_SIZE;
+    smp_ap_count = 0;
+    smp_ap_max = SMP_MAX_APS;
+    smp_parking = false;
+    smp_parked = 0;
+
+    smp_apic = (volatile uint32_t *)(uintptr_t)(base & ~0xfffULL);
+
+    /* The universal startup algorithm, as in the MP specification */
+    smp_ipi(ICR_ALL_BUT_SELF | ICR_ASSERT | ICR_INIT);
+    smp_udelay(10000);
+    for (i = 0; i < 2; i++) {
+	smp_ipi(ICR_ALL_BUT_SELF | ICR_ASSERT | ICR_SIPI |
+		((uintptr_t)page >> 12));
+	smp_udelay(200);
+    }
+
+    /* Give them time to check in; a straggler still joins later */
+    smp_udelay(10000);
+    smp_nr_aps = smp_ap_count < SMP_MAX_APS ? smp_ap_count : SMP_MAX_APS;
+    dprintf("smp: %d APs started\n", smp_nr_aps);
+
+    return smp_cpus();
+
+fail:
+    free(smp_low);
+    free(smp_stacks);
+    smp_low = smp_stacks = NULL;
+    return smp_cpus();
+}
+
+__export void smp_park(void)
+{
+    struct smp_job *job;
+    nstime_t end;
+    int n;
+
+    if (!smp_apic)
+	return;
+
+    /* What is queued gets done first; the APs finish what they hold */
+    while ((job = smp_take()))
+	smp_run(job);
+
+    /* Those without a stack halted as they came in */
+    smp_parking = true;
+    n = smp_ap_count < SMP_MAX_APS ? smp_ap_count : SMP_MAX_APS;
+    end = clock_ns() + 100000000ULL;
+    while (smp_parked < n && clock_ns() < end)
+	cpu_relax();
+
+    /* Back to waiting for a SIPI, as the BIOS left them */
+    smp_ipi(ICR_ALL_BUT_SELF | ICR_ASSERT | ICR_INIT);
+    smp_udelay(10000);
+
+    dprintf("smp: %d of %d APs parked\n", smp_parked, n);
+
+    smp_apic = NULL;
+    smp_nr_aps = 0;
+    free(smp_low);
+    free(smp_stacks);
+    smp_low = smp_stacks = NULL;
+}
+
+#else
+
+__export int smp_start(void)
+{
+    return smp_cpus();
+}
+
+__export void smp_park(void)
+{
+}
+
+#endif /* __FIRMWARE_BIOS__ */
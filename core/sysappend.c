@@ -10,6 +10,7 @@
  *
  * ----------------------------------------------------------------------- */
 
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdbool.h>
@@ -50,24 +51,85 @@ static char *copy_and_mangle(char *dst, const char *src)
 }
  
 /*
- * Handle sysappend strings.
- *
- * Writes the output to 'buf' with a space after each option.
+ * The strings, mangled and joined for the current SysAppends mask.
+ * They hardly ever change once the network is up, so the line is
+ * built once and then reused until sysappend_set() or a new mask
+ * says otherwise.
  */
-__export void do_sysappend(char *buf)
+static char *sysappend_buf;
+static size_t sysappend_buf_size, sysappend_len;
+static uint32_t sysappend_mask;
+static bool sysappend_stale = true;
+
+/*
+ * Set (or, with NULL, clear) one of the strings.  Also to be called
+ * when a string that is already set has changed in place.
+ */
+void sysappend_set(enum syslinux_sysappend type, const char *str)
 {
-    char *q = buf;
+    sysappend_strings[type] = str;
+    sysappend_stale = true;
+}
+
+/*
+ * The sysappend strings selected by SysAppends, separated by spaces;
+ * *len is set to the length.  Returns "" if there are none.
+ */
+__export const char *sysappend_line(size_t *len)
+{
+    size_t need = 1;
+    uint32_t mask;
+    char *q;
     int i;
-    uint32_t mask = SysAppends;
 
-    for (i = 0; i < SYSAPPEND_MAX; i++) {
+    if (!sysappend_stale && sysappend_mask == SysAppends && sysappend_buf)
+	goto done;
+
+    for (i = 0, mask = SysAppends; i < SYSAPPEND_MAX; i++, mask >>= 1) {
+	if ((mask & 1) && sysappend_strings[i])
+	    need += strlen(sysappend_strings[i]) + 1;
+    }
+
+    if (need > sysappend_buf_size) {
+	q = realloc(sysappend_buf, need);
+	if (!q) {
+	    *len = 0;
+	    return "";
+	}
+	sysappend_buf = q;
+	sysappend_buf_size = need;
+    }
+
+    q = sysappend_buf;
+    for (i = 0, mask = SysAppends; i < SYSAPPEND_MAX; i++, mask >>= 1) {
 	if ((mask & 1) && sysappend_strings[i]) {
+	    if (q != sysappend_buf)
+		*q++ = ' ';
 	    q = copy_and_mangle(q, sysappend_strings[i]);
-	    *q++ = ' ';
 	}
-	mask >>= 1;
     }
-    *--q = '\0';
+    *q = '\0';
+
+    sysappend_len = q - sysappend_buf;
+    sysappend_mask = SysAppends;
+    sysappend_stale = false;
+
+done:
+    *len = sysappend_len;
+    return sysappend_buf;
+}
+
+/*
+ * Handle sysappend strings.
+ *
+ * Writes the output to 'buf', which must have room for it.
+ */
+__export void do_sysappend(char *buf)
+{
+    size_t len;
+    const char *line = sysappend_line(&len);
+
+    memcpy(buf, line, len + 1);
 }
 
 /*
@@ -104,7 +166,7 @@ void sysappend_set_uuid(const uint8_t *src)
     /* Remove last dash and zero-terminate */
     *--dst = '\0';
     
-    sysappend_strings[SYSAPPEND_SYSUUID] = sysuuid_str;
+    sysappend_set(SYSAPPEND_SYSUUID, sysuuid_str);
 }
 
 void sysappend_set_fs_uuid(void)
@@ -120,7 +182,7 @@ void sysappend_set_fs_uuid(void)
     fsuuid_str[sizeof(fsuuid_str) - 1] = '\0';
     free(uuid);
 
-    sysappend_strings[SYSAPPEND_FSUUID] = fsuuid_str;
+    sysappend_set(SYSAPPEND_FSUUID, fsuuid_str);
 }
 
 /*
@@ -13,6 +13,7 @@ __noreturn __exit_thread(void)
     /* Remove from the linked list */
     curr->list.prev->next = curr->list.next;
     curr->list.next->prev = curr->list.prev;
+    __thread_unrunnable(curr);
 
     /* Free allocated stacks (note: free(NULL) is permitted and safe). */
     free(curr->stack);
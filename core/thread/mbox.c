@@ -61,3 +61,60 @@ mstime_t mbox_fetch(struct mailbox *mbox, void **msg, mstime_t timeout)
     sem_up(&mbox->prod_sem);
     return t;
 }
+
+/*
+ * Post up to n messages, waiting (up to timeout) only for room for the
+ * first: the others go in if there is room for them right now.  The
+ * slots and the head are taken once for the lot.  Returns the number
+ * of messages posted, 0 if none.
+ */
+int mbox_post_many(struct mailbox *mbox, void **msgs, int n, mstime_t timeout)
+{
+    int i;
+
+    if (!mbox_is_valid(mbox) || n <= 0)
+	return 0;
+    if (sem_down(&mbox->prod_sem, timeout) == (mstime_t)-1)
+	return 0;
+    n = 1 + sem_trydown_many(&mbox->prod_sem, n - 1);
+    sem_down(&mbox->head_sem, 0);
+
+    for (i = 0; i < n; i++) {
+	*mbox->head = msgs[i];
+	mbox->head++;
+	if (mbox->head == mbox->wrap)
+	    mbox->head = &mbox->data[0];
+    }
+
+    sem_up(&mbox->head_sem);
+    sem_up_many(&mbox->cons_sem, n);
+    return n;
+}
+
+/*
+ * Fetch up to max messages, waiting (up to timeout) only for the
+ * first.  Returns the number of messages fetched, 0 if none.
+ */
+int mbox_fetch_many(struct mailbox *mbox, void **msgs, int max,
+		    mstime_t timeout)
+{
+    int i, n;
+
+    if (!mbox || max <= 0)
+	return 0;
+    if (sem_down(&mbox->cons_sem, timeout) == (mstime_t)-1)
+	return 0;
+    n = 1 + sem_trydown_many(&mbox->cons_sem, max - 1);
+    sem_down(&mbox->tail_sem, 0);
+
+    for (i = 0; i < n; i++) {
+	msgs[i] = *mbox->tail;
+	mbox->tail++;
+	if (mbox->tail == mbox->wrap)
+	    mbox->tail = &mbox->data[0];
+    }
+
+    sem_up(&mbox->tail_sem);
+    sem_up_many(&mbox->prod_sem, n);
+    return n;
+}
@@ -4,8 +4,13 @@ struct thread __root_thread = {
     .thread_magic = THREAD_MAGIC,
     .name = "root",
     .list = { .next = &__root_thread.list, .prev = &__root_thread.list },
+    .rq = { .next = &__run_queue, .prev = &__run_queue },
     .blocked = NULL,
     .prio = 0,
 };
 
+struct thread_list __run_queue = {
+    .next = &__root_thread.rq, .prev = &__root_thread.rq
+};
+
 struct thread *__current = &__root_thread;
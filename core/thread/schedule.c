@@ -1,5 +1,6 @@
 #include <klibc/compiler.h>
 #include <sys/cpu.h>
+#include <syslinux/trace.h>
 #include "thread.h"
 #include "core.h"
 #include <dprintf.h>
@@ -10,6 +11,41 @@
 
 void (*sched_hook_func)(void);
 
+/*
+ * Put a thread on the run queue, behind any others of its priority.
+ * Interrupts must be off.
+ */
+void __thread_runnable(struct thread *t)
+{
+    struct thread_list *l;
+
+    if (t->rq.next)
+	return;			/* Already there */
+
+    for (l = __run_queue.prev; l != &__run_queue; l = l->prev) {
+	if (container_of(l, struct thread, rq)->prio <= t->prio)
+	    break;
+    }
+
+    t->rq.prev = l;
+    t->rq.next = l->next;
+    l->next->prev = &t->rq;
+    l->next = &t->rq;
+}
+
+/*
+ * Take a thread off the run queue, if it's on it.  Interrupts must be off.
+ */
+void __thread_unrunnable(struct thread *t)
+{
+    if (!t->rq.next)
+	return;
+
+    t->rq.prev->next = t->rq.next;
+    t->rq.next->prev = t->rq.prev;
+    t->rq.next = t->rq.prev = NULL;
+}
+
 /*
  * __schedule() should only be called with interrupts locked out!
  */
@@ -17,7 +53,7 @@ void __schedule(void)
 {
     static bool in_sched_hook;
     struct thread *curr = current();
-    struct thread *st, *nt, *best;
+    struct thread *nt, *best;
 
 #if DEBUG
     if (__unlikely(irq_state() & 0x200)) {
@@ -45,39 +81,34 @@ void __schedule(void)
     }
 
     /*
-     * The unusual form of this walk is because we have to start with
-     * the thread *following* curr, and curr may not actually be part
-     * of the list anymore (in the case of __exit_thread).
+     * The best thread is first on the run queue.  If we are one of the
+     * runnable threads of that priority, take turns with the others:
+     * the next one is the one queued behind us, if any.  Note that curr
+     * may have exited already (see __exit_thread), in which case it is
+     * no longer queued.
      */
-    best = NULL;
-    nt = st = container_of(curr->list.next, struct thread, list);
-    do {
-	if (__unlikely(nt->thread_magic != THREAD_MAGIC)) {
-	    dprintf("Invalid thread on thread list %p magic = 0x%08x\n",
-		    nt, nt->thread_magic);
-	    kaboom();
-	}
-
-	dprintf("Thread %p (%s) ", nt, nt->name);
-	if (!nt->blocked) {
-	    dprintf("runnable priority %d\n", nt->prio);
-	    if (!best || nt->prio < best->prio)
-		best = nt;
-	} else {
-	    dprintf("blocked\n");
-	}
-	nt = container_of(nt->list.next, struct thread, list);
-    } while (nt != st);
-
-    if (!best)
+    if (__unlikely(__run_queue.next == &__run_queue))
 	kaboom();		/* No runnable thread */
 
+    best = container_of(__run_queue.next, struct thread, rq);
+    if (curr->rq.next && curr->rq.next != &__run_queue &&
+	curr->prio == best->prio) {
+	nt = container_of(curr->rq.next, struct thread, rq);
+	if (nt->prio == curr->prio)
+	    best = nt;
+    }
+
+    if (__unlikely(best->thread_magic != THREAD_MAGIC)) {
+	dprintf("Invalid thread on run queue %p magic = 0x%08x\n",
+		best, best->thread_magic);
+	kaboom();
+    }
+
     if (best != curr) {
-	uint64_t tsc;
-	
-	asm volatile("rdtsc" : "=A" (tsc));
-	
-	dprintf("@ %llu -> %p (%s)\n", tsc, best, best->name);
+	dprintf("-> %p (%s)\n", best, best->name);
+	__thread_account_switch(curr, best);
+	trace_str(TRACE_SCHED, "switch", best->name,
+		  (uintptr_t)curr, (uintptr_t)best);
 	__switch_to(best);
     } else {
 	dprintf("no change\n");
@@ -31,14 +31,17 @@ mstime_t __sem_down_slow(struct semaphore *sem, mstime_t timeout)
 	struct thread_block block;
 	struct thread *curr = current();
 	mstime_t now = ms_timer();
+	mstime_t slept;
 
 	block.thread     = curr;
 	block.semaphore  = sem;
 	block.block_time = now;
 	block.timeout    = timeout ? now+timeout : 0;
 	block.timed_out  = false;
+	block.tlist.next = NULL;
 
 	curr->blocked    = &block;
+	__thread_unrunnable(curr);
 
 	/* Add to the end of the wakeup list */
 	block.list.prev       = sem->list.prev;
@@ -46,9 +49,16 @@ mstime_t __sem_down_slow(struct semaphore *sem, mstime_t timeout)
 	sem->list.prev        = &block.list;
 	block.list.prev->next = &block.list;
 
+	if (block.timeout)
+	    __thread_timeout_add(&block);
+
 	__schedule();
 
-	rv = block.timed_out ? -1 : ms_timer() - block.block_time;
+	slept = ms_timer() - block.block_time;
+	curr->acct.blocks++;
+	curr->acct.blocked_ms += slept;
+
+	rv = block.timed_out ? -1 : slept;
     }
 
     irq_restore(irq);
@@ -77,7 +87,9 @@ void __sem_up_slow(struct semaphore *sem)
 	    sem->list.next = block->list.next;
 	    block->list.next->prev = &sem->list;
 
+	    __thread_timeout_del(block);
 	    block->thread->blocked = NULL;
+	    __thread_runnable(block->thread);
 
 	    __schedule();
 	}
@@ -85,3 +97,29 @@ void __sem_up_slow(struct semaphore *sem)
 
     irq_restore(irq);
 }
+
+/*
+ * Take as many counts as are available right now, up to max, without
+ * blocking.  Returns the number taken.
+ */
+int sem_trydown_many(struct semaphore *sem, int max)
+{
+    irq_state_t irq;
+    int n = 0;
+
+    irq = irq_save();
+
+    if (sem_is_valid(sem) && sem->count > 0) {
+	n = sem->count < max ? sem->count : max;
+	sem->count -= n;
+    }
+
+    irq_restore(irq);
+    return n;
+}
+
+void sem_up_many(struct semaphore *sem, int n)
+{
+    while (n-- > 0)
+	sem_up(sem);
+}
@@ -62,6 +62,7 @@ struct thread *start_thread(const char *name, size_t stack_size, int prio,
     curr->list.next    = &t->list;
     t->list.next->prev = &t->list;
 
+    __thread_runnable(t);
     __schedule();
 
     irq_restore(irq);
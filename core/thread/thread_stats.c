@@ -0,0 +1,125 @@
+/*
+ * Per-thread CPU accounting and the context switch trace.
+ * See <syslinux/threadstat.h>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <klibc/compiler.h>
+#include <cpufeature.h>
+#include <sys/cpu.h>
+#include <syslinux/threadstat.h>
+#include "thread.h"
+#include "core.h"
+
+extern struct thread __root_thread;
+
+static struct thread_trace thread_trace;
+static signed char thread_tsc = -1;	/* -1 = not probed yet */
+
+static uint64_t thread_clock(void)
+{
+    if (__unlikely(thread_tsc < 0)) {
+#if __SIZEOF_POINTER__ == 4
+	thread_tsc = cpu_has_eflag(EFLAGS_ID) &&
+	    (cpuid_edx(1) & (1 << (X86_FEATURE_TSC & 31)));
+#else
+	thread_tsc = 1;
+#endif
+    }
+
+    return thread_tsc ? rdtsc() : 0;
+}
+
+/*
+ * Called by __schedule() right before switching from curr to next,
+ * with interrupts off.  curr may have exited already, in which case
+ * its memory has been freed and must not be written to.
+ */
+void __thread_account_switch(struct thread *curr, struct thread *next)
+{
+    uint64_t now = thread_clock();
+    bool live = curr->list.next->prev == &curr->list;
+    struct thread_trace_rec *rec;
+
+    if (live) {
+	if (curr->acct.last_in)
+	    curr->acct.runtime += now - curr->acct.last_in;
+	curr->acct.switches_out++;
+    }
+
+    next->acct.last_in = now;
+    next->acct.switches_in++;
+
+    if (thread_trace.size) {
+	rec = &thread_trace.rec[thread_trace.total++ % thread_trace.size];
+	rec->tsc  = now;
+	rec->from = curr;
+	rec->to   = next;
+	rec->sem  = live && curr->blocked ? curr->blocked->semaphore : NULL;
+    }
+}
+
+__export int thread_stats_get(struct thread_stat *st, int max)
+{
+    struct thread_list *l = &__root_thread.list;
+    struct thread *t;
+    irq_state_t irq;
+    uint64_t now;
+    int n = 0;
+
+    irq = irq_save();
+    now = thread_clock();
+
+    do {
+	t = container_of(l, struct thread, list);
+	if (n < max) {
+	    st->id           = t;
+	    st->name         = t->name;
+	    st->prio         = t->prio;
+	    st->switches_in  = t->acct.switches_in;
+	    st->switches_out = t->acct.switches_out;
+	    st->blocks       = t->acct.blocks;
+	    st->blocked_ms   = t->acct.blocked_ms;
+	    st->blocked_on   = t->blocked ? t->blocked->semaphore : NULL;
+	    st->runtime      = t->acct.runtime;
+
+	    /* Include the slice the caller is in the middle of */
+	    if (t == current() && t->acct.last_in)
+		st->runtime += now - t->acct.last_in;
+	    st++;
+	}
+	n++;
+	l = l->next;
+    } while (l != &__root_thread.list);
+
+    irq_restore(irq);
+    return n;
+}
+
+__export int thread_trace_enable(unsigned int entries)
+{
+    struct thread_trace_rec *rec = NULL, *old;
+    irq_state_t irq;
+
+    if (entries) {
+	rec = malloc(entries * sizeof *rec);
+	if (!rec)
+	    return -1;
+    }
+
+    irq = irq_save();
+    old = thread_trace.rec;
+    thread_trace.rec   = rec;
+    thread_trace.size  = entries;
+    thread_trace.total = 0;
+    irq_restore(irq);
+
+    free(old);
+    return 0;
+}
+
+__export const struct thread_trace *thread_trace_get(void)
+{
+    return thread_trace.size ? &thread_trace : NULL;
+}
@@ -5,6 +5,41 @@
 
 #include "thread.h"
 
+static struct thread_list timeout_queue = {
+    .next = &timeout_queue, .prev = &timeout_queue
+};
+
+/*
+ * Queue a block behind the ones that time out no later than it does;
+ * most new timeouts are the latest yet, so look from the back.
+ */
+void __thread_timeout_add(struct thread_block *block)
+{
+    struct thread_list *l;
+    struct thread_block *b;
+
+    for (l = timeout_queue.prev; l != &timeout_queue; l = l->prev) {
+	b = container_of(l, struct thread_block, tlist);
+	if ((mstimediff_t)(b->timeout - block->timeout) <= 0)
+	    break;
+    }
+
+    block->tlist.prev = l;
+    block->tlist.next = l->next;
+    l->next->prev = &block->tlist;
+    l->next = &block->tlist;
+}
+
+void __thread_timeout_del(struct thread_block *block)
+{
+    if (!block->tlist.next)
+	return;
+
+    block->tlist.prev->next = block->tlist.next;
+    block->tlist.next->prev = block->tlist.prev;
+    block->tlist.next = block->tlist.prev = NULL;
+}
+
 /*
  * __thread_process_timeouts()
  *
@@ -13,29 +48,27 @@
  */
 void __thread_process_timeouts(void)
 {
-    struct thread *curr = current();
-    struct thread_list *tp;
-    struct thread *t;
     mstime_t now = ms_timer();
     struct thread_block *block;
-    mstime_t timeout;
-
-    /* The current thread is obviously running, so no need to check... */
-    for (tp = curr->list.next; tp != &curr->list; tp = tp->next) {
-	t = container_of(tp, struct thread, list);
-	if ((block = t->blocked) && (timeout = block->timeout)) {
-	    if ((mstimediff_t)(timeout - now) <= 0) {
-		struct semaphore *sem = block->semaphore;
-		/* Remove us from the queue and increase the count */
-		block->list.next->prev = block->list.prev;
-		block->list.prev->next = block->list.next;
-		sem->count++;
-
-		t->blocked = NULL;
-		block->timed_out = true;
-
-		__schedule();	/* Normally sets just __need_schedule */
-	    }
-	}
+    struct semaphore *sem;
+
+    /* Only the front of the queue can have expired */
+    while (timeout_queue.next != &timeout_queue) {
+	block = container_of(timeout_queue.next, struct thread_block, tlist);
+	if ((mstimediff_t)(block->timeout - now) > 0)
+	    break;
+
+	/* Remove us from the queue and increase the count */
+	sem = block->semaphore;
+	block->list.next->prev = block->list.prev;
+	block->list.prev->next = block->list.next;
+	sem->count++;
+
+	__thread_timeout_del(block);
+	block->thread->blocked = NULL;
+	block->timed_out = true;
+	__thread_runnable(block->thread);
+
+	__schedule();	/* Normally sets just __need_schedule */
     }
 }
@@ -0,0 +1,164 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Permission is hereby granted, free of charge, to any person
+ *   obtaining a copy of this software and associated documentation
+ *   files (the "Software"), to deal in the Software without
+ *   restriction, including without limitation the rights to use,
+ *   copy, modify, merge, publish, distribute, sublicense, and/or
+ *   sell copies of the Software, and to permit persons to whom
+ *   the Software is furnished to do so, subject to the following
+ *   conditions:
+ *
+ *   The above copyright notice and this permission notice shall
+ *   be included in all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ *   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *   OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ *   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *   HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ *   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ *   OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * trace.c
+ *
+ * The tracepoint ring.  See <syslinux/trace.h>.
+ *
+ * The ring is only allocated once a group is first turned on, and is
+ * kept from then on, so that a trace survives turning tracing off to
+ * look at it.  Records are claimed with interrupts off, since the
+ * scheduler's tracepoint can fire from the timer interrupt.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <com32.h>
+#include <cpufeature.h>
+#include <sys/cpu.h>
+#include <syslinux/trace.h>
+
+#define TRACE_ENTRIES	2048
+
+__export uint32_t trace_mask;
+
+static struct trace_log trace_log;
+static bool trace_tsc;
+
+static const char * const trace_groups[TRACE_NGROUPS] = {
+    [TRACE_CACHE]    = "cache",
+    [TRACE_GETFSSEC] = "getfssec",
+    [TRACE_NET]      = "net",
+    [TRACE_SCHED]    = "sched",
+    [TRACE_MALLOC]   = "malloc",
+    [TRACE_MODULE]   = "module",
+};
+
+__export void __trace(int group, const char *name, const char *str,
+		      uint64_t a, uint64_t b)
+{
+    struct trace_rec *rec;
+    irq_state_t irq;
+
+    irq = irq_save();
+    rec = &trace_log.rec[trace_log.total++ % trace_log.size];
+    irq_restore(irq);
+
+    rec->tsc   = trace_tsc ? rdtsc() : 0;
+    rec->a     = a;
+    rec->b     = b;
+    rec->name  = name;
+    rec->group = group;
+    if (str)
+	strlcpy(rec->str, str, sizeof rec->str);
+    else
+	rec->str[0] = '\0';
+}
+
+static int trace_alloc(void)
+{
+    if (trace_log.size)
+	return 0;
+
+    trace_log.rec = malloc(TRACE_ENTRIES * sizeof *trace_log.rec);
+    if (!trace_log.rec)
+	return -1;
+
+#if __SIZEOF_POINTER__ == 4
+    trace_tsc = cpu_has_eflag(EFLAGS_ID) &&
+	(cpuid_edx(1) & (1 << (X86_FEATURE_TSC & 31)));
+#else
+    trace_tsc = true;
+#endif
+
+    trace_log.total = 0;
+    trace_log.size  = TRACE_ENTRIES;
+    return 0;
+}
+
+__export int trace_set(const char *spec)
+{
+    uint32_t mask = trace_mask;
+    const char *p = spec;
+    bool off;
+    size_t len;
+    int i, rv = 0;
+
+    for (;;) {
+	p += strspn(p, " \t,");
+	len = strcspn(p, " \t,");
+	if (!len)
+	    break;
+
+	off = *p == '-';
+	if (off) {
+	    p++;
+	    len--;
+	}
+
+	if (len == 3 && !strncmp(p, "all", 3)) {
+	    mask = off ? 0 : (1U << TRACE_NGROUPS) - 1;
+	} else if (len == 3 && !strncmp(p, "off", 3)) {
+	    mask = 0;
+	} else {
+	    for (i = 0; i < TRACE_NGROUPS; i++) {
+		if (strlen(trace_groups[i]) == len &&
+		    !strncmp(p, trace_groups[i], len))
+		    break;
+	    }
+	    if (i < TRACE_NGROUPS) {
+		if (off)
+		    mask &= ~(1U << i);
+		else
+		    mask |= 1U << i;
+	    } else {
+		rv = -1;
+	    }
+	}
+	p += len;
+    }
+
+    /* Get the ring before anything can log into it */
+    if (mask && trace_alloc())
+	return -1;
+
+    trace_mask = mask;
+    return rv;
+}
+
+__export const char *trace_group_name(int group)
+{
+    if (group < 0 || group >= TRACE_NGROUPS)
+	return NULL;
+
+    return trace_groups[group];
+}
+
+__export const struct trace_log *trace_get(void)
+{
+    return trace_log.size ? &trace_log : NULL;
+}
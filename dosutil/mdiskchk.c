@@ -126,12 +126,17 @@ static OUTPUT_FUNC_DECL(normal_output)
 {
     if (m == NULL)
 	return;
-    printf("Drive %02X is MEMDISK %u.%02u:\n"
-	   "\tAddress = 0x%08lx, len = %lu sectors, chs = %u/%u/%u,\n"
+    printf("Drive %02X is MEMDISK %u.%02u:\n",
+	   d, m->mdi.version_major, m->mdi.version_minor);
+    /* A sparse image has no flat copy in memory, and diskbuf == 0 */
+    if (m->mdi.diskbuf)
+	printf("\tAddress = 0x%08lx, ", m->mdi.diskbuf);
+    else
+	printf("\tSparse image, ");
+    printf("len = %lu sectors, chs = %u/%u/%u,\n"
 	   "\tloader = 0x%02x (%s),\n"
 	   "\tcmdline = %Fs\n",
-	   d, m->mdi.version_major, m->mdi.version_minor,
-	   m->mdi.diskbuf, m->mdi.disksize, m->cylinders, m->heads, m->sectors,
+	   m->mdi.disksize, m->cylinders, m->heads, m->sectors,
 	   m->mdi.bootloaderid, bootloadername(m->mdi.bootloaderid),
 	   MK_FP(m->mdi.cmdline.seg_off.segment,
 		 m->mdi.cmdline.seg_off.offset));
@@ -28,6 +28,8 @@ void efi_console_restore(void)
 {
     SIMPLE_TEXT_OUTPUT_INTERFACE *out = ST->ConOut;
 
+    efi_write_flush();
+    serial_tx_flush();
     uefi_call_wrapper(out->SetAttribute, 2, out, console_default_attribute);
     uefi_call_wrapper(out->EnableCursor, 2, out, console_default_cursor);
 }
@@ -35,6 +37,7 @@ void efi_console_restore(void)
 __export void writechr(char data)
 {
 	efi_write_char(data, 0);
+	efi_write_flush();
 }
 
 static inline EFI_STATUS open_protocol(EFI_HANDLE handle, EFI_GUID *protocol,
@@ -8,6 +8,45 @@
 #include <dprintf.h>
 #include "efi.h"
 
+/*
+ * EFI_BLOCK_IO2_PROTOCOL (UEFI 2.3.1) isn't in the gnu-efi headers we
+ * build against, so define the parts of it we use here.
+ */
+#define EFI_BLOCK_IO2_PROTOCOL_GUID \
+    { 0xa77b2472, 0xe282, 0x4e9f, \
+      { 0xa2, 0x45, 0xc2, 0xc0, 0xe2, 0x7b, 0xbc, 0xc1 } }
+
+typedef struct {
+	EFI_EVENT Event;
+	EFI_STATUS TransactionStatus;
+} EFI_BLOCK_IO2_TOKEN;
+
+typedef struct _EFI_BLOCK_IO2_PROTOCOL {
+	EFI_BLOCK_IO_MEDIA *Media;
+	EFI_STATUS (EFIAPI *Reset)(struct _EFI_BLOCK_IO2_PROTOCOL *, BOOLEAN);
+	EFI_STATUS (EFIAPI *ReadBlocksEx)(struct _EFI_BLOCK_IO2_PROTOCOL *,
+					  UINT32, EFI_LBA,
+					  EFI_BLOCK_IO2_TOKEN *, UINTN, VOID *);
+	EFI_STATUS (EFIAPI *WriteBlocksEx)(struct _EFI_BLOCK_IO2_PROTOCOL *,
+					   UINT32, EFI_LBA,
+					   EFI_BLOCK_IO2_TOKEN *, UINTN, VOID *);
+	EFI_STATUS (EFIAPI *FlushBlocksEx)(struct _EFI_BLOCK_IO2_PROTOCOL *,
+					   EFI_BLOCK_IO2_TOKEN *);
+} EFI_BLOCK_IO2_PROTOCOL;
+
+static EFI_GUID BlockIo2Protocol = EFI_BLOCK_IO2_PROTOCOL_GUID;
+
+/*
+ * Pipelined reads: large reads are split into BIO2_CHUNK byte requests,
+ * with up to BIO2_DEPTH of them in flight at any time.
+ */
+#define BIO2_DEPTH	4
+#define BIO2_CHUNK	(256 << 10)
+
+static struct bio2_slot {
+	EFI_BLOCK_IO2_TOKEN token;
+} bio2_slots[BIO2_DEPTH];
+
 static inline EFI_STATUS read_blocks(EFI_BLOCK_IO *bio, uint32_t id, 
 				     sector_t lba, UINTN bytes, void *buf)
 {
@@ -20,6 +59,74 @@ static inline EFI_STATUS write_blocks(EFI_BLOCK_IO *bio, uint32_t id,
 	return uefi_call_wrapper(bio->WriteBlocks, 5, bio, id, lba, bytes, buf);
 }
 
+static EFI_STATUS bio2_wait(struct bio2_slot *slot)
+{
+	UINTN index;
+
+	uefi_call_wrapper(BS->WaitForEvent, 3, 1, &slot->token.Event,
+			  &index);
+	return slot->token.TransactionStatus;
+}
+
+/*
+ * Read COUNT sectors with several BlockIo2 requests in flight.
+ * Returns the number of sectors known to be read successfully from
+ * the start of the buffer.
+ */
+static size_t bio2_read_sectors(struct disk *disk, char *buf,
+				sector_t lba, size_t count)
+{
+	struct efi_disk_private *priv = (struct efi_disk_private *)disk->private;
+	EFI_BLOCK_IO2_PROTOCOL *bio2 = priv->bio2;
+	size_t chunk_secs = BIO2_CHUNK >> disk->sector_shift;
+	size_t submitted = 0, done = 0, chunk;
+	size_t chunks[BIO2_DEPTH];
+	EFI_STATUS status;
+	bool stop = false;	/* Don't submit any more requests */
+	bool error = false;	/* A request failed; later data is invalid */
+	int head = 0, tail = 0, inflight = 0;
+
+	while ((submitted < count && !stop) || inflight) {
+		/* Keep the pipeline full */
+		while (submitted < count && !stop && inflight < BIO2_DEPTH) {
+			struct bio2_slot *slot = &bio2_slots[tail];
+
+			chunk = count - submitted;
+			if (chunk > chunk_secs)
+				chunk = chunk_secs;
+
+			slot->token.TransactionStatus = EFI_SUCCESS;
+			status = uefi_call_wrapper(bio2->ReadBlocksEx, 6, bio2,
+				disk->disk_number, lba + submitted,
+				&slot->token, chunk << disk->sector_shift,
+				buf + (submitted << disk->sector_shift));
+			if (status != EFI_SUCCESS) {
+				stop = true;
+				break;
+			}
+
+			chunks[tail] = chunk;
+			submitted += chunk;
+			tail = (tail + 1) % BIO2_DEPTH;
+			inflight++;
+		}
+
+		if (!inflight)
+			break;
+
+		/* Retire the oldest request */
+		status = bio2_wait(&bio2_slots[head]);
+		if (status != EFI_SUCCESS)
+			error = stop = true;
+		else if (!error)
+			done += chunks[head];
+		head = (head + 1) % BIO2_DEPTH;
+		inflight--;
+	}
+
+	return done;
+}
+
 static int efi_rdwr_sectors(struct disk *disk, void *buf,
 			    sector_t lba, size_t count, bool is_write)
 {
@@ -27,18 +134,36 @@ static int efi_rdwr_sectors(struct disk *disk, void *buf,
 	EFI_BLOCK_IO *bio = priv->bio;
 	EFI_STATUS status;
 	UINTN bytes = count * disk->sector_size;
+	size_t done = 0;
+
+	/*
+	 * Use the pipelined path for reads which span several chunks.  If
+	 * it comes up short, finish off with a plain blocking read, which
+	 * will also report the error.
+	 */
+	if (!is_write && priv->bio2 && bytes > BIO2_CHUNK) {
+		done = bio2_read_sectors(disk, buf, lba, count);
+		if (done == count)
+			return done;
+		buf = (char *)buf + (done << disk->sector_shift);
+		lba += done;
+		count -= done;
+		bytes = count * disk->sector_size;
+	}
 
 	if (is_write)
 		status = write_blocks(bio, disk->disk_number, lba, bytes, buf);
 	else
 		status = read_blocks(bio, disk->disk_number, lba, bytes, buf);
 
-	if (status != EFI_SUCCESS)
+	if (status != EFI_SUCCESS) {
 		Print(L"Failed to %s blocks: 0x%x\n",
 			is_write ? L"write" : L"read",
 			status);
+		return done;
+	}
 
-	return count << disk->sector_shift;
+	return done + count;
 }
 
 struct disk *efi_disk_init(void *private)
@@ -68,12 +193,37 @@ struct disk *efi_disk_init(void *private)
     disk.sector_size   = bio->Media->BlockSize;
     disk.rdwr_sectors  = efi_rdwr_sectors;
     disk.sector_shift  = ilog2(disk.sector_size);
+    disk.io_align      = bio->Media->IoAlign > 1 ? bio->Media->IoAlign : 0;
 
     dprintf("sector_size=%d, disk_number=%d\n", disk.sector_size,
 	    disk.disk_number);
 
     priv->bio = bio;
     priv->dio = dio;
+    priv->bio2 = NULL;
+
+    /* Use BlockIo2 for pipelined reads if we can set up its events */
+    status = uefi_call_wrapper(BS->HandleProtocol, 3, handle,
+			       &BlockIo2Protocol, (void **)&priv->bio2);
+    if (status == EFI_SUCCESS && priv->bio2) {
+	int i;
+
+	for (i = 0; i < BIO2_DEPTH; i++) {
+	    status = uefi_call_wrapper(BS->CreateEvent, 5, 0, TPL_CALLBACK,
+				       NULL, NULL,
+				       &bio2_slots[i].token.Event);
+	    if (status != EFI_SUCCESS) {
+		while (i--)
+		    uefi_call_wrapper(BS->CloseEvent, 1,
+				      bio2_slots[i].token.Event);
+		priv->bio2 = NULL;
+		break;
+	    }
+	}
+    } else {
+	priv->bio2 = NULL;
+    }
+    dprintf("BlockIo2 %savailable\n", priv->bio2 ? "" : "not ");
     disk.private = private;
 #if 0
 
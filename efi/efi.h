@@ -29,10 +29,13 @@
 /* We should keep EFI_NOMAP_PRINT_COUNT at 10 to limit flooding the console */
 #define EFI_NOMAP_PRINT_COUNT	10
 
+struct _EFI_BLOCK_IO2_PROTOCOL;
+
 struct efi_disk_private {
 	EFI_HANDLE dev_handle;
 	EFI_BLOCK_IO *bio;
 	EFI_DISK_IO *dio;
+	struct _EFI_BLOCK_IO2_PROTOCOL *bio2;	/* NULL if not available */
 };
 
 struct efi_binding {
@@ -48,11 +51,16 @@ struct screen_info;
 extern void setup_screen(struct screen_info *);
 
 extern void efi_write_char(uint8_t, uint8_t);
+extern void efi_write_flush(void);
 
 enum heap;
 extern void *efi_malloc(size_t, enum heap, size_t);
 extern void *efi_realloc(void *, size_t);
 extern void efi_free(void *);
+struct com32_mem_stats;
+extern int efi_mem_stats(struct com32_mem_stats *);
+extern int efi_heap_grow_below(size_t, size_t);
+extern void efi_mem_init(void);
 
 extern struct efi_binding *efi_create_binding(EFI_GUID *, EFI_GUID *);
 extern void efi_destroy_binding(struct efi_binding *, EFI_GUID *);
@@ -80,4 +88,6 @@ handover_func_t efi_handover;
 extern void efi_console_save(void);
 extern void efi_console_restore(void);
 
+extern void efi_netcache_init(void);
+
 #endif /* _SYSLINUX_EFI_H */
@@ -0,0 +1,259 @@
+/*
+ * efifs.c
+ *
+ * Files read through the firmware's own EFI_FILE_PROTOCOL, on the
+ * volume we were loaded from, rather than by parsing the FAT on it
+ * over BlockIo.  The firmware has the FAT driver, and its caching,
+ * anyway; reading a kernel this way is one Read() call for the lot.
+ *
+ * It is used when the load options ask for it with "nativefs", and
+ * falls back to vfat if the volume can't be opened.  What it gives
+ * up is what needs the device itself: there is no FSUUID=, and no
+ * installer preload map.
+ *
+ * The current directory is only a prefix, as for PXE; the firmware
+ * resolves the rest of the path.
+ */
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <minmax.h>
+#include <dprintf.h>
+#include <fs.h>
+#include "efi.h"
+#include "fio.h"
+
+#define EFIFS_SECTOR_SHIFT	12	/* Arbitrary, as for PXE */
+#define EFIFS_PATH_MAX		(CURRENTDIR_MAX + FILENAME_MAX)
+
+struct efifs_pvt_inode {
+	EFI_FILE_HANDLE fd;
+};
+
+#define EFIFS_PVT(i) ((struct efifs_pvt_inode *)((i)->pvt))
+
+static size_t efifs_path(struct fs_info *fs, char *dst, const char *src,
+			 size_t bufsize)
+{
+	return snprintf(dst, bufsize, "%s%s",
+			src[0] == '/' ? "" : fs->cwd_name, src);
+}
+
+/*
+ * Open name, relative to the current directory; returns NULL if it
+ * isn't there, with what it was found as in *info.
+ */
+static EFI_FILE_HANDLE efifs_open(struct fs_info *fs, const char *name,
+				  char *path, EFI_FILE_INFO *info)
+{
+	CHAR16 wpath[EFIFS_PATH_MAX];
+	EFI_FILE_HANDLE fd;
+	size_t i, len;
+
+	len = efifs_path(fs, path, name, EFIFS_PATH_MAX);
+	if (len >= EFIFS_PATH_MAX)
+		return NULL;
+
+	for (i = 0; i <= len; i++)
+		wpath[i] = path[i] == '/' ? L'\\' : (UINT8)path[i];
+
+	fd = efi_open(wpath, EFI_FILE_MODE_READ);
+	if (EFI_ERROR(efi_errno))
+		return NULL;
+
+	if (efi_fstat(fd, info)) {
+		efi_close(fd);
+		return NULL;
+	}
+
+	return fd;
+}
+
+static void efifs_searchdir(const char *name, int flags, struct file *file)
+{
+	char path[EFIFS_PATH_MAX];
+	EFI_FILE_INFO info;
+	EFI_FILE_HANDLE fd;
+	struct inode *inode;
+	bool dir;
+
+	file->inode = NULL;
+
+	fd = efifs_open(file->fs, name, path, &info);
+	if (!fd) {
+		dprintf("efifs: %s not found\n", path);
+		return;
+	}
+
+	dir = !!(info.Attribute & EFI_FILE_DIRECTORY);
+	if ((flags & O_DIRECTORY) && !dir)
+		goto bad;
+
+	inode = alloc_inode(file->fs, 0, sizeof(struct efifs_pvt_inode));
+	if (!inode)
+		goto bad;
+
+	inode->mode   = dir ? DT_DIR : DT_REG;
+	inode->size   = info.FileSize;
+	inode->blocks = (info.FileSize + (1 << EFIFS_SECTOR_SHIFT) - 1)
+		>> EFIFS_SECTOR_SHIFT;
+	EFIFS_PVT(inode)->fd = fd;
+
+	file->inode  = inode;
+	file->offset = 0;
+	return;
+
+bad:
+	efi_close(fd);
+}
+
+static uint32_t efifs_getfssec(struct file *file, char *buf,
+			       int sectors, bool *have_more)
+{
+	struct inode *inode = file->inode;
+	uint32_t bytes;
+	size_t got = 0;
+
+	bytes = min((uint64_t)sectors << EFIFS_SECTOR_SHIFT,
+		    inode->size - file->offset);
+	if (bytes)
+		got = efi_xpread(EFIFS_PVT(inode)->fd, buf, bytes,
+				 file->offset);
+
+	if (got == (size_t)-1) {
+		dprintf("efifs: read error %lx\n", (unsigned long)efi_errno);
+		*have_more = false;
+		return 0;
+	}
+
+	file->offset += got;
+	*have_more = got == bytes && file->offset < inode->size;
+
+	return got;
+}
+
+static void efifs_free_inode(struct inode *inode)
+{
+	efi_close(EFIFS_PVT(inode)->fd);
+}
+
+static int efifs_readdir(struct file *file, struct dirent *dirent)
+{
+	static union {
+		EFI_FILE_INFO info;
+		UINT8 buf[sizeof(EFI_FILE_INFO) + NAME_MAX * sizeof(CHAR16)];
+	} u;
+	EFI_FILE_HANDLE fd = EFIFS_PVT(file->inode)->fd;
+	UINTN size;
+	void *big;
+	int i;
+
+	for (;;) {
+		size = sizeof u;
+		efi_errno = uefi_call_wrapper(fd->Read, 3, fd, &size, &u);
+		if (efi_errno != EFI_BUFFER_TOO_SMALL)
+			break;
+
+		/* A name that doesn't fit in a dirent; step over it */
+		big = malloc(size);
+		if (!big)
+			return -1;
+		efi_errno = uefi_call_wrapper(fd->Read, 3, fd, &size, big);
+		free(big);
+		if (EFI_ERROR(efi_errno))
+			return -1;
+	}
+
+	if (EFI_ERROR(efi_errno) || !size)
+		return -1;	/* The end */
+
+	for (i = 0; i < NAME_MAX && u.info.FileName[i]; i++)
+		dirent->d_name[i] = u.info.FileName[i] < 0x100 ?
+			u.info.FileName[i] : '?';
+	dirent->d_name[i] = '\0';
+
+	dirent->d_ino = 0;
+	dirent->d_off = file->offset++;
+	dirent->d_reclen = offsetof(struct dirent, d_name) + i;
+	dirent->d_type = u.info.Attribute & EFI_FILE_DIRECTORY ?
+		DT_DIR : DT_REG;
+
+	return 0;
+}
+
+static void efifs_mangle_name(char *dst, const char *src)
+{
+	size_t len = FILENAME_MAX-1;
+
+	while (len-- && not_whitespace(*src)) {
+		*dst++ = *src == '\\' ? '/' : *src;
+		src++;
+	}
+
+	*dst = '\0';
+}
+
+static int efifs_chdir(struct fs_info *fs, const char *src)
+{
+	char path[EFIFS_PATH_MAX];
+	EFI_FILE_INFO info;
+	EFI_FILE_HANDLE fd;
+	size_t len;
+
+	fd = efifs_open(fs, src, path, &info);
+	if (!fd)
+		return -1;
+	efi_close(fd);
+
+	if (!(info.Attribute & EFI_FILE_DIRECTORY))
+		return -1;
+
+	/* The cwd is a prefix, so it ends in a slash */
+	len = strlen(path);
+	if (!len || path[len-1] != '/')
+		path[len++] = '/';
+	path[len] = '\0';
+
+	if (len >= sizeof fs->cwd_name)
+		return -1;
+	memcpy(fs->cwd_name, path, len + 1);
+
+	dprintf("efifs: cwd = \"%s\"\n", fs->cwd_name);
+	return 0;
+}
+
+static int efifs_init(struct fs_info *fs)
+{
+	char path[EFIFS_PATH_MAX];
+	EFI_FILE_INFO info;
+	EFI_FILE_HANDLE fd;
+
+	fd = efifs_open(fs, "/", path, &info);
+	if (!fd)
+		return -1;
+	efi_close(fd);
+
+	fs->sector_shift = fs->block_shift = EFIFS_SECTOR_SHIFT;
+	fs->sector_size  = fs->block_size  = 1 << EFIFS_SECTOR_SHIFT;
+
+	return fs->block_shift;
+}
+
+const struct fs_ops efi_fs_ops = {
+	.fs_name	= "efifs",
+	.fs_flags	= FS_NODEV,
+	.fs_init	= efifs_init,
+	.searchdir	= efifs_searchdir,
+	.chdir		= efifs_chdir,
+	.realpath	= efifs_path,
+	.getfssec	= efifs_getfssec,
+	.close_file	= generic_close_file,
+	.mangle_name	= efifs_mangle_name,
+	.chdir_start	= generic_chdir_start,
+	.open_config	= generic_open_config,
+	.free_inode	= efifs_free_inode,
+	.readdir	= efifs_readdir,
+	.fs_uuid	= NULL,
+};
@@ -9,6 +9,7 @@
 #include <syslinux/memscan.h>
 #include <syslinux/firmware.h>
 #include <syslinux/linux.h>
+#include <syslinux/boottime.h>
 #include <sys/ansi.h>
 #include <setjmp.h>
 
@@ -250,18 +251,67 @@ void sem_up(struct semaphore *sem)
 __export volatile uint32_t __ms_timer = 0;
 volatile uint32_t __jiffies = 0;
 
+/*
+ * Every firmware call is slow, so printable characters are collected
+ * here and handed to OutputString a run at a time.  A run ends on a
+ * control character, an attribute change, cursor motion that isn't
+ * simply "the next cell", or an explicit flush.
+ */
+#define EFI_CON_BUF	128
+
+static struct {
+	CHAR16 buf[EFI_CON_BUF + 1];
+	int len;
+	int attr;		/* Attribute set in the firmware, -1 if unknown */
+	int x, y;		/* Cursor after the buffered output ... */
+	bool xy_valid;		/* ... if we know where that is */
+} efi_con = { .attr = -1 };
+
+static void efi_write_drain(void)
+{
+	SIMPLE_TEXT_OUTPUT_INTERFACE *out = ST->ConOut;
+
+	if (!efi_con.len)
+		return;
+
+	efi_con.buf[efi_con.len] = '\0';
+	efi_con.len = 0;
+	uefi_call_wrapper(out->OutputString, 2, out, efi_con.buf);
+}
+
+/*
+ * Push out anything buffered, and forget what we know about the
+ * console, for when someone else is about to touch it.
+ */
+void efi_write_flush(void)
+{
+	efi_write_drain();
+	efi_con.attr = -1;
+	efi_con.xy_valid = false;
+}
+
 void efi_write_char(uint8_t ch, uint8_t attribute)
 {
 	SIMPLE_TEXT_OUTPUT_INTERFACE *out = ST->ConOut;
-	uint16_t c[2];
 
-	uefi_call_wrapper(out->SetAttribute, 2, out, attribute);
+	if (attribute != efi_con.attr) {
+		efi_write_drain();
+		uefi_call_wrapper(out->SetAttribute, 2, out, attribute);
+		efi_con.attr = attribute;
+	}
 
 	/* Lookup primary Unicode encoding in the system codepage */
-	c[0] = codepage.uni[0][ch];
-	c[1] = '\0';
+	efi_con.buf[efi_con.len++] = codepage.uni[0][ch];
 
-	uefi_call_wrapper(out->OutputString, 2, out, c);
+	if (ch < ' ') {
+		/* Let the firmware move the cursor, and ask it later */
+		efi_write_drain();
+		efi_con.xy_valid = false;
+	} else {
+		efi_con.x++;
+		if (efi_con.len == EFI_CON_BUF)
+			efi_write_drain();
+	}
 }
 
 static void efi_showcursor(const struct term_state *st)
@@ -269,6 +319,7 @@ static void efi_showcursor(const struct term_state *st)
 	SIMPLE_TEXT_OUTPUT_INTERFACE *out = ST->ConOut;
 	bool cursor = st->cursor ? true : false;
 
+	efi_write_drain();
 	uefi_call_wrapper(out->EnableCursor, 2, out, cursor);
 }
 
@@ -276,7 +327,15 @@ static void efi_set_cursor(int x, int y, bool visible)
 {
 	SIMPLE_TEXT_OUTPUT_INTERFACE *out = ST->ConOut;
 
+	/* The ANSI layer positions the cursor before every character */
+	if (efi_con.xy_valid && x == efi_con.x && y == efi_con.y)
+		return;
+
+	efi_write_drain();
 	uefi_call_wrapper(out->SetCursorPosition, 3, out, x, y);
+	efi_con.x = x;
+	efi_con.y = y;
+	efi_con.xy_valid = true;
 }
 
 static void efi_scroll_up(uint8_t cols, uint8_t rows, uint8_t attribute)
@@ -300,6 +359,7 @@ static void efi_erase(int x0, int y0, int x1, int y1, uint8_t attribute)
 	SIMPLE_TEXT_OUTPUT_INTERFACE *out = ST->ConOut;
 	int cols, rows;
 
+	efi_write_flush();
 	efi_get_mode(&cols, &rows);
 
 	/*
@@ -323,6 +383,8 @@ static void efi_text_mode(void)
 static void efi_get_cursor(uint8_t *x, uint8_t *y)
 {
 	SIMPLE_TEXT_OUTPUT_INTERFACE *out = ST->ConOut;
+
+	efi_write_drain();
 	*x = out->Mode->CursorColumn;
 	*y = out->Mode->CursorRow;
 }
@@ -336,6 +398,7 @@ struct output_ops efi_ops = {
 	.get_mode = efi_get_mode,
 	.text_mode = efi_text_mode,
 	.get_cursor = efi_get_cursor,
+	.flush = efi_write_drain,
 };
 
 char SubvolName[2];
@@ -376,6 +439,14 @@ int efi_scan_memory(scan_memory_callback_t callback, void *data)
 			break;
 		}
 
+		/* Where addr_t is 32 bits, what is above 4 GB isn't there */
+		if (sizeof(addr_t) < sizeof(UINT64)) {
+			if (m->PhysicalStart > (addr_t)-1)
+				continue;
+			if (region_sz > (UINT64)(addr_t)-1 + 1 - m->PhysicalStart)
+				region_sz = (UINT64)(addr_t)-1 + 1 - m->PhysicalStart;
+		}
+
 		rv = callback(data, m->PhysicalStart, region_sz, type);
 		if (rv)
 			break;
@@ -389,13 +460,12 @@ static struct syslinux_memscan efi_memscan = {
     .func = efi_scan_memory,
 };
 
-extern uint16_t *bios_free_mem;
 void efi_init(void)
 {
 	/* XXX timer */
-	*bios_free_mem = 0;
 	syslinux_memscan_add(&efi_memscan);
-	mem_init();
+	efi_mem_init();
+	dmesg_init();
 }
 
 char efi_getchar(char *hi)
@@ -404,6 +474,8 @@ char efi_getchar(char *hi)
 	EFI_INPUT_KEY key;
 	EFI_STATUS status;
 
+	efi_write_drain();
+
 	do {
 		status = uefi_call_wrapper(in->ReadKeyStroke, 2, in, &key);
 	} while (status == EFI_NOT_READY);
@@ -423,6 +495,7 @@ int efi_pollchar(void)
 	SIMPLE_INPUT_INTERFACE *in = ST->ConIn;
 	EFI_STATUS status;
 
+	efi_write_drain();
 	status = WaitForSingleEvent(in->WaitForKey, 1);
 	return status != EFI_TIMEOUT;
 }
@@ -470,7 +543,11 @@ struct e820_entry {
 
 struct boot_params {
 	struct screen_info screen_info;
-	uint8_t _pad[0x1c0 - sizeof(struct screen_info)];
+	uint8_t _pad[0x0c0 - sizeof(struct screen_info)];
+	uint32_t ext_ramdisk_image;	/* High 32 bits, protocol 2.12 */
+	uint32_t ext_ramdisk_size;
+	uint32_t ext_cmd_line_ptr;
+	uint8_t _pad1[0x1c0 - 0x0cc];
 	struct efi_info efi;
 	uint8_t _pad2[8];
 	uint8_t e820_entries;
@@ -877,6 +954,7 @@ static char *build_cmdline(char *str)
 	EFI_PHYSICAL_ADDRESS addr;
 	EFI_STATUS status;
 	char *cmdline = NULL; /* internal, in efi_physical below 0x3FFFFFFF */
+	size_t len = strlen(str) + 1;
 
 	/*
 	 * The kernel expects cmdline to be allocated pretty low,
@@ -887,14 +965,13 @@ static char *build_cmdline(char *str)
 	 */
 	addr = 0xA0000;
 	status = allocate_pages(AllocateMaxAddress, EfiLoaderData,
-			     EFI_SIZE_TO_PAGES(strlen(str) + 1),
-			     &addr);
+			     EFI_SIZE_TO_PAGES(len), &addr);
 	if (status != EFI_SUCCESS) {
 		printf("Failed to allocate memory for kernel command line, bailing out\n");
 		return NULL;
 	}
 	cmdline = (char *)(UINTN)addr;
-	memcpy(cmdline, str, strlen(str) + 1);
+	memcpy(cmdline, str, len);
 	return cmdline;
 }
 
@@ -932,35 +1009,62 @@ static int build_gdt(void)
 	return 0;
 }
 
+static void set_ramdisk(struct boot_params *bp, struct linux_header *hdr,
+			UINT64 addr, UINT64 size)
+{
+	hdr->ramdisk_image = (uint32_t)addr;
+	hdr->ramdisk_size = (uint32_t)size;
+	bp->ext_ramdisk_image = (uint32_t)(addr >> 32);
+	bp->ext_ramdisk_size = (uint32_t)(size >> 32);
+}
+
 /*
  * Callers use ->ramdisk_size to check whether any memory was
  * allocated (and therefore needs free'ing). The return value indicates
  * hard error conditions, such as failing to alloc memory for the
  * ramdisk image. Having no initramfs is not an error.
+ *
+ * addr_max is from syslinux_linux_initrd_max(); above 4 GB, the high
+ * half of the address goes in the boot_params' ext_ramdisk_image.
  */
-static int handle_ramdisks(struct linux_header *hdr,
-			   struct initramfs *initramfs)
+static int handle_ramdisks(struct boot_params *bp, struct linux_header *hdr,
+			   struct initramfs *initramfs, size_t addr_max,
+			   bool *allocated)
 {
 	EFI_PHYSICAL_ADDRESS last;
 	struct initramfs *ip;
 	EFI_STATUS status;
 	addr_t irf_size;
 	addr_t next_addr, len, pad;
+	void *base;
 
 	hdr->ramdisk_image = 0;
 	hdr->ramdisk_size = 0;
+	bp->ext_ramdisk_image = 0;
+	bp->ext_ramdisk_size = 0;
+	*allocated = false;
 
 	/*
 	 * Figure out the size of the initramfs, and where to put it.
 	 * We should put it at the highest possible address which is
-	 * <= hdr->initrd_addr_max, which fits the entire initramfs.
+	 * <= addr_max, which fits the entire initramfs.
 	 */
 	irf_size = initramfs_size(initramfs);	/* Handles initramfs == NULL */
 	if (!irf_size)
 		return 0;
 
+	/*
+	 * The initrds may have been read straight into memory that is
+	 * fine for the kernel as it is; then there is nothing to copy.
+	 */
+	base = initramfs_reserved_base(initramfs, addr_max);
+	if (base) {
+		set_ramdisk(bp, hdr, (UINTN)base, irf_size);
+		return 0;
+	}
+
 	last = 0;
-	find_addr(NULL, &last, 0x1000, hdr->initrd_addr_max,
+	find_addr(NULL, &last, 0x1000, addr_max,
 		  irf_size, INITRAMFS_MAX_ALIGN);
 	if (last)
 		status = allocate_addr(&last, irf_size);
@@ -970,8 +1074,8 @@ static int handle_ramdisks(struct linux_header *hdr,
 		return -1;
 	}
 
-	hdr->ramdisk_image = (uint32_t)last;
-	hdr->ramdisk_size = irf_size;
+	set_ramdisk(bp, hdr, last, irf_size);
+	*allocated = true;
 
 	/* Copy initramfs into allocated memory */
 	for (ip = initramfs->next; ip->len; ip = ip->next) {
@@ -1098,6 +1202,83 @@ static int exit_boot(struct boot_params *bp)
 	return 0;
 }
 
+/*
+ * Copy the setup_data entries, followed by the boot phase timestamps,
+ * into one block of memory and chain them off the kernel header.
+ */
+static int handle_setup_data(struct linux_header *hdr,
+			     struct setup_data *setup_data,
+			     EFI_PHYSICAL_ADDRESS *block, UINT64 *block_size)
+{
+	const struct boot_times *times = boot_times_get();
+	struct setup_data_header *sdh;
+	struct setup_data *sdp;
+	uint64_t *prev_ptr = &hdr->setup_data;
+	UINT64 size = 0;
+	EFI_STATUS status;
+	char *p;
+
+	*block = 0;
+	*block_size = 0;
+
+	if (setup_data) {
+		for (sdp = setup_data->next; sdp != setup_data; sdp = sdp->next)
+			if (sdp->data && sdp->hdr.len)
+				size += (sizeof *sdh + sdp->hdr.len + 15) & ~15;
+	}
+
+	if (hdr->version < 0x0209) {
+		if (size) {
+			printf("Kernel does not support setup_data, bailing out\n");
+			return -1;
+		}
+		return 0;
+	}
+
+	if (times)
+		size += sizeof *sdh + sizeof *times;
+	if (!size)
+		return 0;
+
+	status = emalloc(size, 16, block);
+	if (status != EFI_SUCCESS) {
+		printf("Failed to allocate memory for setup_data, bailing out\n");
+		return -1;
+	}
+	*block_size = size;
+	p = (char *)(UINTN)*block;
+
+	if (setup_data) {
+		for (sdp = setup_data->next; sdp != setup_data; sdp = sdp->next) {
+			if (!sdp->data || !sdp->hdr.len)
+				continue;
+
+			sdh = (struct setup_data_header *)p;
+			sdh->next = 0;
+			sdh->type = sdp->hdr.type;
+			sdh->len = sdp->hdr.len;
+			memcpy(sdh + 1, sdp->data, sdh->len);
+
+			*prev_ptr = (UINTN)sdh;
+			prev_ptr = &sdh->next;
+			p += (sizeof *sdh + sdh->len + 15) & ~15;
+		}
+	}
+
+	if (times) {
+		boot_time_stamp(BOOT_PHASE_SHUFFLE);
+
+		sdh = (struct setup_data_header *)p;
+		sdh->next = 0;
+		sdh->type = SETUP_BOOT_TIMES;
+		sdh->len = sizeof *times;
+		memcpy(sdh + 1, times, sizeof *times);
+		*prev_ptr = (UINTN)sdh;
+	}
+
+	return 0;
+}
+
 /* efi_boot_linux: 
  * Boots the linux kernel using the image and parameters to boot with.
  * The EFI boot loader is reworked taking the cue from
@@ -1120,7 +1301,9 @@ int efi_boot_linux(void *kernel_buf, size_t kernel_size,
 	struct boot_params *bp;
 	EFI_STATUS status;
 	EFI_PHYSICAL_ADDRESS addr, pref_address, kernel_start = 0;
-	UINT64 setup_sz, init_size = 0;
+	EFI_PHYSICAL_ADDRESS sd_block = 0;
+	UINT64 setup_sz, init_size = 0, sd_size = 0;
+	bool ramdisk_allocated = false;
 	char *_cmdline;
 
 	if (check_linux_header(kernel_buf))
@@ -1194,7 +1377,13 @@ int efi_boot_linux(void *kernel_buf, size_t kernel_size,
 	dprintf("efi_boot_linux: kernel_start 0x%x kernel_size 0x%x initramfs 0x%x setup_data 0x%x cmdline 0x%x\n",
 	kernel_start, kernel_size, initramfs, setup_data, _cmdline);
 
-	if (handle_ramdisks(hdr, initramfs))
+	if (handle_ramdisks(bp, hdr, initramfs,
+			    syslinux_linux_initrd_max(kernel_buf, kernel_size,
+						      cmdline),
+			    &ramdisk_allocated))
+		goto free_map;
+
+	if (handle_setup_data(hdr, setup_data, &sd_block, &sd_size))
 		goto free_map;
 
 	/* Attempt to use the handover protocol if available */
@@ -1231,8 +1420,13 @@ free_map:
 		efree((EFI_PHYSICAL_ADDRESS)(unsigned long)bp,
 		       BOOT_PARAM_BLKSIZE);
 	if (kernel_start) efree(kernel_start, init_size);
-	if (hdr->ramdisk_size)
-		free_addr(hdr->ramdisk_image, hdr->ramdisk_size);
+	if (sd_block)
+		efree(sd_block, sd_size);
+	if (ramdisk_allocated)
+		free_addr(hdr->ramdisk_image |
+			  (EFI_PHYSICAL_ADDRESS)bp->ext_ramdisk_image << 32,
+			  hdr->ramdisk_size |
+			  (UINT64)bp->ext_ramdisk_size << 32);
 bail:
 	return -1;
 }
@@ -1246,6 +1440,8 @@ struct mem_ops efi_mem_ops = {
 	.malloc = efi_malloc,
 	.realloc = efi_realloc,
 	.free = efi_free,
+	.stats = efi_mem_stats,
+	.grow_below = efi_heap_grow_below,
 };
 
 struct firmware efi_fw = {
@@ -1268,6 +1464,7 @@ static inline void syslinux_register_efi(void)
 extern void init(void);
 extern const struct fs_ops vfat_fs_ops;
 extern const struct fs_ops pxe_fs_ops;
+extern const struct fs_ops efi_fs_ops;
 
 char free_high_memory[4096];
 
@@ -1305,12 +1502,34 @@ static void efi_setcwd(CHAR16 *dp)
 	*c8 = '\0';
 }
 
+/*
+ * Is opt one of the words in our load options?
+ */
+static bool efi_load_option(EFI_LOADED_IMAGE *info, CHAR16 *opt)
+{
+	CHAR16 *p = info->LoadOptions;
+	CHAR16 *end = p + info->LoadOptionsSize / sizeof(CHAR16);
+	UINTN len = StrLen(opt);
+	CHAR16 *word;
+
+	while (p && p < end && *p) {
+		while (p < end && WS(*p))
+			p++;
+		for (word = p; p < end && *p && !WS(*p); p++)
+			;
+		if ((UINTN)(p - word) == len && !StrnCmp(word, opt, len))
+			return true;
+	}
+
+	return false;
+}
+
 EFI_STATUS efi_main(EFI_HANDLE image, EFI_SYSTEM_TABLE *table)
 {
 	EFI_PXE_BASE_CODE *pxe;
 	EFI_LOADED_IMAGE *info;
 	EFI_STATUS status = EFI_SUCCESS;
-	const struct fs_ops *ops[] = { NULL, NULL };
+	const struct fs_ops *ops[] = { NULL, NULL, NULL };
 	unsigned long len = (unsigned long)__bss_end - (unsigned long)__bss_start;
 	static struct efi_disk_private priv;
 	SIMPLE_INPUT_INTERFACE *in;
@@ -1347,11 +1566,24 @@ EFI_STATUS efi_main(EFI_HANDLE image, EFI_SYSTEM_TABLE *table)
 		}
 
 		efi_derivative(SYSLINUX_FS_SYSLINUX);
-		ops[0] = &vfat_fs_ops;
+		/*
+		 * Read the files through the firmware's own driver
+		 * if asked to, with vfat if that doesn't work.
+		 */
+		if (efi_load_option(info, L"nativefs")) {
+			ops[0] = &efi_fs_ops;
+			ops[1] = &vfat_fs_ops;
+		} else {
+			ops[0] = &vfat_fs_ops;
+		}
 	} else {
 		efi_derivative(SYSLINUX_FS_PXELINUX);
 		ops[0] = &pxe_fs_ops;
 		image_device_handle = info->DeviceHandle;
+
+		/* Keep what comes over HTTP on the ESP, if asked to */
+		if (efi_load_option(info, L"netcache"))
+			efi_netcache_init();
 	}
 
 	/* setup timer for boot menu system support */
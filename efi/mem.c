@@ -2,26 +2,94 @@
  * Copyright 2012-2014 Intel Corporation - All Rights Reserved
  */
 
+/*
+ * The core allocator, on pages from the firmware: a large block is
+ * taken at startup, and more whenever the heap runs out, so that
+ * malloc() is as fast as on BIOS and tagged frees work.  The pages
+ * are never given back.
+ */
+
 #include <mem/malloc.h>
 #include <string.h>
+#include <minmax.h>
 #include "efi.h"
 
+#define EFI_HEAP_INIT	(16 << 20)	/* Taken at startup */
+#define EFI_HEAP_GROW	(4 << 20)	/* At least this much at a time */
+
+static int efi_heap_add(EFI_ALLOCATE_TYPE type, EFI_PHYSICAL_ADDRESS addr,
+			size_t size)
+{
+	struct free_arena_header *fp;
+	UINTN npages = EFI_SIZE_TO_PAGES(size);
+	EFI_STATUS status;
+
+	status = uefi_call_wrapper(BS->AllocatePages, 4, type,
+				   EfiLoaderData, npages, &addr);
+	if (status != EFI_SUCCESS)
+		return -1;
+
+	fp = (struct free_arena_header *)(uintptr_t)addr;
+	fp->a.attrs = ARENA_TYPE_USED | (HEAP_MAIN << ARENA_HEAP_POS);
+	ARENA_SIZE_SET(fp->a.attrs, npages * EFI_PAGE_SIZE);
+#ifdef DEBUG_MALLOC
+	fp->a.magic = ARENA_MAGIC;
+#endif
+	/* sem_down() doesn't block on EFI, so this is safe under malloc() */
+	__inject_free_block(fp);
+
+	return 0;
+}
+
+static int efi_heap_grow(size_t size)
+{
+	return efi_heap_add(AllocateAnyPages, 0, size);
+}
+
+/*
+ * For malloc_high(): the firmware hands out the highest pages that
+ * fit under the limit, which is where the caller wants them anyway.
+ */
+int efi_heap_grow_below(size_t size, size_t limit)
+{
+	return efi_heap_add(AllocateMaxAddress, limit, size);
+}
+
+void efi_mem_init(void)
+{
+	__mem_init_heads();
+	efi_heap_grow(EFI_HEAP_INIT);
+}
+
+/*
+ * There is no low memory to speak of; all of it goes on the main heap,
+ * with the tag of the caller.
+ */
 void *efi_malloc(size_t size, enum heap heap, malloc_tag_t tag)
 {
-	return AllocatePool(size);
+	void *p;
+
+	(void)heap;
+
+	p = bios_malloc(size, HEAP_MAIN, tag);
+	if (!p && size && !efi_heap_grow(max(size + 4 * sizeof(struct arena_header),
+					     (size_t)EFI_HEAP_GROW)))
+		p = bios_malloc(size, HEAP_MAIN, tag);
+
+	return p;
 }
 
 void *efi_realloc(void *ptr, size_t size)
 {
-	void *newptr;
-
-	newptr = AllocatePool(size);
-	memcpy(newptr, ptr, size);
-	FreePool(ptr);
-	return newptr;
+	return bios_realloc(ptr, size);
 }
 
 void efi_free(void *ptr)
 {
-	FreePool(ptr);
+	bios_free(ptr);
+}
+
+int efi_mem_stats(struct com32_mem_stats *st)
+{
+	return bios_mem_stats(st);
 }
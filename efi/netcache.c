@@ -0,0 +1,280 @@
+/*
+ * netcache.c
+ *
+ * Files fetched over HTTP, kept on the EFI System Partition for the
+ * next boot: http.c asks the server whether its copy is still good,
+ * and on a 304 reads it from here instead.  It is used when the load
+ * options ask for it with "netcache".
+ *
+ * Each URL has a file of its own in NETCACHE_DIR, named for a hash of
+ * it.  The file starts with a header holding the URL, so a collision
+ * is only a miss, and the ETag or Last-Modified the server sent; the
+ * data follows.  The magic number goes in last, so a copy that was
+ * cut short is never taken for a whole one.
+ */
+
+#include <string.h>
+#include <minmax.h>
+#include <dprintf.h>
+#include <syslinux/firmware.h>
+#include "efi.h"
+#include "fio.h"
+
+#define NETCACHE_DIR		L"\\EFI\\syslinux\\netcache"
+#define NETCACHE_MAGIC		0x4e4c5953	/* "SYLN" */
+#define NETCACHE_KEY		256
+#define NETCACHE_VALIDATOR	128
+
+struct netcache_hdr {
+	uint32_t magic;
+	uint32_t size;			/* Of the data after the header */
+	char key[NETCACHE_KEY];
+	char validator[NETCACHE_VALIDATOR];
+};
+
+struct netcache_file {
+	EFI_FILE_HANDLE fd;
+	struct netcache_hdr hdr;
+	bool writing;			/* A new copy, from create() */
+	bool bad;			/* A write failed; throw it away */
+};
+
+static EFI_FILE_HANDLE netcache_root;	/* The ESP */
+
+/* FNV-1a, as the name of the file for key */
+static void netcache_name(const char *key, CHAR16 *name)
+{
+	static const char hexchar[16] = "0123456789abcdef";
+	uint32_t h = 2166136261u;
+	CHAR16 *p;
+	int i;
+
+	while (*key) {
+		h ^= (uint8_t)*key++;
+		h *= 16777619;
+	}
+
+	StrCpy(name, NETCACHE_DIR L"\\");
+	p = name + StrLen(name);
+	for (i = 28; i >= 0; i -= 4)
+		*p++ = hexchar[(h >> i) & 15];
+	*p = L'\0';
+}
+
+static EFI_FILE_HANDLE netcache_file_open(const char *key, UINT64 mode)
+{
+	CHAR16 name[sizeof NETCACHE_DIR / sizeof(CHAR16) + 10];
+	EFI_FILE_HANDLE fd = NULL;
+
+	netcache_name(key, name);
+	efi_errno = uefi_call_wrapper(netcache_root->Open, 5, netcache_root,
+				      &fd, name, mode, 0);
+	return EFI_ERROR(efi_errno) ? NULL : fd;
+}
+
+static void *netcache_open(const char *key, char *validator, size_t len,
+			   uint32_t *size)
+{
+	struct netcache_file *f;
+
+	if (strlen(key) >= NETCACHE_KEY)
+		return NULL;
+
+	f = zalloc(sizeof *f);
+	if (!f)
+		return NULL;
+
+	f->fd = netcache_file_open(key, EFI_FILE_MODE_READ);
+	if (!f->fd)
+		goto bail;
+
+	if (efi_xpread(f->fd, &f->hdr, sizeof f->hdr, 0) != sizeof f->hdr ||
+	    f->hdr.magic != NETCACHE_MAGIC || strcmp(f->hdr.key, key) ||
+	    !memchr(f->hdr.validator, '\0', NETCACHE_VALIDATOR)) {
+		efi_close(f->fd);
+		goto bail;
+	}
+
+	strlcpy(validator, f->hdr.validator, len);
+	*size = f->hdr.size;
+	return f;
+
+bail:
+	free(f);
+	return NULL;
+}
+
+static uint32_t netcache_read(void *h, void *buf, uint32_t len,
+			      uint32_t offset)
+{
+	struct netcache_file *f = h;
+	size_t got;
+
+	if (offset >= f->hdr.size)
+		return 0;
+	len = min(len, f->hdr.size - offset);
+
+	got = efi_xpread(f->fd, buf, len, sizeof f->hdr + offset);
+	return got == (size_t)-1 ? 0 : got;
+}
+
+static void *netcache_create(const char *key)
+{
+	struct netcache_file *f;
+
+	if (strlen(key) >= NETCACHE_KEY)
+		return NULL;
+
+	f = zalloc(sizeof *f);
+	if (!f)
+		return NULL;
+
+	f->fd = netcache_file_open(key, EFI_FILE_MODE_READ |
+				   EFI_FILE_MODE_WRITE | EFI_FILE_MODE_CREATE);
+	if (!f->fd) {
+		free(f);
+		return NULL;
+	}
+
+	/* Whatever was there is not a copy any more */
+	f->writing = true;
+	strcpy(f->hdr.key, key);
+	if (efi_xpwrite(f->fd, &f->hdr, sizeof f->hdr, 0) != sizeof f->hdr)
+		f->bad = true;
+
+	return f;
+}
+
+static void netcache_write(void *h, const void *buf, uint32_t len,
+			   uint32_t offset)
+{
+	struct netcache_file *f = h;
+
+	if (!f->bad &&
+	    efi_xpwrite(f->fd, (void *)buf, len, sizeof f->hdr + offset) != len)
+		f->bad = true;
+}
+
+/* Cut the file to what the header says it holds */
+static void netcache_truncate(struct netcache_file *f)
+{
+	EFI_FILE_INFO *info;
+
+	info = LibFileInfo(f->fd);
+	if (!info)
+		return;
+
+	info->FileSize = sizeof f->hdr + f->hdr.size;
+	uefi_call_wrapper(f->fd->SetInfo, 4, f->fd, &GenericFileInfo,
+			  info->Size, info);
+	FreePool(info);
+}
+
+static void netcache_close(void *h, const char *validator, uint32_t size)
+{
+	struct netcache_file *f = h;
+
+	if (f->writing) {
+		if (!validator || strlen(validator) >= NETCACHE_VALIDATOR)
+			f->bad = true;
+
+		if (!f->bad) {
+			f->hdr.size = size;
+			strcpy(f->hdr.validator, validator);
+			netcache_truncate(f);
+			efi_sync(f->fd);
+
+			/* Only now is it a copy */
+			f->hdr.magic = NETCACHE_MAGIC;
+			if (efi_xpwrite(f->fd, &f->hdr, sizeof f->hdr, 0) !=
+			    sizeof f->hdr)
+				f->bad = true;
+		}
+
+		if (f->bad) {
+			/* Delete closes it, too */
+			dprintf("netcache: dropping %s\n", f->hdr.key);
+			uefi_call_wrapper(f->fd->Delete, 1, f->fd);
+			free(f);
+			return;
+		}
+
+		dprintf("netcache: stored %s, %u bytes\n", f->hdr.key, size);
+	}
+
+	efi_close(f->fd);
+	free(f);
+}
+
+static struct netcache_ops efi_netcache_ops = {
+	.open	= netcache_open,
+	.read	= netcache_read,
+	.create	= netcache_create,
+	.write	= netcache_write,
+	.close	= netcache_close,
+};
+
+/* Open dir under root, making it if it isn't there */
+static EFI_FILE_HANDLE netcache_mkdir(EFI_FILE_HANDLE root, CHAR16 *dir)
+{
+	EFI_FILE_HANDLE fd = NULL;
+
+	efi_errno = uefi_call_wrapper(root->Open, 5, root, &fd, dir,
+				      EFI_FILE_MODE_READ |
+				      EFI_FILE_MODE_WRITE |
+				      EFI_FILE_MODE_CREATE,
+				      EFI_FILE_DIRECTORY);
+	return EFI_ERROR(efi_errno) ? NULL : fd;
+}
+
+/*
+ * Find the ESP, as the first volume with an \EFI directory, and make
+ * the cache directory on it; then http.c has somewhere to keep files.
+ */
+void efi_netcache_init(void)
+{
+	static CHAR16 * const dirs[] = {
+		L"\\EFI", L"\\EFI\\syslinux", NETCACHE_DIR
+	};
+	EFI_HANDLE *handles = NULL;
+	EFI_FILE_HANDLE root, fd;
+	UINTN i, j, nr_handles = 0;
+
+	if (EFI_ERROR(LibLocateHandle(ByProtocol, &FileSystemProtocol, NULL,
+				      &nr_handles, &handles)))
+		return;
+
+	for (i = 0; i < nr_handles && !netcache_root; i++) {
+		root = LibOpenRoot(handles[i]);
+		if (!root)
+			continue;
+
+		fd = NULL;
+		efi_errno = uefi_call_wrapper(root->Open, 5, root, &fd,
+					      dirs[0], EFI_FILE_MODE_READ, 0);
+		if (EFI_ERROR(efi_errno)) {
+			efi_close(root);
+			continue;
+		}
+		efi_close(fd);
+
+		for (j = 1; j < sizeof dirs / sizeof dirs[0]; j++) {
+			fd = netcache_mkdir(root, dirs[j]);
+			if (!fd)
+				break;
+			efi_close(fd);
+		}
+
+		if (j < sizeof dirs / sizeof dirs[0])
+			efi_close(root);	/* Read-only, perhaps */
+		else
+			netcache_root = root;
+	}
+
+	FreePool(handles);
+
+	if (netcache_root) {
+		dprintf("netcache: on volume %u\n", (unsigned int)(i - 1));
+		firmware->netcache = &efi_netcache_ops;
+	}
+}
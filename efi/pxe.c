@@ -23,9 +23,62 @@ void net_core_init(void)
     http_bake_cookies();
 }
 
+/*
+ * MTU of the interface we booted from, as the SNP driver reports it
+ */
+unsigned int net_core_mtu(void)
+{
+    EFI_SIMPLE_NETWORK *snp;
+    EFI_STATUS status;
+
+    status = uefi_call_wrapper(BS->HandleProtocol, 3, image_device_handle,
+			       &SimpleNetworkProtocol, (void **)&snp);
+    if (status != EFI_SUCCESS || !snp->Mode)
+	return 0;
+
+    return snp->Mode->MaxPacketSize;
+}
+
+/*
+ * Frame counts of the interface, if the SNP driver keeps them
+ */
+void net_core_stats(struct com32_net_stats *st)
+{
+    EFI_SIMPLE_NETWORK *snp;
+    EFI_NETWORK_STATISTICS ns;
+    UINTN size = sizeof ns;
+    EFI_STATUS status;
+
+    status = uefi_call_wrapper(BS->HandleProtocol, 3, image_device_handle,
+			       &SimpleNetworkProtocol, (void **)&snp);
+    if (status != EFI_SUCCESS)
+	return;
+
+    status = uefi_call_wrapper(snp->Statistics, 4, snp, FALSE, &size, &ns);
+    if (status != EFI_SUCCESS)
+	return;
+
+    st->rx_packets = ns.RxTotalFrames;
+    st->tx_packets = ns.TxTotalFrames;
+}
+
+/* The firmware does ARP, and keeps its table */
+bool net_core_arp_lookup(uint32_t ip, uint8_t *mac)
+{
+    return false;
+}
+
+void net_core_arp_add(uint32_t ip, const uint8_t *mac) {}
+
 void pxe_init_isr(void) {}
 void gpxe_init(void) {}
 void pxe_idle_init(void) {}
+void pxe_prefetch_file(struct fs_info *fs, const char *name) {}
+bool pxe_prefetch_take(const char *filename, int flags, struct file *file)
+{
+    return false;
+}
+void pxe_prefetch_put(struct inode *inode) {}
 
 int reset_pxe(void)
 {
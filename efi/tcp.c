@@ -173,6 +173,113 @@ out:
     return rv;
 }
 
+/*
+ * Receives are kept posted EFI_TCP_RX_TOKENS at a time, each into a
+ * buffer of its own.  The driver fills them in the order they were
+ * posted, core_tcp_fill_buffer() hands them out in that order and
+ * posts each again once its data has been used up, so the firmware
+ * always has somewhere to put what comes in.
+ */
+#define EFI_TCP_RX_TOKENS	8
+#define EFI_TCP_RX_BUFSIZE	16384	/* tftp_bytesleft is 16 bits */
+
+struct efi_tcp_rxtok {
+    EFI_TCP4_IO_TOKEN iotoken;
+    EFI_TCP4_RECEIVE_DATA rxdata;
+    volatile bool done;
+    char buf[EFI_TCP_RX_BUFSIZE];
+};
+
+struct efi_tcp_rx {
+    struct efi_tcp_rxtok tok[EFI_TCP_RX_TOKENS];
+    int next;			/* Token to hand out next */
+    int held;			/* Token the caller is reading, or -1 */
+};
+
+static EFIAPI void tcp_rx_cb(EFI_EVENT ev, void *context)
+{
+    struct efi_tcp_rxtok *t = context;
+
+    (void)ev;
+
+    t->done = true;
+}
+
+static void efi_tcp_rx_post(EFI_TCP4 *tcp, struct efi_tcp_rxtok *t)
+{
+    EFI_TCP4_FRAGMENT_DATA *frag = &t->rxdata.FragmentTable[0];
+    EFI_STATUS status;
+
+    t->rxdata.FragmentCount = 1;
+    t->rxdata.DataLength = EFI_TCP_RX_BUFSIZE;
+    frag->FragmentBuffer = t->buf;
+    frag->FragmentLength = EFI_TCP_RX_BUFSIZE;
+    t->iotoken.Packet.RxData = &t->rxdata;
+
+    t->done = false;
+    status = uefi_call_wrapper(tcp->Receive, 2, tcp, &t->iotoken);
+    if (status != EFI_SUCCESS) {
+	/* EFI_CONNECTION_FIN, most likely; it ends the stream here */
+	t->iotoken.CompletionToken.Status = status;
+	t->done = true;
+    }
+}
+
+/*
+ * The binding has to be gone first, so that no token is still posted
+ */
+static void efi_tcp_rx_free(struct pxe_pvt_inode *socket)
+{
+    struct efi_tcp_rx *rx = socket->net.efi.tcp_rx;
+    int i;
+
+    if (!rx)
+	return;
+
+    for (i = 0; i < EFI_TCP_RX_TOKENS; i++) {
+	if (rx->tok[i].iotoken.CompletionToken.Event)
+	    uefi_call_wrapper(BS->CloseEvent, 1,
+			      rx->tok[i].iotoken.CompletionToken.Event);
+    }
+
+    free(rx);
+    socket->net.efi.tcp_rx = NULL;
+}
+
+static struct efi_tcp_rx *efi_tcp_rx_get(struct pxe_pvt_inode *socket)
+{
+    struct efi_tcp_rx *rx = socket->net.efi.tcp_rx;
+    EFI_TCP4 *tcp = (EFI_TCP4 *)socket->net.efi.binding->this;
+    struct efi_tcp_rxtok *t;
+    EFI_STATUS status;
+    int i;
+
+    if (rx)
+	return rx;
+
+    rx = zalloc(sizeof(*rx));
+    if (!rx)
+	return NULL;
+
+    rx->held = -1;
+    socket->net.efi.tcp_rx = rx;
+
+    for (i = 0; i < EFI_TCP_RX_TOKENS; i++) {
+	t = &rx->tok[i];
+	status = efi_setup_event(&t->iotoken.CompletionToken.Event,
+				 (EFI_EVENT_NOTIFY)tcp_rx_cb, t);
+	if (status != EFI_SUCCESS) {
+	    efi_tcp_rx_free(socket);
+	    return NULL;
+	}
+    }
+
+    for (i = 0; i < EFI_TCP_RX_TOKENS; i++)
+	efi_tcp_rx_post(tcp, &rx->tok[i]);
+
+    return rx;
+}
+
 void core_tcp_close_file(struct inode *inode)
 {
     struct pxe_pvt_inode *socket = PVT(inode);
@@ -197,60 +304,47 @@ void core_tcp_close_file(struct inode *inode)
 
     efi_destroy_binding(b, &Tcp4ServiceBindingProtocol);
     socket->net.efi.binding = NULL;
+    efi_tcp_rx_free(socket);
 }
 
-static char databuf[8192];
-
 void core_tcp_fill_buffer(struct inode *inode)
 {
     struct pxe_pvt_inode *socket = PVT(inode);
     struct efi_binding *b = socket->net.efi.binding;
-    EFI_TCP4_IO_TOKEN iotoken;
-    EFI_TCP4_RECEIVE_DATA rxdata;
-    EFI_TCP4_FRAGMENT_DATA *frag;
-    EFI_STATUS status;
     EFI_TCP4 *tcp = (EFI_TCP4 *)b->this;
-    void *data;
+    struct efi_tcp_rxtok *t;
+    struct efi_tcp_rx *rx;
     size_t len;
 
-    memset(&iotoken, 0, sizeof(iotoken));
-    memset(&rxdata, 0, sizeof(rxdata));
-
-    status = efi_setup_event(&iotoken.CompletionToken.Event,
-		      (EFI_EVENT_NOTIFY)tcp_cb, &iotoken.CompletionToken);
-    if (status != EFI_SUCCESS)
-	return;
+    rx = efi_tcp_rx_get(socket);
+    if (!rx)
+	goto eof;
 
-    iotoken.Packet.RxData = &rxdata;
-    rxdata.FragmentCount = 1;
-    rxdata.DataLength = sizeof(databuf);
-    frag = &rxdata.FragmentTable[0];
-    frag->FragmentBuffer = databuf;
-    frag->FragmentLength = sizeof(databuf);
-
-    status = uefi_call_wrapper(tcp->Receive, 2, tcp, &iotoken);
-    if (status == EFI_CONNECTION_FIN) {
-	socket->tftp_goteof = 1;
-	if (inode->size == (uint64_t)-1)
-	    inode->size = socket->tftp_filepos;
-	socket->ops->close(inode);
-	goto out;
+    /* What we handed out last time has been used up */
+    if (rx->held >= 0) {
+	efi_tcp_rx_post(tcp, &rx->tok[rx->held]);
+	rx->held = -1;
     }
 
-    while (cb_status == -1)
+    t = &rx->tok[rx->next];
+    while (!t->done)
 	uefi_call_wrapper(tcp->Poll, 1, tcp);
 
-    /* Reset */
-    cb_status = -1;
+    if (t->iotoken.CompletionToken.Status != EFI_SUCCESS)
+	goto eof;
 
-    len = frag->FragmentLength;
-    memcpy(databuf, frag->FragmentBuffer, len);
-    data = databuf;
+    rx->held = rx->next;
+    rx->next = (rx->next + 1) % EFI_TCP_RX_TOKENS;
 
-    socket->tftp_dataptr = data;
+    len = t->rxdata.FragmentTable[0].FragmentLength;
+    socket->tftp_dataptr = t->buf;
     socket->tftp_filepos += len;
     socket->tftp_bytesleft = len;
+    return;
 
-out:
-    uefi_call_wrapper(BS->CloseEvent, 1, iotoken.CompletionToken.Event);
+eof:
+    socket->tftp_goteof = 1;
+    if (inode->size == (uint64_t)-1)
+	inode->size = socket->tftp_filepos;
+    socket->ops->close(inode);
 }
@@ -13,6 +13,10 @@ extern EFI_GUID Udp4ServiceBindingProtocol, Udp4Protocol;
 static int volatile efi_udp_has_recv = 0;
 int volatile efi_net_def_addr = 1;
 
+struct efi_udp_rx;
+static void efi_udp_rx_flush(struct efi_udp_rx *rx);
+static void efi_udp_rx_free(struct pxe_pvt_inode *socket);
+
 /** 
  * Try to configure this UDP socket
  *
@@ -113,6 +117,7 @@ void core_udp_close(struct pxe_pvt_inode *socket)
     if (!socket->net.efi.binding)
 	return;
 
+    efi_udp_rx_free(socket);
     efi_destroy_binding(socket->net.efi.binding, &Udp4ServiceBindingProtocol);
     socket->net.efi.binding = NULL;
 }
@@ -174,11 +179,15 @@ void core_udp_disconnect(struct pxe_pvt_inode *socket)
 
     udp = (EFI_UDP4 *)socket->net.efi.binding->this;
 
-    /* Reset */
+    /* Reset; this aborts the posted receives */
     status = uefi_call_wrapper(udp->Configure, 2, udp, NULL);
     if (status != EFI_SUCCESS)
 	Print(L"Failed to reset UDP: %d\n", status);
 
+    /* Whatever came in for the old connection is of no use */
+    if (socket->net.efi.rx)
+	efi_udp_rx_flush(socket->net.efi.rx);
+
 }
 
 static int volatile cb_status = -1;
@@ -194,6 +203,147 @@ static EFIAPI void udp4_cb(EFI_EVENT event, void *context)
 	cb_status = 1;
 }
 
+/*
+ * Receives are kept posted EFI_UDP_RX_TOKENS at a time, so that the
+ * datagrams of a burst (a TFTP window, say) that arrive between two
+ * calls of core_udp_recv_split() have somewhere to go.  udp4_rx_cb()
+ * queues each one that comes in and posts its token again, as long as
+ * the queue has room for whatever the posted tokens may yet bring.
+ */
+#define EFI_UDP_RX_TOKENS	8
+#define EFI_UDP_RX_QUEUE	32	/* Power of 2, > EFI_UDP_RX_TOKENS */
+
+struct efi_udp_rxtok {
+    EFI_UDP4_COMPLETION_TOKEN token;
+    struct efi_udp_rx *rx;
+    volatile bool posted;
+};
+
+struct efi_udp_rx {
+    EFI_UDP4 *udp;
+    struct efi_udp_rxtok tok[EFI_UDP_RX_TOKENS];
+    EFI_UDP4_RECEIVE_DATA * volatile queue[EFI_UDP_RX_QUEUE];
+    volatile unsigned int head;	/* Advanced by udp4_rx_cb() */
+    volatile unsigned int tail;	/* Advanced by core_udp_recv_split() */
+};
+
+static bool efi_udp_rx_room(const struct efi_udp_rx *rx)
+{
+    return rx->head - rx->tail <= EFI_UDP_RX_QUEUE - EFI_UDP_RX_TOKENS;
+}
+
+static void efi_udp_rx_post(struct efi_udp_rxtok *t)
+{
+    EFI_UDP4 *udp = t->rx->udp;
+    EFI_STATUS status;
+
+    t->token.Packet.RxData = NULL;
+    t->posted = true;
+    status = uefi_call_wrapper(udp->Receive, 2, udp, &t->token);
+    if (status != EFI_SUCCESS)
+	t->posted = false;
+}
+
+static EFIAPI void udp4_rx_cb(EFI_EVENT event, void *context)
+{
+    struct efi_udp_rxtok *t = context;
+    struct efi_udp_rx *rx = t->rx;
+
+    (void)event;
+
+    t->posted = false;
+    if (t->token.Status == EFI_ABORTED)
+	return;			/* Cancelled or reset, stay idle */
+
+    if (t->token.Status == EFI_SUCCESS && t->token.Packet.RxData) {
+	rx->queue[rx->head % EFI_UDP_RX_QUEUE] = t->token.Packet.RxData;
+	rx->head++;
+    }
+
+    if (efi_udp_rx_room(rx))
+	efi_udp_rx_post(t);
+}
+
+/*
+ * Post the tokens that are idle, with the callbacks held off
+ */
+static void efi_udp_rx_refill(struct efi_udp_rx *rx)
+{
+    EFI_TPL tpl;
+    int i;
+
+    tpl = uefi_call_wrapper(BS->RaiseTPL, 1, TPL_CALLBACK);
+    for (i = 0; i < EFI_UDP_RX_TOKENS && efi_udp_rx_room(rx); i++) {
+	if (!rx->tok[i].posted)
+	    efi_udp_rx_post(&rx->tok[i]);
+    }
+    uefi_call_wrapper(BS->RestoreTPL, 1, tpl);
+}
+
+/*
+ * Hand the datagrams nobody has read back to the driver
+ */
+static void efi_udp_rx_flush(struct efi_udp_rx *rx)
+{
+    while (rx->head != rx->tail) {
+	uefi_call_wrapper(BS->SignalEvent, 1,
+			  rx->queue[rx->tail % EFI_UDP_RX_QUEUE]->RecycleSignal);
+	rx->tail++;
+    }
+}
+
+static void efi_udp_rx_free(struct pxe_pvt_inode *socket)
+{
+    struct efi_udp_rx *rx = socket->net.efi.rx;
+    int i;
+
+    if (!rx)
+	return;
+
+    /* Completes every posted token with EFI_ABORTED */
+    uefi_call_wrapper(rx->udp->Cancel, 2, rx->udp, NULL);
+    efi_udp_rx_flush(rx);
+
+    for (i = 0; i < EFI_UDP_RX_TOKENS; i++) {
+	if (rx->tok[i].token.Event)
+	    uefi_call_wrapper(BS->CloseEvent, 1, rx->tok[i].token.Event);
+    }
+
+    free(rx);
+    socket->net.efi.rx = NULL;
+}
+
+static struct efi_udp_rx *efi_udp_rx_get(struct pxe_pvt_inode *socket)
+{
+    struct efi_udp_rx *rx = socket->net.efi.rx;
+    struct efi_udp_rxtok *t;
+    EFI_STATUS status;
+    int i;
+
+    if (rx)
+	return rx;
+
+    rx = zalloc(sizeof(*rx));
+    if (!rx)
+	return NULL;
+
+    rx->udp = (EFI_UDP4 *)socket->net.efi.binding->this;
+    socket->net.efi.rx = rx;
+
+    for (i = 0; i < EFI_UDP_RX_TOKENS; i++) {
+	t = &rx->tok[i];
+	t->rx = rx;
+	status = efi_setup_event(&t->token.Event,
+				 (EFI_EVENT_NOTIFY)udp4_rx_cb, t);
+	if (status != EFI_SUCCESS) {
+	    efi_udp_rx_free(socket);
+	    return NULL;
+	}
+    }
+
+    return rx;
+}
+
 /**
  * Read data from the network stack
  *
@@ -207,75 +357,71 @@ static EFIAPI void udp4_cb(EFI_EVENT event, void *context)
 int core_udp_recv(struct pxe_pvt_inode *socket, void *buf, uint16_t *buf_len,
 		  uint32_t *src_ip, uint16_t *src_port)
 {
-    EFI_UDP4_COMPLETION_TOKEN token;
+    return core_udp_recv_split(socket, NULL, 0, buf, buf_len,
+			       src_ip, src_port);
+}
+
+/**
+ * Read a UDP packet, the first hdr_len bytes into hdr and the rest
+ * into buf.  Packets shorter than hdr_len are dropped.
+ */
+int core_udp_recv_split(struct pxe_pvt_inode *socket,
+			void *hdr, uint16_t hdr_len,
+			void *buf, uint16_t *buf_len,
+			uint32_t *src_ip, uint16_t *src_port)
+{
     EFI_UDP4_FRAGMENT_DATA *frag;
     EFI_UDP4_RECEIVE_DATA *rxdata;
-    struct efi_binding *b;
-    EFI_STATUS status;
-    EFI_UDP4 *udp;
+    struct efi_udp_rx *rx;
     size_t size;
-    int rv = -1;
+    int rv = 0;
     jiffies_t start;
 
-    (void)socket;
-
-    b = socket->net.efi.binding;
-    udp = (EFI_UDP4 *)b->this;
-    memset(&token, 0, sizeof(token));
-
-    status = efi_setup_event(&token.Event, (EFI_EVENT_NOTIFY)udp4_cb,
-			     &token);
-    if (status != EFI_SUCCESS)
+    rx = efi_udp_rx_get(socket);
+    if (!rx)
 	return -1;
 
-    status = uefi_call_wrapper(udp->Receive, 2, udp, &token);
-    if (status != EFI_SUCCESS)
-	goto bail;
+    efi_udp_rx_refill(rx);
 
     start = jiffies();
-    while (cb_status == -1) {
+    while (rx->head == rx->tail) {
 	/* 15ms receive timeout... */
 	if (jiffies() - start >= 15) {
-	    if (jiffies() - start >= 30)
-		dprintf("Failed to cancel UDP\n");
-
-	    uefi_call_wrapper(udp->Cancel, 2, udp, &token);
 	    dprintf("core_udp_recv: timed out\n");
 	    if (!efi_udp_has_recv && (efi_net_def_addr == 1)) {
 		efi_net_def_addr = 0;
 		Print(L"disable UseDefaultAddress\n");
 	    }
+	    return -1;
 	}
 
-	uefi_call_wrapper(udp->Poll, 1, udp);
+	uefi_call_wrapper(rx->udp->Poll, 1, rx->udp);
     }
 
-    if (cb_status == 0)
-	rv = 0;
-
-    /* Reset */
-    cb_status = -1;
-
-    if (rv)
-	goto bail;
-
     if (!efi_udp_has_recv)
 	efi_udp_has_recv = 1;
 
-    rxdata = token.Packet.RxData;
+    rxdata = rx->queue[rx->tail % EFI_UDP_RX_QUEUE];
     frag = &rxdata->FragmentTable[0];
 
-    size = min(frag->FragmentLength, *buf_len);
-    memcpy(buf, frag->FragmentBuffer, size);
-    *buf_len = size;
+    if (frag->FragmentLength < hdr_len) {
+	rv = -1;
+    } else {
+	size = min(frag->FragmentLength - hdr_len, *buf_len);
+	memcpy(hdr, frag->FragmentBuffer, hdr_len);
+	memcpy(buf, (char *)frag->FragmentBuffer + hdr_len, size);
+	*buf_len = size;
+    }
 
     memcpy(src_port, &rxdata->UdpSession.SourcePort, sizeof(*src_port));
     memcpy(src_ip, &rxdata->UdpSession.SourceAddress, sizeof(*src_ip));
 
     uefi_call_wrapper(BS->SignalEvent, 1, rxdata->RecycleSignal);
+    rx->tail++;
+
+    /* A slot is free again; a token idle for want of one can go */
+    efi_udp_rx_refill(rx);
 
-bail:
-    uefi_call_wrapper(BS->CloseEvent, 1, token.Event);
     return rv;
 }
 
@@ -337,6 +483,26 @@ bail:
     free(token);
 }
 
+/*
+ * Multicast receive is not wired up to the UDP4 protocol yet, so
+ * multicast TFTP falls back to unicast here.
+ */
+int core_udp_join(struct pxe_pvt_inode *socket, uint32_t group,
+		  uint16_t port)
+{
+    (void)socket;
+    (void)group;
+    (void)port;
+
+    return -1;
+}
+
+void core_udp_leave(struct pxe_pvt_inode *socket, uint32_t group)
+{
+    (void)socket;
+    (void)group;
+}
+
 /**
  * Send a UDP packet to a destination
  *
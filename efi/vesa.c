@@ -31,6 +31,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/fpu.h>
+#include <sys/cpu.h>
+#include <cpufeature.h>
 #include <syslinux/video.h>
 #include <dprintf.h>
 #include "efi.h"
@@ -75,6 +77,135 @@ uint8_t lfb_gsize;
 uint8_t lfb_bsize;
 uint8_t lfb_resv_size;
 
+/*
+ * Unless the framebuffer is write-combining, vesacon draws into a
+ * shadow copy of the screen in memory instead, and what it changed goes
+ * out through GOP->Blt(), a rectangle at a time.  Firmware leaves the
+ * framebuffer uncached as a rule, where every pixel written is a bus
+ * cycle of its own; and a PixelBltOnly mode has no framebuffer at all.
+ *
+ * The changes are kept as a span of columns for each pixel row until
+ * vesacon is done with a redraw; each run of rows with the same span
+ * is one Blt().
+ */
+struct gop_span {
+    uint16_t x0, x1;		/* Nothing to do if x1 <= x0 */
+};
+
+static EFI_GRAPHICS_OUTPUT_PROTOCOL *gop;
+static EFI_GRAPHICS_OUTPUT_BLT_PIXEL *gop_shadow; /* NULL: draw directly */
+static struct gop_span *gop_span;
+static unsigned int gop_width, gop_height;
+static unsigned int gop_y0 = -1U, gop_y1;	/* Rows with a span; y1 is +1 */
+
+#define MSR_MTRRCAP		0x0fe
+#define MSR_MTRR_DEF_TYPE	0x2ff
+#define MSR_MTRR_PHYSBASE(n)	(0x200 + 2*(n))
+#define MSR_MTRR_PHYSMASK(n)	(0x201 + 2*(n))
+
+#define MTRRCAP_VCNT		0x0ff
+#define MTRR_DEF_TYPE_E		0x800
+#define MTRR_PHYSMASK_V		0x800
+#define MTRR_TYPE_UC		0
+#define MTRR_TYPE_WC		1
+
+/*
+ * Does a variable MTRR make the framebuffer write-combining?  Firmware
+ * runs identity mapped with the default PAT, so that is what decides.
+ * Both ends have to be WC, and nothing may make either of them UC.
+ */
+static bool fb_is_wc(uint64_t base, uint64_t size)
+{
+    uint64_t last = base + size - 1;
+    uint64_t mbase, mmask;
+    bool wc_first = false, wc_last = false;
+    bool in_first, in_last;
+    unsigned int i, vcnt;
+
+    if (!size || cpuid_eax(0) < 1 ||
+	!(cpuid_edx(1) & (1 << X86_FEATURE_MTRR)) ||
+	!(rdmsr(MSR_MTRR_DEF_TYPE) & MTRR_DEF_TYPE_E))
+	return false;
+
+    vcnt = rdmsr(MSR_MTRRCAP) & MTRRCAP_VCNT;
+    for (i = 0; i < vcnt; i++) {
+	mbase = rdmsr(MSR_MTRR_PHYSBASE(i));
+	mmask = rdmsr(MSR_MTRR_PHYSMASK(i));
+	if (!(mmask & MTRR_PHYSMASK_V))
+	    continue;
+
+	mmask &= ~0xfffULL;
+	in_first = !((base ^ mbase) & mmask);
+	in_last = !((last ^ mbase) & mmask);
+
+	switch (mbase & 0xff) {
+	case MTRR_TYPE_UC:
+	    if (in_first || in_last)
+		return false;
+	    break;
+	case MTRR_TYPE_WC:
+	    wc_first |= in_first;
+	    wc_last |= in_last;
+	    break;
+	default:
+	    break;
+	}
+    }
+
+    return wc_first && wc_last;
+}
+
+/*
+ * Decide how vesacon gets to the screen.  With a shadow, vesacon sees
+ * it as its framebuffer: 32-bit BGRA, the format Blt() takes, without
+ * any padding.  Returns nonzero if there is no way to draw at all.
+ */
+static int gop_shadow_init(EFI_GRAPHICS_OUTPUT_PROTOCOL *GraphicsOutput,
+			   struct vesa_mode_info *mi,
+			   enum vesa_pixel_format *bestpxf, bool blt_only)
+{
+    EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE *gop_mode = GraphicsOutput->Mode;
+
+    free(gop_shadow);
+    free(gop_span);
+    gop_shadow = NULL;
+    gop_span = NULL;
+    gop_y0 = -1U;
+    gop_y1 = 0;
+
+    if (!blt_only &&
+	fb_is_wc(gop_mode->FrameBufferBase, gop_mode->FrameBufferSize)) {
+	dprintf("GOP: framebuffer is write-combining, drawing directly\n");
+	return 0;
+    }
+
+    gop_shadow = calloc(mi->h_res * mi->v_res, sizeof *gop_shadow);
+    gop_span = calloc(mi->v_res, sizeof *gop_span);
+    if (!gop_shadow || !gop_span) {
+	free(gop_shadow);
+	free(gop_span);
+	gop_shadow = NULL;
+	gop_span = NULL;
+	return blt_only;	/* Otherwise, slow is better than nothing */
+    }
+
+    dprintf("GOP: drawing into a shadow, flushed with Blt()\n");
+    gop = GraphicsOutput;
+    gop_width = mi->h_res;
+    gop_height = mi->v_res;
+
+    mi->mode_attr = 0x0080;	/* Looks like a linear framebuffer */
+    mi->lfb_ptr = (uint8_t *)gop_shadow;
+    mi->bpp = 32;
+    mi->bpos = 0;
+    mi->gpos = 8;
+    mi->rpos = 16;
+    mi->resv_pos = 24;
+    mi->logical_scan = mi->h_res * sizeof *gop_shadow;
+    *bestpxf = PXF_BGRA32;
+    return 0;
+}
+
 static int efi_vesacon_set_mode(struct vesa_info *vesa_info, int *x, int *y,
 				enum vesa_pixel_format *bestpxf)
 {
@@ -221,10 +352,8 @@ static int efi_vesacon_set_mode(struct vesa_info *vesa_info, int *x, int *y,
 	}
 	break;
     case PixelBltOnly:
-	/* FIXME: unsupported */
-	mi->mode_attr = 0x0000;		/* no support for physical frame buffer */
-	err = 4; /* no mode found */
-	goto exit;
+	/* No framebuffer; gop_shadow_init() sets up the rest */
+	dprintf("BltOnly ");
 	break;
     default:
 	/* should not get here, but let's error out */
@@ -233,8 +362,6 @@ static int efi_vesacon_set_mode(struct vesa_info *vesa_info, int *x, int *y,
 	break;
     }		   
     
-    memcpy(&vesa_info->mi, mi, sizeof *mi);
-
     /* Now set video mode */
     st = uefi_call_wrapper(GraphicsOutput->SetMode, 2, GraphicsOutput, bestmode);
     if (EFI_ERROR(st)) {
@@ -243,10 +370,22 @@ static int efi_vesacon_set_mode(struct vesa_info *vesa_info, int *x, int *y,
 	goto exit;
     }	
 
-    /* TODO: Follow the code usage of vesacon_background & vesacon_shadowfb */
+    /* The framebuffer can move with the mode */
+    mi->lfb_ptr = (uint8_t *)(VOID *)(UINTN)gop_mode->FrameBufferBase;
+    lfb_size = gop_mode->FrameBufferSize;
+
+    if (gop_shadow_init(GraphicsOutput, mi, bestpxf,
+			mode_info->PixelFormat == PixelBltOnly)) {
+	err = 10;		/* Out of memory */
+	goto exit;
+    }
+
+    memcpy(&vesa_info->mi, mi, sizeof *mi);
+
+    /* TODO: Follow the code usage of the vesacon background buffers */
     /*
      __vesacon_background = calloc(mi->h_res*mi->v_res, 4);
-     __vesacon_shadowfb = calloc(mi->h_res*mi->v_res, 4);
+     __vesacon_fb_background = calloc(mi->h_res*mi->v_res, 4);
      */
      /* FIXME: the allocation takes the possible padding into account
       * whereas   BIOS code simply allocates hres * vres bytes.
@@ -277,12 +416,74 @@ static void efi_vesacon_screencpy(size_t dst, const uint32_t *s,
 {
     size_t win_off;
     char *win_base = wi->win_base;
- 
-    /* For EFI, we simply take the offset from the framebuffer and write to it
-     * FIXME: any gotchas?
-     */
-    win_off = dst;
-    memcpy(win_base + win_off, s, bytes);
+    unsigned int x, y, w;
+    struct gop_span *sp;
+
+    if (!gop_shadow) {
+	/* Write-combining: we simply take the offset from the
+	 * framebuffer and write to it */
+	win_off = dst;
+	memcpy(win_base + win_off, s, bytes);
+	return;
+    }
+
+    y = dst / (gop_width * sizeof *gop_shadow);
+    x = dst / sizeof *gop_shadow - y * gop_width;
+    w = bytes / sizeof *gop_shadow;
+    if (y >= gop_height || x >= gop_width)
+	return;
+    if (w > gop_width - x)
+	w = gop_width - x;
+
+    memcpy(&gop_shadow[y * gop_width + x], s, w * sizeof *gop_shadow);
+
+    sp = &gop_span[y];
+    if (sp->x1 <= sp->x0) {
+	sp->x0 = x;
+	sp->x1 = x + w;
+    } else {
+	if (x < sp->x0)
+	    sp->x0 = x;
+	if (x + w > sp->x1)
+	    sp->x1 = x + w;
+    }
+    if (y < gop_y0)
+	gop_y0 = y;
+    if (y >= gop_y1)
+	gop_y1 = y + 1;
+}
+
+/* Blt() what changed in the shadow, one rectangle for each run of rows */
+static void efi_vesacon_flush(void)
+{
+    unsigned int y, y0;
+    struct gop_span *sp;
+
+    if (!gop_shadow || gop_y1 <= gop_y0)
+	return;
+
+    y = gop_y0;
+    while (y < gop_y1) {
+	sp = &gop_span[y];
+	if (sp->x1 <= sp->x0) {
+	    y++;
+	    continue;
+	}
+
+	y0 = y;
+	while (++y < gop_y1 &&
+	       gop_span[y].x0 == sp->x0 && gop_span[y].x1 == sp->x1)
+	    ;
+
+	uefi_call_wrapper(gop->Blt, 10, gop, gop_shadow, EfiBltBufferToVideo,
+			  (UINTN)sp->x0, (UINTN)y0, (UINTN)sp->x0, (UINTN)y0,
+			  (UINTN)(sp->x1 - sp->x0), (UINTN)(y - y0),
+			  (UINTN)(gop_width * sizeof *gop_shadow));
+    }
+
+    memset(&gop_span[gop_y0], 0, (gop_y1 - gop_y0) * sizeof *gop_span);
+    gop_y0 = -1U;
+    gop_y1 = 0;
 }
 
 static int efi_vesacon_font_query(uint8_t **font)
@@ -307,4 +508,5 @@ struct vesa_ops efi_vesa_ops = {
 	.set_mode = efi_vesacon_set_mode,
 	.screencpy = efi_vesacon_screencpy,
 	.font_query = efi_vesacon_font_query,
+	.flush = efi_vesacon_flush,
 };
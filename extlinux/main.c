@@ -38,6 +38,7 @@
 #include <sysexits.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <sys/sysmacros.h>
 #include <sys/types.h>
 #include <sys/mount.h>
@@ -234,9 +235,9 @@ static int patch_file_and_bootblock(int fd, const char *dir, int devfd)
 {
     struct stat dirst, xdst;
     struct hd_geometry geo;
-    sector_t *sectp;
+    struct sector_extent *ext, btrfs_ext[2];
     uint64_t totalbytes, totalsectors;
-    int nsect;
+    int nsect, next;
     struct fat_boot_sector *sbs;
     char *dirpath, *subpath, *xdirpath;
     int rv;
@@ -314,27 +315,28 @@ static int patch_file_and_bootblock(int fd, const char *dir, int devfd)
     dprintf("directory inode = %lu\n", (unsigned long)dirst.st_ino);
     nsect = (boot_image_len + SECTOR_SIZE - 1) >> SECTOR_SHIFT;
     nsect += 2;			/* Two sectors for the ADV */
-    sectp = alloca(sizeof(sector_t) * nsect);
+    ext = NULL;
+    next = 0;
     if (fs_type == EXT2 || fs_type == VFAT || fs_type == NTFS ||
 	fs_type == XFS || fs_type == UFS1 || fs_type == UFS2) {
-	if (sectmap(fd, sectp, nsect)) {
+	next = sectmap(fd, nsect, &ext);
+	if (next < 0) {
 		perror("bmap");
 		exit(1);
 	}
     } else if (fs_type == BTRFS) {
-	int i;
-	sector_t *sp = sectp;
-
-	for (i = 0; i < nsect - 2; i++)
-	    *sp++ = BTRFS_EXTLINUX_OFFSET/SECTOR_SIZE + i;
-	for (i = 0; i < 2; i++)
-	    *sp++ = BTRFS_ADV_OFFSET/SECTOR_SIZE + i;
+	btrfs_ext[0].lba = BTRFS_EXTLINUX_OFFSET/SECTOR_SIZE;
+	btrfs_ext[0].len = nsect - 2;
+	btrfs_ext[1].lba = BTRFS_ADV_OFFSET/SECTOR_SIZE;
+	btrfs_ext[1].len = 2;
+	next = 2;
     }
 
     /* Create the modified image in memory */
-    rv = syslinux_patch(sectp, nsect, opt.stupid_mode,
-			opt.raid_mode, subpath, subvol);
+    rv = syslinux_patch_extents(ext ? ext : btrfs_ext, next, opt.stupid_mode,
+				opt.raid_mode, subpath, subvol);
 
+    free(ext);
     free(dirpath);
     return rv;
 }
@@ -370,15 +372,93 @@ static int ext_read_adv(const char *path, int devfd, const char **namep)
     }
 }
 
-static int ext_write_adv_offset(int devfd, off_t offset)
+/*
+ * Set when an install or update has written anything to the disk, so
+ * that one that finds everything already in place doesn't sync.
+ */
+static bool disk_written;
+
+/*
+ * Write LEN bytes at OFFSET, but only the sectors of it whose contents
+ * differ from what is there already.  Returns 0 on success.
+ */
+static int write_changed(int fd, const void *buf, size_t len, off_t offset)
 {
-    const size_t adv_size = 2 * ADV_SIZE;
+    const char *new = buf;
+    char *old;
+    ssize_t rv;
+    size_t got, pos, start, chunk;
 
-    if (xpwrite(devfd, syslinux_adv, adv_size, offset) != adv_size) {
-	perror("writing adv");
-	return 1;
+    old = malloc(len);
+    if (!old)
+	return -1;
+
+    /*
+     * Not xpread(): a short file, or a write-only descriptor, just
+     * means there is less to compare against.
+     */
+    for (got = 0; got < len; got += rv) {
+	rv = pread(fd, old + got, len - got, offset + got);
+	if (rv <= 0) {
+	    if (rv < 0 && errno == EINTR) {
+		rv = 0;
+		continue;
+	    }
+	    break;
+	}
     }
 
+    /* Write each run of changed sectors in one go */
+    for (pos = 0; pos < len; ) {
+	chunk = len - pos < SECTOR_SIZE ? len - pos : SECTOR_SIZE;
+	if (pos + chunk <= got &&
+	    !memcmp(old + pos, new + pos, chunk)) {
+	    pos += chunk;
+	    continue;
+	}
+
+	start = pos;
+	while (pos < len) {
+	    chunk = len - pos < SECTOR_SIZE ? len - pos : SECTOR_SIZE;
+	    if (pos + chunk <= got &&
+		!memcmp(old + pos, new + pos, chunk))
+		break;
+	    pos += chunk;
+	}
+
+	if (xpwrite(fd, new + start, pos - start, offset + start)
+	    != (ssize_t)(pos - start)) {
+	    free(old);
+	    return -1;
+	}
+	disk_written = true;
+    }
+
+    free(old);
+    return 0;
+}
+
+/*
+ * Write the ADV one copy at a time, making sure the first is on the
+ * disk before the second is touched, so there is always a good copy
+ */
+static int ext_write_adv_offset(int devfd, off_t offset)
+{
+    bool written = disk_written;
+    int i;
+
+    for (i = 0; i < 2; i++) {
+	disk_written = false;
+	if (write_changed(devfd, syslinux_adv + i * ADV_SIZE, ADV_SIZE,
+			  offset + i * ADV_SIZE) ||
+	    (disk_written && fsync(devfd))) {
+	    perror("writing adv");
+	    return 1;
+	}
+	written |= disk_written;
+    }
+
+    disk_written = written;
     return 0;
 }
 
@@ -482,32 +562,29 @@ int install_bootblock(int fd, const char *device)
 
     if (fs_type == VFAT) {
 	struct fat_boot_sector *sbs = (struct fat_boot_sector *)syslinux_bootsect;
-        if (xpwrite(fd, &sbs->FAT_bsHead, FAT_bsHeadLen, 0) != FAT_bsHeadLen ||
-	    xpwrite(fd, &sbs->FAT_bsCode, FAT_bsCodeLen,
-		    offsetof(struct fat_boot_sector, FAT_bsCode)) != FAT_bsCodeLen) {
+        if (write_changed(fd, &sbs->FAT_bsHead, FAT_bsHeadLen, 0) ||
+	    write_changed(fd, &sbs->FAT_bsCode, FAT_bsCodeLen,
+			  offsetof(struct fat_boot_sector, FAT_bsCode))) {
 	    perror("writing fat bootblock");
 	    return 1;
 	}
     } else if (fs_type == NTFS) {
         struct ntfs_boot_sector *sbs =
                 (struct ntfs_boot_sector *)syslinux_bootsect;
-        if (xpwrite(fd, &sbs->NTFS_bsHead,
-                    NTFS_bsHeadLen, 0) != NTFS_bsHeadLen ||
-                    xpwrite(fd, &sbs->NTFS_bsCode, NTFS_bsCodeLen,
-                    offsetof(struct ntfs_boot_sector,
-                    NTFS_bsCode)) != NTFS_bsCodeLen) {
+        if (write_changed(fd, &sbs->NTFS_bsHead, NTFS_bsHeadLen, 0) ||
+                    write_changed(fd, &sbs->NTFS_bsCode, NTFS_bsCodeLen,
+                    offsetof(struct ntfs_boot_sector, NTFS_bsCode))) {
             perror("writing ntfs bootblock");
             return 1;
         }
     } else if (fs_type == XFS) {
-	if (xpwrite(fd, syslinux_bootsect, syslinux_bootsect_len,
-		    XFS_BOOTSECT_OFFSET) != syslinux_bootsect_len) {
+	if (write_changed(fd, syslinux_bootsect, syslinux_bootsect_len,
+			  XFS_BOOTSECT_OFFSET)) {
 	    perror("writing xfs bootblock");
 	    return 1;
 	}
     } else {
-	if (xpwrite(fd, syslinux_bootsect, syslinux_bootsect_len, 0)
-	    != syslinux_bootsect_len) {
+	if (write_changed(fd, syslinux_bootsect, syslinux_bootsect_len, 0)) {
 	    perror("writing bootblock");
 	    return 1;
 	}
@@ -518,10 +595,32 @@ int install_bootblock(int fd, const char *device)
 
 static int rewrite_boot_image(int devfd, const char *path, const char *filename)
 {
+    struct stat st;
     int fd;
     int ret;
     int modbytes;
 
+    /*
+     * An existing LDLINUX.SYS of the right size keeps its blocks: map
+     * it, patch the image to match, and write only what has changed.
+     */
+    fd = open(filename, O_RDWR);
+    if (fd >= 0) {
+	if (!fstat(fd, &st) && S_ISREG(st.st_mode) &&
+	    st.st_size == boot_image_len + 2 * ADV_SIZE) {
+	    patch_file_and_bootblock(fd, path, devfd);
+	    if (write_changed(fd, (const char _force *)boot_image,
+			      boot_image_len, 0) ||
+		ext_write_adv_offset(fd, boot_image_len)) {
+		fprintf(stderr, "%s: write failure on %s\n", program,
+			filename);
+		goto error;
+	    }
+	    return fd;
+	}
+	close(fd);
+    }
+
     /* Let's create LDLINUX.SYS file again (if it already exists, of course) */
     fd = open(filename,  O_WRONLY | O_TRUNC | O_CREAT | O_SYNC,
 	      S_IRUSR | S_IRGRP | S_IROTH);
@@ -529,6 +628,7 @@ static int rewrite_boot_image(int devfd, const char *path, const char *filename)
 	perror(filename);
 	return -1;
     }
+    disk_written = true;
 
     /* Write boot image data into LDLINUX.SYS file */
     ret = xpwrite(fd, (const char _force *)boot_image, boot_image_len, 0);
@@ -562,6 +662,75 @@ error:
     return -1;
 }
 
+/*
+ * Install ldlinux.c32, leaving an identical one alone
+ */
+static int install_c32(const char *file)
+{
+    struct stat st;
+    int fd, rv;
+
+    fd = open(file, O_RDWR);
+    if (fd >= 0) {
+	if (!fstat(fd, &st) && S_ISREG(st.st_mode) &&
+	    st.st_size == syslinux_ldlinuxc32_len) {
+	    rv = write_changed(fd, (const char _force *)syslinux_ldlinuxc32,
+			       syslinux_ldlinuxc32_len, 0);
+	    close(fd);
+	    if (rv)
+		fprintf(stderr, "%s: write failure on %s\n", program, file);
+	    return rv ? 1 : 0;
+	}
+	close(fd);
+    }
+
+    fd = open(file, O_WRONLY | O_TRUNC | O_CREAT | O_SYNC,
+	      S_IRUSR | S_IRGRP | S_IROTH);
+    if (fd < 0) {
+	perror(file);
+	return 1;
+    }
+    disk_written = true;
+
+    rv = xpwrite(fd, (const char _force *)syslinux_ldlinuxc32,
+		 syslinux_ldlinuxc32_len, 0);
+    close(fd);
+    if (rv != (int)syslinux_ldlinuxc32_len) {
+	fprintf(stderr, "%s: write failure on %s\n", program, file);
+	return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Record where ldlinux.c32 is in the boot image, so the core can load
+ * it without a lookup; this has to be done before the image is patched.
+ * If it can't be mapped the core just looks it up as before.
+ */
+static void preload_c32(const char *file)
+{
+    struct sector_extent *ext;
+    int fd, next;
+
+    fd = open(file, O_RDONLY);
+    if (fd < 0)
+	return;
+
+    if (!fsync(fd)) {
+	next = sectmap(fd, (syslinux_ldlinuxc32_len + SECTOR_SIZE - 1)
+		       >> SECTOR_SHIFT, &ext);
+	if (next > 0) {
+	    syslinux_preload("ldlinux.c32", ext, next,
+			     (const void _force *)syslinux_ldlinuxc32,
+			     syslinux_ldlinuxc32_len);
+	    free(ext);
+	}
+    }
+
+    close(fd);
+}
+
 int ext2_fat_install_file(const char *path, int devfd, struct stat *rst)
 {
     char *file, *oldfile, *c32file;
@@ -595,6 +764,12 @@ int ext2_fat_install_file(const char *path, int devfd, struct stat *rst)
 	clear_attributes(fd);
     }
     close(fd);
+    fd = -1;
+
+    /* ldlinux.c32 goes first, so ldlinux.sys can say where it is */
+    if (install_c32(c32file))
+	goto bail;
+    preload_c32(c32file);
 
     fd = rewrite_boot_image(devfd, path, file);
     if (fd < 0)
@@ -620,20 +795,6 @@ int ext2_fat_install_file(const char *path, int devfd, struct stat *rst)
 	unlink(oldfile);
     }
 
-    fd = open(c32file, O_WRONLY | O_TRUNC | O_CREAT | O_SYNC,
-	      S_IRUSR | S_IRGRP | S_IROTH);
-    if (fd < 0) {
-	perror(c32file);
-	goto bail;
-    }
-
-    r3 = xpwrite(fd, (const char _force *)syslinux_ldlinuxc32,
-		 syslinux_ldlinuxc32_len, 0);
-    if (r3 != syslinux_ldlinuxc32_len) {
-	fprintf(stderr, "%s: write failure on %s\n", program, c32file);
-	goto bail;
-    }
-
     free(file);
     free(oldfile);
     free(c32file);
@@ -660,12 +821,11 @@ bail:
 int btrfs_install_file(const char *path, int devfd, struct stat *rst)
 {
     char *file;
-    int fd, rv;
+    int rv;
 
     patch_file_and_bootblock(-1, path, devfd);
-    if (xpwrite(devfd, (const char _force *)boot_image,
-		boot_image_len, BTRFS_EXTLINUX_OFFSET)
-		!= boot_image_len) {
+    if (write_changed(devfd, (const char _force *)boot_image,
+		      boot_image_len, BTRFS_EXTLINUX_OFFSET)) {
 	perror("writing bootblock");
 	return 1;
     }
@@ -691,23 +851,7 @@ int btrfs_install_file(const char *path, int devfd, struct stat *rst)
 	return 1;
     }
 
-    fd = open(file, O_WRONLY | O_TRUNC | O_CREAT | O_SYNC,
-	      S_IRUSR | S_IRGRP | S_IROTH);
-    if (fd < 0) {
-	perror(file);
-	free(file);
-	return 1;
-    }
-
-    rv = xpwrite(fd, (const char _force *)syslinux_ldlinuxc32,
-		 syslinux_ldlinuxc32_len, 0);
-    if (rv != (int)syslinux_ldlinuxc32_len) {
-	fprintf(stderr, "%s: write failure on %s\n", program, file);
-	rv = 1;
-    } else
-	rv = 0;
-
-    close(fd);
+    rv = install_c32(file);
     free(file);
     return rv;
 }
@@ -727,7 +871,6 @@ static int xfs_install_file(const char *path, int devfd, struct stat *rst)
     static char c32file[PATH_MAX + 1];
     int dirfd = -1;
     int fd = -1;
-    int retval;
 
     snprintf(file, PATH_MAX + 1, "%s%sldlinux.sys", path,
 	     path[0] && path[strlen(path) - 1] == '/' ? "" : "/");
@@ -751,6 +894,11 @@ static int xfs_install_file(const char *path, int devfd, struct stat *rst)
     }
 
     close(fd);
+    fd = -1;
+
+    if (install_c32(c32file))
+	goto bail;
+    preload_c32(c32file);
 
     fd = rewrite_boot_image(devfd, path, file);
     if (fd < 0)
@@ -768,26 +916,8 @@ static int xfs_install_file(const char *path, int devfd, struct stat *rst)
     close(dirfd);
     close(fd);
 
-    dirfd = -1;
-    fd = -1;
-
-    fd = open(c32file, O_WRONLY | O_TRUNC | O_CREAT | O_SYNC,
-	      S_IRUSR | S_IRGRP | S_IROTH);
-    if (fd < 0) {
-	perror(c32file);
-	goto bail;
-    }
-
-    retval = xpwrite(fd, (const char _force *)syslinux_ldlinuxc32,
-		     syslinux_ldlinuxc32_len, 0);
-    if (retval != (int)syslinux_ldlinuxc32_len) {
-	fprintf(stderr, "%s: write failure on %s\n", program, file);
-	goto bail;
-    }
-
-    close(fd);
-
-    sync();
+    if (disk_written)
+	sync();
 
     return 0;
 
@@ -1511,11 +1641,14 @@ static int install_loader(const char *path, int update_only)
 	return 1;
     }
 
-    sync();
+    /* ldlinux.sys has to be on the disk before the boot sector is */
+    if (disk_written)
+	sync();
     rv = install_bootblock(devfd, devname);
     free(devname);
     close(devfd);
-    sync();
+    if (disk_written)
+	sync();
 
     return rv;
 }
@@ -1548,19 +1681,111 @@ int modify_existing_adv(const char *path)
     return 0;
 }
 
+/*
+ * Install on, or modify the ADV of, one directory
+ */
+static int run_target(const char *path)
+{
+    if (opt.update_only == -1)
+	return modify_existing_adv(path);
+    else
+	return install_loader(path, opt.update_only);
+}
+
+/*
+ * Handle several directories, each in a child process of its own and
+ * up to opt.jobs of them at a time.  Everything an install works on,
+ * the ADV and the patched ldlinux.sys image included, is per process,
+ * so the installs don't get in each other's way.
+ */
+static int run_targets(const char **dirs, int ndirs)
+{
+    pid_t *pids;
+    int i, next, running, status, failed = 0;
+    int jobs = opt.jobs > 0 && opt.jobs < ndirs ? opt.jobs : ndirs;
+    pid_t pid;
+
+    pids = calloc(ndirs, sizeof *pids);
+    if (!pids) {
+	perror(program);
+	return 1;
+    }
+
+    /* The children share our stdio buffers; don't let them flush ours */
+    fflush(NULL);
+
+    next = running = 0;
+    while (next < ndirs || running) {
+	if (next < ndirs && running < jobs) {
+	    pid = fork();
+	    if (pid < 0) {
+		perror(program);
+		failed++;
+		next++;
+		continue;
+	    }
+	    if (!pid) {
+		status = run_target(dirs[next]);
+		fflush(NULL);
+		_exit(status);
+	    }
+	    pids[next++] = pid;
+	    running++;
+	    continue;
+	}
+
+	pid = wait(&status);
+	if (pid < 0)
+	    break;
+	for (i = 0; i < next; i++) {
+	    if (pids[i] == pid)
+		break;
+	}
+	if (i == next)
+	    continue;		/* Not one of ours */
+	running--;
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+	    fprintf(stderr, "%s: %s: failed\n", program, dirs[i]);
+	    failed++;
+	}
+    }
+
+    free(pids);
+    return failed ? 1 : 0;
+}
+
 int main(int argc, char *argv[])
 {
+    const char **dirs;
+    int i;
+
     parse_options(argc, argv, MODE_EXTLINUX);
 
     if (!opt.directory || opt.install_mbr || opt.activate_partition)
 	usage(EX_USAGE, 0);
 
-    if (opt.update_only == -1) {
-	if (opt.reset_adv || opt.set_once || opt.menu_save)
-	    return modify_existing_adv(opt.directory);
-	else
-	    usage(EX_USAGE, MODE_EXTLINUX);
+    if (opt.update_only == -1 &&
+	!(opt.reset_adv || opt.set_once || opt.menu_save))
+	usage(EX_USAGE, MODE_EXTLINUX);
+
+    if (!opt.n_more_dirs)
+	return run_target(opt.directory);
+
+    /* A forced device can only be right for one of them */
+    if (opt.device)
+	usage(EX_USAGE, MODE_EXTLINUX);
+
+    dirs = malloc((opt.n_more_dirs + 1) * sizeof *dirs);
+    if (!dirs) {
+	perror(program);
+	return 1;
     }
+    dirs[0] = opt.directory;
+    for (i = 0; i < opt.n_more_dirs; i++)
+	dirs[i + 1] = opt.more_dirs[i];
 
-    return install_loader(opt.directory, opt.update_only);
+    i = run_targets(dirs, opt.n_more_dirs + 1);
+    free(dirs);
+    return i;
 }
@@ -13,40 +13,100 @@
 /*
  * cache.c
  *
- * Simple sector cache
+ * Sector cache: a fixed number of sectors, hashed by sector number
+ * and recycled least recently used first, so that mapping a file on a
+ * large volume neither walks a long list for every FAT lookup nor
+ * holds on to every sector it has seen.
  */
 
 #include <stdlib.h>
 #include "libfatint.h"
 
+static inline unsigned int hash_sector(libfat_sector_t n)
+{
+    return ((uint32_t)n * 0x9e370001U) >> (32 - LIBFAT_HASH_SHIFT);
+}
+
+static void lru_unlink(struct libfat_filesystem *fs, struct libfat_sector *ls)
+{
+    if (ls->lru_next == ls) {
+	fs->lru = NULL;
+    } else {
+	ls->lru_prev->lru_next = ls->lru_next;
+	ls->lru_next->lru_prev = ls->lru_prev;
+	if (fs->lru == ls)
+	    fs->lru = ls->lru_next;
+    }
+}
+
+/* Make LS the most recently used sector */
+static void lru_push(struct libfat_filesystem *fs, struct libfat_sector *ls)
+{
+    struct libfat_sector *head = fs->lru;
+
+    if (!head) {
+	ls->lru_prev = ls->lru_next = ls;
+    } else {
+	ls->lru_next = head;
+	ls->lru_prev = head->lru_prev;
+	head->lru_prev->lru_next = ls;
+	head->lru_prev = ls;
+    }
+    fs->lru = ls;
+}
+
+static void hash_unlink(struct libfat_filesystem *fs, struct libfat_sector *ls)
+{
+    struct libfat_sector **lsp = &fs->hash[hash_sector(ls->n)];
+
+    while (*lsp != ls)
+	lsp = &(*lsp)->next;
+    *lsp = ls->next;
+}
+
 void *libfat_get_sector(struct libfat_filesystem *fs, libfat_sector_t n)
 {
     struct libfat_sector *ls;
+    unsigned int h = hash_sector(n);
 
-    for (ls = fs->sectors; ls; ls = ls->next) {
-	if (ls->n == n)
-	    return ls->data;	/* Found in cache */
+    for (ls = fs->hash[h]; ls; ls = ls->next) {
+	if (ls->n == n) {
+	    /* Found in cache */
+	    if (fs->lru != ls) {
+		lru_unlink(fs, ls);
+		lru_push(fs, ls);
+	    }
+	    return ls->data;
+	}
     }
 
-    /* Not found in cache */
-    ls = malloc(sizeof(struct libfat_sector));
-    if (!ls) {
-	libfat_flush(fs);
+    /* Not found in cache; use a new sector or recycle the oldest one */
+    ls = NULL;
+    if (fs->nsectors < LIBFAT_CACHE_SECTORS) {
 	ls = malloc(sizeof(struct libfat_sector));
-
-	if (!ls)
+	if (ls)
+	    fs->nsectors++;
+    }
+    if (!ls) {
+	if (!fs->lru)
 	    return NULL;	/* Can't allocate memory */
+
+	ls = fs->lru->lru_prev;
+	lru_unlink(fs, ls);
+	hash_unlink(fs, ls);
     }
 
     if (fs->read(fs->readptr, ls->data, LIBFAT_SECTOR_SIZE, n)
 	!= LIBFAT_SECTOR_SIZE) {
 	free(ls);
+	fs->nsectors--;
 	return NULL;		/* I/O error */
     }
 
     ls->n = n;
-    ls->next = fs->sectors;
-    fs->sectors = ls;
+    ls->next = fs->hash[h];
+    fs->hash[h] = ls;
+    lru_push(fs, ls);
 
     return ls->data;
 }
@@ -54,12 +114,16 @@ void *libfat_get_sector(struct libfat_filesystem *fs, libfat_sector_t n)
 void libfat_flush(struct libfat_filesystem *fs)
 {
     struct libfat_sector *ls, *lsnext;
+    int i;
 
-    lsnext = fs->sectors;
-    fs->sectors = NULL;
-
-    for (ls = lsnext; ls; ls = lsnext) {
-	lsnext = ls->next;
-	free(ls);
+    for (i = 0; i < LIBFAT_HASH_SIZE; i++) {
+	for (ls = fs->hash[i]; ls; ls = lsnext) {
+	    lsnext = ls->next;
+	    free(ls);
+	}
+	fs->hash[i] = NULL;
     }
+
+    fs->lru = NULL;
+    fs->nsectors = 0;
 }
@@ -38,37 +38,17 @@ libfat_sector_t libfat_clustertosector(const struct libfat_filesystem *fs,
 }
 
 /*
- * Get the next sector of either the root directory or a FAT chain.
- * Returns 0 on end of file and -1 on error.
+ * Read the FAT entry for a cluster.  Returns the entry, with the
+ * reserved high bits of a FAT32 entry masked off, or -1 on error.
  */
-
-libfat_sector_t libfat_nextsector(struct libfat_filesystem * fs,
-				  libfat_sector_t s)
+int32_t libfat_getfat(struct libfat_filesystem *fs, int32_t cluster)
 {
-    int32_t cluster, nextcluster;
     uint32_t fatoffset;
     libfat_sector_t fatsect;
     uint8_t *fsdata;
-    uint32_t clustmask = fs->clustsize - 1;
-    libfat_sector_t rs;
+    int32_t entry;
 
-    if (s < fs->data) {
-	if (s < fs->rootdir)
-	    return -1;
-
-	/* Root directory */
-	s++;
-	return (s < fs->data) ? s : 0;
-    }
-
-    rs = s - fs->data;
-
-    if (~rs & clustmask)
-	return s + 1;		/* Next sector in cluster */
-
-    cluster = 2 + (rs >> fs->clustshift);
-
-    if (cluster >= fs->endcluster)
+    if (cluster < 2 || cluster >= fs->endcluster)
 	return -1;
 
     switch (fs->fat_type) {
@@ -79,7 +59,7 @@ libfat_sector_t libfat_nextsector(struct libfat_filesystem * fs,
 	fsdata = libfat_get_sector(fs, fatsect);
 	if (!fsdata)
 	    return -1;
-	nextcluster = fsdata[fatoffset & LIBFAT_SECTOR_MASK];
+	entry = fsdata[fatoffset & LIBFAT_SECTOR_MASK];
 
 	/* Get second byte */
 	fatoffset++;
@@ -87,17 +67,14 @@ libfat_sector_t libfat_nextsector(struct libfat_filesystem * fs,
 	fsdata = libfat_get_sector(fs, fatsect);
 	if (!fsdata)
 	    return -1;
-	nextcluster |= fsdata[fatoffset & LIBFAT_SECTOR_MASK] << 8;
+	entry |= fsdata[fatoffset & LIBFAT_SECTOR_MASK] << 8;
 
 	/* Extract the FAT entry */
 	if (cluster & 1)
-	    nextcluster >>= 4;
+	    entry >>= 4;
 	else
-	    nextcluster &= 0x0FFF;
-
-	if (nextcluster >= 0x0FF8)
-	    return 0;
-	break;
+	    entry &= 0x0FFF;
+	return entry;
 
     case FAT16:
 	fatoffset = cluster << 1;
@@ -105,12 +82,7 @@ libfat_sector_t libfat_nextsector(struct libfat_filesystem * fs,
 	fsdata = libfat_get_sector(fs, fatsect);
 	if (!fsdata)
 	    return -1;
-	nextcluster =
-	    read16((le16_t *) & fsdata[fatoffset & LIBFAT_SECTOR_MASK]);
-
-	if (nextcluster >= 0x0FFF8)
-	    return 0;
-	break;
+	return read16((le16_t *) & fsdata[fatoffset & LIBFAT_SECTOR_MASK]);
 
     case FAT28:
 	fatoffset = cluster << 2;
@@ -118,17 +90,47 @@ libfat_sector_t libfat_nextsector(struct libfat_filesystem * fs,
 	fsdata = libfat_get_sector(fs, fatsect);
 	if (!fsdata)
 	    return -1;
-	nextcluster =
-	    read32((le32_t *) & fsdata[fatoffset & LIBFAT_SECTOR_MASK]);
-	nextcluster &= 0x0FFFFFFF;
-
-	if (nextcluster >= 0x0FFFFFF8)
-	    return 0;
-	break;
+	entry = read32((le32_t *) & fsdata[fatoffset & LIBFAT_SECTOR_MASK]);
+	return entry & 0x0FFFFFFF;
 
     default:
 	return -1;		/* WTF? */
     }
+}
+
+/*
+ * Get the next sector of either the root directory or a FAT chain.
+ * Returns 0 on end of file and -1 on error.
+ */
+
+libfat_sector_t libfat_nextsector(struct libfat_filesystem * fs,
+				  libfat_sector_t s)
+{
+    int32_t cluster, nextcluster;
+    uint32_t clustmask = fs->clustsize - 1;
+    libfat_sector_t rs;
+
+    if (s < fs->data) {
+	if (s < fs->rootdir)
+	    return -1;
+
+	/* Root directory */
+	s++;
+	return (s < fs->data) ? s : 0;
+    }
+
+    rs = s - fs->data;
+
+    if (~rs & clustmask)
+	return s + 1;		/* Next sector in cluster */
+
+    cluster = 2 + (rs >> fs->clustshift);
+
+    nextcluster = libfat_getfat(fs, cluster);
+    if (nextcluster < 0)
+	return -1;
+    if (nextcluster >= libfat_eoc(fs))
+	return 0;
 
     return libfat_clustertosector(fs, nextcluster);
 }
@@ -0,0 +1,229 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, Inc., 53 Temple Place Ste 330,
+ *   Boston MA 02111-1307, USA; either version 2 of the License, or
+ *   (at your option) any later version; incorporated herein by reference.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * fatwrite.c
+ *
+ * Just enough write support to lay a file down as one contiguous run
+ * of clusters: change FAT entries, allocate and free chains, and find
+ * room in a directory.  Changes go through the sector cache and
+ * straight on to the disk.
+ */
+
+#include <string.h>
+#include "libfatint.h"
+#include "ulint.h"
+
+void libfat_set_write(struct libfat_filesystem *fs,
+		      int (*writefunc) (intptr_t, const void *, size_t,
+					libfat_sector_t))
+{
+    fs->write = writefunc;
+}
+
+int libfat_write_sector(struct libfat_filesystem *fs, libfat_sector_t n)
+{
+    void *data;
+
+    if (!fs->write)
+	return -1;
+
+    data = libfat_get_sector(fs, n);
+    if (!data)
+	return -1;
+
+    return fs->write(fs->readptr, data, LIBFAT_SECTOR_SIZE, n) ==
+	LIBFAT_SECTOR_SIZE ? 0 : -1;
+}
+
+/*
+ * Change the bits in MASK of the byte at OFFSET into every FAT
+ */
+static int fat_setbyte(struct libfat_filesystem *fs, uint32_t offset,
+		       uint8_t val, uint8_t mask)
+{
+    libfat_sector_t s;
+    uint8_t *data;
+    int i;
+
+    for (i = 0; i < fs->nfats; i++) {
+	s = fs->fat + (libfat_sector_t)i * fs->fatsize +
+	    (offset >> LIBFAT_SECTOR_SHIFT);
+	data = libfat_get_sector(fs, s);
+	if (!data)
+	    return -1;
+	data += offset & LIBFAT_SECTOR_MASK;
+	*data = (*data & ~mask) | (val & mask);
+	if (libfat_write_sector(fs, s))
+	    return -1;
+    }
+
+    return 0;
+}
+
+static int fat_setentry(struct libfat_filesystem *fs, int32_t cluster,
+			 uint32_t value)
+{
+    uint32_t offset;
+    int i, rv = 0;
+
+    if (cluster < 2 || cluster >= fs->endcluster)
+	return -1;
+
+    switch (fs->fat_type) {
+    case FAT12:
+	offset = cluster + (cluster >> 1);
+	if (cluster & 1) {
+	    rv |= fat_setbyte(fs, offset, value << 4, 0xF0);
+	    rv |= fat_setbyte(fs, offset + 1, value >> 4, 0xFF);
+	} else {
+	    rv |= fat_setbyte(fs, offset, value, 0xFF);
+	    rv |= fat_setbyte(fs, offset + 1, value >> 8, 0x0F);
+	}
+	break;
+
+    case FAT16:
+	offset = cluster << 1;
+	for (i = 0; i < 2; i++)
+	    rv |= fat_setbyte(fs, offset + i, value >> (i * 8), 0xFF);
+	break;
+
+    case FAT28:
+	/* The top four bits are reserved, and left as they are */
+	offset = cluster << 2;
+	for (i = 0; i < 4; i++)
+	    rv |= fat_setbyte(fs, offset + i, value >> (i * 8),
+			      i == 3 ? 0x0F : 0xFF);
+	break;
+
+    default:
+	return -1;
+    }
+
+    return rv;
+}
+
+/*
+ * The free cluster count in the FAT32 FSINFO sector is only a hint;
+ * once we have changed the FAT, mark it unknown rather than wrong.
+ */
+static int fsinfo_invalidate(struct libfat_filesystem *fs)
+{
+    uint8_t *data;
+
+    if (!fs->fsinfo || fs->fsinfo >= fs->fat)
+	return 0;
+
+    data = libfat_get_sector(fs, fs->fsinfo);
+    if (!data)
+	return -1;
+
+    if (read32((le32_t *)data) != 0x41615252 ||
+	read32((le32_t *)(data + 484)) != 0x61417272)
+	return 0;		/* Not a valid FSINFO sector */
+
+    if (read32((le32_t *)(data + 488)) == 0xFFFFFFFF)
+	return 0;
+
+    write32((le32_t *)(data + 488), 0xFFFFFFFF);
+    return libfat_write_sector(fs, fs->fsinfo);
+}
+
+int32_t libfat_alloc(struct libfat_filesystem *fs, uint32_t size)
+{
+    int32_t cluster, start, entry;
+    uint32_t run, nclust;
+
+    nclust = (size + (fs->clustsize << LIBFAT_SECTOR_SHIFT) - 1)
+	>> (fs->clustshift + LIBFAT_SECTOR_SHIFT);
+    if (!nclust)
+	return -2;
+
+    /* Find the first free run that is long enough */
+    run = 0;
+    start = 2;
+    for (cluster = 2; cluster < fs->endcluster; cluster++) {
+	entry = libfat_getfat(fs, cluster);
+	if (entry < 0)
+	    return -1;
+	if (entry) {
+	    run = 0;
+	    continue;
+	}
+	if (!run++)
+	    start = cluster;
+	if (run == nclust)
+	    break;
+    }
+    if (run < nclust)
+	return -2;
+
+    if (fsinfo_invalidate(fs))
+	return -1;
+
+    /* Chain it, writing the end marker first */
+    if (fat_setentry(fs, start + nclust - 1, 0x0FFFFFFF))
+	return -1;
+    for (cluster = start + nclust - 2; cluster >= start; cluster--) {
+	if (fat_setentry(fs, cluster, cluster + 1))
+	    return -1;
+    }
+
+    return start;
+}
+
+int libfat_freechain(struct libfat_filesystem *fs, int32_t cluster)
+{
+    int32_t next;
+
+    if (fsinfo_invalidate(fs))
+	return -1;
+
+    while (cluster >= 2 && cluster < libfat_eoc(fs)) {
+	next = libfat_getfat(fs, cluster);
+	if (next < 0 || fat_setentry(fs, cluster, 0))
+	    return -1;
+	cluster = next;
+    }
+
+    return 0;
+}
+
+int libfat_findfree(struct libfat_filesystem *fs, int32_t dirclust,
+		    struct libfat_direntry *direntry)
+{
+    struct fat_dirent *dep;
+    int nent;
+    libfat_sector_t s = libfat_clustertosector(fs, dirclust);
+
+    while (1) {
+	if (s == 0)
+	    return -2;		/* Directory full */
+	else if (s == (libfat_sector_t) - 1)
+	    return -1;		/* Error */
+
+	dep = libfat_get_sector(fs, s);
+	if (!dep)
+	    return -1;		/* Read error */
+
+	for (nent = 0; nent < LIBFAT_SECTOR_SIZE;
+	     nent += sizeof(struct fat_dirent)) {
+	    if (dep->name[0] == 0 || dep->name[0] == 0xE5) {
+		memcpy(direntry->entry, dep, sizeof(*dep));
+		direntry->sector = s;
+		direntry->offset = nent;
+		return 0;
+	    }
+	    dep++;
+	}
+
+	s = libfat_nextsector(fs, s);
+    }
+}
@@ -82,4 +82,45 @@ void *libfat_get_sector(struct libfat_filesystem *fs, libfat_sector_t n);
 int32_t libfat_searchdir(struct libfat_filesystem *fs, int32_t dirclust,
 			 const void *name, struct libfat_direntry *direntry);
 
+/*
+ * Read the FAT entry for a cluster; returns -1 on error.
+ */
+int32_t libfat_getfat(struct libfat_filesystem *fs, int32_t cluster);
+
+/*
+ * Write support.  Nothing below works until a write function, in the
+ * same format as the read function and with the same private
+ * argument, has been set.  Every change is written through at once,
+ * to every copy of the FAT.
+ */
+void libfat_set_write(struct libfat_filesystem *fs,
+		      int (*writefunc) (intptr_t, const void *, size_t,
+					libfat_sector_t));
+
+/*
+ * Write back a cached sector after changing it through the pointer
+ * libfat_get_sector() returned.  Returns 0 on success.
+ */
+int libfat_write_sector(struct libfat_filesystem *fs, libfat_sector_t n);
+
+/*
+ * Allocate a chain of contiguous clusters big enough to hold size
+ * bytes.  Returns the first cluster, -2 if there is no free run that
+ * long, or -1 on error.
+ */
+int32_t libfat_alloc(struct libfat_filesystem *fs, uint32_t size);
+
+/*
+ * Free a chain of clusters.  Returns 0 on success.
+ */
+int libfat_freechain(struct libfat_filesystem *fs, int32_t cluster);
+
+/*
+ * Find an unused entry in a directory, without growing it.  Fills in
+ * the location in direntry and returns 0, or returns -2 if the
+ * directory is full and -1 on error.
+ */
+int libfat_findfree(struct libfat_filesystem *fs, int32_t dirclust,
+		    struct libfat_direntry *direntry);
+
 #endif /* LIBFAT_H */
@@ -22,9 +22,18 @@
 #include "libfat.h"
 #include "fat.h"
 
+/*
+ * The sector cache holds at most LIBFAT_CACHE_SECTORS sectors, found
+ * through a hash table and recycled least recently used first.
+ */
+#define LIBFAT_CACHE_SECTORS	128
+#define LIBFAT_HASH_SHIFT	6
+#define LIBFAT_HASH_SIZE	(1 << LIBFAT_HASH_SHIFT)
+
 struct libfat_sector {
     libfat_sector_t n;		/* Sector number */
-    struct libfat_sector *next;	/* Next in list */
+    struct libfat_sector *next;	/* Next in hash chain */
+    struct libfat_sector *lru_prev, *lru_next;
     char data[LIBFAT_SECTOR_SIZE];
 };
 
@@ -36,6 +45,7 @@ enum fat_type {
 
 struct libfat_filesystem {
     int (*read) (intptr_t, void *, size_t, libfat_sector_t);
+    int (*write) (intptr_t, const void *, size_t, libfat_sector_t);
     intptr_t readptr;
 
     enum fat_type fat_type;
@@ -45,11 +55,29 @@ struct libfat_filesystem {
     int32_t rootcluster;	/* Root directory cluster */
 
     libfat_sector_t fat;	/* Start of FAT */
+    uint32_t fatsize;		/* Sectors per FAT */
+    int nfats;			/* Number of FAT copies */
+    libfat_sector_t fsinfo;	/* FAT32 FSINFO sector, or 0 */
     libfat_sector_t rootdir;	/* Start of root directory */
     libfat_sector_t data;	/* Start of data area */
     libfat_sector_t end;	/* End of filesystem */
 
-    struct libfat_sector *sectors;
+    struct libfat_sector *hash[LIBFAT_HASH_SIZE];
+    struct libfat_sector *lru;	/* Most recently used; circular list */
+    unsigned int nsectors;	/* Sectors in the cache */
 };
 
+/* The lowest FAT entry value that marks the end of a chain */
+static inline int32_t libfat_eoc(const struct libfat_filesystem *fs)
+{
+    switch (fs->fat_type) {
+    case FAT12:
+	return 0x0FF8;
+    case FAT16:
+	return 0xFFF8;
+    default:
+	return 0x0FFFFFF8;
+    }
+}
+
 #endif /* LIBFATINT_H */
@@ -18,6 +18,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include "libfatint.h"
 #include "ulint.h"
 
@@ -35,8 +36,11 @@ libfat_open(int (*readfunc) (intptr_t, void *, size_t, libfat_sector_t),
     if (!fs)
 	goto barf;
 
-    fs->sectors = NULL;
+    memset(fs->hash, 0, sizeof fs->hash);
+    fs->lru = NULL;
+    fs->nsectors = 0;
     fs->read = readfunc;
+    fs->write = NULL;
     fs->readptr = readptr;
 
     bs = libfat_get_sector(fs, 0);
@@ -66,7 +70,9 @@ libfat_open(int (*readfunc) (intptr_t, void *, size_t, libfat_sector_t),
     if (!fatsize)
 	fatsize = read32(&bs->u.fat32.bpb_fatsz32);
 
-    fs->rootdir = fs->fat + fatsize * read8(&bs->bsFATs);
+    fs->fatsize = fatsize;
+    fs->nfats = read8(&bs->bsFATs);
+    fs->rootdir = fs->fat + fatsize * fs->nfats;
 
     rootdirsize = ((read16(&bs->bsRootDirEnts) << 5) + LIBFAT_SECTOR_MASK)
 	>> LIBFAT_SECTOR_SHIFT;
@@ -97,16 +103,19 @@ libfat_open(int (*readfunc) (intptr_t, void *, size_t, libfat_sector_t),
     if (minfatsize > fatsize)
 	goto barf;		/* The FATs don't fit */
 
-    if (fs->fat_type == FAT28)
+    if (fs->fat_type == FAT28) {
 	fs->rootcluster = read32(&bs->u.fat32.bpb_rootclus);
-    else
+	fs->fsinfo = read16(&bs->u.fat32.bpb_fsinfo);
+    } else {
 	fs->rootcluster = 0;
+	fs->fsinfo = 0;
+    }
 
     return fs;			/* All good */
 
 barf:
     if (fs)
-	free(fs);
+	libfat_close(fs);
     return NULL;
 }
 
@@ -99,7 +99,8 @@ int write_adv(const char *path, const char *cfg)
     int fd = -1;
     struct stat st, xst;
     int err = 0;
-    int rv;
+    int rv, i;
+    size_t off;
 
     rv = asprintf(&file, "%s%s%s", path,
 		  path[0] && path[strlen(path) - 1] == '/' ? "" : "/", cfg);
@@ -123,7 +124,9 @@ int write_adv(const char *path, const char *cfg)
     } else {
 	/* We got it... maybe? */
 	err = syslinux_validate_adv(advtmp) ? -2 : 0;
-	if (!err) {
+	if (!err && !memcmp(advtmp, syslinux_adv, 2 * ADV_SIZE)) {
+	    /* Nothing has changed, so leave the file alone */
+	} else if (!err) {
 	    /* Got a good one, write our own ADV here */
 	    clear_attributes(fd);
 
@@ -138,10 +141,19 @@ int write_adv(const char *path, const char *cfg)
 		fprintf(stderr, "%s: race condition on write\n", file);
 		err = -2;
 	    }
-	    /* Write our own version ... */
-	    if (xpwrite(fd, syslinux_adv, 2 * ADV_SIZE,
-			st.st_size - 2 * ADV_SIZE) != 2 * ADV_SIZE) {
-		err = -1;
+	    /*
+	     * Write our own version, one copy at a time and only the
+	     * copies that differ.  The file is O_SYNC, so the first copy
+	     * is on disk before the second is touched, and a crash
+	     * in between always leaves one good copy behind.
+	     */
+	    for (i = 0; i < 2 && !err; i++) {
+		off = i * ADV_SIZE;
+		if (!memcmp(advtmp + off, syslinux_adv + off, ADV_SIZE))
+		    continue;
+		if (xpwrite(fd, syslinux_adv + off, ADV_SIZE,
+			    st.st_size - 2 * ADV_SIZE + off) != ADV_SIZE)
+		    err = -1;
 	    }
 
 	    sync();
@@ -56,6 +56,31 @@ static void cleanup_adv(unsigned char *advbuf)
     memcpy(advbuf + ADV_SIZE, advbuf, ADV_SIZE);
 }
 
+/*
+ * Return nonzero if the ADV data at P already says what setting TAG to
+ * (SIZE, DATA) would make it say, so there is nothing to do.
+ */
+static int adv_unchanged(const uint8_t *p, size_t left, int tag,
+			 size_t size, const void *data)
+{
+    while (left >= 2) {
+	uint8_t ptag = p[0];
+	size_t plen = p[1] + 2;
+
+	if (ptag == ADV_END)
+	    break;
+	if (plen > left)
+	    return 0;		/* Corrupt; let it be overwritten */
+	if (ptag == tag)
+	    return p[1] == size && !memcmp(p + 2, data, size);
+
+	left -= plen;
+	p += plen;
+    }
+
+    return !size;
+}
+
 int syslinux_setadv(int tag, size_t size, const void *data)
 {
     uint8_t *p;
@@ -72,6 +97,9 @@ int syslinux_setadv(int tag, size_t size, const void *data)
 	return -1;
     }
 
+    if (adv_unchanged(syslinux_adv + 2 * 4, ADV_LEN, tag, size, data))
+	return 0;
+
     left = ADV_LEN;
     p = advtmp;
     memcpy(p, syslinux_adv + 2 * 4, left);	/* Make working copy */
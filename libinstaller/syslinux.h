@@ -62,4 +62,17 @@ int syslinux_patch(const sector_t *sectors, int nsectors,
 		   int stupid, int raid_mode,
 		   const char *subdir, const char *subvol);
 
+/* ... or on a map of LEN consecutive sectors at a time, starting at LBA */
+struct sector_extent {
+    sector_t lba;
+    uint32_t len;
+};
+int syslinux_patch_extents(const struct sector_extent *ext, int nextents,
+			   int stupid, int raid_mode,
+			   const char *subdir, const char *subvol);
+
+/* Record where a file is, for the core to read it directly */
+int syslinux_preload(const char *name, const struct sector_extent *ext,
+		     int nextents, const void *data, uint32_t size);
+
 #endif
@@ -22,6 +22,7 @@
 #include <stdlib.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <string.h>
 #include <getopt.h>
 #include <unistd.h>
@@ -113,86 +114,131 @@ void set_attributes(int fd)
     }
 }
 
+/* FIEMAP extents asked for per ioctl */
+#define FIEMAP_BATCH	32
+
+/*
+ * An extent list being built up, one run of sectors at a time
+ */
+struct extmap {
+    struct sector_extent *ext;
+    int next, maxext;
+    int nsectors;		/* Sectors still wanted */
+};
+
+/*
+ * Append LEN sectors at LBA to the map, merging them into the last
+ * extent if they follow on from it.  Returns 0 on success.
+ */
+static int extmap_add(struct extmap *map, sector_t lba, uint32_t len)
+{
+    struct sector_extent *ex;
+
+    if (len > (uint32_t)map->nsectors)
+	len = map->nsectors;
+    if (!len)
+	return 0;
+    map->nsectors -= len;
+
+    if (map->next) {
+	ex = &map->ext[map->next - 1];
+	if (ex->lba + ex->len == lba) {
+	    ex->len += len;
+	    return 0;
+	}
+    }
+
+    if (map->next == map->maxext) {
+	map->maxext = map->maxext ? map->maxext * 2 : 16;
+	ex = realloc(map->ext, map->maxext * sizeof *ex);
+	if (!ex)
+	    return -1;
+	map->ext = ex;
+    }
+
+    ex = &map->ext[map->next++];
+    ex->lba = lba;
+    ex->len = len;
+    return 0;
+}
+
 /* New FIEMAP based mapping */
-static int sectmap_fie(int fd, sector_t *sectors, int nsectors)
+static int sectmap_fie(int fd, struct extmap *map)
 {
-    struct fiemap *fm;
+    struct {
+	struct fiemap fm;
+	struct fiemap_extent fe[FIEMAP_BATCH];
+    } req;
     struct fiemap_extent *fe;
-    unsigned int i, nsec;
-    sector_t sec, *secp, *esec;
+    unsigned int i;
     struct stat st;
-    uint64_t maplen;
+    uint64_t maplen, start;
+    bool last = false;
 
     if (fstat(fd, &st))
 	return -1;
 
-    fm = alloca(sizeof(struct fiemap)
-		+ nsectors * sizeof(struct fiemap_extent));
-
-    memset(fm, 0, sizeof *fm);
-
-    maplen = (uint64_t)nsectors << SECTOR_SHIFT;
+    maplen = (uint64_t)map->nsectors << SECTOR_SHIFT;
     if (maplen > (uint64_t)st.st_size)
 	maplen = st.st_size;
 
-    fm->fm_start        = 0;
-    fm->fm_length       = maplen;
-    fm->fm_flags        = FIEMAP_FLAG_SYNC;
-    fm->fm_extent_count = nsectors;
+    start = 0;
+    while (!last && map->nsectors) {
+	memset(&req.fm, 0, sizeof req.fm);
+	req.fm.fm_start        = start;
+	req.fm.fm_length       = maplen - start;
+	req.fm.fm_flags        = FIEMAP_FLAG_SYNC;
+	req.fm.fm_extent_count = FIEMAP_BATCH;
 
-    if (ioctl(fd, FS_IOC_FIEMAP, fm))
-	return -1;
-
-    memset(sectors, 0, nsectors * sizeof *sectors);
-    esec = sectors + nsectors;
+	if (ioctl(fd, FS_IOC_FIEMAP, &req.fm))
+	    return -1;
 
-    fe = fm->fm_extents;
+	if (req.fm.fm_mapped_extents < 1)
+	    return -1;
 
-    if (fm->fm_mapped_extents < 1 ||
-	!(fe[fm->fm_mapped_extents-1].fe_flags & FIEMAP_EXTENT_LAST))
-	return -1;
+	fe = req.fm.fm_extents;
+	for (i = 0; i < req.fm.fm_mapped_extents; i++, fe++) {
+	    if (fe->fe_flags & FIEMAP_EXTENT_LAST) {
+		/* If this is the *final* extent, pad the length */
+		fe->fe_length = (fe->fe_length + SECTOR_SIZE - 1)
+		    & ~(SECTOR_SIZE - 1);
+		last = true;
+	    }
 
-    for (i = 0; i < fm->fm_mapped_extents; i++) {
-	if (fe->fe_flags & FIEMAP_EXTENT_LAST) {
-	    /* If this is the *final* extent, pad the length */
-	    fe->fe_length = (fe->fe_length + SECTOR_SIZE - 1)
-		& ~(SECTOR_SIZE - 1);
-	}
+	    if ((fe->fe_logical | fe->fe_physical| fe->fe_length) &
+		(SECTOR_SIZE - 1))
+		return -1;
 
-	if ((fe->fe_logical | fe->fe_physical| fe->fe_length) &
-	    (SECTOR_SIZE - 1))
-	    return -1;
+	    if (fe->fe_flags & (FIEMAP_EXTENT_UNKNOWN|
+				FIEMAP_EXTENT_DELALLOC|
+				FIEMAP_EXTENT_ENCODED|
+				FIEMAP_EXTENT_DATA_ENCRYPTED|
+				FIEMAP_EXTENT_UNWRITTEN))
+		return -1;
 
-	if (fe->fe_flags & (FIEMAP_EXTENT_UNKNOWN|
-			    FIEMAP_EXTENT_DELALLOC|
-			    FIEMAP_EXTENT_ENCODED|
-			    FIEMAP_EXTENT_DATA_ENCRYPTED|
-			    FIEMAP_EXTENT_UNWRITTEN))
-	    return -1;
+	    /* A hole would leave part of the file without a sector */
+	    if (fe->fe_logical != start)
+		return -1;
 
-	secp = sectors + (fe->fe_logical >> SECTOR_SHIFT);
-	sec  = fe->fe_physical >> SECTOR_SHIFT;
-	nsec = fe->fe_length >> SECTOR_SHIFT;
+	    if (extmap_add(map, fe->fe_physical >> SECTOR_SHIFT,
+			   fe->fe_length >> SECTOR_SHIFT))
+		return -1;
 
-	while (nsec--) {
-	    if (secp >= esec)
-		break;
-	    *secp++ = sec++;
+	    start += fe->fe_length;
 	}
 
-	fe++;
+	if (start >= maplen)
+	    break;
     }
 
-    return 0;
+    return map->nsectors ? -1 : 0;
 }
 
 /* Legacy FIBMAP based mapping */
-static int sectmap_fib(int fd, sector_t *sectors, int nsectors)
+static int sectmap_fib(int fd, struct extmap *map)
 {
     unsigned int blk, nblk;
-    unsigned int i;
     unsigned int blksize;
-    sector_t sec;
 
     /* Get block size */
     if (ioctl(fd, FIGETBSZ, &blksize))
@@ -202,31 +248,41 @@ static int sectmap_fib(int fd, sector_t *sectors, int nsectors)
     blksize >>= SECTOR_SHIFT;
 
     nblk = 0;
-    while (nsectors) {
+    while (map->nsectors) {
 	blk = nblk++;
 	if (ioctl(fd, FIBMAP, &blk))
 	    return -1;
 
-	sec = (sector_t)blk * blksize;
-	for (i = 0; i < blksize; i++) {
-	    *sectors++ = sec++;
-	    if (! --nsectors)
-		break;
-	}
+	if (extmap_add(map, (sector_t)blk * blksize, blksize))
+	    return -1;
     }
 
     return 0;
 }
 
 /*
- * Produce file map
+ * Produce a map of the first NSECTORS sectors of a file, as a list of
+ * extents.  On success *EXTP is set to a malloc'd array, which the
+ * caller frees, and the number of extents in it is returned;
+ * otherwise -1.
  */
-int sectmap(int fd, sector_t *sectors, int nsectors)
+int sectmap(int fd, int nsectors, struct sector_extent **extp)
 {
-    if (!sectmap_fie(fd, sectors, nsectors))
-	return 0;
+    struct extmap map;
+
+    memset(&map, 0, sizeof map);
+    map.nsectors = nsectors;
+    if (sectmap_fie(fd, &map)) {
+	map.next = 0;
+	map.nsectors = nsectors;
+	if (sectmap_fib(fd, &map)) {
+	    free(map.ext);
+	    return -1;
+	}
+    }
 
-    return sectmap_fib(fd, sectors, nsectors);
+    *extp = map.ext;
+    return map.next;
 }
 
 /*
@@ -6,7 +6,7 @@
 extern const char *program;
 void clear_attributes(int fd);
 void set_attributes(int fd);
-int sectmap(int fd, sector_t *sectors, int nsectors);
+int sectmap(int fd, int nsectors, struct sector_extent **extp);
 int syslinux_already_installed(int dev_fd);
 
 #endif
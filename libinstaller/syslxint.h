@@ -216,8 +216,44 @@ struct ext_patch_area {
     uint16_t sect1ptr0;		/* Boot sector offset of sector 1 ptr LSW */
     uint16_t sect1ptr1;		/* Boot sector offset of sector 1 ptr MSW */
     uint16_t raidpatch;		/* Boot sector RAID mode patch pointer */
+    uint16_t bannerptr;		/* Syslinux banner */
+    uint16_t preloadoffset;	/* Map of preloaded files */
+    uint16_t preloadlen;	/* Length of the preload map */
 };
 
+/*
+ * Map of files the core can read without looking them up; the core
+ * side is core/fs/preload.c.  Extents are in 512-byte sectors from
+ * the start of the partition.
+ */
+#define PRELOAD_MAGIC		0x4c455250	/* "PREL" */
+#define PRELOAD_FILES		2
+#define PRELOAD_NAME_MAX	16
+
+PACKME
+struct preload_extent {
+    uint64_t lba;
+    uint32_t len;
+} PACKED;
+
+PACKME
+struct preload_file {
+    char name[PRELOAD_NAME_MAX];	/* In the install directory */
+    uint32_t size;
+    uint32_t csum;			/* FNV-1a of the contents */
+    uint16_t ext;			/* First extent */
+    uint16_t next;			/* Number of extents */
+} PACKED;
+
+PACKME
+struct preload_map {
+    uint32_t magic;			/* PRELOAD_MAGIC */
+    uint16_t nfiles;
+    uint16_t nextents;
+    struct preload_file file[PRELOAD_FILES];
+    struct preload_extent ext[];
+} PACKED;
+
 /* Sector extent */
 PACKME
 struct syslinux_extent {
@@ -29,48 +29,58 @@
 #include "syslxint.h"
 
 
+/* A loader extent has to stay under 64K */
+#define EXTENT_MAX_SECTORS	((65536 >> SECTOR_SHIFT) - 1)
+
 /*
- * Generate sector extents
+ * Generate sector extents for the NSECT sectors of the file that come
+ * after the first SKIP, splitting the file map where it runs too long
  */
 static void generate_extents(struct syslinux_extent _slimg *ex, int nptrs,
-			     const sector_t *sectp, int nsect)
+			     const struct sector_extent *fx, int nfx,
+			     uint32_t skip, uint32_t nsect)
 {
-    uint32_t addr = 0x8000;	/* ldlinux.sys starts loading here */
-    uint32_t base;
     sector_t sect, lba;
-    unsigned int len;
+    uint32_t n, len, room;
 
-    base = addr;
     len = 0;
     lba = 0;
 
     memset_sl(ex, 0, nptrs * sizeof *ex);
 
-    while (nsect) {
-	sect = *sectp++;
-
-	if (len) {
-	    uint32_t xbytes = (len + 1) * SECTOR_SIZE;
-
-	    if (sect == lba + len && xbytes < 65536 &&
-		((addr ^ (base + xbytes - 1)) & 0xffff0000) == 0) {
+    for (; nfx && nsect; fx++, nfx--) {
+	if (skip >= fx->len) {
+	    skip -= fx->len;
+	    continue;
+	}
+	sect = fx->lba + skip;
+	n = fx->len - skip;
+	skip = 0;
+	if (n > nsect)
+	    n = nsect;
+	nsect -= n;
+
+	while (n) {
+	    if (len && sect == lba + len && len < EXTENT_MAX_SECTORS) {
 		/* We can add to the current extent */
-		len++;
-		goto next;
+		room = EXTENT_MAX_SECTORS - len;
+	    } else {
+		if (len) {
+		    set_64_sl(&ex->lba, lba);
+		    set_16_sl(&ex->len, len);
+		    ex++;
+		}
+		lba = sect;
+		len = 0;
+		room = EXTENT_MAX_SECTORS;
 	    }
 
-	    set_64_sl(&ex->lba, lba);
-	    set_16_sl(&ex->len, len);
-	    ex++;
+	    if (room > n)
+		room = n;
+	    len += room;
+	    sect += room;
+	    n -= room;
 	}
-
-	base = addr;
-	lba  = sect;
-	len  = 1;
-
-    next:
-	addr += SECTOR_SIZE;
-	nsect--;
     }
 
     if (len) {
@@ -80,6 +90,18 @@ static void generate_extents(struct syslinux_extent _slimg *ex, int nptrs,
     }
 }
 
+/*
+ * Return sector N of the file
+ */
+static sector_t extent_sector(const struct sector_extent *fx, int nfx,
+			      uint32_t n)
+{
+    while (nfx-- && n >= fx->len)
+	n -= (fx++)->len;
+
+    return fx->lba + n;
+}
+
 /*
  * Form a pointer based on a 16-bit patcharea/epa field
  */
@@ -93,6 +115,105 @@ static inline void _slimg *slptr(void _slimg *img,
     return (char _slimg *)img + get_16_sl(offset_p);
 }
 
+/*
+ * Search for LDLINUX_MAGIC to find the patch area
+ */
+static struct patch_area _slimg *find_patch_area(void)
+{
+    const uint32_t _slimg *wp;
+
+    for (wp = (const uint32_t _slimg *)boot_image;
+	 get_32_sl(wp) != LDLINUX_MAGIC;
+	 wp++)
+	;
+
+    return (struct patch_area _slimg *)wp;
+}
+
+/*
+ * FNV-1a, the checksum of a preloaded file
+ */
+static uint32_t preload_csum(const void *data, uint32_t len)
+{
+    const uint8_t *p = data;
+    uint32_t h = 2166136261U;
+
+    while (len--) {
+	h ^= *p++;
+	h *= 16777619;
+    }
+
+    return h;
+}
+
+/*
+ * Record that the file NAME in the install directory, the SIZE bytes
+ * at DATA, is at the sectors in the map FX, so that the core can read
+ * it without looking it up.  This has to come before the image is
+ * patched, as that checksums it.
+ *
+ * Returns 0, or -1 if there isn't room for it in the preload map.
+ */
+int syslinux_preload(const char *name, const struct sector_extent *fx,
+		     int nfx, const void *data, uint32_t size)
+{
+    struct patch_area _slimg *patcharea;
+    struct ext_patch_area _slimg *epa;
+    struct preload_map _slimg *map;
+    struct preload_file _slimg *pf;
+    struct preload_extent _slimg *ex;
+    uint32_t nsect, len;
+    int i, n, nfiles, nextents, maxext;
+    size_t maplen, namelen;
+
+    patcharea = find_patch_area();
+    epa = slptr(boot_image, &patcharea->epaoffset);
+    map = slptr(boot_image, &epa->preloadoffset);
+    maplen = get_16_sl(&epa->preloadlen);
+    if (maplen < sizeof *map)
+	return -1;
+    maxext = (maplen - sizeof *map) / sizeof *ex;
+
+    if (get_32_sl(&map->magic) != PRELOAD_MAGIC) {
+	memset_sl(map, 0, maplen);
+	set_32_sl(&map->magic, PRELOAD_MAGIC);
+    }
+    nfiles = get_16_sl(&map->nfiles);
+    nextents = get_16_sl(&map->nextents);
+
+    namelen = strlen(name) + 1;
+    if (namelen > PRELOAD_NAME_MAX || nfiles >= PRELOAD_FILES)
+	return -1;
+
+    /* Count the extents the file takes up */
+    nsect = (size + SECTOR_SIZE - 1) >> SECTOR_SHIFT;
+    for (i = n = 0; i < nfx && nsect; i++, n++)
+	nsect -= fx[i].len < nsect ? fx[i].len : nsect;
+    if (nsect || !n || nextents + n > maxext)
+	return -1;
+
+    nsect = (size + SECTOR_SIZE - 1) >> SECTOR_SHIFT;
+    ex = &map->ext[nextents];
+    for (i = 0; i < n; i++, ex++) {
+	len = fx[i].len < nsect ? fx[i].len : nsect;
+	set_64_sl(&ex->lba, fx[i].lba);
+	set_32_sl(&ex->len, len);
+	nsect -= len;
+    }
+
+    pf = &map->file[nfiles];
+    memset_sl(pf, 0, sizeof *pf);
+    memcpy_to_sl(pf->name, name, namelen);
+    set_32_sl(&pf->size, size);
+    set_32_sl(&pf->csum, preload_csum(data, size));
+    set_16_sl(&pf->ext, nextents);
+    set_16_sl(&pf->next, n);
+
+    set_16_sl(&map->nfiles, nfiles + 1);
+    set_16_sl(&map->nextents, nextents + n);
+    return 0;
+}
+
 /*
  * This patches the boot sector and the beginning of ldlinux.sys
  * based on an ldlinux.sys sector map passed in.  Typically this is
@@ -104,9 +225,9 @@ static inline void _slimg *slptr(void _slimg *img,
  * Returns the number of modified bytes in ldlinux.sys if successful,
  * otherwise -1.
  */
-int syslinux_patch(const sector_t *sectp, int nsectors,
-		   int stupid, int raid_mode,
-		   const char *subdir, const char *subvol)
+int syslinux_patch_extents(const struct sector_extent *fx, int nfx,
+			   int stupid, int raid_mode,
+			   const char *subdir, const char *subvol)
 {
     struct patch_area _slimg *patcharea;
     struct ext_patch_area _slimg *epa;
@@ -117,22 +238,23 @@ int syslinux_patch(const sector_t *sectp, int nsectors,
     int i, dw, nptrs;
     struct fat_boot_sector *sbs = (struct fat_boot_sector *)boot_sector;
     uint64_t _slimg *advptrs;
+    uint32_t nsectors;
+    sector_t sect1;
+
+    nsectors = 0;
+    for (i = 0; i < nfx; i++)
+	nsectors += fx[i].len;
 
-    if (nsectors < nsect)
+    if (nsectors < (uint32_t)nsect)
 	return -1;		/* The actual file is too small for content */
 
-    /* Search for LDLINUX_MAGIC to find the patch area */
-    for (wp = (const uint32_t _slimg *)boot_image;
-	 get_32_sl(wp) != LDLINUX_MAGIC;
-	 wp++)
-	;
-    patcharea = (struct patch_area _slimg *)wp;
+    patcharea = find_patch_area();
     epa = slptr(boot_image, &patcharea->epaoffset);
 
     /* First sector need pointer in boot sector */
-    set_32(ptr(sbs, &epa->sect1ptr0), sectp[0]);
-    set_32(ptr(sbs, &epa->sect1ptr1), sectp[0] >> 32);
-    sectp++;
+    sect1 = extent_sector(fx, nfx, 0);
+    set_32(ptr(sbs, &epa->sect1ptr0), sect1);
+    set_32(ptr(sbs, &epa->sect1ptr1), sect1 >> 32);
 
     /* Handle RAID mode */
     if (raid_mode) {
@@ -165,12 +287,12 @@ int syslinux_patch(const sector_t *sectp, int nsectors,
 #endif
 
     /* -1 for the pointer in the boot sector, -2 for the two ADVs */
-    generate_extents(ex, nptrs, sectp, nsect-1-2);
+    generate_extents(ex, nptrs, fx, nfx, 1, nsect-1-2);
 
     /* ADV pointers */
     advptrs = slptr(boot_image, &epa->advptroffset);
-    set_64_sl(&advptrs[0], sectp[nsect-1-2]);
-    set_64_sl(&advptrs[1], sectp[nsect-1-1]);
+    set_64_sl(&advptrs[0], extent_sector(fx, nfx, nsect-2));
+    set_64_sl(&advptrs[1], extent_sector(fx, nfx, nsect-1));
 
     /* Poke in the base directory path */
     if (subdir) {
@@ -207,3 +329,33 @@ int syslinux_patch(const sector_t *sectp, int nsectors,
      */
     return dw << 2;
 }
+
+/*
+ * The same, for installers that have a sector-by-sector map
+ */
+int syslinux_patch(const sector_t *sectp, int nsectors,
+		   int stupid, int raid_mode,
+		   const char *subdir, const char *subvol)
+{
+    struct sector_extent *fx;
+    int i, nfx, rv;
+
+    fx = malloc(nsectors * sizeof *fx);
+    if (!fx)
+	return -1;
+
+    nfx = 0;
+    for (i = 0; i < nsectors; i++) {
+	if (nfx && sectp[i] == fx[nfx-1].lba + fx[nfx-1].len) {
+	    fx[nfx-1].len++;
+	} else {
+	    fx[nfx].lba = sectp[i];
+	    fx[nfx].len = 1;
+	    nfx++;
+	}
+    }
+
+    rv = syslinux_patch_extents(fx, nfx, stupid, raid_mode, subdir, subvol);
+    free(fx);
+    return rv;
+}
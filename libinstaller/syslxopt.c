@@ -45,6 +45,9 @@ struct sys_options opt = {
     .activate_partition = 0,
     .force = 0,
     .bootsecfile = NULL,
+    .more_dirs = NULL,
+    .n_more_dirs = 0,
+    .jobs = 0,
 };
 
 const struct option long_options[] = {
@@ -67,6 +70,7 @@ const struct option long_options[] = {
     {"mbr", 0, NULL, 'm'},	/* DOS/Win32 only */
     {"active", 0, NULL, 'a'},	/* DOS/Win32 only */
     {"device", 1, NULL, OPT_DEVICE},
+    {"jobs", 1, NULL, OPT_JOBS},
     {NULL, 0, NULL, 0}
 };
 
@@ -88,8 +92,9 @@ void __attribute__ ((noreturn)) usage(int rv, enum syslinux_mode mode)
 	/* Mounted fs installation (extlinux) */
 	/* Actually extlinux can also use -d to provide a directory too... */
 	fprintf(stderr,
-	    "Usage: %s [options] directory\n"
-	    "  --device         Force use of a specific block device (experts only)\n",
+	    "Usage: %s [options] directory [directory...]\n"
+	    "  --device         Force use of a specific block device (experts only)\n"
+	    "  --jobs=#         Install on this many directories at a time\n",
 	    program);
 	break;
 
@@ -217,6 +222,11 @@ void parse_options(int argc, char *argv[], enum syslinux_mode mode)
 		usage(EX_USAGE, mode);
 	    opt.device = optarg;
 	    break;
+	case OPT_JOBS:
+	    if (mode != MODE_EXTLINUX)
+		usage(EX_USAGE, mode);
+	    opt.jobs = strtoul(optarg, NULL, 0);
+	    break;
 	case 'v':
 	    fprintf(stderr,
 		    "%s " VERSION_STR "  Copyright 1994-" YEAR_STR
@@ -236,6 +246,14 @@ void parse_options(int argc, char *argv[], enum syslinux_mode mode)
     case MODE_EXTLINUX:
 	if (!opt.directory)
 	    opt.directory = argv[optind++];
+	/* Any further directories get the same treatment */
+	if (opt.directory && argv[optind]) {
+	    opt.more_dirs = &argv[optind];
+	    while (argv[optind]) {
+		optind++;
+		opt.n_more_dirs++;
+	    }
+	}
 	break;
     }
 
@@ -18,6 +18,9 @@ struct sys_options {
     int install_mbr;
     int activate_partition;
     const char *bootsecfile;
+    char **more_dirs;		/* extlinux: further target directories */
+    int n_more_dirs;
+    int jobs;			/* extlinux: installs run at once, 0 = all */
 };
 
 enum long_only_opt {
@@ -25,6 +28,7 @@ enum long_only_opt {
     OPT_RESET_ADV,
     OPT_ONCE,
     OPT_DEVICE,
+    OPT_JOBS,
 };
 
 enum syslinux_mode {
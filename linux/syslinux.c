@@ -267,11 +267,12 @@ int main(int argc, char *argv[])
     char *ldlinux_name;
     char *ldlinux_path;
     char *subdir;
-    sector_t *sectors = NULL;
+    struct sector_extent *ext = NULL;
+    int nextents = 0;
     int ldlinux_sectors = (boot_image_len + SECTOR_SIZE - 1) >> SECTOR_SHIFT;
     const char *errmsg;
     int mnt_cookie;
-    int patch_sectors;
+    int patch_sectors, done;
     int i, rv;
 
     mypid = getpid();
@@ -455,8 +456,8 @@ int main(int argc, char *argv[])
      * Create a block map.
      */
     ldlinux_sectors += 2; /* 2 ADV sectors */
-    sectors = calloc(ldlinux_sectors, sizeof *sectors);
-    if (sectmap(fd, sectors, ldlinux_sectors)) {
+    nextents = sectmap(fd, ldlinux_sectors, &ext);
+    if (nextents < 0) {
 	perror("bmap");
 	exit(1);
     }
@@ -500,18 +501,23 @@ umount:
     /*
      * Patch ldlinux.sys and the boot sector
      */
-    i = syslinux_patch(sectors, ldlinux_sectors, opt.stupid_mode,
-		       opt.raid_mode, subdir, NULL);
+    i = syslinux_patch_extents(ext, nextents, opt.stupid_mode,
+			       opt.raid_mode, subdir, NULL);
     patch_sectors = (i + SECTOR_SIZE - 1) >> SECTOR_SHIFT;
 
     /*
-     * Write the now-patched first sectors of ldlinux.sys
+     * Write the now-patched first sectors of ldlinux.sys, an extent
+     * at a time
      */
-    for (i = 0; i < patch_sectors; i++) {
+    for (i = 0, done = 0; done < patch_sectors; i++) {
+	int n = ext[i].len < (uint32_t)(patch_sectors - done) ?
+	    (int)ext[i].len : patch_sectors - done;
+
 	xpwrite(dev_fd,
-		(const char _force *)boot_image + i * SECTOR_SIZE,
-		SECTOR_SIZE,
-		opt.offset + ((off_t) sectors[i] << SECTOR_SHIFT));
+		(const char _force *)boot_image + done * SECTOR_SIZE,
+		n * SECTOR_SIZE,
+		opt.offset + ((off_t) ext[i].lba << SECTOR_SHIFT));
+	done += n;
     }
 
     /*
@@ -0,0 +1,223 @@
+/*
+ * lz4.c
+ *
+ * LZ4 block format, for cores that are to be quick to unpack rather
+ * than small; core/lzo/lz4_d.S is the decoder that runs at boot.
+ *
+ * Speed doesn't matter here, only size: every position gets the
+ * longest match the hash chains can find, and then the cheapest way
+ * through the whole image is picked working back from the end, much
+ * as LZ4HC does at its top levels.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "lz4.h"
+
+#define MIN_MATCH	4
+#define MAX_OFFSET	65535
+#define LAST_LITERALS	5	/* The last 5 bytes are always literals... */
+#define MF_LIMIT	12	/* ... and no match starts in the last 12 */
+#define NICE_LEN	1024	/* Long enough; don't look any further */
+#define MAX_CHAIN	2048
+#define HASH_BITS	16
+
+static inline uint32_t hash4(const uint8_t *p)
+{
+    uint32_t v = p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+
+    return (v * 2654435761U) >> (32 - HASH_BITS);
+}
+
+/* Bytes for a match of len, with its token; literals cost one each */
+static size_t match_cost(size_t len)
+{
+    len -= MIN_MATCH;
+    return 3 + (len >= 15 ? 1 + (len - 15) / 255 : 0);
+}
+
+static uint8_t *put_len(uint8_t *op, size_t len)
+{
+    for (len -= 15; len >= 255; len -= 255)
+	*op++ = 255;
+    *op++ = len;
+    return op;
+}
+
+static uint8_t *put_seq(uint8_t *op, const uint8_t *lit, size_t nlit,
+			size_t off, size_t len)
+{
+    size_t mlen = len ? len - MIN_MATCH : 0;
+
+    *op++ = (nlit < 15 ? nlit : 15) << 4 | (mlen < 15 ? mlen : 15);
+    if (nlit >= 15)
+	op = put_len(op, nlit);
+    memcpy(op, lit, nlit);
+    op += nlit;
+
+    if (len) {
+	*op++ = off;
+	*op++ = off >> 8;
+	if (mlen >= 15)
+	    op = put_len(op, mlen);
+    }
+    return op;
+}
+
+/*
+ * Compress in_len bytes into out, which must have room for
+ * LZ4_BOUND(in_len).  Returns the compressed size, or 0 if out of
+ * memory.
+ */
+size_t lz4_compress(const uint8_t *in, size_t in_len, uint8_t *out)
+{
+    size_t limit = in_len > MF_LIMIT ? in_len - MF_LIMIT : 0;
+    int32_t *head, *prev;
+    uint32_t *mlen, *moff, *cost, *step;
+    uint8_t *op = out;
+    size_t i, l, anchor;
+
+    head = malloc(sizeof(*head) << HASH_BITS);
+    prev = calloc(in_len + 1, sizeof *prev);
+    mlen = calloc(in_len + 1, sizeof *mlen);
+    moff = calloc(in_len + 1, sizeof *moff);
+    cost = calloc(in_len + 1, sizeof *cost);
+    step = calloc(in_len + 1, sizeof *step);
+    if (!head || !prev || !mlen || !moff || !cost || !step) {
+	in_len = 0;
+	goto out;
+    }
+    memset(head, 0xff, sizeof(*head) << HASH_BITS);
+
+    /* The longest match at each position */
+    for (i = 0; i < limit; i++) {
+	size_t maxl = in_len - LAST_LITERALS - i;
+	size_t best = 0, off = 0;
+	uint32_t h = hash4(in + i);
+	int32_t cand = head[h];
+	int chain = MAX_CHAIN;
+
+	while (cand >= 0 && i - cand <= MAX_OFFSET && chain--) {
+	    if (in[cand + best] == in[i + best]) {
+		for (l = 0; l < maxl && in[cand + l] == in[i + l]; l++)
+		    ;
+		if (l > best) {
+		    best = l;
+		    off = i - cand;
+		    if (l >= NICE_LEN || l == maxl)
+			break;
+		}
+	    }
+	    cand = prev[cand];
+	}
+
+	prev[i] = head[h];
+	head[h] = i;
+	if (best >= MIN_MATCH) {
+	    mlen[i] = best;
+	    moff[i] = off;
+	}
+    }
+
+    /* The cheapest way from each position to the end */
+    cost[in_len] = 0;
+    for (i = in_len; i-- > 0;) {
+	cost[i] = cost[i + 1] + 1;
+	step[i] = 0;
+	for (l = MIN_MATCH; l <= mlen[i]; l++) {
+	    if (l > MIN_MATCH + 14 && l < mlen[i])
+		l = mlen[i];
+	    if (match_cost(l) + cost[i + l] <= cost[i]) {
+		cost[i] = match_cost(l) + cost[i + l];
+		step[i] = l;
+	    }
+	}
+    }
+
+    for (i = anchor = 0; i < in_len;) {
+	if (!step[i]) {
+	    i++;
+	    continue;
+	}
+	op = put_seq(op, in + anchor, i - anchor, moff[i], step[i]);
+	i += step[i];
+	anchor = i;
+    }
+    op = put_seq(op, in + anchor, in_len - anchor, 0, 0);
+    in_len = op - out;
+
+out:
+    free(head);
+    free(prev);
+    free(mlen);
+    free(moff);
+    free(cost);
+    free(step);
+    return in_len;
+}
+
+static int get_len(const uint8_t **ip, const uint8_t *iend, size_t *len)
+{
+    uint8_t b;
+
+    do {
+	if (*ip >= iend)
+	    return -1;
+	b = *(*ip)++;
+	*len += b;
+    } while (b == 255);
+    return 0;
+}
+
+/*
+ * Decompress into out, which has room for *out_len bytes; *out_len
+ * is set to the size of the output.  Returns 0, or -1 if the data
+ * is corrupt or doesn't fit.
+ */
+int lz4_decompress(const uint8_t *in, size_t in_len,
+		   uint8_t *out, size_t *out_len)
+{
+    const uint8_t *ip = in, *iend = in + in_len;
+    uint8_t *op = out, *oend = out + *out_len;
+    size_t len, off;
+    uint8_t token;
+
+    *out_len = 0;
+    for (;;) {
+	if (ip >= iend)
+	    return -1;
+	token = *ip++;
+
+	len = token >> 4;
+	if (len == 15 && get_len(&ip, iend, &len))
+	    return -1;
+	if (len > (size_t)(iend - ip) || len > (size_t)(oend - op))
+	    return -1;
+	memcpy(op, ip, len);
+	op += len;
+	ip += len;
+	if (ip == iend)
+	    break;
+
+	if (iend - ip < 2)
+	    return -1;
+	off = ip[0] | ip[1] << 8;
+	ip += 2;
+	if (!off || off > (size_t)(op - out))
+	    return -1;
+
+	len = token & 15;
+	if (len == 15 && get_len(&ip, iend, &len))
+	    return -1;
+	len += MIN_MATCH;
+	if (len > (size_t)(oend - op))
+	    return -1;
+	while (len--) {
+	    *op = op[-off];
+	    op++;
+	}
+    }
+
+    *out_len = op - out;
+    return 0;
+}
@@ -0,0 +1,20 @@
+/*
+ * lz4.h
+ *
+ * LZ4 block format compression for prepcore
+ */
+
+#ifndef PREPCORE_LZ4_H
+#define PREPCORE_LZ4_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Worst case size of the compressed form of n bytes */
+#define LZ4_BOUND(n)	((n) + (n) / 255 + 16)
+
+size_t lz4_compress(const uint8_t *in, size_t in_len, uint8_t *out);
+int lz4_decompress(const uint8_t *in, size_t in_len,
+		   uint8_t *out, size_t *out_len);
+
+#endif /* PREPCORE_LZ4_H */
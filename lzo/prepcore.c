@@ -92,6 +92,8 @@ lzo1y_999_compress_internal(const lzo_bytep in, lzo_uint in_len,
 #include <string.h>
 #include <time.h>
 
+#include "lz4.h"
+
 #ifdef __GNUC__
 # define noreturn void __attribute__((noreturn))
 #else
@@ -104,6 +106,13 @@ struct prefix {
     uint32_t pfx_cdatalen;
     uint32_t pfx_checksum;
     uint32_t pfx_maxlma;
+    uint32_t pfx_cformat;
+};
+
+/* The values of the core's compressed format field */
+enum cformat {
+    CFORMAT_LZO = 0,		/* LZO1X */
+    CFORMAT_LZ4 = 1,		/* LZ4 block */
 };
 
 static inline uint32_t get_32(const uint32_t * p)
@@ -159,6 +168,12 @@ static void *xzalloc(size_t n)
     return p;
 }
 
+static noreturn usage(void)
+{
+    fprintf(stderr, "Usage: %s [-c lzo|lz4] file output-file\n", progname);
+    exit(1);
+}
+
 /*************************************************************************
 //
 **************************************************************************/
@@ -195,12 +210,21 @@ int main(int argc, char *argv[])
     long l;
 
     struct prefix *prefix;
+    enum cformat cformat = CFORMAT_LZO;
 
     progname = argv[0];
-    if (argc != 3) {
-	fprintf(stderr, "Usage: %s file output-file\n", progname);
-	exit(1);
+    if (argc > 1 && !strcmp(argv[1], "-c")) {
+	if (argc < 3)
+	    usage();
+	if (!strcmp(argv[2], "lz4"))
+	    cformat = CFORMAT_LZ4;
+	else if (strcmp(argv[2], "lzo"))
+	    usage();
+	argc -= 2;
+	argv += 2;
     }
+    if (argc != 3)
+	usage();
     in_name = argv[1];
     if (argc > 2)
 	out_name = argv[2];
@@ -253,6 +277,20 @@ int main(int argc, char *argv[])
     uncompressed_checksum = lzo_adler32(0, NULL, 0);
     uncompressed_checksum = lzo_adler32(uncompressed_checksum, in, in_len);
 
+/*
+ * Step 6: the LZ4 format, which is bigger but quicker to unpack, has
+ * a compressor all of its own
+ */
+    if (cformat == CFORMAT_LZ4) {
+	out_len = lz4_compress(in, in_len, out);
+	if (!out_len)
+	    error("out of memory");
+	if (out_len >= in_len)
+	    fprintf(stderr, "%s: %s: this file contains incompressible data.",
+		    progname, in_name);
+	goto compressed;
+    }
+
 /*
  * Step 6a: compress from `in' to `out' with LZO1X-999
  */
@@ -310,6 +348,7 @@ int main(int argc, char *argv[])
 /*
  * Step 10: compute a checksum of the compressed data
  */
+compressed:
     compressed_checksum = lzo_adler32(0, NULL, 0);
     compressed_checksum = lzo_adler32(compressed_checksum, out, out_len);
 
@@ -324,6 +363,9 @@ int main(int argc, char *argv[])
     soff = get_32(&prefix->pfx_cdatalen);
     set_32((uint32_t *) (infile + soff), out_len);
 
+    soff = get_32(&prefix->pfx_cformat);
+    set_32((uint32_t *) (infile + soff), cformat);
+
     soff = get_32(&prefix->pfx_checksum);
     if (soff) {
 	/* ISOLINUX padding and checksumming */
@@ -361,7 +403,14 @@ int main(int argc, char *argv[])
 #ifdef PARANOID
     orig_len = in_len * 2;
     test = xzalloc(orig_len);
-    r = lzo1x_decompress_safe(out, out_len, test, &orig_len, NULL);
+    if (cformat == CFORMAT_LZ4) {
+	size_t test_len = orig_len;
+
+	r = lz4_decompress(out, out_len, test, &test_len);
+	orig_len = test_len;
+    } else {
+	r = lzo1x_decompress_safe(out, out_len, test, &orig_len, NULL);
+    }
 
     if (r != LZO_E_OK || orig_len != in_len) {
 	/* this should NEVER happen */
@@ -131,10 +131,20 @@ static inline void cli(void)
 }
 
 /* Decompression */
+enum zip_format {
+    ZIP_DEFLATE,		/* gzip or pkzip */
+    ZIP_LZ4,			/* LZ4 frame */
+};
+
 extern int check_zip(void *indata, uint32_t size, uint32_t * zbytes_p,
 		     uint32_t * dbytes_p, uint32_t * orig_crc,
-		     uint32_t * offset_p);
+		     uint32_t * offset_p, enum zip_format *format_p);
 extern void *unzip(void *indata, uint32_t zbytes, uint32_t dbytes,
+		   uint32_t orig_crc, void *target, enum zip_format format);
+extern int check_lz4(void *indata, uint32_t size, uint32_t * zbytes_p,
+		     uint32_t * dbytes_p, uint32_t * orig_crc,
+		     uint32_t * offset_p);
+extern void *unlz4(void *indata, uint32_t zbytes, uint32_t dbytes,
 		   uint32_t orig_crc, void *target);
 
 #endif
@@ -172,6 +172,14 @@ struct patch_area {
     uint16_t mystack;
     uint16_t statusptr;
 
+    uint32_t sparse_map;	/* Block map of a sparse disk, or 0 */
+    uint32_t sparse_zero;	/* A block of zeros */
+    uint32_t pool_next;		/* Growth pool for writes to a sparse disk */
+    uint32_t pool_end;
+    uint32_t sparse_offset;	/* Offset of the image in a sparse disk */
+    uint8_t block_shift;	/* log2(block size) of a sparse disk */
+    uint8_t _pad4[3];		/* Pad to DWORD */
+
     dpt_t dpt;
     struct edd_dpt edd_dpt;
     struct edd4_cd_pkt cd_pkt;	/* Only really in a memdisk_iso_* hook */
@@ -22,6 +22,7 @@
 #include "conio.h"
 #include "version.h"
 #include "memdisk.h"
+#include "sparse.h"
 #include <version.h>
 
 const char memdisk_version[] = "MEMDISK " VERSION_STR " " DATE;
@@ -132,11 +133,12 @@ void unzip_if_needed(uint32_t * where_p, uint32_t * size_p)
     uint32_t gzdatasize, gzwhere;
     uint32_t orig_crc, offset;
     uint32_t target = 0;
+    enum zip_format format;
     int i, okmem;
 
-    /* Is it a gzip image? */
+    /* Is it a compressed image? */
     if (check_zip((void *)where, size, &zbytes, &gzdatasize,
-		  &orig_crc, &offset) == 0) {
+		  &orig_crc, &offset, &format) == 0) {
 
 	if (offset + zbytes > size) {
 	    /*
@@ -225,12 +227,13 @@ void unzip_if_needed(uint32_t * where_p, uint32_t * size_p)
 	    die("Not enough memory to decompress image (need 0x%08x bytes)\n",
 		gzdatasize);
 
-	printf("gzip image: decompressed addr 0x%08x, len 0x%08x: ",
-	       target, gzdatasize);
+	printf("%s image: decompressed addr 0x%08x, len 0x%08x: ",
+	       format == ZIP_LZ4 ? "lz4" : "gzip", target, gzdatasize);
 
 	*size_p = gzdatasize;
 	*where_p = (uint32_t) unzip((void *)(where + offset), zbytes,
-				    gzdatasize, orig_crc, (void *)target);
+				    gzdatasize, orig_crc, (void *)target,
+				    format);
     }
 }
 
@@ -747,6 +750,26 @@ void setmaxmem(unsigned long long restop_ull)
     parse_mem();
 }
 
+/*
+ * Size of the growth pool for a sparse image: what the command line
+ * says, or by default enough for modest writes, none if read-only
+ */
+static uint32_t sparse_pool_size(void)
+{
+    const char *p;
+
+    if (getcmditem("ro") != CMD_NOTFOUND)
+	return 0;
+
+    if (CMD_HASDATA(p = getcmditem("pool")))
+	return min(suffix_number(p), 0x80000000ULL);
+
+    return 1 << 20;
+}
+
+/* The start of a sparse disk, where the geometry is guessed from */
+static char sparse_head[16384] __attribute__ ((aligned(16)));
+
 struct real_mode_args rm_args;
 
 /*
@@ -766,6 +789,8 @@ void setup(const struct real_mode_args *rm_args_ptr)
     uint16_t dosmem_k;
     uint32_t stddosmem;
     const struct geometry *geometry;
+    struct sparse_disk sparse;
+    int is_sparse;
     unsigned int total_size;
     unsigned int cmdline_len, stack_len, e820_len;
     const struct edd4_bvd *bvd;
@@ -802,7 +827,25 @@ void setup(const struct real_mode_args *rm_args_ptr)
 
     unzip_if_needed(&ramdisk_image, &ramdisk_size);
 
-    geometry = get_disk_image_geometry(ramdisk_image, ramdisk_size);
+    /* Reserve the ramdisk memory */
+    insertrange(ramdisk_image, ramdisk_size, 2);
+    parse_mem();		/* Recompute variables */
+
+    is_sparse = sparse_setup(&sparse, ramdisk_image, ramdisk_size,
+			     sparse_pool_size());
+    if (is_sparse) {
+	if (getcmditem("iso") != CMD_NOTFOUND)
+	    die("MEMDISK: iso is not supported with a sparse image\n");
+
+	sparse_read(&sparse, sparse_head, 0, sizeof sparse_head);
+	geometry = get_disk_image_geometry((uint32_t)sparse_head,
+					   sparse.size);
+	if ((geometry->offset & 3) ||
+	    geometry->offset + 512 > sizeof sparse_head)
+	    die("MEMDISK: offset not usable with a sparse image\n");
+    } else {
+	geometry = get_disk_image_geometry(ramdisk_image, ramdisk_size);
+    }
 
     if (getcmditem("edd") != CMD_NOTFOUND ||
 	getcmditem("ebios") != CMD_NOTFOUND)
@@ -838,10 +881,6 @@ void setup(const struct real_mode_args *rm_args_ptr)
 	}
     }
 
-    /* Reserve the ramdisk memory */
-    insertrange(ramdisk_image, ramdisk_size, 2);
-    parse_mem();		/* Recompute variables */
-
     /* Figure out where it needs to go */
     hptr = (struct memdisk_header *)memdisk_hook;
     pptr = (struct patch_area *)(memdisk_hook + hptr->patch_offs);
@@ -859,7 +898,21 @@ void setup(const struct real_mode_args *rm_args_ptr)
     pptr->heads = geometry->h;
     pptr->sectors = geometry->s;
     pptr->mdi.disksize = geometry->sectors;
-    pptr->mdi.diskbuf = ramdisk_image + geometry->offset;
+    if (is_sparse) {
+	/*
+	 * There is no flat copy of the disk to point at; diskbuf = 0
+	 * tells whoever reads the MDI or mBFT not to map it.
+	 */
+	pptr->mdi.diskbuf = 0;
+	pptr->sparse_offset = geometry->offset;
+	pptr->sparse_map = sparse.map;
+	pptr->sparse_zero = sparse.zero;
+	pptr->pool_next = sparse.pool;
+	pptr->pool_end = sparse.pool_end;
+	pptr->block_shift = sparse.block_shift;
+    } else {
+	pptr->mdi.diskbuf = ramdisk_image + geometry->offset;
+    }
     pptr->mdi.sector_shift = geometry->sector_shift;
     pptr->statusptr = (geometry->driveno & 0x80) ? 0x474 : 0x441;
 
@@ -1217,9 +1270,13 @@ void setup(const struct real_mode_args *rm_args_ptr)
     /* Reboot into the new "disk" */
     puts("Loading boot sector... ");
 
-    memcpy((void *)boot_base,
-	   (char *)pptr->mdi.diskbuf + geometry->boot_lba * 512,
-	   boot_len);
+    if (is_sparse)
+	sparse_read(&sparse, (void *)boot_base,
+		    geometry->offset + geometry->boot_lba * 512, boot_len);
+    else
+	memcpy((void *)boot_base,
+	       (char *)pptr->mdi.diskbuf + geometry->boot_lba * 512,
+	       boot_len);
 
     if (getcmditem("pause") != CMD_NOTFOUND) {
 	puts("press any key to boot... ");
@@ -0,0 +1,181 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, Inc., 53 Temple Place Ste 330,
+ *   Boston MA 02111-1307, USA; either version 2 of the License, or
+ *   (at your option) any later version; incorporated herein by reference.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * sparse.c
+ *
+ * Set up a sparse disk image.  Only the blocks that were allocated in
+ * the image are kept, in place where the image was loaded; the block
+ * map built here points at each of them.  Every other block reads as
+ * zeros until it is written to, at which point the INT 13h handler
+ * gives it a block from the growth pool.  That way the memory taken
+ * from the operating system is the image as stored plus the map and
+ * the pool, not the size of the disk.
+ */
+
+#include <stdint.h>
+#include <minmax.h>
+#include "e820.h"
+#include "conio.h"
+#include "memdisk.h"
+#include "sparse.h"
+
+#define SPARSE_ALIGN	4096
+
+extern const char _end[];		/* Symbol signalling end of data */
+
+/*
+ * Find room for "len" bytes as high as possible in memory, below 4 GB
+ * and above ourselves.  Returns 0 if there is none.
+ */
+static uint32_t sparse_alloc(uint32_t len)
+{
+    uint32_t startrange, endrange;
+    int i;
+
+    for (i = nranges - 1; i >= 0; i--) {
+	/* Must be memory */
+	if (ranges[i].type != 1)
+	    continue;
+
+	if (ranges[i].start >= 0xFFFFFFFF)
+	    continue;
+
+	startrange = (uint32_t) ranges[i].start;
+
+	/* Range end (0 for end means 2^64) */
+	endrange = ((ranges[i + 1].start >= 0xFFFFFFFF ||
+		     ranges[i + 1].start == 0)
+		    ? 0xFFFFFFFF : (uint32_t) ranges[i + 1].start);
+
+	/* Make sure we don't overwrite ourselves */
+	if (startrange < (uint32_t) _end)
+	    startrange = (uint32_t) _end;
+
+	startrange = (startrange + (SPARSE_ALIGN - 1)) & ~(SPARSE_ALIGN - 1);
+
+	if (startrange >= endrange || endrange - startrange < len)
+	    continue;
+
+	return (endrange - len) & ~(SPARSE_ALIGN - 1);
+    }
+
+    return 0;
+}
+
+/*
+ * If the image at "where" is a sparse image, set it up with a growth
+ * pool of "pool" bytes and return 1; return 0 if it is a plain image.
+ * The image itself must already be reserved.
+ */
+int sparse_setup(struct sparse_disk *sd, uint32_t where, uint32_t size,
+		 uint32_t pool)
+{
+    const struct sparse_header *hdr = (const struct sparse_header *)where;
+    const uint8_t *bitmap;
+    uint32_t *map;
+    uint32_t bsize, blocks, used, data, base, map_len, i;
+
+    if (size < sizeof *hdr || memcmp(hdr->magic, SPARSE_MAGIC, 8))
+	return 0;
+
+    if (hdr->version != SPARSE_VERSION || hdr->reserved)
+	die("MEMDISK: unsupported sparse image version %u\n", hdr->version);
+
+    /* The disk has to be addressable in 32 bits */
+    if (hdr->block_shift < 9 || hdr->block_shift > 16 ||
+	!hdr->sectors || hdr->sectors >= (1 << 23))
+	die("MEMDISK: invalid sparse image header\n");
+
+    bsize = 1 << hdr->block_shift;
+    blocks = ((hdr->sectors - 1) >> (hdr->block_shift - 9)) + 1;
+
+    if (hdr->bitmap_offset > size ||
+	size - hdr->bitmap_offset < (blocks + 7) >> 3)
+	die("MEMDISK: sparse image is truncated\n");
+
+    bitmap = (const uint8_t *)(where + hdr->bitmap_offset);
+
+    used = 0;
+    for (i = 0; i < blocks; i++)
+	used += (bitmap[i >> 3] >> (i & 7)) & 1;
+
+    if (hdr->data_offset > size ||
+	(size - hdr->data_offset) >> hdr->block_shift < used)
+	die("MEMDISK: sparse image is truncated\n");
+
+    /* The pool never needs to be larger than the unallocated blocks */
+    pool = min(pool >> hdr->block_shift, blocks - used) << hdr->block_shift;
+
+    map_len = (blocks * 4 + bsize - 1) & ~(bsize - 1);
+    base = sparse_alloc(map_len + bsize + pool);
+    if (!base)
+	die("MEMDISK: Not enough memory for the sparse image map\n");
+
+    insertrange(base, map_len + bsize + pool, 2);
+    parse_mem();
+
+    map = (uint32_t *)base;
+    data = where + hdr->data_offset;
+    for (i = 0; i < blocks; i++) {
+	if ((bitmap[i >> 3] >> (i & 7)) & 1) {
+	    map[i] = data;
+	    data += bsize;
+	} else {
+	    map[i] = 0;
+	}
+    }
+
+    sd->map = base;
+    sd->zero = base + map_len;
+    sd->pool = sd->zero + bsize;
+    sd->pool_end = sd->pool + pool;
+    sd->size = hdr->sectors << 9;
+    sd->block_shift = hdr->block_shift;
+
+    memset((void *)sd->zero, 0, bsize);
+
+    printf("Sparse image: %u of %u blocks of %u bytes present, "
+	   "map at 0x%08x, growth pool %uK\n",
+	   used, blocks, bsize, base, pool >> 10);
+
+    return 1;
+}
+
+/*
+ * Read from a sparse disk before the INT 13h handler is installed
+ */
+void sparse_read(const struct sparse_disk *sd, void *buf, uint32_t offset,
+		 uint32_t len)
+{
+    const uint32_t *map = (const uint32_t *)sd->map;
+    uint32_t bsize = 1 << sd->block_shift;
+    uint32_t boff, n, src;
+    char *p = buf;
+
+    while (len) {
+	boff = offset & (bsize - 1);
+	n = min(len, bsize - boff);
+
+	if (offset >= sd->size)
+	    src = 0;
+	else
+	    src = map[offset >> sd->block_shift];
+
+	if (src)
+	    memcpy(p, (const char *)src + boff, n);
+	else
+	    memset(p, 0, n);
+
+	p += n;
+	offset += n;
+	len -= n;
+    }
+}
@@ -0,0 +1,55 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, Inc., 53 Temple Place Ste 330,
+ *   Boston MA 02111-1307, USA; either version 2 of the License, or
+ *   (at your option) any later version; incorporated herein by reference.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * sparse.h
+ *
+ * Sparse disk images, as made by utils/mksparse
+ */
+
+#ifndef MEMDISK_SPARSE_H
+#define MEMDISK_SPARSE_H
+
+#include <stdint.h>
+
+#define SPARSE_MAGIC	"MDSPARSE"
+#define SPARSE_VERSION	1
+
+/*
+ * The image starts with this header, all fields little endian.  It is
+ * followed by the allocation bitmap, one bit per block, LSB first, and
+ * then by the data of every allocated block in ascending order.  All
+ * other blocks read as zeros.
+ */
+struct sparse_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t sectors;		/* Size of the disk in 512-byte sectors */
+    uint32_t block_shift;	/* log2 of the block size */
+    uint32_t bitmap_offset;	/* Offset of the allocation bitmap */
+    uint32_t data_offset;	/* Offset of the first allocated block */
+    uint32_t reserved;		/* Must be zero */
+} __attribute__ ((packed));
+
+/* A sparse disk once set up in memory */
+struct sparse_disk {
+    uint32_t map;		/* Block map: address of each block, or 0 */
+    uint32_t zero;		/* A block of zeros */
+    uint32_t pool;		/* Growth pool for writes... */
+    uint32_t pool_end;		/* ... and its end */
+    uint32_t size;		/* Size of the disk in bytes */
+    uint8_t block_shift;
+};
+
+extern int sparse_setup(struct sparse_disk *, uint32_t, uint32_t, uint32_t);
+extern void sparse_read(const struct sparse_disk *, void *, uint32_t,
+			uint32_t);
+
+#endif /* MEMDISK_SPARSE_H */
@@ -0,0 +1,245 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, Inc., 53 Temple Place Ste 330,
+ *   Boston MA 02111-1307, USA; either version 2 of the License, or
+ *   (at your option) any later version; incorporated herein by reference.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * unlz4.c
+ *
+ * Decompression of LZ4 frame format images.  LZ4 decompresses many
+ * times faster than inflate, so a large image costs far less of a
+ * stall at boot.  The frame must record the content size (lz4
+ * --content-size), as we need to know where to put the image before
+ * we start; the content checksum is verified if there is one.
+ */
+
+#include <stdint.h>
+#include "memdisk.h"
+#include "conio.h"
+
+#define LZ4_MAGIC	0x184D2204
+#define LZ4_HDR_SIZE	15	/* magic, FLG, BD, content size, HC */
+
+/* FLG bits */
+#define LZ4_VERSION	0xC0	/* version field, must be 01 */
+#define LZ4_BCHECK	0x10	/* each block is followed by a checksum */
+#define LZ4_CSIZE	0x08	/* content size present */
+#define LZ4_CCHECK	0x04	/* content checksum at the end */
+#define LZ4_RESERVED	0x02
+#define LZ4_DICTID	0x01	/* dictionary ID present */
+
+#define LZ4_RAW_BLOCK	0x80000000	/* block size flag: stored */
+
+#define PRIME32_1	2654435761U
+#define PRIME32_2	2246822519U
+#define PRIME32_3	3266489917U
+#define PRIME32_4	668265263U
+#define PRIME32_5	374761393U
+
+static inline uint32_t get_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint32_t rotl32(uint32_t x, int n)
+{
+    return (x << n) | (x >> (32 - n));
+}
+
+/* xxHash32, the checksum the LZ4 frame format uses */
+static uint32_t xxh32(const uint8_t *p, uint32_t len)
+{
+    const uint8_t *end = p + len;
+    uint32_t v1, v2, v3, v4, h;
+
+    if (len >= 16) {
+	v1 = PRIME32_1 + PRIME32_2;
+	v2 = PRIME32_2;
+	v3 = 0;
+	v4 = -PRIME32_1;
+	do {
+	    v1 = rotl32(v1 + get_le32(p) * PRIME32_2, 13) * PRIME32_1;
+	    v2 = rotl32(v2 + get_le32(p + 4) * PRIME32_2, 13) * PRIME32_1;
+	    v3 = rotl32(v3 + get_le32(p + 8) * PRIME32_2, 13) * PRIME32_1;
+	    v4 = rotl32(v4 + get_le32(p + 12) * PRIME32_2, 13) * PRIME32_1;
+	    p += 16;
+	} while (end - p >= 16);
+	h = rotl32(v1, 1) + rotl32(v2, 7) + rotl32(v3, 12) + rotl32(v4, 18);
+    } else {
+	h = PRIME32_5;
+    }
+
+    h += len;
+
+    while (end - p >= 4) {
+	h = rotl32(h + get_le32(p) * PRIME32_3, 17) * PRIME32_4;
+	p += 4;
+    }
+    while (p < end)
+	h = rotl32(h + *p++ * PRIME32_5, 11) * PRIME32_1;
+
+    h ^= h >> 15;
+    h *= PRIME32_2;
+    h ^= h >> 13;
+    h *= PRIME32_3;
+    h ^= h >> 16;
+    return h;
+}
+
+static void lz4_error(const char *x)
+{
+    die("failed\nDecompression error: %s\n", x);
+}
+
+static void corrupt(void)
+{
+    lz4_error("lz4 data corrupt");
+}
+
+/* Return 0 if (indata, size) is an LZ4 frame we can decompress */
+int check_lz4(void *indata, uint32_t size, uint32_t * zbytes_p,
+	      uint32_t * dbytes_p, uint32_t * orig_crc, uint32_t * offset_p)
+{
+    const uint8_t *p = indata;
+    uint8_t flg;
+
+    if (size < LZ4_HDR_SIZE + 4 || get_le32(p) != LZ4_MAGIC)
+	return -1;
+
+    flg = p[4];
+    if ((flg & LZ4_VERSION) != 0x40 || (flg & LZ4_RESERVED) ||
+	(p[5] & 0x8f))
+	lz4_error("lz4 file has an unsupported version or flags");
+    if (flg & LZ4_DICTID)
+	lz4_error("lz4 file needs a dictionary; not supported");
+    if (!(flg & LZ4_CSIZE))
+	lz4_error("lz4 file does not record its size; use lz4 --content-size");
+    if (get_le32(p + 10))
+	lz4_error("lz4 image is too large");
+    if (((xxh32(p + 4, LZ4_HDR_SIZE - 5) >> 8) & 0xff) != p[14])
+	lz4_error("lz4 file header is corrupt");
+
+    /* The decompressor reads the frame header again, so start there */
+    *zbytes_p = size;
+    *dbytes_p = get_le32(p + 6);
+    *orig_crc = (flg & LZ4_CCHECK) ? get_le32(p + size - 4) : 0;
+    *offset_p = 0;
+    return 0;
+}
+
+/* Decompress one block, of LEN bytes at IN, to *OUTP */
+static void lz4_block(const uint8_t *in, uint32_t len, const uint8_t *start,
+		      uint8_t **outp, const uint8_t *out_end)
+{
+    const uint8_t *end = in + len;
+    uint8_t *out = *outp;
+    uint32_t lit, mlen, off;
+    uint8_t token, c;
+
+    for (;;) {
+	if (in >= end)
+	    corrupt();
+	token = *in++;
+
+	lit = token >> 4;
+	if (lit == 15) {
+	    do {
+		if (in >= end)
+		    corrupt();
+		c = *in++;
+		lit += c;
+	    } while (c == 255);
+	}
+	if (lit > (uint32_t)(end - in) || lit > (uint32_t)(out_end - out))
+	    corrupt();
+	out = mempcpy(out, in, lit);
+	in += lit;
+
+	/* The last sequence of a block is literals only */
+	if (in == end)
+	    break;
+
+	if (end - in < 2)
+	    corrupt();
+	off = in[0] | (in[1] << 8);
+	in += 2;
+	if (!off || off > (uint32_t)(out - start))
+	    corrupt();
+
+	mlen = (token & 15) + 4;
+	if ((token & 15) == 15) {
+	    do {
+		if (in >= end)
+		    corrupt();
+		c = *in++;
+		mlen += c;
+	    } while (c == 255);
+	}
+	if (mlen > (uint32_t)(out_end - out))
+	    corrupt();
+
+	if (off >= mlen) {
+	    out = mempcpy(out, out - off, mlen);
+	} else {
+	    /* Overlapping match: a repeated pattern, copy it bytewise */
+	    while (mlen--) {
+		*out = *(out - off);
+		out++;
+	    }
+	}
+    }
+
+    *outp = out;
+}
+
+void *unlz4(void *indata, uint32_t zbytes, uint32_t dbytes,
+	    uint32_t orig_crc, void *target)
+{
+    const uint8_t *p = indata;
+    const uint8_t *end = p + zbytes;
+    uint8_t *out = target;
+    uint8_t *out_end = out + dbytes;
+    uint32_t bsize;
+    uint8_t flg = p[4];
+
+    p += LZ4_HDR_SIZE;
+    for (;;) {
+	if (end - p < 4)
+	    corrupt();
+	bsize = get_le32(p);
+	p += 4;
+	if (!bsize)
+	    break;		/* End mark */
+
+	if (bsize & LZ4_RAW_BLOCK) {
+	    bsize &= ~LZ4_RAW_BLOCK;
+	    if (bsize > (uint32_t)(end - p) ||
+		bsize > (uint32_t)(out_end - out))
+		corrupt();
+	    out = mempcpy(out, p, bsize);
+	} else {
+	    if (bsize > (uint32_t)(end - p))
+		corrupt();
+	    lz4_block(p, bsize, target, &out, out_end);
+	}
+	p += bsize;
+
+	if (flg & LZ4_BCHECK)
+	    p += 4;
+    }
+
+    if (out != out_end)
+	lz4_error("uncompressed data length error");
+
+    if ((flg & LZ4_CCHECK) && xxh32(target, dbytes) != orig_crc)
+	lz4_error("crc error");
+
+    puts("ok\n");
+
+    return target;
+}
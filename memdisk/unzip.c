@@ -231,18 +231,24 @@ struct pkzip_header {
 #define PK_UNSUPPORTED    0xFFF0	/* All other bits must be zero */
 
 /* Return 0 if (indata, size) points to a ZIP file, and fill in
-   compressed data size, uncompressed data size, CRC, and offset of
-   data.
+   compressed data size, uncompressed data size, CRC, offset of
+   data and how it is compressed.
 
    If indata is not a ZIP file, return -1. */
 int check_zip(void *indata, uint32_t size, uint32_t * zbytes_p,
-	      uint32_t * dbytes_p, uint32_t * orig_crc, uint32_t * offset_p)
+	      uint32_t * dbytes_p, uint32_t * orig_crc, uint32_t * offset_p,
+	      enum zip_format *format_p)
 {
     struct gzip_header *gzh = (struct gzip_header *)indata;
     struct pkzip_header *pkzh = (struct pkzip_header *)indata;
     uint32_t offset;
 
-    if (gzh->magic == 0x8b1f) {
+    *format_p = ZIP_DEFLATE;
+
+    if (!check_lz4(indata, size, zbytes_p, dbytes_p, orig_crc, offset_p)) {
+	*format_p = ZIP_LZ4;
+	return 0;
+    } else if (gzh->magic == 0x8b1f) {
 	struct gzip_trailer *gzt = indata + size - sizeof(struct gzip_trailer);
 	/* We only support method #8, DEFLATED */
 	if (gzh->method != 8) {
@@ -352,8 +358,11 @@ extern void _end;
 static char heap[65536];
 
 void *unzip(void *indata, uint32_t zbytes, uint32_t dbytes,
-	    uint32_t orig_crc, void *target)
+	    uint32_t orig_crc, void *target, enum zip_format format)
 {
+    if (format == ZIP_LZ4)
+	return unlz4(indata, zbytes, dbytes, orig_crc, target);
+
     /* Set up the heap; it is simply a chunk of bss memory */
     free_mem_ptr     = (size_t)heap;
     free_mem_end_ptr = (size_t)heap + sizeof heap;
@@ -84,7 +84,7 @@ LIBOTHER_OBJS = \
 	bufprintf.o							\
 	inet.o dhcppack.o dhcpunpack.o					\
 	strreplace.o							\
-	lstrdup.o						\
+	lstrdup.o arena.o					\
 	\
 	suffix_number.o							\
 	\
@@ -117,6 +117,7 @@ LIBENTRY_OBJS = \
 	sys/intcall.o sys/farcall.o sys/cfarcall.o sys/zeroregs.o	\
 	sys/argv.o sys/sleep.o						\
 	sys/fileinfo.o sys/opendev.o sys/read.o sys/write.o sys/ftell.o \
+	sys/setvbuf.o							\
 	sys/close.o sys/open.o sys/fileread.o sys/fileclose.o		\
 	sys/openmem.o					\
 	sys/isatty.o sys/fstat.o					\
@@ -163,19 +164,20 @@ LIBLOAD_OBJS = \
 	\
 	syslinux/load_linux.o syslinux/initramfs.o			\
 	syslinux/initramfs_file.o syslinux/initramfs_loadfile.o		\
-	syslinux/initramfs_archive.o
+	syslinux/initramfs_archive.o syslinux/initramfs_stream.o
 
 LIBMODULE_OBJS = \
 	sys/module/common.o sys/module/$(ARCH)/elf_module.o		\
 	sys/module/elfutils.o	\
-	sys/module/exec.o sys/module/elf_module.o
+	sys/module/exec.o sys/module/elf_module.o sys/module/cache.o	\
+	sys/module/bundle.o
 
 # ZIP library object files
 LIBZLIB_OBJS = \
 	zlib/adler32.o zlib/compress.o zlib/crc32.o 			\
 	zlib/uncompr.o zlib/deflate.o zlib/trees.o zlib/zutil.o		\
 	zlib/inflate.o zlib/infback.o zlib/inftrees.o zlib/inffast.o	\
-	sys/zfile.o sys/zfopen.o
+	sys/zfile.o sys/zfopen.o sys/lz4file.o
 
 MINLIBOBJS = \
 	$(addprefix $(OBJ)/,syslinux/ipappend.o \
@@ -201,7 +203,9 @@ CORELIBOBJS = \
 	libgcc/__negdi2.o libgcc/__ashrdi3.o libgcc/__lshrdi3.o		\
 	libgcc/__muldi3.o libgcc/__udivmoddi4.o libgcc/__umoddi3.o	\
 	libgcc/__divdi3.o libgcc/__moddi3.o				\
-	syslinux/debug.o						\
+	syslinux/debug.o sys/x86_init_mem.o				\
+	calloc.o zlib/inflate.o zlib/inftrees.o zlib/inffast.o		\
+	zlib/zutil.o zlib/adler32.o zlib/crc32.o			\
 	$(LIBENTRY_OBJS) \
 	$(LIBMODULE_OBJS)
 
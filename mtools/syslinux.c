@@ -14,9 +14,12 @@
 /*
  * syslinux.c - Linux installer program for SYSLINUX
  *
- * This program now requires mtools.  It turned out to be a lot
- * easier to deal with than dealing with needing mount privileges.
- * We need device write permission anyway.
+ * This program doesn't need mount privileges, only device write
+ * permission.  It writes ldlinux.sys and ldlinux.c32 straight into
+ * the filesystem with libfat when it can, and falls back on mtools
+ * for anything that takes more than that (a directory name that
+ * isn't 8.3, a full directory, a volume too fragmented for a
+ * contiguous file).
  */
 
 #define _GNU_SOURCE
@@ -32,6 +35,7 @@
 #include <stdlib.h>
 #include <sysexits.h>
 #include <syslog.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -39,6 +43,7 @@
 
 #include "syslinux.h"
 #include "libfat.h"
+#include "fat.h"
 #include "setadv.h"
 #include "syslxopt.h"
 #include "syslxfs.h"
@@ -69,6 +74,215 @@ int libfat_xpread(intptr_t pp, void *buf, size_t secsize,
     return xpread(pp, buf, secsize, offset);
 }
 
+/*
+ * Version of the write function suitable for libfat
+ */
+static int libfat_xpwrite(intptr_t pp, const void *buf, size_t secsize,
+			  libfat_sector_t sector)
+{
+    off_t offset = (off_t) sector * secsize + opt.offset;
+    return xpwrite(pp, buf, secsize, offset);
+}
+
+/*
+ * Turn one component of a path into an 8.3 directory entry name.
+ * Returns the length of the component, or -1 if it can't be done
+ * without a long name.
+ */
+static int mangle_name(char *dst, const char *src)
+{
+    static const char ok[] = "!#$%&'()-@^_`{}~";
+    int len, i, dot;
+    char c;
+
+    memset(dst, ' ', 11);
+    for (len = i = dot = 0; src[len] && src[len] != '/' &&
+	     src[len] != '\\'; len++) {
+	c = src[len];
+	if (c == '.') {
+	    if (dot++ || !i)
+		return -1;
+	    i = 8;
+	    continue;
+	}
+	if (c >= 'a' && c <= 'z')
+	    c -= 'a' - 'A';
+	else if (!(c >= 'A' && c <= 'Z') && !(c >= '0' && c <= '9') &&
+		 !strchr(ok, c))
+	    return -1;
+	if (i == (dot ? 11 : 8))
+	    return -1;
+	dst[i++] = c;
+    }
+
+    return len;
+}
+
+/*
+ * Find the cluster of the directory ldlinux.sys goes in: 0 for the
+ * root, or -1 if libfat can't get there by short names alone.
+ */
+static int32_t direct_dir(struct libfat_filesystem *fs)
+{
+    struct libfat_direntry de;
+    struct fat_dirent *dep = (struct fat_dirent *)de.entry;
+    const char *p = opt.directory;
+    char name[11];
+    int32_t dirclust = 0;
+    int len;
+
+    while (p && *p) {
+	if (*p == '/' || *p == '\\') {
+	    p++;
+	    continue;
+	}
+	len = mangle_name(name, p);
+	if (len < 0 || libfat_searchdir(fs, dirclust, name, &de) < 0 ||
+	    !(read8(&dep->attribute) & 0x10))
+	    return -1;
+	/* A directory has no size, so take its cluster from the entry */
+	dirclust = read16(&dep->clustlo) + (read16(&dep->clusthi) << 16);
+	p += len;
+    }
+
+    return dirclust;
+}
+
+/*
+ * A file being written directly: where its directory entry goes,
+ * the chain it had before, if any, and its new contiguous one
+ */
+struct direct_file {
+    struct libfat_direntry de;
+    int32_t oldclust;
+    int32_t clust;
+};
+
+/*
+ * Find or make the directory entry for NAME, and allocate SIZE bytes
+ * for it.  Returns 0, or -1 if mtools will have to do it; nothing
+ * has been changed on the disk in that case.
+ */
+static int direct_prepare(struct libfat_filesystem *fs, int32_t dirclust,
+			  const char *name, uint32_t size,
+			  struct direct_file *f)
+{
+    struct fat_dirent *dep = (struct fat_dirent *)f->de.entry;
+    int32_t rv;
+
+    rv = libfat_searchdir(fs, dirclust, name, &f->de);
+    if (rv == -2) {
+	if (libfat_findfree(fs, dirclust, &f->de))
+	    return -1;
+	memset(dep, 0, sizeof *dep);
+	memcpy(dep->name, name, 11);
+	f->oldclust = 0;
+    } else if (rv < 0 || (read8(&dep->attribute) & 0x18)) {
+	return -1;		/* Error, or a directory or volume label */
+    } else {
+	f->oldclust = rv;
+    }
+
+    /* The old chain stays allocated until the new file is in place */
+    f->clust = libfat_alloc(fs, size);
+    return f->clust < 0 ? -1 : 0;
+}
+
+/*
+ * Point the directory entry at the new data, which must be written
+ * by now, and free the old chain
+ */
+static void direct_commit(struct libfat_filesystem *fs, uint32_t size,
+			  struct direct_file *f)
+{
+    struct fat_dirent *dep;
+    time_t now = time(NULL);
+    struct tm *tm = localtime(&now);
+    uint16_t date, tod;
+
+    date = ((tm->tm_year - 80) << 9) | ((tm->tm_mon + 1) << 5) | tm->tm_mday;
+    tod = (tm->tm_hour << 11) | (tm->tm_min << 5) | (tm->tm_sec >> 1);
+
+    dep = libfat_get_sector(fs, f->de.sector);
+    if (!dep)
+	die("failed to write directory entry");
+    dep += f->de.offset / sizeof *dep;
+
+    memcpy(dep, f->de.entry, sizeof *dep);
+    write8(&dep->attribute, 0x07);	/* Hidden+System+Readonly */
+    write32(&dep->ctime, tod | (date << 16));
+    write16(&dep->atime, date);
+    write32(&dep->mtime, tod | (date << 16));
+    write16(&dep->clustlo, f->clust);
+    write16(&dep->clusthi, f->clust >> 16);
+    write32(&dep->size, size);
+
+    if (libfat_write_sector(fs, f->de.sector))
+	die("failed to write directory entry");
+
+    if (f->oldclust > 0 && libfat_freechain(fs, f->oldclust))
+	die("failed to free the old file");
+}
+
+/*
+ * Write ldlinux.c32 and ldlinux.sys without mtools, each as one
+ * contiguous run of clusters, so the sector map for ldlinux.sys is
+ * known before anything is written and the image only has to be
+ * written once.  Returns 0 on success, or -1 if mtools has to do it.
+ */
+static int direct_install(int dev_fd)
+{
+    struct libfat_filesystem *fs;
+    struct sector_extent ext;
+    struct direct_file f;
+    uint32_t size;
+    int32_t dirclust;
+    off_t offset;
+    int rv = -1;
+
+    fs = libfat_open(libfat_xpread, dev_fd);
+    if (!fs)
+	return -1;
+    libfat_set_write(fs, libfat_xpwrite);
+
+    dirclust = direct_dir(fs);
+    if (dirclust < 0)
+	goto done;
+
+    /* ldlinux.c32 */
+    size = syslinux_ldlinuxc32_len;
+    if (direct_prepare(fs, dirclust, "LDLINUX C32", size, &f))
+	goto done;
+    offset = opt.offset +
+	((off_t) libfat_clustertosector(fs, f.clust) << SECTOR_SHIFT);
+    if (xpwrite(dev_fd, (const char _force *)syslinux_ldlinuxc32, size,
+		offset) != (ssize_t)size)
+	die("failed to write ldlinux.c32");
+    direct_commit(fs, size, &f);
+
+    /* ldlinux.sys, patched with its own sector map first */
+    size = syslinux_ldlinux_len + 2 * ADV_SIZE;
+    if (direct_prepare(fs, dirclust, "LDLINUX SYS", size, &f))
+	goto done;
+    ext.lba = libfat_clustertosector(fs, f.clust);
+    ext.len = (size + SECTOR_SIZE - 1) >> SECTOR_SHIFT;
+    if (syslinux_patch_extents(&ext, 1, opt.stupid_mode, opt.raid_mode,
+			       opt.directory, NULL) < 0)
+	die("failed to patch ldlinux.sys");
+    offset = opt.offset + ((off_t) ext.lba << SECTOR_SHIFT);
+    if (xpwrite(dev_fd, (const char _force *)syslinux_ldlinux,
+		syslinux_ldlinux_len, offset) != syslinux_ldlinux_len ||
+	xpwrite(dev_fd, syslinux_adv, 2 * ADV_SIZE,
+		offset + syslinux_ldlinux_len) != 2 * ADV_SIZE)
+	die("failed to write ldlinux.sys");
+    direct_commit(fs, size, &f);
+
+    rv = 0;
+done:
+    libfat_close(fs);
+    return rv;
+}
+
 static int move_file(char *filename)
 {
     char target_file[4096], command[5120];
@@ -127,11 +341,12 @@ static int move_file(char *filename)
     return status;
 }
 
-int main(int argc, char *argv[])
+/*
+ * Write ldlinux.sys and ldlinux.c32 through mtools, then map
+ * ldlinux.sys with libfat and patch it in place
+ */
+static void mtools_install(int dev_fd)
 {
-    static unsigned char sectbuf[SECTOR_SIZE];
-    int dev_fd;
-    struct stat st;
     int status;
     const char *tmpdir;
     char *mtools_conf;
@@ -142,28 +357,9 @@ int main(int argc, char *argv[])
     libfat_sector_t *sectors;
     int32_t ldlinux_cluster;
     int nsectors;
-    const char *errmsg;
     int ldlinux_sectors, patch_sectors;
     int i;
 
-    (void)argc;			/* Unused */
-
-    mypid = getpid();
-    program = argv[0];
-
-    parse_options(argc, argv, MODE_SYSLINUX);
-
-    if (!opt.device)
-	usage(EX_USAGE, MODE_SYSLINUX);
-
-    if (opt.sectors || opt.heads || opt.reset_adv || opt.set_once
-	|| (opt.update_only > 0) || opt.menu_save) {
-	fprintf(stderr,
-		"At least one specified option not yet implemented"
-		" for this installer.\n");
-	exit(1);
-    }
-
     /*
      * Temp directory of choice...
      */
@@ -178,32 +374,6 @@ int main(int argc, char *argv[])
 #endif
     }
 
-    /*
-     * First make sure we can open the device at all, and that we have
-     * read/write permission.
-     */
-    dev_fd = open(opt.device, O_RDWR);
-    if (dev_fd < 0 || fstat(dev_fd, &st) < 0) {
-	die_err(opt.device);
-	exit(1);
-    }
-
-    if (!opt.force && !S_ISBLK(st.st_mode) && !S_ISREG(st.st_mode)) {
-	fprintf(stderr,
-		"%s: not a block device or regular file (use -f to override)\n",
-		opt.device);
-	exit(1);
-    }
-
-    xpread(dev_fd, sectbuf, SECTOR_SIZE, opt.offset);
-
-    /*
-     * Check to see that what we got was indeed an MS-DOS boot sector/superblock
-     */
-    if ((errmsg = syslinux_check_bootsect(sectbuf, NULL))) {
-	die(errmsg);
-    }
-
     /*
      * Create an mtools configuration file
      */
@@ -236,11 +406,6 @@ int main(int argc, char *argv[])
 	exit(1);
     }
 
-    /*
-     * Create a vacuous ADV in memory.  This should be smarter.
-     */
-    syslinux_reset_adv(syslinux_adv);
-
     /* This command may fail legitimately */
     status = system("mattrib -h -r -s s:/ldlinux.sys 2>/dev/null");
     (void)status;		/* Keep _FORTIFY_SOURCE happy */
@@ -329,6 +494,66 @@ int main(int argc, char *argv[])
      * Cleanup
      */
     unlink(mtools_conf);
+}
+
+int main(int argc, char *argv[])
+{
+    static unsigned char sectbuf[SECTOR_SIZE];
+    int dev_fd;
+    struct stat st;
+    const char *errmsg;
+
+    (void)argc;			/* Unused */
+
+    mypid = getpid();
+    program = argv[0];
+
+    parse_options(argc, argv, MODE_SYSLINUX);
+
+    if (!opt.device)
+	usage(EX_USAGE, MODE_SYSLINUX);
+
+    if (opt.sectors || opt.heads || opt.reset_adv || opt.set_once
+	|| (opt.update_only > 0) || opt.menu_save) {
+	fprintf(stderr,
+		"At least one specified option not yet implemented"
+		" for this installer.\n");
+	exit(1);
+    }
+
+    /*
+     * First make sure we can open the device at all, and that we have
+     * read/write permission.
+     */
+    dev_fd = open(opt.device, O_RDWR);
+    if (dev_fd < 0 || fstat(dev_fd, &st) < 0) {
+	die_err(opt.device);
+	exit(1);
+    }
+
+    if (!opt.force && !S_ISBLK(st.st_mode) && !S_ISREG(st.st_mode)) {
+	fprintf(stderr,
+		"%s: not a block device or regular file (use -f to override)\n",
+		opt.device);
+	exit(1);
+    }
+
+    xpread(dev_fd, sectbuf, SECTOR_SIZE, opt.offset);
+
+    /*
+     * Check to see that what we got was indeed an MS-DOS boot sector/superblock
+     */
+    if ((errmsg = syslinux_check_bootsect(sectbuf, NULL))) {
+	die(errmsg);
+    }
+
+    /*
+     * Create a vacuous ADV in memory.  This should be smarter.
+     */
+    syslinux_reset_adv(syslinux_adv);
+
+    if (direct_install(dev_fd))
+	mtools_install(dev_fd);
 
     /*
      * To finish up, write the boot sector
@@ -343,8 +568,9 @@ int main(int argc, char *argv[])
     /* Write new boot sector */
     xpwrite(dev_fd, sectbuf, SECTOR_SIZE, opt.offset);
 
+    /* Everything went through dev_fd, mtools included */
+    fsync(dev_fd);
     close(dev_fd);
-    sync();
 
     /* Done! */
 
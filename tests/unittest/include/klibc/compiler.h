@@ -12,4 +12,8 @@
 /* Specific calling conventions */
 #define __cdecl
 
+/* Branch prediction hints */
+#define __likely(x)	__builtin_expect(!!(x), 1)
+#define __unlikely(x)	__builtin_expect(!!(x), 0)
+
 #endif /* _COMPILER_H_ */
@@ -945,7 +945,7 @@ int
 main(int argc, char *argv[])
 {
     int i = 0;
-    FILE *fp = NULL;
+    int fd = -1;
     uint8_t *buf = NULL, *bufz = NULL;
     int cylsize = 0, frac = 0;
     size_t orig_gpt_size, free_space, gpt_size;
@@ -967,20 +967,19 @@ main(int argc, char *argv[])
 
     srand(time(NULL) << (getppid() << getpid()));
 
-    if (!(fp = fopen(argv[0], "rb+")))
+    /*
+     * Only a handful of sectors at either end of the image are read or
+     * written, so go straight to them rather than through stdio.
+     */
+    if ((fd = open(argv[0], O_RDWR)) < 0)
         err(1, "could not open file `%s'", argv[0]);
 
-    if (fseeko(fp, (off_t) (16 << 11), SEEK_SET))
-        err(1, "%s: seek error - 0", argv[0]);
-
-    if (fread(&descriptor, sizeof(char), sizeof(descriptor), fp) != sizeof(descriptor))
+    if (pread(fd, &descriptor, sizeof(descriptor), (off_t) (16 << 11))
+        != sizeof(descriptor))
         err(1, "%s: read error - 0", argv[0]);
 
-    if (fseeko(fp, (off_t) 17 * 2048, SEEK_SET))
-        err(1, "%s: seek error - 1", argv[0]);
-
     bufz = buf = calloc(BUFSIZE, sizeof(char));
-    if (fread(buf, sizeof(char), BUFSIZE, fp) != BUFSIZE)
+    if (pread(fd, buf, BUFSIZE, (off_t) 17 * 2048) != BUFSIZE)
         err(1, "%s", argv[0]);
 
     if (check_banner(buf))
@@ -989,12 +988,9 @@ main(int argc, char *argv[])
     if (mode & VERBOSE)
         printf("catalogue offset: %d\n", catoffset);
 
-    if (fseeko(fp, ((off_t) catoffset) * 2048, SEEK_SET))
-        err(1, "%s: seek error - 2", argv[0]);
-
     buf = bufz;
     memset(buf, 0, BUFSIZE);
-    if (fread(buf, sizeof(char), BUFSIZE, fp) != BUFSIZE)
+    if (pread(fd, buf, BUFSIZE, ((off_t) catoffset) * 2048) != BUFSIZE)
         err(1, "%s", argv[0]);
 
     if (check_catalogue(buf))
@@ -1039,12 +1035,9 @@ main(int argc, char *argv[])
 	}
     }
 
-    if (fseeko(fp, (((off_t) de_lba) * 2048 + 0x40), SEEK_SET))
-        err(1, "%s: seek error - 3", argv[0]);
-
     buf = bufz;
     memset(buf, 0, BUFSIZE);
-    if (fread(buf, sizeof(char), 4, fp) != 4)
+    if (pread(fd, buf, 4, ((off_t) de_lba) * 2048 + 0x40) != 4)
         err(1, "%s", argv[0]);
 
     if (memcmp(buf, "\xFB\xC0\x78\x70", 4))
@@ -1052,7 +1045,7 @@ main(int argc, char *argv[])
                  "signature. Note that isolinux-debug.bin does not support " \
                  "hybrid booting", argv[0]);
 
-    if (stat(argv[0], &isostat))
+    if (fstat(fd, &isostat))
         err(1, "%s", argv[0]);
 
     isosize = lendian_int(descriptor.size) * lendian_short(descriptor.block_size);
@@ -1075,10 +1068,7 @@ main(int argc, char *argv[])
 
     if (!id)
     {
-        if (fseeko(fp, (off_t) 440, SEEK_SET))
-            err(1, "%s: seek error - 4", argv[0]);
-
-	if (fread(&id, 1, 4, fp) != 4)
+	if (pread(fd, &id, 4, (off_t) 440) != 4)
 	    err(1, "%s: read error", argv[0]);
 
         id = lendian_int(id);
@@ -1099,10 +1089,7 @@ main(int argc, char *argv[])
     if (mode & VERBOSE)
         display_mbr(buf, i);
 
-    if (fseeko(fp, (off_t) 0, SEEK_SET))
-        err(1, "%s: seek error - 5", argv[0]);
-
-    if (fwrite(buf, sizeof(char), i, fp) != (size_t)i)
+    if (pwrite(fd, buf, i, (off_t) 0) != i)
         err(1, "%s: write error - 1", argv[0]);
 
     if (efi_lba) {
@@ -1140,10 +1127,7 @@ main(int argc, char *argv[])
 	 */
 	initialise_gpt(buf, 1, (isostat.st_size + padding - 512) / 512, 1);
 
-	if (fseeko(fp, (off_t) 512, SEEK_SET))
-	    err(1, "%s: seek error - 6", argv[0]);
-
-	if (fwrite(buf, sizeof(char), gpt_size, fp) != (size_t)gpt_size)
+	if (pwrite(fd, buf, gpt_size, (off_t) 512) != (ssize_t)gpt_size)
 	    err(1, "%s: write error - 2", argv[0]);
     }
 
@@ -1157,16 +1141,17 @@ main(int argc, char *argv[])
 
 	initialise_apm(buf, APM_OFFSET);
 
-	fseeko(fp, (off_t) APM_OFFSET, SEEK_SET);
-	fwrite(buf, sizeof(char), apm_size, fp);
+	if (pwrite(fd, buf, apm_size, (off_t) APM_OFFSET) != apm_size)
+	    err(1, "%s: write error - 3", argv[0]);
     }
 
+    /*
+     * With nothing buffered there is nothing to flush first, and
+     * syncing here would write out the whole of a freshly built image.
+     */
     if (padding)
     {
-        if (fsync(fileno(fp)))
-            err(1, "%s: could not synchronise", argv[0]);
-
-        if (ftruncate(fileno(fp), isostat.st_size + padding))
+        if (ftruncate(fd, isostat.st_size + padding))
             err(1, "%s: could not add padding bytes", argv[0]);
     }
 
@@ -1186,15 +1171,15 @@ main(int argc, char *argv[])
 	 * end of the image
 	 */
 
-	if (fseeko(fp, (isostat.st_size + padding) - orig_gpt_size, SEEK_SET))
-	    err(1, "%s: seek error - 8", argv[0]);
-
-	if (fwrite(buf, sizeof(char), orig_gpt_size, fp) != orig_gpt_size)
+	if (pwrite(fd, buf, orig_gpt_size,
+		   (isostat.st_size + padding) - orig_gpt_size)
+	    != (ssize_t)orig_gpt_size)
 	    err(1, "%s: write error - 4", argv[0]);
     }
 
     free(buf);
-    fclose(fp);
+    if (close(fd))
+        err(1, "%s: write error", argv[0]);
 
     return 0;
 }
@@ -155,6 +155,14 @@ int main(int argc, char *argv[])
     end = map + (0xa0000 - mapbase);
     while (ptr < end) {
 	if (valid_mbft((const struct mBFT *)ptr, end-ptr)) {
+	    /*
+	     * A sparse image has no flat copy in memory to map, which
+	     * MEMDISK says with a diskbuf of 0.
+	     */
+	    if (!((const struct mBFT *)ptr)->mdi.diskbuf) {
+		fprintf(stderr, "%s: MEMDISK has a sparse image\n", argv[0]);
+		break;
+	    }
 	    output_params((const struct mBFT *)ptr);
 	    err = 0;
 	    break;
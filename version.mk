@@ -0,0 +1,6 @@
+VERSION := 6.04
+VERSION_STR := "6.04"
+VERSION_MAJOR := 6
+VERSION_MINOR := 4
+YEAR := 2015
+YEAR_STR := "2015"
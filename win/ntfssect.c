@@ -89,6 +89,77 @@ DWORD M_NTFSSECT_API NtfsSectGetFileVcnExtent(
     return rc;
   }
 
+DWORD M_NTFSSECT_API NtfsSectGetFileExtents(
+    HANDLE File,
+    LARGE_INTEGER * Vcn,
+    S_NTFSSECT_EXTENT * Extents,
+    DWORD * Count
+  ) {
+    BOOL bad, ok;
+    DWORD output_size, rc, i, n;
+    STARTING_VCN_INPUT_BUFFER input;
+    union {
+        RETRIEVAL_POINTERS_BUFFER rpb;
+        BYTE bytes[M_NTFSSECT_BATCH_BYTES];
+      } output;
+    LARGE_INTEGER vcn;
+
+    bad = (
+        File == INVALID_HANDLE_VALUE ||
+        !Vcn ||
+        Vcn->QuadPart < 0 ||
+        !Extents ||
+        !Count ||
+        !*Count
+      );
+    if (bad)
+      return ERROR_INVALID_PARAMETER;
+
+    input.StartingVcn = *Vcn;
+    ok = DeviceIoControl(
+        File,
+        FSCTL_GET_RETRIEVAL_POINTERS,
+        &input,
+        sizeof input,
+        &output,
+        sizeof output,
+        &output_size,
+        NULL
+      );
+    rc = ok ? NO_ERROR : GetLastError();
+    switch (rc) {
+        case NO_ERROR:
+        case ERROR_MORE_DATA:
+          break;
+
+        case ERROR_HANDLE_EOF:
+          return rc;
+
+        default:
+          M_ERR("NtfsSectGetFileExtents(): Unknown status!");
+          return rc;
+      }
+
+    /* Hand out as many as the caller has room for */
+    n = output.rpb.ExtentCount;
+    if (n > *Count)
+      n = *Count;
+    if (!n)
+      return ERROR_HANDLE_EOF;
+
+    vcn = output.rpb.StartingVcn;
+    for (i = 0; i < n; ++i) {
+        Extents[i].FirstVcn = vcn;
+        Extents[i].NextVcn = output.rpb.Extents[i].NextVcn;
+        Extents[i].FirstLcn = output.rpb.Extents[i].Lcn;
+        vcn = Extents[i].NextVcn;
+      }
+
+    *Count = n;
+    *Vcn = vcn;
+    return ERROR_SUCCESS;
+  }
+
 /* Internal use only */
 static DWORD NtfsSectGetVolumeHandle(
     CHAR * VolumeName,
@@ -24,6 +24,9 @@
 #define M_NTFSSECT_H_
 #define M_NTFSSECT_API
 
+/* Retrieval pointers fetched per query, in bytes */
+#define M_NTFSSECT_BATCH_BYTES 16384
+
 /*** Object types */
 
 /* An "extent;" a contiguous range of file data */
@@ -65,6 +68,24 @@ DWORD M_NTFSSECT_API NtfsSectGetFileVcnExtent(
     S_NTFSSECT_EXTENT * Extent
   );
 
+/**
+ * Fetch the extents from a particular VCN on, as many as fit in
+ * *Count, with a single query.  *Count is set to the number fetched
+ * and *Vcn moves past them; ERROR_HANDLE_EOF means there are no more
+ *
+ * @v File
+ * @v Vcn
+ * @v Extents
+ * @v Count
+ * @ret DWORD
+ */
+DWORD M_NTFSSECT_API NtfsSectGetFileExtents(
+    HANDLE File,
+    LARGE_INTEGER * Vcn,
+    S_NTFSSECT_EXTENT * Extents,
+    DWORD * Count
+  );
+
 /**
  * Populate a volume info object
  *
@@ -19,6 +19,8 @@
 
 #include <windows.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <ctype.h>
 #include <getopt.h>
 
@@ -287,6 +289,24 @@ static void move_file(char *pathname, char *filename)
     }
 }
 
+/*
+ * Append LEN sectors at LBA to the map, merging them into the last
+ * extent if they follow on from it
+ */
+static void add_extent(struct sector_extent *ext, int *nextents,
+		       sector_t lba, uint32_t len)
+{
+    struct sector_extent *last = *nextents ? &ext[*nextents - 1] : NULL;
+
+    if (last && last->lba + last->len == lba) {
+	last->len += len;
+    } else {
+	ext[*nextents].lba = lba;
+	ext[*nextents].len = len;
+	(*nextents)++;
+    }
+}
+
 int main(int argc, char *argv[])
 {
     HANDLE f_handle, d_handle;
@@ -303,8 +323,11 @@ int main(int argc, char *argv[])
     static char ldlinuxc32_name[] = "?:\\ldlinux.c32";
     const char *errmsg;
     struct libfat_filesystem *fs;
-    libfat_sector_t s, *secp;
-    libfat_sector_t *sectors;
+    libfat_sector_t s;
+    struct sector_extent *extents;
+    int nextents, modbytes;
+    char *ldlinux_buf;
+    DWORD ldlinux_len;
     int ldlinux_sectors;
     uint32_t ldlinux_cluster;
     int nsectors;
@@ -415,19 +438,23 @@ int main(int argc, char *argv[])
 	exit(1);
     }
 
-    /* Write ldlinux.sys file */
-    if (!WriteFile(f_handle, (const char _force *)syslinux_ldlinux,
-		   syslinux_ldlinux_len, &bytes_written, NULL) ||
-	bytes_written != syslinux_ldlinux_len) {
-	error("Could not write ldlinux.sys");
+    /* Write ldlinux.sys file, with the ADV, in one go */
+    ldlinux_len = syslinux_ldlinux_len + 2 * ADV_SIZE;
+    ldlinux_buf = malloc(ldlinux_len);
+    if (!ldlinux_buf) {
+	error("Could not allocate memory for ldlinux.sys");
 	exit(1);
     }
-    if (!WriteFile(f_handle, syslinux_adv, 2 * ADV_SIZE,
+    memcpy(ldlinux_buf, (const char _force *)syslinux_ldlinux,
+	   syslinux_ldlinux_len);
+    memcpy(ldlinux_buf + syslinux_ldlinux_len, syslinux_adv, 2 * ADV_SIZE);
+    if (!WriteFile(f_handle, ldlinux_buf, ldlinux_len,
 		   &bytes_written, NULL) ||
-	bytes_written != 2 * ADV_SIZE) {
-	error("Could not write ADV to ldlinux.sys");
+	bytes_written != ldlinux_len) {
+	error("Could not write ldlinux.sys");
 	exit(1);
     }
+    free(ldlinux_buf);
 
     /* Now flush the media */
     if (!FlushFileBuffers(f_handle)) {
@@ -435,49 +462,56 @@ int main(int argc, char *argv[])
 	exit(1);
     }
 
-    /* Map the file (is there a better way to do this?) */
-    ldlinux_sectors = (syslinux_ldlinux_len + 2 * ADV_SIZE + SECTOR_SIZE - 1)
-	>> SECTOR_SHIFT;
-    sectors = calloc(ldlinux_sectors, sizeof *sectors);
+    /* Map the file, a run of contiguous sectors at a time */
+    ldlinux_sectors = (ldlinux_len + SECTOR_SIZE - 1) >> SECTOR_SHIFT;
+    extents = calloc(ldlinux_sectors, sizeof *extents);
+    if (!extents) {
+	error("Could not allocate memory for the ldlinux.sys map");
+	exit(1);
+    }
+    nextents = 0;
+    nsectors = 0;
     if (fs_type == NTFS) {
-	DWORD err;
+	DWORD err, i, count;
 	S_NTFSSECT_VOLINFO vol_info;
-	LARGE_INTEGER vcn, lba, len;
-	S_NTFSSECT_EXTENT extent;
+	LARGE_INTEGER vcn, lba;
+	S_NTFSSECT_EXTENT batch[64];
+	uint32_t len;
 
 	err = NtfsSectGetVolumeInfo(drive_name + 4, &vol_info);
 	if (err != ERROR_SUCCESS) {
 	    error("Could not fetch NTFS volume info");
 	    exit(1);
 	}
-	secp = sectors;
-	nsectors = 0;
-	for (vcn.QuadPart = 0;
-	     NtfsSectGetFileVcnExtent(f_handle, &vcn, &extent) == ERROR_SUCCESS;
-	     vcn = extent.NextVcn) {
-	    err = NtfsSectLcnToLba(&vol_info, &extent.FirstLcn, &lba);
-	    if (err != ERROR_SUCCESS) {
-		error("Could not translate LDLINUX.SYS LCN to disk LBA");
-		exit(1);
-	    }
-	    lba.QuadPart -= vol_info.PartitionLba.QuadPart;
-	    len.QuadPart = ((extent.NextVcn.QuadPart -
-			     extent.FirstVcn.QuadPart) *
-			    vol_info.SectorsPerCluster);
-	    while (len.QuadPart-- && nsectors < ldlinux_sectors) {
-		*secp++ = lba.QuadPart++;
-		nsectors++;
+	vcn.QuadPart = 0;
+	while (nsectors < ldlinux_sectors) {
+	    count = sizeof batch / sizeof batch[0];
+	    if (NtfsSectGetFileExtents(f_handle, &vcn, batch, &count) !=
+		ERROR_SUCCESS)
+		break;
+	    for (i = 0; i < count && nsectors < ldlinux_sectors; i++) {
+		err = NtfsSectLcnToLba(&vol_info, &batch[i].FirstLcn, &lba);
+		if (err != ERROR_SUCCESS) {
+		    error("Could not translate LDLINUX.SYS LCN to disk LBA");
+		    exit(1);
+		}
+		lba.QuadPart -= vol_info.PartitionLba.QuadPart;
+		len = (batch[i].NextVcn.QuadPart - batch[i].FirstVcn.QuadPart) *
+		    vol_info.SectorsPerCluster;
+		if (len > (uint32_t)(ldlinux_sectors - nsectors))
+		    len = ldlinux_sectors - nsectors;
+		add_extent(extents, &nextents, lba.QuadPart, len);
+		nsectors += len;
 	    }
 	}
+	CloseHandle(vol_info.Handle);
 	goto map_done;
     }
     fs = libfat_open(libfat_readfile, (intptr_t) d_handle);
     ldlinux_cluster = libfat_searchdir(fs, 0, "LDLINUX SYS", NULL);
-    secp = sectors;
-    nsectors = 0;
     s = libfat_clustertosector(fs, ldlinux_cluster);
     while (s && nsectors < ldlinux_sectors) {
-	*secp++ = s;
+	add_extent(extents, &nextents, s, 1);
 	nsectors++;
 	s = libfat_nextsector(fs, s);
     }
@@ -487,15 +521,21 @@ map_done:
     /*
      * Patch ldlinux.sys and the boot sector
      */
-    syslinux_patch(sectors, nsectors, opt.stupid_mode, opt.raid_mode, opt.directory, NULL);
+    modbytes = syslinux_patch_extents(extents, nextents, opt.stupid_mode,
+				      opt.raid_mode, opt.directory, NULL);
+    free(extents);
+    if (modbytes < 0) {
+	fprintf(stderr, "Could not map ldlinux.sys\n");
+	exit(1);
+    }
 
     /*
-     * Rewrite the file
+     * Rewrite the part of the file that was patched
      */
     if (SetFilePointer(f_handle, 0, NULL, FILE_BEGIN) != 0 ||
-	!WriteFile(f_handle, syslinux_ldlinux, syslinux_ldlinux_len,
+	!WriteFile(f_handle, syslinux_ldlinux, modbytes,
 		   &bytes_written, NULL)
-	|| bytes_written != syslinux_ldlinux_len) {
+	|| bytes_written != (DWORD)modbytes) {
 	error("Could not write ldlinux.sys");
 	exit(1);
     }